@@ -30,6 +30,9 @@
 
 /* System includes */
 #include <math.h>
+#include <malloc.h>
+#include <alloca.h>
+#include <stdarg.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,13 +40,24 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include <linux/ptp_clock.h>
 
+/* Uncertainty model shared with the kernel module (ahead of the userspace
+   definitions in qot_types.h, as in the emulation) */
+#include "../../qot_uncertainty.h"
+
 /* Header for function definitions */
 #include "qot.h"
 
+/* Bulk projection of timestamps */
+#include "../../qot_math.h"
+
 #ifdef PARAVIRT_GUEST
 /* Header for guest to host virtserial-based communication for a PV QEMU-KVM guest */
 #include "../../virt/qot_virtguest.h"
@@ -53,14 +67,64 @@
 
 #define DEBUG 1
 
+/* SCHED_DEADLINE is not exposed by every libc */
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+#ifndef SYS_sched_setattr
+#define SYS_sched_setattr __NR_sched_setattr
+#endif
+
+/* Periods between checks of the discipline for drift */
+#define QOT_DL_REALIGN_PERIODS 16
+/* Frequency drift (ppb) which forces the reservation to be re-issued */
+#define QOT_DL_REALIGN_PPB     1000
+
+/* Kernel sched_attr layout for sched_setattr(2) */
+struct qot_sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t  sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+/* SCHED_DEADLINE reservation state */
+typedef struct timeline_dl {
+    int enabled;                          /* Reservation installed                    */
+    int activated;                        /* A job has been released                  */
+    uint64_t runtime_ns;                  /* Timeline runtime per period              */
+    uint64_t deadline_ns;                 /* Timeline relative deadline               */
+    int64_t mult;                         /* Discipline ppb used for the reservation  */
+    uint32_t periods;                     /* Periods since the last drift check       */
+    timepoint_t activation;               /* Timeline release time of the current job */
+    qot_deadline_stats_t stats;           /* Deadline-miss accounting                 */
+} timeline_dl_t;
+
+/* Event callbacks and dispatch counters */
+typedef struct timeline_events {
+    int registered;                       /* Listed with the event dispatcher         */
+    qot_callback_t callbacks[QOT_EVENT_NUM_TYPES];
+    qot_event_batch_callback_t batch_callbacks[QOT_EVENT_NUM_TYPES];
+    qot_event_stats_t stats;              /* Per-type throughput and depth counters   */
+} timeline_events_t;
+
 /* Timeline implementation */
 typedef struct timeline {
     qot_timeline_t info;                  /* Basic timeline information               */
     qot_binding_t binding;                /* Basic binding info                       */
     int fd;                               /* File descriptor to /dev/timelineX ioctl  */
-    int qotusr_fd;                        /* File descriptor to /dev/qotusr ioctl     */
+    int qotusr_fd;                        /* Shared /dev/qotusr of the process        */
+    int event_fd;                         /* Own /dev/qotusr for events, or -1        */
     int clock_fd;                         /* File Descriptor to /dev/ptpY             */
-    qot_callback_t event_callback;        /* Event Callback Function                  */
+    int bound;                            /* Handles validated by a successful bind   */
+    int period_woken;                     /* last_wakeup holds a periodic wakeup      */
+    utimepoint_t last_wakeup;             /* Timeline time of the last periodic wake  */
+    timeline_events_t events;             /* Event callbacks and counters             */
+    timeline_dl_t dl;                     /* SCHED_DEADLINE reservation               */
     #ifdef PARAVIRT_GUEST
     qot_timeline_t virt_info;             /* Virtual (host) timeline information      */
     int pci_dataregion;                   /* PCI IVSHMEM data region                  */
@@ -68,6 +132,179 @@ typedef struct timeline {
     #endif
 } timeline_t;
 
+/* Stop dispatching the events of a timeline (see EVENT DISPATCH) */
+static void timeline_dispatch_release(timeline_t *timeline);
+
+// REAL-TIME PROFILE /////////////////////////////////////////////////////////////
+
+/* Stack touched by default when the profile is enabled */
+#define QOT_RT_STACK_PREFAULT (64 * 1024)
+/* Log ring slots (a power of two) and the longest message kept */
+#define QOT_RT_LOG_ENTRIES 256
+#define QOT_RT_LOG_LEN     160
+
+/* One log message; seq hands the slot between the producers and the drain */
+typedef struct qot_rt_log_slot {
+    uint64_t seq;                         /* Ring position this slot is ready for     */
+    uint32_t len;                         /* Message length without the terminator    */
+    char msg[QOT_RT_LOG_LEN];             /* Formatted message                        */
+} qot_rt_log_slot_t;
+
+/* Process-wide real-time profile state (static, so it is locked with the image) */
+typedef struct qot_rt_profile {
+    int enabled;                          /* Profile enabled                          */
+    int pool_used[QOT_RT_MAX_TIMELINES];  /* Pool slots handed out                    */
+    timeline_t pool[QOT_RT_MAX_TIMELINES];
+    uint64_t log_head;                    /* Next ring position claimed by a producer */
+    uint64_t log_tail;                    /* Next ring position read by the drain     */
+    uint64_t log_dropped;                 /* Messages lost to a full ring             */
+    qot_rt_log_slot_t log[QOT_RT_LOG_ENTRIES];
+} qot_rt_profile_t;
+
+static qot_rt_profile_t rt_profile;
+/* Serializes drains (never taken by the control loop) */
+static pthread_mutex_t rt_log_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int qot_rt_profile_enabled(void)
+{
+    return __atomic_load_n(&rt_profile.enabled, __ATOMIC_ACQUIRE);
+}
+
+/* Format a message into the next free ring slot, dropping it if the ring is full */
+static void qot_rt_log_push(const char *fmt, va_list ap)
+{
+    qot_rt_log_slot_t *slot;
+    uint64_t pos, seq;
+    int len;
+
+    pos = __atomic_load_n(&rt_profile.log_head, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        slot = &rt_profile.log[pos & (QOT_RT_LOG_ENTRIES - 1)];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos)
+        {
+            if (__atomic_compare_exchange_n(&rt_profile.log_head, &pos, pos + 1, 1,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if ((int64_t) (seq - pos) < 0)
+        {
+            __atomic_fetch_add(&rt_profile.log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            pos = __atomic_load_n(&rt_profile.log_head, __ATOMIC_RELAXED);
+        }
+    }
+    len = vsnprintf(slot->msg, QOT_RT_LOG_LEN, fmt, ap);
+    if (len < 0)
+        len = 0;
+    slot->len = (len < QOT_RT_LOG_LEN) ? len : QOT_RT_LOG_LEN - 1;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/* Library logging: stdio normally, the log ring under the real-time profile */
+static void qot_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void qot_log(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    if (qot_rt_profile_enabled())
+        qot_rt_log_push(fmt, ap);
+    else
+        vprintf(fmt, ap);
+    va_end(ap);
+}
+
+size_t qot_rt_log_drain(int fd)
+{
+    qot_rt_log_slot_t *slot;
+    uint64_t pos;
+    size_t count = 0;
+
+    pthread_mutex_lock(&rt_log_drain_lock);
+    for (;;)
+    {
+        pos = rt_profile.log_tail;
+        slot = &rt_profile.log[pos & (QOT_RT_LOG_ENTRIES - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+            break;
+        if (write(fd, slot->msg, slot->len) < 0 && errno != EAGAIN)
+            fd = -1; // Keep draining so that producers do not stall on a dead sink
+        __atomic_store_n(&slot->seq, pos + QOT_RT_LOG_ENTRIES, __ATOMIC_RELEASE);
+        rt_profile.log_tail = pos + 1;
+        count++;
+    }
+    pthread_mutex_unlock(&rt_log_drain_lock);
+    return count;
+}
+
+uint64_t qot_rt_log_dropped(void)
+{
+    return __atomic_load_n(&rt_profile.log_dropped, __ATOMIC_RELAXED);
+}
+
+/* Touch the stack of the calling thread so the control loop never faults on it */
+static void __attribute__((noinline)) qot_rt_prefault_stack(size_t size)
+{
+    volatile char *stack = (volatile char *) alloca(size);
+    size_t i;
+    for (i = 0; i < size; i += 4096)
+        stack[i] = 0;
+}
+
+qot_return_t qot_rt_profile_enable(const qot_rt_config_t *config)
+{
+    qot_rt_config_t defaults = { QOT_RT_STACK_PREFAULT, 0, 1 };
+    size_t stack;
+    char *heap;
+    int i;
+
+    if (!config)
+        config = &defaults;
+    stack = config->stack_prefault ? config->stack_prefault : QOT_RT_STACK_PREFAULT;
+
+    // Stacks of other control threads are prefaulted by enabling again from them
+    if (qot_rt_profile_enabled())
+    {
+        qot_rt_prefault_stack(stack);
+        return QOT_RETURN_TYPE_OK;
+    }
+
+    // Freed memory stays in the heap instead of going back to the kernel
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    if (config->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+    {
+        qot_log("mlockall failed %d\n", errno);
+        return QOT_RETURN_TYPE_ERR;
+    }
+    if (config->heap_reserve)
+    {
+        heap = (char *) malloc(config->heap_reserve);
+        if (!heap)
+            return QOT_RETURN_TYPE_ERR;
+        memset(heap, 0, config->heap_reserve);
+        free(heap);
+    }
+    qot_rt_prefault_stack(stack);
+
+    // Every slot is free for the first lap of the log ring
+    for (i = 0; i < QOT_RT_LOG_ENTRIES; i++)
+        rt_profile.log[i].seq = i;
+    __atomic_store_n(&rt_profile.enabled, 1, __ATOMIC_RELEASE);
+    return QOT_RETURN_TYPE_OK;
+}
+
+/* Handles are validated once at bind; a descriptor closed behind the API's
+   back makes the syscall which uses it fail instead */
+static inline int timeline_bound(timeline_t *timeline)
+{
+    return timeline && timeline->bound;
+}
+
 /* Is the given timeline a valid one */
 qot_return_t timeline_check_fd(timeline_t *timeline) {
     if (fcntl(timeline->fd, F_GETFD)==-1)
@@ -75,24 +312,123 @@ qot_return_t timeline_check_fd(timeline_t *timeline) {
     return QOT_RETURN_TYPE_OK;
 }
 
+// PROCESS CONTEXT ///////////////////////////////////////////////////////////////
+
+/* The QoT core keeps one event queue per /dev/qotusr connection. Control calls
+   of every timeline in the process share a single connection, and a timeline
+   opens one of its own only when it starts using events */
+typedef struct qot_context {
+    pthread_mutex_t lock;
+    int usr_fd;                           /* Shared /dev/qotusr descriptor            */
+    int refs;                             /* Bound timelines using the descriptor     */
+    int drain;                            /* The core cannot mute the connection      */
+} qot_context_t;
+
+static qot_context_t context = { PTHREAD_MUTEX_INITIALIZER, -1, 0, 0 };
+
+/* Take a reference on the shared connection, opening it with the first bind */
+static int qot_context_get(void)
+{
+    qot_event_t event;
+    int fd;
+
+    pthread_mutex_lock(&context.lock);
+    if (context.refs == 0)
+    {
+        if (DEBUG)
+            qot_log("Opening IOCTL to qot_core\n");
+        context.usr_fd = open("/dev/qotusr", O_RDWR | O_CLOEXEC);
+        if (DEBUG)
+            qot_log("IOCTL to qot_core opened %d\n", context.usr_fd);
+
+        // Nobody reads events on the shared connection, so stop the core from queueing them
+        context.drain = (context.usr_fd >= 0 && ioctl(context.usr_fd, QOTUSR_MUTE_EVENTS) < 0);
+    }
+    else if (context.drain)
+    {
+        // Cores without QOTUSR_MUTE_EVENTS keep queueing, drain them at every bind
+        while (ioctl(context.usr_fd, QOTUSR_GET_NEXT_EVENT, &event) == 0);
+    }
+    fd = context.usr_fd;
+    if (fd >= 0)
+        context.refs++;
+    pthread_mutex_unlock(&context.lock);
+    return fd;
+}
+
+/* Drop a reference, closing the shared connection with the last one */
+static void qot_context_put(void)
+{
+    pthread_mutex_lock(&context.lock);
+    if (context.refs > 0 && --context.refs == 0)
+    {
+        close(context.usr_fd);
+        context.usr_fd = -1;
+    }
+    pthread_mutex_unlock(&context.lock);
+}
+
+/* The connection on which the events of a timeline are queued, opened by the
+   first call that needs it (callbacks, pins, output compare or reads) */
+static int timeline_event_fd(timeline_t *timeline)
+{
+    int fd = __atomic_load_n(&timeline->event_fd, __ATOMIC_ACQUIRE);
+    if (fd >= 0)
+        return fd;
+    pthread_mutex_lock(&context.lock);
+    fd = timeline->event_fd;
+    if (fd < 0)
+    {
+        fd = open("/dev/qotusr", O_RDWR | O_CLOEXEC);
+        if (fd >= 0)
+            __atomic_store_n(&timeline->event_fd, fd, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&context.lock);
+    return fd;
+}
+
 /* Create a Timeline Data Structure */
 timeline_t *timeline_t_create()
 {
     timeline_t *timeline;
-    timeline = (timeline_t*) malloc(sizeof(struct timeline));
+    int i;
+
+    // Under the real-time profile structures come from the preallocated pool
+    if (qot_rt_profile_enabled())
+    {
+        for (i = 0; i < QOT_RT_MAX_TIMELINES; i++)
+        {
+            if (!__atomic_exchange_n(&rt_profile.pool_used[i], 1, __ATOMIC_ACQUIRE))
+            {
+                timeline = &rt_profile.pool[i];
+                memset(timeline, 0, sizeof(struct timeline));
+                timeline->event_fd = -1;
+                return timeline;
+            }
+        }
+        return NULL;
+    }
+    timeline = (timeline_t*) calloc(1, sizeof(struct timeline));
+    if (timeline)
+        timeline->event_fd = -1;
     return timeline;
 }
 
 /* Destroy a Timeline Data Structure */
 void timeline_t_destroy(timeline_t *timeline)
 {
+    if (timeline >= rt_profile.pool && timeline < rt_profile.pool + QOT_RT_MAX_TIMELINES)
+    {
+        __atomic_store_n(&rt_profile.pool_used[timeline - rt_profile.pool], 0, __ATOMIC_RELEASE);
+        return;
+    }
     free(timeline);
 }
 
 /* Bind to a timeline */
 qot_return_t timeline_bind(timeline_t *timeline, const char *uuid, const char *name, timelength_t res, timeinterval_t acc) 
 {
-    char qot_timeline_filename[15];
+    char qot_timeline_filename[32];
     int usr_file;
     char *gl_start;
 
@@ -110,24 +446,20 @@ qot_return_t timeline_bind(timeline_t *timeline, const char *uuid, const char *n
     else
         timeline->info.type = QOT_TIMELINE_LOCAL; // Default to Local
 
-    // Open the QoT Core
-    if (DEBUG) 
-        printf("Opening IOCTL to qot_core\n");
-    usr_file = open("/dev/qotusr", O_RDWR);
-    if (DEBUG)
-        printf("IOCTL to qot_core opened %d\n", usr_file);
-
+    // Use the QoT Core connection shared by the process
+    usr_file = qot_context_get();
     if (usr_file < 0)
     {
-        printf("Error: Invalid file\n");
+        qot_log("Error: Invalid file\n");
         return QOT_RETURN_TYPE_ERR;
     }
 
     timeline->qotusr_fd = usr_file;
+    timeline->event_fd = -1;
     
     // Bind to the timeline
     if (DEBUG) 
-        printf("Binding to timeline %s\n", uuid);
+        qot_log("Binding to timeline %s\n", uuid);
 
     strcpy(timeline->info.name, uuid);  
 
@@ -137,42 +469,49 @@ qot_return_t timeline_bind(timeline_t *timeline, const char *uuid, const char *n
         // If it exists try to get information
         if(ioctl(timeline->qotusr_fd, QOTUSR_GET_TIMELINE_INFO, &timeline->info) < 0)
         {
+            qot_context_put();
             return QOT_RETURN_TYPE_ERR;
         }    
     }
     // Construct the file handle to the posix clock /dev/timelineX
-    sprintf(qot_timeline_filename, "/dev/timeline%d", timeline->info.index);
+    snprintf(qot_timeline_filename, sizeof(qot_timeline_filename), "/dev/timeline%d", timeline->info.index);
 
     // Open the clock
     if (DEBUG) 
-        printf("Opening clock %s\n", qot_timeline_filename);
+        qot_log("Opening clock %s\n", qot_timeline_filename);
     timeline->fd = open(qot_timeline_filename, O_RDWR);
-    if (!timeline->fd)
+    if (timeline->fd < 0)
     {
-        printf("Cant open /dev/timeline%d\n", timeline->info.index);
+        qot_log("Cant open /dev/timeline%d\n", timeline->info.index);
+        qot_context_put();
         return QOT_RETURN_TYPE_ERR;
     }
 
     
     
     if (DEBUG) 
-        printf("Opened clock %s\n", qot_timeline_filename);
+        qot_log("Opened clock %s\n", qot_timeline_filename);
     // Populate Binding fields
     strcpy(timeline->binding.name, name);
     timeline->binding.demand.resolution = res;
     timeline->binding.demand.accuracy = acc;
     TL_FROM_SEC(timeline->binding.period, 0);
     TP_FROM_SEC(timeline->binding.start_offset, 0);
+    memset(&timeline->dl, 0, sizeof(timeline_dl_t));
+    memset(&timeline->events, 0, sizeof(timeline_events_t));
+    timeline->period_woken = 0;
     
     if (DEBUG) 
-        printf("Binding to timeline %s\n", uuid);
+        qot_log("Binding to timeline %s\n", uuid);
     // Bind to the timeline
     if(ioctl(timeline->fd, TIMELINE_BIND_JOIN, &timeline->binding) < 0)
     {
+        close(timeline->fd);
+        qot_context_put();
         return QOT_RETURN_TYPE_ERR;
     }
     if (DEBUG) 
-        printf("Bound to timeline %s\n", uuid);
+        qot_log("Bound to timeline %s\n", uuid);
 
     // Virtualization-specific Guest extensions -> Send TIMELINE_CREATE Message
     #ifdef PARAVIRT_GUEST
@@ -183,11 +522,11 @@ qot_return_t timeline_bind(timeline_t *timeline, const char *uuid, const char *n
     virt_msg.demand = timeline->binding.demand;
     virt_msg.retval = QOT_RETURN_TYPE_ERR;
     if (DEBUG) 
-        printf("Sending timeline metadata to host\n");
+        qot_log("Sending timeline metadata to host\n");
     if(send_message(&virt_msg) == QOT_RETURN_TYPE_ERR)
     {
         if (DEBUG) 
-            printf("Failed to send timeline metadata to host\n");
+            qot_log("Failed to send timeline metadata to host\n");
         return QOT_RETURN_TYPE_ERR;
     }
     else
@@ -195,14 +534,14 @@ qot_return_t timeline_bind(timeline_t *timeline, const char *uuid, const char *n
         // Add error handling -> retry
         timeline->virt_info = virt_msg.info;
         if (DEBUG) 
-            printf("Host replied with %d retval, host timeline id is %d\n",virt_msg.retval, virt_msg.info.index);
+            qot_log("Host replied with %d retval, host timeline id is %d\n",virt_msg.retval, virt_msg.info.index);
     }
     // Setup Memory mapping to read timeline clock parameters (mapping, uncertainty)
     timeline->pci_dataregion = setup_pci_mmio();
     if (timeline->pci_dataregion < 0)
     {
         if (DEBUG) 
-            printf("Failed to open PCI IVSHMEM region\n");
+            qot_log("Failed to open PCI IVSHMEM region\n");
         return QOT_RETURN_TYPE_ERR;
     } 
     // Get pointer to memory region corresponding to timeline clock parameters
@@ -211,7 +550,7 @@ qot_return_t timeline_bind(timeline_t *timeline, const char *uuid, const char *n
     if (timeline->timeline_clock == NULL)
     {
         if (DEBUG) 
-            printf("Failed to get a pointer to PCI IVSHMEM region\n");
+            qot_log("Failed to get a pointer to PCI IVSHMEM region\n");
         return QOT_RETURN_TYPE_ERR;
     } 
     #endif
@@ -222,34 +561,39 @@ qot_return_t timeline_bind(timeline_t *timeline, const char *uuid, const char *n
     // // We can now start polling, because the timeline is setup
     // this->cv.notify_one();
 
+    // The handles are not re-validated by later calls
+    timeline->bound = 1;
     return QOT_RETURN_TYPE_OK;
 }
 
 qot_return_t timeline_unbind(timeline_t *timeline) 
 {
-    if(!timeline)
+    qot_return_t retval = QOT_RETURN_TYPE_OK;
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
+    timeline->bound = 0;
+
+    // Stop dispatching events before the descriptors are closed
+    timeline_dispatch_release(timeline);
 
-    // Unbind from the timeline
+    // Unbind from the timeline (local resources are released regardless)
     if(ioctl(timeline->fd, TIMELINE_BIND_LEAVE, &timeline->binding) < 0)
-    {
-        return QOT_RETURN_TYPE_ERR;
-    }
+        retval = QOT_RETURN_TYPE_ERR;
 
     // Close the timeline file
     if (timeline->fd)
         close(timeline->fd);
 
     // Try to destroy the timeline if possible (will destroy if no other bindings exist)
-    if(ioctl(timeline->qotusr_fd, QOTUSR_DESTROY_TIMELINE, &timeline->info) == 0)
+    if(retval == QOT_RETURN_TYPE_OK && ioctl(timeline->qotusr_fd, QOTUSR_DESTROY_TIMELINE, &timeline->info) == 0)
     {
        if(DEBUG)
-          printf("Timeline %d destroyed\n", timeline->info.index);
+          qot_log("Timeline %d destroyed\n", timeline->info.index);
     }
     else
     {
        if(DEBUG)
-          printf("Timeline %d not destroyed\n", timeline->info.index);
+          qot_log("Timeline %d not destroyed\n", timeline->info.index);
     }
 
     // Virtualization-specific Guest extensions -> Send TIMELINE_DESTROY Message
@@ -261,24 +605,27 @@ qot_return_t timeline_unbind(timeline_t *timeline)
     virt_msg.demand = timeline->binding.demand;
     virt_msg.retval = QOT_RETURN_TYPE_ERR;
     if (DEBUG) 
-        printf("Sending timeline metadata to host\n");
+        qot_log("Sending timeline metadata to host\n");
     if(send_message(&virt_msg) == QOT_RETURN_TYPE_ERR)
     {
         if (DEBUG) 
-            printf("Failed to send timeline metadata to host\n");
-        return QOT_RETURN_TYPE_ERR;
+            qot_log("Failed to send timeline metadata to host\n");
+        retval = QOT_RETURN_TYPE_ERR;
     }
     else
     {
         // Add error handling -> retry
-        printf("Host replied with retval %d\n",virt_msg.retval);
+        qot_log("Host replied with retval %d\n",virt_msg.retval);
     }
     #endif
 
-    if (timeline->qotusr_fd)
-        close(timeline->qotusr_fd);
+    // Release the event connection and the shared one
+    if (timeline->event_fd >= 0)
+        close(timeline->event_fd);
+    timeline->event_fd = -1;
+    qot_context_put();
    
-    return QOT_RETURN_TYPE_OK;
+    return retval;
 }
 
 qot_return_t timeline_get_accuracy(timeline_t *timeline, timeinterval_t *acc) 
@@ -315,10 +662,7 @@ qot_return_t timeline_get_uuid(timeline_t *timeline, char *uuid)
 
 qot_return_t timeline_set_accuracy(timeline_t *timeline, timeinterval_t *acc) 
 {
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
     
     timeline->binding.demand.accuracy = *acc;
@@ -336,17 +680,17 @@ qot_return_t timeline_set_accuracy(timeline_t *timeline, timeinterval_t *acc)
     virt_msg.demand = timeline->binding.demand;
     virt_msg.retval = QOT_RETURN_TYPE_ERR;
     if (DEBUG) 
-        printf("Sending updated timeline metadata to host\n");
+        qot_log("Sending updated timeline metadata to host\n");
     if(send_message(&virt_msg) == QOT_RETURN_TYPE_ERR)
     {
         if (DEBUG) 
-            printf("Failed to send timeline metadata to host\n");
+            qot_log("Failed to send timeline metadata to host\n");
         return QOT_RETURN_TYPE_ERR;
     }
     else
     {
         // Add error handling -> retry
-        printf("Host replied with retval %d\n",virt_msg.retval);
+        qot_log("Host replied with retval %d\n",virt_msg.retval);
     }
     #endif
     *acc = timeline->binding.demand.accuracy;
@@ -355,9 +699,7 @@ qot_return_t timeline_set_accuracy(timeline_t *timeline, timeinterval_t *acc)
 
 qot_return_t timeline_set_resolution(timeline_t *timeline, timelength_t *res) 
 {
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     timeline->binding.demand.resolution = *res;
@@ -375,45 +717,168 @@ qot_return_t timeline_set_resolution(timeline_t *timeline, timelength_t *res)
     virt_msg.demand = timeline->binding.demand;
     virt_msg.retval = QOT_RETURN_TYPE_ERR;
     if (DEBUG) 
-        printf("Sending updated timeline metadata to host\n");
+        qot_log("Sending updated timeline metadata to host\n");
     if(send_message(&virt_msg) == QOT_RETURN_TYPE_ERR)
     {
         if (DEBUG) 
-            printf("Failed to send timeline metadata to host\n");
+            qot_log("Failed to send timeline metadata to host\n");
         return QOT_RETURN_TYPE_ERR;
     }
     else
     {
         // Add error handling -> retry
-        printf("Host replied with retval %d\n",virt_msg.retval);
+        qot_log("Host replied with retval %d\n",virt_msg.retval);
     }
     #endif
     *res = timeline->binding.demand.resolution;
     return QOT_RETURN_TYPE_OK;
 }
 
-qot_return_t timeline_set_schedparams(timeline_t *timeline, timelength_t *period, timepoint_t *start_offset) 
+/* Convert a timeline duration to core nanoseconds under a ppb discipline */
+static u64 timeline_dl_to_core(u64 tl_ns, int64_t mult)
 {
-    if(!timeline)
+    return (u64) floor((double) tl_ns * 1e9 / (1e9 + (double) mult));
+}
+
+/* Install the SCHED_DEADLINE reservation for the calling thread */
+static qot_return_t timeline_dl_apply(timeline_t *timeline, int64_t mult)
+{
+    struct qot_sched_attr attr;
+    u64 period_ns = TL_TO_nSEC(timeline->binding.period);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = timeline_dl_to_core(timeline->dl.runtime_ns, mult);
+    attr.sched_deadline = timeline_dl_to_core(timeline->dl.deadline_ns, mult);
+    attr.sched_period = timeline_dl_to_core(period_ns, mult);
+    if(syscall(SYS_sched_setattr, 0, &attr, 0) < 0)
+    {
+        if (DEBUG)
+            qot_log("sched_setattr failed %d\n", errno);
         return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    }
+    timeline->dl.mult = mult;
+    return QOT_RETURN_TYPE_OK;
+}
+
+/* Account for the job which completed at timeline time now */
+static void timeline_dl_complete(timeline_t *timeline, timepoint_t *now)
+{
+    timelength_t deadline;
+    timepoint_t abs_deadline, completion;
+    s64 now_ns, deadline_ns;
+    if(!timeline->dl.activated)
+        return;
+    TL_FROM_nSEC(deadline, timeline->dl.deadline_ns);
+    abs_deadline = timeline->dl.activation;
+    timepoint_add(&abs_deadline, &deadline);
+    if(timepoint_cmp(now, &abs_deadline) >= 0)
+        return;
+    completion = *now;
+    now_ns = TP_TO_nSEC(completion);
+    deadline_ns = TP_TO_nSEC(abs_deadline);
+    timeline->dl.stats.misses++;
+    if(now_ns - deadline_ns > timeline->dl.stats.max_lateness_ns)
+        timeline->dl.stats.max_lateness_ns = now_ns - deadline_ns;
+}
+
+/* Record a release and re-align the reservation if the discipline drifted */
+static void timeline_dl_release(timeline_t *timeline, timepoint_t *release)
+{
+    tl_translation_t params;
+    timeline->dl.activation = *release;
+    timeline->dl.activated = 1;
+    timeline->dl.stats.activations++;
+    if(++timeline->dl.periods < QOT_DL_REALIGN_PERIODS)
+        return;
+    timeline->dl.periods = 0;
+    if(ioctl(timeline->fd, TIMELINE_GET_PARAMETERS, &params) < 0)
+        return;
+    if(llabs(params.mult - timeline->dl.mult) < QOT_DL_REALIGN_PPB)
+        return;
+    if(timeline_dl_apply(timeline, params.mult) == QOT_RETURN_TYPE_OK)
+        timeline->dl.stats.realignments++;
+}
+
+qot_return_t timeline_set_schedparams(timeline_t *timeline, timelength_t *period, timepoint_t *start_offset) 
+{
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     timeline->binding.start_offset = *start_offset;
     timeline->binding.period = *period;
+    timeline->period_woken = 0;
     // Update the binding
     if(ioctl(timeline->fd, TIMELINE_BIND_UPDATE, &timeline->binding) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
+    // Keep an installed reservation in step with the new period
+    if(timeline->dl.enabled)
+    {
+        timeline->dl.activated = 0;
+        return timeline_dl_apply(timeline, timeline->dl.mult);
+    }
     return QOT_RETURN_TYPE_OK;
 }
 
-qot_return_t timeline_getcoretime(timeline_t *timeline, utimepoint_t *core_now)
+qot_return_t timeline_set_deadline_reservation(timeline_t *timeline, timelength_t *runtime,
+    timelength_t *deadline, int enable)
 {
-    if(!timeline)
+    struct qot_sched_attr attr;
+    tl_translation_t params;
+    u64 period_ns;
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+
+    if(!enable)
+    {
+        // Revert the calling thread to the default policy
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.sched_policy = SCHED_OTHER;
+        if(syscall(SYS_sched_setattr, 0, &attr, 0) < 0)
+            return QOT_RETURN_TYPE_ERR;
+        timeline->dl.enabled = 0;
+        return QOT_RETURN_TYPE_OK;
+    }
+
+    if(!runtime || !deadline)
+        return QOT_RETURN_TYPE_ERR;
+    // The reservation needs periodic scheduling parameters
+    period_ns = TL_TO_nSEC(timeline->binding.period);
+    if(period_ns == 0)
+        return QOT_RETURN_TYPE_ERR;
+    timeline->dl.runtime_ns = TL_TO_nSEC((*runtime));
+    timeline->dl.deadline_ns = TL_TO_nSEC((*deadline));
+    if(timeline->dl.runtime_ns == 0 || timeline->dl.runtime_ns > timeline->dl.deadline_ns
+        || timeline->dl.deadline_ns > period_ns)
+        return QOT_RETURN_TYPE_ERR;
+
+    // Scale the reservation by the current discipline
+    if(ioctl(timeline->fd, TIMELINE_GET_PARAMETERS, &params) < 0)
+        return QOT_RETURN_TYPE_ERR;
+    if(timeline_dl_apply(timeline, params.mult))
+        return QOT_RETURN_TYPE_ERR;
+    timeline->dl.enabled = 1;
+    timeline->dl.activated = 0;
+    timeline->dl.periods = 0;
+    memset(&timeline->dl.stats, 0, sizeof(qot_deadline_stats_t));
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t timeline_get_deadline_stats(timeline_t *timeline, qot_deadline_stats_t *stats)
+{
+    if(!timeline || !stats)
+        return QOT_RETURN_TYPE_ERR;
+    *stats = timeline->dl.stats;
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t timeline_getcoretime(timeline_t *timeline, utimepoint_t *core_now)
+{
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     // Get the core time
@@ -424,6 +889,117 @@ qot_return_t timeline_getcoretime(timeline_t *timeline, utimepoint_t *core_now)
     return QOT_RETURN_TYPE_OK;
 }
 
+// USERSPACE CORE CLOCK //////////////////////////////////////////////////////////
+
+/* Where qot_x86 exports its core clock calibration */
+#define QOT_X86_PARAMETERS "/sys/module/qot_x86/parameters/"
+
+/* How the core clock is read, found once per process */
+typedef struct qot_core_reader {
+    pthread_once_t once;
+    qot_core_read_t mode;
+    u64 tsc_base;                         /* TSC value at calibration                 */
+    u64 tsc_ns_base;                      /* Core time (ns) at calibration            */
+    u32 tsc_mult;                         /* TSC to nanosecond multiplier             */
+    u32 tsc_shift;                        /* TSC to nanosecond shift                  */
+} qot_core_reader_t;
+
+static qot_core_reader_t core_reader = {
+    .once = PTHREAD_ONCE_INIT,
+    .mode = QOT_CORE_READ_IOCTL,
+};
+
+/* Read one module parameter, 0 on success */
+static int qot_core_param(const char *name, char *value, size_t len)
+{
+    char path[128];
+    ssize_t n;
+    int fd;
+    snprintf(path, sizeof(path), QOT_X86_PARAMETERS "%s", name);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    n = read(fd, value, len - 1);
+    close(fd);
+    if (n <= 0)
+        return -1;
+    value[n] = '\0';
+    return 0;
+}
+
+static void qot_core_reader_init(void)
+{
+    char value[32];
+
+    // Without qot_x86 (or in a guest, where it reads the pvclock) only the
+    // timeline ioctl is known to return core time
+    #ifndef PARAVIRT_GUEST
+    if (qot_core_param("tsc_enabled", value, sizeof(value)))
+        return;
+    if (value[0] != 'Y' && value[0] != '1')
+    {
+        core_reader.mode = QOT_CORE_READ_REALTIME;
+        return;
+    }
+    #if defined(__x86_64__) || defined(__i386__)
+    if (qot_core_param("tsc_mult", value, sizeof(value)))
+        return;
+    core_reader.tsc_mult = (u32) strtoul(value, NULL, 10);
+    if (qot_core_param("tsc_shift", value, sizeof(value)))
+        return;
+    core_reader.tsc_shift = (u32) strtoul(value, NULL, 10);
+    if (qot_core_param("tsc_base", value, sizeof(value)))
+        return;
+    core_reader.tsc_base = strtoull(value, NULL, 10);
+    if (qot_core_param("tsc_ns_base", value, sizeof(value)))
+        return;
+    core_reader.tsc_ns_base = strtoull(value, NULL, 10);
+    if (core_reader.tsc_mult && core_reader.tsc_shift < 32)
+        core_reader.mode = QOT_CORE_READ_TSC;
+    #endif
+    #endif
+}
+
+qot_core_read_t qot_core_read_mode(void)
+{
+    pthread_once(&core_reader.once, qot_core_reader_init);
+    return core_reader.mode;
+}
+
+qot_return_t timeline_getcoretime_ns(timeline_t *timeline, s64 *core_ns)
+{
+    utimepoint_t core_now;
+    struct timespec ts;
+    #if defined(__x86_64__) || defined(__i386__)
+    u64 delta;
+    #endif
+
+    if(!core_ns)
+        return QOT_RETURN_TYPE_ERR;
+    switch (qot_core_read_mode())
+    {
+    #if defined(__x86_64__) || defined(__i386__)
+    case QOT_CORE_READ_TSC:
+        // The same conversion as qot_x86, with the 128-bit product split in two
+        __builtin_ia32_lfence();
+        delta = __builtin_ia32_rdtsc() - core_reader.tsc_base;
+        *core_ns = (s64) (core_reader.tsc_ns_base
+            + (delta >> core_reader.tsc_shift) * core_reader.tsc_mult
+            + (((delta & ((1ULL << core_reader.tsc_shift) - 1)) * core_reader.tsc_mult) >> core_reader.tsc_shift));
+        return QOT_RETURN_TYPE_OK;
+    #endif
+    case QOT_CORE_READ_REALTIME:
+        clock_gettime(CLOCK_REALTIME, &ts);
+        *core_ns = (s64) ts.tv_sec * (s64) nSEC_PER_SEC + ts.tv_nsec;
+        return QOT_RETURN_TYPE_OK;
+    default:
+        if(timeline_getcoretime(timeline, &core_now))
+            return QOT_RETURN_TYPE_ERR;
+        *core_ns = (s64) TP_TO_nSEC(core_now.estimate);
+        return QOT_RETURN_TYPE_OK;
+    }
+}
+
 #ifdef PARAVIRT_GUEST
 // BASIC TIME PROJECTION FUNCTIONS /////////////////////////////////////////////
 qot_return_t qot_loc2rem(timeline_t *timeline, utimepoint_t *est, int period)
@@ -476,8 +1052,8 @@ qot_return_t timeline_getvtime(timeline_t *timeline, utimepoint_t *est)
     timeline_getcoretime(timeline, est);
     if (DEBUG)
     {
-    	printf("reading time using ivshmem\n");
-    	printf("Timeline Parameters are mult:%lld last:%lld\n", 
+    	qot_log("reading time using ivshmem\n");
+    	qot_log("Timeline Parameters are mult:%lld last:%lld\n", 
     		timeline->timeline_clock->translation.mult, 
     		timeline->timeline_clock->translation.last);
     }
@@ -488,9 +1064,7 @@ qot_return_t timeline_getvtime(timeline_t *timeline, utimepoint_t *est)
 
 qot_return_t timeline_gettime(timeline_t *timeline, utimepoint_t *est) 
 {    
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     #ifdef PARAVIRT_GUEST
@@ -507,12 +1081,64 @@ qot_return_t timeline_gettime(timeline_t *timeline, utimepoint_t *est)
     return QOT_RETURN_TYPE_OK;
 }
 
+qot_return_t timeline_now(timeline_t *timeline, timewindow_t *now)
+{
+    utimepoint_t est;
+    if(timeline_gettime(timeline, &est))
+        return QOT_RETURN_TYPE_ERR;
+    utimepoint_to_window(now, &est);
+    return QOT_RETURN_TYPE_OK;
+}
+
+int timeline_after(timeline_t *timeline, timepoint_t *tp)
+{
+    timewindow_t now;
+    if(timeline_now(timeline, &now))
+        return -1;
+    return timepoint_cmp(&now.earliest, tp) < 0;
+}
+
+int timeline_before(timeline_t *timeline, timepoint_t *tp)
+{
+    timewindow_t now;
+    if(timeline_now(timeline, &now))
+        return -1;
+    return timepoint_cmp(&now.latest, tp) > 0;
+}
+
+qot_return_t timeline_commit_wait(timeline_t *timeline, timepoint_t *tp, timewindow_t *now)
+{
+    utimepoint_t est, wake;
+    timewindow_t window;
+    timelength_t step;
+    TL_FROM_nSEC(step, 1);
+    for (;;)
+    {
+        if(timeline_gettime(timeline, &est))
+            return QOT_RETURN_TYPE_ERR;
+        utimepoint_to_window(&window, &est);
+        if(timepoint_cmp(&window.earliest, tp) < 0)
+            break;
+
+        // The lower bound passes tp once the estimate is 'below' beyond it.
+        // The bound keeps widening while the clock is not resynchronized, so
+        // wake at the first instant it could have passed and check again.
+        memset(&wake, 0, sizeof(wake));
+        wake.estimate = *tp;
+        timepoint_add(&wake.estimate, &est.interval.below);
+        timepoint_add(&wake.estimate, &step);
+        if(timeline_waituntil(timeline, &wake))
+            return QOT_RETURN_TYPE_ERR;
+    }
+    if(now)
+        *now = window;
+    return QOT_RETURN_TYPE_OK;
+}
+
 qot_return_t timeline_enable_output_compare(timeline_t *timeline,
     qot_perout_t *request) {
 
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
     if(request->duty_cycle >= 100)
         return QOT_RETURN_TYPE_ERR;
@@ -521,7 +1147,7 @@ qot_return_t timeline_enable_output_compare(timeline_t *timeline,
 
     request->timeline = timeline->info;
     // Blocking wait on remote timeline time
-    if(ioctl(timeline->qotusr_fd, QOTUSR_OUTPUT_COMPARE_ENABLE, request) < 0)
+    if(ioctl(timeline_event_fd(timeline), QOTUSR_OUTPUT_COMPARE_ENABLE, request) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
@@ -532,14 +1158,12 @@ qot_return_t timeline_enable_output_compare(timeline_t *timeline,
 qot_return_t timeline_disable_output_compare(timeline_t *timeline,
     qot_perout_t *request) {
 
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     request->timeline = timeline->info;
     // Blocking wait on remote timeline time
-    if(ioctl(timeline->qotusr_fd, QOTUSR_OUTPUT_COMPARE_DISABLE, request) < 0)
+    if(ioctl(timeline_event_fd(timeline), QOTUSR_OUTPUT_COMPARE_DISABLE, request) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
@@ -549,142 +1173,373 @@ qot_return_t timeline_disable_output_compare(timeline_t *timeline,
 
 qot_return_t timeline_config_pin_timestamp(timeline_t *timeline, qot_extts_t *request, int enable) 
 {
-    qot_clock_t core_clock;
-    // char ptp_device[QOT_MAX_NAMELEN];           /* File Name              */
-    // int fd;                                     /* device file descriptor */
-    // int index = 1;                              /* Channel index, 'corresponding to the pin */
-    // struct ptp_clock_caps caps;                 /* Clock capabilities */
-    // struct ptp_pin_desc desc;                   /* Pin configuration */
-    // struct ptp_extts_request extts_request;     /* External timestamp req */
-
+    if(!timeline_bound(timeline) || !request)
+        return QOT_RETURN_TYPE_ERR;
 
-    // if(!timeline)
-    //     return QOT_RETURN_TYPE_ERR;
-    // if (fcntl(timeline->fd, F_GETFD)==-1)
-    //     return QOT_RETURN_TYPE_ERR;
-    
-    // // Get the presiding core clock
-    // if(ioctl(timeline->qotusr_fd, QOTUSR_GET_CORE_CLOCK_INFO, &core_clock) < 0)
-    // {
-    //     return QOT_RETURN_TYPE_ERR;
-    // }
-
-    // // Create the file name
-    // sprintf(ptp_device, "/dev/ptp%d", core_clock.phc_id);
-
-    // if(enable)
-    // {
-    //     /* Open the core clock ptp character device */
-    //     fd = open(ptp_device, O_RDWR);
-    //     if (fd < 0) {
-    //         printf("Failed to open ptp device %s\n", ptp_device);
-    //         return QOT_RETURN_TYPE_ERR;
-    //     }
-    //     printf("Opened ptp device %s with fd = %d\n", ptp_device, fd);
-    //     timeline->clock_fd = fd;
-
-    //     /* Pin to perform external time stamping */
-    //     index = request->pin_index;
-
-    //     /* Check if clock supports external timestamps */
-    //     if (ioctl(fd, PTP_CLOCK_GETCAPS, &caps)) {
-    //         printf("cannot get capabilities of clock");
-    //         return QOT_RETURN_TYPE_ERR;
-    //     }
-    //     if(caps.n_ext_ts < 1)
-    //     {
-    //         printf("clock cannot perform external timestamping\n");
-    //         return QOT_RETURN_TYPE_ERR;
-    //     }
-
-    //     /* Configure the pin to support external timestamps */
-    //     memset(&desc, 0, sizeof(desc));
-    //     desc.index = index;
-    //     desc.func = 1;                              /* '1' corresponds to external timestamp */
-    //     desc.chan = index;
-    //     if (ioctl(fd, PTP_PIN_SETFUNC, &desc)) {
-    //         printf("Set pin func failed for\n");
-    //         return QOT_RETURN_TYPE_ERR;
-    //     }
-        
-    //     /* Request timestamps from the pin */ 
-    //     memset(&extts_request, 0, sizeof(extts_request));
-    //     extts_request.index = index;
-    //     extts_request.flags = PTP_ENABLE_FEATURE;
-    //     if (ioctl(fd, PTP_EXTTS_REQUEST, &extts_request)) {
-    //         printf("Requesting timestamps failed for\n");
-    //         return QOT_RETURN_TYPE_ERR;
-    //     }
-    // }
-    // else
-    // {
-    //     /* Disable the pin */
-    //     if (fcntl(timeline->clock_fd, F_GETFD)==-1)
-    //         return QOT_RETURN_TYPE_ERR;
-    //     memset(&desc, 0, sizeof(desc));
-    //     desc.index = request->pin_index;
-    //     desc.func = 0;              // '0' corresponds to no function 
-    //     desc.chan = request->pin_index;
-    //     if (ioctl(timeline->clock_fd, PTP_PIN_SETFUNC, &desc)) {
-    //         perror("PTP_PIN_SETFUNC Disable");
-    //     }
-        
-    //     /* Close the character device */
-    //     close(timeline->clock_fd);
-    // }
+    // Captures are projected onto this timeline by the QoT core
+    request->timeline = timeline->info;
+    if(ioctl(timeline_event_fd(timeline), (enable ? QOTUSR_INPUT_CAPTURE_ENABLE : QOTUSR_INPUT_CAPTURE_DISABLE), request) < 0)
+    {
+        return QOT_RETURN_TYPE_ERR;
+    }
     return QOT_RETURN_TYPE_OK;
 }
 
 qot_return_t timeline_read_pin_timestamps(timeline_t *timeline, qot_event_t *event) 
 {
-    int cnt;
-    struct ptp_extts_event event_ptp;               /* PTP event */
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    struct pollfd fds;
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->clock_fd, F_GETFD)==-1)
+
+    fds.fd = timeline_event_fd(timeline);
+    fds.events = POLLIN;
+    if(fds.fd < 0)
         return QOT_RETURN_TYPE_ERR;
 
-    cnt = read(timeline->clock_fd, &event_ptp, sizeof(event_ptp));
-    if (cnt != sizeof(event_ptp)) {
-        printf("Cannot read event");
+    // Timestamps arrive on the event queue already projected onto the timeline.
+    // The queue is shared with the other event types, which are skipped
+    do
+    {
+        if(poll(&fds, 1, -1) <= 0 || (fds.revents & (POLLERR | POLLHUP | POLLNVAL)))
+            return QOT_RETURN_TYPE_ERR;
+        if(ioctl(fds.fd, QOTUSR_GET_NEXT_EVENT, event) < 0)
+            continue;
+    } while (event->type != QOT_EVENT_EXTERNAL_TIMESTAMP);
+    return QOT_RETURN_TYPE_OK;
+}
+
+int timeline_get_event_fd(timeline_t *timeline)
+{
+    if(!timeline_bound(timeline))
+        return -1;
+    return timeline_event_fd(timeline);
+}
+
+// EVENT DISPATCH ////////////////////////////////////////////////////////////////
+
+/* Most timelines with event callbacks in one process */
+#define QOT_DISPATCH_MAX_TIMELINES 64
+/* Most events drained from a timeline before they are delivered */
+#define QOT_DISPATCH_BATCH 64
+
+/* Process-wide event dispatcher (one thread, started on first use) */
+typedef struct qot_dispatcher {
+    pthread_mutex_t lock;                 /* Protects everything below and stats      */
+    pthread_cond_t idle;                  /* Signalled when callbacks return          */
+    pthread_t thread;                     /* Dispatcher thread                        */
+    int started;                          /* Thread has been created                  */
+    int wake_fd[2];                       /* Pipe to re-read the timeline list        */
+    timeline_t *busy;                     /* Timeline whose callbacks are running     */
+    timeline_t *timelines[QOT_DISPATCH_MAX_TIMELINES];
+    int count;                            /* Timelines with callbacks                 */
+} qot_dispatcher_t;
+
+static qot_dispatcher_t dispatcher = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+    .wake_fd = { -1, -1 },
+};
+
+static int timeline_dispatch_find(timeline_t *timeline)
+{
+    int i;
+    for (i = 0; i < dispatcher.count; i++)
+        if (dispatcher.timelines[i] == timeline)
+            return i;
+    return -1;
+}
+
+static void timeline_dispatch_wake(void)
+{
+    char c = 0;
+    if (write(dispatcher.wake_fd[1], &c, 1) < 0 && DEBUG)
+        qot_log("Event dispatcher wakeup failed\n");
+}
+
+/* Deliver drained events grouped by type, outside the dispatcher lock */
+static void timeline_dispatch_deliver(qot_event_t *events, int num,
+    qot_callback_t *callbacks, qot_event_batch_callback_t *batch_callbacks)
+{
+    qot_event_t group[QOT_DISPATCH_BATCH];
+    int type, i, count;
+    for (type = 0; type < QOT_EVENT_NUM_TYPES; type++)
+    {
+        count = 0;
+        for (i = 0; i < num; i++)
+            if ((int) events[i].type == type)
+                group[count++] = events[i];
+        if (!count)
+            continue;
+        if (batch_callbacks[type])
+            batch_callbacks[type](group, count);
+        else if (callbacks[type])
+            for (i = 0; i < count; i++)
+                callbacks[type](&group[i]);
     }
-    event->type = QOT_EVENT_EXTERNAL_TIMESTAMP;
-    event->timestamp.estimate.sec  = event_ptp.t.sec;
-    event->timestamp.estimate.asec = event_ptp.t.nsec*nSEC_PER_SEC;
-    
-    // Convert the core time to remote time
-    if(ioctl(timeline->fd, TIMELINE_CORE_TO_REMOTE, &event->timestamp.estimate) < 0)
+}
+
+/* Drain all pending events of a timeline (dispatcher lock held) */
+static void timeline_dispatch_drain(timeline_t *timeline)
+{
+    qot_event_t events[QOT_DISPATCH_BATCH];
+    qot_callback_t callbacks[QOT_EVENT_NUM_TYPES];
+    qot_event_batch_callback_t batch_callbacks[QOT_EVENT_NUM_TYPES];
+    uint32_t depth[QOT_EVENT_NUM_TYPES];
+    qot_event_type_stats_t *stats;
+    int num, i, type;
+
+    timeline->events.stats.wakeups++;
+    do {
+        // One ioctl per event, until the queue reports empty
+        for (num = 0; num < QOT_DISPATCH_BATCH; num++)
+            if (ioctl(timeline->event_fd, QOTUSR_GET_NEXT_EVENT, &events[num]) < 0)
+                break;
+        if (!num)
+            return;
+
+        memset(depth, 0, sizeof(depth));
+        for (i = 0; i < num; i++)
+        {
+            type = events[i].type;
+            if (type < 0 || type >= QOT_EVENT_NUM_TYPES
+                || (!timeline->events.callbacks[type] && !timeline->events.batch_callbacks[type]))
+                timeline->events.stats.unhandled++;
+            else
+                depth[type]++;
+        }
+        for (type = 0; type < QOT_EVENT_NUM_TYPES; type++)
+        {
+            if (!depth[type])
+                continue;
+            stats = &timeline->events.stats.types[type];
+            stats->events += depth[type];
+            stats->batches++;
+            stats->depth = depth[type];
+            if (depth[type] > stats->max_depth)
+                stats->max_depth = depth[type];
+        }
+        memcpy(callbacks, timeline->events.callbacks, sizeof(callbacks));
+        memcpy(batch_callbacks, timeline->events.batch_callbacks, sizeof(batch_callbacks));
+
+        dispatcher.busy = timeline;
+        pthread_mutex_unlock(&dispatcher.lock);
+        timeline_dispatch_deliver(events, num, callbacks, batch_callbacks);
+        pthread_mutex_lock(&dispatcher.lock);
+        dispatcher.busy = NULL;
+        pthread_cond_broadcast(&dispatcher.idle);
+
+        // A callback may have released (or even destroyed) the timeline
+        if (timeline_dispatch_find(timeline) < 0)
+            return;
+    } while (num == QOT_DISPATCH_BATCH);
+}
+
+/* Stop the dispatcher thread, the next registration starts another (lock held) */
+static void timeline_dispatch_stop(void)
+{
+    close(dispatcher.wake_fd[0]);
+    close(dispatcher.wake_fd[1]);
+    dispatcher.wake_fd[0] = dispatcher.wake_fd[1] = -1;
+    dispatcher.started = 0;
+}
+
+static void *timeline_dispatch_thread(void *arg)
+{
+    struct pollfd fds[QOT_DISPATCH_MAX_TIMELINES + 1];
+    timeline_t *polled[QOT_DISPATCH_MAX_TIMELINES];
+    char drain[64];
+    int num, i;
+    (void) arg;
+
+    pthread_mutex_lock(&dispatcher.lock);
+    while (dispatcher.started)
     {
+        fds[0].fd = dispatcher.wake_fd[0];
+        fds[0].events = POLLIN;
+        num = dispatcher.count;
+        for (i = 0; i < num; i++)
+        {
+            polled[i] = dispatcher.timelines[i];
+            fds[i + 1].fd = polled[i]->event_fd;
+            fds[i + 1].events = POLLIN;
+        }
+        pthread_mutex_unlock(&dispatcher.lock);
+
+        if (poll(fds, num + 1, -1) < 0)
+        {
+            pthread_mutex_lock(&dispatcher.lock);
+            if (errno == EINTR)
+                continue;
+            if (DEBUG)
+                qot_log("Event dispatcher cannot poll (%d), stopping\n", errno);
+            timeline_dispatch_stop();
+            break;
+        }
+        if (fds[0].revents & POLLIN)
+            while (read(dispatcher.wake_fd[0], drain, sizeof(drain)) > 0);
+
+        pthread_mutex_lock(&dispatcher.lock);
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            if (DEBUG)
+                qot_log("Event dispatcher lost its wakeup pipe, stopping\n");
+            timeline_dispatch_stop();
+            break;
+        }
+        for (i = 0; i < num; i++)
+        {
+            int index = timeline_dispatch_find(polled[i]);
+            if (index < 0)
+                continue;
+            if (fds[i + 1].revents & POLLIN)
+                timeline_dispatch_drain(polled[i]);
+            else if (fds[i + 1].revents & (POLLERR | POLLHUP | POLLNVAL))
+            {
+                // A failed connection reports the same on every poll, stop polling it
+                if (DEBUG)
+                    qot_log("Event connection of timeline %s failed, no more callbacks\n",
+                        polled[i]->info.name);
+                dispatcher.timelines[index] = dispatcher.timelines[--dispatcher.count];
+                polled[i]->events.registered = 0;
+            }
+        }
+    }
+    pthread_mutex_unlock(&dispatcher.lock);
+    return NULL;
+}
+
+/* Add a timeline to the dispatcher, starting it if needed (lock held) */
+static qot_return_t timeline_dispatch_register(timeline_t *timeline)
+{
+    int i;
+    if (timeline_dispatch_find(timeline) >= 0)
+        return QOT_RETURN_TYPE_OK;
+    if (dispatcher.count >= QOT_DISPATCH_MAX_TIMELINES || timeline_event_fd(timeline) < 0)
         return QOT_RETURN_TYPE_ERR;
+    if (!dispatcher.started)
+    {
+        if (pipe(dispatcher.wake_fd) < 0)
+            return QOT_RETURN_TYPE_ERR;
+        for (i = 0; i < 2; i++)
+        {
+            fcntl(dispatcher.wake_fd[i], F_SETFL, O_NONBLOCK);
+            fcntl(dispatcher.wake_fd[i], F_SETFD, FD_CLOEXEC);
+        }
+        dispatcher.started = 1;
+        if (pthread_create(&dispatcher.thread, NULL, timeline_dispatch_thread, NULL))
+        {
+            timeline_dispatch_stop();
+            return QOT_RETURN_TYPE_ERR;
+        }
+        pthread_detach(dispatcher.thread);
     }
+    dispatcher.timelines[dispatcher.count++] = timeline;
+    timeline->events.registered = 1;
+    timeline_dispatch_wake();
     return QOT_RETURN_TYPE_OK;
 }
 
+/* Remove a timeline and wait for its running callbacks (lock held) */
+static void timeline_dispatch_unregister(timeline_t *timeline)
+{
+    int i = timeline_dispatch_find(timeline);
+    if (i < 0)
+        return;
+    dispatcher.timelines[i] = dispatcher.timelines[--dispatcher.count];
+    timeline->events.registered = 0;
+    timeline_dispatch_wake();
+    // A callback releasing its own timeline must not wait for itself
+    while (dispatcher.busy == timeline && !pthread_equal(pthread_self(), dispatcher.thread))
+        pthread_cond_wait(&dispatcher.idle, &dispatcher.lock);
+}
+
+static void timeline_dispatch_release(timeline_t *timeline)
+{
+    pthread_mutex_lock(&dispatcher.lock);
+    timeline_dispatch_unregister(timeline);
+    pthread_mutex_unlock(&dispatcher.lock);
+}
+
+/* Set or clear the callbacks of one (type >= 0) or all (type < 0) types */
+static qot_return_t timeline_config_callback(timeline_t *timeline, int type, uint8_t enable,
+    qot_callback_t callback, qot_event_batch_callback_t batch_callback)
+{
+    qot_return_t retval = QOT_RETURN_TYPE_OK;
+    int i, any = 0;
+    if(!timeline_bound(timeline) || type >= QOT_EVENT_NUM_TYPES)
+        return QOT_RETURN_TYPE_ERR;
+    if (enable && !callback && !batch_callback)
+        return QOT_RETURN_TYPE_ERR;
+
+    pthread_mutex_lock(&dispatcher.lock);
+    for (i = 0; i < QOT_EVENT_NUM_TYPES; i++)
+    {
+        if (type >= 0 && i != type)
+            continue;
+        timeline->events.callbacks[i] = enable ? callback : NULL;
+        timeline->events.batch_callbacks[i] = enable ? batch_callback : NULL;
+    }
+    for (i = 0; i < QOT_EVENT_NUM_TYPES; i++)
+        if (timeline->events.callbacks[i] || timeline->events.batch_callbacks[i])
+            any = 1;
+    if (any)
+        retval = timeline_dispatch_register(timeline);
+    else
+        timeline_dispatch_unregister(timeline);
+    pthread_mutex_unlock(&dispatcher.lock);
+    return retval;
+}
+
 qot_return_t timeline_config_events(timeline_t *timeline, uint8_t enable,
-    qot_callback_t callback) {
-    return QOT_RETURN_TYPE_ERR;
+    qot_callback_t callback)
+{
+    return timeline_config_callback(timeline, -1, enable, callback, NULL);
+}
+
+qot_return_t timeline_config_event_type(timeline_t *timeline, qot_event_type_t type,
+    uint8_t enable, qot_callback_t callback)
+{
+    if ((int) type < 0)
+        return QOT_RETURN_TYPE_ERR;
+    return timeline_config_callback(timeline, type, enable, callback, NULL);
+}
+
+qot_return_t timeline_config_event_batch(timeline_t *timeline, qot_event_type_t type,
+    uint8_t enable, qot_event_batch_callback_t callback)
+{
+    if ((int) type < 0)
+        return QOT_RETURN_TYPE_ERR;
+    return timeline_config_callback(timeline, type, enable, NULL, callback);
+}
+
+qot_return_t timeline_get_event_stats(timeline_t *timeline, qot_event_stats_t *stats)
+{
+    if (!timeline || !stats)
+        return QOT_RETURN_TYPE_ERR;
+    pthread_mutex_lock(&dispatcher.lock);
+    *stats = timeline->events.stats;
+    pthread_mutex_unlock(&dispatcher.lock);
+    return QOT_RETURN_TYPE_OK;
 }
 
 qot_return_t timeline_read_events(timeline_t *timeline, qot_event_t *event)
 {
     struct pollfd fds;
 
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
-    fds.fd = timeline->qotusr_fd;
+    fds.fd = timeline_event_fd(timeline);
     fds.events = POLLIN;
+    if(fds.fd < 0)
+        return QOT_RETURN_TYPE_ERR;
 
     if(poll(&fds, 1, -1) <= 0)
         return QOT_RETURN_TYPE_ERR;
 
     if(fds.revents && POLLIN == POLLIN)
     {
-        if(ioctl(timeline->qotusr_fd, QOTUSR_GET_NEXT_EVENT, event) < 0)
+        if(ioctl(fds.fd, QOTUSR_GET_NEXT_EVENT, event) < 0)
         {
             return QOT_RETURN_TYPE_ERR;
         }
@@ -695,16 +1550,14 @@ qot_return_t timeline_read_events(timeline_t *timeline, qot_event_t *event)
 qot_return_t timeline_waituntil(timeline_t *timeline, utimepoint_t *utp) 
 {
     qot_sleeper_t sleeper;
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     sleeper.timeline = timeline->info;
     sleeper.wait_until_time = *utp;
 
     if(DEBUG)
-        printf("Task invoked wait until secs %lld %llu\n", sleeper.wait_until_time.estimate.sec, sleeper.wait_until_time.estimate.asec);
+        qot_log("Task invoked wait until secs %" PRId64 " %" PRIu64 "\n", sleeper.wait_until_time.estimate.sec, sleeper.wait_until_time.estimate.asec);
 
     #ifdef PARAVIRT_GUEST
     // Virtualization-specific Guest extensions -> Convert time to local core time
@@ -731,17 +1584,27 @@ qot_return_t timeline_waituntil_nextperiod(timeline_t *timeline, utimepoint_t *u
     u64 elapsed_ns = 0;
     u64 period_ns = 0;
     u64 num_periods = 0;
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    int strict = 0;
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     sleeper.timeline = timeline->info;
+    // Under the real-time profile the previous periodic wakeup stands in for
+    // the current time, so a periodic loop makes one syscall per period (an
+    // overrun wakes immediately, and the next call realigns to the period)
+    if(qot_rt_profile_enabled() && timeline->period_woken && !timeline->dl.enabled)
+    {
+        sleeper.wait_until_time = timeline->last_wakeup;
+        strict = 1;
+    }
     // Get the timeline time
-    if(ioctl(timeline->fd, TIMELINE_GET_TIME_NOW, &sleeper.wait_until_time) < 0)
+    else if(ioctl(timeline->fd, TIMELINE_GET_TIME_NOW, &sleeper.wait_until_time) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
+    // The previous job of a deadline reservation completes here
+    if(timeline->dl.enabled)
+        timeline_dl_complete(timeline, &sleeper.wait_until_time.estimate);
     // Check Start Offset
     if(timepoint_cmp(&timeline->binding.start_offset, &sleeper.wait_until_time.estimate) < 0)
     {
@@ -749,12 +1612,12 @@ qot_return_t timeline_waituntil_nextperiod(timeline_t *timeline, utimepoint_t *u
     }
     else 
     {
-        // Calculate Next Wakeup Time
+        // Calculate Next Wakeup Time (strictly after a previous wakeup)
         timepoint_diff(&elapsed_time, &sleeper.wait_until_time.estimate, &timeline->binding.start_offset);
         elapsed_ns = TL_TO_nSEC(elapsed_time);
         period_ns = TL_TO_nSEC(timeline->binding.period);
         num_periods = (elapsed_ns/period_ns);
-        if(elapsed_ns % period_ns != 0)
+        if(strict || elapsed_ns % period_ns != 0)
             num_periods++;
         elapsed_ns = period_ns*num_periods;
         TL_FROM_nSEC(elapsed_time, elapsed_ns);
@@ -762,12 +1625,18 @@ qot_return_t timeline_waituntil_nextperiod(timeline_t *timeline, utimepoint_t *u
         timepoint_add(&wakeup_time, &elapsed_time);
         sleeper.wait_until_time.estimate = wakeup_time;
      }
+    wakeup_time = sleeper.wait_until_time.estimate;
 
     // Blocking wait on remote timeline time
     if(ioctl(timeline->qotusr_fd, QOTUSR_WAIT_UNTIL, &sleeper) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
+    // Waking on the timeline releases the next job, phase-aligned to the timeline
+    if(timeline->dl.enabled)
+        timeline_dl_release(timeline, &wakeup_time);
+    timeline->last_wakeup = sleeper.wait_until_time;
+    timeline->period_woken = 1;
     *utp = sleeper.wait_until_time;
     return QOT_RETURN_TYPE_OK;
 }
@@ -776,9 +1645,7 @@ qot_return_t timeline_sleep(timeline_t *timeline, utimelength_t *utl)
 {
     qot_sleeper_t sleeper;
 
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     // Get the timeline time
@@ -804,15 +1671,13 @@ qot_return_t timeline_timer_create(timeline_t *timeline, qot_timer_t *timer, qot
 {
     struct sigaction act;
 
-    if(!timeline || !timer)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline) || !timer)
         return QOT_RETURN_TYPE_ERR;
 
     // Create a timer
     if(ioctl(timeline->fd, TIMELINE_CREATE_TIMER, timer) < 0)
     {
-        printf("Failed To Create Timer\n");
+        qot_log("Failed To Create Timer\n");
         return QOT_RETURN_TYPE_ERR;
     }
 
@@ -824,7 +1689,7 @@ qot_return_t timeline_timer_create(timeline_t *timeline, qot_timer_t *timer, qot
 
     if (sigaction(SIGALRM, &act, NULL) == -1)
     {
-        printf("sigaction failed !\n");
+        qot_log("sigaction failed !\n");
         return QOT_RETURN_TYPE_ERR;
     }
 
@@ -834,9 +1699,7 @@ qot_return_t timeline_timer_create(timeline_t *timeline, qot_timer_t *timer, qot
 
 qot_return_t timeline_timer_cancel(timeline_t *timeline, qot_timer_t *timer) 
 {
-    if(!timeline || !timer)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline) || !timer)
         return QOT_RETURN_TYPE_ERR;
 
     // Create a timer
@@ -850,9 +1713,7 @@ qot_return_t timeline_timer_cancel(timeline_t *timeline, qot_timer_t *timer)
 
 qot_return_t timeline_core2rem(timeline_t *timeline, stimepoint_t *est) 
 {    
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
     
     #ifdef PARAVIRT_GUEST
@@ -874,9 +1735,7 @@ qot_return_t timeline_core2rem(timeline_t *timeline, stimepoint_t *est)
 
 qot_return_t timeline_rem2core(timeline_t *timeline, timepoint_t *est) 
 {    
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
     
     #ifdef PARAVIRT_GUEST
@@ -895,3 +1754,111 @@ qot_return_t timeline_rem2core(timeline_t *timeline, timepoint_t *est)
     return QOT_RETURN_TYPE_OK;
     #endif
 }
+
+// BATCH CONVERSIONS ///////////////////////////////////////////////////////////////
+
+/* Timestamps projected per pass, so that core times survive an in-place call */
+#define QOT_CONVERT_CHUNK 256
+
+qot_return_t timeline_get_parameters(timeline_t *timeline, tl_translation_t *params)
+{
+    if(!timeline_bound(timeline) || !params)
+        return QOT_RETURN_TYPE_ERR;
+
+    #ifdef PARAVIRT_GUEST
+    // Virtualization-specific Guest extensions -> Parameters are shared by the host
+    *params = timeline->timeline_clock->translation;
+    #else
+    if(ioctl(timeline->fd, TIMELINE_GET_PARAMETERS, params) < 0)
+    {
+        return QOT_RETURN_TYPE_ERR;
+    }
+    #endif
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t timeline_core2rem_n(timeline_t *timeline, const s64 *core, s64 *tl,
+    s64 *upper, s64 *lower, size_t n)
+{
+    tl_translation_t params;
+
+    if(n && (!core || !tl))
+        return QOT_RETURN_TYPE_ERR;
+    if(timeline_get_parameters(timeline, &params))
+        return QOT_RETURN_TYPE_ERR;
+    return qot_core2rem_params_n(&params, core, tl, upper, lower, n);
+}
+
+qot_return_t qot_core2rem_params_n(const tl_translation_t *params, const s64 *core, s64 *tl,
+    s64 *upper, s64 *lower, size_t n)
+{
+    qot_uncertainty_table_t u_pow, l_pow;
+    s64 dt[QOT_CONVERT_CHUNK];
+    size_t i, j, m;
+
+    if(!params || (n && (!core || !tl)))
+        return QOT_RETURN_TYPE_ERR;
+
+    // Same projection and bounds as TIMELINE_CORE_TO_REMOTE, on one snapshot
+    if(upper)
+        qot_uncertainty_build(&u_pow, params->u_pow);
+    if(lower)
+        qot_uncertainty_build(&l_pow, params->l_pow);
+    for (i = 0; i < n; i += m)
+    {
+        m = (n - i < QOT_CONVERT_CHUNK) ? n - i : QOT_CONVERT_CHUNK;
+        for (j = 0; j < m; j++)
+            dt[j] = core[i + j] - params->last;
+        timepoint_loc2rem_n(params, core + i, tl + i, m);
+        if(upper)
+            for (j = 0; j < m; j++)
+                upper[i + j] = tl[i + j] + qot_uncertainty_bound(params->u_nsec, params->u_mult, &u_pow, dt[j]);
+        if(lower)
+            for (j = 0; j < m; j++)
+                lower[i + j] = tl[i + j] + qot_uncertainty_bound(params->l_nsec, params->l_mult, &l_pow, dt[j]);
+    }
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t timeline_rem2core_n(timeline_t *timeline, const s64 *tl, s64 *core, size_t n)
+{
+    tl_translation_t params;
+    u64 diff;
+    u32 div;
+    size_t i;
+
+    if(n && (!tl || !core))
+        return QOT_RETURN_TYPE_ERR;
+    if(timeline_get_parameters(timeline, &params))
+        return QOT_RETURN_TYPE_ERR;
+
+    // Same arithmetic as TIMELINE_REMOTE_TO_CORE
+    div = (u32) (params.mult + 1000000000LL);
+    for (i = 0; i < n; i++)
+    {
+        diff = (u64) (tl[i] - params.nsec);
+        core[i] = params.last + (s64) ((diff / div) * nSEC_PER_SEC) + (s64) (diff % div);
+    }
+    return QOT_RETURN_TYPE_OK;
+}
+
+int timeline_read_events_n(timeline_t *timeline, qot_event_t *events, size_t max, int timeout_ms)
+{
+    struct pollfd fds;
+    size_t count = 0;
+
+    if(!timeline_bound(timeline) || (max && !events))
+        return -1;
+    if(!max)
+        return 0;
+
+    fds.fd = timeline_event_fd(timeline);
+    fds.events = POLLIN;
+    if(fds.fd < 0 || poll(&fds, 1, timeout_ms) < 0)
+        return -1;
+
+    // The queue does not block when it is empty, so drain until the ioctl fails
+    while (count < max && ioctl(fds.fd, QOTUSR_GET_NEXT_EVENT, &events[count]) == 0)
+        count++;
+    return (int) count;
+}
@@ -44,6 +44,73 @@ typedef void (*qot_callback_t)(const qot_event_t *evt);
 
 typedef void (*qot_timer_callback_t)(int sig, siginfo_t *si, void *ucontext);
 
+/* Deadline-miss accounting for a SCHED_DEADLINE reservation */
+typedef struct qot_deadline_stats {
+    uint64_t activations;                 /* Periods released so far                  */
+    uint64_t misses;                      /* Jobs which completed past their deadline */
+    int64_t max_lateness_ns;              /* Worst completion lateness (timeline ns)  */
+    uint64_t realignments;                /* Reservations re-issued after drift       */
+} qot_deadline_stats_t;
+
+/* Batched event callback: all events of one type drained in one wakeup */
+typedef void (*qot_event_batch_callback_t)(const qot_event_t *evts, size_t count);
+
+/* Event dispatch counters for one event type */
+typedef struct qot_event_type_stats {
+    uint64_t events;                      /* Events delivered to callbacks            */
+    uint64_t batches;                     /* Batches which contained this type        */
+    uint32_t depth;                       /* Events of this type in the latest batch  */
+    uint32_t max_depth;                   /* Most events of this type in one batch    */
+} qot_event_type_stats_t;
+
+/* Event dispatch counters of a timeline */
+typedef struct qot_event_stats {
+    qot_event_type_stats_t types[QOT_EVENT_NUM_TYPES];
+    uint64_t wakeups;                     /* Dispatcher wakeups for this timeline     */
+    uint64_t unhandled;                   /* Events drained with no callback for them */
+} qot_event_stats_t;
+
+/* Most timeline_t structures preallocated by the real-time profile */
+#define QOT_RT_MAX_TIMELINES 16
+
+/* Real-time profile options (zero fields select the defaults) */
+typedef struct qot_rt_config {
+    size_t stack_prefault;                /* Stack bytes touched in the calling thread */
+    size_t heap_reserve;                  /* Heap bytes touched and kept by malloc     */
+    int lock_memory;                      /* mlockall the current and future pages     */
+} qot_rt_config_t;
+
+/**
+ * @brief Enable the process-wide real-time profile. Afterwards timeline
+ *        structures come from a preallocated pool, hot calls issue at most
+ *        one syscall without re-validating the handle, and library logging
+ *        goes to a non-blocking ring instead of stdio. Call it once from the
+ *        control thread before binding and before the control loop starts.
+ * @param config Profile options, or NULL for the defaults
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t qot_rt_profile_enable(const qot_rt_config_t *config);
+
+/**
+ * @brief Check whether the real-time profile is enabled
+ * @return 1 if enabled, 0 otherwise
+ **/
+int qot_rt_profile_enabled(void);
+
+/**
+ * @brief Write the pending library log messages to a descriptor. Call it
+ *        from a thread outside the control loop.
+ * @param fd Descriptor to write the messages to
+ * @return Number of messages written
+ **/
+size_t qot_rt_log_drain(int fd);
+
+/**
+ * @brief Number of log messages dropped because the log ring was full
+ * @return The drop count since the profile was enabled
+ **/
+uint64_t qot_rt_log_dropped(void);
+
 /**
  * @brief Constructor for the timeline_t data structure
  * @return returns a pointer to the timeline_t data structure
@@ -57,7 +124,9 @@ timeline_t *timeline_t_create();
 void timeline_t_destroy(timeline_t *timeline);
 
 /**
- * @brief Bind to a timeline with a given resolution and accuracy
+ * @brief Bind to a timeline with a given resolution and accuracy. Timelines
+ *        bound in one process share a connection to the QoT core; events are
+ *        queued for a timeline from its first event call onwards
  * @param timeline Pointer to a timeline struct
  * @param uuid Name of the timeline
  * @param name Name of this binding
@@ -133,6 +202,29 @@ qot_return_t timeline_set_resolution(timeline_t *timeline, timelength_t *res);
  **/
 qot_return_t timeline_set_schedparams(timeline_t *timeline, timelength_t *period, timepoint_t *start_offset); 
 
+/**
+ * @brief Map the periodic scheduling parameters of this binding to a SCHED_DEADLINE
+ *        reservation for the calling thread. Activations are released by
+ *        timeline_waituntil_nextperiod, so they stay phase-aligned with the timeline,
+ *        and the reservation is re-issued when the timeline discipline drifts.
+ *        Must be called after timeline_set_schedparams.
+ * @param timeline Pointer to a timeline struct
+ * @param runtime Execution budget per period (timeline time)
+ * @param deadline Relative deadline of each activation (timeline time, <= period)
+ * @param enable Non-zero to install the reservation, zero to revert to SCHED_OTHER
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_set_deadline_reservation(timeline_t *timeline, timelength_t *runtime,
+    timelength_t *deadline, int enable);
+
+/**
+ * @brief Get the deadline-miss accounting of the SCHED_DEADLINE reservation
+ * @param timeline Pointer to a timeline struct
+ * @param stats Returns the activation, miss and realignment counters
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_get_deadline_stats(timeline_t *timeline, qot_deadline_stats_t *stats);
+
 /**
  * @brief Query the time according to the core
  * @param timeline Pointer to a timeline struct
@@ -141,6 +233,29 @@ qot_return_t timeline_set_schedparams(timeline_t *timeline, timelength_t *period
  **/
 qot_return_t timeline_getcoretime(timeline_t *timeline, utimepoint_t *core_now);
 
+/* How timeline_getcoretime_ns reads the core clock */
+typedef enum {
+    QOT_CORE_READ_IOCTL    = 0,           /* timeline_getcoretime, one syscall        */
+    QOT_CORE_READ_REALTIME = 1,           /* qot_x86 without TSC: CLOCK_REALTIME      */
+    QOT_CORE_READ_TSC      = 2,           /* qot_x86 TSC mode: rdtsc and calibration  */
+} qot_core_read_t;
+
+/**
+ * @brief Find how this process reads the core clock. The TSC calibration and
+ *        mode of qot_x86 are taken from /sys/module/qot_x86/parameters once.
+ * @return The method used by timeline_getcoretime_ns
+ **/
+qot_core_read_t qot_core_read_mode(void);
+
+/**
+ * @brief Read the core clock in nanoseconds, without a syscall when qot_x86
+ *        provides the core clock (see qot_core_read_mode)
+ * @param timeline Pointer to a bound timeline struct, read in ioctl mode only
+ * @param core_ns Returns the core time
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_getcoretime_ns(timeline_t *timeline, s64 *core_ns);
+
 /**
  * @brief Query the time according to the timeline
  * @param timeline Pointer to a timeline struct
@@ -149,6 +264,43 @@ qot_return_t timeline_getcoretime(timeline_t *timeline, utimepoint_t *core_now);
  **/
 qot_return_t timeline_gettime(timeline_t *timeline, utimepoint_t *est);
 
+/**
+ * @brief Query the window in which the true timeline time lies
+ * @param timeline Pointer to a timeline struct
+ * @param now Earliest and latest possible time, from the live uncertainty bounds
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_now(timeline_t *timeline, timewindow_t *now);
+
+/**
+ * @brief Check whether a timeline time has definitely passed on every node
+ * @param timeline Pointer to a timeline struct
+ * @param tp Timeline time to check
+ * @return 1 if the earliest possible time now is after tp, 0 if not, -1 on error
+ **/
+int timeline_after(timeline_t *timeline, timepoint_t *tp);
+
+/**
+ * @brief Check whether a timeline time has definitely not arrived on any node
+ * @param timeline Pointer to a timeline struct
+ * @param tp Timeline time to check
+ * @return 1 if the latest possible time now is before tp, 0 if not, -1 on error
+ **/
+int timeline_before(timeline_t *timeline, timepoint_t *tp);
+
+/**
+ * @brief Block until a timeline time has definitely passed (commit wait)
+ * @param timeline Pointer to a timeline struct
+ * @param tp Timeline time that must be in the past when this returns
+ * @param now Returns the time window on wakeup (may be NULL)
+ * @return A status code indicating success (0) or other
+ *
+ * Waits only as long as the current uncertainty requires: the bounds are
+ * re-read after every wakeup, so a well-synchronized timeline returns as
+ * soon as its lower bound exceeds tp.
+ **/
+qot_return_t timeline_commit_wait(timeline_t *timeline, timepoint_t *tp, timewindow_t *now);
+
 /**
  * @brief Request an interrupt be generated on a given pin
  * @param timeline Pointer to a timeline struct
@@ -167,16 +319,18 @@ qot_return_t timeline_enable_output_compare(timeline_t *timeline, qot_perout_t *
 qot_return_t timeline_disable_output_compare(timeline_t *timeline, qot_perout_t *request);
 
 /**
- * @brief Request an interrupt be generated on a given pin
+ * @brief Request external timestamps (input capture) on a given pin
  * @param timeline Pointer to a timeline struct
- * @param request Pointer to timestamp configuration
- * @param callback A function to call on each edge event
+ * @param request Pointer to timestamp configuration (pin and edge)
+ * @param enable Enable (1) or disable (0) timestamping
  * @return A status code indicating success (0) or other
  **/
 qot_return_t timeline_config_pin_timestamp(timeline_t *timeline, qot_extts_t *request, int enable);
 
 /**
- * @brief Perform a blocking read to get timestamp events
+ * @brief Perform a blocking read to get timestamp events, already projected
+ *        onto the timeline with their uncertainty. Other events queued for
+ *        the timeline are consumed and skipped
  * @param timeline Pointer to a timeline struct
  * @param event Pointer to event structure
  * @return A status code indicating success (0) or other
@@ -184,14 +338,56 @@ qot_return_t timeline_config_pin_timestamp(timeline_t *timeline, qot_extts_t *re
 qot_return_t timeline_read_pin_timestamps(timeline_t *timeline, qot_event_t *event);
 
 /**
- * @brief Request to be informed of timeline events
+ * @brief Get the /dev/qotusr descriptor on which the events of a timeline are
+ *        queued, opening it on first use. It becomes readable when an event
+ *        is pending, so it can be watched by an event loop
+ * @param timeline Pointer to a timeline struct
+ * @return The descriptor, or -1 on failure
+ **/
+int timeline_get_event_fd(timeline_t *timeline);
+
+/**
+ * @brief Request to be informed of timeline events of every type. Events are
+ *        delivered by one dispatcher thread per process, which drains all the
+ *        pending events of a timeline on each wakeup
  * @param timeline Pointer to a timeline struct
  * @param enable Enable or disable callback for the events
- * @param callback The function that will be called
+ * @param callback The function that will be called for each event
  * @return A status code indicating success (0) or other
  **/
 qot_return_t timeline_config_events(timeline_t *timeline, uint8_t enable, qot_callback_t callback);
 
+/**
+ * @brief Request to be informed of timeline events of one type
+ * @param timeline Pointer to a timeline struct
+ * @param type Type of the events
+ * @param enable Enable or disable callback for the events
+ * @param callback The function that will be called for each event
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_config_event_type(timeline_t *timeline, qot_event_type_t type,
+    uint8_t enable, qot_callback_t callback);
+
+/**
+ * @brief Request batched delivery of timeline events of one type: the callback
+ *        receives every event of the type drained in one dispatcher wakeup
+ * @param timeline Pointer to a timeline struct
+ * @param type Type of the events
+ * @param enable Enable or disable callback for the events
+ * @param callback The function that will be called for each batch
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_config_event_batch(timeline_t *timeline, qot_event_type_t type,
+    uint8_t enable, qot_event_batch_callback_t callback);
+
+/**
+ * @brief Get the per-type event throughput and queue-depth counters
+ * @param timeline Pointer to a timeline struct
+ * @param stats Pointer to the counters to fill
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_get_event_stats(timeline_t *timeline, qot_event_stats_t *stats);
+
 /**
  * @brief Read events on a timeline
  * @param timeline Pointer to a timeline struct
@@ -259,5 +455,65 @@ qot_return_t timeline_core2rem(timeline_t *timeline, stimepoint_t *est);
  **/
 qot_return_t timeline_rem2core(timeline_t *timeline, timepoint_t *est); 
 
+
+/**
+ * @brief Get the translation parameters (discipline and uncertainty model)
+ *        currently in force between core time and the timeline
+ * @param timeline Pointer to a timeline struct
+ * @param params Pointer to the parameters to fill
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_get_parameters(timeline_t *timeline, tl_translation_t *params);
+
+/**
+ * @brief Convert an array of core times to timeline times and their bounds.
+ *        The parameters are read once, so the whole batch is projected with
+ *        one consistent discipline and a single syscall.
+ * @param timeline Pointer to a timeline struct
+ * @param core Core times (ns)
+ * @param tl Timeline times (ns), may alias core
+ * @param upper Upper bounds on the timeline times (ns), or NULL
+ * @param lower Lower bounds on the timeline times (ns), or NULL
+ * @param n Number of elements
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_core2rem_n(timeline_t *timeline, const s64 *core, s64 *tl,
+    s64 *upper, s64 *lower, size_t n);
+
+/**
+ * @brief Convert an array of core times to timeline times and their bounds
+ *        with parameters read earlier by timeline_get_parameters (no syscall)
+ * @param params Translation parameters to project with
+ * @param core Core times (ns)
+ * @param tl Timeline times (ns), may alias core
+ * @param upper Upper bounds on the timeline times (ns), or NULL
+ * @param lower Lower bounds on the timeline times (ns), or NULL
+ * @param n Number of elements
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t qot_core2rem_params_n(const tl_translation_t *params, const s64 *core, s64 *tl,
+    s64 *upper, s64 *lower, size_t n);
+
+/**
+ * @brief Convert an array of timeline times to core times with a single syscall
+ * @param timeline Pointer to a timeline struct
+ * @param tl Timeline times (ns)
+ * @param core Core times (ns), may alias tl
+ * @param n Number of elements
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_rem2core_n(timeline_t *timeline, const s64 *tl, s64 *core, size_t n);
+
+/**
+ * @brief Read all queued events of a timeline, up to a maximum, in one call.
+ *        Do not mix with event callbacks, which consume the same queue.
+ * @param timeline Pointer to a timeline struct
+ * @param events Array of events to fill
+ * @param max Size of the array
+ * @param timeout_ms Wait for the first event (-1 blocks, 0 does not wait)
+ * @return Number of events read, or -1 on error
+ **/
+int timeline_read_events_n(timeline_t *timeline, qot_event_t *events, size_t max, int timeout_ms);
+
 #endif
 
@@ -0,0 +1,374 @@
+/*
+ * @file qot_net.c
+ * @brief Network I/O scheduled and timestamped in timeline time
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+/* System includes */
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+
+/* This file includes */
+#include "qot_net.h"
+
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif
+
+/* Control buffer of one message: the caller's control data and the launch time */
+typedef union qot_net_control {
+    struct cmsghdr align;
+    char buf[QOT_NET_MAX_CONTROL + CMSG_SPACE(sizeof(uint64_t))];
+} qot_net_control_t;
+
+// LAUNCH-TIME TRANSMISSION ///////////////////////////////////////////////////////
+
+qot_return_t qot_txtime_enable(int sock, const qot_txtime_config_t *config)
+{
+    struct sock_txtime txtime;
+    if(!config)
+        return QOT_RETURN_TYPE_ERR;
+    txtime.clockid = config->clockid;
+    txtime.flags = config->flags;
+    if(setsockopt(sock, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) < 0)
+        return QOT_RETURN_TYPE_ERR;
+    return QOT_RETURN_TYPE_OK;
+}
+
+static s64 qot_net_clock_ns(clockid_t clockid)
+{
+    struct timespec ts;
+    clock_gettime(clockid, &ts);
+    return (s64) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Core clock reads bracketing a clock read, keeping the narrowest bracket */
+#define QOT_NET_OFFSET_SAMPLES 5
+
+/* Offset from the core clock to a system clock (the clock of the qdisc) */
+static qot_return_t qot_net_clock_offset(timeline_t *timeline, clockid_t clockid, s64 *offset)
+{
+    s64 before, clk, after, best = -1;
+    int i;
+
+    if(qot_core_read_mode() == QOT_CORE_READ_REALTIME)
+    {
+        // The core clock is CLOCK_REALTIME, and TAI differs from it by whole leap seconds
+        *offset = 0;
+        if(clockid == CLOCK_REALTIME)
+            return QOT_RETURN_TYPE_OK;
+        before = qot_net_clock_ns(CLOCK_REALTIME);
+        clk = qot_net_clock_ns(clockid);
+        after = qot_net_clock_ns(CLOCK_REALTIME);
+        *offset = clk - before - (after - before) / 2;
+        if(clockid == CLOCK_TAI)
+            *offset = (*offset >= 0 ? *offset + 500000000LL : *offset - 500000000LL)
+                / 1000000000LL * 1000000000LL;
+        return QOT_RETURN_TYPE_OK;
+    }
+
+    // Otherwise (the TSC, or a core clock only the timeline ioctl reads) the
+    // two clocks run apart, so sample them back to back
+    for (i = 0; i < QOT_NET_OFFSET_SAMPLES; i++)
+    {
+        if(timeline_getcoretime_ns(timeline, &before))
+            return QOT_RETURN_TYPE_ERR;
+        clk = qot_net_clock_ns(clockid);
+        if(timeline_getcoretime_ns(timeline, &after))
+            return QOT_RETURN_TYPE_ERR;
+        if(best < 0 || after - before < best)
+        {
+            best = after - before;
+            *offset = clk - before - best / 2;
+        }
+    }
+    return QOT_RETURN_TYPE_OK;
+}
+
+/* Append the launch time to the caller's control data of a message */
+static int qot_net_add_txtime(struct msghdr *msg, qot_net_control_t *ctrl, uint64_t txtime)
+{
+    struct cmsghdr *cm;
+    size_t len = CMSG_ALIGN(msg->msg_controllen);
+    if(len > QOT_NET_MAX_CONTROL)
+        return -1;
+    if(msg->msg_controllen)
+        memcpy(ctrl->buf, msg->msg_control, msg->msg_controllen);
+    memset(ctrl->buf + msg->msg_controllen, 0, sizeof(ctrl->buf) - msg->msg_controllen);
+    cm = (struct cmsghdr *) (ctrl->buf + len);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_TXTIME;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    memcpy(CMSG_DATA(cm), &txtime, sizeof(uint64_t));
+    msg->msg_control = ctrl->buf;
+    msg->msg_controllen = len + CMSG_SPACE(sizeof(uint64_t));
+    return 0;
+}
+
+int timeline_sendmmsg_at(timeline_t *timeline, int sock, const qot_txtime_config_t *config,
+    struct mmsghdr *msgs, const timepoint_t *launch, utimepoint_t *achieved,
+    unsigned int vlen, int flags)
+{
+    qot_net_control_t ctrl[QOT_NET_MAX_BATCH];
+    void *user_control[QOT_NET_MAX_BATCH];
+    size_t user_controllen[QOT_NET_MAX_BATCH];
+    s64 tl[QOT_NET_MAX_BATCH], core[QOT_NET_MAX_BATCH];
+    s64 upper[QOT_NET_MAX_BATCH], lower[QOT_NET_MAX_BATCH];
+    unsigned int i, j, m, sent = 0;
+    s64 offset;
+    int ret;
+
+    if(!timeline || !config || !msgs || !launch)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < vlen; i += m)
+    {
+        m = (vlen - i < QOT_NET_MAX_BATCH) ? vlen - i : QOT_NET_MAX_BATCH;
+
+        // Project the launch times onto the core clock, then onto the qdisc clock
+        for (j = 0; j < m; j++)
+            tl[j] = (s64) TP_TO_nSEC(launch[i + j]);
+        if(timeline_rem2core_n(timeline, tl, core, m))
+        {
+            errno = EACCES;
+            return sent ? (int) sent : -1;
+        }
+        if(achieved && timeline_core2rem_n(timeline, core, tl, upper, lower, m))
+        {
+            errno = EACCES;
+            return sent ? (int) sent : -1;
+        }
+        if(qot_net_clock_offset(timeline, config->clockid, &offset))
+        {
+            errno = EACCES;
+            return sent ? (int) sent : -1;
+        }
+
+        for (j = 0; j < m; j++)
+        {
+            user_control[j] = msgs[i + j].msg_hdr.msg_control;
+            user_controllen[j] = msgs[i + j].msg_hdr.msg_controllen;
+            if(qot_net_add_txtime(&msgs[i + j].msg_hdr, &ctrl[j], (uint64_t) (core[j] + offset)))
+            {
+                m = j;
+                errno = EMSGSIZE;
+                break;
+            }
+        }
+        ret = m ? sendmmsg(sock, msgs + i, m, flags) : -1;
+        for (j = 0; j < m; j++)
+        {
+            msgs[i + j].msg_hdr.msg_control = user_control[j];
+            msgs[i + j].msg_hdr.msg_controllen = user_controllen[j];
+        }
+        if(ret < 0)
+            return sent ? (int) sent : -1;
+
+        // The launch happens at the core time, with the uncertainty of the timeline there
+        if(achieved)
+        {
+            for (j = 0; j < (unsigned int) ret; j++)
+            {
+                memset(&achieved[i + j], 0, sizeof(utimepoint_t));
+                TP_FROM_nSEC(achieved[i + j].estimate, tl[j]);
+                TL_FROM_nSEC(achieved[i + j].interval.above, upper[j] > tl[j] ? upper[j] - tl[j] : 0);
+                TL_FROM_nSEC(achieved[i + j].interval.below, tl[j] > lower[j] ? tl[j] - lower[j] : 0);
+                timelength_add(&achieved[i + j].interval.above, (timelength_t *) &config->launch_error.above);
+                timelength_add(&achieved[i + j].interval.below, (timelength_t *) &config->launch_error.below);
+            }
+        }
+        sent += (unsigned int) ret;
+        if((unsigned int) ret < m)
+            break;
+    }
+    return (int) sent;
+}
+
+ssize_t timeline_sendmsg_at(timeline_t *timeline, int sock, const qot_txtime_config_t *config,
+    struct msghdr *msg, const timepoint_t *launch, utimepoint_t *achieved, int flags)
+{
+    struct mmsghdr mmsg;
+    if(!msg)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    mmsg.msg_hdr = *msg;
+    mmsg.msg_len = 0;
+    if(timeline_sendmmsg_at(timeline, sock, config, &mmsg, launch, achieved, 1, flags) != 1)
+        return -1;
+    return (ssize_t) mmsg.msg_len;
+}
+
+// TIMESTAMPED RECEPTION //////////////////////////////////////////////////////////
+
+qot_return_t qot_rxtime_enable(int sock, const char *iface)
+{
+    struct ifreq dev;
+    struct hwtstamp_config hwcfg;
+    int f = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+    // Hardware timestamps need the interface to stamp every received packet
+    if(iface)
+    {
+        memset(&dev, 0, sizeof(dev));
+        strncpy(dev.ifr_name, iface, sizeof(dev.ifr_name) - 1);
+        memset(&hwcfg, 0, sizeof(hwcfg));
+        hwcfg.tx_type = HWTSTAMP_TX_OFF;
+        hwcfg.rx_filter = HWTSTAMP_FILTER_ALL;
+        dev.ifr_data = (void *) &hwcfg;
+        if(ioctl(sock, SIOCSHWTSTAMP, &dev) == 0 && hwcfg.rx_filter != HWTSTAMP_FILTER_NONE)
+            f |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    }
+    if(setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &f, sizeof(f)) < 0)
+        return QOT_RETURN_TYPE_ERR;
+    return QOT_RETURN_TYPE_OK;
+}
+
+/* Time at which a message was received, or -1 if it carries no timestamp.
+   Software timestamps are CLOCK_REALTIME, which sets *sw */
+static s64 qot_net_rx_stamp(struct msghdr *msg, int *sw)
+{
+    struct cmsghdr *cm;
+    struct timespec ts[3];
+    *sw = 1;
+    for (cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm))
+    {
+        if(cm->cmsg_level != SOL_SOCKET)
+            continue;
+        if(cm->cmsg_type == SCM_TIMESTAMPING)
+        {
+            memcpy(ts, CMSG_DATA(cm), sizeof(ts));
+            if(ts[2].tv_sec || ts[2].tv_nsec)
+            {
+                *sw = 0;
+                return (s64) ts[2].tv_sec * 1000000000LL + ts[2].tv_nsec;
+            }
+            return (s64) ts[0].tv_sec * 1000000000LL + ts[0].tv_nsec;
+        }
+        if(cm->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            memcpy(ts, CMSG_DATA(cm), sizeof(struct timespec));
+            return (s64) ts[0].tv_sec * 1000000000LL + ts[0].tv_nsec;
+        }
+    }
+    return -1;
+}
+
+int timeline_recvmmsg(timeline_t *timeline, int sock, struct mmsghdr *msgs,
+    utimepoint_t *arrival, unsigned int vlen, int flags, struct timespec *timeout)
+{
+    union {
+        struct cmsghdr align;
+        char buf[QOT_NET_RX_CONTROL];
+    } ctrl[QOT_NET_MAX_BATCH];
+    int own[QOT_NET_MAX_BATCH];
+    s64 core[QOT_NET_MAX_BATCH], tl[QOT_NET_MAX_BATCH];
+    s64 upper[QOT_NET_MAX_BATCH], lower[QOT_NET_MAX_BATCH];
+    unsigned int i, j, m, got = 0;
+    s64 now, offset;
+    int ret, sw, have_offset, unstamped;
+
+    if(!timeline || !msgs || !arrival)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < vlen; i += m)
+    {
+        m = (vlen - i < QOT_NET_MAX_BATCH) ? vlen - i : QOT_NET_MAX_BATCH;
+        for (j = 0; j < m; j++)
+        {
+            own[j] = !msgs[i + j].msg_hdr.msg_control;
+            if(own[j])
+            {
+                msgs[i + j].msg_hdr.msg_control = ctrl[j].buf;
+                msgs[i + j].msg_hdr.msg_controllen = sizeof(ctrl[j].buf);
+            }
+        }
+        ret = recvmmsg(sock, msgs + i, m, i ? flags | MSG_DONTWAIT : flags, i ? NULL : timeout);
+        unstamped = ret > 0 && timeline_getcoretime_ns(timeline, &now);
+
+        // Stamp the burst in core time and project it onto the timeline in one conversion
+        have_offset = 0;
+        for (j = 0; !unstamped && ret > 0 && j < (unsigned int) ret; j++)
+        {
+            core[j] = qot_net_rx_stamp(&msgs[i + j].msg_hdr, &sw);
+            if(core[j] < 0)
+            {
+                core[j] = now;
+            }
+            else if(sw)
+            {
+                if(!have_offset && qot_net_clock_offset(timeline, CLOCK_REALTIME, &offset))
+                    unstamped = 1;
+                have_offset = 1;
+                core[j] -= offset;
+            }
+        }
+        for (j = 0; j < m; j++)
+        {
+            if(!own[j])
+                continue;
+            msgs[i + j].msg_hdr.msg_control = NULL;
+            msgs[i + j].msg_hdr.msg_controllen = 0;
+        }
+        if(ret < 0)
+        {
+            if(got && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            return got ? (int) got : -1;
+        }
+        if(ret > 0 && (unstamped || timeline_core2rem_n(timeline, core, tl, upper, lower, (size_t) ret)))
+        {
+            errno = EACCES;
+            return got ? (int) got : -1;
+        }
+        for (j = 0; j < (unsigned int) ret; j++)
+        {
+            memset(&arrival[i + j], 0, sizeof(utimepoint_t));
+            TP_FROM_nSEC(arrival[i + j].estimate, tl[j]);
+            TL_FROM_nSEC(arrival[i + j].interval.above, upper[j] > tl[j] ? upper[j] - tl[j] : 0);
+            TL_FROM_nSEC(arrival[i + j].interval.below, tl[j] > lower[j] ? tl[j] - lower[j] : 0);
+        }
+        got += (unsigned int) ret;
+        if((unsigned int) ret < m)
+            break;
+    }
+    return (int) got;
+}
@@ -0,0 +1,132 @@
+/*
+ * @file qot_net.h
+ * @brief Network I/O scheduled and timestamped in timeline time
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QOT_STACK_SRC_API_C_QOT_NET_H
+#define QOT_STACK_SRC_API_C_QOT_NET_H
+
+#include <sys/socket.h>
+
+#include "qot.h"
+
+/* Most messages converted with one translation snapshot */
+#define QOT_NET_MAX_BATCH 64
+
+/* Most caller control data per message sent at a launch time */
+#define QOT_NET_MAX_CONTROL 256
+
+/* Launch-time transmission through SO_TXTIME and an ETF qdisc */
+typedef struct qot_txtime_config {
+    clockid_t clockid;                    /* Clock of the ETF qdisc (CLOCK_TAI)      */
+    uint32_t flags;                       /* SOF_TXTIME_* flags of the socket        */
+    timeinterval_t launch_error;          /* Launch error of the qdisc or the NIC    */
+} qot_txtime_config_t;
+
+/**
+ * @brief Enable launch-time transmission on a socket
+ * @param sock Socket whose packets leave through an ETF qdisc
+ * @param config Clock and flags matching the qdisc configuration
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t qot_txtime_enable(int sock, const qot_txtime_config_t *config);
+
+/**
+ * @brief Send a batch of messages, each at a timeline time
+ * @param timeline Pointer to a timeline struct
+ * @param sock Socket set up with qot_txtime_enable
+ * @param config The configuration the socket was set up with
+ * @param msgs Messages, with at most QOT_NET_MAX_CONTROL bytes of control data each
+ * @param launch Timeline time at which each message should leave
+ * @param achieved Returns the launch instant of each message and its uncertainty (may be NULL)
+ * @param vlen Number of messages
+ * @param flags Flags for sendmmsg
+ * @return Number of messages sent, or -1 with errno set
+ *
+ * Launch times are converted to the qdisc clock through the current
+ * timeline mapping, QOT_NET_MAX_BATCH messages at a time. When the core
+ * clock is not CLOCK_REALTIME (the TSC, for example), the offset from the
+ * core clock to the qdisc clock is measured for every batch by reading
+ * both back to back. The uncertainty
+ * of a launch instant is that of the timeline at the launch, widened by
+ * the launch error of the configuration. Messages whose launch time has
+ * already passed when they reach the qdisc are dropped by it.
+ **/
+int timeline_sendmmsg_at(timeline_t *timeline, int sock, const qot_txtime_config_t *config,
+    struct mmsghdr *msgs, const timepoint_t *launch, utimepoint_t *achieved,
+    unsigned int vlen, int flags);
+
+/**
+ * @brief Send a message at a timeline time
+ * @param timeline Pointer to a timeline struct
+ * @param sock Socket set up with qot_txtime_enable
+ * @param config The configuration the socket was set up with
+ * @param msg Message, with at most QOT_NET_MAX_CONTROL bytes of control data
+ * @param launch Timeline time at which the message should leave
+ * @param achieved Returns the launch instant and its uncertainty (may be NULL)
+ * @param flags Flags for sendmsg
+ * @return Number of bytes sent, or -1 with errno set
+ **/
+ssize_t timeline_sendmsg_at(timeline_t *timeline, int sock, const qot_txtime_config_t *config,
+    struct msghdr *msg, const timepoint_t *launch, utimepoint_t *achieved, int flags);
+
+/* Control data needed by the receive timestamp of one message */
+#define QOT_NET_RX_CONTROL CMSG_SPACE(3 * sizeof(struct timespec))
+
+/**
+ * @brief Timestamp received packets on a socket, in hardware if possible
+ * @param sock Socket to timestamp the packets of
+ * @param iface Interface to enable hardware timestamps on, or NULL for software only
+ * @return A status code indicating success (0) or other
+ *
+ * Hardware timestamps are taken to be in core time, as on platforms whose
+ * core clock is the PTP hardware clock. Software ones are CLOCK_REALTIME,
+ * and are moved onto the core clock when it is a different clock.
+ **/
+qot_return_t qot_rxtime_enable(int sock, const char *iface);
+
+/**
+ * @brief Receive a burst of messages stamped with their timeline arrival time
+ * @param timeline Pointer to a timeline struct
+ * @param sock Socket set up with qot_rxtime_enable (or SO_TIMESTAMPNS)
+ * @param msgs Messages to fill; ones without control data get a buffer for the timestamp
+ * @param arrival Returns the arrival time of each message and its uncertainty
+ * @param vlen Number of messages
+ * @param flags Flags for recvmmsg (MSG_WAITFORONE returns as soon as one arrived)
+ * @param timeout Timeout for recvmmsg (may be NULL)
+ * @return Number of messages received, or -1 with errno set
+ *
+ * Each message is stamped with its hardware timestamp, else its software
+ * one, else the core time at which the burst was returned. The whole burst
+ * is projected onto the timeline with one batched conversion, in bursts of
+ * at most QOT_NET_MAX_BATCH messages; after the first burst the call only
+ * takes messages that are already queued.
+ **/
+int timeline_recvmmsg(timeline_t *timeline, int sock, struct mmsghdr *msgs,
+    utimepoint_t *arrival, unsigned int vlen, int flags, struct timespec *timeout);
+
+#endif
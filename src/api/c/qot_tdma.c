@@ -0,0 +1,283 @@
+/*
+ * @file qot_tdma.c
+ * @brief TDMA slot runtime on top of the QoT C API
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* System includes */
+#include <stdlib.h>
+#include <string.h>
+
+/* This file includes */
+#include "qot_tdma.h"
+
+/* A slot schedule and the position of this node in it. The runtime is
+   driven by the one thread which owns the node's slots. */
+struct tdma {
+    timeline_t *timeline;                       /* Bound timeline               */
+    char node[QOT_MAX_NAMELEN];                 /* Name of this node            */
+    s64 period_ns;                              /* Cycle length                 */
+    s64 start_ns;                               /* Start of cycle 0             */
+    s64 margin_ns;                              /* Fixed part of guard bands    */
+    int num_slots;
+    s64 offset_ns[QOT_TDMA_MAX_SLOTS];          /* Slot starts within the cycle */
+    s64 length_ns[QOT_TDMA_MAX_SLOTS];          /* Slot lengths                 */
+    int mine[QOT_TDMA_MAX_SLOTS];               /* Slot is owned by this node   */
+    int owned;                                  /* Slots owned by this node     */
+    char owner[QOT_TDMA_MAX_SLOTS][QOT_MAX_NAMELEN];
+    s64 above_ns[QOT_TDMA_MAX_SLOTS];           /* Last report of each owner    */
+    s64 below_ns[QOT_TDMA_MAX_SLOTS];
+    int reported[QOT_TDMA_MAX_SLOTS];
+    int started;                                /* Cursor has been placed       */
+    uint64_t cycle;                             /* Cursor: next slot to visit   */
+    int slot;
+    tdma_stats_t stats;
+};
+
+tdma_t *tdma_t_create()
+{
+    return (tdma_t *) calloc(1, sizeof(tdma_t));
+}
+
+void tdma_t_destroy(tdma_t *tdma)
+{
+    free(tdma);
+}
+
+qot_return_t tdma_configure(tdma_t *tdma, timeline_t *timeline, const tdma_config_t *config)
+{
+    s64 end = 0;
+    int i;
+    if (!tdma || !timeline || !config || !config->node || !config->slots)
+        return QOT_RETURN_TYPE_ERR;
+    if (config->num_slots < 1 || config->num_slots > QOT_TDMA_MAX_SLOTS)
+        return QOT_RETURN_TYPE_ERR;
+
+    memset(tdma, 0, sizeof(tdma_t));
+    tdma->period_ns = (s64) TL_TO_nSEC(config->period);
+    tdma->start_ns = (s64) TP_TO_nSEC(config->start_offset);
+    tdma->margin_ns = (s64) TL_TO_nSEC(config->margin);
+    if (tdma->period_ns <= 0)
+        return QOT_RETURN_TYPE_ERR;
+
+    // Slots must be in order and must not overlap, within one cycle
+    for (i = 0; i < config->num_slots; i++)
+    {
+        tdma->offset_ns[i] = (s64) TL_TO_nSEC(config->slots[i].offset);
+        tdma->length_ns[i] = (s64) TL_TO_nSEC(config->slots[i].length);
+        if (tdma->offset_ns[i] < end || tdma->length_ns[i] <= 0)
+            return QOT_RETURN_TYPE_ERR;
+        end = tdma->offset_ns[i] + tdma->length_ns[i];
+        strncpy(tdma->owner[i], config->slots[i].owner, QOT_MAX_NAMELEN - 1);
+        tdma->mine[i] = !strncmp(config->slots[i].owner, config->node, QOT_MAX_NAMELEN);
+        tdma->owned += tdma->mine[i];
+    }
+    if (end > tdma->period_ns)
+        return QOT_RETURN_TYPE_ERR;
+
+    strncpy(tdma->node, config->node, QOT_MAX_NAMELEN - 1);
+    tdma->num_slots = config->num_slots;
+    tdma->timeline = timeline;
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t tdma_set_peer_uncertainty(tdma_t *tdma, const char *node, timeinterval_t *uncertainty)
+{
+    qot_return_t retval = QOT_RETURN_TYPE_ERR;
+    int i;
+    if (!tdma || !node || !uncertainty)
+        return QOT_RETURN_TYPE_ERR;
+    for (i = 0; i < tdma->num_slots; i++)
+    {
+        if (strncmp(tdma->owner[i], node, QOT_MAX_NAMELEN))
+            continue;
+        tdma->above_ns[i] = (s64) TL_TO_nSEC(uncertainty->above);
+        tdma->below_ns[i] = (s64) TL_TO_nSEC(uncertainty->below);
+        tdma->reported[i] = 1;
+        retval = QOT_RETURN_TYPE_OK;
+    }
+    return retval;
+}
+
+/* Uncertainty of this node at a timeline time, from the model in force */
+static qot_return_t tdma_uncertainty_at(tdma_t *tdma, s64 tl_ns, s64 *above_ns, s64 *below_ns)
+{
+    tl_translation_t params;
+    s64 core, tl, upper, lower;
+    if (timeline_get_parameters(tdma->timeline, &params))
+        return QOT_RETURN_TYPE_ERR;
+    if (timeline_rem2core_n(tdma->timeline, &tl_ns, &core, 1))
+        return QOT_RETURN_TYPE_ERR;
+    if (qot_core2rem_params_n(&params, &core, &tl, &upper, &lower, 1))
+        return QOT_RETURN_TYPE_ERR;
+    *above_ns = (upper > tl) ? upper - tl : 0;
+    *below_ns = (tl > lower) ? tl - lower : 0;
+    return QOT_RETURN_TYPE_OK;
+}
+
+/* Guard band needed at the start of a slot: the previous owner may still be
+   transmitting until its clock, which can run late by its upper uncertainty,
+   reads the end of its slot, and this node may wake as early as its lower
+   uncertainty. Idle time between the two slots already covers part of it. */
+static s64 tdma_guard(tdma_t *tdma, int slot, s64 above_ns, s64 below_ns)
+{
+    int prev = (slot + tdma->num_slots - 1) % tdma->num_slots;
+    s64 prev_end, need;
+    if (tdma->mine[prev])
+        return 0;
+    prev_end = tdma->offset_ns[prev] + tdma->length_ns[prev];
+    if (prev >= slot)
+        prev_end -= tdma->period_ns;
+    need = tdma->margin_ns + below_ns;
+    if (tdma->reported[prev])
+        need += tdma->above_ns[prev];
+    else
+        need += above_ns;
+    need -= tdma->offset_ns[slot] - prev_end;
+    if (need < 0)
+        return 0;
+    return need;
+}
+
+qot_return_t tdma_wait_slot(tdma_t *tdma, tdma_window_t *window)
+{
+    utimepoint_t now;
+    s64 now_ns, slot_ns, end_ns, guard_ns, above_ns, below_ns;
+    int slot, first;
+    uint64_t cycle;
+
+    if (!tdma || !tdma->timeline || !tdma->owned || !window)
+        return QOT_RETURN_TYPE_ERR;
+    if (timeline_gettime(tdma->timeline, &now))
+        return QOT_RETURN_TYPE_ERR;
+    now_ns = (s64) TP_TO_nSEC(now.estimate);
+
+    // Place the cursor on the cycle in progress at the first call
+    first = !tdma->started;
+    if (first)
+    {
+        tdma->cycle = 0;
+        if (now_ns > tdma->start_ns)
+            tdma->cycle = (uint64_t) ((now_ns - tdma->start_ns) / tdma->period_ns);
+        tdma->slot = 0;
+        tdma->started = 1;
+    }
+    else if (now_ns - tdma->period_ns > tdma->start_ns + (s64) (tdma->cycle + 1) * tdma->period_ns)
+    {
+        // Skip the whole cycles which went by since the last slot
+        cycle = (uint64_t) ((now_ns - tdma->start_ns) / tdma->period_ns) - 1;
+        tdma->stats.missed += (cycle - tdma->cycle) * (uint64_t) tdma->owned;
+        for (slot = tdma->slot; slot < tdma->num_slots; slot++)
+            tdma->stats.missed += (uint64_t) tdma->mine[slot];
+        tdma->stats.missed -= (uint64_t) tdma->owned;
+        tdma->cycle = cycle;
+        tdma->slot = 0;
+    }
+
+    // Find the next owned slot which has not ended yet
+    for (;;)
+    {
+        slot = tdma->slot;
+        cycle = tdma->cycle;
+        if (++tdma->slot == tdma->num_slots)
+        {
+            tdma->slot = 0;
+            tdma->cycle++;
+        }
+        if (!tdma->mine[slot])
+            continue;
+        slot_ns = tdma->start_ns + (s64) cycle * tdma->period_ns + tdma->offset_ns[slot];
+        end_ns = slot_ns + tdma->length_ns[slot];
+        if (end_ns > now_ns)
+            break;
+        if (!first)
+            tdma->stats.missed++;
+    }
+
+    // The guard band must hold when the slot starts, not only now
+    if (tdma_uncertainty_at(tdma, slot_ns, &above_ns, &below_ns))
+        return QOT_RETURN_TYPE_ERR;
+    guard_ns = tdma_guard(tdma, slot, above_ns, below_ns);
+    if (guard_ns >= tdma->length_ns[slot])
+    {
+        guard_ns = tdma->length_ns[slot];
+        tdma->stats.starved++;
+    }
+
+    memset(window, 0, sizeof(tdma_window_t));
+    window->cycle = cycle;
+    window->slot = slot;
+    TP_FROM_nSEC(window->start, slot_ns + guard_ns);
+    TP_FROM_nSEC(window->end, end_ns);
+    TL_FROM_nSEC(window->guard, guard_ns);
+
+    tdma->stats.slots++;
+    tdma->stats.nominal_ns += (uint64_t) tdma->length_ns[slot];
+    tdma->stats.usable_ns += (uint64_t) (tdma->length_ns[slot] - guard_ns);
+    tdma->stats.guard = window->guard;
+    if (timelength_cmp(&tdma->stats.max_guard, &window->guard) > 0)
+        tdma->stats.max_guard = window->guard;
+
+    // Wake at the start of the usable part of the slot
+    if (slot_ns + guard_ns <= now_ns)
+    {
+        window->wakeup = now;
+        return QOT_RETURN_TYPE_OK;
+    }
+    window->wakeup.estimate = window->start;
+    return timeline_waituntil(tdma->timeline, &window->wakeup);
+}
+
+qot_return_t tdma_slot_done(tdma_t *tdma, tdma_window_t *window)
+{
+    utimepoint_t now;
+    s64 now_ns, start_ns, end_ns;
+    if (!tdma || !window)
+        return QOT_RETURN_TYPE_ERR;
+    if (timeline_gettime(tdma->timeline, &now))
+        return QOT_RETURN_TYPE_ERR;
+    now_ns = (s64) TP_TO_nSEC(now.estimate);
+    start_ns = (s64) TP_TO_nSEC(window->start);
+    end_ns = (s64) TP_TO_nSEC(window->end);
+    if (now_ns > end_ns)
+    {
+        tdma->stats.overruns++;
+        if (now_ns - end_ns > tdma->stats.max_overrun_ns)
+            tdma->stats.max_overrun_ns = now_ns - end_ns;
+        now_ns = end_ns;
+    }
+    if (now_ns > start_ns)
+        tdma->stats.used_ns += (uint64_t) (now_ns - start_ns);
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t tdma_get_stats(tdma_t *tdma, tdma_stats_t *stats)
+{
+    if (!tdma || !stats)
+        return QOT_RETURN_TYPE_ERR;
+    *stats = tdma->stats;
+    return QOT_RETURN_TYPE_OK;
+}
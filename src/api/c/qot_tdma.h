@@ -0,0 +1,144 @@
+/*
+ * @file qot_tdma.h
+ * @brief TDMA slot runtime on top of the QoT C API
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QOT_STACK_SRC_API_C_QOT_TDMA_H
+#define QOT_STACK_SRC_API_C_QOT_TDMA_H
+
+#include "qot.h"
+
+/* Most slots in one TDMA cycle */
+#define QOT_TDMA_MAX_SLOTS 64
+
+/* Opaque type */
+typedef struct tdma tdma_t;
+
+/* A slot of the TDMA cycle */
+typedef struct tdma_slot {
+    char owner[QOT_MAX_NAMELEN];          /* Node which transmits in the slot        */
+    timelength_t offset;                  /* Start of the slot within the cycle      */
+    timelength_t length;                  /* Nominal length of the slot              */
+} tdma_slot_t;
+
+/* Schedule of the cycle, identical on every participant */
+typedef struct tdma_config {
+    const char *node;                     /* Name of this node in the slot owners    */
+    timelength_t period;                  /* Length of one cycle                     */
+    timepoint_t start_offset;             /* Timeline time at which cycle 0 starts   */
+    timelength_t margin;                  /* Fixed guard added for wakeup latency    */
+    const tdma_slot_t *slots;             /* Slots, in order of their offset         */
+    int num_slots;
+} tdma_config_t;
+
+/* The part of a slot this node may transmit in */
+typedef struct tdma_window {
+    uint64_t cycle;                       /* Cycle the slot belongs to               */
+    int slot;                             /* Index of the slot in the schedule       */
+    timepoint_t start;                    /* Slot start, after the guard band        */
+    timepoint_t end;                      /* Nominal end of the slot                 */
+    timelength_t guard;                   /* Guard band taken from the slot start    */
+    utimepoint_t wakeup;                  /* Time at which this node woke up         */
+} tdma_window_t;
+
+/* Slot accounting of this node */
+typedef struct tdma_stats {
+    uint64_t slots;                       /* Owned slots this node woke up for       */
+    uint64_t missed;                      /* Owned slots over before it asked for them */
+    uint64_t starved;                     /* Slots whose guard band filled the slot  */
+    uint64_t overruns;                    /* Slots finished after their end          */
+    int64_t max_overrun_ns;               /* Worst time past the end of a slot       */
+    uint64_t nominal_ns;                  /* Total nominal length of owned slots     */
+    uint64_t usable_ns;                   /* Total length left after guard bands     */
+    uint64_t used_ns;                     /* Total time from window start to done    */
+    timelength_t guard;                   /* Guard band of the latest slot           */
+    timelength_t max_guard;               /* Largest guard band so far               */
+} tdma_stats_t;
+
+/**
+ * @brief Constructor for the TDMA runtime
+ * @return Pointer to a TDMA runtime, or NULL on failure
+ **/
+tdma_t *tdma_t_create();
+
+/**
+ * @brief Destructor for the TDMA runtime
+ * @param tdma Pointer to a TDMA runtime
+ **/
+void tdma_t_destroy(tdma_t *tdma);
+
+/**
+ * @brief Load a slot schedule for a bound timeline
+ * @param tdma Pointer to a TDMA runtime
+ * @param timeline Pointer to a bound timeline struct
+ * @param config Slot schedule and the name of this node
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t tdma_configure(tdma_t *tdma, timeline_t *timeline, const tdma_config_t *config);
+
+/**
+ * @brief Record the latest uncertainty a peer reported for its timeline
+ * @param tdma Pointer to a TDMA runtime
+ * @param node Name of the peer, as in the slot owners
+ * @param uncertainty Distances below and above its estimate
+ * @return A status code indicating success (0) or other
+ *
+ * Until a peer reports, its uncertainty is taken to be that of this node.
+ **/
+qot_return_t tdma_set_peer_uncertainty(tdma_t *tdma, const char *node, timeinterval_t *uncertainty);
+
+/**
+ * @brief Block until the next slot owned by this node starts
+ * @param tdma Pointer to a TDMA runtime
+ * @param window Returns the part of the slot this node may transmit in
+ * @return A status code indicating success (0) or other
+ *
+ * The guard band before each slot covers the previous slot's owner running
+ * late (the upper side of its latest report) and this node running early
+ * (the lower side of its own uncertainty at the start of the slot), less any
+ * idle time between the two slots. A slot whose guard band fills it is returned
+ * with start equal to end so that the caller can skip it.
+ **/
+qot_return_t tdma_wait_slot(tdma_t *tdma, tdma_window_t *window);
+
+/**
+ * @brief Report the end of transmission in a slot
+ * @param tdma Pointer to a TDMA runtime
+ * @param window The window returned by tdma_wait_slot
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t tdma_slot_done(tdma_t *tdma, tdma_window_t *window);
+
+/**
+ * @brief Get the slot accounting of this node
+ * @param tdma Pointer to a TDMA runtime
+ * @param stats Returns the counters since tdma_configure
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t tdma_get_stats(tdma_t *tdma, tdma_stats_t *stats);
+
+#endif
@@ -0,0 +1,458 @@
+/*
+ * @file qot_trace.c
+ * @brief Binary trace records stamped in core time and flushed in timeline time
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+/* System includes */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* This file includes */
+#include "qot_trace.h"
+
+/* Records per thread buffer unless configured */
+#define QOT_TRACE_DEFAULT_RECORDS 4096
+
+/* Records projected onto the timeline with one conversion */
+#define QOT_TRACE_CHUNK 256
+
+/* Single-producer ring of one thread: the thread moves head, the flush tail.
+   A ring belongs to its thread, which reuses it from session to session and
+   frees it when it exits, so that no other thread ever frees it under it. */
+typedef struct qot_trace_buffer {
+    struct qot_trace_buffer *next;
+    uint32_t tid;
+    uint32_t records;                     /* Ring size, a power of two               */
+    uint64_t gen;                         /* Session the ring was last attached to   */
+    uint64_t head __attribute__((aligned(64)));
+    int busy;                             /* Owner is taking a record                */
+    uint64_t dropped;                     /* Records lost to a full ring             */
+    uint64_t tail __attribute__((aligned(64)));
+    qot_trace_record_t ring[];
+} qot_trace_buffer_t;
+
+typedef struct qot_tracer {
+    pthread_mutex_t lock;                 /* File, buffer list and names             */
+    pthread_cond_t wake;                  /* Wakes the background flush              */
+    int enabled;                          /* Atomic, producers check it per record   */
+    uint64_t gen;                         /* Atomic, moves on at each open and close */
+    timeline_t *timeline;
+    tl_translation_t params;              /* Projection of the last flush            */
+    tl_translation_t prev;                /* The one it replaced                     */
+    int have_params;                      /* params (1) and prev (2) are valid       */
+    FILE *file;
+    uint32_t records;
+    qot_trace_buffer_t *buffers;
+    qot_trace_name_t *names;              /* Names not yet written to the file       */
+    uint32_t num_names;
+    uint64_t written;
+    uint64_t dropped;                     /* Drops of rings whose thread exited      */
+    uint32_t threads;
+    int flush_ms;
+    int stop;
+    pthread_t flusher;
+} qot_tracer_t;
+
+static qot_tracer_t tracer = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+static __thread qot_trace_buffer_t *trace_local;
+
+/* Frees the ring of an exiting thread */
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+static qot_return_t qot_trace_flush_locked(void);
+
+/* Write out and free the ring of an exiting thread */
+static void qot_trace_detach(void *arg)
+{
+    qot_trace_buffer_t *buf = (qot_trace_buffer_t *) arg, **link;
+    pthread_mutex_lock(&tracer.lock);
+    for (link = &tracer.buffers; *link; link = &(*link)->next)
+    {
+        if (*link != buf)
+            continue;
+        qot_trace_flush_locked();
+        *link = buf->next;
+        tracer.dropped += buf->dropped;
+        break;
+    }
+    pthread_mutex_unlock(&tracer.lock);
+    free(buf);
+}
+
+static void qot_trace_make_key(void)
+{
+    pthread_key_create(&trace_key, qot_trace_detach);
+}
+
+/* Attach the calling thread's ring to the current session */
+static qot_trace_buffer_t *qot_trace_attach(void)
+{
+    qot_trace_buffer_t *buf = trace_local;
+    pthread_once(&trace_key_once, qot_trace_make_key);
+    pthread_mutex_lock(&tracer.lock);
+    if (!tracer.enabled)
+    {
+        pthread_mutex_unlock(&tracer.lock);
+        return NULL;
+    }
+
+    // The ring is not linked into the session (close unlinks them all), so it
+    // can be resized by its owner alone
+    if (buf && buf->records != tracer.records)
+    {
+        free(buf);
+        buf = NULL;
+    }
+    if (!buf)
+        buf = (qot_trace_buffer_t *) aligned_alloc(64, sizeof(qot_trace_buffer_t)
+            + (size_t) tracer.records * sizeof(qot_trace_record_t));
+    if (buf)
+    {
+        memset(buf, 0, sizeof(qot_trace_buffer_t));
+        buf->tid = (uint32_t) syscall(SYS_gettid);
+        buf->records = tracer.records;
+        buf->gen = tracer.gen;
+        buf->next = tracer.buffers;
+        tracer.buffers = buf;
+        tracer.threads++;
+    }
+    trace_local = buf;
+    pthread_setspecific(trace_key, buf);
+    pthread_mutex_unlock(&tracer.lock);
+    return buf;
+}
+
+void qot_trace(uint32_t id, uint64_t arg0, uint64_t arg1)
+{
+    qot_trace_buffer_t *buf = trace_local;
+    qot_trace_record_t *rec;
+    uint64_t head;
+
+    if (!__atomic_load_n(&tracer.enabled, __ATOMIC_RELAXED))
+        return;
+    if (!buf || buf->gen != __atomic_load_n(&tracer.gen, __ATOMIC_ACQUIRE))
+    {
+        buf = qot_trace_attach();
+        if (!buf)
+            return;
+    }
+
+    // Close disables tracing and then waits for busy rings, so a record either
+    // sees tracing disabled here or is complete before close drains the ring
+    __atomic_store_n(&buf->busy, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&tracer.enabled, __ATOMIC_SEQ_CST)
+        || buf->gen != __atomic_load_n(&tracer.gen, __ATOMIC_RELAXED))
+        goto done;
+    head = buf->head;
+    if (head - __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE) >= buf->records)
+    {
+        __atomic_store_n(&buf->dropped, buf->dropped + 1, __ATOMIC_RELAXED);
+        goto done;
+    }
+    rec = &buf->ring[head & (buf->records - 1)];
+    if (timeline_getcoretime_ns(tracer.timeline, &rec->core_ns))
+        goto done;
+    rec->tid = buf->tid;
+    rec->id = id;
+    rec->arg[0] = arg0;
+    rec->arg[1] = arg1;
+    __atomic_store_n(&buf->head, head + 1, __ATOMIC_RELEASE);
+done:
+    __atomic_store_n(&buf->busy, 0, __ATOMIC_RELEASE);
+}
+
+static int qot_trace_write_block(uint32_t type, const void *data, size_t size, uint32_t count)
+{
+    qot_trace_block_t block = { type, count };
+    if (fwrite(&block, sizeof(block), 1, tracer.file) != 1)
+        return -1;
+    if (count && fwrite(data, size, count, tracer.file) != count)
+        return -1;
+    return 0;
+}
+
+static uint32_t qot_trace_saturate(int64_t ns)
+{
+    if (ns < 0)
+        return 0;
+    return ns > UINT32_MAX ? UINT32_MAX : (uint32_t) ns;
+}
+
+/* Take the projection for this flush, recording it in the file when it changed */
+static qot_return_t qot_trace_update_params(void)
+{
+    tl_translation_t params;
+    if (timeline_get_parameters(tracer.timeline, &params))
+        return QOT_RETURN_TYPE_ERR;
+    if (tracer.have_params && !memcmp(&params, &tracer.params, sizeof(params)))
+        return QOT_RETURN_TYPE_OK;
+    if (qot_trace_write_block(QOT_TRACE_BLOCK_PARAMS, &params, sizeof(params), 1))
+        return QOT_RETURN_TYPE_ERR;
+    if (tracer.have_params)
+    {
+        tracer.prev = tracer.params;
+        tracer.have_params = 2;
+    }
+    else
+    {
+        tracer.have_params = 1;
+    }
+    tracer.params = params;
+    return QOT_RETURN_TYPE_OK;
+}
+
+/* Drain every thread buffer into the file (tracer lock held) */
+static qot_return_t qot_trace_flush_locked(void)
+{
+    qot_trace_entry_t entries[QOT_TRACE_CHUNK];
+    s64 core[QOT_TRACE_CHUNK], tl[QOT_TRACE_CHUNK];
+    s64 upper[QOT_TRACE_CHUNK], lower[QOT_TRACE_CHUNK];
+    qot_trace_buffer_t *buf;
+    uint64_t head, tail;
+    uint32_t i, n;
+
+    if (!tracer.file)
+        return QOT_RETURN_TYPE_ERR;
+    if (qot_trace_update_params())
+        return QOT_RETURN_TYPE_ERR;
+
+    // Names first, so that the decoder knows them before their records
+    if (tracer.num_names)
+    {
+        if (qot_trace_write_block(QOT_TRACE_BLOCK_NAMES, tracer.names,
+            sizeof(qot_trace_name_t), tracer.num_names))
+            return QOT_RETURN_TYPE_ERR;
+        tracer.num_names = 0;
+    }
+
+    for (buf = tracer.buffers; buf; buf = buf->next)
+    {
+        head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+        for (tail = buf->tail; tail < head; tail += n)
+        {
+            n = (head - tail < QOT_TRACE_CHUNK) ? (uint32_t) (head - tail) : QOT_TRACE_CHUNK;
+            for (i = 0; i < n; i++)
+            {
+                entries[i].rec = buf->ring[(tail + i) & (buf->records - 1)];
+                core[i] = entries[i].rec.core_ns;
+            }
+            if (qot_core2rem_params_n(&tracer.params, core, tl, upper, lower, n))
+                return QOT_RETURN_TYPE_ERR;
+            for (i = 0; i < n; i++)
+            {
+                // Records from before the last discipline change take the
+                // projection that was in force when they were taken
+                if (tracer.have_params == 2 && core[i] < tracer.params.last)
+                    qot_core2rem_params_n(&tracer.prev, &core[i], &tl[i], &upper[i], &lower[i], 1);
+                entries[i].tl_ns = tl[i];
+                entries[i].below_ns = qot_trace_saturate(tl[i] - lower[i]);
+                entries[i].above_ns = qot_trace_saturate(upper[i] - tl[i]);
+            }
+            // The slots can be reused once they are copied out
+            __atomic_store_n(&buf->tail, tail + n, __ATOMIC_RELEASE);
+            if (qot_trace_write_block(QOT_TRACE_BLOCK_ENTRIES, entries, sizeof(qot_trace_entry_t), n))
+                return QOT_RETURN_TYPE_ERR;
+            tracer.written += n;
+        }
+    }
+    fflush(tracer.file);
+    return QOT_RETURN_TYPE_OK;
+}
+
+static void *qot_trace_flush_thread(void *arg)
+{
+    struct timespec deadline;
+    (void) arg;
+    pthread_mutex_lock(&tracer.lock);
+    while (!tracer.stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += tracer.flush_ms / 1000;
+        deadline.tv_nsec += (long) (tracer.flush_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&tracer.wake, &tracer.lock, &deadline);
+        if (!tracer.stop)
+            qot_trace_flush_locked();
+    }
+    pthread_mutex_unlock(&tracer.lock);
+    return NULL;
+}
+
+qot_return_t qot_trace_open(timeline_t *timeline, const char *path, const qot_trace_config_t *config)
+{
+    qot_trace_header_t header;
+    uint32_t records = QOT_TRACE_DEFAULT_RECORDS;
+
+    if (!timeline || !path)
+        return QOT_RETURN_TYPE_ERR;
+    if (config && config->records)
+    {
+        if (config->records & (config->records - 1))
+            return QOT_RETURN_TYPE_ERR;
+        records = config->records;
+    }
+
+    pthread_mutex_lock(&tracer.lock);
+    if (tracer.file)
+    {
+        pthread_mutex_unlock(&tracer.lock);
+        return QOT_RETURN_TYPE_ERR;
+    }
+    memset(&header, 0, sizeof(header));
+    header.magic = QOT_TRACE_MAGIC;
+    header.version = QOT_TRACE_VERSION;
+    header.entry_size = sizeof(qot_trace_entry_t);
+    if (timeline_get_uuid(timeline, header.timeline))
+    {
+        pthread_mutex_unlock(&tracer.lock);
+        return QOT_RETURN_TYPE_ERR;
+    }
+    tracer.file = fopen(path, "wb");
+    if (!tracer.file || fwrite(&header, sizeof(header), 1, tracer.file) != 1)
+    {
+        if (tracer.file)
+            fclose(tracer.file);
+        tracer.file = NULL;
+        pthread_mutex_unlock(&tracer.lock);
+        return QOT_RETURN_TYPE_ERR;
+    }
+    tracer.timeline = timeline;
+    tracer.have_params = 0;
+    tracer.records = records;
+    tracer.written = 0;
+    tracer.dropped = 0;
+    tracer.threads = 0;
+    tracer.stop = 0;
+    tracer.flush_ms = config ? config->flush_ms : 0;
+    __atomic_add_fetch(&tracer.gen, 1, __ATOMIC_RELEASE);
+    if (tracer.flush_ms > 0 && pthread_create(&tracer.flusher, NULL, qot_trace_flush_thread, NULL))
+        tracer.flush_ms = 0;
+    __atomic_store_n(&tracer.enabled, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&tracer.lock);
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t qot_trace_name(uint32_t id, const char *name)
+{
+    qot_trace_name_t *names;
+    if (!name)
+        return QOT_RETURN_TYPE_ERR;
+    pthread_mutex_lock(&tracer.lock);
+    names = (qot_trace_name_t *) realloc(tracer.names, (tracer.num_names + 1) * sizeof(qot_trace_name_t));
+    if (!names)
+    {
+        pthread_mutex_unlock(&tracer.lock);
+        return QOT_RETURN_TYPE_ERR;
+    }
+    tracer.names = names;
+    memset(&names[tracer.num_names], 0, sizeof(qot_trace_name_t));
+    names[tracer.num_names].id = id;
+    strncpy(names[tracer.num_names].name, name, QOT_TRACE_NAMELEN - 1);
+    tracer.num_names++;
+    pthread_mutex_unlock(&tracer.lock);
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t qot_trace_flush(void)
+{
+    qot_return_t retval;
+    pthread_mutex_lock(&tracer.lock);
+    retval = qot_trace_flush_locked();
+    pthread_mutex_unlock(&tracer.lock);
+    return retval;
+}
+
+qot_return_t qot_trace_get_stats(qot_trace_stats_t *stats)
+{
+    qot_trace_buffer_t *buf;
+    if (!stats)
+        return QOT_RETURN_TYPE_ERR;
+    pthread_mutex_lock(&tracer.lock);
+    memset(stats, 0, sizeof(qot_trace_stats_t));
+    stats->written = tracer.written;
+    stats->threads = tracer.threads;
+    stats->dropped = tracer.dropped;
+    for (buf = tracer.buffers; buf; buf = buf->next)
+        stats->dropped += __atomic_load_n(&buf->dropped, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&tracer.lock);
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t qot_trace_close(void)
+{
+    qot_trace_buffer_t *buf;
+    qot_return_t retval;
+
+    pthread_mutex_lock(&tracer.lock);
+    if (!tracer.file)
+    {
+        pthread_mutex_unlock(&tracer.lock);
+        return QOT_RETURN_TYPE_ERR;
+    }
+    __atomic_store_n(&tracer.enabled, 0, __ATOMIC_SEQ_CST);
+    if (tracer.flush_ms > 0)
+    {
+        tracer.stop = 1;
+        pthread_cond_signal(&tracer.wake);
+        pthread_mutex_unlock(&tracer.lock);
+        pthread_join(tracer.flusher, NULL);
+        pthread_mutex_lock(&tracer.lock);
+    }
+
+    // Let the records being taken complete, so that they are written below
+    for (buf = tracer.buffers; buf; buf = buf->next)
+        while (__atomic_load_n(&buf->busy, __ATOMIC_SEQ_CST))
+            sched_yield();
+    retval = qot_trace_flush_locked();
+    if (fclose(tracer.file))
+        retval = QOT_RETURN_TYPE_ERR;
+    tracer.file = NULL;
+
+    // The rings stay with their threads, which reuse them in the next session
+    tracer.buffers = NULL;
+    free(tracer.names);
+    tracer.names = NULL;
+    tracer.num_names = 0;
+    __atomic_add_fetch(&tracer.gen, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&tracer.lock);
+    return retval;
+}
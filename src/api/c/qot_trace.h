@@ -0,0 +1,160 @@
+/*
+ * @file qot_trace.h
+ * @brief Binary trace records stamped in core time and flushed in timeline time
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QOT_STACK_SRC_API_C_QOT_TRACE_H
+#define QOT_STACK_SRC_API_C_QOT_TRACE_H
+
+#include "qot.h"
+
+/* Trace files start with this header, followed by blocks */
+#define QOT_TRACE_MAGIC   0x45434152544f51ULL   /* "QOTRACE" */
+#define QOT_TRACE_VERSION 2
+
+/* Longest event name, including the terminator */
+#define QOT_TRACE_NAMELEN 56
+
+/* Record taken by a thread: fixed layout, stamped with the raw core time */
+typedef struct qot_trace_record {
+    int64_t core_ns;                      /* Core time of the record                 */
+    uint32_t tid;                         /* Thread which took the record            */
+    uint32_t id;                          /* Application event id                    */
+    uint64_t arg[2];                      /* Application arguments                   */
+} qot_trace_record_t;
+
+/* Record as written to the trace file, projected onto the timeline */
+typedef struct qot_trace_entry {
+    qot_trace_record_t rec;
+    int64_t tl_ns;                        /* Timeline time of the record             */
+    uint32_t below_ns;                    /* Uncertainty below it (saturating)       */
+    uint32_t above_ns;                    /* Uncertainty above it (saturating)       */
+} qot_trace_entry_t;
+
+/* Name of an event id, written once before its first records */
+typedef struct qot_trace_name {
+    uint32_t id;
+    char name[QOT_TRACE_NAMELEN];
+    uint32_t reserved;
+} qot_trace_name_t;
+
+/* File layout: a header, then blocks of names or entries */
+typedef struct qot_trace_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    char timeline[QOT_MAX_NAMELEN];       /* Timeline the entries are projected on   */
+} qot_trace_header_t;
+
+/* A PARAMS block holds the translation parameters (tl_translation_t) of the
+   entries that follow it, until the next one. Entries older than its 'last'
+   field were projected with the PARAMS block before it, the discipline in
+   force when they were taken */
+typedef enum {
+    QOT_TRACE_BLOCK_NAMES   = 1,          /* count qot_trace_name_t follow           */
+    QOT_TRACE_BLOCK_ENTRIES = 2,          /* count qot_trace_entry_t follow          */
+    QOT_TRACE_BLOCK_PARAMS  = 3,          /* count tl_translation_t follow (one)     */
+} qot_trace_block_type_t;
+
+typedef struct qot_trace_block {
+    uint32_t type;
+    uint32_t count;
+} qot_trace_block_t;
+
+/* Tracer options (zero fields select the defaults) */
+typedef struct qot_trace_config {
+    uint32_t records;                     /* Records per thread buffer (power of 2)  */
+    int flush_ms;                         /* Background flush period, 0 for none     */
+} qot_trace_config_t;
+
+/* Tracer counters */
+typedef struct qot_trace_stats {
+    uint64_t written;                     /* Records flushed to the file             */
+    uint64_t dropped;                     /* Records lost to full thread buffers     */
+    uint32_t threads;                     /* Threads which took records              */
+} qot_trace_stats_t;
+
+/**
+ * @brief Start tracing into a file, projecting records onto a timeline
+ * @param timeline Pointer to a bound timeline struct
+ * @param path File to write the trace to
+ * @param config Tracer options, or NULL for the defaults
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t qot_trace_open(timeline_t *timeline, const char *path, const qot_trace_config_t *config);
+
+/**
+ * @brief Name an event id in the trace
+ * @param id Application event id
+ * @param name Name printed by the decoder
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t qot_trace_name(uint32_t id, const char *name);
+
+/**
+ * @brief Take a trace record in the calling thread
+ * @param id Application event id
+ * @param arg0 First application argument
+ * @param arg1 Second application argument
+ *
+ * Never blocks: the record goes into a buffer of the calling thread, and is
+ * dropped (and counted) when that buffer is full. The core time is read by
+ * timeline_getcoretime_ns, which makes no syscall when qot_x86 provides the
+ * core clock (TSC or CLOCK_REALTIME) and one ioctl otherwise.
+ **/
+void qot_trace(uint32_t id, uint64_t arg0, uint64_t arg1);
+
+/**
+ * @brief Write the buffered records of all threads to the file
+ * @return A status code indicating success (0) or other
+ *
+ * Records are projected onto the timeline here, one batched conversion per
+ * buffer drained, with the discipline in force at the flush. A record taken
+ * before the latest discipline change uses the one seen by the previous
+ * flush instead, so flush more often than the timeline is disciplined. The
+ * parameters are written to the file with each change (see PARAMS blocks).
+ **/
+qot_return_t qot_trace_flush(void);
+
+/**
+ * @brief Get the tracer counters
+ * @param stats Returns the counters since qot_trace_open
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t qot_trace_get_stats(qot_trace_stats_t *stats);
+
+/**
+ * @brief Flush and stop tracing
+ * @return A status code indicating success (0) or other
+ *
+ * Records other threads are taking at the time complete and are written,
+ * later ones are discarded. Thread buffers are kept for the next session and
+ * freed when their threads exit, after their records are written.
+ **/
+qot_return_t qot_trace_close(void);
+
+#endif
@@ -39,15 +39,13 @@
 using namespace qot;
 
 
-NewUserHandler::NewUserHandler(std::vector<std::string>& ClusterNodes, std::vector<std::string>& AliveNodes, qot_node_callback_t callback, dds::sub::status::DataState& dataState)
-: dataState(dataState), ClusterNodes(ClusterNodes), AliveNodes(AliveNodes) 
+NewUserHandler::NewUserHandler(ClusterMembership& membership, dds::sub::status::DataState& dataState)
+: dataState(dataState), membership(membership)
 {
-    node_callback = callback;
 }
 
 void NewUserHandler::operator() (dds::sub::DataReader<qot_msgs::NameService>& dr)
 {
-    qot_node_t node_info;
     dds::sub::status::DataState newDataState;
     newDataState << dds::sub::status::SampleState::not_read()
             << dds::sub::status::ViewState::new_view()
@@ -55,35 +53,22 @@ void NewUserHandler::operator() (dds::sub::DataReader<qot_msgs::NameService>& dr
     /** Read the new users */
     dds::sub::LoanedSamples<qot_msgs::NameService> messages = dr.select().state(newDataState).read();
 
-    /** Output each new user's user name and add it to the vector */
+    /** Mark each new user alive, the application hears of them once the dispatch is done */
     for (dds::sub::LoanedSamples<qot_msgs::NameService>::const_iterator message = messages.begin();
         message < messages.end(); ++message)
     {
-        if(message->info().valid())
-        {
+        if(message->info().valid() && membership.Join(message->data().name(), message->data().userID()))
             std::cout << "New user: " << message->data().name() << std::endl;
-            // Add to List of Active Nodes
-            AliveNodes.insert(std::upper_bound(AliveNodes.begin(), AliveNodes.end(), message->data().name()), message->data().name());
-            // Populate Callback information
-            strcpy(node_info.name, (message->data().name()).c_str()); 
-            node_info.userID = message->data().userID();
-            node_info.status = QOT_NODE_JOINED;
-            // Trigger a Callback to the application
-            if(node_callback != NULL)
-                node_callback(&node_info);
-        }
     }
 }
 
-UserLeftHandler::UserLeftHandler(std::vector<std::string>& ClusterNodes, std::vector<std::string>& AliveNodes, qot_node_callback_t callback, dds::sub::DataReader<qot_msgs::NameService>& nameServiceReader)
-: nameServiceReader(nameServiceReader), prevAliveCount(0), ClusterNodes(ClusterNodes), AliveNodes(AliveNodes) 
+UserLeftHandler::UserLeftHandler(ClusterMembership& membership, dds::sub::DataReader<qot_msgs::NameService>& nameServiceReader)
+: nameServiceReader(nameServiceReader), prevAliveCount(0), membership(membership)
 {
-    node_callback = callback;
 }
 
 void UserLeftHandler::operator() (dds::core::Entity& e)
 {
-    qot_node_t node_info;
     dds::sub::DataReader<qot_msgs::TimelineMsgingType>& MessageReader
         = (dds::sub::DataReader<qot_msgs::TimelineMsgingType>&)e;
 
@@ -101,24 +86,12 @@ void UserLeftHandler::operator() (dds::core::Entity& e)
         dds::sub::LoanedSamples<qot_msgs::NameService> users
             = nameServiceReader.select().state(notAliveDataState).take();
 
-         /** Output the number of messages sent by each user that has left */
+        /** Remove each user that has left from the alive nodes */
         for (dds::sub::LoanedSamples<qot_msgs::NameService>::const_iterator user = users.begin();
             user < users.end(); ++user)
         {
-            if(user->info().valid())
-            {
+            if(user->info().valid() && membership.Leave(user->data().name()))
                 std::cout << "Departed user: " << user->data().name() << "\n";
-                // Remove User from Alive Nodes
-                AliveNodes.erase(std::remove(AliveNodes.begin(), AliveNodes.end(), user->data().name()), AliveNodes.end());
-                 // Populate Callback information
-                strcpy(node_info.name, (user->data().name()).c_str()); 
-                node_info.userID = user->data().userID();
-                node_info.status = QOT_NODE_LEFT;
-                // Trigger a Callback to the application
-                if(node_callback != NULL)
-                    node_callback(&node_info);
-                //terminated = true;
-            }
         }
     }
     prevAliveCount = livChangedStatus.alive_count();
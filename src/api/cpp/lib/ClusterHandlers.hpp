@@ -49,6 +49,9 @@ extern "C"
     #include "../../../qot_types.h"
 }
 
+// Cluster membership
+#include "../transport/ClusterMembership.hpp"
+
 /**
  * The logic utilises WaitSets and two DataReaders in order to detect
  * when a user has joined or left the message board. It will display the username
@@ -62,7 +65,7 @@ namespace qot  {
 
     /**
      * The NewUserHandler will be called when the ReadCondition triggers.
-     * It will output a message showing the user name of the user that has joined.
+     * It marks the users that have joined alive in the membership.
      */
     class NewUserHandler
     {
@@ -70,21 +73,18 @@ namespace qot  {
         /**
          * @param dataState The dataState on which to filter the messages
          */
-        NewUserHandler(std::vector<std::string>& ClusterNodes, std::vector<std::string>& AliveNodes, qot_node_callback_t callback, dds::sub::status::DataState& dataState);
+        NewUserHandler(ClusterMembership& membership, dds::sub::status::DataState& dataState);
         void operator() (dds::sub::DataReader<qot_msgs::NameService>& dr);
 
     private:
         dds::sub::status::DataState& dataState;
-        std::vector<std::string>& ClusterNodes;
-        std::vector<std::string>& AliveNodes;
-        qot_node_callback_t node_callback;
+        ClusterMembership& membership;
 
     };
 
     /**
      * The UserLeftHandler will be called when the StatusCondition triggers.
-     * It will output a message showing users that have left and the number of messages
-     * they have sent.
+     * It removes the users that have left from the alive nodes of the membership.
      */
     class UserLeftHandler
     {
@@ -92,16 +92,14 @@ namespace qot  {
         /**
          * @param nameServiceReader the dds::sub::DataReader<qot_msgs::NameService>
          */
-        UserLeftHandler(std::vector<std::string>& ClusterNodes, std::vector<std::string>& AliveNodes, qot_node_callback_t callback, dds::sub::DataReader<qot_msgs::NameService>& nameServiceReader);
+        UserLeftHandler(ClusterMembership& membership, dds::sub::DataReader<qot_msgs::NameService>& nameServiceReader);
 
         void operator() (dds::core::Entity& e);
 
     private:
         dds::sub::DataReader<qot_msgs::NameService>& nameServiceReader;
         int prevAliveCount;
-        std::vector<std::string>& ClusterNodes;
-        std::vector<std::string>& AliveNodes;
-        qot_node_callback_t node_callback;
+        ClusterMembership& membership;
 
     };
 
@@ -44,13 +44,11 @@ std::ostream& operator <<(std::ostream& os, const qot_msgs::NameService& ns)
 }
 
 
-ClusterManager::ClusterManager(const std::string &name, const std::string &uuid)
-	: sub_entity(name, uuid), name(name), uuid(uuid), ClusterNodes(), AliveNodes()
+ClusterManager::ClusterManager(const std::string &name, const std::string &uuid,
+	const dds::pub::DataWriter<qot_msgs::BarrierType> &barrier_writer)
+	: membership(), sub_entity(name, uuid), name(name), uuid(uuid), barrier_writer(barrier_writer)
 {
 	// Initialize the Cluster Manager	
-	/* Set the callback to NULL*/
-	node_callback = NULL;
-	
 	/**
      * A ReadCondition is created and assigned a handler which is triggered
      * when a new user joins
@@ -59,14 +57,14 @@ ClusterManager::ClusterManager(const std::string &name, const std::string &uuid)
     newDataState << dds::sub::status::SampleState::not_read()
             << dds::sub::status::ViewState::new_view()
             << dds::sub::status::InstanceState::alive();
-    qot::NewUserHandler newUserHandler(ClusterNodes, AliveNodes, node_callback, newDataState);
+    qot::NewUserHandler newUserHandler(membership, newDataState);
     dds::sub::cond::ReadCondition newUser(sub_entity.nameServiceReader, newDataState, newUserHandler);
 
     /**
      * A StatusCondition is created and assigned a handler which is triggered
      * when a DataWriter changes it's liveliness
      */
-    qot::UserLeftHandler userLeftHandler(ClusterNodes, AliveNodes, node_callback, sub_entity.nameServiceReader);
+    qot::UserLeftHandler userLeftHandler(membership, sub_entity.nameServiceReader);
     dds::core::cond::StatusCondition userLeft(sub_entity.MessageReader, userLeftHandler);
     dds::core::status::StatusMask statusMask;
     statusMask << dds::core::status::StatusMask::liveliness_changed();
@@ -80,13 +78,24 @@ ClusterManager::ClusterManager(const std::string &name, const std::string &uuid)
     escape.handler(escapeHandler);
 
 
+    /**
+     * A ReadCondition is assigned a handler which collects the proposals and
+     * reports of timed barriers
+     */
+    dds::sub::status::DataState barrierDataState;
+    barrierDataState << dds::sub::status::SampleState::not_read()
+            << dds::sub::status::ViewState::any()
+            << dds::sub::status::InstanceState::alive();
+    dds::sub::cond::ReadCondition barrierSample(sub_entity.BarrierReader, barrierDataState,
+        [this](dds::sub::DataReader<qot_msgs::BarrierType>& dr) { barrier_receive(dr); });
+
     /** A WaitSet is created and the four conditions created above are attached to it */
     waitSet += newUser;
     waitSet += userLeft;
+    waitSet += barrierSample;
     waitSet += escape;
 
-    /* Start Polling Thread to wait for all users to join */
-    readyFlag = false; // Set ready flag to false -> indicates all nodes have joined
+    /* Start the thread which watches the nodes join and leave */
     terminated = false; // Set terminated flag to false
     thread = boost::thread(boost::bind(&ClusterManager::watch, this));
     
@@ -97,7 +106,8 @@ ClusterManager::ClusterManager(const std::string &name, const std::string &uuid)
 ClusterManager::~ClusterManager() 
 {
 	// Can be extended later ...
-	// Join the main thread
+	// Release the waiters and join the main thread
+	membership.Stop();
 	escape.trigger_value(true);
 	thread.join();
 }
@@ -105,22 +115,22 @@ ClusterManager::~ClusterManager()
 // Define the initial cluster of nodes participating in the coordination
 qot_return_t ClusterManager::DefineCluster(const std::vector<std::string> Nodes, qot_node_callback_t callback)
 {
-	// Copy Cluster Vector from User and sort it
-	ClusterNodes.assign(Nodes.begin(), Nodes.end());
-	std::sort(ClusterNodes.begin(), ClusterNodes.end());
-	node_callback = callback;
+	// Nodes which already joined count towards the new cluster at once
+	membership.SetCallback(callback);
+	membership.Define(Nodes);
+	cv.notify_all();
 	return QOT_RETURN_TYPE_OK;
 }
 
 qot_return_t ClusterManager::WaitForReady()
 {
-	std::unique_lock<std::mutex> lck(mtx);
 	if(DEBUG)
-		std::cout << "[ClusterManager::WaitForReady] Waiting for nodes to join: Ready Flag is " << readyFlag << "\n";
-  	while (!readyFlag) 
-  		cv.wait(lck);
+		std::cout << "[ClusterManager::WaitForReady] Waiting for nodes to join: " << membership.AliveMembers()
+			<< " of " << membership.Members() << " alive\n";
+	if (!membership.WaitForReady(-1))
+		return QOT_RETURN_TYPE_ERR;
   	if(DEBUG)
-  		std::cout << "[ClusterManager::WaitForReady] All Nodes Joined: Ready Flag is " << readyFlag << "\n";
+  		std::cout << "[ClusterManager::WaitForReady] All Nodes Joined\n";
   	return QOT_RETURN_TYPE_OK;
 }
 
@@ -128,20 +138,132 @@ void ClusterManager::watch()
 {
 	while(!terminated)
 	{
+		// The handlers update the membership for every sample of a dispatch, the
+		// application then hears about the changes in one batch
 		waitSet.dispatch(); 
-		if(std::includes(AliveNodes.begin(), AliveNodes.end(), ClusterNodes.begin(), ClusterNodes.end()) && !ClusterNodes.empty() && !AliveNodes.empty())
-		{
-			std::unique_lock<std::mutex> lck(mtx);
-			if(DEBUG)
-				std::cout << "Ready flag has become true" << std::endl;
-			readyFlag = true;
-			cv.notify_all();
-		}
+		membership.Dispatch();
+	}
+}
+
+
+
+bool ClusterManager::barrier_member(const std::string &node)
+{
+	return node == name || membership.IsMember(node);
+}
+
+void ClusterManager::barrier_receive(dds::sub::DataReader<qot_msgs::BarrierType>& dr)
+{
+	dds::sub::LoanedSamples<qot_msgs::BarrierType> samples = dr.take();
+	std::unique_lock<std::mutex> lck(mtx);
+	for (dds::sub::LoanedSamples<qot_msgs::BarrierType>::const_iterator sample = samples.begin();
+		sample < samples.end(); ++sample)
+	{
+		if (!sample->info().valid())
+			continue;
+		const qot_msgs::BarrierType &data = sample->data();
+		BarrierEntry entry = { data.timestamp(), data.uncertainty(), data.slack() };
+		BarrierRound &round = barrier_rounds[data.round()];
+		if (data.phase() == qot_msgs::BARRIER_PROPOSE)
+			round.proposals[data.name()] = entry;
 		else
-		{
-			readyFlag = false;
-		}
+			round.reports[data.name()] = entry;
+	}
+	cv.notify_all();
+}
+
+qot_return_t ClusterManager::BarrierPropose(uint64_t round, int64_t release_ns, int64_t uncertainty_ns,
+	int timeout_ms, int64_t &agreed_ns, int64_t &uncertainty_max_ns)
+{
+	qot_msgs::BarrierType sample;
+	std::unique_lock<std::mutex> lck(mtx);
+	if (membership.Members() == 0)
+		return QOT_RETURN_TYPE_ERR;
+
+	// Only the previous round can still be reported on; a faster peer may already be in the next
+	barrier_rounds.erase(barrier_rounds.begin(), barrier_rounds.lower_bound(round ? round - 1 : 0));
+	BarrierEntry own = { release_ns, uncertainty_ns, 0 };
+	barrier_rounds[round].proposals[name] = own;
+	lck.unlock();
+
+	sample.name() = name;
+	sample.phase() = qot_msgs::BARRIER_PROPOSE;
+	sample.round() = round;
+	sample.timestamp() = release_ns;
+	sample.uncertainty() = uncertainty_ns;
+	sample.slack() = 0;
+	barrier_writer.write(sample);
+
+	lck.lock();
+	auto all_in = [this, round]() {
+		const BarrierRound &r = barrier_rounds[round];
+		uint32_t count = 0;
+		for (std::map<std::string, BarrierEntry>::const_iterator it = r.proposals.begin(); it != r.proposals.end(); ++it)
+			count += membership.IsMember(it->first);
+		return count == membership.Members();
+	};
+	if (timeout_ms < 0)
+		cv.wait(lck, all_in);
+	else if (!cv.wait_for(lck, std::chrono::milliseconds(timeout_ms), all_in))
+		return QOT_RETURN_TYPE_ERR;
+
+	// Every node takes the latest of the same set of proposals, so they all agree
+	agreed_ns = release_ns;
+	uncertainty_max_ns = uncertainty_ns;
+	const BarrierRound &r = barrier_rounds[round];
+	for (std::map<std::string, BarrierEntry>::const_iterator it = r.proposals.begin(); it != r.proposals.end(); ++it)
+	{
+		if (!barrier_member(it->first))
+			continue;
+		agreed_ns = std::max(agreed_ns, it->second.timestamp);
+		uncertainty_max_ns = std::max(uncertainty_max_ns, it->second.uncertainty);
 	}
+	if(DEBUG)
+		std::cout << "[ClusterManager::BarrierPropose] Round " << round << " releases at " << agreed_ns << "\n";
+	return QOT_RETURN_TYPE_OK;
 }
 
+qot_return_t ClusterManager::BarrierReport(uint64_t round, int64_t wakeup_ns, int64_t slack_ns)
+{
+	qot_msgs::BarrierType sample;
+	BarrierEntry own = { wakeup_ns, 0, slack_ns };
+	{
+		std::unique_lock<std::mutex> lck(mtx);
+		barrier_rounds[round].reports[name] = own;
+	}
+	sample.name() = name;
+	sample.phase() = qot_msgs::BARRIER_REPORT;
+	sample.round() = round;
+	sample.timestamp() = wakeup_ns;
+	sample.uncertainty() = 0;
+	sample.slack() = slack_ns;
+	barrier_writer.write(sample);
+	return QOT_RETURN_TYPE_OK;
+}
 
+uint32_t ClusterManager::BarrierResult(uint64_t round, int64_t &skew_ns, int64_t &slack_ns)
+{
+	std::unique_lock<std::mutex> lck(mtx);
+	std::map<uint64_t, BarrierRound>::const_iterator r = barrier_rounds.find(round);
+	int64_t first = 0, last = 0;
+	uint32_t count = 0;
+	skew_ns = 0;
+	slack_ns = 0;
+	if (r == barrier_rounds.end())
+		return 0;
+	for (std::map<std::string, BarrierEntry>::const_iterator it = r->second.reports.begin();
+		it != r->second.reports.end(); ++it)
+	{
+		if (!barrier_member(it->first))
+			continue;
+		if (!count || it->second.timestamp < first)
+			first = it->second.timestamp;
+		if (!count || it->second.timestamp > last)
+			last = it->second.timestamp;
+		if (!count || it->second.slack < slack_ns)
+			slack_ns = it->second.slack;
+		count++;
+	}
+	skew_ns = last - first;
+	return count;
+}
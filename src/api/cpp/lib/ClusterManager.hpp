@@ -41,6 +41,7 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <map>
 #include <mutex>
 #include <condition_variable>
 
@@ -53,21 +54,23 @@ extern "C"
 // Get the Subscriber Entities
 #include "MsgingEntities.cpp"
 
+// Cluster membership
+#include "../transport/ClusterMembership.hpp"
+
 namespace qot
 {
 	// Distributed Inter-Process Cluster Management
 	class ClusterManager 
 	{
-		// Node Management Vectors 
-		// -> ClusterNodes: Specified Nodes in Coordination
-		// -> ActiveNodes : Nodes that have joined the DDS Domain
-		private: std::vector<std::string> ClusterNodes; 
-		private: std::vector<std::string> AliveNodes;
+		// Node Management -> the specified nodes in coordination, and which of
+		// the nodes that joined the DDS domain are still alive
+		private: qot::ClusterMembership membership;
 		
 		// Constructor and destructor
 		// The Constructor initializes private member variables and starts the DDS listener
 		// The Destructor stops the DDS listener
-		public: ClusterManager(const std::string &name, const std::string &uuid);
+		public: ClusterManager(const std::string &name, const std::string &uuid,
+			const dds::pub::DataWriter<qot_msgs::BarrierType> &barrier_writer);
 		public: ~ClusterManager();
 	
 		// Define the nodes which will be a part of the coordination
@@ -76,9 +79,26 @@ namespace qot
 		// Wait for al the nodes to join the cluster
 		public: qot_return_t WaitForReady();
 
+		// Timed barrier -> Publish this node's proposed release for a round and wait for the
+		// proposal of every cluster node; all nodes agree on the latest proposal
+		public: qot_return_t BarrierPropose(uint64_t round, int64_t release_ns, int64_t uncertainty_ns,
+			int timeout_ms, int64_t &agreed_ns, int64_t &uncertainty_max_ns);
+
+		// Timed barrier -> Tell the peers when this node woke and how early it was ready
+		public: qot_return_t BarrierReport(uint64_t round, int64_t wakeup_ns, int64_t slack_ns);
+
+		// Timed barrier -> Spread of wake-ups and least slack over the reports received so far
+		public: uint32_t BarrierResult(uint64_t round, int64_t &skew_ns, int64_t &slack_ns);
+
 		// Private Function -> Watch for changes to the cluster
 		private: void watch();
 
+		// Private Function -> Collect barrier samples (called on the watch thread)
+		private: void barrier_receive(dds::sub::DataReader<qot_msgs::BarrierType>& dr);
+
+		// Private Function -> Nodes whose samples count towards a barrier round
+		private: bool barrier_member(const std::string &node);
+
 
 		// Information about the application and the timeline
 		private: std::string uuid;    // timeline uuid
@@ -101,21 +121,23 @@ namespace qot
 		// ClusterManagement Thread
 		private: boost::thread thread;
 
-		// Flag Signifying whether all  nodes have joined the DDS domain
-		public: bool readyFlag;
-
 		// Guard condition to terminate the watch thread 
     	private: dds::core::cond::GuardCondition escape;
 
     	// Flag to terminate the cluster manager
 		private: bool terminated;
 
-		// ClusterManagement Ready Synchronization 
+		// Barrier Synchronization
 		private: std::mutex mtx;
 		private: std::condition_variable cv;
 
-		// ClusterManagement User Callback
-		private: qot_node_callback_t node_callback;
+		// Barrier samples of the rounds in flight, by round and then node name
+		private: struct BarrierEntry { int64_t timestamp; int64_t uncertainty; int64_t slack; };
+		private: struct BarrierRound { std::map<std::string, BarrierEntry> proposals, reports; };
+		private: std::map<uint64_t, BarrierRound> barrier_rounds;
+
+		// Barrier sample writer (owned by the messenger's publishing entities)
+		private: dds::pub::DataWriter<qot_msgs::BarrierType> barrier_writer;
 
 	};
 }
@@ -0,0 +1,252 @@
+/**
+ * @file DdsTransport.cpp
+ * @brief OpenSplice DDS underneath the timeline messaging transport interface
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <iostream>
+
+/* This file header */
+#include "DdsTransport.hpp"
+
+#include <cstring>
+
+// Largest payload carried in one sample (DDS itself fragments large samples)
+#define DDS_MAX_PAYLOAD (1 << 20)
+
+using namespace qot;
+
+DdsTransport::DdsTransport(const dds::pub::DataWriter<qot_msgs::TimelineMsgingType> &writer,
+	const dds::sub::DataReader<qot_msgs::TimelineMsgingType> &reader, const TransportConfig &config)
+	: config(config), writer(writer), reader(reader), sent(0), received(0), errors(0)
+{
+}
+
+DdsTransport *DdsTransport::Open(const TransportConfig &config)
+{
+	dds::pub::DataWriter<qot_msgs::TimelineMsgingType> writer(dds::core::null);
+	dds::sub::DataReader<qot_msgs::TimelineMsgingType> reader(dds::core::null);
+	try
+	{
+		/** A dds::domain::DomainParticipant is created for the default domain. */
+		dds::domain::DomainParticipant dp(org::opensplice::domain::default_id());
+
+		/** Transient durability keeps samples for late joiners, Reliable guarantees delivery */
+		dds::topic::qos::TopicQos topicQos
+			= dp.default_topic_qos()
+				<< dds::core::policy::Durability::Transient()
+				<< dds::core::policy::Reliability::Reliable();
+		dds::topic::Topic<qot_msgs::TimelineMsgingType> topic(dp, config.topic, topicQos);
+
+		/** Each timeline has its own partition */
+		if (config.roles & TRANSPORT_ROLE_PUB)
+		{
+			dds::pub::qos::PublisherQos pubQos
+				= dp.default_publisher_qos()
+					<< dds::core::policy::Partition(config.timeline);
+			dds::pub::Publisher pub(dp, pubQos);
+
+			/** Let the publisher exit before the subscribers without disposing its instances */
+			dds::pub::qos::DataWriterQos dwqos = topic.qos();
+			dwqos << dds::core::policy::WriterDataLifecycle::ManuallyDisposeUnregisteredInstances();
+			writer = dds::pub::DataWriter<qot_msgs::TimelineMsgingType>(pub, topic, dwqos);
+		}
+		if (config.roles & TRANSPORT_ROLE_SUB)
+		{
+			dds::sub::qos::SubscriberQos subQos
+				= dp.default_subscriber_qos()
+					<< dds::core::policy::Partition(config.timeline);
+			dds::sub::Subscriber sub(dp, subQos);
+			dds::sub::qos::DataReaderQos drqos = topic.qos();
+			reader = dds::sub::DataReader<qot_msgs::TimelineMsgingType>(sub, topic, drqos);
+		}
+	}
+	catch (const dds::core::Exception& e)
+	{
+		std::cerr << "ERROR: Exception: " << e.what() << std::endl;
+		writer = dds::core::null;
+		reader = dds::core::null;
+	}
+	return new DdsTransport(writer, reader, config);
+}
+
+DdsTransport::~DdsTransport()
+{
+	// Cancel the listener
+	if (callback && !reader.is_nil())
+		reader.listener(nullptr, dds::core::status::StatusMask::none());
+}
+
+void DdsTransport::to_sample(const TransportHeader &header, const void *payload, size_t length,
+	qot_msgs::TimelineMsgingType &sample)
+{
+	const uint8_t *bytes = (const uint8_t *) payload;
+	qot_msgs::UncertainTimestamp utimestamp;
+
+	// Unroll Message Timestamp (resolution is in ns)
+	utimestamp.timestamp()     = header.timestamp.estimate.sec*nSEC_PER_SEC + header.timestamp.estimate.asec/ASEC_PER_NSEC;
+	utimestamp.uncertainty_u() = header.timestamp.interval.above.sec*nSEC_PER_SEC + header.timestamp.interval.above.asec/ASEC_PER_NSEC;
+	utimestamp.uncertainty_l() = header.timestamp.interval.below.sec*nSEC_PER_SEC + header.timestamp.interval.below.asec/ASEC_PER_NSEC;
+
+	// Unroll message parameters
+	sample.name() = std::string(header.name, strnlen(header.name, QOT_MAX_NAMELEN));  // Our name
+	sample.uuid() = config.timeline;                                                   // Timeline UUID
+	sample.type() = (qot_msgs::MsgType) header.type;                                   // Msg Type
+	sample.data() = std::string((const char *) payload,
+		strnlen((const char *) payload, length < QOT_MAX_NAMELEN ? length : QOT_MAX_NAMELEN - 1));
+	sample.payload().assign(bytes, bytes + length);                                    // Msg Payload
+	sample.utimestamp() = utimestamp;                                                  // Timestamp Associated with Msg
+	sample.published() = header.published_ns;                                         // Latency stamps
+	sample.handoff() = header.handoff_ns;
+	sample.stamp_uncertainty() = header.stamp_unc_ns;
+}
+
+qot_return_t DdsTransport::Publish(const TransportHeader &header, const void *payload, size_t length)
+{
+	return PublishBatch(&header, &payload, &length, 1);
+}
+
+qot_return_t DdsTransport::PublishBatch(const TransportHeader *headers, const void *const *payloads,
+	const size_t *lengths, size_t count)
+{
+	size_t i;
+	if (writer.is_nil())
+		return QOT_RETURN_TYPE_ERR;
+	std::lock_guard<std::mutex> lck(batch_lock);
+	if (samples.size() < count)
+		samples.resize(count);
+	for (i = 0; i < count; i++)
+		to_sample(headers[i], payloads[i], lengths[i], samples[i]);
+	try
+	{
+		writer.write(samples.begin(), samples.begin() + count);
+	}
+	catch (const dds::core::Exception& e)
+	{
+		std::cerr << "ERROR: Exception: " << e.what() << std::endl;
+		errors.fetch_add(count, std::memory_order_relaxed);
+		return QOT_RETURN_TYPE_ERR;
+	}
+	sent.fetch_add(count, std::memory_order_relaxed);
+	return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t DdsTransport::Subscribe(TransportCallback callback)
+{
+	if (!callback || this->callback || reader.is_nil())
+		return QOT_RETURN_TYPE_ERR;
+	this->callback = callback;
+
+	/** Create a topic listener for the data reader **/
+	reader.listener(this, dds::core::status::StatusMask::data_available());
+	return QOT_RETURN_TYPE_OK;
+}
+
+void DdsTransport::SetLatencyBudget(uint32_t budget_us)
+{
+	// Samples may leave DDS up to budget_us late, so it can pack them into fewer packets
+	if (writer.is_nil())
+		return;
+	try
+	{
+		dds::pub::qos::DataWriterQos dwqos = writer.qos();
+		if (budget_us)
+			dwqos << dds::core::policy::LatencyBudget(dds::core::Duration::from_microsecs(budget_us));
+		else
+			dwqos << dds::core::policy::LatencyBudget(dds::core::Duration::zero());
+		writer.qos(dwqos);
+	}
+	catch (const dds::core::Exception& e)
+	{
+		std::cerr << "ERROR: Exception: " << e.what() << std::endl;
+	}
+}
+
+size_t DdsTransport::MaxPayload()
+{
+	return DDS_MAX_PAYLOAD;
+}
+
+void DdsTransport::on_data_available(dds::sub::DataReader<qot_msgs::TimelineMsgingType>& dr)
+{
+	TransportHeader header;
+
+	// get only new/unread data
+	dds::sub::status::DataState aliveDataState;
+	aliveDataState << dds::sub::status::SampleState::any()
+		<< dds::sub::status::ViewState::any()
+		<< dds::sub::status::InstanceState::alive();
+
+	/**
+	 * Take messages. Using take instead of read removes the messages from
+	 * the system, preventing resources from being saturated due to a build
+	 * up of messages
+	 */
+	dds::sub::LoanedSamples<qot_msgs::TimelineMsgingType> messages
+		= dr.select().state(aliveDataState).take();
+
+	for (dds::sub::LoanedSamples<qot_msgs::TimelineMsgingType>::const_iterator message
+			= messages.begin(); message < messages.end(); ++message)
+	{
+		if (!message->info().valid())
+			continue;
+		const qot_msgs::TimelineMsgingType &sample = message->data();
+		if (!config.receive_own && sample.name() == config.node)
+			continue;
+		strncpy(header.name, sample.name().c_str(), QOT_MAX_NAMELEN - 1);
+		header.name[QOT_MAX_NAMELEN - 1] = '\0';
+		header.type = (qot_msg_type_t) sample.type();
+		TP_FROM_nSEC(header.timestamp.estimate, sample.utimestamp().timestamp());
+		TL_FROM_nSEC(header.timestamp.interval.above, sample.utimestamp().uncertainty_u());
+		TL_FROM_nSEC(header.timestamp.interval.below, sample.utimestamp().uncertainty_l());
+		header.published_ns = sample.published();
+		header.handoff_ns = sample.handoff();
+		header.stamp_unc_ns = sample.stamp_uncertainty();
+		received.fetch_add(1, std::memory_order_relaxed);
+		callback(header, sample.payload().data(), sample.payload().size());
+	}
+}
+
+void DdsTransport::GetStats(TransportStats &stats)
+{
+	stats.sent = sent.load(std::memory_order_relaxed);
+	stats.received = received.load(std::memory_order_relaxed);
+	stats.lost = 0;
+	stats.errors = errors.load(std::memory_order_relaxed);
+}
+
+Transport *qot::OpenTransport(TransportType type, const TransportConfig &config)
+{
+	Transport *transport = NULL;
+	type = ResolveTransport(type);
+	if (type != TRANSPORT_DDS)
+	{
+		transport = CreateTransport(type, config);
+		if (!transport)
+			std::cerr << "ERROR: Could not open the transport of topic " << config.topic << ", using DDS" << std::endl;
+	}
+	if (!transport)
+		transport = DdsTransport::Open(config);
+	return transport;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file DdsTransport.hpp
+ * @brief OpenSplice DDS underneath the timeline messaging transport interface
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef DDS_TRANSPORT_HPP
+#define DDS_TRANSPORT_HPP
+
+// std library includes
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Timeline Message DDS IDL
+#include <msg/QoT_DCPS.hpp>
+
+// Transport interface
+#include "../transport/Transport.hpp"
+
+namespace qot
+{
+	// Carries the messages of a topic as DDS samples. The payload travels in the
+	// sample's payload sequence, and its start in the data string for readers
+	// built before payloads existed
+	class DdsTransport : public Transport, public dds::sub::NoOpDataReaderListener<qot_msgs::TimelineMsgingType>
+	{
+		// Carry the messages of an existing writer and reader (either may be dds::core::null)
+		public: DdsTransport(const dds::pub::DataWriter<qot_msgs::TimelineMsgingType> &writer,
+			const dds::sub::DataReader<qot_msgs::TimelineMsgingType> &reader, const TransportConfig &config);
+
+		// Create the topic entities of a channel on the timeline's partition (if that
+		// fails the channel is still returned, but cannot publish or subscribe)
+		public: static DdsTransport *Open(const TransportConfig &config);
+		public: ~DdsTransport();
+
+		// Transport interface
+		public: qot_return_t Publish(const TransportHeader &header, const void *payload, size_t length);
+		public: qot_return_t PublishBatch(const TransportHeader *headers, const void *const *payloads,
+			const size_t *lengths, size_t count);
+		public: qot_return_t Subscribe(TransportCallback callback);
+		public: void SetLatencyBudget(uint32_t budget_us);
+		public: size_t MaxPayload();
+		public: void GetStats(TransportStats &stats);
+
+		// Required by dds::sub::NoOpDataReaderListener dds callback. Gets called when new data is available to read.
+		public: virtual void on_data_available(dds::sub::DataReader<qot_msgs::TimelineMsgingType>& dr);
+
+		// Convert a message to a sample
+		private: void to_sample(const TransportHeader &header, const void *payload, size_t length,
+			qot_msgs::TimelineMsgingType &sample);
+
+		private: TransportConfig config;
+
+		// DDS Data Writer and Reader
+		private: dds::pub::DataWriter<qot_msgs::TimelineMsgingType> writer;
+		private: dds::sub::DataReader<qot_msgs::TimelineMsgingType> reader;
+
+		// Receive callback (DDS thread)
+		private: TransportCallback callback;
+
+		// Samples of the batch being written, reused from batch to batch
+		private: std::mutex batch_lock;
+		private: std::vector<qot_msgs::TimelineMsgingType> samples;
+
+		// Counters
+		private: std::atomic<uint64_t> sent;
+		private: std::atomic<uint64_t> received;
+		private: std::atomic<uint64_t> errors;
+	};
+
+	// Open a channel on any transport, falling back to DDS when the requested one cannot be opened
+	Transport *OpenTransport(TransportType type, const TransportConfig &config);
+}
+
+#endif
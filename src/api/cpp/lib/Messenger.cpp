@@ -31,6 +31,8 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <cstring>
+#include <new>
 
 // Delays (milliseconds)
 #define DELAY_HEARTBEAT 		1000
@@ -51,23 +53,12 @@ std::ostream& operator <<(std::ostream& os, const qot_msgs::TimelineMsgingType&
 	return os;
 }
 
-// Initialize Hashmap to convert from qot_msg_type_t to the DDS idl 
-// ->> Should be changed when a new message is added
-void Messenger::initialize_hashmap()
-{
-	type_hashmap[QOT_MSG_COORD_READY] = "COORD_READY"; 
-	type_hashmap[QOT_MSG_COORD_START] = "COORD_START";
-	type_hashmap[QOT_MSG_COORD_STOP]  = "COORD_STOP";
-	type_hashmap[QOT_MSG_SENSOR_VAL]  = "SENSOR_VAL";
-	type_hashmap[QOT_MSG_INVALID]     = "INVALID_MSG";
-}
-
 // Need to populate these functions
 void Messenger::add_to_subscribed_msg_type_list(qot_msg_type_t type)
 {
 	unsigned long long temp_mask = 1;
 	temp_mask = temp_mask << type;
-	sub_type_mask = sub_type_mask | temp_mask;
+	sub_type_mask |= temp_mask;
 	return;
 }
 
@@ -77,7 +68,7 @@ void Messenger::remove_from_subscribed_msg_type_list(qot_msg_type_t type)
 	unsigned long long temp_mask = 1;
 	temp_mask = temp_mask << type;
 	temp_mask = ~temp_mask;
-	sub_type_mask = sub_type_mask & temp_mask;
+	sub_type_mask &= temp_mask;
 	return;
 }
 
@@ -97,83 +88,142 @@ void Messenger::remove_from_subscribed_msg_name_list(const std::string &name)
 	return;
 }
 
-void Messenger::on_data_available(dds::sub::DataReader<qot_msgs::TimelineMsgingType>& dr) 
+unsigned long long Messenger::type_mask(const std::set<qot_msg_type_t> &MsgTypes)
 {
-	// QoT Message type
-	qot_message_t qot_msg;
-	// get only new/unread data
-	dds::sub::status::DataState aliveDataState;
-            aliveDataState << dds::sub::status::SampleState::any()
-                << dds::sub::status::ViewState::any()
-                << dds::sub::status::InstanceState::alive();
-
-    // Setup query based on application subscription requests
-    query_lock.lock();
-    dds::sub::Query query(dr, sub_expression, sub_params);
-    query_lock.unlock();
-    /**
-     * Take messages. Using take instead of read removes the messages from
-     * the system, preventing resources from being saturated due to a build
-     * up of messages
-     */
-    dds::sub::LoanedSamples<qot_msgs::TimelineMsgingType> messages
-        = dr.select().content(query).state(aliveDataState).take();
-
-    /** Output the username and content for each message */
-    for (dds::sub::LoanedSamples<qot_msgs::TimelineMsgingType>::const_iterator message
-            = messages.begin(); message < messages.end(); ++message)
-    {
-        if(message->info().valid())
-        {
-            strcpy(qot_msg.name, (message->data().name()).c_str());
-            qot_msg.type = (qot_msg_type_t) message->data().type();
-            strcpy(qot_msg.data, (message->data().data()).c_str());
-            TP_FROM_nSEC(qot_msg.timestamp.estimate, message->data().utimestamp().timestamp());
-            TL_FROM_nSEC(qot_msg.timestamp.interval.above, message->data().utimestamp().uncertainty_u());
-            TL_FROM_nSEC(qot_msg.timestamp.interval.below, message->data().utimestamp().uncertainty_l());
-            if(msg_callback != NULL)
-			{
-				msg_callback(&qot_msg);
-			}
-        }
-    }
+	unsigned long long mask = 0;
+	for(std::set<qot_msg_type_t>::const_iterator it = MsgTypes.begin() ; it != MsgTypes.end(); ++it)
+	{
+		if (*it >= 0 && *it < QOT_MSG_INVALID)
+			mask |= 1ULL << *it;
+	}
+	return mask;
 }
 
-void Messenger::on_liveliness_changed(dds::sub::DataReader<qot_msgs::TimelineMsgingType>& dr, 
-	const dds::core::status::LivelinessChangedStatus& status) 
+const char *Messenger::topic_name(qot_msg_type_t type)
 {
-	// Not sure what to do with this...
+	static const char *names[QOT_MSG_INVALID + 1] = {
+		"coord_ready", "coord_start", "coord_stop", "sensor_val", "data", "invalid" };
+	if (type < 0 || type > QOT_MSG_INVALID)
+		return names[QOT_MSG_INVALID];
+	return names[type];
+}
+
+void Messenger::measure(const TransportHeader &header)
+{
+	qot_clock_callback_t now_fn = clock.load();
+	utimepoint_t now;
+	if (!measure_latency.load(std::memory_order_relaxed) || now_fn == NULL || header.published_ns == 0)
+		return;
+	if (now_fn(clock_arg.load(), &now))
+		return;
+	latency.Record(topic_name(header.type), header, now);
+}
 
-	// according to C++ API reference, this function gets called when the
-	// 'liveliness' of a DataWriter writing to this DataReader has changed
-	// "changed" meaning has become 'alive' or 'not alive'.
-	// 
-	// I think this can detect when new writers have joined the board/topic
-	// and when current writers have died. (maybe)
-	//   - Sean Kim
+void Messenger::measure(const qot_message_t *msgs, const MessageStamps *stamps, size_t count)
+{
+	qot_clock_callback_t now_fn = clock.load();
+	TransportHeader header;
+	utimepoint_t now;
+	bool have_now = false;
+	size_t i;
 
-	BOOST_LOG_TRIVIAL(info) << "on_liveliness_changed() called.";
+	for (i = 0; i < count && now_fn != NULL; i++)
+	{
+		if (stamps[i].published_ns == 0)
+			continue;
+		if (!have_now && now_fn(clock_arg.load(), &now))
+			return;
+		have_now = true;
+		memcpy(header.name, msgs[i].name, QOT_MAX_NAMELEN);
+		header.type = msgs[i].type;
+		header.timestamp = msgs[i].timestamp;
+		header.published_ns = stamps[i].published_ns;
+		header.handoff_ns = stamps[i].handoff_ns;
+		header.stamp_unc_ns = stamps[i].stamp_unc_ns;
+		latency.Record(topic_name(header.type), header, now);
+	}
 }
 
-Messenger::Messenger(const std::string &name, const std::string &uuid)
-	: pub_entity(name, uuid), sub_entity(name, uuid), name(name), uuid(uuid), cluster_manager(name, uuid), sub_type_mask(0xffffffffffffffff)
+void Messenger::on_message(const TransportHeader &header, const void *payload, size_t length)
 {
-	std::ostringstream convert;
+	qot_payload_callback_t pcallback;
+	qot_message_t msg;
 
-	// Initialize the hashmap for the queries
-	initialize_hashmap();
+	// Filter out the message types which are not subscribed to
+	if (header.type < 0 || header.type >= QOT_MSG_INVALID
+		|| !(sub_type_mask.load(std::memory_order_relaxed) & (1ULL << header.type)))
+		return;
 
-	// Query expression initialization (accept all packets except the invalid ones)
-	sub_expression = "(type < %0)";
-	convert << "INVALID_MSG";
-	sub_params.clear();
-	sub_params.push_back(convert.str());
+	// Payload subscribers get the payload in place, before it is released
+	pcallback = payload_callback.load();
+	if (pcallback != NULL)
+	{
+		HeaderToMessage(header, payload, length, msg);
+		measure(header);
+		pcallback(&msg, payload, length);
+		return;
+	}
 
-	// Initialize Subscription Function pointer to NULL
-	msg_callback = NULL;
+	// The ordering stage drops expired messages and delivers the rest in timestamp order
+	std::shared_ptr<MessageReorderer> order = std::atomic_load(&reorderer);
+	if (order)
+	{
+		order->Push(header, payload, length);
+		return;
+	}
+	HeaderToMessage(header, payload, length, msg);
+	deliver(header, msg);
+}
 
-	// Create the message listener
-	sub_entity.MessageReader.listener(this, dds::core::status::StatusMask::data_available());
+void Messenger::deliver(const TransportHeader &header, const qot_message_t &msg)
+{
+	qot_msg_callback_t callback;
+
+	/** Hand the message to the receive queue, where it is measured once taken, or the callback */
+	std::shared_ptr<MessageQueue> queue = std::atomic_load(&msg_queue);
+	if (queue)
+	{
+		MessageStamps stamps = { header.published_ns, header.handoff_ns, header.stamp_unc_ns };
+		queue->Push(&msg, 1, &stamps);
+		return;
+	}
+	callback = msg_callback.load();
+	if(callback != NULL)
+	{
+		measure(header);
+		callback(&msg);
+	}
+}
+
+qot::Transport *Messenger::open_transport()
+{
+	TransportType type = ResolveTransport(TRANSPORT_DEFAULT);
+	TransportConfig config;
+	Transport *transport = NULL;
+
+	if (type != TRANSPORT_DDS)
+	{
+		config.timeline = uuid;
+		config.topic = "QoT_Messaging";
+		config.node = name;
+		transport = CreateTransport(type, config);
+		if (transport)
+			return transport;
+		BOOST_LOG_TRIVIAL(warning) << "Messenger could not open the requested transport, using DDS";
+	}
+
+	// DDS carries the messages on the messenger's own entities
+	config.timeline = uuid;
+	config.node = name;
+	return new DdsTransport(pub_entity.MessageWriter, sub_entity.MessageReader, config);
+}
+
+Messenger::Messenger(const std::string &name, const std::string &uuid)
+	: pub_entity(name, uuid), sub_entity(name, uuid), name(name), uuid(uuid), cluster_manager(name, uuid, pub_entity.BarrierWriter), sub_type_mask(0xffffffffffffffff),
+	  msg_callback(NULL), payload_callback(NULL), clock(NULL), clock_arg(NULL), measure_latency(false), transport(open_transport()), batcher(*transport)
+{
+	// Start receiving messages
+	transport->Subscribe(boost::bind(&Messenger::on_message, this, _1, _2, _3));
 
 	// Add this node to the NameService
 	name_msg.userID() = rand();          // Give a user ID -> this has to be changed later should be automated
@@ -186,81 +236,155 @@ Messenger::Messenger(const std::string &name, const std::string &uuid)
 
 Messenger::~Messenger() 
 {
-	// Cancel the listener
-	sub_entity.MessageReader.listener(nullptr, dds::core::status::StatusMask::none());
+	// The batcher and then the transport are destroyed first, which stops the delivery
 	std::cout << "Messenger has terminated" << std::endl;
 }
 
 qot_return_t Messenger::Publish(const qot_message_t msg)
 {
-	qot_msgs::UncertainTimestamp utimestamp;
-
-	// Unroll Message Timestamp (resolution is in ns -> convert to asec later)
-	utimestamp.timestamp()     = msg.timestamp.estimate.sec*nSEC_PER_SEC + msg.timestamp.estimate.asec/ASEC_PER_NSEC;
-	utimestamp.uncertainty_u() = msg.timestamp.interval.above.sec*nSEC_PER_SEC + msg.timestamp.interval.above.asec/ASEC_PER_NSEC;
-	utimestamp.uncertainty_l() = msg.timestamp.interval.below.sec*nSEC_PER_SEC + msg.timestamp.interval.below.asec/ASEC_PER_NSEC;
-	
-	// Unroll message parameters
-	timeline_msg.name() = (std::string) name;			      // Our name
-	timeline_msg.uuid() = (std::string) uuid;   			  // Timeline UUID
-	timeline_msg.type() = (qot_msgs::MsgType) msg.type;  	  // Msg Type
-	timeline_msg.data() = std::string(msg.data);              // Msg Data
-	timeline_msg.utimestamp() = utimestamp;                   // Timestamp Associated with Msg
-	
-	// Publish the message
-	pub_entity.MessageWriter.write(timeline_msg);
-	return QOT_RETURN_TYPE_OK;  
+	TransportHeader header;
+	MessageToHeader(msg, name, header);
+
+	// Publish the message, or add it to the batch in progress
+	return batcher.Publish(header, msg.data, strnlen(msg.data, QOT_MAX_NAMELEN));
+}
+
+qot_return_t Messenger::PublishPayload(const qot_message_t &msg, const void *payload, size_t length)
+{
+	TransportHeader header;
+	if (length > transport->MaxPayload() || (length && !payload))
+		return QOT_RETURN_TYPE_ERR;
+	MessageToHeader(msg, name, header);
+	return batcher.Publish(header, payload, length);
 }
 
 // Subscribe to Messages -> The list is reset each time
 qot_return_t Messenger::Subscribe(const std::set<qot_msg_type_t> &MsgTypes, qot_msg_callback_t callback) 
 {
-	int param_count = 1;
-	std::ostringstream sub_exp_temp;
-
-	query_lock.lock();
+	if(callback == NULL)
+		return QOT_RETURN_TYPE_ERR;
+	msg_callback = callback;
+	sub_type_mask = type_mask(MsgTypes);
+	return QOT_RETURN_TYPE_OK;
+}
 
-	if(callback != NULL)
-	{
-		msg_callback = callback;
-	}
-	else
-	{
-		query_lock.unlock();
+// Subscribe to Messages and their payloads -> The list is reset each time
+qot_return_t Messenger::SubscribePayload(const std::set<qot_msg_type_t> &MsgTypes, qot_payload_callback_t callback)
+{
+	if(callback == NULL)
 		return QOT_RETURN_TYPE_ERR;
-	}
+	payload_callback = callback;
+	sub_type_mask = type_mask(MsgTypes);
+	return QOT_RETURN_TYPE_OK;
+}
 
-	// Clear the parameter vector and the expression string
-	sub_expression = "(type < %0)";
-	sub_params.clear();
-	sub_params.push_back(type_hashmap[QOT_MSG_INVALID]);
+qot_return_t Messenger::ConfigureMessaging(const qot_msg_config_t &config)
+{
+	std::shared_ptr<MessageQueue> queue;
+	std::shared_ptr<MessageReorderer> order;
 
+	// The queue positions wrap with a mask, and ordering needs the timeline time
+	if (config.queue_depth > QOT_MSG_MAX_QUEUE_DEPTH || (config.queue_depth & (config.queue_depth - 1)))
+		return QOT_RETURN_TYPE_ERR;
+	if ((config.order_hold_us || config.deadline_ns || config.latency_stats) && clock.load() == NULL)
+		return QOT_RETURN_TYPE_ERR;
+	if (batcher.Configure(config.batch_size, config.flush_us))
+		return QOT_RETURN_TYPE_ERR;
 
-	// Populate the Subscription Message Type List
-	for(std::set<qot_msg_type_t>::const_iterator it = MsgTypes.begin() ; it != MsgTypes.end(); ++it)
+	// Messages still in a previous queue are dropped with it
+	if (config.queue_depth)
 	{
-		if (*it >= 0 && *it < QOT_MSG_INVALID)
+		try
+		{
+			queue = std::make_shared<MessageQueue>(config.queue_depth, config.block_us);
+		}
+		catch (const std::bad_alloc &)
 		{
-			sub_params.push_back(type_hashmap[*it]);
-			if (it != MsgTypes.begin())
-			{
-				sub_exp_temp << " OR ";
-			}
-			else
-			{
-				sub_exp_temp << " AND (";
-			}
-			sub_exp_temp << "(type = %" << param_count << ")";
-			param_count++;
+			return QOT_RETURN_TYPE_ERR;
 		}
 	}
-	sub_exp_temp << ")";
-	sub_expression = sub_expression + sub_exp_temp.str();
-	query_lock.unlock();
-	std::cout << sub_expression << std::endl;
+	std::atomic_store(&msg_queue, queue);
+
+	// Held messages are released into the new queue before the previous stage goes
+	if (config.order_hold_us || config.deadline_ns)
+	{
+		qot_clock_callback_t now = clock.load();
+		void *arg = clock_arg.load();
+		order = std::make_shared<MessageReorderer>(
+			[now, arg](utimepoint_t &tp) { return now(arg, &tp); },
+			[this](const TransportHeader &header, const qot_message_t &msg) { deliver(header, msg); });
+		order->Configure(config.order_hold_us, config.order_depth, config.deadline_ns);
+	}
+	order = std::atomic_exchange(&reorderer, order);
+	if (order)
+		order->Flush();
+
+	// Stamp what is published, so that it can be measured and put in publish order
+	if (config.latency_stats || config.order_hold_us || config.deadline_ns)
+	{
+		qot_clock_callback_t now = clock.load();
+		void *arg = clock_arg.load();
+		batcher.SetClock([now, arg](utimepoint_t &tp) { return now(arg, &tp); });
+	}
+	else
+		batcher.SetClock(MessageClock());
+	measure_latency = (config.latency_stats != 0);
 	return QOT_RETURN_TYPE_OK;
 }
 
+void Messenger::SetClock(qot_clock_callback_t clock, void *arg)
+{
+	this->clock_arg = arg;
+	this->clock = clock;
+}
+
+qot_return_t Messenger::FlushMessages()
+{
+	return batcher.Flush();
+}
+
+size_t Messenger::ReceiveMessages(qot_message_t *msgs, size_t max, int timeout_ms)
+{
+	std::shared_ptr<MessageQueue> queue = std::atomic_load(&msg_queue);
+	if (!queue || !msgs)
+		return 0;
+	if (!measure_latency.load(std::memory_order_relaxed))
+		return queue->Pop(msgs, max, timeout_ms);
+
+	// The latency runs until the application takes the message, queueing included
+	std::vector<MessageStamps> stamps(max);
+	size_t count = queue->Pop(msgs, max, timeout_ms, stamps.data());
+	measure(msgs, stamps.data(), count);
+	return count;
+}
+
+qot_return_t Messenger::GetMessageStats(qot_msg_stats_t &stats)
+{
+	std::shared_ptr<MessageQueue> queue = std::atomic_load(&msg_queue);
+	std::shared_ptr<MessageReorderer> order = std::atomic_load(&reorderer);
+	memset(&stats, 0, sizeof(qot_msg_stats_t));
+	batcher.GetStats(stats);
+	if (queue)
+		queue->GetStats(stats);
+	if (order)
+		order->GetStats(stats);
+	return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t Messenger::GetLatencyStats(const char *topic, const char *peer, qot_latency_stats_t &stats)
+{
+	if (!latency.Query(topic, peer, stats))
+		return QOT_RETURN_TYPE_ERR;
+	return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t Messenger::DumpLatencyStats(const char *path)
+{
+	if (path == NULL)
+		return QOT_RETURN_TYPE_ERR;
+	return latency.Dump(path);
+}
+
 qot_return_t Messenger::DefineCluster(const std::vector<std::string> Nodes, qot_node_callback_t callback)
 {
 	// Call the Cluster Manager Cluster Define Function
@@ -275,3 +399,19 @@ qot_return_t Messenger::WaitForPeers()
 	return retval;
 }
 
+qot_return_t Messenger::BarrierPropose(uint64_t round, int64_t release_ns, int64_t uncertainty_ns,
+	int timeout_ms, int64_t &agreed_ns, int64_t &uncertainty_max_ns)
+{
+	return cluster_manager.BarrierPropose(round, release_ns, uncertainty_ns, timeout_ms, agreed_ns, uncertainty_max_ns);
+}
+
+qot_return_t Messenger::BarrierReport(uint64_t round, int64_t wakeup_ns, int64_t slack_ns)
+{
+	return cluster_manager.BarrierReport(round, wakeup_ns, slack_ns);
+}
+
+uint32_t Messenger::BarrierResult(uint64_t round, int64_t &skew_ns, int64_t &slack_ns)
+{
+	return cluster_manager.BarrierResult(round, skew_ns, slack_ns);
+}
+
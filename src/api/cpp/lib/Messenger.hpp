@@ -34,8 +34,10 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 // Std Includes
+#include <atomic>
 #include <unordered_set>
 #include <string>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 
@@ -48,6 +50,11 @@
 // Cluster Manager
 #include "ClusterManager.hpp"
 
+// Message transports, batched publishing and queued delivery
+#include "../transport/MsgPipeline.hpp"
+#include "../transport/LatencyStats.hpp"
+#include "DdsTransport.hpp"
+
 // Include the QoT api
 extern "C"
 {
@@ -59,35 +66,63 @@ std::ostream& operator <<(std::ostream& os, const qot_msgs::TimelineMsgingType&
 namespace qot
 {
 	// Distributed Inter-Process Messenger functionality
-	class Messenger : public dds::sub::NoOpDataReaderListener<qot_msgs::TimelineMsgingType>
+	class Messenger
 	{
 		// Constructor and destructor
-		// The Constructor initializes private member variables and starts the DDS listener
-		// The Destructor stops the DDS listener
+		// The Constructor initializes private member variables and starts receiving messages
+		// on the transport (QOT_TRANSPORT picks shm or udp instead of DDS)
+		// The Destructor stops receiving
 		public: Messenger(const std::string &name, const std::string &uuid);
 		public: ~Messenger();
-
-		// Required by dds::sub::NoOpDataReaderListener dds callback. Gets called when new data is available to read. 
-		public: virtual void on_data_available(dds::sub::DataReader<qot_msgs::TimelineMsgingType>& dr);
-
-		// another dds callback. not sure what it does
-		public: virtual void on_liveliness_changed(dds::sub::DataReader<qot_msgs::TimelineMsgingType>& dr, 
-			const dds::core::status::LivelinessChangedStatus& status);
 	
 		// Publish a Message
 		public: qot_return_t Publish(const qot_message_t msg);
 
+		// Publish a Message with a payload of any size instead of its data field
+		public: qot_return_t PublishPayload(const qot_message_t &msg, const void *payload, size_t length);
+
 		// Subscribe to Messages
 		public: qot_return_t Subscribe(const std::set<qot_msg_type_t> &MsgTypes, qot_msg_callback_t callback);
 
+		// Subscribe to Messages with their payloads (delivered instead of the message callback and queue)
+		public: qot_return_t SubscribePayload(const std::set<qot_msg_type_t> &MsgTypes, qot_payload_callback_t callback);
+
+		// Configure publish batching, timestamp ordering and the receive queue
+		public: qot_return_t ConfigureMessaging(const qot_msg_config_t &config);
+
+		// Set the timeline clock that received messages are ordered and aged against
+		public: void SetClock(qot_clock_callback_t clock, void *arg);
+
+		// Latency of the received messages of a topic (message type) and peer, NULL matching all
+		public: qot_return_t GetLatencyStats(const char *topic, const char *peer, qot_latency_stats_t &stats);
+
+		// Write the latency histograms of every topic and peer to a file
+		public: qot_return_t DumpLatencyStats(const char *path);
+
+		// Write the messages of a partial batch now
+		public: qot_return_t FlushMessages();
+
+		// Take up to max messages from the receive queue, waiting up to timeout_ms for the first
+		public: size_t ReceiveMessages(qot_message_t *msgs, size_t max, int timeout_ms);
+
+		// Get the message pipeline counters
+		public: qot_return_t GetMessageStats(qot_msg_stats_t &stats);
+
 		// Define the cluster -> Wrapper around the cluster manager function
 		public: qot_return_t DefineCluster(const std::vector<std::string> Nodes, qot_node_callback_t callback);
 
 		// Wait for all cluster peers to join -> Wrapper around the cluster manager function
 		public: qot_return_t WaitForPeers();
 
-		// UserFunction Callback for message
-		private: qot_msg_callback_t msg_callback;
+		// Timed barrier rounds -> Wrappers around the cluster manager functions
+		public: qot_return_t BarrierPropose(uint64_t round, int64_t release_ns, int64_t uncertainty_ns,
+			int timeout_ms, int64_t &agreed_ns, int64_t &uncertainty_max_ns);
+		public: qot_return_t BarrierReport(uint64_t round, int64_t wakeup_ns, int64_t slack_ns);
+		public: uint32_t BarrierResult(uint64_t round, int64_t &skew_ns, int64_t &slack_ns);
+
+		// UserFunction Callbacks for message
+		private: std::atomic<qot_msg_callback_t> msg_callback;
+		private: std::atomic<qot_payload_callback_t> payload_callback;
 
 		// Private member Functions
 		// Add and remove types of messages to subscribe to
@@ -96,16 +131,30 @@ namespace qot
 		private: void add_to_subscribed_msg_name_list(const std::string &name);
 		private: void remove_from_subscribed_msg_name_list(const std::string &name);
 
-		// DDS Query Information to filter out messages based oon subscription lists
-		private: std::string sub_expression;
-		private: std::vector<std::string> sub_params;
-		private: std::mutex query_lock; // Lock the query parameters 
-		private: std::unordered_map<int,std::string> type_hashmap; 
-		private: void initialize_hashmap();
+		// Mask of the subscribed types from a list
+		private: static unsigned long long type_mask(const std::set<qot_msg_type_t> &MsgTypes);
+
+		// Transport callback -> filters a received message and delivers it (transport thread)
+		private: void on_message(const TransportHeader &header, const void *payload, size_t length);
+
+		// Hand a message to the receive queue, or measure it and call the callback
+		private: void deliver(const TransportHeader &header, const qot_message_t &msg);
+
+		// Measure the latency of a delivered message
+		private: void measure(const TransportHeader &header);
+
+		// Measure messages taken from the receive queue, against one reading of the clock
+		private: void measure(const qot_message_t *msgs, const qot::MessageStamps *stamps, size_t count);
+
+		// Topic a message type is measured under
+		private: static const char *topic_name(qot_msg_type_t type);
+
+		// Open the transport picked by QOT_TRANSPORT, falling back to DDS
+		private: qot::Transport *open_transport();
 
 		// Private Lists of Subscribed Messages
 		private: std::unordered_set<std::string> sub_nodes; // Unordered Set of nodes subscribed to (stores the unique name of each node)
-		private: unsigned long long sub_type_mask;		    // 64-bit mask of msg types subscribed to -> Init to 0xffffffffffffffff (all messages allowed)
+		private: std::atomic<unsigned long long> sub_type_mask; // 64-bit mask of msg types subscribed to -> Init to 0xffffffffffffffff (all messages allowed)
 
 		// Messenger information about the application and the timeline
 		private: std::string uuid;    // timeline uuid
@@ -120,8 +169,22 @@ namespace qot
 		// Cluster Management Class
 		private: qot::ClusterManager cluster_manager; 
 
+		// Receive queue (NULL delivers on the transport thread)
+		private: std::shared_ptr<qot::MessageQueue> msg_queue;
+
+		// Timeline clock, and the ordering stage in front of the queue (NULL delivers in arrival order)
+		private: std::atomic<qot_clock_callback_t> clock;
+		private: std::atomic<void *> clock_arg;
+		private: std::shared_ptr<qot::MessageReorderer> reorderer;
 
+		// Latency histograms, kept while measure_latency is set
+		private: std::atomic<bool> measure_latency;
+		private: qot::LatencyMonitor latency;
 
+		// Transport of the timeline messages, and publish batching on it. Declared
+		// last so that delivery stops before the members it uses are destroyed
+		private: std::unique_ptr<qot::Transport> transport;
+		private: qot::MessageBatcher batcher;
 	};
 }
 
@@ -62,6 +62,69 @@ qot_return_t subscribe_message(messenger_t messenger, const std::set<qot_msg_typ
     return retval;
 }
 
+/* Publish a Message with a payload of any size */
+qot_return_t publish_payload(messenger_t messenger, const qot_message_t *msg, const void *payload, size_t length)
+{
+    qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+    return typed_obj->PublishPayload(*msg, payload, length);
+}
+
+/* Subscribe to Messages with their payloads */
+qot_return_t subscribe_payload(messenger_t messenger, const std::set<qot_msg_type_t> &MsgTypes, qot_payload_callback_t callback)
+{
+    qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+    return typed_obj->SubscribePayload(MsgTypes, callback);
+}
+
+/* Configure publish batching and the receive queue */
+void set_message_clock(messenger_t messenger, qot_clock_callback_t clock, void *arg)
+{
+    qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+    typed_obj->SetClock(clock, arg);
+}
+
+/* Configure publish batching, timestamp ordering and the receive queue */
+qot_return_t configure_messaging(messenger_t messenger, const qot_msg_config_t *config)
+{
+    qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+    return typed_obj->ConfigureMessaging(*config);
+}
+
+/* Write the messages of a partial batch now */
+qot_return_t flush_messages(messenger_t messenger)
+{
+    qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+    return typed_obj->FlushMessages();
+}
+
+/* Take messages from the receive queue */
+size_t receive_messages(messenger_t messenger, qot_message_t *msgs, size_t max, int timeout_ms)
+{
+    qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+    return typed_obj->ReceiveMessages(msgs, max, timeout_ms);
+}
+
+/* Get the message pipeline counters */
+qot_return_t get_message_stats(messenger_t messenger, qot_msg_stats_t *stats)
+{
+    qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+    return typed_obj->GetMessageStats(*stats);
+}
+
+/* Latency of the received messages of a topic and peer */
+qot_return_t get_latency_stats(messenger_t messenger, const char *topic, const char *peer, qot_latency_stats_t *stats)
+{
+    qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+    return typed_obj->GetLatencyStats(topic, peer, *stats);
+}
+
+/* Write the latency histograms to a file */
+qot_return_t dump_latency_stats(messenger_t messenger, const char *path)
+{
+    qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+    return typed_obj->DumpLatencyStats(path);
+}
+
 /* Define the core cluster of peers to wait for */
 qot_return_t define_cluster(messenger_t messenger, const std::vector<std::string> Nodes, qot_node_callback_t callback) 
 {
@@ -78,4 +141,26 @@ qot_return_t wait_for_peers_to_join(messenger_t messenger)
 	qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
 	retval = typed_obj->WaitForPeers();
 	return retval;
+}
+
+/* Propose a barrier release and wait for the proposals of all peers */
+qot_return_t barrier_propose(messenger_t messenger, uint64_t round, int64_t release_ns, int64_t uncertainty_ns,
+	int timeout_ms, int64_t *agreed_ns, int64_t *uncertainty_max_ns)
+{
+	qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+	return typed_obj->BarrierPropose(round, release_ns, uncertainty_ns, timeout_ms, *agreed_ns, *uncertainty_max_ns);
+}
+
+/* Report when this node woke for a barrier round */
+qot_return_t barrier_report(messenger_t messenger, uint64_t round, int64_t wakeup_ns, int64_t slack_ns)
+{
+	qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+	return typed_obj->BarrierReport(round, wakeup_ns, slack_ns);
+}
+
+/* Wake-up spread and least slack of a barrier round */
+uint32_t barrier_result(messenger_t messenger, uint64_t round, int64_t *skew_ns, int64_t *slack_ns)
+{
+	qot::Messenger* typed_obj = static_cast<qot::Messenger*>(messenger);
+	return typed_obj->BarrierResult(round, *skew_ns, *slack_ns);
 }
\ No newline at end of file
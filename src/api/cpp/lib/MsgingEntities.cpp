@@ -44,7 +44,7 @@ public:
      * This constructor initialises the entities used for publishing.
      */
     PubEntities(const std::string &node_name, const std::string &timeline_uuid):
-        MessageWriter(dds::core::null), nameServiceWriter(dds::core::null)
+        MessageWriter(dds::core::null), nameServiceWriter(dds::core::null), BarrierWriter(dds::core::null)
     {
         std::ostringstream timeline_partition;
         /** Each timeline has its own DDS partition **/
@@ -99,11 +99,23 @@ public:
         dds::pub::qos::DataWriterQos dwQos = nameServiceTopic.qos();
         dwQos << dds::core::policy::WriterDataLifecycle::ManuallyDisposeUnregisteredInstances();
         nameServiceWriter = dds::pub::DataWriter<qot_msgs::NameService>(publisher, nameServiceTopic, dwQos);
+
+        /**
+         * A dds::pub::DataWriter is created for the reliable qot_msgs::BarrierType topic. It
+         * keeps every sample like the reader, so that a proposal is not replaced by the next
+         * round's before a slow peer has acknowledged it
+         */
+        dds::topic::Topic<qot_msgs::BarrierType> BarrierTopic
+            = dds::topic::Topic<qot_msgs::BarrierType>(participant, "QoT_Barrier", reliableTopicQos);
+        dds::pub::qos::DataWriterQos barrierQos = BarrierTopic.qos();
+        barrierQos << dds::core::policy::History::KeepAll();
+        BarrierWriter = dds::pub::DataWriter<qot_msgs::BarrierType>(publisher, BarrierTopic, barrierQos);
     }
 
 public:
     dds::pub::DataWriter<qot_msgs::TimelineMsgingType> MessageWriter;
     dds::pub::DataWriter<qot_msgs::NameService> nameServiceWriter;
+    dds::pub::DataWriter<qot_msgs::BarrierType> BarrierWriter;
 };
 
 /**
@@ -116,7 +128,7 @@ public:
      * This constructor initialises the entities for subscribing.
      */
     SubEntities(const std::string &node_name, const std::string &timeline_uuid) :
-        MessageReader(dds::core::null), nameServiceReader(dds::core::null)
+        MessageReader(dds::core::null), nameServiceReader(dds::core::null), BarrierReader(dds::core::null)
     {
         std::ostringstream timeline_partition;
         /** Each timeline has its own DDS partition **/
@@ -185,11 +197,22 @@ public:
         /** A dds::sub::DataReader is created for the qot_msgs::NameService topic with the TopicQos. */
         nameServiceReader
             = dds::sub::DataReader<qot_msgs::NameService>(subscriber, nameServiceTopic, nameServiceTopic.qos());
+
+        /**
+         * A dds::sub::DataReader is created for the qot_msgs::BarrierType topic. Every
+         * sample of every node is kept, since a node may run a round ahead of another
+         */
+        dds::topic::Topic<qot_msgs::BarrierType> BarrierTopic
+            = dds::topic::Topic<qot_msgs::BarrierType>(participant, "QoT_Barrier", reliableTopicQos);
+        dds::sub::qos::DataReaderQos barrierQos = BarrierTopic.qos();
+        barrierQos << dds::core::policy::History::KeepAll();
+        BarrierReader = dds::sub::DataReader<qot_msgs::BarrierType>(subscriber, BarrierTopic, barrierQos);
     }
 
 public:
     dds::sub::DataReader<qot_msgs::TimelineMsgingType> MessageReader;
     dds::sub::DataReader<qot_msgs::NameService> nameServiceReader;
+    dds::sub::DataReader<qot_msgs::BarrierType> BarrierReader;
 };
 
 }
@@ -26,12 +26,25 @@
  */
 
 #include <iostream>
+#include <new>
 
 // Pub-Sub Header
 #include "PubSub.hpp"
 
 using namespace qot;
 
+// Open the transport of a topic
+static Transport *open_topic(const std::string &topicName, const std::string &nodeName, const std::string &timelineUUID,
+    qot::TransportType transportType, int roles)
+{
+    TransportConfig config;
+    config.timeline = timelineUUID;
+    config.topic = topicName;
+    config.node = nodeName;
+    config.roles = roles;
+    return OpenTransport(transportType, config);
+}
+
 // Helper function to reshape topic name based on topic type
 void PublisherImpl::reshapeTopicName()
 {
@@ -56,58 +69,22 @@ void PublisherImpl::reshapeTopicName()
     std::cout << "PublisherImpl: Publishing to topic " << topic_name << "\n";
 }
 
+// Helper function to open the transport of the reshaped topic
+Transport *PublisherImpl::open_transport(qot::TransportType transportType)
+{
+    reshapeTopicName();
+    std::cout << "Creating Publisher on Timeline " << timeline_uuid << " for topic " << topic_name << "\n";
+    return open_topic(topic_name, node_name, timeline_uuid, transportType, TRANSPORT_ROLE_PUB);
+}
+
 /**
  * Publisher Constructor
  */
-PublisherImpl::PublisherImpl(const std::string &topicName, const qot::TopicType topicType, const std::string &nodeName, const std::string &timelineUUID)
- : timeline_uuid(timelineUUID), topic_type(topicType), topic_name(topicName), node_name(nodeName), dataWriter(dds::core::null)
+PublisherImpl::PublisherImpl(const std::string &topicName, const qot::TopicType topicType, const std::string &nodeName, const std::string &timelineUUID,
+    qot::TransportType transportType)
+ : timeline_uuid(timelineUUID), topic_type(topicType), topic_name(topicName), node_name(nodeName),
+   transport(open_transport(transportType)), batcher(*transport)
 {
-    int result = 0;
-    try
-    {
-        /** A dds::domain::DomainParticipant is created for the default domain. */
-        dds::domain::DomainParticipant dp(org::opensplice::domain::default_id());
-
-        /** The Durability::Transient policy is specified as a dds::topic::qos::TopicQos
-         * so that even if the subscriber does not join until after the sample is written
-         * then the DDS will still retain the sample for it. The Reliability::Reliable
-         * policy is also specified to guarantee delivery. */
-        dds::topic::qos::TopicQos topicQos
-             = dp.default_topic_qos()
-                << dds::core::policy::Durability::Transient()
-                << dds::core::policy::Reliability::Reliable();
-
-        /** Reshape Topic Name based on type **/
-        reshapeTopicName();
-
-        /** A dds::topic::Topic is created for our messaging type on the domain participant. */
-        dds::topic::Topic<qot_msgs::TimelineMsgingType> topic(dp, topic_name, topicQos);
-
-        std::cout << "Creating Publisher on Timeline " << timeline_uuid << " for topic " << topic_name << "\n";
-
-        /** A dds::pub::Publisher is created on the domain participant. 
-            Set the partition specific to the timeline **/
-        dds::pub::qos::PublisherQos pubQos
-            = dp.default_publisher_qos()
-                << dds::core::policy::Partition(timeline_uuid);
-        dds::pub::Publisher pub(dp, pubQos);
-
-        /** The dds::pub::qos::DataWriterQos is derived from the topic qos and the
-         * WriterDataLifecycle::ManuallyDisposeUnregisteredInstances policy is
-         * specified as an addition. This is so the publisher can optionally be run (and
-         * exit) before the subscriber. It prevents the middleware default 'clean up' of
-         * the topic instance after the writer deletion, this deletion implicitly performs
-         * DataWriter::unregister_instance */
-        dds::pub::qos::DataWriterQos dwqos = topic.qos();
-        dwqos << dds::core::policy::WriterDataLifecycle::ManuallyDisposeUnregisteredInstances();
-
-        /** A dds::pub::DataWriter is created on the Publisher & Topic with the modififed Qos. */
-        dataWriter = dds::pub::DataWriter<qot_msgs::TimelineMsgingType>(pub, topic, dwqos);
-    }
-    catch (const dds::core::Exception& e)
-    {
-        std::cerr << "ERROR: Exception: " << e.what() << std::endl;
-    }
 }
 
 /**
@@ -121,23 +98,57 @@ PublisherImpl::~PublisherImpl()
 /* Public function to publish a message to a topic */
 qot_return_t PublisherImpl::Publish(const qot_message_t msg)
 {
-    qot_msgs::UncertainTimestamp utimestamp;
+    TransportHeader header;
+    MessageToHeader(msg, node_name, header);
+
+    // Publish the message, or add it to the batch in progress
+    return batcher.Publish(header, msg.data, strnlen(msg.data, QOT_MAX_NAMELEN));
+}
+
+/* Publish a payload of any size with the message */
+qot_return_t PublisherImpl::PublishPayload(const qot_message_t &msg, const void *payload, size_t length)
+{
+    TransportHeader header;
+    if (length > transport->MaxPayload() || (length && !payload))
+        return QOT_RETURN_TYPE_ERR;
+    MessageToHeader(msg, node_name, header);
+    return batcher.Publish(header, payload, length);
+}
+
+/* Reserve space for a payload, written in place on the shared-memory transport */
+qot_return_t PublisherImpl::Reserve(size_t length, TransportBuffer &buffer)
+{
+    // Batched messages go out first, so that messages stay in order
+    batcher.Flush();
+    return transport->Reserve(length, buffer);
+}
+
+/* Publish a reserved payload */
+qot_return_t PublisherImpl::Commit(const qot_message_t &msg, TransportBuffer &buffer)
+{
+    TransportHeader header;
+    MessageToHeader(msg, node_name, header);
+    return transport->Commit(header, buffer);
+}
+
+/* Configure publish batching */
+qot_return_t PublisherImpl::Configure(const qot_msg_config_t &config)
+{
+    return batcher.Configure(config.batch_size, config.flush_us);
+}
+
+/* Write the messages of a partial batch now */
+qot_return_t PublisherImpl::Flush()
+{
+    return batcher.Flush();
+}
 
-    // Unroll Message Timestamp (resolution is in ns -> convert to asec later)
-    utimestamp.timestamp()     = msg.timestamp.estimate.sec*nSEC_PER_SEC + msg.timestamp.estimate.asec/ASEC_PER_NSEC;
-    utimestamp.uncertainty_u() = msg.timestamp.interval.above.sec*nSEC_PER_SEC + msg.timestamp.interval.above.asec/ASEC_PER_NSEC;
-    utimestamp.uncertainty_l() = msg.timestamp.interval.below.sec*nSEC_PER_SEC + msg.timestamp.interval.below.asec/ASEC_PER_NSEC;
-    
-    // Unroll message parameters
-    timeline_msg.name() = (std::string) node_name;            // Our name
-    timeline_msg.uuid() = (std::string) timeline_uuid;        // Timeline UUID
-    timeline_msg.type() = (qot_msgs::MsgType) msg.type;       // Msg Type
-    timeline_msg.data() = std::string(msg.data);              // Msg Data
-    timeline_msg.utimestamp() = utimestamp;                   // Timestamp Associated with Msg
-    
-    // Publish the message
-    dataWriter.write(timeline_msg);
-    return QOT_RETURN_TYPE_OK;  
+/* Get the publishing counters */
+qot_return_t PublisherImpl::GetStats(qot_msg_stats_t &stats)
+{
+    memset(&stats, 0, sizeof(qot_msg_stats_t));
+    batcher.GetStats(stats);
+    return QOT_RETURN_TYPE_OK;
 }
 
 // Helper function to reshape topic name based on topic type
@@ -165,53 +176,25 @@ void SubscriberImpl::reshapeTopicName()
     std::cout << "SubscriberImpl: Subscribing to topic " << topic_name << "\n";
 }
 
+// Helper function to open the transport of the reshaped topic
+Transport *SubscriberImpl::open_transport(qot::TransportType transportType)
+{
+    reshapeTopicName();
+    std::cout << "Creating Subscriber on Timeline " << timeline_uuid << " for topic " << topic_name << "\n";
+    return open_topic(topic_name, "", timeline_uuid, transportType, TRANSPORT_ROLE_SUB);
+}
+
 /**
  * Subscriber Constructor
  */
-SubscriberImpl::SubscriberImpl(const std::string &topicName, const qot::TopicType topicType, const std::string &timelineUUID, qot_msg_callback_t callback)
- : timeline_uuid(timelineUUID), topic_name(topicName), topic_type(topicType), dataReader(dds::core::null), msg_callback(NULL)
+SubscriberImpl::SubscriberImpl(const std::string &topicName, const qot::TopicType topicType, const std::string &timelineUUID, qot_msg_callback_t callback,
+    qot::TransportType transportType)
+ : msg_callback(callback), payload_callback(NULL), timeline_uuid(timelineUUID), topic_name(topicName), topic_type(topicType),
+   transport(open_transport(transportType))
 {
-    // Set the subscriber callback function
-    if(callback != NULL)
-    {
-        msg_callback = callback;
-    }
-
-    try
-    {
-        /** A domain participant and topic are created identically as in
-         the ::publisher */
-        dds::domain::DomainParticipant dp(org::opensplice::domain::default_id());
-        dds::topic::qos::TopicQos topicQos = dp.default_topic_qos()
-                                                    << dds::core::policy::Durability::Transient()
-                                                    << dds::core::policy::Reliability::Reliable();
-
-        /** Reshape Topic Name based on type **/
-        reshapeTopicName();
-
-        dds::topic::Topic<qot_msgs::TimelineMsgingType> topic(dp, topic_name, topicQos);
-
-        std::cout << "Creating Subscriber on Timeline " << timeline_uuid << " for topic " << topic_name << "\n";
-        /** A dds::sub::Subscriber is created on the domain participant. 
-            Set the partition specific to the timeline **/
-        dds::sub::qos::SubscriberQos subQos
-            = dp.default_subscriber_qos()
-                << dds::core::policy::Partition(timeline_uuid);
-        dds::sub::Subscriber sub(dp, subQos);
-
-        /** The dds::sub::qos::DataReaderQos are derived from the topic qos */
-        dds::sub::qos::DataReaderQos drqos = topic.qos();
-
-        /** A dds::sub::DataReader is created on the Subscriber & Topic with the DataReaderQos. */
-        dataReader = dds::sub::DataReader<qot_msgs::TimelineMsgingType>(sub, topic, drqos);
-
-        /** Create a topic listener for the data reader **/
-        dataReader.listener(this, dds::core::status::StatusMask::data_available());
-    }
-    catch (const dds::core::Exception& e)
-    {
-        std::cerr << "ERROR: Exception: " << e.what() << std::endl;
-    }
+    // Start receiving messages
+    transport->Subscribe(std::bind(&SubscriberImpl::on_message, this,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 }
 
 /**
@@ -219,58 +202,79 @@ SubscriberImpl::SubscriberImpl(const std::string &topicName, const qot::TopicTyp
  */
 SubscriberImpl::~SubscriberImpl()
 {
-    dataReader.listener(nullptr, dds::core::status::StatusMask::none());
+    // The transport is destroyed first, which stops the delivery
     std::cout << "Subscriber of topic " << topic_name << " has terminated" << std::endl;
 }
 
-/* DDS Callback to receive subscribed messages */
-void SubscriberImpl::on_data_available(dds::sub::DataReader<qot_msgs::TimelineMsgingType>& dr) 
+/* Transport callback to deliver subscribed messages */
+void SubscriberImpl::on_message(const TransportHeader &header, const void *payload, size_t length)
 {
-    // QoT Message type
-    qot_message_t qot_msg;
-    // get only new/unread data
-    dds::sub::status::DataState aliveDataState;
-            aliveDataState << dds::sub::status::SampleState::any()
-                << dds::sub::status::ViewState::any()
-                << dds::sub::status::InstanceState::alive();
-    /**
-     * Take messages. Using take instead of read removes the messages from
-     * the system, preventing resources from being saturated due to a build
-     * up of messages
-     */
-    dds::sub::LoanedSamples<qot_msgs::TimelineMsgingType> messages
-        = dr.select().state(aliveDataState).take();
+    qot_payload_callback_t pcallback;
+    qot_message_t msg;
+    HeaderToMessage(header, payload, length, msg);
 
-    /** Output the username and content for each message */
-    for (dds::sub::LoanedSamples<qot_msgs::TimelineMsgingType>::const_iterator message
-            = messages.begin(); message < messages.end(); ++message)
+    // Payload subscribers get the payload in place, before it is released
+    pcallback = payload_callback.load();
+    if (pcallback != NULL)
     {
-        if(message->info().valid())
-        {
-            strcpy(qot_msg.name, (message->data().name()).c_str());
-            qot_msg.type = (qot_msg_type_t) message->data().type();
-            strcpy(qot_msg.data, (message->data().data()).c_str());
-            TP_FROM_nSEC(qot_msg.timestamp.estimate, message->data().utimestamp().timestamp());
-            TL_FROM_nSEC(qot_msg.timestamp.interval.above, message->data().utimestamp().uncertainty_u());
-            TL_FROM_nSEC(qot_msg.timestamp.interval.below, message->data().utimestamp().uncertainty_l());
-            if(msg_callback != NULL)
-            {
-                msg_callback(&qot_msg);
-            }
-        }
+        pcallback(&msg, payload, length);
+        return;
+    }
+
+    /** Hand the message to the receive queue or the callback */
+    std::shared_ptr<MessageQueue> queue = std::atomic_load(&msg_queue);
+    if (queue)
+    {
+        queue->Push(&msg, 1);
+        return;
     }
+    if(msg_callback != NULL)
+        msg_callback(&msg);
 }
 
-void SubscriberImpl::on_liveliness_changed(dds::sub::DataReader<qot_msgs::TimelineMsgingType>& dr, 
-    const dds::core::status::LivelinessChangedStatus& status) 
+/* Deliver payloads to a callback of their own */
+qot_return_t SubscriberImpl::SetPayloadCallback(qot_payload_callback_t callback)
 {
-    // according to C++ API reference, this function gets called when the
-    // 'liveliness' of a DataWriter writing to this DataReader has changed
-    // "changed" meaning has become 'alive' or 'not alive'.
-    // 
-    // I think this can detect when new writers have joined the board/topic
-    // and when current writers have died. (maybe)
+    payload_callback = callback;
+    return QOT_RETURN_TYPE_OK;
 }
 
+/* Configure the receive queue, messages still in a previous queue are dropped with it */
+qot_return_t SubscriberImpl::Configure(const qot_msg_config_t &config)
+{
+    std::shared_ptr<MessageQueue> queue;
+    if (config.queue_depth > QOT_MSG_MAX_QUEUE_DEPTH || (config.queue_depth & (config.queue_depth - 1)))
+        return QOT_RETURN_TYPE_ERR;
+    if (config.queue_depth)
+    {
+        try
+        {
+            queue = std::make_shared<MessageQueue>(config.queue_depth, config.block_us);
+        }
+        catch (const std::bad_alloc &)
+        {
+            return QOT_RETURN_TYPE_ERR;
+        }
+    }
+    std::atomic_store(&msg_queue, queue);
+    return QOT_RETURN_TYPE_OK;
+}
 
+/* Take messages from the receive queue */
+size_t SubscriberImpl::Receive(qot_message_t *msgs, size_t max, int timeout_ms)
+{
+    std::shared_ptr<MessageQueue> queue = std::atomic_load(&msg_queue);
+    if (!queue || !msgs)
+        return 0;
+    return queue->Pop(msgs, max, timeout_ms);
+}
 
+/* Get the delivery counters */
+qot_return_t SubscriberImpl::GetStats(qot_msg_stats_t &stats)
+{
+    std::shared_ptr<MessageQueue> queue = std::atomic_load(&msg_queue);
+    memset(&stats, 0, sizeof(qot_msg_stats_t));
+    if (queue)
+        queue->GetStats(stats);
+    return QOT_RETURN_TYPE_OK;
+}
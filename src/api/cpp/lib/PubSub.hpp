@@ -37,8 +37,15 @@ extern "C"
 // Timeline Message DDS IDL
 #include <msg/QoT_DCPS.hpp>
 
+#include <atomic>
+#include <memory>
+
 #include "PubSubWrapper.hpp"
 
+// Message transports, batched publishing and queued delivery
+#include "../transport/MsgPipeline.hpp"
+#include "DdsTransport.hpp"
+
 std::ostream& operator <<(std::ostream& os, const qot_msgs::TimelineMsgingType& tms);
 
 namespace qot
@@ -47,61 +54,96 @@ namespace qot
 	class PublisherImpl
 	{
 		// Constructor and destructor
-		// The Constructor initializes private member variables and starts the DDS datawriter
-		// The Destructor destroys the datawriter
-		public: PublisherImpl(const std::string &topicName, const qot::TopicType topicType, const std::string &nodeName, const std::string &timelineUUID);
+		// The Constructor initializes private member variables and opens the transport of the topic
+		// The Destructor closes the transport
+		public: PublisherImpl(const std::string &topicName, const qot::TopicType topicType, const std::string &nodeName, const std::string &timelineUUID,
+			qot::TransportType transportType);
 		public: ~PublisherImpl();
 	
 		// Publish to a topic -> Needs to be called for each data point published
 		public: qot_return_t Publish(const qot_message_t msg);
 
+		// Publish a payload of any size instead of the message data field
+		public: qot_return_t PublishPayload(const qot_message_t &msg, const void *payload, size_t length);
+
+		// Zero-copy publish -> reserve space for the payload, write it, then commit it
+		public: qot_return_t Reserve(size_t length, qot::TransportBuffer &buffer);
+		public: qot_return_t Commit(const qot_message_t &msg, qot::TransportBuffer &buffer);
+
+		// Configure publish batching (the receive queue fields are ignored)
+		public: qot_return_t Configure(const qot_msg_config_t &config);
+
+		// Write the messages of a partial batch now
+		public: qot_return_t Flush();
+
+		// Get the publishing counters
+		public: qot_return_t GetStats(qot_msg_stats_t &stats);
+
 		// Helper function to reshape topic name based on topic type
 		private: void reshapeTopicName();
 
+		// Helper function to open the transport of the reshaped topic
+		private: qot::Transport *open_transport(qot::TransportType transportType);
+
 		// Information about the application, topic and the timeline
 		private: std::string timeline_uuid;    // timeline uuid
 		private: std::string node_name;    	   // application name
 		private: std::string topic_name;	   // topic name 
 		private: qot::TopicType topic_type;	   // topic type			 
 
-		// DDS Data Writer
-		private: dds::pub::DataWriter<qot_msgs::TimelineMsgingType> dataWriter;		
-
-		// DDS Message Data Type
-		private: qot_msgs::TimelineMsgingType timeline_msg;
+		// Transport of the topic
+		private: std::unique_ptr<qot::Transport> transport;
 
+		// Publish batching on the transport
+		private: qot::MessageBatcher batcher;
 
 	};
 
 	// Distributed Inter-Process Subscriber functionality
-	class SubscriberImpl : public dds::sub::NoOpDataReaderListener<qot_msgs::TimelineMsgingType>
+	class SubscriberImpl
 	{
 		// Constructor and destructor
-		// The Constructor initializes private member variables and starts the DDS datareader
-		// The Destructor destroys the datareader
-		public: SubscriberImpl(const std::string &topicName, const qot::TopicType topicType, const std::string &timelineUUID, qot_msg_callback_t callback);
+		// The Constructor initializes private member variables and starts receiving on the transport of the topic
+		// The Destructor stops receiving
+		public: SubscriberImpl(const std::string &topicName, const qot::TopicType topicType, const std::string &timelineUUID, qot_msg_callback_t callback,
+			qot::TransportType transportType);
 		public: ~SubscriberImpl();
 
-		// Required by dds::sub::NoOpDataReaderListener dds callback. Gets called when new data is available to read. 
-		public: virtual void on_data_available(dds::sub::DataReader<qot_msgs::TimelineMsgingType>& dr);
+		// Deliver the messages with their payloads to callback instead (NULL restores the message callback)
+		public: qot_return_t SetPayloadCallback(qot_payload_callback_t callback);
+
+		// Configure the receive queue (the publish batching fields are ignored)
+		public: qot_return_t Configure(const qot_msg_config_t &config);
+
+		// Take up to max messages from the receive queue, waiting up to timeout_ms for the first
+		public: size_t Receive(qot_message_t *msgs, size_t max, int timeout_ms);
 
-		// another dds callback. not sure what it does
-		public: virtual void on_liveliness_changed(dds::sub::DataReader<qot_msgs::TimelineMsgingType>& dr, 
-			const dds::core::status::LivelinessChangedStatus& status);
+		// Get the delivery counters
+		public: qot_return_t GetStats(qot_msg_stats_t &stats);
 
 		// Helper function to reshape topic name based on topic type
 		private: void reshapeTopicName();
 
-		// UserFunction Callback for message
+		// Helper function to open the transport of the reshaped topic
+		private: qot::Transport *open_transport(qot::TransportType transportType);
+
+		// Transport callback -> delivers a received message (transport thread)
+		private: void on_message(const qot::TransportHeader &header, const void *payload, size_t length);
+
+		// UserFunction Callbacks for message
 		private: qot_msg_callback_t msg_callback;
+		private: std::atomic<qot_payload_callback_t> payload_callback;
 
 		// Information about the topic and the timeline
 		private: std::string timeline_uuid;    // timeline uuid
 		private: std::string topic_name;       // topic name
 		private: qot::TopicType topic_type;	   // topic type			 
 
-		// DDS Data Writer
-		private: dds::sub::DataReader<qot_msgs::TimelineMsgingType> dataReader;
+		// Receive queue (NULL delivers on the transport thread)
+		private: std::shared_ptr<qot::MessageQueue> msg_queue;
+
+		// Transport of the topic, declared last so that delivery stops first
+		private: std::unique_ptr<qot::Transport> transport;
 	};
 }
 
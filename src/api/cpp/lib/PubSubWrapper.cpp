@@ -39,7 +39,8 @@ extern "C"
 using namespace qot;
 
 // Publisher Constructor
-Publisher::Publisher(const std::string &topicName, const qot::TopicType topicType, const std::string &nodeName, const std::string &timelineUUID)
+Publisher::Publisher(const std::string &topicName, const qot::TopicType topicType, const std::string &nodeName, const std::string &timelineUUID,
+	qot::TransportType transportType)
 {
 	// Check if timeline is global before allowing global topics
 	if (topicType == TOPIC_GLOBAL || topicType == TOPIC_GLOBAL_OPT)
@@ -51,7 +52,7 @@ Publisher::Publisher(const std::string &topicName, const qot::TopicType topicTyp
 			throw 20; // Change this to a specific number
 		}
 	} 
-	Impl = new PublisherImpl(topicName, topicType, nodeName, timelineUUID);
+	Impl = new PublisherImpl(topicName, topicType, nodeName, timelineUUID, transportType);
 }
 
 // Publisher Destructor
@@ -67,7 +68,44 @@ qot_return_t Publisher::Publish(const qot_message_t msg)
 	return QOT_RETURN_TYPE_OK;
 }
 
-Subscriber::Subscriber(const std::string &topicName, const qot::TopicType topicType, const std::string &timelineUUID, qot_msg_callback_t callback)
+// Publish a payload of any size
+qot_return_t Publisher::PublishPayload(const qot_message_t &msg, const void *payload, size_t length)
+{
+	return Impl->PublishPayload(msg, payload, length);
+}
+
+// Reserve space for a payload
+qot_return_t Publisher::Reserve(size_t length, qot::TransportBuffer &buffer)
+{
+	return Impl->Reserve(length, buffer);
+}
+
+// Publish a reserved payload
+qot_return_t Publisher::Commit(const qot_message_t &msg, qot::TransportBuffer &buffer)
+{
+	return Impl->Commit(msg, buffer);
+}
+
+// Batch published messages
+qot_return_t Publisher::Configure(const qot_msg_config_t &config)
+{
+	return Impl->Configure(config);
+}
+
+// Write the messages of a partial batch now
+qot_return_t Publisher::Flush()
+{
+	return Impl->Flush();
+}
+
+// Get the publishing counters
+qot_return_t Publisher::GetStats(qot_msg_stats_t &stats)
+{
+	return Impl->GetStats(stats);
+}
+
+Subscriber::Subscriber(const std::string &topicName, const qot::TopicType topicType, const std::string &timelineUUID, qot_msg_callback_t callback,
+	qot::TransportType transportType)
 {
 	// Check if timeline is global before allowing global topics
 	if (topicType == TOPIC_GLOBAL || topicType == TOPIC_GLOBAL_OPT)
@@ -79,7 +117,7 @@ Subscriber::Subscriber(const std::string &topicName, const qot::TopicType topicT
 			throw 20; // Change this to a specific number
 		}
 	} 
-	Impl = new SubscriberImpl(topicName, topicType, timelineUUID, callback);
+	Impl = new SubscriberImpl(topicName, topicType, timelineUUID, callback, transportType);
 }
 
 Subscriber::~Subscriber()
@@ -87,3 +125,27 @@ Subscriber::~Subscriber()
 	delete Impl;
 }
 
+// Deliver payloads to a callback of their own
+qot_return_t Subscriber::SetPayloadCallback(qot_payload_callback_t callback)
+{
+	return Impl->SetPayloadCallback(callback);
+}
+
+// Queue received messages
+qot_return_t Subscriber::Configure(const qot_msg_config_t &config)
+{
+	return Impl->Configure(config);
+}
+
+// Take queued messages
+size_t Subscriber::Receive(qot_message_t *msgs, size_t max, int timeout_ms)
+{
+	return Impl->Receive(msgs, max, timeout_ms);
+}
+
+// Get the delivery counters
+qot_return_t Subscriber::GetStats(qot_msg_stats_t &stats)
+{
+	return Impl->GetStats(stats);
+}
+
@@ -36,6 +36,9 @@ extern "C"
 
 #include <string>
 
+// Message transports
+#include "../transport/Transport.hpp"
+
 namespace qot
 {
 	enum TopicType { 
@@ -52,11 +55,30 @@ namespace qot
 	class Publisher 
 	{
 		// Constructor and destructor
-		public: Publisher(const std::string &topicName, const qot::TopicType topicType, const std::string &nodeName, const std::string &timelineUUID);
+		// The transport defaults to the one named by QOT_TRANSPORT, else DDS
+		public: Publisher(const std::string &topicName, const qot::TopicType topicType, const std::string &nodeName, const std::string &timelineUUID,
+			qot::TransportType transportType = qot::TRANSPORT_DEFAULT);
 		public: ~Publisher();
 	  	
 	  	// Publish to a topic -> Needs to be called for each data point published
 		public: qot_return_t Publish(const qot_message_t msg);
+
+		// Publish a payload of any size instead of the data field (name and type come from msg)
+		public: qot_return_t PublishPayload(const qot_message_t &msg, const void *payload, size_t length);
+
+		// Zero-copy publish -> reserve space for the payload (in the shared-memory ring on
+		// the shm transport), write it to buffer.data, then commit it with its message
+		public: qot_return_t Reserve(size_t length, qot::TransportBuffer &buffer);
+		public: qot_return_t Commit(const qot_message_t &msg, qot::TransportBuffer &buffer);
+
+		// Batch published messages -> batch_size and flush_us of the config are used
+		public: qot_return_t Configure(const qot_msg_config_t &config);
+
+		// Write the messages of a partial batch now
+		public: qot_return_t Flush();
+
+		// Get the publishing counters
+		public: qot_return_t GetStats(qot_msg_stats_t &stats);
 		
 		// Publisher Implementation class
 		private: PublisherImpl *Impl;
@@ -69,8 +91,23 @@ namespace qot
 	class Subscriber
 	{
 		// Constructor and destructor
-		public: Subscriber(const std::string &topicName, const qot::TopicType topicType, const std::string &timelineUUID, qot_msg_callback_t callback);
+		public: Subscriber(const std::string &topicName, const qot::TopicType topicType, const std::string &timelineUUID, qot_msg_callback_t callback,
+			qot::TransportType transportType = qot::TRANSPORT_DEFAULT);
 		public: ~Subscriber();
+
+		// Deliver each message with its payload to callback instead of the message
+		// callback and the queue. The payload is only valid during the call
+		public: qot_return_t SetPayloadCallback(qot_payload_callback_t callback);
+
+		// Queue received messages for Receive instead of calling back on the DDS
+		// thread -> queue_depth and block_us of the config are used
+		public: qot_return_t Configure(const qot_msg_config_t &config);
+
+		// Take up to max queued messages, waiting up to timeout_ms for the first (-1 waits forever)
+		public: size_t Receive(qot_message_t *msgs, size_t max, int timeout_ms);
+
+		// Get the delivery counters
+		public: qot_return_t GetStats(qot_msg_stats_t &stats);
 	  	
 		// Subscriber Implementation class
 		private: SubscriberImpl *Impl;
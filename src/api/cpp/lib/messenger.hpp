@@ -50,8 +50,45 @@ qot_return_t publish_message(messenger_t messenger, qot_message_t msg);
 /* Subscribe Message*/
 qot_return_t subscribe_message(messenger_t messenger, const std::set<qot_msg_type_t> &MsgTypes, qot_msg_callback_t callback);
 
+/* Publish a Message with a payload of any size */
+qot_return_t publish_payload(messenger_t messenger, const qot_message_t *msg, const void *payload, size_t length);
+
+/* Subscribe to Messages with their payloads */
+qot_return_t subscribe_payload(messenger_t messenger, const std::set<qot_msg_type_t> &MsgTypes, qot_payload_callback_t callback);
+
+/* Set the timeline clock received messages are ordered against */
+void set_message_clock(messenger_t messenger, qot_clock_callback_t clock, void *arg);
+
+/* Configure publish batching, timestamp ordering and the receive queue */
+qot_return_t configure_messaging(messenger_t messenger, const qot_msg_config_t *config);
+
+/* Write the messages of a partial batch now */
+qot_return_t flush_messages(messenger_t messenger);
+
+/* Take messages from the receive queue */
+size_t receive_messages(messenger_t messenger, qot_message_t *msgs, size_t max, int timeout_ms);
+
+/* Get the message pipeline counters */
+qot_return_t get_message_stats(messenger_t messenger, qot_msg_stats_t *stats);
+
+/* Latency of the received messages of a topic and peer */
+qot_return_t get_latency_stats(messenger_t messenger, const char *topic, const char *peer, qot_latency_stats_t *stats);
+
+/* Write the latency histograms to a file */
+qot_return_t dump_latency_stats(messenger_t messenger, const char *path);
+
 /* Define the Nodes participating in the coordination */
 qot_return_t define_cluster(messenger_t messenger, const std::vector<std::string> Nodes, qot_node_callback_t callback);
 
 /* Wait for all peers to join the cluster*/
 qot_return_t wait_for_peers_to_join(messenger_t messenger);
+
+/* Propose a barrier release and wait for the proposals of all peers */
+qot_return_t barrier_propose(messenger_t messenger, uint64_t round, int64_t release_ns, int64_t uncertainty_ns,
+	int timeout_ms, int64_t *agreed_ns, int64_t *uncertainty_max_ns);
+
+/* Report when this node woke for a barrier round */
+qot_return_t barrier_report(messenger_t messenger, uint64_t round, int64_t wakeup_ns, int64_t slack_ns);
+
+/* Wake-up spread and least slack of a barrier round, returns the nodes reported */
+uint32_t barrier_result(messenger_t messenger, uint64_t round, int64_t *skew_ns, int64_t *slack_ns);
@@ -32,6 +32,9 @@
 extern "C"
 {
     #include <math.h>
+    #include <malloc.h>
+    #include <alloca.h>
+    #include <stdarg.h>
     #include <pthread.h>
     #include <stdio.h>
     #include <stdlib.h>
@@ -39,27 +42,267 @@ extern "C"
     #include <fcntl.h>
     #include <signal.h>
     #include <errno.h>
+    #include <inttypes.h>
     #include <poll.h>
+    #include <sched.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
 
     #include <linux/ptp_clock.h>
 }
 
+/* Uncertainty model shared with the kernel module (ahead of the userspace
+   definitions in qot_types.h, as in the emulation) */
+extern "C"
+{
+    #include "../../qot_uncertainty.h"
+}
+
 /* This file includes */
 #include "qot.hpp"
 
+/* Bulk projection of timestamps */
+#include "../../qot_math.h"
+
 #define DEBUG 0
 
+/* SCHED_DEADLINE is not exposed by every libc */
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+#ifndef SYS_sched_setattr
+#define SYS_sched_setattr __NR_sched_setattr
+#endif
+
+/* Dynamic POSIX clock id of a /dev/timelineX file descriptor */
+#define FD_TO_CLOCKID(fd) ((~(clockid_t) (fd) << 3) | 3)
+
+/* Periods between checks of the discipline for drift */
+#define QOT_DL_REALIGN_PERIODS 16
+/* Frequency drift (ppb) which forces the reservation to be re-issued */
+#define QOT_DL_REALIGN_PPB     1000
+
+/* Kernel sched_attr layout for sched_setattr(2) */
+struct qot_sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t  sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+/* SCHED_DEADLINE reservation state */
+typedef struct timeline_dl {
+    int enabled;                          /* Reservation installed                    */
+    int activated;                        /* A job has been released                  */
+    uint64_t runtime_ns;                  /* Timeline runtime per period              */
+    uint64_t deadline_ns;                 /* Timeline relative deadline               */
+    int64_t mult;                         /* Discipline ppb used for the reservation  */
+    uint32_t periods;                     /* Periods since the last drift check       */
+    timepoint_t activation;               /* Timeline release time of the current job */
+    qot_deadline_stats_t stats;           /* Deadline-miss accounting                 */
+} timeline_dl_t;
+
+/* Event callbacks and dispatch counters */
+typedef struct timeline_events {
+    int registered;                       /* Listed with the event dispatcher         */
+    qot_callback_t callbacks[QOT_EVENT_NUM_TYPES];
+    qot_event_batch_callback_t batch_callbacks[QOT_EVENT_NUM_TYPES];
+    qot_event_stats_t stats;              /* Per-type throughput and depth counters   */
+} timeline_events_t;
+
 /* Timeline implementation */
 typedef struct timeline {
     qot_timeline_t info;                  /* Basic timeline information               */
     qot_binding_t binding;                /* Basic binding info                       */
     int fd;                               /* File descriptor to /dev/timelineX ioctl  */
-    int qotusr_fd;                        /* File descriptor to /dev/qotusr ioctl     */
+    int qotusr_fd;                        /* Shared /dev/qotusr of the process        */
+    int event_fd;                         /* Own /dev/qotusr for events, or -1        */
     int clock_fd;                         /* File Descriptor to /dev/ptpY             */
-    qot_callback_t event_callback;        /* Event Callback Function                  */
-    messenger_t messenger;                /* Messenger Object                         */
+    int bound;                            /* Handles validated by a successful bind   */
+    int period_woken;                     /* last_wakeup holds a periodic wakeup      */
+    utimepoint_t last_wakeup;             /* Timeline time of the last periodic wake  */
+    timeline_events_t events;             /* Event callbacks and counters             */
+    timeline_dl_t dl;                     /* SCHED_DEADLINE reservation               */
+    messenger_t messenger;                /* Messenger Object, built on first use     */
 } timeline_t;
 
+/* Stop dispatching the events of a timeline (see EVENT DISPATCH) */
+static void timeline_dispatch_release(timeline_t *timeline);
+
+// REAL-TIME PROFILE /////////////////////////////////////////////////////////////
+
+/* Stack touched by default when the profile is enabled */
+#define QOT_RT_STACK_PREFAULT (64 * 1024)
+/* Log ring slots (a power of two) and the longest message kept */
+#define QOT_RT_LOG_ENTRIES 256
+#define QOT_RT_LOG_LEN     160
+
+/* One log message; seq hands the slot between the producers and the drain */
+typedef struct qot_rt_log_slot {
+    uint64_t seq;                         /* Ring position this slot is ready for     */
+    uint32_t len;                         /* Message length without the terminator    */
+    char msg[QOT_RT_LOG_LEN];             /* Formatted message                        */
+} qot_rt_log_slot_t;
+
+/* Process-wide real-time profile state (static, so it is locked with the image) */
+typedef struct qot_rt_profile {
+    int enabled;                          /* Profile enabled                          */
+    int pool_used[QOT_RT_MAX_TIMELINES];  /* Pool slots handed out                    */
+    timeline_t pool[QOT_RT_MAX_TIMELINES];
+    uint64_t log_head;                    /* Next ring position claimed by a producer */
+    uint64_t log_tail;                    /* Next ring position read by the drain     */
+    uint64_t log_dropped;                 /* Messages lost to a full ring             */
+    qot_rt_log_slot_t log[QOT_RT_LOG_ENTRIES];
+} qot_rt_profile_t;
+
+static qot_rt_profile_t rt_profile;
+/* Serializes drains (never taken by the control loop) */
+static pthread_mutex_t rt_log_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int qot_rt_profile_enabled(void)
+{
+    return __atomic_load_n(&rt_profile.enabled, __ATOMIC_ACQUIRE);
+}
+
+/* Format a message into the next free ring slot, dropping it if the ring is full */
+static void qot_rt_log_push(const char *fmt, va_list ap)
+{
+    qot_rt_log_slot_t *slot;
+    uint64_t pos, seq;
+    int len;
+
+    pos = __atomic_load_n(&rt_profile.log_head, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        slot = &rt_profile.log[pos & (QOT_RT_LOG_ENTRIES - 1)];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos)
+        {
+            if (__atomic_compare_exchange_n(&rt_profile.log_head, &pos, pos + 1, 1,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if ((int64_t) (seq - pos) < 0)
+        {
+            __atomic_fetch_add(&rt_profile.log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            pos = __atomic_load_n(&rt_profile.log_head, __ATOMIC_RELAXED);
+        }
+    }
+    len = vsnprintf(slot->msg, QOT_RT_LOG_LEN, fmt, ap);
+    if (len < 0)
+        len = 0;
+    slot->len = (len < QOT_RT_LOG_LEN) ? len : QOT_RT_LOG_LEN - 1;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/* Library logging: stdio normally, the log ring under the real-time profile */
+static void qot_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void qot_log(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    if (qot_rt_profile_enabled())
+        qot_rt_log_push(fmt, ap);
+    else
+        vprintf(fmt, ap);
+    va_end(ap);
+}
+
+size_t qot_rt_log_drain(int fd)
+{
+    qot_rt_log_slot_t *slot;
+    uint64_t pos;
+    size_t count = 0;
+
+    pthread_mutex_lock(&rt_log_drain_lock);
+    for (;;)
+    {
+        pos = rt_profile.log_tail;
+        slot = &rt_profile.log[pos & (QOT_RT_LOG_ENTRIES - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+            break;
+        if (write(fd, slot->msg, slot->len) < 0 && errno != EAGAIN)
+            fd = -1; // Keep draining so that producers do not stall on a dead sink
+        __atomic_store_n(&slot->seq, pos + QOT_RT_LOG_ENTRIES, __ATOMIC_RELEASE);
+        rt_profile.log_tail = pos + 1;
+        count++;
+    }
+    pthread_mutex_unlock(&rt_log_drain_lock);
+    return count;
+}
+
+uint64_t qot_rt_log_dropped(void)
+{
+    return __atomic_load_n(&rt_profile.log_dropped, __ATOMIC_RELAXED);
+}
+
+/* Touch the stack of the calling thread so the control loop never faults on it */
+static void __attribute__((noinline)) qot_rt_prefault_stack(size_t size)
+{
+    volatile char *stack = (volatile char *) alloca(size);
+    size_t i;
+    for (i = 0; i < size; i += 4096)
+        stack[i] = 0;
+}
+
+qot_return_t qot_rt_profile_enable(const qot_rt_config_t *config)
+{
+    qot_rt_config_t defaults = { QOT_RT_STACK_PREFAULT, 0, 1 };
+    size_t stack;
+    char *heap;
+    int i;
+
+    if (!config)
+        config = &defaults;
+    stack = config->stack_prefault ? config->stack_prefault : QOT_RT_STACK_PREFAULT;
+
+    // Stacks of other control threads are prefaulted by enabling again from them
+    if (qot_rt_profile_enabled())
+    {
+        qot_rt_prefault_stack(stack);
+        return QOT_RETURN_TYPE_OK;
+    }
+
+    // Freed memory stays in the heap instead of going back to the kernel
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    if (config->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+    {
+        qot_log("mlockall failed %d\n", errno);
+        return QOT_RETURN_TYPE_ERR;
+    }
+    if (config->heap_reserve)
+    {
+        heap = (char *) malloc(config->heap_reserve);
+        if (!heap)
+            return QOT_RETURN_TYPE_ERR;
+        memset(heap, 0, config->heap_reserve);
+        free(heap);
+    }
+    qot_rt_prefault_stack(stack);
+
+    // Every slot is free for the first lap of the log ring
+    for (i = 0; i < QOT_RT_LOG_ENTRIES; i++)
+        rt_profile.log[i].seq = i;
+    __atomic_store_n(&rt_profile.enabled, 1, __ATOMIC_RELEASE);
+    return QOT_RETURN_TYPE_OK;
+}
+
+/* Handles are validated once at bind; a descriptor closed behind the API's
+   back makes the syscall which uses it fail instead */
+static inline int timeline_bound(timeline_t *timeline)
+{
+    return timeline && timeline->bound;
+}
+
 /* Is the given timeline a valid one */
 qot_return_t timeline_check_fd(timeline_t *timeline) {
     if (fcntl(timeline->fd, F_GETFD)==-1)
@@ -67,24 +310,123 @@ qot_return_t timeline_check_fd(timeline_t *timeline) {
     return QOT_RETURN_TYPE_OK;
 }
 
+// PROCESS CONTEXT ///////////////////////////////////////////////////////////////
+
+/* The QoT core keeps one event queue per /dev/qotusr connection. Control calls
+   of every timeline in the process share a single connection, and a timeline
+   opens one of its own only when it starts using events */
+typedef struct qot_context {
+    pthread_mutex_t lock;
+    int usr_fd;                           /* Shared /dev/qotusr descriptor            */
+    int refs;                             /* Bound timelines using the descriptor     */
+    int drain;                            /* The core cannot mute the connection      */
+} qot_context_t;
+
+static qot_context_t context = { PTHREAD_MUTEX_INITIALIZER, -1, 0, 0 };
+
+/* Take a reference on the shared connection, opening it with the first bind */
+static int qot_context_get(void)
+{
+    qot_event_t event;
+    int fd;
+
+    pthread_mutex_lock(&context.lock);
+    if (context.refs == 0)
+    {
+        if (DEBUG)
+            qot_log("Opening IOCTL to qot_core\n");
+        context.usr_fd = open("/dev/qotusr", O_RDWR | O_CLOEXEC);
+        if (DEBUG)
+            qot_log("IOCTL to qot_core opened %d\n", context.usr_fd);
+
+        // Nobody reads events on the shared connection, so stop the core from queueing them
+        context.drain = (context.usr_fd >= 0 && ioctl(context.usr_fd, QOTUSR_MUTE_EVENTS) < 0);
+    }
+    else if (context.drain)
+    {
+        // Cores without QOTUSR_MUTE_EVENTS keep queueing, drain them at every bind
+        while (ioctl(context.usr_fd, QOTUSR_GET_NEXT_EVENT, &event) == 0);
+    }
+    fd = context.usr_fd;
+    if (fd >= 0)
+        context.refs++;
+    pthread_mutex_unlock(&context.lock);
+    return fd;
+}
+
+/* Drop a reference, closing the shared connection with the last one */
+static void qot_context_put(void)
+{
+    pthread_mutex_lock(&context.lock);
+    if (context.refs > 0 && --context.refs == 0)
+    {
+        close(context.usr_fd);
+        context.usr_fd = -1;
+    }
+    pthread_mutex_unlock(&context.lock);
+}
+
+/* The connection on which the events of a timeline are queued, opened by the
+   first call that needs it (callbacks, pins, output compare or reads) */
+static int timeline_event_fd(timeline_t *timeline)
+{
+    int fd = __atomic_load_n(&timeline->event_fd, __ATOMIC_ACQUIRE);
+    if (fd >= 0)
+        return fd;
+    pthread_mutex_lock(&context.lock);
+    fd = timeline->event_fd;
+    if (fd < 0)
+    {
+        fd = open("/dev/qotusr", O_RDWR | O_CLOEXEC);
+        if (fd >= 0)
+            __atomic_store_n(&timeline->event_fd, fd, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&context.lock);
+    return fd;
+}
+
 /* Create a Timeline Data Structure */
 timeline_t *timeline_t_create()
 {
     timeline_t *timeline;
-    timeline = (timeline_t*) malloc(sizeof(struct timeline));
+    int i;
+
+    // Under the real-time profile structures come from the preallocated pool
+    if (qot_rt_profile_enabled())
+    {
+        for (i = 0; i < QOT_RT_MAX_TIMELINES; i++)
+        {
+            if (!__atomic_exchange_n(&rt_profile.pool_used[i], 1, __ATOMIC_ACQUIRE))
+            {
+                timeline = &rt_profile.pool[i];
+                memset(timeline, 0, sizeof(struct timeline));
+                timeline->event_fd = -1;
+                return timeline;
+            }
+        }
+        return NULL;
+    }
+    timeline = (timeline_t*) calloc(1, sizeof(struct timeline));
+    if (timeline)
+        timeline->event_fd = -1;
     return timeline;
 }
 
 /* Destroy a Timeline Data Structure */
 void timeline_t_destroy(timeline_t *timeline)
 {
+    if (timeline >= rt_profile.pool && timeline < rt_profile.pool + QOT_RT_MAX_TIMELINES)
+    {
+        __atomic_store_n(&rt_profile.pool_used[timeline - rt_profile.pool], 0, __ATOMIC_RELEASE);
+        return;
+    }
     free(timeline);
 }
 
 /* Bind to a timeline */
 qot_return_t timeline_bind(timeline_t *timeline, const char *uuid, const char *name, timelength_t res, timeinterval_t acc) 
 {
-    char qot_timeline_filename[15];
+    char qot_timeline_filename[32];
     int usr_file;
     char *gl_start;
 
@@ -102,24 +444,20 @@ qot_return_t timeline_bind(timeline_t *timeline, const char *uuid, const char *n
     else
         timeline->info.type = QOT_TIMELINE_LOCAL; // Default to Local
 
-    // Open the QoT Core
-    if (DEBUG) 
-        printf("Opening IOCTL to qot_core\n");
-    usr_file = open("/dev/qotusr", O_RDWR);
-    if (DEBUG)
-        printf("IOCTL to qot_core opened %d\n", usr_file);
-
+    // Use the QoT Core connection shared by the process
+    usr_file = qot_context_get();
     if (usr_file < 0)
     {
-        printf("Error: Invalid file\n");
+        qot_log("Error: Invalid file\n");
         return QOT_RETURN_TYPE_ERR;
     }
 
     timeline->qotusr_fd = usr_file;
+    timeline->event_fd = -1;
     
     // Bind to the timeline
     if (DEBUG) 
-        printf("Binding to timeline %s\n", uuid);
+        qot_log("Binding to timeline %s\n", uuid);
 
     strcpy(timeline->info.name, uuid);  
 
@@ -129,51 +467,60 @@ qot_return_t timeline_bind(timeline_t *timeline, const char *uuid, const char *n
         // If it exists try to get information
         if(ioctl(timeline->qotusr_fd, QOTUSR_GET_TIMELINE_INFO, &timeline->info) < 0)
         {
+            qot_context_put();
             return QOT_RETURN_TYPE_ERR;
         } 
     }
     // Construct the file handle to the posix clock /dev/timelineX
-    sprintf(qot_timeline_filename, "/dev/timeline%d", timeline->info.index);
+    snprintf(qot_timeline_filename, sizeof(qot_timeline_filename), "/dev/timeline%d", timeline->info.index);
 
     // Open the clock
     if (DEBUG) 
-        printf("Opening clock %s\n", qot_timeline_filename);
+        qot_log("Opening clock %s\n", qot_timeline_filename);
     timeline->fd = open(qot_timeline_filename, O_RDWR);
-    if (!timeline->fd)
+    if (timeline->fd < 0)
     {
-        printf("Cant open /dev/timeline%d\n", timeline->info.index);
+        qot_log("Cant open /dev/timeline%d\n", timeline->info.index);
+        qot_context_put();
         return QOT_RETURN_TYPE_ERR;
     }
   
     if (DEBUG) 
-        printf("Opened clock %s\n", qot_timeline_filename);
+        qot_log("Opened clock %s\n", qot_timeline_filename);
     // Populate Binding fields
     strcpy(timeline->binding.name, name);
     timeline->binding.demand.resolution = res;
     timeline->binding.demand.accuracy = acc;
     TL_FROM_SEC(timeline->binding.period, 0);
     TP_FROM_SEC(timeline->binding.start_offset, 0);
+    memset(&timeline->dl, 0, sizeof(timeline_dl_t));
+    memset(&timeline->events, 0, sizeof(timeline_events_t));
+    timeline->period_woken = 0;
     
     if (DEBUG) 
-        printf("Binding to timeline %s\n", uuid);
+        qot_log("Binding to timeline %s\n", uuid);
     // Bind to the timeline
     if(ioctl(timeline->fd, TIMELINE_BIND_JOIN, &timeline->binding) < 0)
     {
+        close(timeline->fd);
+        qot_context_put();
         return QOT_RETURN_TYPE_ERR;
     }
     if (DEBUG) 
-        printf("Bound to timeline %s\n", uuid);
+        qot_log("Bound to timeline %s\n", uuid);
 
-    // Initialize Messenger
-    timeline->messenger = create_messenger(timeline->binding.name, timeline->info.name);
+    // The messenger is created by the first messaging call
+    timeline->messenger = NULL;
 
+    // The handles are not re-validated by later calls
+    timeline->bound = 1;
     return QOT_RETURN_TYPE_OK;
 }
 
 /* Bind to a timeline after all core cluster nodes are up */
 qot_return_t timeline_cluster_bind(timeline_t *timeline, const char *uuid, const char *name, timelength_t res, timeinterval_t acc, const std::vector<std::string> Nodes) 
 {
-    char qot_timeline_filename[15];
+    char qot_timeline_filename[32];
     int usr_file;
     char *gl_start;
 
@@ -191,20 +538,16 @@ qot_return_t timeline_cluster_bind(timeline_t *timeline, const char *uuid, const
     else
         timeline->info.type = QOT_TIMELINE_LOCAL; // Default to Local
 
-    // Open the QoT Core
-    if (DEBUG) 
-        printf("Opening IOCTL to qot_core\n");
-    usr_file = open("/dev/qotusr", O_RDWR);
-    if (DEBUG)
-        printf("IOCTL to qot_core opened %d\n", usr_file);
-
+    // Use the QoT Core connection shared by the process
+    usr_file = qot_context_get();
     if (usr_file < 0)
     {
-        printf("Error: Invalid file\n");
+        qot_log("Error: Invalid file\n");
         return QOT_RETURN_TYPE_ERR;
     }
 
     timeline->qotusr_fd = usr_file;
+    timeline->event_fd = -1;
 
     strcpy(timeline->info.name, uuid);  
 
@@ -215,22 +558,26 @@ qot_return_t timeline_cluster_bind(timeline_t *timeline, const char *uuid, const
     if (define_cluster(timeline->messenger, Nodes, NULL))
     {
         delete_messenger(timeline->messenger);
+        timeline->messenger = NULL;
+        qot_context_put();
         return QOT_RETURN_TYPE_ERR;
     }
     
     // Wait for peer nodes to come online
     if (DEBUG) 
-        printf("Waiting for other nodes to join the timeline %s\n", uuid);
+        qot_log("Waiting for other nodes to join the timeline %s\n", uuid);
     
     if (wait_for_peers_to_join(timeline->messenger))
     {
         delete_messenger(timeline->messenger);
+        timeline->messenger = NULL;
+        qot_context_put();
         return QOT_RETURN_TYPE_ERR;   
     }
 
     // Bind to the timeline
     if (DEBUG) 
-        printf("Binding to timeline %s\n", uuid);
+        qot_log("Binding to timeline %s\n", uuid);
 
     // Try to create a new timeline if none exists
     if(ioctl(timeline->qotusr_fd, QOTUSR_CREATE_TIMELINE, &timeline->info) < 0)
@@ -238,107 +585,296 @@ qot_return_t timeline_cluster_bind(timeline_t *timeline, const char *uuid, const
         // If it exists try to get information
         if(ioctl(timeline->qotusr_fd, QOTUSR_GET_TIMELINE_INFO, &timeline->info) < 0)
         {
+            delete_messenger(timeline->messenger);
+            timeline->messenger = NULL;
+            qot_context_put();
             return QOT_RETURN_TYPE_ERR;
         } 
     }
     
     // Construct the file handle to the posix clock /dev/timelineX
-    sprintf(qot_timeline_filename, "/dev/timeline%d", timeline->info.index);
+    snprintf(qot_timeline_filename, sizeof(qot_timeline_filename), "/dev/timeline%d", timeline->info.index);
 
     // Open the clock
     if (DEBUG) 
-        printf("Opening clock %s\n", qot_timeline_filename);
+        qot_log("Opening clock %s\n", qot_timeline_filename);
     timeline->fd = open(qot_timeline_filename, O_RDWR);
-    if (!timeline->fd)
+    if (timeline->fd < 0)
     {
-        printf("Cant open /dev/timeline%d\n", timeline->info.index);
+        qot_log("Cant open /dev/timeline%d\n", timeline->info.index);
+        delete_messenger(timeline->messenger);
+        timeline->messenger = NULL;
+        qot_context_put();
         return QOT_RETURN_TYPE_ERR;
     }
   
     if (DEBUG) 
-        printf("Opened clock %s\n", qot_timeline_filename);
+        qot_log("Opened clock %s\n", qot_timeline_filename);
     // Populate Binding fields
     strcpy(timeline->binding.name, name);
     timeline->binding.demand.resolution = res;
     timeline->binding.demand.accuracy = acc;
     TL_FROM_SEC(timeline->binding.period, 0);
     TP_FROM_SEC(timeline->binding.start_offset, 0);
+    timeline->period_woken = 0;
     
     if (DEBUG) 
-        printf("Binding to timeline %s\n", uuid);
+        qot_log("Binding to timeline %s\n", uuid);
     // Bind to the timeline
     if(ioctl(timeline->fd, TIMELINE_BIND_JOIN, &timeline->binding) < 0)
     {
+        close(timeline->fd);
+        delete_messenger(timeline->messenger);
+        timeline->messenger = NULL;
+        qot_context_put();
         return QOT_RETURN_TYPE_ERR;
     }
     if (DEBUG) 
-        printf("Bound to timeline %s\n", uuid);
+        qot_log("Bound to timeline %s\n", uuid);
 
+    // The handles are not re-validated by later calls
+    timeline->bound = 1;
     return QOT_RETURN_TYPE_OK;
 }
 
 qot_return_t timeline_unbind(timeline_t *timeline) 
 {
-    if(!timeline)
+    qot_return_t retval = QOT_RETURN_TYPE_OK;
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
+    timeline->bound = 0;
 
-    // Unbind from the timeline
+    // Stop dispatching events before the descriptors are closed
+    timeline_dispatch_release(timeline);
+
+    // Unbind from the timeline (local resources are released regardless)
     if(ioctl(timeline->fd, TIMELINE_BIND_LEAVE, &timeline->binding) < 0)
-    {
-        return QOT_RETURN_TYPE_ERR;
-    }
+        retval = QOT_RETURN_TYPE_ERR;
 
     // Close the timeline file
     if (timeline->fd)
         close(timeline->fd);
 
     // Try to destroy the timeline if possible (will destroy if no other bindings exist)
-    if(ioctl(timeline->qotusr_fd, QOTUSR_DESTROY_TIMELINE, &timeline->info) == 0)
+    if(retval == QOT_RETURN_TYPE_OK && ioctl(timeline->qotusr_fd, QOTUSR_DESTROY_TIMELINE, &timeline->info) == 0)
     {
        if(DEBUG)
-          printf("Timeline %d destroyed\n", timeline->info.index);
+          qot_log("Timeline %d destroyed\n", timeline->info.index);
     }
     else
     {
        if(DEBUG)
-          printf("Timeline %d not destroyed\n", timeline->info.index);
+          qot_log("Timeline %d not destroyed\n", timeline->info.index);
     }
 
-    if (timeline->qotusr_fd)
-        close(timeline->qotusr_fd);
+    // Release the event connection and the shared one
+    if (timeline->event_fd >= 0)
+        close(timeline->event_fd);
+    timeline->event_fd = -1;
+    qot_context_put();
 
-    // Call Messenger Object Destructor 
-    delete_messenger(timeline->messenger);
-    return QOT_RETURN_TYPE_OK;
+    // Call Messenger Object Destructor, if messaging was ever used
+    if (timeline->messenger)
+        delete_messenger(timeline->messenger);
+    timeline->messenger = NULL;
+    return retval;
+}
+
+static pthread_mutex_t messenger_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Received messages are ordered and aged in the time of their timeline */
+static qot_return_t timeline_message_clock(void *timeline, utimepoint_t *now)
+{
+    return timeline_gettime((timeline_t *) timeline, now);
+}
+
+/* The messenger brings up a full set of DDS entities, so it is only built for
+   timelines which publish, subscribe or define a cluster */
+static messenger_t timeline_messenger(timeline_t *timeline)
+{
+    messenger_t messenger = __atomic_load_n(&timeline->messenger, __ATOMIC_ACQUIRE);
+    if (messenger || !timeline_bound(timeline))
+        return messenger;
+    pthread_mutex_lock(&messenger_lock);
+    messenger = timeline->messenger;
+    if (!messenger)
+    {
+        messenger = create_messenger(timeline->binding.name, timeline->info.name);
+        set_message_clock(messenger, timeline_message_clock, timeline);
+        __atomic_store_n(&timeline->messenger, messenger, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&messenger_lock);
+    return messenger;
 }
 
 qot_return_t timeline_publish_message(timeline_t *timeline, qot_message_t message) 
 {
-    publish_message(timeline->messenger, message);
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger)
+        return QOT_RETURN_TYPE_ERR;
+    publish_message(messenger, message);
     return QOT_RETURN_TYPE_OK;
 }
 
 qot_return_t timeline_subscribe_message(timeline_t *timeline, const std::set<qot_msg_type_t> &MsgTypes, qot_msg_callback_t callback)
 {
     qot_return_t retval;
-    retval = subscribe_message(timeline->messenger, MsgTypes, callback);
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger)
+        return QOT_RETURN_TYPE_ERR;
+    retval = subscribe_message(messenger, MsgTypes, callback);
     return retval;
 }
 
+qot_return_t timeline_publish_payload(timeline_t *timeline, const qot_message_t *message, const void *payload, size_t length)
+{
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger || !message)
+        return QOT_RETURN_TYPE_ERR;
+    return publish_payload(messenger, message, payload, length);
+}
+
+qot_return_t timeline_subscribe_payload(timeline_t *timeline, const std::set<qot_msg_type_t> &MsgTypes, qot_payload_callback_t callback)
+{
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger)
+        return QOT_RETURN_TYPE_ERR;
+    return subscribe_payload(messenger, MsgTypes, callback);
+}
+
+qot_return_t timeline_config_messaging(timeline_t *timeline, const qot_msg_config_t *config)
+{
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger || !config)
+        return QOT_RETURN_TYPE_ERR;
+    return configure_messaging(messenger, config);
+}
+
+qot_return_t timeline_flush_messages(timeline_t *timeline)
+{
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger)
+        return QOT_RETURN_TYPE_ERR;
+    return flush_messages(messenger);
+}
+
+size_t timeline_receive_messages(timeline_t *timeline, qot_message_t *msgs, size_t max, int timeout_ms)
+{
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger || !msgs)
+        return 0;
+    return receive_messages(messenger, msgs, max, timeout_ms);
+}
+
+qot_return_t timeline_get_message_stats(timeline_t *timeline, qot_msg_stats_t *stats)
+{
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger || !stats)
+        return QOT_RETURN_TYPE_ERR;
+    return get_message_stats(messenger, stats);
+}
+
+qot_return_t timeline_get_latency_stats(timeline_t *timeline, const char *topic, const char *peer,
+    qot_latency_stats_t *stats)
+{
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger || !stats)
+        return QOT_RETURN_TYPE_ERR;
+    return get_latency_stats(messenger, topic, peer, stats);
+}
+
+qot_return_t timeline_dump_latency_stats(timeline_t *timeline, const char *path)
+{
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger || !path)
+        return QOT_RETURN_TYPE_ERR;
+    return dump_latency_stats(messenger, path);
+}
+
 qot_return_t timeline_define_cluster(timeline_t *timeline, const std::vector<std::string> Nodes, qot_node_callback_t callback)
 {
     qot_return_t retval;
-    retval = define_cluster(timeline->messenger, Nodes, callback);
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger)
+        return QOT_RETURN_TYPE_ERR;
+    retval = define_cluster(messenger, Nodes, callback);
     return retval;
 }
 
 qot_return_t timeline_wait_for_peers(timeline_t *timeline)
 {
     qot_return_t retval;
-    retval = wait_for_peers_to_join(timeline->messenger);
+    messenger_t messenger = timeline_messenger(timeline);
+    if (!messenger)
+        return QOT_RETURN_TYPE_ERR;
+    retval = wait_for_peers_to_join(messenger);
     return retval; 
 }
 
+/* Safety margin of the next barrier round: twice what it takes to gather every
+   proposal, cover the worst peer uncertainty and absorb the last skew. It grows
+   at once (at least doubling after a late round) and shrinks by an eighth */
+static void timeline_barrier_adapt(qot_barrier_t *barrier)
+{
+    s64 floor = (s64) TL_TO_nSEC(barrier->margin_floor);
+    s64 margin = (s64) TL_TO_nSEC(barrier->margin);
+    s64 target = 2 * ((s64) TL_TO_nSEC(barrier->latency)
+        + (s64) TL_TO_nSEC(barrier->uncertainty) + (s64) TL_TO_nSEC(barrier->skew));
+
+    if (barrier->reported && barrier->slack_ns < 0 && target < 2 * margin)
+        target = 2 * margin;
+    if (target < margin)
+        target = margin - (margin - target) / 8;
+    if (target < floor)
+        target = floor;
+    TL_FROM_nSEC(barrier->margin, target);
+}
+
+qot_return_t timeline_barrier(timeline_t *timeline, qot_barrier_t *barrier)
+{
+    messenger_t messenger = timeline_messenger(timeline);
+    utimepoint_t now, ready, wake;
+    int64_t skew, slack, release, uncertainty;
+    s64 start;
+
+    if (!messenger || !barrier)
+        return QOT_RETURN_TYPE_ERR;
+
+    // The peers report their wake-ups after a release, so the previous round is complete now
+    if (barrier->round > 0)
+    {
+        barrier->reported = barrier_result(messenger, barrier->round - 1, &skew, &slack);
+        TL_FROM_nSEC(barrier->skew, barrier->reported ? skew : 0);
+        barrier->slack_ns = slack;
+    }
+    timeline_barrier_adapt(barrier);
+
+    // Propose now + margin, and wait for the proposal of every peer
+    if (timeline_gettime(timeline, &now))
+        return QOT_RETURN_TYPE_ERR;
+    start = (s64) TP_TO_nSEC(now.estimate);
+    if (barrier_propose(messenger, barrier->round, start + (s64) TL_TO_nSEC(barrier->margin),
+        (s64) (TL_TO_nSEC(now.interval.below) + TL_TO_nSEC(now.interval.above)),
+        barrier->timeout_ms, &release, &uncertainty))
+        return QOT_RETURN_TYPE_ERR;
+    if (timeline_gettime(timeline, &ready))
+        return QOT_RETURN_TYPE_ERR;
+    TL_FROM_nSEC(barrier->latency, (s64) TP_TO_nSEC(ready.estimate) - start);
+    TL_FROM_nSEC(barrier->uncertainty, uncertainty);
+
+    // Everyone sleeps until the same instant; a late node wakes at once
+    memset(&wake, 0, sizeof(wake));
+    TP_FROM_nSEC(wake.estimate, release);
+    barrier->release = wake.estimate;
+    if (timeline_waituntil(timeline, &wake))
+        return QOT_RETURN_TYPE_ERR;
+    barrier->wakeup = wake.estimate;
+    barrier_report(messenger, barrier->round, (s64) TP_TO_nSEC(wake.estimate),
+        release - (s64) TP_TO_nSEC(ready.estimate));
+    barrier->round++;
+    return QOT_RETURN_TYPE_OK;
+}
+
 qot_return_t timeline_get_accuracy(timeline_t *timeline, timeinterval_t *acc) 
 {
     if(!timeline)
@@ -373,10 +909,7 @@ qot_return_t timeline_get_uuid(timeline_t *timeline, char *uuid)
 
 qot_return_t timeline_set_accuracy(timeline_t *timeline, timeinterval_t *acc) 
 {
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
     
     timeline->binding.demand.accuracy = *acc;
@@ -391,9 +924,7 @@ qot_return_t timeline_set_accuracy(timeline_t *timeline, timeinterval_t *acc)
 
 qot_return_t timeline_set_resolution(timeline_t *timeline, timelength_t *res) 
 {
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     timeline->binding.demand.resolution = *res;
@@ -406,28 +937,151 @@ qot_return_t timeline_set_resolution(timeline_t *timeline, timelength_t *res)
     return QOT_RETURN_TYPE_OK;
 }
 
-qot_return_t timeline_set_schedparams(timeline_t *timeline, timelength_t *period, timepoint_t *start_offset) 
+/* Convert a timeline duration to core nanoseconds under a ppb discipline */
+static u64 timeline_dl_to_core(u64 tl_ns, int64_t mult)
 {
-    if(!timeline)
+    return (u64) floor((double) tl_ns * 1e9 / (1e9 + (double) mult));
+}
+
+/* Install the SCHED_DEADLINE reservation for the calling thread */
+static qot_return_t timeline_dl_apply(timeline_t *timeline, int64_t mult)
+{
+    struct qot_sched_attr attr;
+    u64 period_ns = TL_TO_nSEC(timeline->binding.period);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = timeline_dl_to_core(timeline->dl.runtime_ns, mult);
+    attr.sched_deadline = timeline_dl_to_core(timeline->dl.deadline_ns, mult);
+    attr.sched_period = timeline_dl_to_core(period_ns, mult);
+    if(syscall(SYS_sched_setattr, 0, &attr, 0) < 0)
+    {
+        if (DEBUG)
+            qot_log("sched_setattr failed %d\n", errno);
         return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    }
+    timeline->dl.mult = mult;
+    return QOT_RETURN_TYPE_OK;
+}
+
+/* Account for the job which completed at timeline time now */
+static void timeline_dl_complete(timeline_t *timeline, timepoint_t *now)
+{
+    timelength_t deadline;
+    timepoint_t abs_deadline, completion;
+    s64 now_ns, deadline_ns;
+    if(!timeline->dl.activated)
+        return;
+    TL_FROM_nSEC(deadline, timeline->dl.deadline_ns);
+    abs_deadline = timeline->dl.activation;
+    timepoint_add(&abs_deadline, &deadline);
+    if(timepoint_cmp(now, &abs_deadline) >= 0)
+        return;
+    completion = *now;
+    now_ns = TP_TO_nSEC(completion);
+    deadline_ns = TP_TO_nSEC(abs_deadline);
+    timeline->dl.stats.misses++;
+    if(now_ns - deadline_ns > timeline->dl.stats.max_lateness_ns)
+        timeline->dl.stats.max_lateness_ns = now_ns - deadline_ns;
+}
+
+/* Record a release and re-align the reservation if the discipline drifted */
+static void timeline_dl_release(timeline_t *timeline, timepoint_t *release)
+{
+    tl_translation_t params;
+    timeline->dl.activation = *release;
+    timeline->dl.activated = 1;
+    timeline->dl.stats.activations++;
+    if(++timeline->dl.periods < QOT_DL_REALIGN_PERIODS)
+        return;
+    timeline->dl.periods = 0;
+    if(ioctl(timeline->fd, TIMELINE_GET_PARAMETERS, &params) < 0)
+        return;
+    if(llabs(params.mult - timeline->dl.mult) < QOT_DL_REALIGN_PPB)
+        return;
+    if(timeline_dl_apply(timeline, params.mult) == QOT_RETURN_TYPE_OK)
+        timeline->dl.stats.realignments++;
+}
+
+qot_return_t timeline_set_schedparams(timeline_t *timeline, timelength_t *period, timepoint_t *start_offset) 
+{
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     timeline->binding.start_offset = *start_offset;
     timeline->binding.period = *period;
+    timeline->period_woken = 0;
     // Update the binding
     if(ioctl(timeline->fd, TIMELINE_BIND_UPDATE, &timeline->binding) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
+    // Keep an installed reservation in step with the new period
+    if(timeline->dl.enabled)
+    {
+        timeline->dl.activated = 0;
+        return timeline_dl_apply(timeline, timeline->dl.mult);
+    }
     return QOT_RETURN_TYPE_OK;
 }
 
-qot_return_t timeline_getcoretime(timeline_t *timeline, utimepoint_t *core_now)
+qot_return_t timeline_set_deadline_reservation(timeline_t *timeline, timelength_t *runtime,
+    timelength_t *deadline, int enable)
 {
-    if(!timeline)
+    struct qot_sched_attr attr;
+    tl_translation_t params;
+    u64 period_ns;
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+
+    if(!enable)
+    {
+        // Revert the calling thread to the default policy
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.sched_policy = SCHED_OTHER;
+        if(syscall(SYS_sched_setattr, 0, &attr, 0) < 0)
+            return QOT_RETURN_TYPE_ERR;
+        timeline->dl.enabled = 0;
+        return QOT_RETURN_TYPE_OK;
+    }
+
+    if(!runtime || !deadline)
+        return QOT_RETURN_TYPE_ERR;
+    // The reservation needs periodic scheduling parameters
+    period_ns = TL_TO_nSEC(timeline->binding.period);
+    if(period_ns == 0)
+        return QOT_RETURN_TYPE_ERR;
+    timeline->dl.runtime_ns = TL_TO_nSEC((*runtime));
+    timeline->dl.deadline_ns = TL_TO_nSEC((*deadline));
+    if(timeline->dl.runtime_ns == 0 || timeline->dl.runtime_ns > timeline->dl.deadline_ns
+        || timeline->dl.deadline_ns > period_ns)
+        return QOT_RETURN_TYPE_ERR;
+
+    // Scale the reservation by the current discipline
+    if(ioctl(timeline->fd, TIMELINE_GET_PARAMETERS, &params) < 0)
+        return QOT_RETURN_TYPE_ERR;
+    if(timeline_dl_apply(timeline, params.mult))
+        return QOT_RETURN_TYPE_ERR;
+    timeline->dl.enabled = 1;
+    timeline->dl.activated = 0;
+    timeline->dl.periods = 0;
+    memset(&timeline->dl.stats, 0, sizeof(qot_deadline_stats_t));
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t timeline_get_deadline_stats(timeline_t *timeline, qot_deadline_stats_t *stats)
+{
+    if(!timeline || !stats)
+        return QOT_RETURN_TYPE_ERR;
+    *stats = timeline->dl.stats;
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t timeline_getcoretime(timeline_t *timeline, utimepoint_t *core_now)
+{
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     // Get the core time
@@ -440,9 +1094,7 @@ qot_return_t timeline_getcoretime(timeline_t *timeline, utimepoint_t *core_now)
 
 qot_return_t timeline_gettime(timeline_t *timeline, utimepoint_t *est) 
 {    
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
     
     // Get the timeline time
@@ -454,12 +1106,64 @@ qot_return_t timeline_gettime(timeline_t *timeline, utimepoint_t *est)
     return QOT_RETURN_TYPE_OK;
 }
 
+qot_return_t timeline_now(timeline_t *timeline, timewindow_t *now)
+{
+    utimepoint_t est;
+    if(timeline_gettime(timeline, &est))
+        return QOT_RETURN_TYPE_ERR;
+    utimepoint_to_window(now, &est);
+    return QOT_RETURN_TYPE_OK;
+}
+
+int timeline_after(timeline_t *timeline, timepoint_t *tp)
+{
+    timewindow_t now;
+    if(timeline_now(timeline, &now))
+        return -1;
+    return timepoint_cmp(&now.earliest, tp) < 0;
+}
+
+int timeline_before(timeline_t *timeline, timepoint_t *tp)
+{
+    timewindow_t now;
+    if(timeline_now(timeline, &now))
+        return -1;
+    return timepoint_cmp(&now.latest, tp) > 0;
+}
+
+qot_return_t timeline_commit_wait(timeline_t *timeline, timepoint_t *tp, timewindow_t *now)
+{
+    utimepoint_t est, wake;
+    timewindow_t window;
+    timelength_t step;
+    TL_FROM_nSEC(step, 1);
+    for (;;)
+    {
+        if(timeline_gettime(timeline, &est))
+            return QOT_RETURN_TYPE_ERR;
+        utimepoint_to_window(&window, &est);
+        if(timepoint_cmp(&window.earliest, tp) < 0)
+            break;
+
+        // The lower bound passes tp once the estimate is 'below' beyond it.
+        // The bound keeps widening while the clock is not resynchronized, so
+        // wake at the first instant it could have passed and check again.
+        memset(&wake, 0, sizeof(wake));
+        wake.estimate = *tp;
+        timepoint_add(&wake.estimate, &est.interval.below);
+        timepoint_add(&wake.estimate, &step);
+        if(timeline_waituntil(timeline, &wake))
+            return QOT_RETURN_TYPE_ERR;
+    }
+    if(now)
+        *now = window;
+    return QOT_RETURN_TYPE_OK;
+}
+
 qot_return_t timeline_enable_output_compare(timeline_t *timeline,
     qot_perout_t *request) {
 
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
     if(request->duty_cycle >= 100)
         return QOT_RETURN_TYPE_ERR;
@@ -468,7 +1172,7 @@ qot_return_t timeline_enable_output_compare(timeline_t *timeline,
 
     request->timeline = timeline->info;
     // Blocking wait on remote timeline time
-    if(ioctl(timeline->qotusr_fd, QOTUSR_OUTPUT_COMPARE_ENABLE, request) < 0)
+    if(ioctl(timeline_event_fd(timeline), QOTUSR_OUTPUT_COMPARE_ENABLE, request) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
@@ -479,14 +1183,12 @@ qot_return_t timeline_enable_output_compare(timeline_t *timeline,
 qot_return_t timeline_disable_output_compare(timeline_t *timeline,
     qot_perout_t *request) {
 
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     request->timeline = timeline->info;
     // Blocking wait on remote timeline time
-    if(ioctl(timeline->qotusr_fd, QOTUSR_OUTPUT_COMPARE_DISABLE, request) < 0)
+    if(ioctl(timeline_event_fd(timeline), QOTUSR_OUTPUT_COMPARE_DISABLE, request) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
@@ -496,142 +1198,371 @@ qot_return_t timeline_disable_output_compare(timeline_t *timeline,
 
 qot_return_t timeline_config_pin_timestamp(timeline_t *timeline, qot_extts_t *request, int enable) 
 {
-    qot_clock_t core_clock;
-    char ptp_device[QOT_MAX_NAMELEN];           /* File Name              */
-    int fd;                                     /* device file descriptor */
-    int index = 1;                              /* Channel index, 'corresponding to the pin */
-    struct ptp_clock_caps caps;                 /* Clock capabilities */
-    struct ptp_pin_desc desc;                   /* Pin configuration */
-    struct ptp_extts_request extts_request;     /* External timestamp req */
-
-
-    if(!timeline)
+    if(!timeline_bound(timeline) || !request)
         return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
-        return QOT_RETURN_TYPE_ERR;
-    
-    // Get the presiding core clock
-    if(ioctl(timeline->qotusr_fd, QOTUSR_GET_CORE_CLOCK_INFO, &core_clock) < 0)
+
+    // Captures are projected onto this timeline by the QoT core
+    request->timeline = timeline->info;
+    if(ioctl(timeline_event_fd(timeline), (enable ? QOTUSR_INPUT_CAPTURE_ENABLE : QOTUSR_INPUT_CAPTURE_DISABLE), request) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
+    return QOT_RETURN_TYPE_OK;
+}
 
-    // Create the file name
-    sprintf(ptp_device, "/dev/ptp%d", core_clock.phc_id);
+qot_return_t timeline_read_pin_timestamps(timeline_t *timeline, qot_event_t *event) 
+{
+    struct pollfd fds;
+    if(!timeline_bound(timeline))
+        return QOT_RETURN_TYPE_ERR;
 
-    if(enable)
+    fds.fd = timeline_event_fd(timeline);
+    fds.events = POLLIN;
+    if(fds.fd < 0)
+        return QOT_RETURN_TYPE_ERR;
+
+    // Timestamps arrive on the event queue already projected onto the timeline.
+    // The queue is shared with the other event types, which are skipped
+    do
     {
-        /* Open the core clock ptp character device */
-        fd = open(ptp_device, O_RDWR);
-        if (fd < 0) {
-            printf("Failed to open ptp device %s\n", ptp_device);
+        if(poll(&fds, 1, -1) <= 0 || (fds.revents & (POLLERR | POLLHUP | POLLNVAL)))
             return QOT_RETURN_TYPE_ERR;
+        if(ioctl(fds.fd, QOTUSR_GET_NEXT_EVENT, event) < 0)
+            continue;
+    } while (event->type != QOT_EVENT_EXTERNAL_TIMESTAMP);
+    return QOT_RETURN_TYPE_OK;
+}
+
+int timeline_get_event_fd(timeline_t *timeline)
+{
+    if(!timeline_bound(timeline))
+        return -1;
+    return timeline_event_fd(timeline);
+}
+
+// EVENT DISPATCH ////////////////////////////////////////////////////////////////
+
+/* Most timelines with event callbacks in one process */
+#define QOT_DISPATCH_MAX_TIMELINES 64
+/* Most events drained from a timeline before they are delivered */
+#define QOT_DISPATCH_BATCH 64
+
+/* Process-wide event dispatcher (one thread, started on first use) */
+typedef struct qot_dispatcher {
+    pthread_mutex_t lock;                 /* Protects everything below and stats      */
+    pthread_cond_t idle;                  /* Signalled when callbacks return          */
+    pthread_t thread;                     /* Dispatcher thread                        */
+    int started;                          /* Thread has been created                  */
+    int wake_fd[2];                       /* Pipe to re-read the timeline list        */
+    timeline_t *busy;                     /* Timeline whose callbacks are running     */
+    timeline_t *timelines[QOT_DISPATCH_MAX_TIMELINES];
+    int count;                            /* Timelines with callbacks                 */
+} qot_dispatcher_t;
+
+static qot_dispatcher_t dispatcher = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, pthread_t(), 0, { -1, -1 }, NULL, { NULL }, 0
+};
+
+static int timeline_dispatch_find(timeline_t *timeline)
+{
+    int i;
+    for (i = 0; i < dispatcher.count; i++)
+        if (dispatcher.timelines[i] == timeline)
+            return i;
+    return -1;
+}
+
+static void timeline_dispatch_wake(void)
+{
+    char c = 0;
+    if (write(dispatcher.wake_fd[1], &c, 1) < 0 && DEBUG)
+        qot_log("Event dispatcher wakeup failed\n");
+}
+
+/* Deliver drained events grouped by type, outside the dispatcher lock */
+static void timeline_dispatch_deliver(qot_event_t *events, int num,
+    qot_callback_t *callbacks, qot_event_batch_callback_t *batch_callbacks)
+{
+    qot_event_t group[QOT_DISPATCH_BATCH];
+    int type, i, count;
+    for (type = 0; type < QOT_EVENT_NUM_TYPES; type++)
+    {
+        count = 0;
+        for (i = 0; i < num; i++)
+            if (events[i].type == type)
+                group[count++] = events[i];
+        if (!count)
+            continue;
+        if (batch_callbacks[type])
+            batch_callbacks[type](group, count);
+        else if (callbacks[type])
+            for (i = 0; i < count; i++)
+                callbacks[type](&group[i]);
+    }
+}
+
+/* Drain all pending events of a timeline (dispatcher lock held) */
+static void timeline_dispatch_drain(timeline_t *timeline)
+{
+    qot_event_t events[QOT_DISPATCH_BATCH];
+    qot_callback_t callbacks[QOT_EVENT_NUM_TYPES];
+    qot_event_batch_callback_t batch_callbacks[QOT_EVENT_NUM_TYPES];
+    uint32_t depth[QOT_EVENT_NUM_TYPES];
+    qot_event_type_stats_t *stats;
+    int num, i, type;
+
+    timeline->events.stats.wakeups++;
+    do {
+        // One ioctl per event, until the queue reports empty
+        for (num = 0; num < QOT_DISPATCH_BATCH; num++)
+            if (ioctl(timeline->event_fd, QOTUSR_GET_NEXT_EVENT, &events[num]) < 0)
+                break;
+        if (!num)
+            return;
+
+        memset(depth, 0, sizeof(depth));
+        for (i = 0; i < num; i++)
+        {
+            type = events[i].type;
+            if (type < 0 || type >= QOT_EVENT_NUM_TYPES
+                || (!timeline->events.callbacks[type] && !timeline->events.batch_callbacks[type]))
+                timeline->events.stats.unhandled++;
+            else
+                depth[type]++;
         }
-        printf("Opened ptp device %s with fd = %d\n", ptp_device, fd);
-        timeline->clock_fd = fd;
+        for (type = 0; type < QOT_EVENT_NUM_TYPES; type++)
+        {
+            if (!depth[type])
+                continue;
+            stats = &timeline->events.stats.types[type];
+            stats->events += depth[type];
+            stats->batches++;
+            stats->depth = depth[type];
+            if (depth[type] > stats->max_depth)
+                stats->max_depth = depth[type];
+        }
+        memcpy(callbacks, timeline->events.callbacks, sizeof(callbacks));
+        memcpy(batch_callbacks, timeline->events.batch_callbacks, sizeof(batch_callbacks));
+
+        dispatcher.busy = timeline;
+        pthread_mutex_unlock(&dispatcher.lock);
+        timeline_dispatch_deliver(events, num, callbacks, batch_callbacks);
+        pthread_mutex_lock(&dispatcher.lock);
+        dispatcher.busy = NULL;
+        pthread_cond_broadcast(&dispatcher.idle);
+
+        // A callback may have released (or even destroyed) the timeline
+        if (timeline_dispatch_find(timeline) < 0)
+            return;
+    } while (num == QOT_DISPATCH_BATCH);
+}
 
-        /* Pin to perform external time stamping */
-        index = request->pin_index;
+/* Stop the dispatcher thread, the next registration starts another (lock held) */
+static void timeline_dispatch_stop(void)
+{
+    close(dispatcher.wake_fd[0]);
+    close(dispatcher.wake_fd[1]);
+    dispatcher.wake_fd[0] = dispatcher.wake_fd[1] = -1;
+    dispatcher.started = 0;
+}
 
-        /* Check if clock supports external timestamps */
-        if (ioctl(fd, PTP_CLOCK_GETCAPS, &caps)) {
-            printf("cannot get capabilities of clock");
-            return QOT_RETURN_TYPE_ERR;
+static void *timeline_dispatch_thread(void *arg)
+{
+    struct pollfd fds[QOT_DISPATCH_MAX_TIMELINES + 1];
+    timeline_t *polled[QOT_DISPATCH_MAX_TIMELINES];
+    char drain[64];
+    int num, i;
+    (void) arg;
+
+    pthread_mutex_lock(&dispatcher.lock);
+    while (dispatcher.started)
+    {
+        fds[0].fd = dispatcher.wake_fd[0];
+        fds[0].events = POLLIN;
+        num = dispatcher.count;
+        for (i = 0; i < num; i++)
+        {
+            polled[i] = dispatcher.timelines[i];
+            fds[i + 1].fd = polled[i]->event_fd;
+            fds[i + 1].events = POLLIN;
         }
-        if(caps.n_ext_ts < 1)
+        pthread_mutex_unlock(&dispatcher.lock);
+
+        if (poll(fds, num + 1, -1) < 0)
         {
-            printf("clock cannot perform external timestamping\n");
-            return QOT_RETURN_TYPE_ERR;
+            pthread_mutex_lock(&dispatcher.lock);
+            if (errno == EINTR)
+                continue;
+            if (DEBUG)
+                qot_log("Event dispatcher cannot poll (%d), stopping\n", errno);
+            timeline_dispatch_stop();
+            break;
         }
+        if (fds[0].revents & POLLIN)
+            while (read(dispatcher.wake_fd[0], drain, sizeof(drain)) > 0);
 
-        /* Configure the pin to support external timestamps */
-        memset(&desc, 0, sizeof(desc));
-        desc.index = index;
-        desc.func = 1;                              /* '1' corresponds to external timestamp */
-        desc.chan = index;
-        if (ioctl(fd, PTP_PIN_SETFUNC, &desc)) {
-            printf("Set pin func failed for\n");
-            return QOT_RETURN_TYPE_ERR;
+        pthread_mutex_lock(&dispatcher.lock);
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            if (DEBUG)
+                qot_log("Event dispatcher lost its wakeup pipe, stopping\n");
+            timeline_dispatch_stop();
+            break;
         }
-        
-        /* Request timestamps from the pin */ 
-        memset(&extts_request, 0, sizeof(extts_request));
-        extts_request.index = index;
-        extts_request.flags = PTP_ENABLE_FEATURE;
-        if (ioctl(fd, PTP_EXTTS_REQUEST, &extts_request)) {
-            printf("Requesting timestamps failed for\n");
-            return QOT_RETURN_TYPE_ERR;
+        for (i = 0; i < num; i++)
+        {
+            int index = timeline_dispatch_find(polled[i]);
+            if (index < 0)
+                continue;
+            if (fds[i + 1].revents & POLLIN)
+                timeline_dispatch_drain(polled[i]);
+            else if (fds[i + 1].revents & (POLLERR | POLLHUP | POLLNVAL))
+            {
+                // A failed connection reports the same on every poll, stop polling it
+                if (DEBUG)
+                    qot_log("Event connection of timeline %s failed, no more callbacks\n",
+                        polled[i]->info.name);
+                dispatcher.timelines[index] = dispatcher.timelines[--dispatcher.count];
+                polled[i]->events.registered = 0;
+            }
         }
     }
-    else
+    pthread_mutex_unlock(&dispatcher.lock);
+    return NULL;
+}
+
+/* Add a timeline to the dispatcher, starting it if needed (lock held) */
+static qot_return_t timeline_dispatch_register(timeline_t *timeline)
+{
+    int i;
+    if (timeline_dispatch_find(timeline) >= 0)
+        return QOT_RETURN_TYPE_OK;
+    if (dispatcher.count >= QOT_DISPATCH_MAX_TIMELINES || timeline_event_fd(timeline) < 0)
+        return QOT_RETURN_TYPE_ERR;
+    if (!dispatcher.started)
     {
-        /* Disable the pin */
-        if (fcntl(timeline->clock_fd, F_GETFD)==-1)
+        if (pipe(dispatcher.wake_fd) < 0)
+            return QOT_RETURN_TYPE_ERR;
+        for (i = 0; i < 2; i++)
+        {
+            fcntl(dispatcher.wake_fd[i], F_SETFL, O_NONBLOCK);
+            fcntl(dispatcher.wake_fd[i], F_SETFD, FD_CLOEXEC);
+        }
+        dispatcher.started = 1;
+        if (pthread_create(&dispatcher.thread, NULL, timeline_dispatch_thread, NULL))
+        {
+            timeline_dispatch_stop();
             return QOT_RETURN_TYPE_ERR;
-        memset(&desc, 0, sizeof(desc));
-        desc.index = request->pin_index;
-        desc.func = 0;              // '0' corresponds to no function 
-        desc.chan = request->pin_index;
-        if (ioctl(timeline->clock_fd, PTP_PIN_SETFUNC, &desc)) {
-            perror("PTP_PIN_SETFUNC Disable");
         }
-        
-        /* Close the character device */
-        close(timeline->clock_fd);
+        pthread_detach(dispatcher.thread);
     }
+    dispatcher.timelines[dispatcher.count++] = timeline;
+    timeline->events.registered = 1;
+    timeline_dispatch_wake();
     return QOT_RETURN_TYPE_OK;
 }
 
-qot_return_t timeline_read_pin_timestamps(timeline_t *timeline, qot_event_t *event) 
+/* Remove a timeline and wait for its running callbacks (lock held) */
+static void timeline_dispatch_unregister(timeline_t *timeline)
 {
-    int cnt;
-    struct ptp_extts_event event_ptp;               /* PTP event */
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    int i = timeline_dispatch_find(timeline);
+    if (i < 0)
+        return;
+    dispatcher.timelines[i] = dispatcher.timelines[--dispatcher.count];
+    timeline->events.registered = 0;
+    timeline_dispatch_wake();
+    // A callback releasing its own timeline must not wait for itself
+    while (dispatcher.busy == timeline && !pthread_equal(pthread_self(), dispatcher.thread))
+        pthread_cond_wait(&dispatcher.idle, &dispatcher.lock);
+}
+
+static void timeline_dispatch_release(timeline_t *timeline)
+{
+    pthread_mutex_lock(&dispatcher.lock);
+    timeline_dispatch_unregister(timeline);
+    pthread_mutex_unlock(&dispatcher.lock);
+}
+
+/* Set or clear the callbacks of one (type >= 0) or all (type < 0) types */
+static qot_return_t timeline_config_callback(timeline_t *timeline, int type, uint8_t enable,
+    qot_callback_t callback, qot_event_batch_callback_t batch_callback)
+{
+    qot_return_t retval = QOT_RETURN_TYPE_OK;
+    int i, any = 0;
+    if(!timeline_bound(timeline) || type >= QOT_EVENT_NUM_TYPES)
         return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->clock_fd, F_GETFD)==-1)
+    if (enable && !callback && !batch_callback)
         return QOT_RETURN_TYPE_ERR;
 
-    cnt = read(timeline->clock_fd, &event_ptp, sizeof(event_ptp));
-    if (cnt != sizeof(event_ptp)) {
-        printf("Cannot read event");
-    }
-    event->type = QOT_EVENT_EXTERNAL_TIMESTAMP;
-    event->timestamp.estimate.sec  = event_ptp.t.sec;
-    event->timestamp.estimate.asec = event_ptp.t.nsec*nSEC_PER_SEC;
-    
-    // Convert the core time to remote time
-    if(ioctl(timeline->fd, TIMELINE_CORE_TO_REMOTE, &event->timestamp.estimate) < 0)
+    pthread_mutex_lock(&dispatcher.lock);
+    for (i = 0; i < QOT_EVENT_NUM_TYPES; i++)
     {
-        return QOT_RETURN_TYPE_ERR;
+        if (type >= 0 && i != type)
+            continue;
+        timeline->events.callbacks[i] = enable ? callback : NULL;
+        timeline->events.batch_callbacks[i] = enable ? batch_callback : NULL;
     }
-    return QOT_RETURN_TYPE_OK;
+    for (i = 0; i < QOT_EVENT_NUM_TYPES; i++)
+        if (timeline->events.callbacks[i] || timeline->events.batch_callbacks[i])
+            any = 1;
+    if (any)
+        retval = timeline_dispatch_register(timeline);
+    else
+        timeline_dispatch_unregister(timeline);
+    pthread_mutex_unlock(&dispatcher.lock);
+    return retval;
 }
 
 qot_return_t timeline_config_events(timeline_t *timeline, uint8_t enable,
-    qot_callback_t callback) {
-    return QOT_RETURN_TYPE_ERR;
+    qot_callback_t callback)
+{
+    return timeline_config_callback(timeline, -1, enable, callback, NULL);
+}
+
+qot_return_t timeline_config_event_type(timeline_t *timeline, qot_event_type_t type,
+    uint8_t enable, qot_callback_t callback)
+{
+    if ((int) type < 0)
+        return QOT_RETURN_TYPE_ERR;
+    return timeline_config_callback(timeline, type, enable, callback, NULL);
+}
+
+qot_return_t timeline_config_event_batch(timeline_t *timeline, qot_event_type_t type,
+    uint8_t enable, qot_event_batch_callback_t callback)
+{
+    if ((int) type < 0)
+        return QOT_RETURN_TYPE_ERR;
+    return timeline_config_callback(timeline, type, enable, NULL, callback);
+}
+
+qot_return_t timeline_get_event_stats(timeline_t *timeline, qot_event_stats_t *stats)
+{
+    if (!timeline || !stats)
+        return QOT_RETURN_TYPE_ERR;
+    pthread_mutex_lock(&dispatcher.lock);
+    *stats = timeline->events.stats;
+    pthread_mutex_unlock(&dispatcher.lock);
+    return QOT_RETURN_TYPE_OK;
 }
 
 qot_return_t timeline_read_events(timeline_t *timeline, qot_event_t *event)
 {
     struct pollfd fds;
 
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
-    fds.fd = timeline->qotusr_fd;
+    fds.fd = timeline_event_fd(timeline);
     fds.events = POLLIN;
+    if(fds.fd < 0)
+        return QOT_RETURN_TYPE_ERR;
 
     if(poll(&fds, 1, -1) <= 0)
         return QOT_RETURN_TYPE_ERR;
 
     if(fds.revents && POLLIN == POLLIN)
     {
-        if(ioctl(timeline->qotusr_fd, QOTUSR_GET_NEXT_EVENT, event) < 0)
+        if(ioctl(fds.fd, QOTUSR_GET_NEXT_EVENT, event) < 0)
         {
             return QOT_RETURN_TYPE_ERR;
         }
@@ -642,16 +1573,14 @@ qot_return_t timeline_read_events(timeline_t *timeline, qot_event_t *event)
 qot_return_t timeline_waituntil(timeline_t *timeline, utimepoint_t *utp) 
 {
     qot_sleeper_t sleeper;
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     sleeper.timeline = timeline->info;
     sleeper.wait_until_time = *utp;
 
     if(DEBUG)
-        printf("Task invoked wait until secs %lld %llu\n", utp->estimate.sec, utp->estimate.asec);
+        qot_log("Task invoked wait until secs %" PRId64 " %" PRIu64 "\n", utp->estimate.sec, utp->estimate.asec);
     
     // Blocking wait on remote timeline time
     if(ioctl(timeline->qotusr_fd, QOTUSR_WAIT_UNTIL, &sleeper) < 0)
@@ -670,17 +1599,27 @@ qot_return_t timeline_waituntil_nextperiod(timeline_t *timeline, utimepoint_t *u
     u64 elapsed_ns = 0;
     u64 period_ns = 0;
     u64 num_periods = 0;
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    int strict = 0;
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     sleeper.timeline = timeline->info;
+    // Under the real-time profile the previous periodic wakeup stands in for
+    // the current time, so a periodic loop makes one syscall per period (an
+    // overrun wakes immediately, and the next call realigns to the period)
+    if(qot_rt_profile_enabled() && timeline->period_woken && !timeline->dl.enabled)
+    {
+        sleeper.wait_until_time = timeline->last_wakeup;
+        strict = 1;
+    }
     // Get the timeline time
-    if(ioctl(timeline->fd, TIMELINE_GET_TIME_NOW, &sleeper.wait_until_time) < 0)
+    else if(ioctl(timeline->fd, TIMELINE_GET_TIME_NOW, &sleeper.wait_until_time) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
+    // The previous job of a deadline reservation completes here
+    if(timeline->dl.enabled)
+        timeline_dl_complete(timeline, &sleeper.wait_until_time.estimate);
     // Check Start Offset
     if(timepoint_cmp(&timeline->binding.start_offset, &sleeper.wait_until_time.estimate) < 0)
     {
@@ -688,12 +1627,12 @@ qot_return_t timeline_waituntil_nextperiod(timeline_t *timeline, utimepoint_t *u
     }
     else 
     {
-        // Calculate Next Wakeup Time
+        // Calculate Next Wakeup Time (strictly after a previous wakeup)
         timepoint_diff(&elapsed_time, &sleeper.wait_until_time.estimate, &timeline->binding.start_offset);
         elapsed_ns = TL_TO_nSEC(elapsed_time);
         period_ns = TL_TO_nSEC(timeline->binding.period);
         num_periods = (elapsed_ns/period_ns);
-        if(elapsed_ns % period_ns != 0)
+        if(strict || elapsed_ns % period_ns != 0)
             num_periods++;
         elapsed_ns = period_ns*num_periods;
         TL_FROM_nSEC(elapsed_time, elapsed_ns);
@@ -701,12 +1640,18 @@ qot_return_t timeline_waituntil_nextperiod(timeline_t *timeline, utimepoint_t *u
         timepoint_add(&wakeup_time, &elapsed_time);
         sleeper.wait_until_time.estimate = wakeup_time;
      }
+    wakeup_time = sleeper.wait_until_time.estimate;
 
     // Blocking wait on remote timeline time
     if(ioctl(timeline->qotusr_fd, QOTUSR_WAIT_UNTIL, &sleeper) < 0)
     {
         return QOT_RETURN_TYPE_ERR;
     }
+    // Waking on the timeline releases the next job, phase-aligned to the timeline
+    if(timeline->dl.enabled)
+        timeline_dl_release(timeline, &wakeup_time);
+    timeline->last_wakeup = sleeper.wait_until_time;
+    timeline->period_woken = 1;
     *utp = sleeper.wait_until_time;
     return QOT_RETURN_TYPE_OK;
 }
@@ -715,9 +1660,7 @@ qot_return_t timeline_sleep(timeline_t *timeline, utimelength_t *utl)
 {
     qot_sleeper_t sleeper;
 
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
 
     // Get the timeline time
@@ -743,15 +1686,13 @@ qot_return_t timeline_timer_create(timeline_t *timeline, qot_timer_t *timer, qot
 {
     struct sigaction act;
 
-    if(!timeline || !timer)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline) || !timer)
         return QOT_RETURN_TYPE_ERR;
 
     // Create a timer
     if(ioctl(timeline->fd, TIMELINE_CREATE_TIMER, timer) < 0)
     {
-        printf("Failed To Create Timer\n");
+        qot_log("Failed To Create Timer\n");
         return QOT_RETURN_TYPE_ERR;
     }
 
@@ -763,7 +1704,7 @@ qot_return_t timeline_timer_create(timeline_t *timeline, qot_timer_t *timer, qot
 
     if (sigaction(SIGALRM, &act, NULL) == -1)
     {
-        printf("sigaction failed !\n");
+        qot_log("sigaction failed !\n");
         return QOT_RETURN_TYPE_ERR;
     }
 
@@ -773,9 +1714,7 @@ qot_return_t timeline_timer_create(timeline_t *timeline, qot_timer_t *timer, qot
 
 qot_return_t timeline_timer_cancel(timeline_t *timeline, qot_timer_t *timer) 
 {
-    if(!timeline || !timer)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline) || !timer)
         return QOT_RETURN_TYPE_ERR;
 
     // Create a timer
@@ -789,9 +1728,7 @@ qot_return_t timeline_timer_cancel(timeline_t *timeline, qot_timer_t *timer)
 
 qot_return_t timeline_core2rem(timeline_t *timeline, timepoint_t *est) 
 {    
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
     
     // Get the timeline time
@@ -805,9 +1742,7 @@ qot_return_t timeline_core2rem(timeline_t *timeline, timepoint_t *est)
 
 qot_return_t timeline_rem2core(timeline_t *timeline, timepoint_t *est) 
 {    
-    if(!timeline)
-        return QOT_RETURN_TYPE_ERR;
-    if (fcntl(timeline->fd, F_GETFD)==-1)
+    if(!timeline_bound(timeline))
         return QOT_RETURN_TYPE_ERR;
     
     // Get the timeline time
@@ -817,4 +1752,288 @@ qot_return_t timeline_rem2core(timeline_t *timeline, timepoint_t *est)
     }
     
     return QOT_RETURN_TYPE_OK;
-}
\ No newline at end of file
+}
+
+// RAII TIMELINE HANDLE AND CHRONO CLOCK /////////////////////////////////////////
+
+using namespace qot;
+
+std::atomic<int> timeline_clock::source_fd(-1);
+constexpr bool timeline_clock::is_steady;
+
+Timeline::Timeline() : timeline(NULL), fd(-1), usr_fd(-1), clkid(0)
+{
+    memset(&sleeper, 0, sizeof(qot_sleeper_t));
+}
+
+Timeline::~Timeline()
+{
+    if (timeline)
+        Unbind();
+}
+
+Timeline::Timeline(Timeline &&other) noexcept
+    : timeline(other.timeline), fd(other.fd), usr_fd(other.usr_fd),
+      clkid(other.clkid), sleeper(other.sleeper), period(other.period),
+      start(other.start)
+{
+    other.timeline = NULL;
+    other.fd = -1;
+    other.usr_fd = -1;
+}
+
+Timeline &Timeline::operator=(Timeline &&other) noexcept
+{
+    if (this != &other) {
+        if (timeline)
+            Unbind();
+        timeline = other.timeline;
+        fd = other.fd;
+        usr_fd = other.usr_fd;
+        clkid = other.clkid;
+        sleeper = other.sleeper;
+        period = other.period;
+        start = other.start;
+        other.timeline = NULL;
+        other.fd = -1;
+        other.usr_fd = -1;
+    }
+    return *this;
+}
+
+qot_return_t Timeline::Bind(const std::string &uuid, const std::string &name,
+    const TimeLength &resolution, const TimeLength &below, const TimeLength &above)
+{
+    timeinterval_t acc;
+    timeline_t *tl;
+    if (timeline)
+        return QOT_RETURN_TYPE_ERR;
+    tl = timeline_t_create();
+    if (!tl)
+        return QOT_RETURN_TYPE_ERR;
+    acc.below = below;
+    acc.above = above;
+    if (timeline_bind(tl, uuid.c_str(), name.c_str(), resolution, acc) != QOT_RETURN_TYPE_OK)
+    {
+        timeline_t_destroy(tl);
+        return QOT_RETURN_TYPE_ERR;
+    }
+
+    // Validate the descriptors once, so the hot path never has to
+    if (fcntl(tl->fd, F_GETFD) == -1 || fcntl(tl->qotusr_fd, F_GETFD) == -1)
+    {
+        timeline_unbind(tl);
+        timeline_t_destroy(tl);
+        return QOT_RETURN_TYPE_ERR;
+    }
+    timeline = tl;
+    fd = tl->fd;
+    usr_fd = tl->qotusr_fd;
+    clkid = FD_TO_CLOCKID(fd);
+    sleeper.timeline = tl->info;
+    period = TimeLength();
+    start = TimePoint();
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t Timeline::SetSchedParams(const TimeLength &period, const TimePoint &start)
+{
+    timelength_t p = period;
+    timepoint_t s = start;
+    if (!timeline || timeline_set_schedparams(timeline, &p, &s) != QOT_RETURN_TYPE_OK)
+        return QOT_RETURN_TYPE_ERR;
+    this->period = period;
+    this->start = start;
+    return QOT_RETURN_TYPE_OK;
+}
+
+TimePoint Timeline::NextPeriod(const TimePoint &now) const
+{
+    u64 elapsed_ns, num_periods;
+    u64 period_ns = period.ToNsec();
+    if (now < start || !period_ns)
+        return start;
+    elapsed_ns = (now - start).ToNsec();
+    num_periods = elapsed_ns / period_ns;
+    if (elapsed_ns % period_ns != 0)
+        num_periods++;
+    return start + TimeLength::FromNsec(period_ns * num_periods);
+}
+
+qot_return_t Timeline::Unbind()
+{
+    qot_return_t retval;
+    int expected = fd;
+    if (!timeline)
+        return QOT_RETURN_TYPE_ERR;
+
+    // Stop timeline_clock from reading a descriptor about to be closed
+    timeline_clock::source_fd.compare_exchange_strong(expected, -1);
+
+    retval = timeline_unbind(timeline);
+    timeline_t_destroy(timeline);
+    timeline = NULL;
+    fd = -1;
+    usr_fd = -1;
+    return retval;
+}
+
+qot_return_t Timeline::Now(UTimePoint &now) const
+{
+    if (ioctl(fd, TIMELINE_GET_TIME_NOW, static_cast<utimepoint_t*>(&now)) < 0)
+        return QOT_RETURN_TYPE_ERR;
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t Timeline::Now(TimePoint &now) const
+{
+    struct timespec ts;
+    if (clock_gettime(clkid, &ts) < 0)
+        return QOT_RETURN_TYPE_ERR;
+    now = TimePoint(ts.tv_sec, (u64) ts.tv_nsec * nSEC_PER_SEC);
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t Timeline::CoreNow(UTimePoint &now) const
+{
+    if (ioctl(fd, TIMELINE_GET_CORE_TIME_NOW, static_cast<utimepoint_t*>(&now)) < 0)
+        return QOT_RETURN_TYPE_ERR;
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t Timeline::WaitUntil(UTimePoint &until) const
+{
+    qot_sleeper_t request = sleeper;
+    request.wait_until_time = until;
+    if (ioctl(usr_fd, QOTUSR_WAIT_UNTIL, &request) < 0)
+        return QOT_RETURN_TYPE_ERR;
+    until = UTimePoint(request.wait_until_time);
+    return QOT_RETURN_TYPE_OK;
+}
+
+timeline_clock::time_point timeline_clock::now() noexcept
+{
+    struct timespec ts;
+    int source = source_fd.load(std::memory_order_relaxed);
+    if (source < 0 || clock_gettime(FD_TO_CLOCKID(source), &ts) < 0)
+        return time_point();
+    return time_point(duration((rep) ts.tv_sec * (rep) nSEC_PER_SEC + ts.tv_nsec));
+}
+
+timeline_clock::time_point timeline_clock::now(uncertainty &u) noexcept
+{
+    utimepoint_t utp;
+    s64 estimate;
+    u64 below, above;
+    int source = source_fd.load(std::memory_order_relaxed);
+    if (source < 0 || ioctl(source, TIMELINE_GET_TIME_NOW, &utp) < 0)
+    {
+        u.below = u.above = duration::zero();
+        return time_point();
+    }
+    estimate = TP_TO_nSEC(utp.estimate);
+    below = TL_TO_nSEC(utp.interval.below);
+    above = TL_TO_nSEC(utp.interval.above);
+    u.below = duration((rep) below);
+    u.above = duration((rep) above);
+    return time_point(duration(estimate));
+}
+
+void timeline_clock::Use(const Timeline &timeline) noexcept
+{
+    source_fd.store(timeline.Bound() ? timeline.fd : -1);
+}
+
+// BATCH CONVERSIONS ///////////////////////////////////////////////////////////////
+
+/* Timestamps projected per pass, so that core times survive an in-place call */
+#define QOT_CONVERT_CHUNK 256
+
+qot_return_t timeline_get_parameters(timeline_t *timeline, tl_translation_t *params)
+{
+    if(!timeline_bound(timeline) || !params)
+        return QOT_RETURN_TYPE_ERR;
+
+    if(ioctl(timeline->fd, TIMELINE_GET_PARAMETERS, params) < 0)
+    {
+        return QOT_RETURN_TYPE_ERR;
+    }
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t timeline_core2rem_n(timeline_t *timeline, const s64 *core, s64 *tl,
+    s64 *upper, s64 *lower, size_t n)
+{
+    tl_translation_t params;
+    qot_uncertainty_table_t u_pow, l_pow;
+    s64 dt[QOT_CONVERT_CHUNK];
+    size_t i, j, m;
+
+    if(n && (!core || !tl))
+        return QOT_RETURN_TYPE_ERR;
+    if(timeline_get_parameters(timeline, &params))
+        return QOT_RETURN_TYPE_ERR;
+
+    // Same projection and bounds as TIMELINE_CORE_TO_REMOTE, on one snapshot
+    if(upper)
+        qot_uncertainty_build(&u_pow, params.u_pow);
+    if(lower)
+        qot_uncertainty_build(&l_pow, params.l_pow);
+    for (i = 0; i < n; i += m)
+    {
+        m = (n - i < QOT_CONVERT_CHUNK) ? n - i : QOT_CONVERT_CHUNK;
+        for (j = 0; j < m; j++)
+            dt[j] = core[i + j] - params.last;
+        timepoint_loc2rem_n(&params, core + i, tl + i, m);
+        if(upper)
+            for (j = 0; j < m; j++)
+                upper[i + j] = tl[i + j] + qot_uncertainty_bound(params.u_nsec, params.u_mult, &u_pow, dt[j]);
+        if(lower)
+            for (j = 0; j < m; j++)
+                lower[i + j] = tl[i + j] + qot_uncertainty_bound(params.l_nsec, params.l_mult, &l_pow, dt[j]);
+    }
+    return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t timeline_rem2core_n(timeline_t *timeline, const s64 *tl, s64 *core, size_t n)
+{
+    tl_translation_t params;
+    u64 diff;
+    u32 div;
+    size_t i;
+
+    if(n && (!tl || !core))
+        return QOT_RETURN_TYPE_ERR;
+    if(timeline_get_parameters(timeline, &params))
+        return QOT_RETURN_TYPE_ERR;
+
+    // Same arithmetic as TIMELINE_REMOTE_TO_CORE
+    div = (u32) (params.mult + 1000000000LL);
+    for (i = 0; i < n; i++)
+    {
+        diff = (u64) (tl[i] - params.nsec);
+        core[i] = params.last + (s64) ((diff / div) * nSEC_PER_SEC) + (s64) (diff % div);
+    }
+    return QOT_RETURN_TYPE_OK;
+}
+
+int timeline_read_events_n(timeline_t *timeline, qot_event_t *events, size_t max, int timeout_ms)
+{
+    struct pollfd fds;
+    size_t count = 0;
+
+    if(!timeline_bound(timeline) || (max && !events))
+        return -1;
+    if(!max)
+        return 0;
+
+    fds.fd = timeline_event_fd(timeline);
+    fds.events = POLLIN;
+    if(fds.fd < 0 || poll(&fds, 1, timeout_ms) < 0)
+        return -1;
+
+    // The queue does not block when it is empty, so drain until the ioctl fails
+    while (count < max && ioctl(fds.fd, QOTUSR_GET_NEXT_EVENT, &events[count]) == 0)
+        count++;
+    return (int) count;
+}
@@ -33,6 +33,8 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <atomic>
+#include <chrono>
 
 /* Include basic types, time math and ioctl interface */
 extern "C"
@@ -41,6 +43,9 @@ extern "C"
 	#include "../../qot_types.h"
 }
 
+/* Include the constexpr C++ time value types */
+#include "qot_time.hpp"
+
 /* Include Messenger Framework */ 
 #include "lib/messenger.hpp"
 
@@ -55,6 +60,73 @@ typedef void (*qot_callback_t)(const qot_event_t *evt);
 
 typedef void (*qot_timer_callback_t)(int sig, siginfo_t *si, void *ucontext);
 
+/* Deadline-miss accounting for a SCHED_DEADLINE reservation */
+typedef struct qot_deadline_stats {
+    uint64_t activations;                 /* Periods released so far                  */
+    uint64_t misses;                      /* Jobs which completed past their deadline */
+    int64_t max_lateness_ns;              /* Worst completion lateness (timeline ns)  */
+    uint64_t realignments;                /* Reservations re-issued after drift       */
+} qot_deadline_stats_t;
+
+/* Batched event callback: all events of one type drained in one wakeup */
+typedef void (*qot_event_batch_callback_t)(const qot_event_t *evts, size_t count);
+
+/* Event dispatch counters for one event type */
+typedef struct qot_event_type_stats {
+    uint64_t events;                      /* Events delivered to callbacks            */
+    uint64_t batches;                     /* Batches which contained this type        */
+    uint32_t depth;                       /* Events of this type in the latest batch  */
+    uint32_t max_depth;                   /* Most events of this type in one batch    */
+} qot_event_type_stats_t;
+
+/* Event dispatch counters of a timeline */
+typedef struct qot_event_stats {
+    qot_event_type_stats_t types[QOT_EVENT_NUM_TYPES];
+    uint64_t wakeups;                     /* Dispatcher wakeups for this timeline     */
+    uint64_t unhandled;                   /* Events drained with no callback for them */
+} qot_event_stats_t;
+
+/* Most timeline_t structures preallocated by the real-time profile */
+#define QOT_RT_MAX_TIMELINES 16
+
+/* Real-time profile options (zero fields select the defaults) */
+typedef struct qot_rt_config {
+    size_t stack_prefault;                /* Stack bytes touched in the calling thread */
+    size_t heap_reserve;                  /* Heap bytes touched and kept by malloc     */
+    int lock_memory;                      /* mlockall the current and future pages     */
+} qot_rt_config_t;
+
+/**
+ * @brief Enable the process-wide real-time profile. Afterwards timeline
+ *        structures come from a preallocated pool, hot calls issue at most
+ *        one syscall without re-validating the handle, and library logging
+ *        goes to a non-blocking ring instead of stdio. Call it once from the
+ *        control thread before binding and before the control loop starts.
+ * @param config Profile options, or NULL for the defaults
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t qot_rt_profile_enable(const qot_rt_config_t *config);
+
+/**
+ * @brief Check whether the real-time profile is enabled
+ * @return 1 if enabled, 0 otherwise
+ **/
+int qot_rt_profile_enabled(void);
+
+/**
+ * @brief Write the pending library log messages to a descriptor. Call it
+ *        from a thread outside the control loop.
+ * @param fd Descriptor to write the messages to
+ * @return Number of messages written
+ **/
+size_t qot_rt_log_drain(int fd);
+
+/**
+ * @brief Number of log messages dropped because the log ring was full
+ * @return The drop count since the profile was enabled
+ **/
+uint64_t qot_rt_log_dropped(void);
+
 /**
  * @brief Constructor for the timeline_t data structure
  * @return returns a pointer to the timeline_t data structure
@@ -68,7 +140,9 @@ timeline_t *timeline_t_create();
 void timeline_t_destroy(timeline_t *timeline);
 
 /**
- * @brief Bind to a timeline with a given resolution and accuracy
+ * @brief Bind to a timeline with a given resolution and accuracy. Timelines
+ *        bound in one process share a connection to the QoT core; events are
+ *        queued for a timeline from its first event call onwards
  * @param timeline Pointer to a timeline struct
  * @param uuid Name of the timeline
  * @param name Name of this binding
@@ -102,7 +176,8 @@ qot_return_t timeline_cluster_bind(timeline_t *timeline, const char *uuid,
 qot_return_t timeline_unbind(timeline_t *timeline);
 
 /**
- * @brief Send a Message
+ * @brief Send a Message. The first messaging call on a timeline creates its
+ *        messenger, so bindings which never message carry no DDS entities
  * @param timeline Pointer to a timeline struct
  * @param message QoT Message type
  * @return A status code indicating success (0) or other
@@ -117,6 +192,101 @@ qot_return_t timeline_publish_message(timeline_t *timeline, qot_message_t messag
  **/
 qot_return_t timeline_subscribe_message(timeline_t *timeline, const std::set<qot_msg_type_t> &MsgTypes, qot_msg_callback_t callback);
 
+/**
+ * @brief Send a Message with a payload of any size (up to the transport's
+ *        limit) instead of its fixed data field. Set QOT_TRANSPORT=shm to
+ *        exchange messages through shared memory between the processes of a
+ *        host, or QOT_TRANSPORT=udp for plain UDP multicast, instead of DDS
+ * @param timeline Pointer to a timeline struct
+ * @param message QoT Message type (name and data are ignored)
+ * @param payload Payload bytes
+ * @param length Payload length
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_publish_payload(timeline_t *timeline, const qot_message_t *message, const void *payload, size_t length);
+
+/**
+ * @brief Subscribe to Messages with their payloads. The callback replaces the
+ *        message callback and queue, and the payload is only valid during it
+ *        (it may point into a shared-memory ring)
+ * @param timeline Pointer to a timeline struct
+ * @param MsgTypes set of message types
+ * @param callback Called with each message and its payload
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_subscribe_payload(timeline_t *timeline, const std::set<qot_msg_type_t> &MsgTypes, qot_payload_callback_t callback);
+
+/**
+ * @brief Batch published messages and queue received ones. With a batch size
+ *        above one, messages are sent once a batch fills or once the oldest
+ *        has waited flush_us. With a queue depth, received messages are no
+ *        longer passed to the subscription callback on the transport thread,
+ *        but queued for timeline_receive_messages. With an order hold, received
+ *        messages are delivered in the timeline order they were published in:
+ *        each is held until the timeline has passed its publish stamp by the
+ *        sender and receiver uncertainty plus the observed latency (at most
+ *        order_hold_us), and messages published before one already delivered
+ *        are dropped. Messages from peers which do not stamp them are ordered
+ *        by their timestamp, unless it is still in the future. Messages which
+ *        were published more than deadline_ns ago are dropped, on arrival or
+ *        when released. Payload subscriptions are not ordered
+ * @param timeline Pointer to a timeline struct
+ * @param config Batching, ordering and queue options (zero fields select the defaults)
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_config_messaging(timeline_t *timeline, const qot_msg_config_t *config);
+
+/**
+ * @brief Write the messages of a partial batch now
+ * @param timeline Pointer to a timeline struct
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_flush_messages(timeline_t *timeline);
+
+/**
+ * @brief Take a batch of received messages from the receive queue
+ * @param timeline Pointer to a timeline struct
+ * @param msgs Array to fill with messages
+ * @param max Size of the array
+ * @param timeout_ms Longest wait for the first message (0 does not wait, -1 waits forever)
+ * @return Number of messages taken
+ **/
+size_t timeline_receive_messages(timeline_t *timeline, qot_message_t *msgs, size_t max, int timeout_ms);
+
+/**
+ * @brief Get the publishing and delivery counters of the timeline messages
+ * @param timeline Pointer to a timeline struct
+ * @param stats Returns the counters
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_get_message_stats(timeline_t *timeline, qot_msg_stats_t *stats);
+
+/**
+ * @brief Get the one-way latency of received messages, measured when the
+ *        messaging is configured with latency_stats. Publishers stamp each
+ *        message in timeline time when it is published and when it is handed
+ *        to the transport; the receiver compares those with its own time when
+ *        it delivers the message, so the uncertainty of both clocks is part
+ *        of every sample. Topics are message types ("coord_ready",
+ *        "coord_start", "coord_stop", "sensor_val" or "data")
+ * @param timeline Pointer to a timeline struct
+ * @param topic Topic to report, NULL for all of them
+ * @param peer Publishing node to report, NULL for all of them
+ * @param stats Returns the latency percentiles and uncertainty
+ * @return A status code indicating success (0) or other (nothing measured)
+ **/
+qot_return_t timeline_get_latency_stats(timeline_t *timeline, const char *topic, const char *peer,
+    qot_latency_stats_t *stats);
+
+/**
+ * @brief Write the latency histograms of every topic and peer to a file, each
+ *        as a summary line followed by its cumulative distribution
+ * @param timeline Pointer to a timeline struct
+ * @param path File to write
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_dump_latency_stats(timeline_t *timeline, const char *path);
+
 /**
  * @brief Define the cluster
  * @param timeline Pointer to a timeline struct
@@ -132,6 +302,19 @@ qot_return_t timeline_define_cluster(timeline_t *timeline, const std::vector<std
  **/
 qot_return_t timeline_wait_for_peers(timeline_t *timeline);
 
+/**
+ * @brief Timed barrier: release every node of the cluster at a common timeline
+ *        instant. Peers agree on the latest of their proposals (now + margin),
+ *        then each waits until it. The margin adapts between rounds to the time
+ *        taken to gather proposals, the worst peer uncertainty and the skew the
+ *        peers reported for the previous round
+ * @param timeline Pointer to a timeline struct (cluster defined and peers joined)
+ * @param barrier Barrier state, zeroed before the first round; set margin_floor
+ *        and timeout_ms, the results of the round are filled in
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_barrier(timeline_t *timeline, qot_barrier_t *barrier);
+
 /**
  * @brief Get the accuracy requirement associated with this binding
  * @param timeline Pointer to a timeline struct
@@ -190,6 +373,29 @@ qot_return_t timeline_set_resolution(timeline_t *timeline, timelength_t *res);
  **/
 qot_return_t timeline_set_schedparams(timeline_t *timeline, timelength_t *period, timepoint_t *start_offset); 
 
+/**
+ * @brief Map the periodic scheduling parameters of this binding to a SCHED_DEADLINE
+ *        reservation for the calling thread. Activations are released by
+ *        timeline_waituntil_nextperiod, so they stay phase-aligned with the timeline,
+ *        and the reservation is re-issued when the timeline discipline drifts.
+ *        Must be called after timeline_set_schedparams.
+ * @param timeline Pointer to a timeline struct
+ * @param runtime Execution budget per period (timeline time)
+ * @param deadline Relative deadline of each activation (timeline time, <= period)
+ * @param enable Non-zero to install the reservation, zero to revert to SCHED_OTHER
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_set_deadline_reservation(timeline_t *timeline, timelength_t *runtime,
+    timelength_t *deadline, int enable);
+
+/**
+ * @brief Get the deadline-miss accounting of the SCHED_DEADLINE reservation
+ * @param timeline Pointer to a timeline struct
+ * @param stats Returns the activation, miss and realignment counters
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_get_deadline_stats(timeline_t *timeline, qot_deadline_stats_t *stats);
+
 /**
  * @brief Query the time according to the core
  * @param timeline Pointer to a timeline struct
@@ -206,6 +412,43 @@ qot_return_t timeline_getcoretime(timeline_t *timeline, utimepoint_t *core_now);
  **/
 qot_return_t timeline_gettime(timeline_t *timeline, utimepoint_t *est);
 
+/**
+ * @brief Query the window in which the true timeline time lies
+ * @param timeline Pointer to a timeline struct
+ * @param now Earliest and latest possible time, from the live uncertainty bounds
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_now(timeline_t *timeline, timewindow_t *now);
+
+/**
+ * @brief Check whether a timeline time has definitely passed on every node
+ * @param timeline Pointer to a timeline struct
+ * @param tp Timeline time to check
+ * @return 1 if the earliest possible time now is after tp, 0 if not, -1 on error
+ **/
+int timeline_after(timeline_t *timeline, timepoint_t *tp);
+
+/**
+ * @brief Check whether a timeline time has definitely not arrived on any node
+ * @param timeline Pointer to a timeline struct
+ * @param tp Timeline time to check
+ * @return 1 if the latest possible time now is before tp, 0 if not, -1 on error
+ **/
+int timeline_before(timeline_t *timeline, timepoint_t *tp);
+
+/**
+ * @brief Block until a timeline time has definitely passed (commit wait)
+ * @param timeline Pointer to a timeline struct
+ * @param tp Timeline time that must be in the past when this returns
+ * @param now Returns the time window on wakeup (may be NULL)
+ * @return A status code indicating success (0) or other
+ *
+ * Waits only as long as the current uncertainty requires: the bounds are
+ * re-read after every wakeup, so a well-synchronized timeline returns as
+ * soon as its lower bound exceeds tp.
+ **/
+qot_return_t timeline_commit_wait(timeline_t *timeline, timepoint_t *tp, timewindow_t *now);
+
 /**
  * @brief Request an interrupt be generated on a given pin
  * @param timeline Pointer to a timeline struct
@@ -224,16 +467,18 @@ qot_return_t timeline_enable_output_compare(timeline_t *timeline, qot_perout_t *
 qot_return_t timeline_disable_output_compare(timeline_t *timeline, qot_perout_t *request);
 
 /**
- * @brief Request an interrupt be generated on a given pin
+ * @brief Request external timestamps (input capture) on a given pin
  * @param timeline Pointer to a timeline struct
- * @param request Pointer to timestamp configuration
- * @param callback A function to call on each edge event
+ * @param request Pointer to timestamp configuration (pin and edge)
+ * @param enable Enable (1) or disable (0) timestamping
  * @return A status code indicating success (0) or other
  **/
 qot_return_t timeline_config_pin_timestamp(timeline_t *timeline, qot_extts_t *request, int enable);
 
 /**
- * @brief Perform a blocking read to get timestamp events
+ * @brief Perform a blocking read to get timestamp events, already projected
+ *        onto the timeline with their uncertainty. Other events queued for
+ *        the timeline are consumed and skipped
  * @param timeline Pointer to a timeline struct
  * @param event Pointer to event structure
  * @return A status code indicating success (0) or other
@@ -241,14 +486,56 @@ qot_return_t timeline_config_pin_timestamp(timeline_t *timeline, qot_extts_t *re
 qot_return_t timeline_read_pin_timestamps(timeline_t *timeline, qot_event_t *event);
 
 /**
- * @brief Request to be informed of timeline events
+ * @brief Get the /dev/qotusr descriptor on which the events of a timeline are
+ *        queued, opening it on first use. It becomes readable when an event
+ *        is pending, so it can be watched by an event loop
+ * @param timeline Pointer to a timeline struct
+ * @return The descriptor, or -1 on failure
+ **/
+int timeline_get_event_fd(timeline_t *timeline);
+
+/**
+ * @brief Request to be informed of timeline events of every type. Events are
+ *        delivered by one dispatcher thread per process, which drains all the
+ *        pending events of a timeline on each wakeup
  * @param timeline Pointer to a timeline struct
  * @param enable Enable or disable callback for the events
- * @param callback The function that will be called
+ * @param callback The function that will be called for each event
  * @return A status code indicating success (0) or other
  **/
 qot_return_t timeline_config_events(timeline_t *timeline, uint8_t enable, qot_callback_t callback);
 
+/**
+ * @brief Request to be informed of timeline events of one type
+ * @param timeline Pointer to a timeline struct
+ * @param type Type of the events
+ * @param enable Enable or disable callback for the events
+ * @param callback The function that will be called for each event
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_config_event_type(timeline_t *timeline, qot_event_type_t type,
+    uint8_t enable, qot_callback_t callback);
+
+/**
+ * @brief Request batched delivery of timeline events of one type: the callback
+ *        receives every event of the type drained in one dispatcher wakeup
+ * @param timeline Pointer to a timeline struct
+ * @param type Type of the events
+ * @param enable Enable or disable callback for the events
+ * @param callback The function that will be called for each batch
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_config_event_batch(timeline_t *timeline, qot_event_type_t type,
+    uint8_t enable, qot_event_batch_callback_t callback);
+
+/**
+ * @brief Get the per-type event throughput and queue-depth counters
+ * @param timeline Pointer to a timeline struct
+ * @param stats Pointer to the counters to fill
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_get_event_stats(timeline_t *timeline, qot_event_stats_t *stats);
+
 /**
  * @brief Read events on a timeline
  * @param timeline Pointer to a timeline struct
@@ -314,7 +601,165 @@ qot_return_t timeline_core2rem(timeline_t *timeline, timepoint_t *est);
  * @param est timepoint to be converted
  * @return A status code indicating success (0) or other
  **/
-qot_return_t timeline_rem2core(timeline_t *timeline, timepoint_t *est); 
+qot_return_t timeline_rem2core(timeline_t *timeline, timepoint_t *est);
 
-#endif
+/**
+ * @brief Get the translation parameters (discipline and uncertainty model)
+ *        currently in force between core time and the timeline
+ * @param timeline Pointer to a timeline struct
+ * @param params Pointer to the parameters to fill
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_get_parameters(timeline_t *timeline, tl_translation_t *params);
 
+/**
+ * @brief Convert an array of core times to timeline times and their bounds.
+ *        The parameters are read once, so the whole batch is projected with
+ *        one consistent discipline and a single syscall.
+ * @param timeline Pointer to a timeline struct
+ * @param core Core times (ns)
+ * @param tl Timeline times (ns), may alias core
+ * @param upper Upper bounds on the timeline times (ns), or NULL
+ * @param lower Lower bounds on the timeline times (ns), or NULL
+ * @param n Number of elements
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_core2rem_n(timeline_t *timeline, const s64 *core, s64 *tl,
+    s64 *upper, s64 *lower, size_t n);
+
+/**
+ * @brief Convert an array of timeline times to core times with a single syscall
+ * @param timeline Pointer to a timeline struct
+ * @param tl Timeline times (ns)
+ * @param core Core times (ns), may alias tl
+ * @param n Number of elements
+ * @return A status code indicating success (0) or other
+ **/
+qot_return_t timeline_rem2core_n(timeline_t *timeline, const s64 *tl, s64 *core, size_t n);
+
+/**
+ * @brief Read all queued events of a timeline, up to a maximum, in one call.
+ *        Do not mix with event callbacks, which consume the same queue.
+ * @param timeline Pointer to a timeline struct
+ * @param events Array of events to fill
+ * @param max Size of the array
+ * @param timeout_ms Wait for the first event (-1 blocks, 0 does not wait)
+ * @return Number of events read, or -1 on error
+ **/
+int timeline_read_events_n(timeline_t *timeline, qot_event_t *events, size_t max, int timeout_ms);
+
+namespace qot
+{
+    // Owning handle to a timeline binding. Binding opens the timeline and
+    // qotusr file descriptors once; the handle closes them when it is
+    // destroyed (or unbound), and can be moved but not copied. The fds are
+    // validated at bind time, so the hot-path calls below issue exactly one
+    // ioctl/syscall each, unlike the timeline_* functions which re-check the
+    // descriptor with fcntl on every call.
+    class Timeline
+    {
+        public: Timeline();
+        public: ~Timeline();
+        public: Timeline(Timeline &&other) noexcept;
+        public: Timeline &operator=(Timeline &&other) noexcept;
+        public: Timeline(const Timeline &) = delete;
+        public: Timeline &operator=(const Timeline &) = delete;
+
+        // Bind to (creating if needed) a timeline, see timeline_bind
+        public: qot_return_t Bind(const std::string &uuid, const std::string &name,
+            const TimeLength &resolution, const TimeLength &below, const TimeLength &above);
+
+        // Leave the timeline and close its descriptors
+        public: qot_return_t Unbind();
+
+        // Whether the handle is bound
+        public: bool Bound() const { return timeline != NULL; }
+        public: explicit operator bool() const { return Bound(); }
+
+        // Timeline time with its uncertainty (one ioctl)
+        public: qot_return_t Now(UTimePoint &now) const;
+
+        // Timeline time estimate only (one clock_gettime on the timeline clock)
+        public: qot_return_t Now(TimePoint &now) const;
+
+        // Core time with its uncertainty (one ioctl)
+        public: qot_return_t CoreNow(UTimePoint &now) const;
+
+        // Block until a timeline time, returning the wake-up time (one ioctl)
+        public: qot_return_t WaitUntil(UTimePoint &until) const;
+
+        // Set the period and start offset of the binding, see
+        // timeline_set_schedparams (cached for NextPeriod)
+        public: qot_return_t SetSchedParams(const TimeLength &period, const TimePoint &start);
+
+        // The first period boundary at or after a timeline time, as used by
+        // timeline_waituntil_nextperiod (no syscall)
+        public: TimePoint NextPeriod(const TimePoint &now) const;
+
+        // POSIX clock id of the timeline (valid while bound)
+        public: clockid_t ClockId() const { return clkid; }
+
+        // Descriptors for event loops: the timeline clock and the /dev/qotusr
+        // connection of this binding's events (opened on first use), which
+        // becomes readable when an event is queued for it
+        public: int Fd() const { return fd; }
+        public: int QotusrFd() const { return timeline ? timeline_get_event_fd(timeline) : -1; }
+
+        // Underlying handle, for the remaining timeline_* functions
+        public: timeline_t *Get() const { return timeline; }
+
+        private: timeline_t *timeline;
+        private: int fd;              // Cached /dev/timelineX descriptor
+        private: int usr_fd;          // Cached /dev/qotusr descriptor
+        private: clockid_t clkid;     // Cached dynamic clock id of fd
+        private: qot_sleeper_t sleeper;
+        private: TimeLength period;   // Cached scheduling period
+        private: TimePoint start;     // Cached scheduling start offset
+        friend class timeline_clock;
+    };
+
+    // A std::chrono clock (TrivialClock) running on timeline time, so that
+    // std::this_thread::sleep_until, std::condition_variable::wait_until and
+    // chrono arithmetic work directly on a timeline. The clock reads the
+    // timeline selected with Use(); timelines may be disciplined and
+    // stepped, so the clock is not steady.
+    class timeline_clock
+    {
+        public: typedef std::chrono::nanoseconds duration;
+        public: typedef duration::rep rep;
+        public: typedef duration::period period;
+        public: typedef std::chrono::time_point<timeline_clock> time_point;
+        public: static constexpr bool is_steady = false;
+
+        // Uncertainty around a reading: the true time lies in
+        // [estimate - below, estimate + above]
+        public: struct uncertainty {
+            duration below;
+            duration above;
+        };
+
+        // Current timeline time (one clock_gettime); the epoch if no timeline
+        // has been selected or the read fails
+        public: static time_point now() noexcept;
+
+        // Current timeline time with its uncertainty (one ioctl)
+        public: static time_point now(uncertainty &u) noexcept;
+
+        // Select the timeline read by now() for the whole process (the
+        // selection is dropped when that timeline is unbound)
+        public: static void Use(const Timeline &timeline) noexcept;
+
+        // Conversions to and from the QoT value types
+        public: static TimePoint ToTimePoint(const time_point &tp) {
+            return TimePoint::FromNsec(tp.time_since_epoch().count());
+        }
+        public: static time_point FromTimePoint(const TimePoint &tp) {
+            return time_point(duration(tp.ToNsec()));
+        }
+
+        private: static std::atomic<int> source_fd;
+        friend class Timeline;
+    };
+}
+
+#endif
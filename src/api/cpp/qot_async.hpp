@@ -0,0 +1,496 @@
+/*
+ * @file qot_async.hpp
+ * @brief C++20 coroutine reactor for timeline waits, periods and events
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QOT_STACK_SRC_API_CPP_QOT_ASYNC_H
+#define QOT_STACK_SRC_API_CPP_QOT_ASYNC_H
+
+#if __cplusplus < 202002L
+    #error "qot_async.hpp requires C++20 coroutines (-std=c++20)"
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+    #include <errno.h>
+    #include <time.h>
+    #include <unistd.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <sys/ioctl.h>
+    #include <sys/timerfd.h>
+}
+
+#include "qot.hpp"
+
+/* A single reactor thread multiplexes every attached timeline through epoll:
+   the qotusr descriptor of each binding (events) and one timerfd, armed for
+   the earliest pending wait of any timeline. Waits are kept in a heap per
+   timeline ordered by timeline time; when the timer fires the reactor reads
+   each timeline once and hands every expired wait to a small worker pool in
+   (timeline time, arrival) order, so with one worker the wake-up order is
+   fully deterministic. Thousands of timed coroutines then cost one thread
+   for the reactor plus the pool, instead of one blocked thread each.
+
+       qot::Task job(qot::AsyncTimeline &tl, qot::TimePoint deadline) {
+           auto [ret, now] = co_await tl.until(deadline);
+           ...
+       }
+
+       qot::Reactor reactor(1);
+       qot::AsyncTimeline tl(reactor, timeline);
+       reactor.Spawn(job(tl, deadline));
+
+   Arguments are copied into the coroutine frame, whereas the captures of a
+   lambda coroutine live in the lambda object, so a temporary lambda must not
+   be spawned. AsyncTimelines must be destroyed before their Reactor. Tasks
+   still suspended when the Reactor is destroyed are destroyed without
+   resuming. */
+namespace qot
+{
+    // A fire-and-forget coroutine, started by Reactor::Spawn
+    class Task
+    {
+        public: struct promise_type
+        {
+            Task get_return_object() noexcept {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+
+        public: explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+        public: Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        public: Task(const Task &) = delete;
+        public: Task &operator=(const Task &) = delete;
+        public: ~Task() { if (handle) handle.destroy(); }
+
+        // Give up ownership of the (not yet started) coroutine
+        public: std::coroutine_handle<> Release() { return std::exchange(handle, nullptr); }
+
+        private: std::coroutine_handle<promise_type> handle;
+    };
+
+    class Reactor
+    {
+        // A coroutine waiting for a timeline time
+        private: struct Sleeper
+        {
+            TimePoint target;
+            uint64_t seq;
+            std::coroutine_handle<> handle;
+            qot_return_t *status;
+            UTimePoint *wake;
+        };
+        private: struct SleeperLater
+        {
+            bool operator()(const Sleeper &a, const Sleeper &b) const {
+                return b.target < a.target || (a.target == b.target && b.seq < a.seq);
+            }
+        };
+
+        // A coroutine waiting for a timeline event
+        private: struct EventWaiter
+        {
+            std::coroutine_handle<> handle;
+            qot_return_t *status;
+            qot_event_t *event;
+        };
+
+        // Per-timeline state
+        private: struct Source
+        {
+            Timeline *timeline;
+            std::priority_queue<Sleeper, std::vector<Sleeper>, SleeperLater> sleepers;
+            std::deque<EventWaiter> waiters;
+            std::deque<qot_event_t> events;   // Events nobody was waiting for
+            uint64_t dropped;                 // Events dropped from a full queue
+        };
+
+        // Undelivered events kept per timeline
+        private: static const size_t kMaxPendingEvents = 1024;
+
+        // Start the reactor thread and a pool of (at least one) workers
+        public: explicit Reactor(size_t workers = 1)
+            : epfd(epoll_create1(EPOLL_CLOEXEC)),
+              tfd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)),
+              efd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+              seq(0), armed(0), stopping(false)
+        {
+            Watch(tfd, &tfd);
+            Watch(efd, &efd);
+            loop = std::thread(&Reactor::Loop, this);
+            for (size_t i = 0; i < std::max<size_t>(workers, 1); i++)
+                pool.emplace_back(&Reactor::Work, this);
+        }
+
+        public: ~Reactor()
+        {
+            std::vector<std::coroutine_handle<>> pending;
+            uint64_t one = 1;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            if (write(efd, &one, sizeof(one)) < 0) {}
+            ready_cv.notify_all();
+            loop.join();
+            for (std::thread &t : pool)
+                t.join();
+
+            // Reclaim the frames of tasks which will never be resumed
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                pending.assign(ready.begin(), ready.end());
+                ready.clear();
+                for (Source *s : sources) {
+                    for (; !s->sleepers.empty(); s->sleepers.pop())
+                        pending.push_back(s->sleepers.top().handle);
+                    for (EventWaiter &w : s->waiters)
+                        pending.push_back(w.handle);
+                    s->waiters.clear();
+                }
+            }
+            for (std::coroutine_handle<> h : pending)
+                h.destroy();
+            close(epfd);
+            close(tfd);
+            close(efd);
+        }
+
+        public: Reactor(const Reactor &) = delete;
+        public: Reactor &operator=(const Reactor &) = delete;
+
+        // Queue a task to start on the worker pool
+        public: void Spawn(Task task)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            ready.push_back(task.Release());
+            ready_cv.notify_one();
+        }
+
+        private: static int64_t MonotonicNow()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (int64_t) ts.tv_sec * (int64_t) nSEC_PER_SEC + ts.tv_nsec;
+        }
+
+        // Core time until a timeline time. The timeline may run fast by its
+        // ppb drift, so aim slightly early (~122 ppm) and re-arm on wake-up
+        // rather than overshoot.
+        private: static int64_t Delay(const TimePoint &target, const TimePoint &now)
+        {
+            int64_t ns = (int64_t) (target - now).ToNsec();
+            ns -= ns >> 13;
+            return ns > 0 ? ns : 1;
+        }
+
+        private: void Watch(int fd, void *tag)
+        {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = tag;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        }
+
+        // Arm the timer for an absolute monotonic deadline (0 disarms)
+        private: void Arm(int64_t deadline)
+        {
+            struct itimerspec its = {};
+            armed = deadline;
+            its.it_value.tv_sec = deadline / (int64_t) nSEC_PER_SEC;
+            its.it_value.tv_nsec = deadline % (int64_t) nSEC_PER_SEC;
+            timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+        }
+
+        private: Source *Attach(Timeline *timeline)
+        {
+            Source *s = new Source();
+            s->timeline = timeline;
+            s->dropped = 0;
+            std::lock_guard<std::mutex> guard(lock);
+            sources.push_back(s);
+            Watch(timeline->QotusrFd(), s);
+            return s;
+        }
+
+        // Wake every wait on a timeline with an error and forget it
+        private: void Detach(Source *s)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            epoll_ctl(epfd, EPOLL_CTL_DEL, s->timeline->QotusrFd(), NULL);
+            for (; !s->sleepers.empty(); s->sleepers.pop()) {
+                *s->sleepers.top().status = QOT_RETURN_TYPE_ERR;
+                ready.push_back(s->sleepers.top().handle);
+            }
+            for (EventWaiter &w : s->waiters) {
+                *w.status = QOT_RETURN_TYPE_ERR;
+                ready.push_back(w.handle);
+            }
+            ready_cv.notify_all();
+            sources.erase(std::find(sources.begin(), sources.end(), s));
+            delete s;
+        }
+
+        // Suspend until a timeline time (or the next period boundary);
+        // returns false, without suspending, if it has already passed
+        private: bool Sleep(Source *s, bool period, TimePoint target,
+            std::coroutine_handle<> h, qot_return_t *status, UTimePoint *wake)
+        {
+            UTimePoint now;
+            int64_t deadline;
+            std::lock_guard<std::mutex> guard(lock);
+            if (s->timeline->Now(now) != QOT_RETURN_TYPE_OK) {
+                *status = QOT_RETURN_TYPE_ERR;
+                return false;
+            }
+            if (period)
+                target = s->timeline->NextPeriod(now.Estimate());
+            *status = QOT_RETURN_TYPE_OK;
+            if (target <= now.Estimate()) {
+                *wake = now;
+                return false;
+            }
+            s->sleepers.push(Sleeper{target, seq++, h, status, wake});
+            deadline = MonotonicNow() + Delay(target, now.Estimate());
+            if (!armed || deadline < armed)
+                Arm(deadline);
+            return true;
+        }
+
+        // Suspend until an event arrives, unless one is already queued
+        private: bool AwaitEvent(Source *s, std::coroutine_handle<> h,
+            qot_return_t *status, qot_event_t *event)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            *status = QOT_RETURN_TYPE_OK;
+            if (!s->events.empty()) {
+                *event = s->events.front();
+                s->events.pop_front();
+                return false;
+            }
+            s->waiters.push_back(EventWaiter{h, status, event});
+            return true;
+        }
+
+        // Release every expired wait in timeline-time order and re-arm
+        private: void Expire()
+        {
+            std::vector<Sleeper> due;
+            int64_t mono = MonotonicNow(), next = 0;
+            for (Source *s : sources) {
+                UTimePoint now;
+                if (s->sleepers.empty())
+                    continue;
+                if (s->timeline->Now(now) != QOT_RETURN_TYPE_OK) {
+                    for (; !s->sleepers.empty(); s->sleepers.pop()) {
+                        *s->sleepers.top().status = QOT_RETURN_TYPE_ERR;
+                        due.push_back(s->sleepers.top());
+                    }
+                    continue;
+                }
+                for (; !s->sleepers.empty() && s->sleepers.top().target <= now.Estimate();
+                    s->sleepers.pop()) {
+                    *s->sleepers.top().wake = now;
+                    due.push_back(s->sleepers.top());
+                }
+                if (!s->sleepers.empty()) {
+                    int64_t deadline = mono + Delay(s->sleepers.top().target, now.Estimate());
+                    if (!next || deadline < next)
+                        next = deadline;
+                }
+            }
+            std::sort(due.begin(), due.end(), [](const Sleeper &a, const Sleeper &b) {
+                return SleeperLater()(b, a);
+            });
+            for (Sleeper &sl : due)
+                ready.push_back(sl.handle);
+            if (!due.empty())
+                ready_cv.notify_all();
+            Arm(next);
+        }
+
+        // Deliver queued events to waiters in arrival order
+        private: void Drain(Source *s)
+        {
+            qot_event_t event;
+            while (ioctl(s->timeline->QotusrFd(), QOTUSR_GET_NEXT_EVENT, &event) == 0) {
+                if (!s->waiters.empty()) {
+                    EventWaiter w = s->waiters.front();
+                    s->waiters.pop_front();
+                    *w.event = event;
+                    ready.push_back(w.handle);
+                    ready_cv.notify_one();
+                    continue;
+                }
+                if (s->events.size() >= kMaxPendingEvents) {
+                    s->events.pop_front();
+                    s->dropped++;
+                }
+                s->events.push_back(event);
+            }
+        }
+
+        private: void Loop()
+        {
+            struct epoll_event evs[16];
+            for (;;) {
+                int n = epoll_wait(epfd, evs, 16, -1);
+                if (n < 0 && errno != EINTR)
+                    return;
+                std::lock_guard<std::mutex> guard(lock);
+                if (stopping)
+                    return;
+                for (int i = 0; i < n; i++) {
+                    uint64_t count;
+                    if (evs[i].data.ptr == &tfd) {
+                        if (read(tfd, &count, sizeof(count)) < 0) {}
+                        armed = 0;
+                        Expire();
+                    } else if (evs[i].data.ptr == &efd) {
+                        if (read(efd, &count, sizeof(count)) < 0) {}
+                    } else if (std::find(sources.begin(), sources.end(),
+                        evs[i].data.ptr) != sources.end()) {
+                        Drain((Source *) evs[i].data.ptr);
+                    }
+                }
+            }
+        }
+
+        private: void Work()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            for (;;) {
+                ready_cv.wait(guard, [this]() { return stopping || !ready.empty(); });
+                if (stopping)
+                    return;
+                std::coroutine_handle<> h = ready.front();
+                ready.pop_front();
+                guard.unlock();
+                h.resume();
+                guard.lock();
+            }
+        }
+
+        private: int epfd;
+        private: int tfd;
+        private: int efd;
+        private: uint64_t seq;                // Arrival order of waits
+        private: int64_t armed;               // Timer deadline (monotonic ns)
+        private: bool stopping;
+        private: std::mutex lock;
+        private: std::condition_variable ready_cv;
+        private: std::deque<std::coroutine_handle<>> ready;
+        private: std::vector<Source *> sources;
+        private: std::thread loop;
+        private: std::vector<std::thread> pool;
+
+        friend class AsyncTimeline;
+    };
+
+    // A timeline attached to a reactor, offering awaitable waits
+    class AsyncTimeline
+    {
+        // co_await until(...) / next_period() -> {status, wake-up time}
+        public: struct SleepAwaiter
+        {
+            Reactor *reactor;
+            Reactor::Source *source;
+            bool period;
+            TimePoint target;
+            qot_return_t status;
+            UTimePoint wake;
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> h) {
+                return reactor->Sleep(source, period, target, h, &status, &wake);
+            }
+            std::pair<qot_return_t, UTimePoint> await_resume() const {
+                return std::make_pair(status, wake);
+            }
+        };
+
+        // co_await next_event() -> {status, event}
+        public: struct EventAwaiter
+        {
+            Reactor *reactor;
+            Reactor::Source *source;
+            qot_return_t status;
+            qot_event_t event;
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> h) {
+                return reactor->AwaitEvent(source, h, &status, &event);
+            }
+            std::pair<qot_return_t, qot_event_t> await_resume() const {
+                return std::make_pair(status, event);
+            }
+        };
+
+        public: AsyncTimeline(Reactor &reactor, Timeline &timeline)
+            : reactor(reactor), source(reactor.Attach(&timeline)) {}
+        public: ~AsyncTimeline() { reactor.Detach(source); }
+        public: AsyncTimeline(const AsyncTimeline &) = delete;
+        public: AsyncTimeline &operator=(const AsyncTimeline &) = delete;
+
+        // Resume once the timeline reaches a time
+        public: SleepAwaiter until(const TimePoint &tp) {
+            return SleepAwaiter{&reactor, source, false, tp, QOT_RETURN_TYPE_OK, UTimePoint()};
+        }
+        public: SleepAwaiter until(const UTimePoint &tp) { return until(tp.Estimate()); }
+
+        // Resume at the next period boundary (see Timeline::SetSchedParams)
+        public: SleepAwaiter next_period() {
+            return SleepAwaiter{&reactor, source, true, TimePoint(), QOT_RETURN_TYPE_OK, UTimePoint()};
+        }
+
+        // Resume with the next event queued for this binding
+        public: EventAwaiter next_event() {
+            return EventAwaiter{&reactor, source, QOT_RETURN_TYPE_OK, qot_event_t()};
+        }
+
+        private: Reactor &reactor;
+        private: Reactor::Source *source;
+    };
+}
+
+#endif
@@ -0,0 +1,330 @@
+/*
+ * @file qot_time.hpp
+ * @brief Zero-overhead C++ value types for QoT time lengths and points
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QOT_STACK_SRC_API_CPP_QOT_TIME_H
+#define QOT_STACK_SRC_API_CPP_QOT_TIME_H
+
+#include <cstddef>
+#include <type_traits>
+
+/* Include basic types and time math */
+extern "C"
+{
+    #include "../../qot_types.h"
+}
+
+/* Value types layered directly on the C structs in qot_types.h. They add no
+   members, so a TimePoint is a timepoint_t and can be handed to (or read
+   from) the C API and ioctls without copying. Every constructor keeps the
+   attosecond field normalized (asec < 1s), which lets the operators carry
+   with a single comparison; all of them are constexpr, so constant
+   schedules and guard times are folded by the compiler. */
+namespace qot
+{
+    // Attoseconds per unit, for a unit with 'per_sec' ticks per second
+    constexpr u64 AsecPerUnit(u64 per_sec) { return aSEC_PER_SEC / per_sec; }
+
+    // An unsigned length of time
+    class TimeLength : public timelength_t
+    {
+        // Construct from an already normalized pair
+        private: struct Normalized {};
+        private: constexpr TimeLength(u64 sec, u64 asec, Normalized)
+            : timelength_t{sec, asec} {}
+
+        public: constexpr TimeLength() : timelength_t{0, 0} {}
+        public: constexpr TimeLength(u64 sec, u64 asec)
+            : timelength_t{sec + asec / aSEC_PER_SEC, asec % aSEC_PER_SEC} {}
+        public: constexpr TimeLength(const timelength_t &tl)
+            : TimeLength(tl.sec, tl.asec) {}
+
+        // From a scalar count of units, as scalar_to_timelength
+        public: static constexpr TimeLength FromUnits(u64 v, u64 per_sec) {
+            return TimeLength(v / per_sec, (v % per_sec) * AsecPerUnit(per_sec),
+                Normalized());
+        }
+        public: static constexpr TimeLength FromSec(u64 v)  { return FromUnits(v,  SEC_PER_SEC); }
+        public: static constexpr TimeLength FromMsec(u64 v) { return FromUnits(v, mSEC_PER_SEC); }
+        public: static constexpr TimeLength FromUsec(u64 v) { return FromUnits(v, uSEC_PER_SEC); }
+        public: static constexpr TimeLength FromNsec(u64 v) { return FromUnits(v, nSEC_PER_SEC); }
+        public: static constexpr TimeLength FromPsec(u64 v) { return FromUnits(v, pSEC_PER_SEC); }
+        public: static constexpr TimeLength FromFsec(u64 v) { return FromUnits(v, fSEC_PER_SEC); }
+        public: static constexpr TimeLength FromAsec(u64 v) { return FromUnits(v, aSEC_PER_SEC); }
+
+        // To a scalar count of units (truncating), as TL_TO_GEN
+        public: constexpr u64 ToUnits(u64 per_sec) const {
+            return sec * per_sec + asec / AsecPerUnit(per_sec);
+        }
+        public: constexpr u64 ToSec()  const { return ToUnits( SEC_PER_SEC); }
+        public: constexpr u64 ToMsec() const { return ToUnits(mSEC_PER_SEC); }
+        public: constexpr u64 ToUsec() const { return ToUnits(uSEC_PER_SEC); }
+        public: constexpr u64 ToNsec() const { return ToUnits(nSEC_PER_SEC); }
+        public: constexpr u64 ToPsec() const { return ToUnits(pSEC_PER_SEC); }
+        public: constexpr u64 ToFsec() const { return ToUnits(fSEC_PER_SEC); }
+        public: constexpr u64 ToAsec() const { return ToUnits(aSEC_PER_SEC); }
+
+        // Arithmetic (subtraction requires a length no longer than this one)
+        public: constexpr TimeLength operator+(const TimeLength &v) const {
+            return Carry(sec + v.sec, asec + v.asec);
+        }
+        public: constexpr TimeLength operator-(const TimeLength &v) const {
+            return asec < v.asec
+                ? TimeLength(sec - v.sec - 1, aSEC_PER_SEC - (v.asec - asec), Normalized())
+                : TimeLength(sec - v.sec, asec - v.asec, Normalized());
+        }
+        public: constexpr TimeLength operator*(u32 k) const {
+            return Scale(sec * k, (asec / nSEC_PER_SEC) * k,
+                (asec % nSEC_PER_SEC) * k);
+        }
+        public: TimeLength &operator+=(const TimeLength &v) { return *this = *this + v; }
+        public: TimeLength &operator-=(const TimeLength &v) { return *this = *this - v; }
+
+        // A sum of two normalized fields carries at most one second
+        private: static constexpr TimeLength Carry(u64 sec, u64 asec) {
+            return asec >= aSEC_PER_SEC
+                ? TimeLength(sec + 1, asec - aSEC_PER_SEC, Normalized())
+                : TimeLength(sec, asec, Normalized());
+        }
+
+        // Scale the nanosecond and sub-nanosecond parts separately so that
+        // neither overflows for any 32-bit factor
+        private: static constexpr TimeLength Scale(u64 sec, u64 ns, u64 frac) {
+            return Rescale(sec, ns + frac / nSEC_PER_SEC, frac % nSEC_PER_SEC);
+        }
+        private: static constexpr TimeLength Rescale(u64 sec, u64 ns, u64 frac) {
+            return TimeLength(sec + ns / nSEC_PER_SEC,
+                (ns % nSEC_PER_SEC) * nSEC_PER_SEC + frac, Normalized());
+        }
+
+        friend class TimePoint;
+    };
+
+    constexpr bool operator==(const TimeLength &a, const TimeLength &b) {
+        return a.sec == b.sec && a.asec == b.asec;
+    }
+    constexpr bool operator!=(const TimeLength &a, const TimeLength &b) { return !(a == b); }
+    constexpr bool operator<(const TimeLength &a, const TimeLength &b) {
+        return a.sec < b.sec || (a.sec == b.sec && a.asec < b.asec);
+    }
+    constexpr bool operator>(const TimeLength &a, const TimeLength &b)  { return b < a; }
+    constexpr bool operator<=(const TimeLength &a, const TimeLength &b) { return !(b < a); }
+    constexpr bool operator>=(const TimeLength &a, const TimeLength &b) { return !(a < b); }
+    constexpr TimeLength operator*(u32 k, const TimeLength &v) { return v * k; }
+
+    // A signed point in time (T = sec + asec, with asec always positive)
+    class TimePoint : public timepoint_t
+    {
+        private: struct Normalized {};
+        private: constexpr TimePoint(s64 sec, u64 asec, Normalized)
+            : timepoint_t{sec, asec} {}
+
+        public: constexpr TimePoint() : timepoint_t{0, 0} {}
+        public: constexpr TimePoint(s64 sec, u64 asec)
+            : timepoint_t{sec + (s64) (asec / aSEC_PER_SEC), asec % aSEC_PER_SEC} {}
+        public: constexpr TimePoint(const timepoint_t &tp)
+            : TimePoint(tp.sec, tp.asec) {}
+
+        // From a signed scalar count of units, as scalar_to_timepoint
+        public: static constexpr TimePoint FromUnits(s64 v, u64 per_sec) {
+            return v >= 0
+                ? TimePoint((s64) ((u64) v / per_sec),
+                    ((u64) v % per_sec) * AsecPerUnit(per_sec), Normalized())
+                : Negative(0 - (u64) v, per_sec);
+        }
+        public: static constexpr TimePoint FromSec(s64 v)  { return FromUnits(v,  SEC_PER_SEC); }
+        public: static constexpr TimePoint FromMsec(s64 v) { return FromUnits(v, mSEC_PER_SEC); }
+        public: static constexpr TimePoint FromUsec(s64 v) { return FromUnits(v, uSEC_PER_SEC); }
+        public: static constexpr TimePoint FromNsec(s64 v) { return FromUnits(v, nSEC_PER_SEC); }
+        public: static constexpr TimePoint FromPsec(s64 v) { return FromUnits(v, pSEC_PER_SEC); }
+        public: static constexpr TimePoint FromFsec(s64 v) { return FromUnits(v, fSEC_PER_SEC); }
+        public: static constexpr TimePoint FromAsec(s64 v) { return FromUnits(v, aSEC_PER_SEC); }
+
+        // To a signed scalar count of units (rounding down), as TP_TO_GEN
+        public: constexpr s64 ToUnits(u64 per_sec) const {
+            return (s64) ((u64) sec * per_sec + asec / AsecPerUnit(per_sec));
+        }
+        public: constexpr s64 ToSec()  const { return ToUnits( SEC_PER_SEC); }
+        public: constexpr s64 ToMsec() const { return ToUnits(mSEC_PER_SEC); }
+        public: constexpr s64 ToUsec() const { return ToUnits(uSEC_PER_SEC); }
+        public: constexpr s64 ToNsec() const { return ToUnits(nSEC_PER_SEC); }
+        public: constexpr s64 ToPsec() const { return ToUnits(pSEC_PER_SEC); }
+        public: constexpr s64 ToFsec() const { return ToUnits(fSEC_PER_SEC); }
+        public: constexpr s64 ToAsec() const { return ToUnits(aSEC_PER_SEC); }
+
+        // Shift by a length of time
+        public: constexpr TimePoint operator+(const TimeLength &v) const {
+            return asec + v.asec >= aSEC_PER_SEC
+                ? TimePoint(sec + (s64) v.sec + 1, asec + v.asec - aSEC_PER_SEC, Normalized())
+                : TimePoint(sec + (s64) v.sec, asec + v.asec, Normalized());
+        }
+        public: constexpr TimePoint operator-(const TimeLength &v) const {
+            return asec < v.asec
+                ? TimePoint(sec - (s64) v.sec - 1, aSEC_PER_SEC - (v.asec - asec), Normalized())
+                : TimePoint(sec - (s64) v.sec, asec - v.asec, Normalized());
+        }
+        public: TimePoint &operator+=(const TimeLength &v) { return *this = *this + v; }
+        public: TimePoint &operator-=(const TimeLength &v) { return *this = *this - v; }
+
+        // Absolute distance between two points (as timepoint_diff)
+        public: constexpr TimeLength operator-(const TimePoint &t) const {
+            return (sec > t.sec || (sec == t.sec && asec >= t.asec))
+                ? Distance(*this, t) : Distance(t, *this);
+        }
+
+        private: static constexpr TimePoint Negative(u64 mag, u64 per_sec) {
+            return mag % per_sec
+                ? TimePoint(-(s64) (mag / per_sec) - 1,
+                    aSEC_PER_SEC - (mag % per_sec) * AsecPerUnit(per_sec), Normalized())
+                : TimePoint(-(s64) (mag / per_sec), 0, Normalized());
+        }
+        private: static constexpr TimeLength Distance(const TimePoint &hi,
+            const TimePoint &lo) {
+            return hi.asec < lo.asec
+                ? TimeLength((u64) (hi.sec - lo.sec) - 1,
+                    aSEC_PER_SEC - (lo.asec - hi.asec), TimeLength::Normalized())
+                : TimeLength((u64) (hi.sec - lo.sec), hi.asec - lo.asec,
+                    TimeLength::Normalized());
+        }
+    };
+
+    constexpr bool operator==(const TimePoint &a, const TimePoint &b) {
+        return a.sec == b.sec && a.asec == b.asec;
+    }
+    constexpr bool operator!=(const TimePoint &a, const TimePoint &b) { return !(a == b); }
+    constexpr bool operator<(const TimePoint &a, const TimePoint &b) {
+        return a.sec < b.sec || (a.sec == b.sec && a.asec < b.asec);
+    }
+    constexpr bool operator>(const TimePoint &a, const TimePoint &b)  { return b < a; }
+    constexpr bool operator<=(const TimePoint &a, const TimePoint &b) { return !(b < a); }
+    constexpr bool operator>=(const TimePoint &a, const TimePoint &b) { return !(a < b); }
+    constexpr TimePoint operator+(const TimeLength &v, const TimePoint &t) { return t + v; }
+
+    // A length of time with an uncertainty interval around it
+    class UTimeLength : public utimelength_t
+    {
+        public: constexpr UTimeLength()
+            : utimelength_t{TimeLength(), {TimeLength(), TimeLength()}} {}
+        public: constexpr UTimeLength(const TimeLength &estimate,
+            const TimeLength &below = TimeLength(), const TimeLength &above = TimeLength())
+            : utimelength_t{estimate, {below, above}} {}
+        public: constexpr UTimeLength(const utimelength_t &ul)
+            : UTimeLength(TimeLength(ul.estimate),
+                TimeLength(ul.interval.below), TimeLength(ul.interval.above)) {}
+
+        public: constexpr TimeLength Estimate() const { return TimeLength(estimate); }
+        public: constexpr TimeLength Below() const { return TimeLength(interval.below); }
+        public: constexpr TimeLength Above() const { return TimeLength(interval.above); }
+
+        // Interval arithmetic: uncertainties accumulate on both sides
+        public: constexpr UTimeLength operator+(const UTimeLength &v) const {
+            return UTimeLength(Estimate() + v.Estimate(),
+                Below() + v.Below(), Above() + v.Above());
+        }
+    };
+
+    // A point in time with an uncertainty interval around it
+    class UTimePoint : public utimepoint_t
+    {
+        public: constexpr UTimePoint()
+            : utimepoint_t{TimePoint(), {TimeLength(), TimeLength()}} {}
+        public: constexpr UTimePoint(const TimePoint &estimate,
+            const TimeLength &below = TimeLength(), const TimeLength &above = TimeLength())
+            : utimepoint_t{estimate, {below, above}} {}
+        public: constexpr UTimePoint(const utimepoint_t &up)
+            : UTimePoint(TimePoint(up.estimate),
+                TimeLength(up.interval.below), TimeLength(up.interval.above)) {}
+
+        public: constexpr TimePoint Estimate() const { return TimePoint(estimate); }
+        public: constexpr TimeLength Below() const { return TimeLength(interval.below); }
+        public: constexpr TimeLength Above() const { return TimeLength(interval.above); }
+
+        // Bounds of the interval in which the true time lies
+        public: constexpr TimePoint Earliest() const { return Estimate() - Below(); }
+        public: constexpr TimePoint Latest() const { return Estimate() + Above(); }
+
+        // An exact shift moves the interval without widening it
+        public: constexpr UTimePoint operator+(const TimeLength &v) const {
+            return UTimePoint(Estimate() + v, Below(), Above());
+        }
+        public: constexpr UTimePoint operator-(const TimeLength &v) const {
+            return UTimePoint(Estimate() - v, Below(), Above());
+        }
+
+        // Interval arithmetic. Unlike utimepoint_sub, subtracting an uncertain
+        // length swaps its bounds: a later length gives an earlier point.
+        public: constexpr UTimePoint operator+(const UTimeLength &v) const {
+            return UTimePoint(Estimate() + v.Estimate(),
+                Below() + v.Below(), Above() + v.Above());
+        }
+        public: constexpr UTimePoint operator-(const UTimeLength &v) const {
+            return UTimePoint(Estimate() - v.Estimate(),
+                Below() + v.Above(), Above() + v.Below());
+        }
+
+        // Whether the true time certainly lies before / after a point
+        public: constexpr bool Before(const TimePoint &t) const { return Latest() < t; }
+        public: constexpr bool After(const TimePoint &t) const { return Earliest() > t; }
+        public: constexpr bool Contains(const TimePoint &t) const {
+            return Earliest() <= t && t <= Latest();
+        }
+    };
+
+    // Whether a certainly precedes b, or the two intervals overlap
+    constexpr bool Before(const UTimePoint &a, const UTimePoint &b) {
+        return a.Latest() < b.Earliest();
+    }
+    constexpr bool Overlaps(const UTimePoint &a, const UTimePoint &b) {
+        return !Before(a, b) && !Before(b, a);
+    }
+
+    // Layout compatibility with the C structs (zero-copy interop)
+    static_assert(sizeof(TimeLength) == sizeof(timelength_t)
+        && std::is_standard_layout<TimeLength>::value, "TimeLength layout");
+    static_assert(sizeof(TimePoint) == sizeof(timepoint_t)
+        && std::is_standard_layout<TimePoint>::value, "TimePoint layout");
+    static_assert(sizeof(UTimeLength) == sizeof(utimelength_t)
+        && std::is_standard_layout<UTimeLength>::value, "UTimeLength layout");
+    static_assert(sizeof(UTimePoint) == sizeof(utimepoint_t)
+        && std::is_standard_layout<UTimePoint>::value, "UTimePoint layout");
+
+    // Unit literals, e.g. 'using namespace qot::literals; auto g = 10_us;'
+    namespace literals
+    {
+        constexpr TimeLength operator"" _sec(unsigned long long v)  { return TimeLength::FromSec(v); }
+        constexpr TimeLength operator"" _ms(unsigned long long v)   { return TimeLength::FromMsec(v); }
+        constexpr TimeLength operator"" _us(unsigned long long v)   { return TimeLength::FromUsec(v); }
+        constexpr TimeLength operator"" _ns(unsigned long long v)   { return TimeLength::FromNsec(v); }
+        constexpr TimeLength operator"" _ps(unsigned long long v)   { return TimeLength::FromPsec(v); }
+        constexpr TimeLength operator"" _fs(unsigned long long v)   { return TimeLength::FromFsec(v); }
+        constexpr TimeLength operator"" _asec(unsigned long long v) { return TimeLength::FromAsec(v); }
+    }
+}
+
+#endif
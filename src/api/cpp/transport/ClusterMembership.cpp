@@ -0,0 +1,195 @@
+/**
+ * @file ClusterMembership.cpp
+ * @brief Membership of the nodes of a coordination cluster
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This file header */
+#include "ClusterMembership.hpp"
+
+#include <chrono>
+#include <cstring>
+
+using namespace qot;
+
+ClusterMembership::ClusterMembership()
+	: members(0), alive_members(0), stopped(false), callback(NULL)
+{
+}
+
+NodeId ClusterMembership::intern(const std::string &name)
+{
+	std::pair<std::unordered_map<std::string, NodeId>::iterator, bool> slot
+		= ids.insert(std::make_pair(name, (NodeId) nodes.size()));
+	if (slot.second)
+	{
+		Node node = { name, 0, false, false, false, false };
+		nodes.push_back(node);
+	}
+	return slot.first->second;
+}
+
+NodeId ClusterMembership::Intern(const std::string &name)
+{
+	std::lock_guard<std::mutex> lck(lock);
+	return intern(name);
+}
+
+void ClusterMembership::Define(const std::vector<std::string> &names)
+{
+	std::lock_guard<std::mutex> lck(lock);
+	for (size_t i = 0; i < nodes.size(); i++)
+		nodes[i].member = false;
+	members = 0;
+	alive_members = 0;
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		Node &node = nodes[intern(names[i])];
+		if (node.member)
+			continue;
+		node.member = true;
+		members++;
+		if (node.alive)
+			alive_members++;
+	}
+	if (ready())
+		cv.notify_all();
+}
+
+bool ClusterMembership::IsMember(const std::string &name)
+{
+	std::lock_guard<std::mutex> lck(lock);
+	std::unordered_map<std::string, NodeId>::const_iterator it = ids.find(name);
+	return it != ids.end() && nodes[it->second].member;
+}
+
+void ClusterMembership::queue_change(NodeId id)
+{
+	if (nodes[id].queued)
+		return;
+	nodes[id].queued = true;
+	pending.push_back(id);
+}
+
+bool ClusterMembership::Join(const std::string &name, long userID)
+{
+	std::lock_guard<std::mutex> lck(lock);
+	NodeId id = intern(name);
+	Node &node = nodes[id];
+	node.userID = userID;
+	if (node.alive)
+		return false;
+	node.alive = true;
+	queue_change(id);
+	if (node.member && ++alive_members == members)
+		cv.notify_all();
+	return true;
+}
+
+bool ClusterMembership::Leave(const std::string &name)
+{
+	std::lock_guard<std::mutex> lck(lock);
+	std::unordered_map<std::string, NodeId>::const_iterator it = ids.find(name);
+	if (it == ids.end() || !nodes[it->second].alive)
+		return false;
+	Node &node = nodes[it->second];
+	node.alive = false;
+	queue_change(it->second);
+	if (node.member)
+		alive_members--;
+	return true;
+}
+
+size_t ClusterMembership::Dispatch()
+{
+	qot_node_callback_t notify;
+	qot_node_t info;
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		batch.clear();
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			// Only the state a node ended up in counts
+			Node &node = nodes[pending[i]];
+			node.queued = false;
+			if (node.alive == node.reported)
+				continue;
+			node.reported = node.alive;
+			memset(&info, 0, sizeof(info));
+			strncpy(info.name, node.name.c_str(), QOT_MAX_NAMELEN - 1);
+			info.userID = node.userID;
+			info.status = node.alive ? QOT_NODE_JOINED : QOT_NODE_LEFT;
+			batch.push_back(info);
+		}
+		pending.clear();
+		notify = callback;
+	}
+
+	// The callback runs without the lock, so it may look at the membership
+	if (notify != NULL)
+		for (size_t i = 0; i < batch.size(); i++)
+			notify(&batch[i]);
+	return batch.size();
+}
+
+void ClusterMembership::SetCallback(qot_node_callback_t callback)
+{
+	std::lock_guard<std::mutex> lck(lock);
+	this->callback = callback;
+}
+
+bool ClusterMembership::Ready()
+{
+	std::lock_guard<std::mutex> lck(lock);
+	return ready();
+}
+
+bool ClusterMembership::WaitForReady(int timeout_ms)
+{
+	std::unique_lock<std::mutex> lck(lock);
+	if (timeout_ms < 0)
+		cv.wait(lck, [this]{ return ready() || stopped; });
+	else
+		cv.wait_for(lck, std::chrono::milliseconds(timeout_ms), [this]{ return ready() || stopped; });
+	return ready() && !stopped;
+}
+
+void ClusterMembership::Stop()
+{
+	std::lock_guard<std::mutex> lck(lock);
+	stopped = true;
+	cv.notify_all();
+}
+
+uint32_t ClusterMembership::Members()
+{
+	std::lock_guard<std::mutex> lck(lock);
+	return members;
+}
+
+uint32_t ClusterMembership::AliveMembers()
+{
+	std::lock_guard<std::mutex> lck(lock);
+	return alive_members;
+}
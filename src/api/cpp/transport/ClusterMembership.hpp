@@ -0,0 +1,119 @@
+/**
+ * @file ClusterMembership.hpp
+ * @brief Membership of the nodes of a coordination cluster
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef CLUSTER_MEMBERSHIP_HPP
+#define CLUSTER_MEMBERSHIP_HPP
+
+// std library includes
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Include the QoT Data Types
+extern "C"
+{
+	#include "../../../qot_types.h"
+}
+
+namespace qot
+{
+	// Interned node identifier, an index into the membership's node table
+	typedef uint32_t NodeId;
+
+	// Nodes seen on the timeline and the cluster defined over them. Names are
+	// interned once into dense ids, so that joins, leaves and lookups are hash
+	// lookups; readiness is a count of alive cluster nodes rather than a scan
+	class ClusterMembership
+	{
+		public: ClusterMembership();
+
+		// Id of a node name, interning names not seen before
+		public: NodeId Intern(const std::string &name);
+
+		// Define the nodes of the cluster (replacing any earlier definition)
+		public: void Define(const std::vector<std::string> &nodes);
+
+		// Whether a node is part of the cluster
+		public: bool IsMember(const std::string &name);
+
+		// A node joined or left the timeline, false when nothing changed. The
+		// change is queued for the callback until the next Dispatch
+		public: bool Join(const std::string &name, long userID);
+		public: bool Leave(const std::string &name);
+
+		// Hand the changes queued since the last call to the callback in one batch
+		// (a node which left and came back in between is not reported), called on
+		// the thread which feeds the joins and leaves. Returns the nodes reported
+		public: size_t Dispatch();
+		public: void SetCallback(qot_node_callback_t callback);
+
+		// Whether every cluster node is alive, and waiting for it (timeout_ms < 0
+		// waits forever). Waiting returns false on timeout or once Stop is called
+		public: bool Ready();
+		public: bool WaitForReady(int timeout_ms);
+		public: void Stop();
+
+		// Counts of the cluster nodes, and of those alive
+		public: uint32_t Members();
+		public: uint32_t AliveMembers();
+
+		// A node ever seen or named in the cluster
+		private: struct Node {
+			std::string name;
+			long userID;
+			bool alive;
+			bool member;
+			bool reported;				// Alive as far as the callback was last told
+			bool queued;				// Has a change waiting for Dispatch
+		};
+
+		// Find or add a node, called with lock held
+		private: NodeId intern(const std::string &name);
+		private: bool ready() const { return members > 0 && alive_members == members; }
+
+		// Queue a change of a node for the callback, called with lock held
+		private: void queue_change(NodeId id);
+
+		private: std::unordered_map<std::string, NodeId> ids;
+		private: std::vector<Node> nodes;
+		private: uint32_t members;
+		private: uint32_t alive_members;
+		private: bool stopped;
+
+		// Changes not reported yet, and the batch being reported
+		private: std::vector<NodeId> pending;
+		private: std::vector<qot_node_t> batch;
+		private: qot_node_callback_t callback;
+
+		// lock guards everything above, cv wakes the threads waiting for the cluster
+		private: std::mutex lock;
+		private: std::condition_variable cv;
+	};
+}
+
+#endif
@@ -0,0 +1,247 @@
+/**
+ * @file LatencyStats.cpp
+ * @brief End-to-end latency histograms of timeline messages
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This file header */
+#include "LatencyStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Buckets per power of two are 2^(LATENCY_SUB_BITS - 1), values are kept below 2^LATENCY_MAX_BITS
+#define LATENCY_SUB_BITS 6
+#define LATENCY_MAX_BITS 42
+
+using namespace qot;
+
+// HISTOGRAM ////////////////////////////////////////////////////////////////////
+
+LatencyHistogram::LatencyHistogram()
+	: counts(index_of((1ULL << LATENCY_MAX_BITS) - 1) + 1, 0), count(0), sum(0), min(INT64_MAX), max(0)
+{
+}
+
+size_t LatencyHistogram::index_of(uint64_t value)
+{
+	int shift;
+	if (value < (1ULL << LATENCY_SUB_BITS))
+		return value;
+
+	// The top LATENCY_SUB_BITS bits of the value pick the bucket within its power of two
+	shift = 63 - __builtin_clzll(value) - (LATENCY_SUB_BITS - 1);
+	return ((size_t) shift << (LATENCY_SUB_BITS - 1)) + (value >> shift);
+}
+
+uint64_t LatencyHistogram::lowest(size_t index)
+{
+	size_t shift;
+	if (index < (1ULL << LATENCY_SUB_BITS))
+		return index;
+	shift = (index >> (LATENCY_SUB_BITS - 1)) - 1;
+	return (uint64_t) (index - (shift << (LATENCY_SUB_BITS - 1))) << shift;
+}
+
+uint64_t LatencyHistogram::highest(size_t index)
+{
+	if (index < (1ULL << LATENCY_SUB_BITS))
+		return index;
+	return lowest(index) + (1ULL << ((index >> (LATENCY_SUB_BITS - 1)) - 1)) - 1;
+}
+
+void LatencyHistogram::Record(int64_t value)
+{
+	if (value < 0)
+		value = 0;
+	if (value >= (int64_t) (1ULL << LATENCY_MAX_BITS))
+		value = (1ULL << LATENCY_MAX_BITS) - 1;
+	counts[index_of(value)]++;
+	count++;
+	sum += value;
+	min = std::min(min, value);
+	max = std::max(max, value);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram &other)
+{
+	for (size_t i = 0; i < counts.size(); i++)
+		counts[i] += other.counts[i];
+	count += other.count;
+	sum += other.sum;
+	min = std::min(min, other.min);
+	max = std::max(max, other.max);
+}
+
+int64_t LatencyHistogram::Percentile(double percentile) const
+{
+	uint64_t target, seen = 0;
+	if (count == 0)
+		return 0;
+	target = (uint64_t) std::ceil(std::min(percentile, 100.0) / 100.0 * count);
+	target = std::max<uint64_t>(target, 1);
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		seen += counts[i];
+		if (seen >= target)
+			return std::min((int64_t) highest(i), max);
+	}
+	return max;
+}
+
+void LatencyHistogram::Print(FILE *file) const
+{
+	uint64_t seen = 0;
+	fprintf(file, "%14s %12s %12s\n", "value_ns", "percentile", "count");
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		if (!counts[i])
+			continue;
+		seen += counts[i];
+		fprintf(file, "%14lld %12.6f %12llu\n", (long long) std::min((int64_t) highest(i), max),
+			100.0 * seen / count, (unsigned long long) seen);
+	}
+}
+
+// MONITOR //////////////////////////////////////////////////////////////////////
+
+LatencyMonitor::LatencyMonitor()
+{
+}
+
+void LatencyMonitor::Record(const std::string &topic, const TransportHeader &header, const utimepoint_t &now)
+{
+	int64_t now_ns, total, handoff, unc;
+	if (header.published_ns == 0)
+		return;
+
+	// One-way latency is only as good as both clocks, so the uncertainties add up
+	now_ns = (int64_t) TP_TO_nSEC(now.estimate);
+	handoff = header.handoff_ns ? header.handoff_ns : header.published_ns;
+	total = now_ns - header.published_ns;
+	unc = header.stamp_unc_ns + (int64_t) (TL_TO_nSEC(now.interval.above) + TL_TO_nSEC(now.interval.below));
+
+	std::lock_guard<std::mutex> lck(lock);
+	Entry &entry = entries[std::make_pair(topic, std::string(header.name, strnlen(header.name, QOT_MAX_NAMELEN)))];
+	if (total < 0)
+		entry.negative++;
+	entry.total.Record(total);
+	entry.transport.Record(now_ns - handoff);
+	entry.batching += handoff - header.published_ns;
+	entry.uncertainty += unc;
+	entry.uncertainty_max = std::max(entry.uncertainty_max, unc);
+}
+
+bool LatencyMonitor::combine(const char *topic, const char *peer, Entry &sum)
+{
+	bool found = false;
+	for (EntryMap::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		if ((topic && *topic && it->first.first != topic) || (peer && *peer && it->first.second != peer))
+			continue;
+		sum.total.Merge(it->second.total);
+		sum.transport.Merge(it->second.transport);
+		sum.negative += it->second.negative;
+		sum.batching += it->second.batching;
+		sum.uncertainty += it->second.uncertainty;
+		sum.uncertainty_max = std::max(sum.uncertainty_max, it->second.uncertainty_max);
+		found = true;
+	}
+	return found;
+}
+
+bool LatencyMonitor::Query(const char *topic, const char *peer, qot_latency_stats_t &stats)
+{
+	Entry sum;
+	memset(&stats, 0, sizeof(stats));
+	if (topic)
+		strncpy(stats.topic, topic, QOT_MAX_NAMELEN - 1);
+	if (peer)
+		strncpy(stats.peer, peer, QOT_MAX_NAMELEN - 1);
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		if (!combine(topic, peer, sum))
+			return false;
+	}
+	stats.samples = sum.total.Count();
+	stats.negative = sum.negative;
+	stats.min_ns = sum.total.Min();
+	stats.mean_ns = sum.total.Mean();
+	stats.p50_ns = sum.total.Percentile(50);
+	stats.p90_ns = sum.total.Percentile(90);
+	stats.p99_ns = sum.total.Percentile(99);
+	stats.p999_ns = sum.total.Percentile(99.9);
+	stats.max_ns = sum.total.Max();
+	stats.transport_p50_ns = sum.transport.Percentile(50);
+	stats.transport_p99_ns = sum.transport.Percentile(99);
+	stats.batching_mean_ns = (int64_t) (sum.batching / stats.samples);
+	stats.uncertainty_mean_ns = (int64_t) (sum.uncertainty / stats.samples);
+	stats.uncertainty_max_ns = sum.uncertainty_max;
+	return true;
+}
+
+qot_return_t LatencyMonitor::Dump(const char *path)
+{
+	qot_latency_stats_t stats;
+	std::vector<std::pair<std::string, std::string> > keys;
+	FILE *file = fopen(path, "w");
+	if (!file)
+		return QOT_RETURN_TYPE_ERR;
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		for (EntryMap::iterator it = entries.begin(); it != entries.end(); ++it)
+			keys.push_back(it->first);
+	}
+
+	// A summary line per topic and peer, then its publish to delivery distribution
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		if (!Query(keys[i].first.c_str(), keys[i].second.c_str(), stats))
+			continue;
+		fprintf(file, "# topic %s peer %s samples %llu negative %llu min %lld mean %lld p50 %lld p90 %lld "
+			"p99 %lld p99.9 %lld max %lld transport_p50 %lld transport_p99 %lld batching %lld "
+			"uncertainty %lld uncertainty_max %lld\n", stats.topic, stats.peer,
+			(unsigned long long) stats.samples, (unsigned long long) stats.negative,
+			(long long) stats.min_ns, (long long) stats.mean_ns, (long long) stats.p50_ns,
+			(long long) stats.p90_ns, (long long) stats.p99_ns, (long long) stats.p999_ns,
+			(long long) stats.max_ns, (long long) stats.transport_p50_ns, (long long) stats.transport_p99_ns,
+			(long long) stats.batching_mean_ns, (long long) stats.uncertainty_mean_ns,
+			(long long) stats.uncertainty_max_ns);
+		std::lock_guard<std::mutex> lck(lock);
+		EntryMap::iterator it = entries.find(keys[i]);
+		if (it != entries.end())
+			it->second.total.Print(file);
+		fprintf(file, "\n");
+	}
+	if (fclose(file))
+		return QOT_RETURN_TYPE_ERR;
+	return QOT_RETURN_TYPE_OK;
+}
+
+void LatencyMonitor::Reset()
+{
+	std::lock_guard<std::mutex> lck(lock);
+	entries.clear();
+}
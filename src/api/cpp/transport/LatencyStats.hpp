@@ -0,0 +1,121 @@
+/**
+ * @file LatencyStats.hpp
+ * @brief End-to-end latency histograms of timeline messages
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LATENCY_STATS_HPP
+#define LATENCY_STATS_HPP
+
+// std library includes
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Transport interface
+#include "Transport.hpp"
+
+namespace qot
+{
+	// Log-linear histogram of nanosecond values in the manner of HdrHistogram: each
+	// power of two is split into 32 buckets, so that any value is kept to within
+	// 1/32 of itself. Values beyond about 73 minutes are clamped
+	class LatencyHistogram
+	{
+		public: LatencyHistogram();
+
+		// Count a value (negative values count as zero)
+		public: void Record(int64_t value);
+
+		// Add the counts of another histogram
+		public: void Merge(const LatencyHistogram &other);
+
+		// Highest value of the bucket below which percentile (0 to 100) of the counts lie
+		public: int64_t Percentile(double percentile) const;
+
+		// Summary of what was recorded
+		public: uint64_t Count() const { return count; }
+		public: int64_t Min() const { return count ? min : 0; }
+		public: int64_t Max() const { return max; }
+		public: int64_t Mean() const { return count ? (int64_t) (sum / count) : 0; }
+
+		// Write the cumulative distribution, one line per non-empty bucket
+		public: void Print(FILE *file) const;
+
+		// Bucket of a value, and the lowest and highest value of a bucket
+		private: static size_t index_of(uint64_t value);
+		private: static uint64_t lowest(size_t index);
+		private: static uint64_t highest(size_t index);
+
+		private: std::vector<uint64_t> counts;
+		private: uint64_t count;
+		private: double sum;
+		private: int64_t min;
+		private: int64_t max;
+	};
+
+	// Latency of the messages received, per topic and per publishing peer. The
+	// publisher stamps a message when it is published and when it is handed to
+	// the transport, the receiver when it is delivered; all three in timeline time
+	class LatencyMonitor
+	{
+		public: LatencyMonitor();
+
+		// Measure a delivered message against the receiver's time now. Messages
+		// which were not stamped by their publisher are skipped
+		public: void Record(const std::string &topic, const TransportHeader &header, const utimepoint_t &now);
+
+		// Combine the histograms of a topic and peer, NULL or "" matching all of them.
+		// Returns false when nothing was measured
+		public: bool Query(const char *topic, const char *peer, qot_latency_stats_t &stats);
+
+		// Write every topic and peer, and their distributions, to a file
+		public: qot_return_t Dump(const char *path);
+
+		// Forget everything measured
+		public: void Reset();
+
+		// Histograms of a topic and peer
+		private: struct Entry {
+			LatencyHistogram total;			// Publish to delivery
+			LatencyHistogram transport;		// Handoff to delivery
+			uint64_t negative;
+			double batching;				// Sum of publish to handoff
+			double uncertainty;				// Sum of the combined uncertainty
+			int64_t uncertainty_max;
+			Entry() : negative(0), batching(0), uncertainty(0), uncertainty_max(0) {}
+		};
+		private: typedef std::map<std::pair<std::string, std::string>, Entry> EntryMap;
+
+		// Merge the entries matching topic and peer into sum, called with lock held
+		private: bool combine(const char *topic, const char *peer, Entry &sum);
+
+		private: EntryMap entries;
+		private: std::mutex lock;
+	};
+}
+
+#endif
@@ -0,0 +1,686 @@
+/*
+ * @file MsgPipeline.cpp
+ * @brief Batched publishing and queued delivery of timeline messages
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This file header */
+#include "MsgPipeline.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+// Default time a message may wait in a partial batch (microseconds)
+#define DEFAULT_FLUSH_US 1000
+
+// Default number of messages held for ordering
+#define DEFAULT_ORDER_DEPTH 1024
+
+using namespace qot;
+
+void qot::MessageToHeader(const qot_message_t &msg, const std::string &name, TransportHeader &header)
+{
+	strncpy(header.name, name.c_str(), QOT_MAX_NAMELEN - 1);       // Our name
+	header.name[QOT_MAX_NAMELEN - 1] = '\0';
+	header.type = msg.type;                                         // Msg Type
+	header.timestamp = msg.timestamp;                               // Timestamp Associated with Msg
+	header.published_ns = 0;                                        // Stamped by the batcher
+	header.handoff_ns = 0;
+	header.stamp_unc_ns = 0;
+}
+
+void qot::HeaderToMessage(const TransportHeader &header, const void *payload, size_t length, qot_message_t &msg)
+{
+	memcpy(msg.name, header.name, QOT_MAX_NAMELEN);
+	msg.name[QOT_MAX_NAMELEN - 1] = '\0';
+	msg.type = header.type;
+	msg.timestamp = header.timestamp;
+
+	// The fixed data field holds the start of the payload as a string
+	length = strnlen((const char *) payload, length < QOT_MAX_NAMELEN ? length : QOT_MAX_NAMELEN - 1);
+	memcpy(msg.data, payload, length);
+	msg.data[length] = '\0';
+}
+
+// BATCHED PUBLISHING ///////////////////////////////////////////////////////////
+
+MessageBatcher::MessageBatcher(Transport &transport)
+	: transport(transport), pending_count(0), writing_count(0), batch_size(1), flush_us(DEFAULT_FLUSH_US),
+	  running(false), published(0), batches(0), timed_flushes(0)
+{
+}
+
+MessageBatcher::~MessageBatcher()
+{
+	stop_flusher();
+	std::lock_guard<std::mutex> wlck(write_lock);
+	write_pending(false);
+}
+
+qot_return_t MessageBatcher::Configure(uint32_t batch_size, uint32_t flush_us)
+{
+	// The batch vectors are reserved up front
+	if (batch_size > QOT_MSG_MAX_BATCH_SIZE)
+		return QOT_RETURN_TYPE_ERR;
+
+	// Send what was batched under the previous configuration
+	stop_flusher();
+	{
+		std::lock_guard<std::mutex> wlck(write_lock);
+		write_pending(false);
+		headers.reserve(batch_size);
+		payloads.reserve(batch_size);
+		lengths.reserve(batch_size);
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		this->batch_size = batch_size ? batch_size : 1;
+		this->flush_us = flush_us ? flush_us : DEFAULT_FLUSH_US;
+		pending.reserve(this->batch_size);
+		writing.reserve(this->batch_size);
+	}
+
+	// Messages may leave the transport up to a flush interval late, so it can pack a batch into fewer packets
+	transport.SetLatencyBudget(this->batch_size > 1 ? this->flush_us : 0);
+
+	// Partial batches are flushed by a thread of their own
+	if (this->batch_size > 1)
+	{
+		running = true;
+		thread = std::thread(&MessageBatcher::flusher, this);
+	}
+	return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t MessageBatcher::Publish(const TransportHeader &header, const void *payload, size_t length)
+{
+	const char *bytes = (const char *) payload;
+	TransportHeader stamped;
+	utimepoint_t now;
+	std::unique_lock<std::mutex> lck(lock);
+	published++;
+
+	// Unbatched messages go straight to the transport, so one stamp serves both
+	if (batch_size <= 1)
+	{
+		batches++;
+		if (clock && !clock(now))
+		{
+			stamped = header;
+			stamped.published_ns = (int64_t) TP_TO_nSEC(now.estimate);
+			stamped.handoff_ns = stamped.published_ns;
+			stamped.stamp_unc_ns = (int64_t) (TL_TO_nSEC(now.interval.above) + TL_TO_nSEC(now.interval.below));
+			lck.unlock();
+			return transport.Publish(stamped, payload, length);
+		}
+		lck.unlock();
+		return transport.Publish(header, payload, length);
+	}
+
+	if (pending_count == 0)
+	{
+		oldest = std::chrono::steady_clock::now();
+		cv.notify_one();
+	}
+	if (pending_count == pending.size())
+		pending.push_back(Entry());
+	pending[pending_count].header = header;
+	pending[pending_count].payload.assign(bytes, bytes + length);
+	if (clock && !clock(now))
+	{
+		pending[pending_count].header.published_ns = (int64_t) TP_TO_nSEC(now.estimate);
+		pending[pending_count].header.stamp_unc_ns =
+			(int64_t) (TL_TO_nSEC(now.interval.above) + TL_TO_nSEC(now.interval.below));
+	}
+	if (++pending_count < batch_size)
+		return QOT_RETURN_TYPE_OK;
+	lck.unlock();
+
+	std::lock_guard<std::mutex> wlck(write_lock);
+	write_pending(false);
+	return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t MessageBatcher::Flush()
+{
+	std::lock_guard<std::mutex> wlck(write_lock);
+	write_pending(false);
+	return QOT_RETURN_TYPE_OK;
+}
+
+void MessageBatcher::SetClock(MessageClock clock)
+{
+	std::lock_guard<std::mutex> lck(lock);
+	this->clock = clock;
+}
+
+void MessageBatcher::GetStats(qot_msg_stats_t &stats)
+{
+	std::lock_guard<std::mutex> lck(lock);
+	stats.published = published;
+	stats.batches = batches;
+	stats.timed_flushes = timed_flushes;
+}
+
+void MessageBatcher::write_pending(bool timed)
+{
+	int64_t handoff = 0, unc = 0;
+	utimepoint_t now;
+	size_t i;
+
+	// Swap the batch out so that publishers keep queueing while it is sent; the
+	// two vectors trade places, and their entries keep their payload buffers
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		if (pending_count == 0)
+			return;
+		writing.swap(pending);
+		writing_count = pending_count;
+		pending_count = 0;
+		batches++;
+		if (timed)
+			timed_flushes++;
+
+		// The whole batch is handed over at once
+		if (clock && !clock(now))
+		{
+			handoff = (int64_t) TP_TO_nSEC(now.estimate);
+			unc = (int64_t) (TL_TO_nSEC(now.interval.above) + TL_TO_nSEC(now.interval.below));
+		}
+	}
+	headers.resize(writing_count);
+	payloads.resize(writing_count);
+	lengths.resize(writing_count);
+	for (i = 0; i < writing_count; i++)
+	{
+		headers[i] = writing[i].header;
+		if (handoff && headers[i].published_ns)
+		{
+			headers[i].handoff_ns = handoff;
+			headers[i].stamp_unc_ns = std::max(headers[i].stamp_unc_ns, unc);
+		}
+		payloads[i] = writing[i].payload.data();
+		lengths[i] = writing[i].payload.size();
+	}
+	if (transport.PublishBatch(headers.data(), payloads.data(), lengths.data(), writing_count))
+		std::cerr << "ERROR: Failed to send a batch of " << writing_count << " messages" << std::endl;
+	writing_count = 0;
+}
+
+void MessageBatcher::flusher()
+{
+	std::chrono::steady_clock::time_point deadline;
+	std::unique_lock<std::mutex> lck(lock);
+	while (running)
+	{
+		if (pending_count == 0)
+		{
+			cv.wait(lck);
+			continue;
+		}
+		deadline = oldest + std::chrono::microseconds(flush_us);
+		if (std::chrono::steady_clock::now() < deadline)
+		{
+			cv.wait_until(lck, deadline);
+			continue;
+		}
+		lck.unlock();
+		{
+			std::lock_guard<std::mutex> wlck(write_lock);
+			write_pending(true);
+		}
+		lck.lock();
+	}
+}
+
+void MessageBatcher::stop_flusher()
+{
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		if (!running)
+			return;
+		running = false;
+	}
+	cv.notify_all();
+	thread.join();
+}
+
+// QUEUED DELIVERY //////////////////////////////////////////////////////////////
+
+MessageQueue::MessageQueue(uint32_t depth, uint32_t block_us)
+	: slots(new Slot[depth]), mask(depth - 1), block_us(block_us), head(0), tail(0), waiters(0),
+	  received(0), delivered(0), dropped(0), stalls(0), max_depth(0)
+{
+	// Every slot is free for the first lap of the ring
+	for (uint64_t i = 0; i < depth; i++)
+		slots[i].seq.store(i, std::memory_order_relaxed);
+}
+
+MessageQueue::~MessageQueue()
+{
+}
+
+bool MessageQueue::try_push(const qot_message_t &msg, const MessageStamps &stamps)
+{
+	uint64_t pos = head.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Slot &slot = slots[pos & mask];
+		int64_t dif = (int64_t) (slot.seq.load(std::memory_order_acquire) - pos);
+		if (dif == 0)
+		{
+			if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				slot.msg = msg;
+				slot.stamps = stamps;
+				slot.seq.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (dif < 0)
+		{
+			return false;
+		}
+		else
+		{
+			pos = head.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool MessageQueue::try_pop(qot_message_t &msg, MessageStamps &stamps)
+{
+	uint64_t pos = tail.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Slot &slot = slots[pos & mask];
+		int64_t dif = (int64_t) (slot.seq.load(std::memory_order_acquire) - (pos + 1));
+		if (dif == 0)
+		{
+			if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				msg = slot.msg;
+				stamps = slot.stamps;
+				slot.seq.store(pos + mask + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (dif < 0)
+		{
+			return false;
+		}
+		else
+		{
+			pos = tail.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool MessageQueue::empty()
+{
+	uint64_t pos = tail.load(std::memory_order_relaxed);
+	return slots[pos & mask].seq.load(std::memory_order_acquire) != pos + 1;
+}
+
+void MessageQueue::Push(const qot_message_t *msgs, size_t count, const MessageStamps *stamps)
+{
+	static const MessageStamps unstamped = { 0, 0, 0 };
+	std::chrono::steady_clock::time_point deadline;
+	uint64_t depth;
+	uint32_t max;
+	size_t i;
+	bool pushed;
+
+	for (i = 0; i < count; i++)
+	{
+		if (try_push(msgs[i], stamps ? stamps[i] : unstamped))
+			continue;
+		if (!block_us)
+			break;
+
+		// Backpressure: wake the consumers and give them block_us to make room
+		stalls.fetch_add(1, std::memory_order_relaxed);
+		deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(block_us);
+		{
+			std::lock_guard<std::mutex> lck(lock);
+			cv.notify_all();
+		}
+		while (!(pushed = try_push(msgs[i], stamps ? stamps[i] : unstamped)) && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::yield();
+		if (!pushed)
+			break;
+	}
+	received.fetch_add(count, std::memory_order_relaxed);
+	dropped.fetch_add(count - i, std::memory_order_relaxed);
+
+	depth = head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed);
+	max = max_depth.load(std::memory_order_relaxed);
+	while (depth > max && !max_depth.compare_exchange_weak(max, (uint32_t) depth, std::memory_order_relaxed));
+
+	// Pairs with the fence in Pop, so that a consumer about to sleep either sees
+	// the new messages or is seen here as a waiter
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiters.load(std::memory_order_relaxed))
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		cv.notify_all();
+	}
+}
+
+size_t MessageQueue::Pop(qot_message_t *msgs, size_t max, int timeout_ms, MessageStamps *stamps)
+{
+	MessageStamps ignored;
+	size_t count = 0;
+	while (count < max && try_pop(msgs[count], stamps ? stamps[count] : ignored))
+		count++;
+
+	if (count == 0 && max > 0 && timeout_ms != 0)
+	{
+		std::unique_lock<std::mutex> lck(lock);
+		waiters.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto ready = [this] { return !empty(); };
+		if (timeout_ms < 0)
+			cv.wait(lck, ready);
+		else
+			cv.wait_for(lck, std::chrono::milliseconds(timeout_ms), ready);
+		waiters.fetch_sub(1, std::memory_order_relaxed);
+		lck.unlock();
+		while (count < max && try_pop(msgs[count], stamps ? stamps[count] : ignored))
+			count++;
+	}
+	delivered.fetch_add(count, std::memory_order_relaxed);
+	return count;
+}
+
+void MessageQueue::GetStats(qot_msg_stats_t &stats)
+{
+	uint64_t h = head.load(std::memory_order_relaxed);
+	uint64_t t = tail.load(std::memory_order_relaxed);
+	stats.received = received.load(std::memory_order_relaxed);
+	stats.delivered = delivered.load(std::memory_order_relaxed);
+	stats.dropped = dropped.load(std::memory_order_relaxed);
+	stats.stalls = stalls.load(std::memory_order_relaxed);
+	stats.depth = (h > t) ? (uint32_t) (h - t) : 0;
+	stats.max_depth = max_depth.load(std::memory_order_relaxed);
+}
+
+// TIMESTAMP ORDERED DELIVERY ///////////////////////////////////////////////////
+
+MessageReorderer::MessageReorderer(Clock clock, Sink sink)
+	: clock(clock), sink(sink), max_hold_ns(0), depth(DEFAULT_ORDER_DEPTH), deadline_ns(0),
+	  arrivals(0), newest(INT64_MIN), released(INT64_MIN), latency(0), latency_dev(-1), sender_unc(0),
+	  running(false), reordered(0), late(0), expired(0), max_held(0)
+{
+}
+
+MessageReorderer::~MessageReorderer()
+{
+	stop_releaser();
+}
+
+qot_return_t MessageReorderer::Configure(uint32_t max_hold_us, uint32_t depth, uint64_t deadline_ns)
+{
+	// Messages held under the previous configuration are released first
+	stop_releaser();
+	Flush();
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		this->max_hold_ns = (int64_t) max_hold_us * 1000;
+		this->depth = depth ? depth : DEFAULT_ORDER_DEPTH;
+		this->deadline_ns = (int64_t) deadline_ns;
+		held.reserve(this->depth + 1);
+		if (max_hold_us == 0)
+			return QOT_RETURN_TYPE_OK;
+		running = true;
+	}
+	thread = std::thread(&MessageReorderer::releaser, this);
+	return QOT_RETURN_TYPE_OK;
+}
+
+int64_t MessageReorderer::horizon(const utimepoint_t &now)
+{
+	// Any message still on its way was sent within the latency bound of now, and
+	// both clocks may be off by their uncertainty
+	int64_t bound = (latency_dev < 0) ? 0 : std::max<int64_t>(latency + 4 * latency_dev, 0);
+	int64_t h = bound + sender_unc + (int64_t) (TL_TO_nSEC(now.interval.above) + TL_TO_nSEC(now.interval.below));
+	return std::min(h, max_hold_ns);
+}
+
+// Timeline time a message is ordered and aged by, and how much later it may really
+// have been sent. The publish stamp is preferred: applications may put a future
+// action time in the message timestamp, which says nothing about when it was sent
+static void order_stamp(const TransportHeader &header, int64_t &stamp, int64_t &unc)
+{
+	if (header.published_ns)
+	{
+		stamp = header.published_ns;
+		unc = header.stamp_unc_ns;
+		return;
+	}
+	stamp = (int64_t) TP_TO_nSEC(header.timestamp.estimate);
+	unc = (int64_t) (TL_TO_nSEC(header.timestamp.interval.above) + TL_TO_nSEC(header.timestamp.interval.below));
+}
+
+bool MessageReorderer::past_deadline(int64_t earliest_ns, int64_t stamp, int64_t unc)
+{
+	return deadline_ns && earliest_ns != INT64_MIN && earliest_ns - (stamp + unc) > deadline_ns;
+}
+
+void MessageReorderer::release_first(int64_t earliest_ns, std::vector<Held> &ready)
+{
+	std::pop_heap(held.begin(), held.end(), Later());
+	released = std::max(released, held.back().stamp);
+	if (past_deadline(earliest_ns, held.back().stamp, held.back().unc))
+		expired.fetch_add(1, std::memory_order_relaxed);
+	else
+		ready.push_back(held.back());
+	held.pop_back();
+}
+
+void MessageReorderer::take_ready(int64_t now_ns, int64_t horizon_ns, int64_t earliest_ns, std::vector<Held> &ready)
+{
+	while (!held.empty() && held.front().stamp + horizon_ns <= now_ns)
+		release_first(earliest_ns, ready);
+}
+
+void MessageReorderer::deliver(std::unique_lock<std::mutex> &lck, std::vector<Held> &ready)
+{
+	std::unique_lock<std::mutex> dlck(deliver_lock);
+	lck.unlock();
+	for (size_t i = 0; i < ready.size(); i++)
+		sink(ready[i].header, ready[i].msg);
+}
+
+void MessageReorderer::Push(const TransportHeader &header, const void *payload, size_t length)
+{
+	std::vector<Held> ready(1);
+	utimepoint_t now;
+	int64_t stamp, unc, now_ns = 0, earliest_ns = INT64_MIN, sample;
+	bool timed = !clock(now);
+
+	order_stamp(header, stamp, unc);
+	if (timed)
+	{
+		now_ns = (int64_t) TP_TO_nSEC(now.estimate);
+		earliest_ns = now_ns - (int64_t) TL_TO_nSEC(now.interval.below);
+	}
+	ready[0].stamp = stamp;
+	ready[0].unc = unc;
+	ready[0].header = header;
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	// Drop messages surely older than the deadline from their header alone
+	if (past_deadline(earliest_ns, stamp, unc))
+	{
+		expired.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	// Without ordering, or for an unstamped message whose timestamp has not come
+	// yet, keep the arrival order
+	if (max_hold_ns == 0 || (timed && !header.published_ns && stamp > now_ns + (int64_t) TL_TO_nSEC(now.interval.above)))
+	{
+		HeaderToMessage(header, payload, length, ready[0].msg);
+		deliver(lck, ready);
+		return;
+	}
+
+	// Update the latency bound (smoothed like a TCP round trip estimate) and the
+	// sender uncertainty. A sample can only be negative by the clock uncertainty
+	if (timed)
+	{
+		sample = std::max<int64_t>(now_ns - stamp, 0);
+		if (latency_dev < 0)
+		{
+			latency = sample;
+			latency_dev = sample / 2;
+		}
+		else
+		{
+			latency_dev += (std::abs(sample - latency) - latency_dev) / 4;
+			latency += (sample - latency) / 8;
+		}
+		sender_unc = (unc > sender_unc) ? unc : sender_unc + (unc - sender_unc) / 16;
+	}
+
+	// Order can no longer be kept for messages stamped before one already released
+	if (stamp < released)
+	{
+		late.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	if (stamp < newest)
+		reordered.fetch_add(1, std::memory_order_relaxed);
+	else
+		newest = stamp;
+
+	// Hold the message, releasing the earliest one when too many are held
+	ready[0].seq = arrivals++;
+	held.push_back(ready[0]);
+	ready.clear();
+	HeaderToMessage(header, payload, length, held.back().msg);
+	std::push_heap(held.begin(), held.end(), Later());
+	if (held.size() > depth)
+		release_first(earliest_ns, ready);
+	if (held.size() > max_held.load(std::memory_order_relaxed))
+		max_held.store((uint32_t) held.size(), std::memory_order_relaxed);
+
+	// Without the time the release thread waits out the longest hold
+	if (timed)
+		take_ready(now_ns, horizon(now), earliest_ns, ready);
+
+	// A new earliest message may be due before the release thread wakes
+	if (!held.empty() && held.front().seq == arrivals - 1)
+		cv.notify_one();
+	if (ready.empty())
+		return;
+
+	// Releases leave in the order they were taken
+	deliver(lck, ready);
+}
+
+void MessageReorderer::Flush()
+{
+	std::vector<Held> ready;
+	std::unique_lock<std::mutex> lck(lock);
+	take_ready(INT64_MAX, 0, INT64_MIN, ready);
+	deliver(lck, ready);
+}
+
+void MessageReorderer::GetStats(qot_msg_stats_t &stats)
+{
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		stats.reorder_depth = (uint32_t) held.size();
+	}
+	stats.reordered = reordered.load(std::memory_order_relaxed);
+	stats.late = late.load(std::memory_order_relaxed);
+	stats.expired = expired.load(std::memory_order_relaxed);
+	stats.max_reorder_depth = max_held.load(std::memory_order_relaxed);
+}
+
+void MessageReorderer::releaser()
+{
+	std::vector<Held> ready;
+	std::unique_lock<std::mutex> lck(lock);
+	utimepoint_t now;
+	int64_t now_ns, h;
+
+	while (running)
+	{
+		if (held.empty())
+		{
+			cv.wait(lck);
+			continue;
+		}
+
+		// Without the time, wait out the longest hold
+		if (clock(now))
+		{
+			cv.wait_for(lck, std::chrono::nanoseconds(max_hold_ns));
+			if (running)
+				take_ready(INT64_MAX, 0, INT64_MIN, ready);
+		}
+		else
+		{
+			now_ns = (int64_t) TP_TO_nSEC(now.estimate);
+			h = horizon(now);
+			take_ready(now_ns, h, now_ns - (int64_t) TL_TO_nSEC(now.interval.below), ready);
+			if (ready.empty())
+			{
+				cv.wait_for(lck, std::chrono::nanoseconds(held.front().stamp + h - now_ns));
+				continue;
+			}
+		}
+		if (ready.empty())
+			continue;
+
+		// Deliver outside the lock, so that the transport thread keeps queueing
+		std::unique_lock<std::mutex> dlck(deliver_lock);
+		lck.unlock();
+		for (size_t i = 0; i < ready.size(); i++)
+			sink(ready[i].header, ready[i].msg);
+		ready.clear();
+		dlck.unlock();
+		lck.lock();
+	}
+}
+
+void MessageReorderer::stop_releaser()
+{
+	{
+		std::lock_guard<std::mutex> lck(lock);
+		if (!running)
+			return;
+		running = false;
+	}
+	cv.notify_all();
+	thread.join();
+}
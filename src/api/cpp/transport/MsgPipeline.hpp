@@ -0,0 +1,266 @@
+/**
+ * @file MsgPipeline.hpp
+ * @brief Batched publishing and queued delivery of timeline messages
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef MSG_PIPELINE_HPP
+#define MSG_PIPELINE_HPP
+
+// std library includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Transport interface
+#include "Transport.hpp"
+
+namespace qot
+{
+	// Convert between QoT messages and transport headers (the message data is the payload)
+	void MessageToHeader(const qot_message_t &msg, const std::string &name, TransportHeader &header);
+	void HeaderToMessage(const TransportHeader &header, const void *payload, size_t length, qot_message_t &msg);
+
+	// Timeline time with its uncertainty
+	typedef std::function<qot_return_t(utimepoint_t &now)> MessageClock;
+
+	// Latency stamps of a queued message, as in its transport header
+	struct MessageStamps {
+		int64_t published_ns;
+		int64_t handoff_ns;
+		int64_t stamp_unc_ns;
+	};
+
+	// Collects published messages and hands them to a transport a batch at a time
+	class MessageBatcher
+	{
+		// Constructor and destructor
+		// The transport must outlive the batcher; the destructor sends what is still pending
+		public: MessageBatcher(Transport &transport);
+		public: ~MessageBatcher();
+
+		// Set the batch size (up to QOT_MSG_MAX_BATCH_SIZE) and the flush interval (a batch size of 1
+		// sends each message at once)
+		public: qot_return_t Configure(uint32_t batch_size, uint32_t flush_us);
+
+		// Queue a message, sending the batch once it is full
+		public: qot_return_t Publish(const TransportHeader &header, const void *payload, size_t length);
+
+		// Send the pending messages now
+		public: qot_return_t Flush();
+
+		// Stamp messages in timeline time when they are published and handed to the
+		// transport, for the receivers to measure latency (an empty clock stops stamping)
+		public: void SetClock(MessageClock clock);
+
+		// Add the publishing counters to stats
+		public: void GetStats(qot_msg_stats_t &stats);
+
+		// A message waiting in a batch
+		private: struct Entry { TransportHeader header; std::vector<char> payload; };
+
+		// Send the pending messages, called with write_lock held
+		private: void write_pending(bool timed);
+
+		// Flush thread -> sends partial batches once their oldest message is flush_us old
+		private: void flusher();
+		private: void stop_flusher();
+
+		// Transport the batches are sent on
+		private: Transport &transport;
+
+		// Messages not sent yet and the time at which the oldest was queued. Entries
+		// are reused from batch to batch, count says how many are in use
+		private: std::vector<Entry> pending;
+		private: size_t pending_count;
+		private: std::vector<Entry> writing;		// Batch being sent (write_lock)
+		private: size_t writing_count;
+		private: std::chrono::steady_clock::time_point oldest;
+		private: uint32_t batch_size;
+		private: uint32_t flush_us;
+		private: MessageClock clock;
+
+		// Gathered pointers of the batch being sent (write_lock)
+		private: std::vector<TransportHeader> headers;
+		private: std::vector<const void *> payloads;
+		private: std::vector<size_t> lengths;
+
+		// lock guards the pending batch, write_lock keeps batches in order on the wire
+		private: std::mutex lock;
+		private: std::mutex write_lock;
+		private: std::condition_variable cv;
+		private: std::thread thread;
+		private: bool running;
+
+		// Counters
+		private: uint64_t published;
+		private: uint64_t batches;
+		private: uint64_t timed_flushes;
+	};
+
+	// Bounded lock-free queue between the transport thread and the application threads
+	class MessageQueue
+	{
+		// Constructor and destructor -> depth must be a power of two
+		public: MessageQueue(uint32_t depth, uint32_t block_us);
+		public: ~MessageQueue();
+
+		// Queue a burst of messages (transport thread), with their latency stamps if
+		// stamps is not NULL. A full queue is waited on for at most block_us, after
+		// which the rest of the burst is dropped
+		public: void Push(const qot_message_t *msgs, size_t count, const MessageStamps *stamps = NULL);
+
+		// Take up to max messages, and their stamps if stamps is not NULL, waiting up to
+		// timeout_ms for the first (-1 waits forever)
+		public: size_t Pop(qot_message_t *msgs, size_t max, int timeout_ms, MessageStamps *stamps = NULL);
+
+		// Add the delivery counters to stats
+		public: void GetStats(qot_msg_stats_t &stats);
+
+		// Single message operations, false when the queue is full or empty
+		private: bool try_push(const qot_message_t &msg, const MessageStamps &stamps);
+		private: bool try_pop(qot_message_t &msg, MessageStamps &stamps);
+		private: bool empty();
+
+		// Ring slots -> seq hands each slot between producers and consumers
+		private: struct Slot { std::atomic<uint64_t> seq; qot_message_t msg; MessageStamps stamps; };
+		private: std::unique_ptr<Slot[]> slots;
+		private: uint64_t mask;
+		private: uint32_t block_us;
+
+		// Ring positions, kept on their own cache lines
+		private: alignas(64) std::atomic<uint64_t> head;
+		private: alignas(64) std::atomic<uint64_t> tail;
+
+		// Sleeping consumers, only woken when there are any
+		private: alignas(64) std::atomic<int> waiters;
+		private: std::mutex lock;
+		private: std::condition_variable cv;
+
+		// Counters
+		private: std::atomic<uint64_t> received;
+		private: std::atomic<uint64_t> delivered;
+		private: std::atomic<uint64_t> dropped;
+		private: std::atomic<uint64_t> stalls;
+		private: std::atomic<uint32_t> max_depth;
+	};
+
+	// Holds received messages back and releases them in the timeline order they were
+	// published in. A message is released once no message published before it can
+	// still arrive: when the timeline has moved past its publish stamp by the sender
+	// and receiver uncertainty plus the latency bound observed so far (never more than
+	// max_hold_us). Messages the sender did not stamp are ordered by their timestamp,
+	// unless it lies in the future (an action time), in which case they pass straight
+	// through
+	class MessageReorderer
+	{
+		// Timeline time, and where released messages go (with the header they came with)
+		public: typedef MessageClock Clock;
+		public: typedef std::function<void(const TransportHeader &header, const qot_message_t &msg)> Sink;
+
+		// Constructor and destructor -> the destructor drops the messages still held
+		public: MessageReorderer(Clock clock, Sink sink);
+		public: ~MessageReorderer();
+
+		// Hold messages up to max_hold_us to order them (0 passes them straight through),
+		// keeping at most depth of them, and drop messages older than deadline_ns (0 keeps all)
+		public: qot_return_t Configure(uint32_t max_hold_us, uint32_t depth, uint64_t deadline_ns);
+
+		// Offer a received message (transport thread). Messages past the deadline, or
+		// stamped before one already released, are dropped before they are deserialized.
+		// Held messages which pass the deadline meanwhile are dropped when released
+		public: void Push(const TransportHeader &header, const void *payload, size_t length);
+
+		// Release all held messages now, in order
+		public: void Flush();
+
+		// Add the ordering counters to stats
+		public: void GetStats(qot_msg_stats_t &stats);
+
+		// A held message, ordered by its publish stamp (or timestamp when it has none)
+		// and the sender uncertainty of that stamp. Ties are broken by arrival
+		private: struct Held { int64_t stamp; int64_t unc; uint64_t seq; TransportHeader header; qot_message_t msg; };
+		private: struct Later { bool operator()(const Held &a, const Held &b) const
+			{ return a.stamp > b.stamp || (a.stamp == b.stamp && a.seq > b.seq); } };
+
+		// How long after its timestamp a message is released, called with lock held
+		private: int64_t horizon(const utimepoint_t &now);
+
+		// Whether a message is older than the deadline at the earliest possible time
+		// now (INT64_MIN when the time is not known), called with lock held
+		private: bool past_deadline(int64_t earliest_ns, int64_t stamp, int64_t unc);
+
+		// Take the earliest held message into ready, unless it has expired meanwhile
+		private: void release_first(int64_t earliest_ns, std::vector<Held> &ready);
+
+		// Take the messages whose time has come into ready, called with lock held
+		private: void take_ready(int64_t now_ns, int64_t horizon_ns, int64_t earliest_ns, std::vector<Held> &ready);
+
+		// Hand messages to the sink in order, dropping lck once they are lined up
+		private: void deliver(std::unique_lock<std::mutex> &lck, std::vector<Held> &ready);
+
+		// Release thread -> sleeps until the earliest held message is due
+		private: void releaser();
+		private: void stop_releaser();
+
+		private: Clock clock;
+		private: Sink sink;
+
+		// Configuration
+		private: int64_t max_hold_ns;
+		private: uint32_t depth;
+		private: int64_t deadline_ns;
+
+		// Held messages, earliest on top
+		private: std::vector<Held> held;
+		private: uint64_t arrivals;
+		private: int64_t newest;				// Latest timestamp which arrived
+		private: int64_t released;				// Latest timestamp released
+
+		// Smoothed latency and its mean deviation, and the sender uncertainty (ns)
+		private: int64_t latency;
+		private: int64_t latency_dev;
+		private: int64_t sender_unc;
+
+		// lock guards the held messages, deliver_lock keeps releases in order
+		private: std::mutex lock;
+		private: std::mutex deliver_lock;
+		private: std::condition_variable cv;
+		private: std::thread thread;
+		private: bool running;
+
+		// Counters
+		private: std::atomic<uint64_t> reordered;
+		private: std::atomic<uint64_t> late;
+		private: std::atomic<uint64_t> expired;
+		private: std::atomic<uint32_t> max_held;
+	};
+}
+
+#endif
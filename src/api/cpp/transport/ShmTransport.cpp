@@ -0,0 +1,436 @@
+/*
+ * @file ShmTransport.cpp
+ * @brief Zero-copy shared-memory transport between the processes of one host
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This file header */
+#include "ShmTransport.hpp"
+
+/* System includes */
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+// Segment format
+#define SHM_MAGIC        0x314d48535f544f51ULL	// "QOT_SHM1"
+#define SHM_VERSION      2
+#define SHM_DATA_OFFSET  256					// Ring data starts after the ring header
+#define SHM_RECORD_ALIGN 64						// Records start on cache lines
+#define SHM_RECORD_PAD   1						// Filler up to the end of the ring
+
+// Longest wait for the creator of a segment to initialize it, or for the last
+// user of a segment to remove it (milliseconds)
+#define SHM_OPEN_WAIT_MS 1000
+
+// Segments are private to the user running the timeline
+#define SHM_MODE         0600
+
+// Longest sleep of the receive thread between checks for termination (nanoseconds)
+#define SHM_IDLE_NS      100000000
+
+// Polls of an empty ring before the receive thread sleeps on it
+#define SHM_SPIN         2000
+
+using namespace qot;
+
+// Ring header, shared by every process mapping the segment
+struct ShmTransport::Ring {
+	uint64_t magic;				// Set last by the creator
+	uint32_t version;
+	uint32_t record_size;		// sizeof(Record), rejects segments of other builds
+	uint64_t size;				// Ring bytes, a power of two
+	uint64_t commits;			// Records committed so far
+	uint32_t users;				// Transports mapping the segment
+	uint32_t reserved;
+	uint8_t pad0[24];
+	uint64_t tail;				// Next free position, on a line of its own
+	uint8_t pad1[56];
+	uint32_t notify;			// Futex word, bumped on every commit
+	uint32_t waiters;			// Subscribers sleeping on notify
+};
+
+// Record header, followed by the payload. Positions grow without wrapping;
+// a record lives at its position modulo the ring size
+struct ShmTransport::Record {
+	uint64_t commit;			// Position of the record plus one, once complete
+	uint32_t bytes;				// Whole record, SHM_RECORD_ALIGN aligned
+	uint32_t flags;				// SHM_RECORD_PAD for filler up to the ring end
+	uint32_t length;			// Payload bytes
+	uint32_t reserved;
+	TransportHeader header;
+};
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__arm__) || defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+static inline long futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+ShmTransport::ShmTransport(const TransportConfig &config)
+	: config(config), segment(ShmSegmentName(config.timeline, config.topic)), ring(NULL), data(NULL),
+	  mapped(0), mask(0), stopping(false), sent(0), received(0), lost(0), errors(0)
+{
+}
+
+ShmTransport *ShmTransport::Open(const TransportConfig &config)
+{
+	ShmTransport *transport;
+	static_assert(sizeof(Ring) <= SHM_DATA_OFFSET, "ring header overlaps the ring");
+	if (config.shm_bytes < 4096 || (config.shm_bytes & (config.shm_bytes - 1)))
+		return NULL;
+	transport = new ShmTransport(config);
+	if (!transport->map())
+	{
+		delete transport;
+		return NULL;
+	}
+	return transport;
+}
+
+ShmTransport::~ShmTransport()
+{
+	if (thread.joinable())
+	{
+		stopping.store(true);
+		__atomic_fetch_add(&ring->notify, 1, __ATOMIC_SEQ_CST);
+		futex(&ring->notify, FUTEX_WAKE, INT_MAX, NULL);
+		thread.join();
+	}
+	// The last user removes the segment (one that crashed keeps it alive)
+	if (ring)
+	{
+		if (__atomic_sub_fetch(&ring->users, 1, __ATOMIC_ACQ_REL) == 0)
+			shm_unlink(segment.c_str());
+		munmap(ring, mapped);
+	}
+}
+
+bool ShmTransport::map()
+{
+	uint32_t users;
+	bool creator;
+	int i;
+
+	// A segment whose last user has left is about to be unlinked: wait for it
+	// to go and create a fresh one
+	for (i = 0; i < SHM_OPEN_WAIT_MS; i++)
+	{
+		if (!attach(creator))
+			return false;
+		if (creator)
+			return true;
+		users = __atomic_load_n(&ring->users, __ATOMIC_ACQUIRE);
+		while (users && !__atomic_compare_exchange_n(&ring->users, &users, users + 1, 1,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+		if (users)
+			return true;
+		munmap(ring, mapped);
+		ring = NULL;
+		usleep(1000);
+	}
+	return false;
+}
+
+bool ShmTransport::attach(bool &creator)
+{
+	struct stat st;
+	void *addr;
+	int fd, i;
+
+	// The first process to open the channel creates and sizes the segment
+	fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, SHM_MODE);
+	creator = (fd >= 0);
+	if (creator)
+	{
+		mapped = SHM_DATA_OFFSET + config.shm_bytes;
+		if (ftruncate(fd, mapped))
+		{
+			close(fd);
+			shm_unlink(segment.c_str());
+			return false;
+		}
+	}
+	else
+	{
+		if (errno != EEXIST)
+			return false;
+		fd = shm_open(segment.c_str(), O_RDWR, 0);
+		if (fd < 0)
+			return false;
+		for (i = 0; !fstat(fd, &st) && st.st_size < SHM_DATA_OFFSET; i++)
+		{
+			if (i == SHM_OPEN_WAIT_MS)
+				break;
+			usleep(1000);
+		}
+		mapped = st.st_size;
+	}
+	if (mapped < SHM_DATA_OFFSET)
+	{
+		close(fd);
+		return false;
+	}
+	addr = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		if (creator)
+			shm_unlink(segment.c_str());
+		return false;
+	}
+	ring = (Ring *) addr;
+	data = (char *) addr + SHM_DATA_OFFSET;
+
+	if (creator)
+	{
+		// The segment is zero-filled, so only the geometry needs writing; the
+		// creator counts as a user before any other process can see the ring
+		ring->version = SHM_VERSION;
+		ring->record_size = sizeof(Record);
+		ring->size = config.shm_bytes;
+		ring->users = 1;
+		__atomic_store_n(&ring->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+	}
+	else
+	{
+		for (i = 0; __atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC; i++)
+		{
+			if (i == SHM_OPEN_WAIT_MS)
+				break;
+			usleep(1000);
+		}
+		if (ring->magic != SHM_MAGIC || ring->version != SHM_VERSION || ring->record_size != sizeof(Record)
+			|| (ring->size & (ring->size - 1)) || SHM_DATA_OFFSET + ring->size != mapped)
+		{
+			munmap(ring, mapped);
+			ring = NULL;
+			return false;
+		}
+	}
+	mask = ring->size - 1;
+	return true;
+}
+
+ShmTransport::Record *ShmTransport::record_at(uint64_t position)
+{
+	return (Record *) (data + (position & mask));
+}
+
+size_t ShmTransport::MaxPayload()
+{
+	return ring->size / 4 - sizeof(Record);
+}
+
+qot_return_t ShmTransport::Reserve(size_t length, TransportBuffer &buffer)
+{
+	uint64_t pos, off, need, total;
+	Record *rec;
+
+	if (length > MaxPayload())
+		return QOT_RETURN_TYPE_ERR;
+	need = (sizeof(Record) + length + SHM_RECORD_ALIGN - 1) & ~((uint64_t) SHM_RECORD_ALIGN - 1);
+
+	// Claim the record, and the rest of the ring too if it does not fit before the end
+	pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	do
+	{
+		off = pos & mask;
+		total = (off + need > ring->size) ? ring->size - off + need : need;
+	}
+	while (!__atomic_compare_exchange_n(&ring->tail, &pos, pos + total, 1,
+		__ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	// Subscribers check the tail after reading a record; order the claim before
+	// the writes which may overwrite what a slow subscriber is reading
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if (total != need)
+	{
+		rec = record_at(pos);
+		rec->bytes = total - need;
+		rec->flags = SHM_RECORD_PAD;
+		rec->length = 0;
+		__atomic_store_n(&rec->commit, pos + 1, __ATOMIC_RELEASE);
+		pos += total - need;
+	}
+	rec = record_at(pos);
+	rec->bytes = need;
+	rec->flags = 0;
+	rec->length = length;
+
+	buffer.data = rec + 1;
+	buffer.length = length;
+	buffer.position = pos;
+	return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t ShmTransport::Commit(const TransportHeader &header, TransportBuffer &buffer)
+{
+	Record *rec = record_at(buffer.position);
+	rec->header = header;
+	__atomic_store_n(&rec->commit, buffer.position + 1, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&ring->commits, 1, __ATOMIC_RELAXED);
+	sent.fetch_add(1, std::memory_order_relaxed);
+
+	// Wake the subscribers only when some are asleep
+	__atomic_fetch_add(&ring->notify, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->waiters, __ATOMIC_SEQ_CST))
+		futex(&ring->notify, FUTEX_WAKE, INT_MAX, NULL);
+	return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t ShmTransport::Publish(const TransportHeader &header, const void *payload, size_t length)
+{
+	TransportBuffer buffer;
+	if (Reserve(length, buffer))
+	{
+		errors.fetch_add(1, std::memory_order_relaxed);
+		return QOT_RETURN_TYPE_ERR;
+	}
+	if (length)
+		memcpy(buffer.data, payload, length);
+	return Commit(header, buffer);
+}
+
+qot_return_t ShmTransport::Subscribe(TransportCallback callback)
+{
+	if (!callback || thread.joinable() || !(config.roles & TRANSPORT_ROLE_SUB))
+		return QOT_RETURN_TYPE_ERR;
+	this->callback = callback;
+
+	// Deliver what is published from now on
+	thread = std::thread(&ShmTransport::receiver, this,
+		__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE), __atomic_load_n(&ring->commits, __ATOMIC_ACQUIRE));
+	return QOT_RETURN_TYPE_OK;
+}
+
+void ShmTransport::receiver(uint64_t cursor, uint64_t base)
+{
+	struct timespec idle = { 0, SHM_IDLE_NS };
+	uint64_t tail, consumed = 0;
+	uint32_t seen, bytes, flags, length;
+	int spin = 0, spin_max = std::thread::hardware_concurrency() > 1 ? SHM_SPIN : 0;
+	std::vector<char> scratch(MaxPayload());
+	TransportHeader header;
+	Record *rec;
+	bool valid;
+
+	while (!stopping.load(std::memory_order_relaxed))
+	{
+		seen = __atomic_load_n(&ring->notify, __ATOMIC_ACQUIRE);
+		tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+		// Publishers went a whole ring past the cursor: skip what was overwritten
+		if (tail - cursor > ring->size)
+		{
+			uint64_t commits = __atomic_load_n(&ring->commits, __ATOMIC_ACQUIRE);
+			if (commits > base + consumed)
+				lost.fetch_add(commits - base - consumed, std::memory_order_relaxed);
+			base = commits;
+			consumed = 0;
+			cursor = tail;
+			continue;
+		}
+
+		// Sleep until the next commit when there is nothing committed to read
+		rec = record_at(cursor);
+		if (cursor == tail || __atomic_load_n(&rec->commit, __ATOMIC_ACQUIRE) != cursor + 1)
+		{
+			// Bursts arrive back to back, so poll a little before paying for a wake-up
+			// (unless the publishers need this CPU to make progress)
+			if (spin++ < spin_max)
+			{
+				cpu_relax();
+				continue;
+			}
+			spin = 0;
+			__atomic_fetch_add(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&ring->notify, __ATOMIC_SEQ_CST) == seen)
+				futex(&ring->notify, FUTEX_WAIT, seen, &idle);
+			__atomic_fetch_sub(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+
+		// Copy the record out, as a publisher may reuse its space at any time
+		bytes = rec->bytes;
+		flags = rec->flags;
+		length = rec->length;
+		valid = (flags & SHM_RECORD_PAD) || (length <= scratch.size()
+			&& bytes >= sizeof(Record) + length && bytes <= ring->size - (cursor & mask));
+		if (valid && !(flags & SHM_RECORD_PAD))
+		{
+			header = rec->header;
+			memcpy(scratch.data(), rec + 1, length);
+		}
+
+		// Only trust the copy if no publisher has claimed the record since
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&ring->tail, __ATOMIC_RELAXED) - cursor > ring->size)
+			continue;
+		if (flags & SHM_RECORD_PAD)
+		{
+			cursor += bytes;
+			continue;
+		}
+		if (!valid)
+		{
+			lost.fetch_add(1, std::memory_order_relaxed);
+			cursor = tail;
+			continue;
+		}
+
+		spin = 0;
+		consumed++;
+		if (config.receive_own || strncmp(header.name, config.node.c_str(), QOT_MAX_NAMELEN))
+		{
+			received.fetch_add(1, std::memory_order_relaxed);
+			callback(header, scratch.data(), length);
+		}
+		cursor += bytes;
+	}
+}
+
+void ShmTransport::GetStats(TransportStats &stats)
+{
+	stats.sent = sent.load(std::memory_order_relaxed);
+	stats.received = received.load(std::memory_order_relaxed);
+	stats.lost = lost.load(std::memory_order_relaxed);
+	stats.errors = errors.load(std::memory_order_relaxed);
+}
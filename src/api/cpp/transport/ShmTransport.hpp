@@ -0,0 +1,90 @@
+/**
+ * @file ShmTransport.hpp
+ * @brief Zero-copy shared-memory transport between the processes of one host
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SHM_TRANSPORT_HPP
+#define SHM_TRANSPORT_HPP
+
+#include <atomic>
+#include <thread>
+
+#include "Transport.hpp"
+
+namespace qot
+{
+	// A topic is one broadcast ring in a shared-memory segment. Publishers of
+	// every process claim space with a compare-and-swap on the ring tail and
+	// commit a record by stamping it with its position; each subscriber keeps
+	// its own cursor and copies each record out before delivering it.
+	// Subscribers that fall a whole ring behind lose what was overwritten
+	// instead of holding the publishers back. The last transport to close a
+	// segment removes it.
+	class ShmTransport : public Transport
+	{
+		// Map (creating if needed) the segment of a channel, NULL on failure
+		public: static ShmTransport *Open(const TransportConfig &config);
+		public: ~ShmTransport();
+
+		// Transport interface
+		public: qot_return_t Publish(const TransportHeader &header, const void *payload, size_t length);
+		public: qot_return_t Reserve(size_t length, TransportBuffer &buffer);
+		public: qot_return_t Commit(const TransportHeader &header, TransportBuffer &buffer);
+		public: qot_return_t Subscribe(TransportCallback callback);
+		public: size_t MaxPayload();
+		public: void GetStats(TransportStats &stats);
+
+		private: ShmTransport(const TransportConfig &config);
+		private: bool map();
+		private: bool attach(bool &creator);
+
+		// Receive thread -> follows the ring from the tail at subscription
+		private: void receiver(uint64_t cursor, uint64_t base);
+
+		// Segment layout (see ShmTransport.cpp)
+		private: struct Ring;
+		private: struct Record;
+		private: Record *record_at(uint64_t position);
+
+		private: TransportConfig config;
+		private: std::string segment;
+		private: Ring *ring;
+		private: char *data;
+		private: size_t mapped;
+		private: uint64_t mask;
+
+		// Receive side
+		private: TransportCallback callback;
+		private: std::thread thread;
+		private: std::atomic<bool> stopping;
+
+		// Counters
+		private: std::atomic<uint64_t> sent;
+		private: std::atomic<uint64_t> received;
+		private: std::atomic<uint64_t> lost;
+		private: std::atomic<uint64_t> errors;
+	};
+}
+
+#endif
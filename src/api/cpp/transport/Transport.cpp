@@ -0,0 +1,111 @@
+/*
+ * @file Transport.cpp
+ * @brief Transport interface underneath the timeline messaging layer
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This file header */
+#include "Transport.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "ShmTransport.hpp"
+#include "UdpTransport.hpp"
+
+// Default shared-memory ring size (bytes) and multicast port
+#define DEFAULT_SHM_BYTES (1 << 20)
+#define DEFAULT_UDP_PORT  47400
+
+using namespace qot;
+
+TransportConfig::TransportConfig()
+	: roles(TRANSPORT_ROLE_PUB | TRANSPORT_ROLE_SUB), receive_own(true), shm_bytes(DEFAULT_SHM_BYTES),
+	  udp_port(DEFAULT_UDP_PORT), udp_ttl(1)
+{
+}
+
+qot_return_t Transport::PublishBatch(const TransportHeader *headers, const void *const *payloads,
+	const size_t *lengths, size_t count)
+{
+	qot_return_t retval = QOT_RETURN_TYPE_OK;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (Publish(headers[i], payloads[i], lengths[i]))
+			retval = QOT_RETURN_TYPE_ERR;
+	}
+	return retval;
+}
+
+qot_return_t Transport::Reserve(size_t length, TransportBuffer &buffer)
+{
+	if (length > MaxPayload())
+		return QOT_RETURN_TYPE_ERR;
+	buffer.storage.resize(length);
+	buffer.data = buffer.storage.data();
+	buffer.length = length;
+	buffer.position = 0;
+	return QOT_RETURN_TYPE_OK;
+}
+
+qot_return_t Transport::Commit(const TransportHeader &header, TransportBuffer &buffer)
+{
+	return Publish(header, buffer.data, buffer.length);
+}
+
+TransportType qot::ResolveTransport(TransportType type)
+{
+	const char *name;
+	if (type != TRANSPORT_DEFAULT)
+		return type;
+	name = getenv("QOT_TRANSPORT");
+	if (name && !strcmp(name, "shm"))
+		return TRANSPORT_SHM;
+	if (name && !strcmp(name, "udp"))
+		return TRANSPORT_UDP;
+	return TRANSPORT_DDS;
+}
+
+Transport *qot::CreateTransport(TransportType type, const TransportConfig &config)
+{
+	switch (ResolveTransport(type)) {
+		case TRANSPORT_SHM :
+			return ShmTransport::Open(config);
+		case TRANSPORT_UDP :
+			return UdpTransport::Open(config);
+		default:
+			return NULL;
+	}
+}
+
+std::string qot::ShmSegmentName(const std::string &timeline, const std::string &topic)
+{
+	std::string name = "/qot_" + timeline + "_" + topic;
+	for (size_t i = 1; i < name.size(); i++)
+	{
+		if (name[i] == '/')
+			name[i] = '_';
+	}
+	return name;
+}
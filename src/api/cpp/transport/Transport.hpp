@@ -0,0 +1,144 @@
+/**
+ * @file Transport.hpp
+ * @brief Transport interface underneath the timeline messaging layer
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+// std library includes
+#include <functional>
+#include <string>
+#include <vector>
+
+// Include the QoT Data Types
+extern "C"
+{
+	#include "../../../qot_types.h"
+}
+
+namespace qot
+{
+	// Transports which can carry timeline messages
+	enum TransportType {
+		TRANSPORT_DEFAULT = (0),	// Named by QOT_TRANSPORT (dds, shm or udp), else DDS
+		TRANSPORT_DDS,				// OpenSplice DDS, needs the DDS install
+		TRANSPORT_SHM,				// Shared-memory ring between the processes of one host
+		TRANSPORT_UDP,				// UDP multicast on the LAN
+		TRANSPORT_NUM_TYPES			// Number of types
+	};
+
+	// What a channel is opened for
+	enum TransportRole {
+		TRANSPORT_ROLE_PUB = (1),	// Publishing
+		TRANSPORT_ROLE_SUB = (2),	// Subscribing
+	};
+
+	// Header of a message, carried next to its variable-size payload
+	struct TransportHeader {
+		char name[QOT_MAX_NAMELEN];		// Node which published the message
+		qot_msg_type_t type;			// Message type
+		utimepoint_t timestamp;			// Uncertain timestamp associated with the message
+		int64_t published_ns;			// Timeline time of the publish call (0 when not stamped)
+		int64_t handoff_ns;				// Timeline time the transport was handed the message
+		int64_t stamp_unc_ns;			// Uncertainty (above plus below) of those two stamps
+	};
+
+	// Receive callback, called on the transport's thread. The payload is only
+	// valid until the callback returns
+	typedef std::function<void(const TransportHeader &header, const void *payload, size_t length)> TransportCallback;
+
+	// Space for a payload reserved with Transport::Reserve
+	struct TransportBuffer {
+		void *data;						// Where the payload is written
+		size_t length;					// Bytes reserved
+		uint64_t position;				// Transport bookkeeping
+		std::vector<char> storage;		// Copy buffer of transports which cannot write in place
+	};
+
+	// Channel options (fields left at their defaults suit most channels)
+	struct TransportConfig {
+		TransportConfig();
+		std::string timeline;			// Timeline uuid, messages never cross timelines
+		std::string topic;				// Topic name
+		std::string node;				// Name of this node
+		int roles;						// TRANSPORT_ROLE_* flags
+		bool receive_own;				// Deliver the messages this node published
+		size_t shm_bytes;				// Shared-memory ring size, a power of two
+		std::string udp_group;			// Multicast group, empty derives one from the topic
+		uint16_t udp_port;				// Multicast port
+		std::string udp_iface;			// Address of the interface to use, empty for the default
+		int udp_ttl;					// Multicast hops
+	};
+
+	// Channel counters
+	struct TransportStats {
+		uint64_t sent;					// Messages published
+		uint64_t received;				// Messages delivered to the callback
+		uint64_t lost;					// Messages overwritten or malformed before delivery
+		uint64_t errors;				// Failed sends
+	};
+
+	// A channel carrying the messages of one topic of one timeline
+	class Transport
+	{
+		public: virtual ~Transport() {}
+
+		// Publish a message, copying its payload
+		public: virtual qot_return_t Publish(const TransportHeader &header, const void *payload, size_t length) = 0;
+
+		// Publish a batch of messages, in order
+		public: virtual qot_return_t PublishBatch(const TransportHeader *headers, const void *const *payloads,
+			const size_t *lengths, size_t count);
+
+		// Zero-copy publish: reserve space for a payload, write it, then commit it.
+		// Transports which cannot write in place reserve a copy buffer
+		public: virtual qot_return_t Reserve(size_t length, TransportBuffer &buffer);
+		public: virtual qot_return_t Commit(const TransportHeader &header, TransportBuffer &buffer);
+
+		// Start delivering the messages received on the channel
+		public: virtual qot_return_t Subscribe(TransportCallback callback) = 0;
+
+		// Let the transport hold messages up to budget_us to send them together
+		public: virtual void SetLatencyBudget(uint32_t budget_us) { (void) budget_us; }
+
+		// Largest payload of one message
+		public: virtual size_t MaxPayload() = 0;
+
+		// Get the channel counters
+		public: virtual void GetStats(TransportStats &stats) = 0;
+	};
+
+	// Resolve TRANSPORT_DEFAULT through the QOT_TRANSPORT environment variable
+	TransportType ResolveTransport(TransportType type);
+
+	// Open a shared-memory or UDP channel, NULL on failure (DDS channels are
+	// opened by the messaging library, which links against DDS)
+	Transport *CreateTransport(TransportType type, const TransportConfig &config);
+
+	// Name of the shared-memory segment of a channel (under /dev/shm)
+	std::string ShmSegmentName(const std::string &timeline, const std::string &topic);
+}
+
+#endif
@@ -0,0 +1,361 @@
+/*
+ * @file UdpTransport.cpp
+ * @brief Lightweight UDP multicast transport for the LAN
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This file header */
+#include "UdpTransport.hpp"
+
+/* System includes */
+#include <cerrno>
+#include <cstring>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Wire format
+#define UDP_MAGIC       0x51554431			// "QUD1"
+#define UDP_VERSION     2
+#define UDP_MAX_DGRAM   65507				// Largest IPv4 UDP payload
+
+// Datagrams read by one recvmmsg
+#define UDP_BURST       16
+
+using namespace qot;
+
+// Datagram header, big endian, followed by the payload
+struct __attribute__((packed)) UdpTransport::WireHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t type;					// qot_msg_type_t
+	uint64_t topic;					// Hash of the timeline and topic
+	int64_t estimate;				// Timestamp, nanoseconds (timeline times may be negative)
+	uint64_t above;					// Uncertainty above, nanoseconds
+	uint64_t below;					// Uncertainty below, nanoseconds
+	int64_t published;				// Publish and handoff stamps, nanoseconds
+	int64_t handoff;
+	int64_t stamp_unc;
+	uint32_t length;				// Payload bytes
+	char name[QOT_MAX_NAMELEN];		// Publishing node
+};
+
+// FNV-1a, stable across hosts and builds
+static uint64_t channel_hash(const std::string &timeline, const std::string &topic)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	std::string key = timeline + "/" + topic;
+	for (size_t i = 0; i < key.size(); i++)
+	{
+		hash ^= (uint8_t) key[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static uint64_t to_ns(const timelength_t &length)
+{
+	return (uint64_t) length.sec * nSEC_PER_SEC + length.asec / ASEC_PER_NSEC;
+}
+
+static void from_ns(timelength_t &length, uint64_t ns)
+{
+	length.sec = ns / nSEC_PER_SEC;
+	length.asec = (ns % nSEC_PER_SEC) * ASEC_PER_NSEC;
+}
+
+UdpTransport::UdpTransport(const TransportConfig &config)
+	: config(config), topic_id(channel_hash(config.timeline, config.topic)), tx_sock(-1), rx_sock(-1),
+	  stop_fd(-1), sent(0), received(0), lost(0), errors(0)
+{
+	memset(&group, 0, sizeof(group));
+	group.sin_family = AF_INET;
+	group.sin_port = htons(config.udp_port);
+	iface.s_addr = htonl(INADDR_ANY);
+}
+
+UdpTransport *UdpTransport::Open(const TransportConfig &config)
+{
+	UdpTransport *transport = new UdpTransport(config);
+	if (!transport->open_sender())
+	{
+		delete transport;
+		return NULL;
+	}
+	return transport;
+}
+
+UdpTransport::~UdpTransport()
+{
+	uint64_t one = 1;
+	if (thread.joinable())
+	{
+		if (write(stop_fd, &one, sizeof(one)) != sizeof(one))
+			shutdown(rx_sock, SHUT_RDWR);
+		thread.join();
+	}
+	if (stop_fd >= 0)
+		close(stop_fd);
+	if (rx_sock >= 0)
+		close(rx_sock);
+	if (tx_sock >= 0)
+		close(tx_sock);
+}
+
+bool UdpTransport::open_sender()
+{
+	unsigned char ttl = config.udp_ttl, loop = 1;
+
+	// Each topic gets its own administratively scoped group, so hosts only
+	// receive the topics they joined
+	if (config.udp_group.empty())
+		group.sin_addr.s_addr = htonl(0xefff0000 | (topic_id & 0xffff));
+	else if (inet_pton(AF_INET, config.udp_group.c_str(), &group.sin_addr) != 1)
+		return false;
+	if (!IN_MULTICAST(ntohl(group.sin_addr.s_addr)))
+		return false;
+	if (!config.udp_iface.empty() && inet_pton(AF_INET, config.udp_iface.c_str(), &iface) != 1)
+		return false;
+
+	if (!(config.roles & TRANSPORT_ROLE_PUB))
+		return true;
+	tx_sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (tx_sock < 0)
+		return false;
+	if (setsockopt(tx_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl))
+		|| setsockopt(tx_sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)))
+		return false;
+	if (!config.udp_iface.empty()
+		&& setsockopt(tx_sock, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)))
+		return false;
+	return true;
+}
+
+size_t UdpTransport::MaxPayload()
+{
+	return UDP_MAX_DGRAM - sizeof(WireHeader);
+}
+
+void UdpTransport::encode(WireHeader &wire, const TransportHeader &header, size_t length)
+{
+	wire.magic = htobe32(UDP_MAGIC);
+	wire.version = htobe16(UDP_VERSION);
+	wire.type = htobe16(header.type);
+	wire.topic = htobe64(topic_id);
+	wire.estimate = htobe64((uint64_t) TP_TO_nSEC(header.timestamp.estimate));
+	wire.above = htobe64(to_ns(header.timestamp.interval.above));
+	wire.below = htobe64(to_ns(header.timestamp.interval.below));
+	wire.published = htobe64(header.published_ns);
+	wire.handoff = htobe64(header.handoff_ns);
+	wire.stamp_unc = htobe64(header.stamp_unc_ns);
+	wire.length = htobe32(length);
+	strncpy(wire.name, header.name, QOT_MAX_NAMELEN);
+}
+
+qot_return_t UdpTransport::Publish(const TransportHeader &header, const void *payload, size_t length)
+{
+	return PublishBatch(&header, &payload, &length, 1);
+}
+
+qot_return_t UdpTransport::PublishBatch(const TransportHeader *headers, const void *const *payloads,
+	const size_t *lengths, size_t count)
+{
+	WireHeader wires[UDP_BURST];
+	struct iovec iovs[UDP_BURST][2];
+	struct mmsghdr msgs[UDP_BURST];
+	qot_return_t retval = QOT_RETURN_TYPE_OK;
+	size_t i, n, done = 0;
+	int ret;
+
+	if (tx_sock < 0)
+		return QOT_RETURN_TYPE_ERR;
+	while (done < count)
+	{
+		// One sendmmsg per burst of messages
+		memset(msgs, 0, sizeof(msgs));
+		for (n = 0; n < UDP_BURST && done + n < count; n++)
+		{
+			i = done + n;
+			if (lengths[i] > MaxPayload())
+				break;
+			encode(wires[n], headers[i], lengths[i]);
+			iovs[n][0].iov_base = &wires[n];
+			iovs[n][0].iov_len = sizeof(WireHeader);
+			iovs[n][1].iov_base = (void *) payloads[i];
+			iovs[n][1].iov_len = lengths[i];
+			msgs[n].msg_hdr.msg_name = &group;
+			msgs[n].msg_hdr.msg_namelen = sizeof(group);
+			msgs[n].msg_hdr.msg_iov = iovs[n];
+			msgs[n].msg_hdr.msg_iovlen = 2;
+		}
+		if (n == 0)
+		{
+			// Too large for a datagram
+			errors.fetch_add(1, std::memory_order_relaxed);
+			retval = QOT_RETURN_TYPE_ERR;
+			done++;
+			continue;
+		}
+		ret = sendmmsg(tx_sock, msgs, n, 0);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			errors.fetch_add(n, std::memory_order_relaxed);
+			retval = QOT_RETURN_TYPE_ERR;
+			done += n;
+			continue;
+		}
+		sent.fetch_add(ret, std::memory_order_relaxed);
+		done += ret;
+	}
+	return retval;
+}
+
+qot_return_t UdpTransport::Subscribe(TransportCallback callback)
+{
+	struct sockaddr_in addr;
+	struct ip_mreq mreq;
+	int one = 1, zero = 0;
+
+	if (!callback || thread.joinable() || !(config.roles & TRANSPORT_ROLE_SUB))
+		return QOT_RETURN_TYPE_ERR;
+	rx_sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (rx_sock < 0 || stop_fd < 0)
+		goto fail;
+
+	// Several subscribers of a host share the port, each joins the group
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = group.sin_port;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (setsockopt(rx_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))
+		|| bind(rx_sock, (struct sockaddr *) &addr, sizeof(addr)))
+		goto fail;
+
+	// Without this Linux delivers the groups joined by every socket on the port
+	setsockopt(rx_sock, IPPROTO_IP, IP_MULTICAST_ALL, &zero, sizeof(zero));
+	mreq.imr_multiaddr = group.sin_addr;
+	mreq.imr_interface = iface;
+	if (setsockopt(rx_sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)))
+		goto fail;
+
+	this->callback = callback;
+	thread = std::thread(&UdpTransport::receiver, this);
+	return QOT_RETURN_TYPE_OK;
+
+fail:
+	if (rx_sock >= 0)
+		close(rx_sock);
+	if (stop_fd >= 0)
+		close(stop_fd);
+	rx_sock = stop_fd = -1;
+	return QOT_RETURN_TYPE_ERR;
+}
+
+void UdpTransport::receiver()
+{
+	std::vector<char> buffers(UDP_BURST * UDP_MAX_DGRAM);
+	struct iovec iovs[UDP_BURST];
+	struct mmsghdr msgs[UDP_BURST];
+	struct pollfd fds[2];
+	TransportHeader header;
+	WireHeader *wire;
+	size_t length;
+	int i, n;
+
+	fds[0].fd = rx_sock;
+	fds[0].events = POLLIN;
+	fds[1].fd = stop_fd;
+	fds[1].events = POLLIN;
+	while (true)
+	{
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		if (fds[1].revents)
+			return;
+
+		// Drain the socket in bursts
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < UDP_BURST; i++)
+		{
+			iovs[i].iov_base = &buffers[i * UDP_MAX_DGRAM];
+			iovs[i].iov_len = UDP_MAX_DGRAM;
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		n = recvmmsg(rx_sock, msgs, UDP_BURST, MSG_DONTWAIT, NULL);
+		if (n <= 0)
+			continue;
+
+		for (i = 0; i < n; i++)
+		{
+			wire = (WireHeader *) iovs[i].iov_base;
+			if (msgs[i].msg_len < sizeof(WireHeader)
+				|| be32toh(wire->magic) != UDP_MAGIC || be16toh(wire->version) != UDP_VERSION)
+			{
+				lost.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+			// Another channel hashed onto the same group
+			if (be64toh(wire->topic) != topic_id)
+				continue;
+			length = be32toh(wire->length);
+			if (msgs[i].msg_len != sizeof(WireHeader) + length)
+			{
+				lost.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+			memcpy(header.name, wire->name, QOT_MAX_NAMELEN);
+			header.name[QOT_MAX_NAMELEN - 1] = '\0';
+			if (!config.receive_own && !strncmp(header.name, config.node.c_str(), QOT_MAX_NAMELEN))
+				continue;
+			header.type = (qot_msg_type_t) be16toh(wire->type);
+			TP_FROM_nSEC(header.timestamp.estimate, (int64_t) be64toh(wire->estimate));
+			from_ns(header.timestamp.interval.above, be64toh(wire->above));
+			from_ns(header.timestamp.interval.below, be64toh(wire->below));
+			header.published_ns = (int64_t) be64toh(wire->published);
+			header.handoff_ns = (int64_t) be64toh(wire->handoff);
+			header.stamp_unc_ns = (int64_t) be64toh(wire->stamp_unc);
+			received.fetch_add(1, std::memory_order_relaxed);
+			callback(header, wire + 1, length);
+		}
+	}
+}
+
+void UdpTransport::GetStats(TransportStats &stats)
+{
+	stats.sent = sent.load(std::memory_order_relaxed);
+	stats.received = received.load(std::memory_order_relaxed);
+	stats.lost = lost.load(std::memory_order_relaxed);
+	stats.errors = errors.load(std::memory_order_relaxed);
+}
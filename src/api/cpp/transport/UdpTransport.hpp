@@ -0,0 +1,86 @@
+/**
+ * @file UdpTransport.hpp
+ * @brief Lightweight UDP multicast transport for the LAN
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 	1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef UDP_TRANSPORT_HPP
+#define UDP_TRANSPORT_HPP
+
+#include <atomic>
+#include <thread>
+
+#include <netinet/in.h>
+
+#include "Transport.hpp"
+
+namespace qot
+{
+	// One datagram per message, sent to a multicast group derived from the
+	// timeline and topic unless one is configured. Delivery is best effort:
+	// there is no retransmission, datagrams lost on the way are simply missing.
+	class UdpTransport : public Transport
+	{
+		// Open the sending socket of a channel, NULL on failure
+		public: static UdpTransport *Open(const TransportConfig &config);
+		public: ~UdpTransport();
+
+		// Transport interface
+		public: qot_return_t Publish(const TransportHeader &header, const void *payload, size_t length);
+		public: qot_return_t PublishBatch(const TransportHeader *headers, const void *const *payloads,
+			const size_t *lengths, size_t count);
+		public: qot_return_t Subscribe(TransportCallback callback);
+		public: size_t MaxPayload();
+		public: void GetStats(TransportStats &stats);
+
+		private: UdpTransport(const TransportConfig &config);
+		private: bool open_sender();
+
+		// Receive thread -> reads bursts of datagrams with recvmmsg
+		private: void receiver();
+
+		// Wire header (see UdpTransport.cpp)
+		private: struct WireHeader;
+		private: void encode(WireHeader &wire, const TransportHeader &header, size_t length);
+
+		private: TransportConfig config;
+		private: uint64_t topic_id;			// Hash of the timeline and topic, checked on receipt
+		private: struct sockaddr_in group;	// Destination of the messages
+		private: struct in_addr iface;		// Interface to send and join on
+		private: int tx_sock;
+		private: int rx_sock;
+		private: int stop_fd;				// eventfd which ends the receive thread
+
+		// Receive side
+		private: TransportCallback callback;
+		private: std::thread thread;
+
+		// Counters
+		private: std::atomic<uint64_t> sent;
+		private: std::atomic<uint64_t> received;
+		private: std::atomic<uint64_t> lost;
+		private: std::atomic<uint64_t> errors;
+	};
+}
+
+#endif
@@ -0,0 +1,152 @@
+#
+# @file __init__.py
+# @brief Python bindings for the QoT Stack, with NumPy batch conversions
+# @author Sandeep D'souza
+#
+# Copyright (c) Carnegie Mellon University 2018.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#  1. Redistributions of source code must retain the above copyright notice,
+#     this list of conditions and the following disclaimer.
+#  2. Redistributions in binary form must reproduce the above copyright notice,
+#     this list of conditions and the following disclaimer in the documentation
+#     and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+
+"""Python bindings for the QoT Stack.
+
+All times are integer nanoseconds. Conversions take and return NumPy int64
+arrays; a contiguous int64 input is passed to the native library without a
+copy and the whole array is converted with a single translation snapshot.
+"""
+
+from collections import namedtuple
+
+import numpy as np
+
+from . import _qot
+from ._qot import (QoTError, EVENT_TIMELINE_CREATE, EVENT_CLOCK_CREATE,
+                   EVENT_EXTERNAL_TIMESTAMP, EVENT_PWM_START, EVENT_TIMER_CALLBACK)
+
+# An uncertain point in time: estimate and the distances below/above it (ns)
+UTime = namedtuple('UTime', ['estimate', 'below', 'above'])
+
+# Layout of the arrays returned by Timeline.read_events
+EVENT_DTYPE = np.dtype([('type', np.int64), ('estimate', np.int64),
+                        ('below', np.int64), ('above', np.int64)])
+
+
+def _ns_array(values):
+    """View the input as a contiguous int64 array, copying only if needed"""
+    return np.ascontiguousarray(values, dtype=np.int64)
+
+
+class Timeline(object):
+    """A binding to a QoT timeline
+
+    with Timeline('my_timeline') as tl:
+        core = ...                                  # int64 core timestamps
+        t, upper, lower = tl.core_to_timeline(core)
+    """
+
+    def __init__(self, uuid=None, name='python', resolution_ns=1,
+                 accuracy_ns=(1000, 1000)):
+        self._tl = _qot.Timeline()
+        if uuid is not None:
+            self.bind(uuid, name, resolution_ns, accuracy_ns)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+        return False
+
+    def bind(self, uuid, name='python', resolution_ns=1, accuracy_ns=(1000, 1000)):
+        below, above = accuracy_ns
+        self._tl.bind(uuid, name, int(resolution_ns), int(below), int(above))
+
+    def unbind(self):
+        self._tl.unbind()
+
+    def close(self):
+        """Unbind and release the handle (QoTError while another thread is in a call on it)"""
+        self._tl.close()
+
+    def now(self):
+        """Timeline time now as a UTime"""
+        return UTime(*self._tl.gettime())
+
+    def core_now(self):
+        """Core time now as a UTime"""
+        return UTime(*self._tl.getcoretime())
+
+    def wait_until(self, when_ns):
+        """Block (without holding the GIL) until a timeline time"""
+        return UTime(*self._tl.waituntil(int(when_ns)))
+
+    def set_period(self, period_ns, start_ns=0):
+        self._tl.set_schedparams(int(period_ns), int(start_ns))
+
+    def wait_next_period(self):
+        return UTime(*self._tl.waituntil_nextperiod())
+
+    def parameters(self):
+        """Translation parameters currently in force"""
+        return self._tl.get_parameters()
+
+    def core_to_timeline(self, core_ns, bounds=True, out=None):
+        """Convert core times to timeline times
+
+        Returns the timeline times, or (times, upper, lower) when bounds is
+        True. Passing out=core_ns converts in place.
+        """
+        core = _ns_array(core_ns)
+        flat = core.reshape(-1)
+        tl = np.empty_like(flat) if out is None else _ns_array(out).reshape(-1)
+        if bounds:
+            upper = np.empty_like(flat)
+            lower = np.empty_like(flat)
+            self._tl.core2rem_into(flat, tl, upper, lower)
+            return (tl.reshape(core.shape), upper.reshape(core.shape),
+                    lower.reshape(core.shape))
+        self._tl.core2rem_into(flat, tl)
+        return tl.reshape(core.shape)
+
+    def timeline_to_core(self, tl_ns, out=None):
+        """Convert timeline times to core times"""
+        tl = _ns_array(tl_ns)
+        flat = tl.reshape(-1)
+        core = np.empty_like(flat) if out is None else _ns_array(out).reshape(-1)
+        self._tl.rem2core_into(flat, core)
+        return core.reshape(tl.shape)
+
+    def read_events(self, max_events=1024, timeout_ms=0):
+        """Drain queued events into a structured array (see EVENT_DTYPE)
+
+        timeout_ms bounds the wait for the first event; -1 blocks.
+        """
+        cols = np.empty((4, max_events), dtype=np.int64)
+        n = self._tl.read_events_into(cols[0], cols[1], cols[2], cols[3], timeout_ms)
+        events = np.empty(n, dtype=EVENT_DTYPE)
+        for i, field in enumerate(EVENT_DTYPE.names):
+            events[field] = cols[i, :n]
+        return events
+
+    def read_event_records(self, max_events=64, timeout_ms=0):
+        """Drain queued events as tuples, including their data strings"""
+        return self._tl.read_events(max_events, timeout_ms)
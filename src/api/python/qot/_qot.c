@@ -0,0 +1,571 @@
+/*
+ * @file _qot.c
+ * @brief CPython extension wrapping the QoT Stack C API
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+/* System includes */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* QoT API */
+#include "qot.h"
+
+static PyObject *QoTError;
+
+typedef struct {
+    PyObject_HEAD
+    timeline_t *timeline;
+    int busy;                   /* Calls running on the handle without the GIL */
+} TimelineObject;
+
+/* Raise QoTError for a failed API call, keeping errno when the kernel set one */
+static PyObject *qotpy_error(const char *what, qot_return_t retval)
+{
+    if (errno)
+        return PyErr_Format(QoTError, "%s failed (%d): %s", what, (int) retval, strerror(errno));
+    return PyErr_Format(QoTError, "%s failed (%d)", what, (int) retval);
+}
+
+static PyObject *qotpy_utimepoint(const utimepoint_t *utp)
+{
+    return Py_BuildValue("(LLL)", (long long) TP_TO_nSEC(utp->estimate),
+        (long long) TL_TO_nSEC(utp->interval.below),
+        (long long) TL_TO_nSEC(utp->interval.above));
+}
+
+/* Borrow a 1-D contiguous buffer of native 64-bit integers (e.g. a NumPy int64 array) */
+static int qotpy_get_ns_buffer(PyObject *obj, Py_buffer *view, int writable, const char *what)
+{
+    const char *fmt;
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+    if (writable)
+        flags |= PyBUF_WRITABLE;
+    if (PyObject_GetBuffer(obj, view, flags) < 0)
+        return -1;
+    fmt = view->format ? view->format : "B";
+    if (*fmt == '@' || *fmt == '=' || *fmt == '<')
+        fmt++;
+    if (view->ndim > 1 || view->itemsize != sizeof(s64)
+        || (strcmp(fmt, "l") && strcmp(fmt, "q"))) {
+        PyBuffer_Release(view);
+        PyErr_Format(PyExc_TypeError, "%s must be a contiguous 1-D int64 buffer", what);
+        return -1;
+    }
+    return 0;
+}
+
+static int qotpy_check_len(Py_buffer *view, Py_ssize_t n, const char *what)
+{
+    if (view->len / view->itemsize != n) {
+        PyErr_Format(PyExc_ValueError, "%s must have the same length as the input", what);
+        return -1;
+    }
+    return 0;
+}
+
+static int qotpy_check_bound(TimelineObject *self)
+{
+    if (!self->timeline) {
+        PyErr_SetString(QoTError, "timeline has been closed");
+        return -1;
+    }
+    return 0;
+}
+
+/* Bindings belong to the thread which made them, so unbind and close refuse a handle
+   which another thread is using without the GIL instead of pulling it from under the call */
+static int qotpy_check_idle(TimelineObject *self)
+{
+    if (self->busy) {
+        PyErr_SetString(QoTError, "timeline is in use by another thread");
+        return -1;
+    }
+    return 0;
+}
+
+/* Mark the handle in use before releasing the GIL (the count is only touched with the GIL held) */
+static void qotpy_enter(TimelineObject *self)
+{
+    self->busy++;
+}
+
+static void qotpy_leave(TimelineObject *self)
+{
+    self->busy--;
+}
+
+static PyObject *Timeline_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    (void) args;
+    (void) kwds;
+    TimelineObject *self = (TimelineObject *) type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->timeline = timeline_t_create();
+    if (!self->timeline) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *) self;
+}
+
+static void Timeline_dealloc(TimelineObject *self)
+{
+    if (self->timeline) {
+        timeline_unbind(self->timeline);
+        timeline_t_destroy(self->timeline);
+    }
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *Timeline_bind(TimelineObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"uuid", "name", "resolution_ns", "below_ns", "above_ns", NULL};
+    const char *uuid, *name = "python";
+    long long res_ns = 1, below_ns = 1000, above_ns = 1000;
+    timelength_t res;
+    timeinterval_t acc;
+    qot_return_t retval;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|sLLL", kwlist, &uuid, &name,
+        &res_ns, &below_ns, &above_ns))
+        return NULL;
+    if (qotpy_check_bound(self))
+        return NULL;
+    TL_FROM_nSEC(res, res_ns);
+    TL_FROM_nSEC(acc.below, below_ns);
+    TL_FROM_nSEC(acc.above, above_ns);
+    errno = 0;
+    qotpy_enter(self);
+    Py_BEGIN_ALLOW_THREADS
+    retval = timeline_bind(self->timeline, uuid, name, res, acc);
+    Py_END_ALLOW_THREADS
+    qotpy_leave(self);
+    if (retval != QOT_RETURN_TYPE_OK)
+        return qotpy_error("timeline_bind", retval);
+    Py_RETURN_NONE;
+}
+
+static PyObject *Timeline_unbind(TimelineObject *self, PyObject *unused)
+{
+    qot_return_t retval;
+    (void) unused;
+    if (qotpy_check_bound(self) || qotpy_check_idle(self))
+        return NULL;
+    errno = 0;
+    retval = timeline_unbind(self->timeline);
+    if (retval != QOT_RETURN_TYPE_OK)
+        return qotpy_error("timeline_unbind", retval);
+    Py_RETURN_NONE;
+}
+
+static PyObject *Timeline_close(TimelineObject *self, PyObject *unused)
+{
+    (void) unused;
+    if (qotpy_check_idle(self))
+        return NULL;
+    if (self->timeline) {
+        timeline_unbind(self->timeline);
+        timeline_t_destroy(self->timeline);
+        self->timeline = NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *Timeline_gettime(TimelineObject *self, PyObject *unused)
+{
+    (void) unused;
+    utimepoint_t utp;
+    qot_return_t retval;
+    if (qotpy_check_bound(self))
+        return NULL;
+    errno = 0;
+    retval = timeline_gettime(self->timeline, &utp);
+    if (retval != QOT_RETURN_TYPE_OK)
+        return qotpy_error("timeline_gettime", retval);
+    return qotpy_utimepoint(&utp);
+}
+
+static PyObject *Timeline_getcoretime(TimelineObject *self, PyObject *unused)
+{
+    (void) unused;
+    utimepoint_t utp;
+    qot_return_t retval;
+    if (qotpy_check_bound(self))
+        return NULL;
+    errno = 0;
+    retval = timeline_getcoretime(self->timeline, &utp);
+    if (retval != QOT_RETURN_TYPE_OK)
+        return qotpy_error("timeline_getcoretime", retval);
+    return qotpy_utimepoint(&utp);
+}
+
+static PyObject *Timeline_waituntil(TimelineObject *self, PyObject *args)
+{
+    long long when_ns;
+    utimepoint_t utp;
+    qot_return_t retval;
+    if (!PyArg_ParseTuple(args, "L", &when_ns))
+        return NULL;
+    if (qotpy_check_bound(self))
+        return NULL;
+    memset(&utp, 0, sizeof(utp));
+    TP_FROM_nSEC(utp.estimate, when_ns);
+    errno = 0;
+    qotpy_enter(self);
+    Py_BEGIN_ALLOW_THREADS
+    retval = timeline_waituntil(self->timeline, &utp);
+    Py_END_ALLOW_THREADS
+    qotpy_leave(self);
+    if (retval != QOT_RETURN_TYPE_OK)
+        return qotpy_error("timeline_waituntil", retval);
+    return qotpy_utimepoint(&utp);
+}
+
+static PyObject *Timeline_set_schedparams(TimelineObject *self, PyObject *args)
+{
+    long long period_ns, start_ns = 0;
+    timelength_t period;
+    timepoint_t start;
+    qot_return_t retval;
+    if (!PyArg_ParseTuple(args, "L|L", &period_ns, &start_ns))
+        return NULL;
+    if (qotpy_check_bound(self))
+        return NULL;
+    TL_FROM_nSEC(period, period_ns);
+    TP_FROM_nSEC(start, start_ns);
+    errno = 0;
+    retval = timeline_set_schedparams(self->timeline, &period, &start);
+    if (retval != QOT_RETURN_TYPE_OK)
+        return qotpy_error("timeline_set_schedparams", retval);
+    Py_RETURN_NONE;
+}
+
+static PyObject *Timeline_waituntil_nextperiod(TimelineObject *self, PyObject *unused)
+{
+    utimepoint_t utp;
+    qot_return_t retval;
+    (void) unused;
+    if (qotpy_check_bound(self))
+        return NULL;
+    memset(&utp, 0, sizeof(utp));
+    errno = 0;
+    qotpy_enter(self);
+    Py_BEGIN_ALLOW_THREADS
+    retval = timeline_waituntil_nextperiod(self->timeline, &utp);
+    Py_END_ALLOW_THREADS
+    qotpy_leave(self);
+    if (retval != QOT_RETURN_TYPE_OK)
+        return qotpy_error("timeline_waituntil_nextperiod", retval);
+    return qotpy_utimepoint(&utp);
+}
+
+static PyObject *Timeline_get_parameters(TimelineObject *self, PyObject *unused)
+{
+    (void) unused;
+    tl_translation_t p;
+    qot_return_t retval;
+    if (qotpy_check_bound(self))
+        return NULL;
+    errno = 0;
+    retval = timeline_get_parameters(self->timeline, &p);
+    if (retval != QOT_RETURN_TYPE_OK)
+        return qotpy_error("timeline_get_parameters", retval);
+    return Py_BuildValue("{sLsLsLsLsLsLsLsLsL}",
+        "last", (long long) p.last, "mult", (long long) p.mult,
+        "nsec", (long long) p.nsec, "u_nsec", (long long) p.u_nsec,
+        "l_nsec", (long long) p.l_nsec, "u_mult", (long long) p.u_mult,
+        "l_mult", (long long) p.l_mult, "u_pow", (long long) p.u_pow,
+        "l_pow", (long long) p.l_pow);
+}
+
+static PyObject *Timeline_core2rem_into(TimelineObject *self, PyObject *args)
+{
+    PyObject *core_obj, *tl_obj, *upper_obj = Py_None, *lower_obj = Py_None;
+    Py_buffer core, tl, upper, lower;
+    int have_upper = 0, have_lower = 0;
+    Py_ssize_t n;
+    qot_return_t retval;
+    PyObject *result = NULL;
+    if (!PyArg_ParseTuple(args, "OO|OO", &core_obj, &tl_obj, &upper_obj, &lower_obj))
+        return NULL;
+    if (qotpy_check_bound(self))
+        return NULL;
+    if (qotpy_get_ns_buffer(core_obj, &core, 0, "core"))
+        return NULL;
+    if (qotpy_get_ns_buffer(tl_obj, &tl, 1, "tl"))
+        goto release_core;
+    n = core.len / core.itemsize;
+    if (qotpy_check_len(&tl, n, "tl"))
+        goto release_tl;
+    if (upper_obj != Py_None) {
+        if (qotpy_get_ns_buffer(upper_obj, &upper, 1, "upper"))
+            goto release_tl;
+        have_upper = 1;
+        if (qotpy_check_len(&upper, n, "upper"))
+            goto release_bounds;
+    }
+    if (lower_obj != Py_None) {
+        if (qotpy_get_ns_buffer(lower_obj, &lower, 1, "lower"))
+            goto release_bounds;
+        have_lower = 1;
+        if (qotpy_check_len(&lower, n, "lower"))
+            goto release_bounds;
+    }
+    errno = 0;
+    qotpy_enter(self);
+    Py_BEGIN_ALLOW_THREADS
+    retval = timeline_core2rem_n(self->timeline, (const s64 *) core.buf, (s64 *) tl.buf,
+        have_upper ? (s64 *) upper.buf : NULL, have_lower ? (s64 *) lower.buf : NULL,
+        (size_t) n);
+    Py_END_ALLOW_THREADS
+    qotpy_leave(self);
+    if (retval != QOT_RETURN_TYPE_OK) {
+        qotpy_error("timeline_core2rem_n", retval);
+        goto release_bounds;
+    }
+    result = PyLong_FromSsize_t(n);
+release_bounds:
+    if (have_lower)
+        PyBuffer_Release(&lower);
+    if (have_upper)
+        PyBuffer_Release(&upper);
+release_tl:
+    PyBuffer_Release(&tl);
+release_core:
+    PyBuffer_Release(&core);
+    return result;
+}
+
+static PyObject *Timeline_rem2core_into(TimelineObject *self, PyObject *args)
+{
+    PyObject *tl_obj, *core_obj;
+    Py_buffer tl, core;
+    Py_ssize_t n;
+    qot_return_t retval;
+    PyObject *result = NULL;
+    if (!PyArg_ParseTuple(args, "OO", &tl_obj, &core_obj))
+        return NULL;
+    if (qotpy_check_bound(self))
+        return NULL;
+    if (qotpy_get_ns_buffer(tl_obj, &tl, 0, "tl"))
+        return NULL;
+    if (qotpy_get_ns_buffer(core_obj, &core, 1, "core"))
+        goto release_tl;
+    n = tl.len / tl.itemsize;
+    if (qotpy_check_len(&core, n, "core"))
+        goto release_core;
+    errno = 0;
+    qotpy_enter(self);
+    Py_BEGIN_ALLOW_THREADS
+    retval = timeline_rem2core_n(self->timeline, (const s64 *) tl.buf, (s64 *) core.buf,
+        (size_t) n);
+    Py_END_ALLOW_THREADS
+    qotpy_leave(self);
+    if (retval != QOT_RETURN_TYPE_OK) {
+        qotpy_error("timeline_rem2core_n", retval);
+        goto release_core;
+    }
+    result = PyLong_FromSsize_t(n);
+release_core:
+    PyBuffer_Release(&core);
+release_tl:
+    PyBuffer_Release(&tl);
+    return result;
+}
+
+/* Drain up to max events with one native call, releasing the GIL while waiting */
+static int qotpy_read_events(TimelineObject *self, qot_event_t **events, Py_ssize_t max,
+    int timeout_ms)
+{
+    int count;
+    if (max <= 0) {
+        PyErr_SetString(PyExc_ValueError, "max_events must be positive");
+        return -1;
+    }
+    *events = PyMem_RawMalloc((size_t) max * sizeof(qot_event_t));
+    if (!*events) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    errno = 0;
+    qotpy_enter(self);
+    Py_BEGIN_ALLOW_THREADS
+    count = timeline_read_events_n(self->timeline, *events, (size_t) max, timeout_ms);
+    Py_END_ALLOW_THREADS
+    qotpy_leave(self);
+    if (count < 0) {
+        PyMem_RawFree(*events);
+        *events = NULL;
+        qotpy_error("timeline_read_events_n", QOT_RETURN_TYPE_ERR);
+        return -1;
+    }
+    return count;
+}
+
+static PyObject *Timeline_read_events(TimelineObject *self, PyObject *args)
+{
+    Py_ssize_t max = 64, i;
+    int timeout_ms = 0, count;
+    qot_event_t *events;
+    PyObject *list;
+    if (!PyArg_ParseTuple(args, "|ni", &max, &timeout_ms))
+        return NULL;
+    if (qotpy_check_bound(self))
+        return NULL;
+    count = qotpy_read_events(self, &events, max, timeout_ms);
+    if (count < 0)
+        return NULL;
+    list = PyList_New(count);
+    for (i = 0; list && i < count; i++) {
+        PyObject *item = Py_BuildValue("(iLLLs)", (int) events[i].type,
+            (long long) TP_TO_nSEC(events[i].timestamp.estimate),
+            (long long) TL_TO_nSEC(events[i].timestamp.interval.below),
+            (long long) TL_TO_nSEC(events[i].timestamp.interval.above),
+            events[i].data);
+        if (!item) {
+            Py_CLEAR(list);
+            break;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    PyMem_RawFree(events);
+    return list;
+}
+
+static PyObject *Timeline_read_events_into(TimelineObject *self, PyObject *args)
+{
+    PyObject *objs[4];
+    Py_buffer views[4];
+    static const char *names[4] = {"types", "estimate", "below", "above"};
+    int timeout_ms = 0, count = -1, got = 0, i;
+    Py_ssize_t max;
+    qot_event_t *events;
+    if (!PyArg_ParseTuple(args, "OOOO|i", &objs[0], &objs[1], &objs[2], &objs[3], &timeout_ms))
+        return NULL;
+    if (qotpy_check_bound(self))
+        return NULL;
+    for (; got < 4; got++)
+        if (qotpy_get_ns_buffer(objs[got], &views[got], 1, names[got]))
+            goto release;
+    max = views[0].len / views[0].itemsize;
+    for (i = 1; i < 4; i++)
+        if (qotpy_check_len(&views[i], max, names[i]))
+            goto release;
+    count = qotpy_read_events(self, &events, max, timeout_ms);
+    if (count < 0)
+        goto release;
+    for (i = 0; i < count; i++) {
+        ((s64 *) views[0].buf)[i] = events[i].type;
+        ((s64 *) views[1].buf)[i] = TP_TO_nSEC(events[i].timestamp.estimate);
+        ((s64 *) views[2].buf)[i] = TL_TO_nSEC(events[i].timestamp.interval.below);
+        ((s64 *) views[3].buf)[i] = TL_TO_nSEC(events[i].timestamp.interval.above);
+    }
+    PyMem_RawFree(events);
+release:
+    while (got-- > 0)
+        PyBuffer_Release(&views[got]);
+    if (count < 0)
+        return NULL;
+    return PyLong_FromLong(count);
+}
+
+static PyMethodDef Timeline_methods[] = {
+    {"bind", (PyCFunction) (void (*)(void)) Timeline_bind, METH_VARARGS | METH_KEYWORDS,
+        "bind(uuid, name='python', resolution_ns=1, below_ns=1000, above_ns=1000)\n"
+        "Bind to a timeline, creating it if it does not exist."},
+    {"unbind", (PyCFunction) Timeline_unbind, METH_NOARGS, "Unbind from the timeline."},
+    {"close", (PyCFunction) Timeline_close, METH_NOARGS,
+        "Unbind and release the native timeline handle."},
+    {"gettime", (PyCFunction) Timeline_gettime, METH_NOARGS,
+        "Timeline time now as (estimate_ns, below_ns, above_ns)."},
+    {"getcoretime", (PyCFunction) Timeline_getcoretime, METH_NOARGS,
+        "Core time now as (estimate_ns, below_ns, above_ns)."},
+    {"waituntil", (PyCFunction) Timeline_waituntil, METH_VARARGS,
+        "waituntil(when_ns) -> (estimate_ns, below_ns, above_ns) at wake-up."},
+    {"set_schedparams", (PyCFunction) Timeline_set_schedparams, METH_VARARGS,
+        "set_schedparams(period_ns, start_ns=0)"},
+    {"waituntil_nextperiod", (PyCFunction) Timeline_waituntil_nextperiod, METH_NOARGS,
+        "Block until the next period boundary; returns the wake-up time."},
+    {"get_parameters", (PyCFunction) Timeline_get_parameters, METH_NOARGS,
+        "Translation parameters between core time and the timeline."},
+    {"core2rem_into", (PyCFunction) Timeline_core2rem_into, METH_VARARGS,
+        "core2rem_into(core, tl, upper=None, lower=None) -> n\n"
+        "Convert int64 core times (ns) to timeline times and bounds in place."},
+    {"rem2core_into", (PyCFunction) Timeline_rem2core_into, METH_VARARGS,
+        "rem2core_into(tl, core) -> n\n"
+        "Convert int64 timeline times (ns) to core times in place."},
+    {"read_events", (PyCFunction) Timeline_read_events, METH_VARARGS,
+        "read_events(max_events=64, timeout_ms=0) -> [(type, estimate_ns, below_ns, above_ns, data)]"},
+    {"read_events_into", (PyCFunction) Timeline_read_events_into, METH_VARARGS,
+        "read_events_into(types, estimate, below, above, timeout_ms=0) -> n\n"
+        "Drain queued events into int64 buffers sized to the maximum to read."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject TimelineType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "qot._qot.Timeline",
+    .tp_basicsize = sizeof(TimelineObject),
+    .tp_dealloc = (destructor) Timeline_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_doc = "Native QoT timeline handle",
+    .tp_methods = Timeline_methods,
+    .tp_new = Timeline_new,
+};
+
+static struct PyModuleDef qot_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "qot._qot",
+    .m_doc = "Native bindings for the QoT Stack",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit__qot(void)
+{
+    PyObject *m;
+    if (PyType_Ready(&TimelineType) < 0)
+        return NULL;
+    m = PyModule_Create(&qot_module);
+    if (!m)
+        return NULL;
+    QoTError = PyErr_NewException("qot.QoTError", PyExc_OSError, NULL);
+    Py_INCREF(QoTError);
+    PyModule_AddObject(m, "QoTError", QoTError);
+    Py_INCREF(&TimelineType);
+    PyModule_AddObject(m, "Timeline", (PyObject *) &TimelineType);
+    PyModule_AddIntConstant(m, "EVENT_TIMELINE_CREATE", QOT_EVENT_TIMELINE_CREATE);
+    PyModule_AddIntConstant(m, "EVENT_CLOCK_CREATE", QOT_EVENT_CLOCK_CREATE);
+    PyModule_AddIntConstant(m, "EVENT_EXTERNAL_TIMESTAMP", QOT_EVENT_EXTERNAL_TIMESTAMP);
+    PyModule_AddIntConstant(m, "EVENT_PWM_START", QOT_EVENT_PWM_START);
+    PyModule_AddIntConstant(m, "EVENT_TIMER_CALLBACK", QOT_EVENT_TIMER_CALLBACK);
+    return m;
+}
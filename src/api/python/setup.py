@@ -0,0 +1,54 @@
+#
+# @file setup.py
+# @brief Build script for the QoT Stack Python bindings
+# @author Sandeep D'souza
+#
+# Copyright (c) Carnegie Mellon University 2018.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#  1. Redistributions of source code must retain the above copyright notice,
+#     this list of conditions and the following disclaimer.
+#  2. Redistributions in binary form must reproduce the above copyright notice,
+#     this list of conditions and the following disclaimer in the documentation
+#     and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+
+# Links against the installed libqot (/usr/local/lib); set QOT_LIB_DIR to
+# build against a build tree instead, e.g. QOT_LIB_DIR=../../../build/src/api/c
+
+import os
+
+from setuptools import setup, Extension
+
+here = os.path.dirname(os.path.abspath(__file__))
+lib_dirs = [os.environ['QOT_LIB_DIR']] if 'QOT_LIB_DIR' in os.environ else []
+
+setup(
+    name='qot',
+    version='0.1',
+    description='Python bindings for the QoT Stack',
+    packages=['qot'],
+    ext_modules=[Extension(
+        'qot._qot',
+        sources=['qot/_qot.c'],
+        include_dirs=[os.path.join(here, '..', 'c'), os.path.join(here, '..', '..')],
+        library_dirs=lib_dirs,
+        runtime_library_dirs=lib_dirs,
+        libraries=['qot'],
+    )],
+    install_requires=['numpy'],
+)
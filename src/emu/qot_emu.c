@@ -0,0 +1,1060 @@
+/*
+ * @file qot_emu.c
+ * @brief Userspace emulation of the QoT core behind the /dev ioctl surface
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* System includes */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/* The discipline and uncertainty model are shared with the kernel module */
+#include "../qot_uncertainty.h"
+
+#include "qot_emu.h"
+
+/* Sizes of the emulated core (the kernel uses dynamic structures) */
+#define QOT_EMU_MAX_TIMELINES 32
+#define QOT_EMU_MAX_BINDINGS  64
+#define QOT_EMU_MAX_FDS       1024
+#define QOT_EMU_MAX_EVENTS    64
+#define QOT_EMU_MAX_TIMERS    64
+
+/* Marks an initialized shared segment */
+#define QOT_EMU_MAGIC 0x514f5445
+
+/* Name reported for the emulated core clock */
+#define QOT_EMU_CLOCK_NAME "qot_emu"
+
+/* FD_TO_CLOCKID / CLOCKID_TO_FD for dynamic POSIX clocks */
+#define QOT_EMU_CLOCKFD 3
+#define QOT_EMU_CLOCKID_TO_FD(clk) ((unsigned int) ~((clk) >> 3))
+
+/* A binding to a timeline, keyed on the thread which created it */
+typedef struct qot_emu_binding {
+    int active;                 /* Slot in use                                   */
+    int pid;                    /* Thread which created the binding              */
+    qot_binding_t info;         /* Binding information                           */
+} qot_emu_binding_t;
+
+/* Emulated timeline, mirroring timeline_impl_t in qot_timeline_chdev.c */
+typedef struct qot_emu_timeline {
+    int active;                 /* Slot in use (slot number is the index)        */
+    qot_timeline_t info;        /* Timeline info                                 */
+    s32 dialed_frequency;       /* Discipline: dialed frequency                  */
+    s64 last;                   /* Discipline: last cycle count of               */
+    s64 mult;                   /* Discipline: ppb multiplier                    */
+    s64 nsec;                   /* Discipline: global time offset                */
+    s64 u_nsec;                 /* Discipline: global time for master            */
+    s64 l_nsec;                 /* Discipline: global time for master            */
+    s64 u_mult;                 /* Discipline: upper bound on ppb                */
+    s64 l_mult;                 /* Discipline: lower bound on ppb                */
+    qot_uncertainty_table_t u_pow; /* Discipline: upper (t-t0)^(3/2) bound table */
+    qot_uncertainty_table_t l_pow; /* Discipline: lower (t-t0)^(3/2) bound table */
+    qot_emu_binding_t bindings[QOT_EMU_MAX_BINDINGS];
+} qot_emu_timeline_t;
+
+/* State of the emulated core, optionally shared between processes */
+typedef struct qot_emu_core {
+    u32 magic;                  /* Set once the segment is initialized           */
+    pthread_mutex_t lock;       /* Protects everything below                     */
+    pthread_cond_t update;      /* Broadcast when a discipline changes           */
+    utimelength_t os_latency;   /* OS latency set through /dev/qotadm            */
+    qot_emu_timeline_t timelines[QOT_EMU_MAX_TIMELINES];
+} qot_emu_core_t;
+
+/* Kinds of device which can be opened */
+typedef enum {
+    QOT_EMU_DEV_NONE = 0,
+    QOT_EMU_DEV_USR,
+    QOT_EMU_DEV_ADM,
+    QOT_EMU_DEV_TIMELINE,
+} qot_emu_dev_t;
+
+/* An open emulated device (per process, like a struct file) */
+typedef struct qot_emu_file {
+    qot_emu_dev_t type;         /* Device behind the descriptor                  */
+    int index;                  /* Timeline index (/dev/timelineX only)          */
+    int head;                   /* Next event to be read                         */
+    int count;                  /* Number of queued events                       */
+    int muted;                  /* Control only, no timeline events are queued   */
+    qot_event_t events[QOT_EMU_MAX_EVENTS]; /* Event queue (/dev/qotusr, qotadm) */
+} qot_emu_file_t;
+
+/* A periodic timer created through TIMELINE_CREATE_TIMER */
+typedef struct qot_emu_timer {
+    int active;                 /* Slot in use                                   */
+    int pid;                    /* Thread which receives SIGALRM                 */
+    int index;                  /* Timeline index                                */
+    int fired;                  /* Number of expiries delivered                  */
+    qot_timer_t info;           /* Timer information                             */
+    timer_t timerid;            /* Backing POSIX timer                           */
+} qot_emu_timer_t;
+
+static qot_emu_core_t *core = NULL;
+static pthread_once_t core_once = PTHREAD_ONCE_INIT;
+
+/* Per-process state */
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+static qot_emu_file_t *files[QOT_EMU_MAX_FDS];
+static qot_emu_timer_t timers[QOT_EMU_MAX_TIMERS];
+
+// CORE STATE ////////////////////////////////////////////////////////////////////
+
+static void qot_emu_core_init(qot_emu_core_t *c, int pshared)
+{
+    pthread_mutexattr_t mattr;
+    pthread_condattr_t cattr;
+
+    memset(c, 0, sizeof(qot_emu_core_t));
+    pthread_mutexattr_init(&mattr);
+    pthread_condattr_init(&cattr);
+    if (pshared) {
+        pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+        pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    }
+    pthread_mutex_init(&c->lock, &mattr);
+    pthread_cond_init(&c->update, &cattr);
+    pthread_mutexattr_destroy(&mattr);
+    pthread_condattr_destroy(&cattr);
+    __atomic_store_n(&c->magic, QOT_EMU_MAGIC, __ATOMIC_RELEASE);
+}
+
+/* Map the core state, either shared through QOT_EMU_SHM or private */
+static void qot_emu_core_attach(void)
+{
+    const char *name = getenv(QOT_EMU_SHM_ENV);
+    qot_emu_core_t *c;
+    struct stat st;
+    int fd, created = 1;
+
+    if (name && name[0]) {
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            created = 0;
+            fd = shm_open(name, O_RDWR, 0600);
+        }
+        if (fd >= 0 && created && ftruncate(fd, sizeof(qot_emu_core_t)) < 0) {
+            syscall(SYS_close, fd);
+            fd = -1;
+        }
+        /* Wait for the creator to size the segment before touching it */
+        while (fd >= 0 && !created && fstat(fd, &st) == 0
+            && st.st_size < (off_t) sizeof(qot_emu_core_t))
+            sched_yield();
+        if (fd >= 0) {
+            c = mmap(NULL, sizeof(qot_emu_core_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            syscall(SYS_close, fd);
+            if (c != MAP_FAILED) {
+                if (created)
+                    qot_emu_core_init(c, 1);
+                else
+                    while (__atomic_load_n(&c->magic, __ATOMIC_ACQUIRE) != QOT_EMU_MAGIC)
+                        sched_yield();
+                core = c;
+                return;
+            }
+        }
+        fprintf(stderr, "qot_emu: cannot map %s, falling back to a private core\n", name);
+    }
+    c = mmap(NULL, sizeof(qot_emu_core_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (c == MAP_FAILED)
+        return;
+    qot_emu_core_init(c, 0);
+    core = c;
+}
+
+static void qot_emu_lock(void)
+{
+    /* Recover the state if another process died while holding the lock */
+    if (pthread_mutex_lock(&core->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&core->lock);
+}
+
+static void qot_emu_unlock(void)
+{
+    pthread_mutex_unlock(&core->lock);
+}
+
+static int qot_emu_gettid(void)
+{
+    return (int) syscall(SYS_gettid);
+}
+
+// CORE CLOCK ////////////////////////////////////////////////////////////////////
+
+/* The emulated core clock is CLOCK_REALTIME, like qot_x86 without a TSC */
+static s64 qot_emu_core_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (s64) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void qot_emu_get_core_time(utimepoint_t *utp)
+{
+    memset(utp, 0, sizeof(utimepoint_t));
+    TP_FROM_nSEC(utp->estimate, qot_emu_core_ns());
+}
+
+// TIME PROJECTION (see qot_loc2rem / qot_rem2loc) ///////////////////////////////
+
+static s64 qot_emu_loc2rem(qot_emu_timeline_t *tl, int period, s64 val)
+{
+    if (period)
+        return val + (tl->mult * val) / 1000000000L;
+    val -= tl->last;
+    return tl->nsec + val + (tl->mult * val) / 1000000000L;
+}
+
+static s64 qot_emu_rem2loc(qot_emu_timeline_t *tl, int period, s64 val)
+{
+    u32 div = (u32) (tl->mult + 1000000000LL);
+    u64 diff;
+    if (period)
+        return (s64) ((u64) val / div) * 1000000000LL + (s64) ((u64) val % div);
+    diff = (u64) (val - tl->nsec);
+    return tl->last + (s64) ((diff / div) * 1000000000ULL) + (s64) (diff % div);
+}
+
+/* Timeline time with the synchronization uncertainty, for a core time */
+static void qot_emu_project(qot_emu_timeline_t *tl, s64 coretime, stimepoint_t *stp)
+{
+    s64 timelinetime = qot_emu_loc2rem(tl, 0, coretime);
+    s64 dt = coretime - tl->last;
+    TP_FROM_nSEC(stp->estimate, timelinetime);
+    TP_FROM_nSEC(stp->u_estimate, timelinetime + qot_uncertainty_bound(tl->u_nsec, tl->u_mult, &tl->u_pow, dt));
+    TP_FROM_nSEC(stp->l_estimate, timelinetime + qot_uncertainty_bound(tl->l_nsec, tl->l_mult, &tl->l_pow, dt));
+}
+
+// TIMELINES /////////////////////////////////////////////////////////////////////
+
+/* Find a timeline by name (core lock held) */
+static qot_emu_timeline_t *qot_emu_timeline_find(const char *name)
+{
+    int i;
+    for (i = 0; i < QOT_EMU_MAX_TIMELINES; i++)
+        if (core->timelines[i].active
+            && !strncmp(core->timelines[i].info.name, name, QOT_MAX_NAMELEN))
+            return &core->timelines[i];
+    return NULL;
+}
+
+/* Find a timeline by index (core lock held) */
+static qot_emu_timeline_t *qot_emu_timeline_get(int index)
+{
+    if (index < 0 || index >= QOT_EMU_MAX_TIMELINES || !core->timelines[index].active)
+        return NULL;
+    return &core->timelines[index];
+}
+
+static qot_emu_binding_t *qot_emu_binding_find(qot_emu_timeline_t *tl, int pid)
+{
+    int i;
+    for (i = 0; i < QOT_EMU_MAX_BINDINGS; i++)
+        if (tl->bindings[i].active && tl->bindings[i].pid == pid)
+            return &tl->bindings[i];
+    return NULL;
+}
+
+static int qot_emu_binding_count(qot_emu_timeline_t *tl)
+{
+    int i, n = 0;
+    for (i = 0; i < QOT_EMU_MAX_BINDINGS; i++)
+        n += tl->bindings[i].active;
+    return n;
+}
+
+/* Discipline changed: wake sleepers so that they re-project their deadline */
+static void qot_emu_scheduler_update(void)
+{
+    pthread_cond_broadcast(&core->update);
+}
+
+// EVENTS ////////////////////////////////////////////////////////////////////////
+
+/* Queue an event on an open device (files lock held) */
+static void qot_emu_event_add(int fd, qot_event_t *event)
+{
+    qot_emu_file_t *file = files[fd];
+    u64 one = 1;
+    if (file->count == QOT_EMU_MAX_EVENTS) {
+        fprintf(stderr, "qot_emu: event queue full, dropping event\n");
+        return;
+    }
+    file->events[(file->head + file->count) % QOT_EMU_MAX_EVENTS] = *event;
+    file->count++;
+    /* The eventfd behind the descriptor makes poll() report POLLIN */
+    if (write(fd, &one, sizeof(one)) < 0)
+        fprintf(stderr, "qot_emu: cannot signal event\n");
+}
+
+/* Notify every open /dev/qotusr in this process about a new timeline */
+static void qot_emu_timeline_create_notify(qot_timeline_t *timeline)
+{
+    qot_event_t event;
+    int fd;
+    memset(&event, 0, sizeof(event));
+    event.type = QOT_EVENT_TIMELINE_CREATE;
+    qot_emu_get_core_time(&event.timestamp);
+    strncpy(event.data, timeline->name, QOT_MAX_NAMELEN);
+    pthread_mutex_lock(&files_lock);
+    for (fd = 0; fd < QOT_EMU_MAX_FDS; fd++)
+        if (files[fd] && files[fd]->type == QOT_EMU_DEV_USR && !files[fd]->muted)
+            qot_emu_event_add(fd, &event);
+    pthread_mutex_unlock(&files_lock);
+}
+
+/* Drop the queued events of a control-only connection and queue no more */
+static long qot_emu_event_mute(int fd)
+{
+    qot_emu_file_t *file;
+    u64 pending;
+    pthread_mutex_lock(&files_lock);
+    file = files[fd];
+    if (!file) {
+        pthread_mutex_unlock(&files_lock);
+        return -EACCES;
+    }
+    file->muted = 1;
+    for (; file->count; file->count--)
+        if (read(fd, &pending, sizeof(pending)) < 0)
+            fprintf(stderr, "qot_emu: cannot consume event\n");
+    file->head = 0;
+    pthread_mutex_unlock(&files_lock);
+    return 0;
+}
+
+static long qot_emu_event_next(int fd, qot_event_t *event)
+{
+    qot_emu_file_t *file;
+    u64 one;
+    pthread_mutex_lock(&files_lock);
+    file = files[fd];
+    if (!file || !file->count) {
+        pthread_mutex_unlock(&files_lock);
+        return -EACCES;
+    }
+    *event = file->events[file->head];
+    file->head = (file->head + 1) % QOT_EMU_MAX_EVENTS;
+    file->count--;
+    /* Semaphore-mode eventfd: consume exactly one pending event */
+    if (read(fd, &one, sizeof(one)) < 0)
+        fprintf(stderr, "qot_emu: cannot consume event\n");
+    pthread_mutex_unlock(&files_lock);
+    return 0;
+}
+
+// SCHEDULER /////////////////////////////////////////////////////////////////////
+
+/* Block until a timeline time is reached, re-projecting it onto the core clock
+   whenever the discipline changes (see qot_attosleep) */
+static long qot_emu_wait_until(qot_sleeper_t *sleeper)
+{
+    qot_emu_timeline_t *tl;
+    stimepoint_t stp;
+    struct timespec ts;
+    s64 target, coretime;
+
+    qot_emu_lock();
+    for (;;) {
+        tl = qot_emu_timeline_find(sleeper->timeline.name);
+        if (!tl) {
+            qot_emu_unlock();
+            return -EACCES;
+        }
+        target = TP_TO_nSEC(sleeper->wait_until_time.estimate);
+        coretime = qot_emu_rem2loc(tl, 0, target);
+        if (qot_emu_core_ns() >= coretime)
+            break;
+        ts.tv_sec = coretime / 1000000000LL;
+        ts.tv_nsec = coretime % 1000000000LL;
+        if (pthread_cond_timedwait(&core->update, &core->lock, &ts) == EOWNERDEAD)
+            pthread_mutex_consistent(&core->lock);
+    }
+    /* Send the time at which the task woke up back to user */
+    qot_emu_project(tl, qot_emu_core_ns(), &stp);
+    memset(&sleeper->wait_until_time, 0, sizeof(utimepoint_t));
+    sleeper->wait_until_time.estimate = stp.estimate;
+    qot_emu_unlock();
+    return 0;
+}
+
+/* Deliver a periodic timer expiry as SIGALRM to the binding's thread */
+static void qot_emu_timer_notify(union sigval sv)
+{
+    qot_emu_timer_t *timer = (qot_emu_timer_t *) sv.sival_ptr;
+    struct itimerspec stop;
+    if (!timer->active)
+        return;
+    syscall(SYS_tgkill, getpid(), timer->pid, SIGALRM);
+    timer->fired++;
+    if (timer->info.count && timer->fired > timer->info.count) {
+        memset(&stop, 0, sizeof(stop));
+        timer_settime(timer->timerid, 0, &stop, NULL);
+    }
+}
+
+static long qot_emu_timer_create(qot_emu_timeline_t *tl, qot_timer_t *info)
+{
+    qot_emu_timer_t *timer = NULL;
+    struct sigevent sev;
+    struct itimerspec its;
+    s64 start, period;
+    int i, pid = qot_emu_gettid();
+
+    pthread_mutex_lock(&files_lock);
+    for (i = 0; i < QOT_EMU_MAX_TIMERS; i++) {
+        if (timers[i].active && timers[i].pid == pid && timers[i].index == tl->info.index) {
+            pthread_mutex_unlock(&files_lock);
+            return -EACCES;
+        }
+        if (!timer && !timers[i].active)
+            timer = &timers[i];
+    }
+    if (!timer) {
+        pthread_mutex_unlock(&files_lock);
+        return -ENOMEM;
+    }
+    memset(timer, 0, sizeof(qot_emu_timer_t));
+    timer->pid = pid;
+    timer->index = tl->info.index;
+    timer->info = *info;
+    timer->info.timeline = tl->info;
+
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD;
+    sev.sigev_notify_function = qot_emu_timer_notify;
+    sev.sigev_value.sival_ptr = timer;
+    if (timer_create(CLOCK_REALTIME, &sev, &timer->timerid) < 0) {
+        pthread_mutex_unlock(&files_lock);
+        return -EACCES;
+    }
+    /* Period and start are projected with the discipline at creation time */
+    start = TP_TO_nSEC(info->start_offset);
+    start = qot_emu_rem2loc(tl, 0, start);
+    period = TL_TO_nSEC(info->period);
+    period = qot_emu_rem2loc(tl, 1, period);
+    its.it_value.tv_sec = start / 1000000000LL;
+    its.it_value.tv_nsec = start % 1000000000LL;
+    its.it_interval.tv_sec = period / 1000000000LL;
+    its.it_interval.tv_nsec = period % 1000000000LL;
+    timer->active = 1;
+    if (timer_settime(timer->timerid, TIMER_ABSTIME, &its, NULL) < 0) {
+        timer->active = 0;
+        timer_delete(timer->timerid);
+        pthread_mutex_unlock(&files_lock);
+        return -EACCES;
+    }
+    *info = timer->info;
+    pthread_mutex_unlock(&files_lock);
+    return 0;
+}
+
+static long qot_emu_timer_destroy(int index)
+{
+    int i, pid = qot_emu_gettid();
+    pthread_mutex_lock(&files_lock);
+    for (i = 0; i < QOT_EMU_MAX_TIMERS; i++) {
+        if (timers[i].active && timers[i].pid == pid && timers[i].index == index) {
+            timers[i].active = 0;
+            timer_delete(timers[i].timerid);
+            pthread_mutex_unlock(&files_lock);
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&files_lock);
+    return -EACCES;
+}
+
+// DEVICE FILES //////////////////////////////////////////////////////////////////
+
+int qot_emu_open(const char *path)
+{
+    qot_emu_file_t *file;
+    qot_emu_timeline_t *tl;
+    qot_event_t event;
+    u64 pending;
+    int fd, index = -1, i;
+    qot_emu_dev_t type;
+    char tail;
+
+    if (!path)
+        return QOT_EMU_NOT_EMULATED;
+    if (!strcmp(path, "/dev/qotusr"))
+        type = QOT_EMU_DEV_USR;
+    else if (!strcmp(path, "/dev/qotadm"))
+        type = QOT_EMU_DEV_ADM;
+    else if (sscanf(path, "/dev/timeline%d%c", &index, &tail) == 1)
+        type = QOT_EMU_DEV_TIMELINE;
+    else
+        return QOT_EMU_NOT_EMULATED;
+
+    pthread_once(&core_once, qot_emu_core_attach);
+    if (!core) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (type == QOT_EMU_DEV_TIMELINE) {
+        qot_emu_lock();
+        tl = qot_emu_timeline_get(index);
+        qot_emu_unlock();
+        if (!tl) {
+            errno = ENOENT;
+            return -1;
+        }
+    }
+
+    /* A semaphore-mode eventfd backs each descriptor so that fcntl(), poll()
+       and close() keep working on it */
+    fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE | EFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fd >= QOT_EMU_MAX_FDS) {
+        syscall(SYS_close, fd);
+        errno = EMFILE;
+        return -1;
+    }
+    file = calloc(1, sizeof(qot_emu_file_t));
+    if (!file) {
+        syscall(SYS_close, fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    file->type = type;
+    file->index = index;
+
+    /* Notify the connection of all existing timelines (qot_user_chdev_ioctl_open) */
+    if (type == QOT_EMU_DEV_USR) {
+        memset(&event, 0, sizeof(event));
+        event.type = QOT_EVENT_TIMELINE_CREATE;
+        qot_emu_lock();
+        for (i = 0; i < QOT_EMU_MAX_TIMELINES && file->count < QOT_EMU_MAX_EVENTS; i++) {
+            if (!core->timelines[i].active)
+                continue;
+            strncpy(event.data, core->timelines[i].info.name, QOT_MAX_NAMELEN);
+            file->events[file->count++] = event;
+        }
+        qot_emu_unlock();
+        if (file->count) {
+            pending = file->count;
+            if (write(fd, &pending, sizeof(pending)) < 0)
+                fprintf(stderr, "qot_emu: cannot signal event\n");
+        }
+    }
+    pthread_mutex_lock(&files_lock);
+    files[fd] = file;
+    pthread_mutex_unlock(&files_lock);
+    return fd;
+}
+
+int qot_emu_is_emulated(int fd)
+{
+    int ret;
+    if (fd < 0 || fd >= QOT_EMU_MAX_FDS)
+        return 0;
+    pthread_mutex_lock(&files_lock);
+    ret = (files[fd] != NULL);
+    pthread_mutex_unlock(&files_lock);
+    return ret;
+}
+
+int qot_emu_close(int fd)
+{
+    qot_emu_file_t *file;
+    if (fd < 0 || fd >= QOT_EMU_MAX_FDS)
+        return -EBADF;
+    pthread_mutex_lock(&files_lock);
+    file = files[fd];
+    files[fd] = NULL;
+    pthread_mutex_unlock(&files_lock);
+    if (!file)
+        return -EBADF;
+    free(file);
+    if (syscall(SYS_close, fd) < 0)
+        return -errno;
+    return 0;
+}
+
+static qot_emu_dev_t qot_emu_file_type(int fd, int *index)
+{
+    qot_emu_dev_t type = QOT_EMU_DEV_NONE;
+    if (fd < 0 || fd >= QOT_EMU_MAX_FDS)
+        return type;
+    pthread_mutex_lock(&files_lock);
+    if (files[fd]) {
+        type = files[fd]->type;
+        *index = files[fd]->index;
+    }
+    pthread_mutex_unlock(&files_lock);
+    return type;
+}
+
+// /dev/qotusr ///////////////////////////////////////////////////////////////////
+
+static void qot_emu_get_core_clock(qot_clock_t *clk)
+{
+    memset(clk, 0, sizeof(qot_clock_t));
+    strncpy(clk->name, QOT_EMU_CLOCK_NAME, QOT_MAX_NAMELEN);
+    clk->state = QOT_CLK_STATE_ON;
+    clk->nom_freq_nhz = 1000000000ULL * 1000000000ULL;
+    clk->phc_id = -1;
+}
+
+static long qot_emu_user_ioctl(int fd, unsigned long cmd, void *arg)
+{
+    qot_emu_timeline_t *tl;
+    qot_timeline_t *msgt = (qot_timeline_t *) arg;
+    int i;
+
+    switch (cmd) {
+    /* Get the next event in the queue for this connection */
+    case QOTUSR_GET_NEXT_EVENT:
+        return qot_emu_event_next(fd, (qot_event_t *) arg);
+    /* Get information about a timeline */
+    case QOTUSR_GET_TIMELINE_INFO:
+        qot_emu_lock();
+        tl = qot_emu_timeline_find(msgt->name);
+        if (tl)
+            *msgt = tl->info;
+        qot_emu_unlock();
+        return tl ? 0 : -EACCES;
+    /* Get information about the core clock */
+    case QOTUSR_GET_CORE_CLOCK_INFO:
+        qot_emu_get_core_clock((qot_clock_t *) arg);
+        return 0;
+    /* Create a timeline */
+    case QOTUSR_CREATE_TIMELINE:
+        qot_emu_lock();
+        tl = qot_emu_timeline_find(msgt->name);
+        if (tl) {
+            /* Timeline exists: the kernel returns QOT_RETURN_TYPE_ERR */
+            *msgt = tl->info;
+            qot_emu_unlock();
+            return QOT_RETURN_TYPE_ERR;
+        }
+        for (i = 0; i < QOT_EMU_MAX_TIMELINES; i++)
+            if (!core->timelines[i].active)
+                break;
+        if (i == QOT_EMU_MAX_TIMELINES) {
+            qot_emu_unlock();
+            return -EACCES;
+        }
+        tl = &core->timelines[i];
+        memset(tl, 0, sizeof(qot_emu_timeline_t));
+        tl->info = *msgt;
+        tl->info.index = i;
+        /* A new timeline starts out aligned with the core clock */
+        tl->last = qot_emu_core_ns();
+        tl->nsec = tl->last;
+        tl->active = 1;
+        *msgt = tl->info;
+        qot_emu_unlock();
+        qot_emu_timeline_create_notify(msgt);
+        return 0;
+    /* Try to destroy a timeline (only once no bindings remain) */
+    case QOTUSR_DESTROY_TIMELINE:
+        qot_emu_lock();
+        tl = qot_emu_timeline_find(msgt->name);
+        if (!tl || qot_emu_binding_count(tl)) {
+            qot_emu_unlock();
+            return QOT_RETURN_TYPE_ERR;
+        }
+        tl->active = 0;
+        qot_emu_scheduler_update();
+        qot_emu_unlock();
+        return 0;
+    /* Wait until a time on a timeline reference */
+    case QOTUSR_WAIT_UNTIL:
+        return qot_emu_wait_until((qot_sleeper_t *) arg);
+    /* There are no pins on the emulated core clock */
+    case QOTUSR_OUTPUT_COMPARE_ENABLE:
+    case QOTUSR_OUTPUT_COMPARE_DISABLE:
+    case QOTUSR_INPUT_CAPTURE_ENABLE:
+    case QOTUSR_INPUT_CAPTURE_DISABLE:
+        return -EACCES;
+    /* Stop queueing timeline events on a connection used only for control */
+    case QOTUSR_MUTE_EVENTS:
+        return qot_emu_event_mute(fd);
+    default:
+        return -EINVAL;
+    }
+}
+
+// /dev/qotadm ///////////////////////////////////////////////////////////////////
+
+static long qot_emu_admin_ioctl(int fd, unsigned long cmd, void *arg)
+{
+    qot_clock_t *msgc = (qot_clock_t *) arg;
+    utimepoint_t utp;
+
+    switch (cmd) {
+    case QOTADM_GET_NEXT_EVENT:
+        return qot_emu_event_next(fd, (qot_event_t *) arg);
+    case QOTADM_GET_CLOCK_INFO:
+        if (strncmp(msgc->name, QOT_EMU_CLOCK_NAME, QOT_MAX_NAMELEN))
+            return -EACCES;
+        qot_emu_get_core_clock(msgc);
+        return 0;
+    /* The single emulated clock is always awake and active */
+    case QOTADM_SET_CLOCK_SLEEP:
+    case QOTADM_SET_CLOCK_WAKE:
+    case QOTADM_SET_CLOCK_ACTIVE:
+        if (strncmp(msgc->name, QOT_EMU_CLOCK_NAME, QOT_MAX_NAMELEN))
+            return -EACCES;
+        return 0;
+    case QOTADM_SET_OS_LATENCY:
+        qot_emu_lock();
+        core->os_latency = *(utimelength_t *) arg;
+        qot_emu_unlock();
+        return 0;
+    case QOTADM_GET_OS_LATENCY:
+        qot_emu_lock();
+        *(utimelength_t *) arg = core->os_latency;
+        qot_emu_unlock();
+        return 0;
+    case QOTADM_GET_CORE_TIME_RAW:
+        qot_emu_get_core_time(&utp);
+        *(timepoint_t *) arg = utp.estimate;
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+// /dev/timelineX ////////////////////////////////////////////////////////////////
+
+/* Tightest requirement over all bindings (see TIMELINE_GET_BINDING_INFO) */
+static long qot_emu_binding_info(qot_emu_timeline_t *tl, qot_binding_t *msgb)
+{
+    qot_emu_binding_t *b;
+    int i, found = 0;
+    for (i = 0; i < QOT_EMU_MAX_BINDINGS; i++) {
+        b = &tl->bindings[i];
+        if (!b->active)
+            continue;
+        if (!found) {
+            msgb->demand = b->info.demand;
+            found = 1;
+            continue;
+        }
+        if (timelength_cmp(&b->info.demand.resolution, &msgb->demand.resolution) > 0)
+            msgb->demand.resolution = b->info.demand.resolution;
+        if (timelength_cmp(&b->info.demand.accuracy.below, &msgb->demand.accuracy.below) > 0)
+            msgb->demand.accuracy.below = b->info.demand.accuracy.below;
+        if (timelength_cmp(&b->info.demand.accuracy.above, &msgb->demand.accuracy.above) > 0)
+            msgb->demand.accuracy.above = b->info.demand.accuracy.above;
+    }
+    return found ? 0 : -EACCES;
+}
+
+static long qot_emu_timeline_ioctl(int index, unsigned long cmd, void *arg)
+{
+    qot_emu_timeline_t *tl;
+    qot_emu_binding_t *b;
+    qot_binding_t *msgb = (qot_binding_t *) arg;
+    qot_bounds_t *bounds;
+    tl_translation_t *params;
+    stimepoint_t stp;
+    utimepoint_t *utp;
+    timepoint_t *tp;
+    s64 coretime, timelinetime;
+    long ret = 0;
+    int i, pid = qot_emu_gettid();
+
+    qot_emu_lock();
+    tl = qot_emu_timeline_get(index);
+    if (!tl) {
+        qot_emu_unlock();
+        return -EACCES;
+    }
+    switch (cmd) {
+    /* Get information about this timeline */
+    case TIMELINE_GET_INFO:
+        *(qot_timeline_t *) arg = tl->info;
+        break;
+    /* Get information about this timeline's requirements */
+    case TIMELINE_GET_BINDING_INFO:
+        ret = qot_emu_binding_info(tl, msgb);
+        break;
+    /* Bind to this timeline (one binding per thread) */
+    case TIMELINE_BIND_JOIN:
+        if (qot_emu_binding_find(tl, pid)) {
+            ret = -EACCES;
+            break;
+        }
+        for (i = 0; i < QOT_EMU_MAX_BINDINGS; i++)
+            if (!tl->bindings[i].active)
+                break;
+        if (i == QOT_EMU_MAX_BINDINGS) {
+            ret = -EACCES;
+            break;
+        }
+        b = &tl->bindings[i];
+        b->info = *msgb;
+        b->info.id = pid;
+        b->pid = pid;
+        b->active = 1;
+        *msgb = b->info;
+        break;
+    /* Unbind from this timeline */
+    case TIMELINE_BIND_LEAVE:
+        b = qot_emu_binding_find(tl, pid);
+        if (!b) {
+            ret = -EACCES;
+            break;
+        }
+        b->active = 0;
+        break;
+    /* Update binding parameters */
+    case TIMELINE_BIND_UPDATE:
+        b = qot_emu_binding_find(tl, pid);
+        if (!b) {
+            ret = -EACCES;
+            break;
+        }
+        b->info = *msgb;
+        break;
+    /* Setting the upper and lower bound on timeline's drift */
+    case TIMELINE_SET_SYNC_UNCERTAINTY:
+        bounds = (qot_bounds_t *) arg;
+        tl->u_mult = (s32) bounds->u_drift;
+        tl->l_mult = (s32) bounds->l_drift;
+        tl->u_nsec = (s64) bounds->u_nsec;
+        tl->l_nsec = (s64) bounds->l_nsec;
+        qot_uncertainty_build(&tl->u_pow, bounds->u_pow);
+        qot_uncertainty_build(&tl->l_pow, bounds->l_pow);
+        break;
+    /* Convert a core time to a timeline */
+    case TIMELINE_CORE_TO_REMOTE:
+        coretime = TP_TO_nSEC(((stimepoint_t *) arg)->estimate);
+        qot_emu_project(tl, coretime, &stp);
+        *(stimepoint_t *) arg = stp;
+        break;
+    /* Convert timeline time to core time */
+    case TIMELINE_REMOTE_TO_CORE:
+        tp = (timepoint_t *) arg;
+        timelinetime = TP_TO_nSEC((*tp));
+        coretime = qot_emu_rem2loc(tl, 0, timelinetime);
+        TP_FROM_nSEC((*tp), coretime);
+        break;
+    /* Get the current core time */
+    case TIMELINE_GET_CORE_TIME_NOW:
+        qot_emu_get_core_time((utimepoint_t *) arg);
+        break;
+    /* Get the current timeline time */
+    case TIMELINE_GET_TIME_NOW:
+        utp = (utimepoint_t *) arg;
+        qot_emu_project(tl, qot_emu_core_ns(), &stp);
+        memset(utp, 0, sizeof(utimepoint_t));
+        utp->estimate = stp.estimate;
+        if (timepoint_cmp(&stp.u_estimate, &stp.estimate) < 0)
+            timepoint_diff(&utp->interval.above, &stp.u_estimate, &stp.estimate);
+        if (timepoint_cmp(&stp.estimate, &stp.l_estimate) < 0)
+            timepoint_diff(&utp->interval.below, &stp.estimate, &stp.l_estimate);
+        break;
+    case TIMELINE_CREATE_TIMER:
+        if (!qot_emu_binding_find(tl, pid)) {
+            ret = -EACCES;
+            break;
+        }
+        ret = qot_emu_timer_create(tl, (qot_timer_t *) arg);
+        break;
+    case TIMELINE_DESTROY_TIMER:
+        if (!qot_emu_binding_find(tl, pid)) {
+            ret = -EACCES;
+            break;
+        }
+        ret = qot_emu_timer_destroy(index);
+        break;
+    /* Get timeline parameters (mapping and uncertainty) */
+    case TIMELINE_GET_PARAMETERS:
+        params = (tl_translation_t *) arg;
+        params->last   = tl->last;
+        params->mult   = tl->mult;
+        params->nsec   = tl->nsec;
+        params->u_nsec = tl->u_nsec;
+        params->l_nsec = tl->l_nsec;
+        params->u_mult = tl->u_mult;
+        params->l_mult = tl->l_mult;
+        params->u_pow  = tl->u_pow.coef;
+        params->l_pow  = tl->l_pow.coef;
+        break;
+    default:
+        ret = -EINVAL;
+    }
+    qot_emu_unlock();
+    return ret;
+}
+
+long qot_emu_ioctl(int fd, unsigned long cmd, void *arg)
+{
+    int index = -1;
+    qot_emu_dev_t type = qot_emu_file_type(fd, &index);
+    if (type == QOT_EMU_DEV_NONE)
+        return -EBADF;
+    if (!arg)
+        return -EFAULT;
+    switch (type) {
+    case QOT_EMU_DEV_USR:
+        return qot_emu_user_ioctl(fd, cmd, arg);
+    case QOT_EMU_DEV_ADM:
+        return qot_emu_admin_ioctl(fd, cmd, arg);
+    case QOT_EMU_DEV_TIMELINE:
+        return qot_emu_timeline_ioctl(index, cmd, arg);
+    default:
+        return -EINVAL;
+    }
+}
+
+// POSIX CLOCK OPERATIONS ////////////////////////////////////////////////////////
+
+int qot_emu_clock_fd(clockid_t clkid)
+{
+    int fd, index;
+    if (clkid >= 0 || (clkid & 7) != QOT_EMU_CLOCKFD)
+        return -1;
+    fd = (int) QOT_EMU_CLOCKID_TO_FD(clkid);
+    if (qot_emu_file_type(fd, &index) != QOT_EMU_DEV_TIMELINE)
+        return -1;
+    return fd;
+}
+
+/* Lock the core and find the timeline behind a descriptor */
+static qot_emu_timeline_t *qot_emu_clock_timeline(int fd)
+{
+    qot_emu_timeline_t *tl;
+    int index = -1;
+    if (qot_emu_file_type(fd, &index) != QOT_EMU_DEV_TIMELINE)
+        return NULL;
+    qot_emu_lock();
+    tl = qot_emu_timeline_get(index);
+    if (!tl)
+        qot_emu_unlock();
+    return tl;
+}
+
+int qot_emu_clock_gettime(int fd, struct timespec *tp)
+{
+    qot_emu_timeline_t *tl = qot_emu_clock_timeline(fd);
+    s64 now;
+    if (!tl)
+        return -EINVAL;
+    now = qot_emu_loc2rem(tl, 0, qot_emu_core_ns());
+    qot_emu_unlock();
+    tp->tv_sec = now / 1000000000LL;
+    tp->tv_nsec = now % 1000000000LL;
+    if (tp->tv_nsec < 0) {
+        tp->tv_sec--;
+        tp->tv_nsec += 1000000000LL;
+    }
+    return 0;
+}
+
+int qot_emu_clock_settime(int fd, const struct timespec *tp)
+{
+    qot_emu_timeline_t *tl = qot_emu_clock_timeline(fd);
+    if (!tl)
+        return -EINVAL;
+    tl->last = qot_emu_core_ns();
+    tl->nsec = (s64) tp->tv_sec * 1000000000LL + tp->tv_nsec;
+    qot_emu_scheduler_update();
+    qot_emu_unlock();
+    return 0;
+}
+
+int qot_emu_clock_getres(int fd, struct timespec *tp)
+{
+    if (qot_emu_file_type(fd, &fd) != QOT_EMU_DEV_TIMELINE)
+        return -EINVAL;
+    tp->tv_sec = 0;
+    tp->tv_nsec = 1;
+    return 0;
+}
+
+/* Same conversion as qot_timeline_chdev_ppm_to_ppb */
+static s32 qot_emu_ppm_to_ppb(long ppm)
+{
+    s64 ppb = 1 + ppm;
+    ppb *= 125;
+    ppb >>= 13;
+    return (s32) ppb;
+}
+
+int qot_emu_clock_adjtime(int fd, struct timex *tx)
+{
+    qot_emu_timeline_t *tl;
+    s64 ns, delta;
+    int err = -EOPNOTSUPP;
+
+    if (tx->modes & ADJ_SETOFFSET) {
+        delta = tx->time.tv_usec;
+        if (!(tx->modes & ADJ_NANO))
+            delta *= 1000;
+        if ((unsigned long) delta >= 1000000000UL)
+            return -EINVAL;
+        delta += (s64) tx->time.tv_sec * 1000000000LL;
+        tl = qot_emu_clock_timeline(fd);
+        if (!tl)
+            return -EINVAL;
+        tl->nsec += delta;
+        err = 0;
+    } else if (tx->modes & ADJ_FREQUENCY) {
+        tl = qot_emu_clock_timeline(fd);
+        if (!tl)
+            return -EINVAL;
+        ns = qot_emu_core_ns();
+        tl->nsec += (ns - tl->last) + (tl->mult * (ns - tl->last)) / 1000000000L;
+        tl->last = ns;
+        tl->mult = qot_emu_ppm_to_ppb(tx->freq);
+        tl->dialed_frequency = tx->freq;
+        err = 0;
+    } else if (tx->modes == 0) {
+        tl = qot_emu_clock_timeline(fd);
+        if (!tl)
+            return -EINVAL;
+        tx->freq = tl->dialed_frequency;
+        err = 0;
+    } else {
+        return err;
+    }
+    qot_emu_scheduler_update();
+    qot_emu_unlock();
+    return err;
+}
@@ -0,0 +1,95 @@
+/*
+ * @file qot_emu.h
+ * @brief Userspace emulation of the QoT core behind the /dev ioctl surface
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QOT_STACK_SRC_EMU_QOT_EMU_H
+#define QOT_STACK_SRC_EMU_QOT_EMU_H
+
+#include <time.h>
+#include <sys/timex.h>
+
+/* Public interface */
+#include "../qot_types.h"
+
+/* Returned by qot_emu_open for paths which are not QoT devices */
+#define QOT_EMU_NOT_EMULATED (-2)
+
+/* Environment variable naming a POSIX shared memory segment (for example
+   "/qot_emu") in which timelines are shared between processes. When it is
+   not set the emulated core is private to the process. */
+#define QOT_EMU_SHM_ENV "QOT_EMU_SHM"
+
+/**
+ * @brief Open an emulated /dev/qotusr, /dev/qotadm or /dev/timelineX
+ * @param path Path of the device
+ * @return A file descriptor, -1 (errno set) on error or QOT_EMU_NOT_EMULATED
+ **/
+int qot_emu_open(const char *path);
+
+/**
+ * @brief Check whether a file descriptor refers to an emulated device
+ * @param fd File descriptor
+ * @return 1 if it is emulated, 0 otherwise
+ **/
+int qot_emu_is_emulated(int fd);
+
+/**
+ * @brief Release an emulated device and its file descriptor
+ * @param fd File descriptor
+ * @return 0 on success, -errno otherwise
+ **/
+int qot_emu_close(int fd);
+
+/**
+ * @brief Dispatch an ioctl to the emulated device, as the kernel would
+ * @param fd File descriptor
+ * @param cmd Ioctl request
+ * @param arg Ioctl argument
+ * @return The kernel return value (>= 0), or -errno
+ **/
+long qot_emu_ioctl(int fd, unsigned long cmd, void *arg);
+
+/**
+ * @brief Map a dynamic POSIX clock id onto an emulated timeline descriptor
+ * @param clkid Clock id (FD_TO_CLOCKID of the timeline descriptor)
+ * @return The file descriptor, or -1 if the clock is not emulated
+ **/
+int qot_emu_clock_fd(clockid_t clkid);
+
+/**
+ * @brief POSIX clock operations on an emulated timeline
+ * @param fd Timeline file descriptor
+ * @return 0 on success, -errno otherwise (adjtime returns the clock state)
+ **/
+int qot_emu_clock_gettime(int fd, struct timespec *tp);
+int qot_emu_clock_settime(int fd, const struct timespec *tp);
+int qot_emu_clock_getres(int fd, struct timespec *tp);
+int qot_emu_clock_adjtime(int fd, struct timex *tx);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * @file qot_emu_shim.c
+ * @brief LD_PRELOAD shim routing QoT device access to the userspace core emulation
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+/* System includes */
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/timex.h>
+
+#include "qot_emu.h"
+
+/* The next definition of every wrapped symbol (normally the one in libc) */
+static int (*real_open)(const char *path, int flags, ...);
+static int (*real_open64)(const char *path, int flags, ...);
+static int (*real_openat)(int dirfd, const char *path, int flags, ...);
+static int (*real_close)(int fd);
+static int (*real_ioctl)(int fd, unsigned long request, ...);
+static int (*real_clock_gettime)(clockid_t clkid, struct timespec *tp);
+static int (*real_clock_settime)(clockid_t clkid, const struct timespec *tp);
+static int (*real_clock_getres)(clockid_t clkid, struct timespec *tp);
+static int (*real_clock_adjtime)(clockid_t clkid, struct timex *tx);
+
+static pthread_once_t shim_once = PTHREAD_ONCE_INIT;
+
+static void qot_emu_shim_init(void)
+{
+    real_open = dlsym(RTLD_NEXT, "open");
+    real_open64 = dlsym(RTLD_NEXT, "open64");
+    real_openat = dlsym(RTLD_NEXT, "openat");
+    real_close = dlsym(RTLD_NEXT, "close");
+    real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+    real_clock_gettime = dlsym(RTLD_NEXT, "clock_gettime");
+    real_clock_settime = dlsym(RTLD_NEXT, "clock_settime");
+    real_clock_getres = dlsym(RTLD_NEXT, "clock_getres");
+    real_clock_adjtime = dlsym(RTLD_NEXT, "clock_adjtime");
+}
+
+/* Convert a -errno return into the libc convention */
+static int qot_emu_shim_ret(long ret)
+{
+    if (ret < 0) {
+        errno = (int) -ret;
+        return -1;
+    }
+    return (int) ret;
+}
+
+/* The mode argument is only present when a file may be created */
+#define QOT_EMU_SHIM_MODE(flags, last, mode) do {   \
+    va_list ap;                                     \
+    if ((flags) & (O_CREAT | O_TMPFILE)) {          \
+        va_start(ap, last);                         \
+        mode = va_arg(ap, mode_t);                  \
+        va_end(ap);                                 \
+    }                                               \
+} while (0)
+
+int open(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    int fd = qot_emu_open(path);
+    if (fd != QOT_EMU_NOT_EMULATED)
+        return fd;
+    QOT_EMU_SHIM_MODE(flags, flags, mode);
+    pthread_once(&shim_once, qot_emu_shim_init);
+    return real_open(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    int fd = qot_emu_open(path);
+    if (fd != QOT_EMU_NOT_EMULATED)
+        return fd;
+    QOT_EMU_SHIM_MODE(flags, flags, mode);
+    pthread_once(&shim_once, qot_emu_shim_init);
+    return real_open64(path, flags, mode);
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    int fd = qot_emu_open(path);
+    if (fd != QOT_EMU_NOT_EMULATED)
+        return fd;
+    QOT_EMU_SHIM_MODE(flags, flags, mode);
+    pthread_once(&shim_once, qot_emu_shim_init);
+    return real_openat(dirfd, path, flags, mode);
+}
+
+int close(int fd)
+{
+    if (qot_emu_is_emulated(fd))
+        return qot_emu_shim_ret(qot_emu_close(fd));
+    pthread_once(&shim_once, qot_emu_shim_init);
+    return real_close(fd);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    void *arg;
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+    if (qot_emu_is_emulated(fd))
+        return qot_emu_shim_ret(qot_emu_ioctl(fd, request, arg));
+    pthread_once(&shim_once, qot_emu_shim_init);
+    return real_ioctl(fd, request, arg);
+}
+
+int clock_gettime(clockid_t clkid, struct timespec *tp)
+{
+    int fd = qot_emu_clock_fd(clkid);
+    if (fd >= 0)
+        return qot_emu_shim_ret(qot_emu_clock_gettime(fd, tp));
+    pthread_once(&shim_once, qot_emu_shim_init);
+    return real_clock_gettime(clkid, tp);
+}
+
+int clock_settime(clockid_t clkid, const struct timespec *tp)
+{
+    int fd = qot_emu_clock_fd(clkid);
+    if (fd >= 0)
+        return qot_emu_shim_ret(qot_emu_clock_settime(fd, tp));
+    pthread_once(&shim_once, qot_emu_shim_init);
+    return real_clock_settime(clkid, tp);
+}
+
+int clock_getres(clockid_t clkid, struct timespec *tp)
+{
+    int fd = qot_emu_clock_fd(clkid);
+    if (fd >= 0)
+        return qot_emu_shim_ret(qot_emu_clock_getres(fd, tp));
+    pthread_once(&shim_once, qot_emu_shim_init);
+    return real_clock_getres(clkid, tp);
+}
+
+int clock_adjtime(clockid_t clkid, struct timex *tx)
+{
+    int fd = qot_emu_clock_fd(clkid);
+    if (fd >= 0)
+        return qot_emu_shim_ret(qot_emu_clock_adjtime(fd, tx));
+    pthread_once(&shim_once, qot_emu_shim_init);
+    return real_clock_adjtime(clkid, tx);
+}
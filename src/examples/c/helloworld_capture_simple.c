@@ -97,6 +97,7 @@ int main(int argc, char *argv[])
     
     // Populate timestamping request variable
     request.pin_index = 1;
+    request.edge = QOT_TRIGGER_RISING;
 
     signal(SIGINT, exit_handler);
 
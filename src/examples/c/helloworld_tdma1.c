@@ -44,8 +44,9 @@
 
 #include <linux/ptp_clock.h>
 
-// Include the QoT API
+// Include the QoT API and the TDMA runtime
 #include "../../api/c/qot.h"
+#include "../../api/c/qot_tdma.h"
 
 // Include the BBB GPIO MMIO Configuration
 #include "beaglebone_gpio.h"
@@ -54,7 +55,10 @@
 #define TIMELINE_UUID    "my_test_timeline"
 #define APPLICATION_NAME "default"
 #define OFFSET_MSEC      1000
-#define GUARD_BAND       100
+#define MARGIN_USEC      50
+
+// Slot schedule: tdma2 owns the first half of every cycle, tdma1 the second
+#define NODE_NAME        "tdma1"
 
 #define ANALYZE 0
 char filename[100] = "/home/qot_tdma";
@@ -76,12 +80,13 @@ int main(int argc, char *argv[])
 	timeinterval_t accuracy = { .below.sec = 0, .below.asec = 1e12, .above.sec = 0, .above.asec = 1e12 }; // 1usec
 
     utimepoint_t wake_now;
-    timepoint_t wake;
-    timepoint_t temp_wake;
     timelength_t stepsize;
-    timelength_t guard_band = { .sec = 0, .asec = 1e14};
 
-    int late_indicator;
+    tdma_t *tdma;
+    tdma_slot_t slots[2];
+    tdma_config_t config;
+    tdma_window_t window;
+    tdma_stats_t stats;
 
     int step_size_ms = OFFSET_MSEC;
     
@@ -156,59 +161,64 @@ int main(int argc, char *argv[])
 		return QOT_RETURN_TYPE_ERR;
 	}
     
-    // Read Initial Time
-    if(timeline_gettime(my_timeline, &wake_now))
+    // Two slots of one step each, the cycle starting on even steps
+    memset(slots, 0, sizeof(slots));
+    strcpy(slots[0].owner, "tdma2");
+    slots[0].length = stepsize;
+    strcpy(slots[1].owner, "tdma1");
+    slots[1].offset = stepsize;
+    slots[1].length = stepsize;
+    memset(&config, 0, sizeof(config));
+    config.node = NODE_NAME;
+    config.period = stepsize;
+    timelength_add(&config.period, &stepsize);
+    TL_FROM_uSEC(config.margin, MARGIN_USEC);
+    config.slots = slots;
+    config.num_slots = 2;
+
+    tdma = tdma_t_create();
+    if(!tdma || tdma_configure(tdma, my_timeline, &config))
     {
-        printf("Could not read timeline reference time\n");
+        printf("Could not load the slot schedule\n");
+        tdma_t_destroy(tdma);
         goto exit_point;
     }
-    else
+
+    if(ANALYZE)
     {
-        if(ANALYZE)
-        {
-          sprintf(file_timestamp, "%lld", wake_now.estimate.sec);
-          strcat(filename, file_timestamp);
-          fp = fopen(filename, "w");
-        }
-        wake = wake_now.estimate;
-        timepoint_add(&wake, &stepsize);
-        wake.asec = 0;
-    }    
+      timeline_gettime(my_timeline, &wake_now);
+      sprintf(file_timestamp, "%lld", wake_now.estimate.sec);
+      strcat(filename, file_timestamp);
+      fp = fopen(filename, "w");
+    }
 
     // Exit Handler on SIGINT
     signal(SIGINT, exit_handler);
 
     printf("Start toggling PIN \n");
 
-    timepoint_add(&wake, &stepsize);
-    temp_wake = wake;
-    wake_now.estimate = wake;
+    // The guard band of each slot follows the live uncertainty of the timeline
     while (running) {
+        if(tdma_wait_slot(tdma, &window))
+            break;
+        if(timepoint_cmp(&window.start, &window.end) == 0)
+            continue;
+        *gpio_setdataout_addr= PIN;
+        wake_now.estimate = window.end;
         timeline_waituntil(my_timeline, &wake_now);
-        // Toggle Pins
-        if(wake.sec % 2 != 0)
-        {
-            *gpio_setdataout_addr= PIN;
-            timepoint_add(&wake, &stepsize);
-            temp_wake = wake;
-            timepoint_sub(&temp_wake, &guard_band);
-            wake_now.estimate = temp_wake;
-        }
-        else
-        {
-            *gpio_cleardataout_addr = PIN;
-            // if(timepoint_cmp(&wake_now.estimate, &wake) != 1)
-            // {
-            //     timepoint_diff(&guard_band, &wake_now.estimate, &temp_wake);
-            // }
-            timepoint_add(&wake, &stepsize);
-            wake_now.estimate = wake;
-        }
+        *gpio_cleardataout_addr = PIN;
+        tdma_slot_done(tdma, &window);
         if(ANALYZE)
-            fprintf(fp, "%lld\t%llu\n", wake_now.estimate.sec, wake_now.estimate.asec);
-
+            fprintf(fp, "%lld\t%llu\t%llu\n", window.wakeup.estimate.sec, window.wakeup.estimate.asec,
+                (unsigned long long) TL_TO_nSEC(window.guard));
     }
 
+    tdma_get_stats(tdma, &stats);
+    printf("Slots %llu missed %llu overruns %llu, usable %llu of %llu ns\n",
+        (unsigned long long) stats.slots, (unsigned long long) stats.missed,
+        (unsigned long long) stats.overruns, (unsigned long long) stats.usable_ns,
+        (unsigned long long) stats.nominal_ns);
+    tdma_t_destroy(tdma);
 
     /** DESTROY TIMELINE **/
 exit_point:
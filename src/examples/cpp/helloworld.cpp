@@ -81,6 +81,7 @@ int main(int argc, char *argv[])
 	timepoint_t  wake;
 	timelength_t step_size;
 	qot_message_t message;
+	qot_barrier_t barrier;
 
 	timelength_t resolution;
 	timeinterval_t accuracy;
@@ -167,6 +168,18 @@ int main(int argc, char *argv[])
 		goto exit_point;
 	}
 
+	// Start together: all peers are released at one timeline instant
+	memset(&barrier, 0, sizeof(barrier));
+	TL_FROM_mSEC(barrier.margin_floor, 10);
+	barrier.timeout_ms = 5000;
+	if(timeline_barrier(my_timeline, &barrier))
+	{
+		printf("Failed to synchronize the start with the peers\n");
+		goto exit_point;
+	}
+	printf("Released at %" PRId64 " %" PRIu64 " with a margin of %" PRIu64 " ns\n", barrier.wakeup.sec,
+		barrier.wakeup.asec, (uint64_t) TL_TO_nSEC(barrier.margin));
+
 	// Read Initial Time
     if(timeline_gettime(my_timeline, &wake_now))
 	{
@@ -1892,6 +1892,8 @@ enum servo_state clock_synchronize(struct clock *c,
 		
 		bounds.u_nsec = -(offset_stats.rms - offset_stats.stddev);
 		bounds.l_nsec = -(offset_stats.rms + offset_stats.stddev);
+		bounds.u_pow = 0;
+		bounds.l_pow = 0;
 
 		//c->off_stddev = offset_stats.stddev;
 		//c->freq_stddev = freq_stats.stddev;
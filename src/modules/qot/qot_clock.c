@@ -156,6 +156,22 @@ qot_return_t qot_clock_program_output_compare(timepoint_t *core_start, timelengt
     return QOT_RETURN_TYPE_OK;
 }
 
+/* Program input capture on a pin */
+qot_return_t qot_clock_program_input_capture(qot_extts_t *extts, int on, qot_return_t (*callback)(qot_extts_t *extts_ret, timepoint_t *event_core_timestamp))
+{
+    long retval = 0;
+    if (!core || !core->impl.enable_extts)
+        return QOT_RETURN_TYPE_ERR;
+    /* Enable or disable capture on the core clock driver */
+    retval = core->impl.enable_extts(extts, callback, on);
+    if(retval)
+    {
+        return QOT_RETURN_TYPE_ERR;
+    }
+    /* Success */
+    return QOT_RETURN_TYPE_OK;
+}
+
 /* Add Interrupt Latency uncertainity to a measurement */
 qot_return_t qot_clock_add_core_interrupt_latency(utimepoint_t *utp)
 {
@@ -71,6 +71,15 @@ qot_return_t qot_clock_program_core_interrupt(timepoint_t expiry, int force, lon
  **/
 qot_return_t qot_clock_program_output_compare(timepoint_t *core_start, timelength_t *core_period, qot_perout_t *perout, int on, qot_return_t (*callback)(qot_perout_t *perout_ret, timepoint_t *event_core_timestamp, timepoint_t *next_event));
 
+/**
+ * @brief Program input capture (external timestamping) on a pin
+ * @param extts Capture request (pin, edge, timeline and owner)
+ * @param on 1 to enable capture, 0 to disable
+ * @param callback Function called with the core timestamp of every capture
+ * @return A status code indicating success (0) or other (no more clocks)
+ **/
+qot_return_t qot_clock_program_input_capture(qot_extts_t *extts, int on, qot_return_t (*callback)(qot_extts_t *extts_ret, timepoint_t *event_core_timestamp));
+
 /**
  * @brief Add the uncertainity in interrupt latency to the callback
  * @param utp A pointer to an data structure to fill (add to)
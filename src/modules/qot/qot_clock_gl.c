@@ -35,6 +35,7 @@
 
 #include "qot_clock_gl.h"
 #include "qot_admin.h"
+#include "../../qot_uncertainty.h"
 
 /* Spinlock for Global Clock */
 static spinlock_t qot_clock_gl_lock;
@@ -42,6 +43,10 @@ static spinlock_t qot_clock_gl_lock;
 /* Global clock parameters */
 tl_translation_t clkgl_params;
 
+/* Global clock (t-t0)^(3/2) uncertainty tables */
+static qot_uncertainty_table_t clkgl_u_pow;
+static qot_uncertainty_table_t clkgl_l_pow;
+
 /* Public functions */
 
 /* read the disciplined global time */
@@ -67,8 +72,8 @@ qot_return_t qot_clock_gl_get_time(utimepoint_t *utp)
     TL_FROM_uSEC(utp->interval.above, 0);
 
     /* Calculate sync uncertainty */
-    u_timelinetime = div_s64(clkgl_params.u_mult*(ns - clkgl_params.last),1000000000L) + clkgl_params.u_nsec;
-    l_timelinetime = div_s64(clkgl_params.l_mult*(ns - clkgl_params.last),1000000000L) + clkgl_params.l_nsec;
+    u_timelinetime = qot_uncertainty_bound(clkgl_params.u_nsec, clkgl_params.u_mult, &clkgl_u_pow, ns - clkgl_params.last);
+    l_timelinetime = qot_uncertainty_bound(clkgl_params.l_nsec, clkgl_params.l_mult, &clkgl_l_pow, ns - clkgl_params.last);
 
     spin_unlock_irqrestore(&qot_clock_gl_lock, flags);
     
@@ -174,6 +179,10 @@ qot_return_t qot_clock_gl_set_uncertainty(qot_bounds_t bounds)
     clkgl_params.l_mult = (s32) bounds.l_drift; 
     clkgl_params.u_nsec = (s64) bounds.u_nsec;
     clkgl_params.l_nsec = (s64) bounds.l_nsec;
+    clkgl_params.u_pow = (s64) bounds.u_pow;
+    clkgl_params.l_pow = (s64) bounds.l_pow;
+    qot_uncertainty_build(&clkgl_u_pow, bounds.u_pow);
+    qot_uncertainty_build(&clkgl_l_pow, bounds.l_pow);
     spin_unlock_irqrestore(&qot_clock_gl_lock, flags);  
     return QOT_RETURN_TYPE_OK;
 }
@@ -247,6 +256,10 @@ qot_return_t qot_clock_gl_init(void)
     clkgl_params.l_nsec = 0;
     clkgl_params.u_mult = 0;
     clkgl_params.l_mult = 0;
+    clkgl_params.u_pow = 0;
+    clkgl_params.l_pow = 0;
+    qot_uncertainty_build(&clkgl_u_pow, 0);
+    qot_uncertainty_build(&clkgl_l_pow, 0);
     spin_lock_init(&qot_clock_gl_lock);
     return QOT_RETURN_TYPE_OK;
 }
@@ -45,6 +45,7 @@ typedef struct qot_clock_impl {
     long (*program_interrupt)(timepoint_t expiry, int force, long (*callback)(void));
     long (*cancel_interrupt)(void);
     long (*enable_compare)(timepoint_t *core_start, timelength_t *core_period, qot_perout_t *perout, qot_return_t (*callback)(qot_perout_t *perout_ret, timepoint_t *event_core_timestamp, timepoint_t *next_event), int on);
+    long (*enable_extts)(qot_extts_t *extts, qot_return_t (*callback)(qot_extts_t *extts_ret, timepoint_t *event_core_timestamp), int on);
     long (*sleep)(void);
     long (*wake)(void);
 } qot_clock_impl_t;
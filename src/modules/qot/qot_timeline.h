@@ -185,6 +185,15 @@ qot_return_t qot_loc2rem(int index, int period, s64 *val);
  **/
 qot_return_t qot_rem2loc(int index, int period, s64 *val);
 
+/**
+ * @brief Project a captured core timestamp using the discipline valid at capture time
+ * @param index Timeline index
+ * @param core_ts Core time at which the event was captured
+ * @param utp Pointer to the timeline time (with sync uncertainty) to fill
+ * @return A status code indicating success (0) or failure (!0)
+ **/
+qot_return_t qot_loc2rem_capture(int index, timepoint_t *core_ts, utimepoint_t *utp);
+
 /**
  * @brief Helper Function for qot_scheduler to make the timer field of a binding NULL
  * @param task pointer to a task struct
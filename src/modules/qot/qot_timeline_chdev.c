@@ -49,6 +49,7 @@
 #include "qot_timeline.h"
 #include "qot_scheduler.h"
 #include "qot_clock_gl.h"
+#include "../../qot_uncertainty.h"
 
 #define DEVICE_NAME "timeline"
 
@@ -64,6 +65,17 @@ static DEFINE_IDR(qot_timelines_map);
 
 static spinlock_t qot_timelines_lock;
 
+/* Number of past disciplines remembered for projecting captured timestamps */
+#define QOT_DISCIPLINE_HISTORY 8
+
+/* A past timeline discipline, and the core time until which it was valid */
+typedef struct qot_discipline {
+    s64 last;                   /* Discipline: last cycle count of               */
+    s64 mult;                   /* Discipline: ppb multiplier                    */
+    s64 nsec;                   /* Discipline: global time offset                */
+    s64 valid_until;            /* Core time (ns) at which it was replaced       */
+} qot_discipline_t;
+
 /* Private data for a timeline, not visible outside this code */
 typedef struct timeline_impl {
     qot_timeline_t *info;       /* Timeline info                                 */
@@ -80,6 +92,11 @@ typedef struct timeline_impl {
     s64 l_nsec;                 /* Discipline: global time for master            */
     s64 u_mult;                 /* Discipline: upper bound on ppb                */
     s64 l_mult;                 /* Discipline: lower bound on ppb                */
+    qot_uncertainty_table_t u_pow; /* Discipline: upper (t-t0)^(3/2) bound table */
+    qot_uncertainty_table_t l_pow; /* Discipline: lower (t-t0)^(3/2) bound table */
+    qot_discipline_t history[QOT_DISCIPLINE_HISTORY]; /* Past disciplines   */
+    int history_head;           /* Next slot to be written in the history        */
+    int history_count;          /* Number of valid entries in the history        */
     u32 mult_adj;               /* Adjustment: mult to prevent precision loss    */
     u32 shift_adj;              /* Adjustment: shift to prevent precision loss   */
     spinlock_t lock;            /* Protects driver time registers                */
@@ -358,6 +375,67 @@ qot_return_t qot_rem2loc(int index, int period, s64 *val)
     return QOT_RETURN_TYPE_OK;
 }
 
+/* Remember the current discipline before it is changed (timeline lock held) */
+static inline void qot_timeline_save_discipline(timeline_impl_t *timeline_impl, s64 now)
+{
+    qot_discipline_t *entry = &timeline_impl->history[timeline_impl->history_head];
+    entry->last = timeline_impl->last;
+    entry->mult = timeline_impl->mult;
+    entry->nsec = timeline_impl->nsec;
+    entry->valid_until = now;
+    timeline_impl->history_head = (timeline_impl->history_head + 1) % QOT_DISCIPLINE_HISTORY;
+    if (timeline_impl->history_count < QOT_DISCIPLINE_HISTORY)
+        timeline_impl->history_count++;
+}
+
+qot_return_t qot_loc2rem_capture(int index, timepoint_t *core_ts, utimepoint_t *utp)
+{
+    timeline_impl_t *timeline_impl = idr_find(&qot_timelines_map, index);
+    qot_discipline_t *entry;
+    unsigned long flags;
+    s64 coretime, last, mult, nsec;
+    s64 timelinetime, u_timelinetime, l_timelinetime;
+    int i, slot;
+
+    if (timeline_impl == NULL || !core_ts || !utp)
+        return QOT_RETURN_TYPE_ERR;
+
+    coretime = TP_TO_nSEC(*core_ts);
+    spin_lock_irqsave(&timeline_impl->lock, flags);
+    last = timeline_impl->last;
+    mult = timeline_impl->mult;
+    nsec = timeline_impl->nsec;
+
+    /* Walk back to the discipline which was in force at the capture instant */
+    slot = timeline_impl->history_head;
+    for (i = 0; i < timeline_impl->history_count; i++)
+    {
+        slot = (slot + QOT_DISCIPLINE_HISTORY - 1) % QOT_DISCIPLINE_HISTORY;
+        entry = &timeline_impl->history[slot];
+        if (coretime >= entry->valid_until)
+            break;
+        last = entry->last;
+        mult = entry->mult;
+        nsec = entry->nsec;
+    }
+
+    timelinetime = nsec + (coretime - last) + div_s64(mult * (coretime - last), 1000000000L);
+    u_timelinetime = timelinetime + qot_uncertainty_bound(timeline_impl->u_nsec, timeline_impl->u_mult, &timeline_impl->u_pow, coretime - last);
+    l_timelinetime = timelinetime + qot_uncertainty_bound(timeline_impl->l_nsec, timeline_impl->l_mult, &timeline_impl->l_pow, coretime - last);
+    spin_unlock_irqrestore(&timeline_impl->lock, flags);
+
+    TP_FROM_nSEC(utp->estimate, timelinetime);
+    if(u_timelinetime > timelinetime)
+        TL_FROM_nSEC(utp->interval.above, u_timelinetime - timelinetime);
+    else
+        TL_FROM_nSEC(utp->interval.above, 0);
+    if(timelinetime > l_timelinetime)
+        TL_FROM_nSEC(utp->interval.below, timelinetime - l_timelinetime);
+    else
+        TL_FROM_nSEC(utp->interval.below, 0);
+    return QOT_RETURN_TYPE_OK;
+}
+
 /* Helper Function to calculate mult and shift for preventing loss of precision during time conversion */ 
 void clocks_calc_mult_shift(u32 *mult, u32 *shift, u32 from, u32 to, u32 maxsec)
 {
@@ -406,6 +484,7 @@ static int qot_timeline_clock_adjfreq(struct posix_clock *pc, s32 ppb)
         return 1;
     }
     ns = TP_TO_nSEC(utp.estimate);
+    qot_timeline_save_discipline(timeline_impl, ns);
     // The order of the next two statements is interchanged -> Sandeep
     timeline_impl->nsec += (ns - timeline_impl->last)
         + div_s64(timeline_impl->mult * (ns - timeline_impl->last),1000000000L); // ULL Changed to L -> Sandeep
@@ -432,6 +511,7 @@ static int qot_timeline_clock_adjtime(struct posix_clock *pc, s64 delta)
     }
 
     ns = TP_TO_nSEC(utp.estimate);
+    qot_timeline_save_discipline(timeline_impl, ns);
     timeline_impl->nsec += delta; 
     // Added for virt-host support
     timeline_impl->sync_update_flag = 1;
@@ -471,6 +551,7 @@ static int qot_timeline_chdev_settime(struct posix_clock *pc,
     }
 
     ns = TP_TO_nSEC(utp.estimate);
+    qot_timeline_save_discipline(timeline_impl, ns);
     timeline_impl->last = ns;
     timeline_impl->nsec = timespec_to_ns(tp);
     // Added for virt-host support
@@ -742,6 +823,8 @@ static long qot_timeline_chdev_ioctl(struct posix_clock *pc, unsigned int cmd, u
             timeline_impl->l_mult = (s32) bounds.l_drift; 
             timeline_impl->u_nsec = (s64) bounds.u_nsec;
             timeline_impl->l_nsec = (s64) bounds.l_nsec;
+            qot_uncertainty_build(&timeline_impl->u_pow, bounds.u_pow);
+            qot_uncertainty_build(&timeline_impl->l_pow, bounds.l_pow);
             spin_unlock_irqrestore(&timeline_impl->lock, flags);
         }
         else
@@ -764,8 +847,8 @@ static long qot_timeline_chdev_ioctl(struct posix_clock *pc, unsigned int cmd, u
 
             spin_lock_irqsave(&timeline_impl->lock, flags);
             /* Add Uncertainty */
-            u_timelinetime = timelinetime + div_s64(timeline_impl->u_mult*(coretime - timeline_impl->last),1000000000L) + timeline_impl->u_nsec;
-            l_timelinetime = timelinetime + div_s64(timeline_impl->l_mult*(coretime - timeline_impl->last),1000000000L) + timeline_impl->l_nsec;
+            u_timelinetime = timelinetime + qot_uncertainty_bound(timeline_impl->u_nsec, timeline_impl->u_mult, &timeline_impl->u_pow, coretime - timeline_impl->last);
+            l_timelinetime = timelinetime + qot_uncertainty_bound(timeline_impl->l_nsec, timeline_impl->l_mult, &timeline_impl->l_pow, coretime - timeline_impl->last);
 
             spin_unlock_irqrestore(&timeline_impl->lock, flags);
             TP_FROM_nSEC(stp.u_estimate, u_timelinetime);
@@ -780,8 +863,8 @@ static long qot_timeline_chdev_ioctl(struct posix_clock *pc, unsigned int cmd, u
             TP_FROM_nSEC(stp.estimate, timelinetime);
 
             /* Add Uncertainty */
-            u_timelinetime = timelinetime + div_s64(timeline_impl->u_mult*(coretime - timeline_impl->last),1000000000L) + timeline_impl->u_nsec;
-            l_timelinetime = timelinetime + div_s64(timeline_impl->l_mult*(coretime - timeline_impl->last),1000000000L) + timeline_impl->l_nsec;
+            u_timelinetime = timelinetime + qot_uncertainty_bound(timeline_impl->u_nsec, timeline_impl->u_mult, &timeline_impl->u_pow, coretime - timeline_impl->last);
+            l_timelinetime = timelinetime + qot_uncertainty_bound(timeline_impl->l_nsec, timeline_impl->l_mult, &timeline_impl->l_pow, coretime - timeline_impl->last);
 
             TP_FROM_nSEC(stp.u_estimate, u_timelinetime);
             TP_FROM_nSEC(stp.l_estimate, l_timelinetime);
@@ -849,8 +932,8 @@ static long qot_timeline_chdev_ioctl(struct posix_clock *pc, unsigned int cmd, u
             spin_lock_irqsave(&timeline_impl->lock, flags);
 
             /* Calculate sync uncertainty */
-            u_timelinetime = timelinetime + div_s64(timeline_impl->u_mult*(coretime - timeline_impl->last),1000000000L) + timeline_impl->u_nsec;
-            l_timelinetime = timelinetime + div_s64(timeline_impl->l_mult*(coretime - timeline_impl->last),1000000000L) + timeline_impl->l_nsec;
+            u_timelinetime = timelinetime + qot_uncertainty_bound(timeline_impl->u_nsec, timeline_impl->u_mult, &timeline_impl->u_pow, coretime - timeline_impl->last);
+            l_timelinetime = timelinetime + qot_uncertainty_bound(timeline_impl->l_nsec, timeline_impl->l_mult, &timeline_impl->l_pow, coretime - timeline_impl->last);
 
             spin_unlock_irqrestore(&timeline_impl->lock, flags);
             sync_uncertainty.estimate.sec = 0;
@@ -922,6 +1005,8 @@ static long qot_timeline_chdev_ioctl(struct posix_clock *pc, unsigned int cmd, u
             timeline_params.l_nsec = timeline_impl->l_nsec;                          /* Discipline: global time for master  */
             timeline_params.u_mult = timeline_impl->u_mult;                          /* Discipline: upper bound on ppb      */
             timeline_params.l_mult = timeline_impl->l_mult;                          /* Discipline: lower bound on ppb      */
+            timeline_params.u_pow  = timeline_impl->u_pow.coef;                      /* Discipline: upper (t-t0)^(3/2) coef */
+            timeline_params.l_pow  = timeline_impl->l_pow.coef;                      /* Discipline: lower (t-t0)^(3/2) coef */
             spin_unlock_irqrestore(&timeline_impl->lock, flags);
         }
         else
@@ -1068,6 +1153,10 @@ int qot_timeline_chdev_register(qot_timeline_t *info)
     timeline_impl->l_nsec = 0;
     timeline_impl->u_mult = 0;
     timeline_impl->l_mult = 0;
+    qot_uncertainty_build(&timeline_impl->u_pow, 0);
+    qot_uncertainty_build(&timeline_impl->l_pow, 0);
+    timeline_impl->history_head = 0;
+    timeline_impl->history_count = 0;
     timeline_impl->dialed_frequency = 0;
     timeline_impl->max_adj = 1000000;
 
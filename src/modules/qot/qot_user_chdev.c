@@ -58,6 +58,9 @@ typedef struct qot_user_chdev_con {
     int event_flag;                     /* Data ready flag      */
     struct list_head event_list;        /* Event list           */
     raw_spinlock_t list_lock;           /* Event list Lock      */
+    qot_extts_t extts;                  /* Capture it enabled   */
+    int extts_enabled;                  /* Capture is active    */
+    int muted;                          /* No timeline events   */
 } qot_user_chdev_con_t;
 
 /* Information required to open a character device */
@@ -144,6 +147,11 @@ static int qot_user_timeline_create_notify(qot_timeline_t *timeline)
     while(con_node != NULL)
     {
         con = container_of(con_node, struct qot_user_chdev_con, node);   
+        // Control-only connections never read their events
+        if (con->muted) {
+            con_node = rb_next(con_node);
+            continue;
+        }
         event = kzalloc(sizeof(event_t), GFP_KERNEL);
         if (!event) {
             pr_warn("qot_user_chdev: failed to allocate event\n");
@@ -232,6 +240,44 @@ static qot_return_t qot_perout_notify(qot_perout_t *perout, timepoint_t *event_c
     return QOT_RETURN_TYPE_OK;
 }
 
+// TIME PROJECTION FOR INPUT CAPTURE (EXTERNAL TIMESTAMPS) ////////////////////////////
+static qot_return_t qot_extts_notify(qot_extts_t *extts, timepoint_t *event_core_timestamp)
+{
+    unsigned long flags;
+    event_t *event;
+    qot_user_chdev_con_t *con = qot_user_chdev_con_search(extts->owner_file);
+    if (!con) {
+        pr_err("qot_user_chdev: could not find user chdev connection\n");
+        return QOT_RETURN_TYPE_ERR;
+    }
+
+    // Called from the capture interrupt, so the allocation must not sleep
+    event = kzalloc(sizeof(event_t), GFP_ATOMIC);
+    if (!event) {
+        pr_warn("qot_user_chdev: failed to allocate event\n");
+        return QOT_RETURN_TYPE_ERR;
+    }
+
+    // Project with the discipline that was valid when the edge was captured
+    if (qot_loc2rem_capture(extts->timeline.index, event_core_timestamp, &event->info.timestamp)) {
+        kfree(event);
+        return QOT_RETURN_TYPE_ERR;
+    }
+
+    // Populate event information
+    event->info.type = QOT_EVENT_EXTERNAL_TIMESTAMP;
+    strncpy(event->info.data, extts->timeline.name, QOT_MAX_NAMELEN);
+
+    // Add event to the event list corresponding to the connection
+    raw_spin_lock_irqsave(&con->list_lock, flags);
+    list_add_tail(&event->list, &con->event_list);
+    con->event_flag = 1;
+    raw_spin_unlock_irqrestore(&con->list_lock, flags);
+    wake_up_interruptible(&con->wq);
+
+    return QOT_RETURN_TYPE_OK;
+}
+
 /* chardev ioctl open callback implementation */
 static int qot_user_chdev_ioctl_open(struct inode *i, struct file *f)
 {
@@ -290,6 +336,13 @@ static int qot_user_chdev_ioctl_close(struct inode *i, struct file *f)
         pr_err("qot_user_chdev: could not find ioctl connection\n");
         return -ENOMEM;
     }
+    /* Stop the capture this connection owns, so that the driver neither keeps
+       raising it nor matches a later file allocated at the same address */
+    if (con->extts_enabled) {
+        if (qot_clock_program_input_capture(&con->extts, 0, qot_extts_notify))
+            pr_warn("qot_user_chdev: failed to release input capture\n");
+        con->extts_enabled = 0;
+    }
     qot_user_chdev_con_remove(con);
     qot_user_chdev_con_free(con);
     return 0;
@@ -300,6 +353,7 @@ static long qot_user_chdev_ioctl_access(struct file *f, unsigned int cmd,
     unsigned long arg)
 {
     int retval;
+    unsigned long flags;
     event_t *event;
     qot_event_t msge;
     qot_timeline_t msgt;
@@ -316,6 +370,8 @@ static long qot_user_chdev_ioctl_access(struct file *f, unsigned int cmd,
 
     qot_clock_t msgc;
 
+    qot_extts_t extts;
+
     qot_user_chdev_con_t *con = qot_user_chdev_con_search(f);
     if (!con)
         return -EACCES;
@@ -444,6 +500,35 @@ static long qot_user_chdev_ioctl_access(struct file *f, unsigned int cmd,
         if(qot_clock_program_output_compare(&core_start, &core_period, &perout, 0, qot_perout_notify))
             return -EACCES;
         break;
+    case QOTUSR_INPUT_CAPTURE_ENABLE:
+    case QOTUSR_INPUT_CAPTURE_DISABLE:
+        if (copy_from_user(&extts, (qot_extts_t*)arg, sizeof(qot_extts_t)))
+            return -EACCES;
+        timeline = &extts.timeline;
+        extts.owner_file = f;
+        // Check if the timeline exists
+        if (qot_timeline_get_info(&timeline))
+            return -EACCES;
+        // Captures are in core time, so only local timelines can be projected
+        if (timeline->type != QOT_TIMELINE_LOCAL)
+            return -EINVAL;
+
+        extts.timeline = *timeline;
+        // Enable or disable timestamping on the core clock driver
+        if(qot_clock_program_input_capture(&extts, (cmd == QOTUSR_INPUT_CAPTURE_ENABLE), qot_extts_notify))
+            return -EACCES;
+        // Remember the capture, so that closing the file releases it
+        con->extts = extts;
+        con->extts_enabled = (cmd == QOTUSR_INPUT_CAPTURE_ENABLE);
+        break;
+    /* Stop queueing timeline events on a connection used only for control */
+    case QOTUSR_MUTE_EVENTS:
+        raw_spin_lock_irqsave(&con->list_lock, flags);
+        con->muted = 1;
+        con->event_flag = 0;
+        qot_user_chdev_con_free(con);
+        raw_spin_unlock_irqrestore(&con->list_lock, flags);
+        break;
     default:
         return -EINVAL;
     }
@@ -101,6 +101,12 @@ struct qot_am335x_compare_interface{
 	qot_return_t (*callback)(qot_perout_t *perout_ret, timepoint_t *event_core_timestamp, timepoint_t *next_event_time);	/* Time Conversion Callback */
 };
 
+struct qot_am335x_capture_interface{
+	qot_extts_t extts;						/* External Timestamp Request  		  */
+	int key;								/* Key to enable single access        */
+	qot_return_t (*callback)(qot_extts_t *extts_ret, timepoint_t *event_core_timestamp);	/* Time Projection Callback */
+};
+
 struct qot_am335x_sched_interface {
 	struct qot_am335x_data *parent;			/* Pointer to parent */
 	struct omap_dm_timer *timer;
@@ -130,6 +136,7 @@ struct qot_am335x_data {
 	struct qot_am335x_sched_interface core_sched;	/* Scheduler Interface */
 	struct qot_clock_impl qot_am335x_impl_info; 	/* QoT Info */
 	struct qot_am335x_compare_interface compare;    /* Compare Interface */
+	struct qot_am335x_capture_interface capture;    /* Capture Interface */
 };
 
 static void omap_dm_timer_setup_capture(struct omap_dm_timer *timer, u32 edge) {
@@ -397,6 +404,7 @@ static irqreturn_t qot_am335x_interrupt(int irq, void *data)
 	unsigned long flags;
 	unsigned int irq_status;
 	struct ptp_clock_event pevent;
+	timepoint_t event_core_timestamp;
 	struct qot_am335x_channel *channel = data;
 	raw_spin_lock_irqsave(&channel->parent->lock, flags);
 	irq_status = omap_dm_timer_read_status(channel->timer);
@@ -409,6 +417,13 @@ static irqreturn_t qot_am335x_interrupt(int irq, void *data)
 			pevent.type = PTP_CLOCK_EXTTS;
 			pevent.index = channel->state.extts.index;
 			ptp_clock_event(channel->parent->clock, &pevent);
+			// Hand the capture to the QoT core for projection onto the timeline
+			if (channel->parent->capture.callback
+			    && channel->parent->capture.extts.pin_index == pevent.index)
+			{
+				TP_FROM_nSEC(event_core_timestamp, (s64) pevent.timestamp);
+				channel->parent->capture.callback(&channel->parent->capture.extts, &event_core_timestamp);
+			}
 			qot_am335x_overflow(channel); // Fatima: Fix for time going backward in capture
 		}
 		break;
@@ -613,6 +628,59 @@ static long qot_am335x_timeline_enable_compare(timepoint_t *core_start, timeleng
 	return 0;
 }
 
+static long qot_am335x_timeline_enable_extts(qot_extts_t *extts, qot_return_t (*callback)(qot_extts_t *extts_ret, timepoint_t *event_core_timestamp), int on)
+{
+	unsigned long flags;
+	struct qot_am335x_data *pdata = qot_am335x_data_ptr;
+	struct qot_am335x_channel *channel;
+
+	if (extts->pin_index < 0 || extts->pin_index >= pdata->num_pins)
+		return -EINVAL;
+	channel = &pdata->pins[extts->pin_index];
+
+	raw_spin_lock_irqsave(&pdata->lock, flags);
+	if(pdata->capture.key != 0 && pdata->capture.extts.owner_file != extts->owner_file)
+	{
+		raw_spin_unlock_irqrestore(&pdata->lock, flags);
+		pr_info("enable_extts: capture is in use\n");
+		return 1;
+	}
+	if(on)
+	{
+		pdata->capture.key = 1;
+		pdata->capture.extts = *extts;
+		pdata->capture.callback = callback;
+	}
+	else
+	{
+		pdata->capture.key = 0;
+		pdata->capture.callback = NULL;
+		pdata->capture.extts.owner_file = NULL;
+	}
+	raw_spin_unlock_irqrestore(&pdata->lock, flags);
+
+	// Set PTP state (the same path as a PTP_CLK_REQ_EXTTS request)
+	channel->state.type = PTP_CLK_REQ_EXTTS;
+	channel->state.extts.index = extts->pin_index;
+	channel->state.extts.flags = PTP_ENABLE_FEATURE;
+	if (extts->edge & QOT_TRIGGER_RISING)
+		channel->state.extts.flags |= PTP_RISING_EDGE;
+	if (extts->edge & QOT_TRIGGER_FALLING)
+		channel->state.extts.flags |= PTP_FALLING_EDGE;
+	pr_info("enable_extts: timeline %d, pin %d, on %d\n", extts->timeline.index, extts->pin_index, on);
+
+	if(qot_am335x_extts(channel, (on ? EVENT_START : EVENT_STOP)) < 0)
+	{
+		raw_spin_lock_irqsave(&pdata->lock, flags);
+		pdata->capture.key = 0;
+		pdata->capture.callback = NULL;
+		pdata->capture.extts.owner_file = NULL;
+		raw_spin_unlock_irqrestore(&pdata->lock, flags);
+		return 1;
+	}
+	return 0;
+}
+
 static int qot_am335x_verify(struct ptp_clock_info *ptp, unsigned int pin,
                              enum ptp_pin_function func, unsigned int chan)
 {
@@ -959,6 +1027,7 @@ struct qot_clock_impl qot_am335x_impl_info = {
 	.program_interrupt =  qot_am335x_program_sched_interrupt,
 	.cancel_interrupt = qot_am335x_cancel_sched_interrupt,
 	.enable_compare = qot_am335x_timeline_enable_compare,
+	.enable_extts = qot_am335x_timeline_enable_extts,
 	.sleep = qot_am335x_sleep,
 	.wake = qot_am335x_wake
 };
@@ -1227,6 +1296,11 @@ static struct qot_am335x_data *qot_am335x_of_parse(struct platform_device *pdev)
 	pdata->compare.reprogram_flag = 0;
 	pdata->compare.callback = NULL; // Initialize to NULL
 
+	/* Initialize key for input capture */
+	pdata->capture.key = 0;
+	pdata->capture.callback = NULL;
+	pdata->capture.extts.owner_file = NULL;
+
 	/* Return the platform data */
 	return pdata;
 
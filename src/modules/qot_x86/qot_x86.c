@@ -36,6 +36,14 @@
 #include <linux/slab.h>
 #include <linux/clk.h>
 #include <linux/hrtimer.h>
+#include <linux/clocksource.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+
+/* Invariant TSC support */
+#include <asm/cpufeature.h>
+#include <asm/msr.h>
+#include <asm/tsc.h>
 
 /* Paravirtual Extensions */
 #ifdef PARAVIRT_GUEST
@@ -66,6 +74,49 @@ static struct qot_x86_data *qot_x86_data_ptr = NULL;
 // Global starting offset of core clock
 s64 offset;
 
+// TSC Core Clock Mode (used only on invariant TSC machines). Guests keep the
+// pvclock, which the host shares and pv_offset is measured against
+#ifdef PARAVIRT_GUEST
+static bool use_tsc = false;
+module_param(use_tsc, bool, 0444);
+MODULE_PARM_DESC(use_tsc, "Use the invariant TSC as a lockless core clock source (default 0 in guests)");
+#else
+static bool use_tsc = true;
+module_param(use_tsc, bool, 0444);
+MODULE_PARM_DESC(use_tsc, "Use the invariant TSC as a lockless core clock source (default 1)");
+#endif
+
+// TSC calibration, written once at probe and read-only thereafter. It is
+// exported read-only through sysfs so that userspace may read core time
+// directly without a syscall:
+//   core_ns = tsc_ns_base + (((rdtscp() - tsc_base) * tsc_mult) >> tsc_shift)
+// The product (rdtscp() - tsc_base) * tsc_mult needs 128 bits: mult is chosen
+// for precision, so a 64-bit product overflows within seconds of calibration.
+// Without a 128-bit multiply, split the delta into whole and fractional parts:
+//   delta = rdtscp() - tsc_base
+//   core_ns = tsc_ns_base + (delta >> tsc_shift) * tsc_mult
+//           + (((delta & ((1 << tsc_shift) - 1)) * tsc_mult) >> tsc_shift)
+static bool tsc_enabled = false;
+static u32 tsc_mult  = 0;
+static u32 tsc_shift = 0;
+static u64 tsc_base  = 0;
+static u64 tsc_ns_base = 0;
+module_param(tsc_enabled, bool, 0444);
+MODULE_PARM_DESC(tsc_enabled, "Set when the TSC core clock mode is active");
+module_param(tsc_mult, uint, 0444);
+MODULE_PARM_DESC(tsc_mult, "TSC to nanosecond multiplier");
+module_param(tsc_shift, uint, 0444);
+MODULE_PARM_DESC(tsc_shift, "TSC to nanosecond shift");
+module_param(tsc_base, ullong, 0444);
+MODULE_PARM_DESC(tsc_base, "TSC value at calibration");
+module_param(tsc_ns_base, ullong, 0444);
+MODULE_PARM_DESC(tsc_ns_base, "Core time (ns, without offset) at calibration");
+
+// Software External Timestamp Source (x86 has no capture pins)
+static ulong swextts_period_ns = 1000000;
+module_param(swextts_period_ns, ulong, 0644);
+MODULE_PARM_DESC(swextts_period_ns, "Period (ns) of the software external timestamp source (default 1ms)");
+
 // Paravirtual Extensions
 #ifdef PARAVIRT_GUEST
 static struct pvclock_vsyscall_time_info *hv_clock;
@@ -81,13 +132,22 @@ struct qot_x86_sched_interface {
 	long (*callback)(void);                         /* QoT Callback           */
 };
 
+// Software Capture Interface
+struct qot_x86_capture_interface {
+	spinlock_t lock;                                /* Protects the request   */
+	struct hrtimer timer;                           /* Generates soft edges   */
+	qot_extts_t extts;                              /* External Timestamp Req */
+	int key;                                        /* Single access key      */
+	qot_return_t (*callback)(qot_extts_t *extts_ret, timepoint_t *event_core_timestamp); /* QoT Callback */
+};
+
 // Platform Data Structure
 struct qot_x86_data {
-	raw_spinlock_t lock;						/* Protects timer registers */
 	struct ptp_clock *clock;					/* PTP clock */
 	struct ptp_clock_info info;					/* PTP clock info */
 	struct qot_clock_impl *qot_x86_impl_info; 	/* QoT Info */
 	struct qot_x86_sched_interface core_sched;	/* Scheduler Interface */
+	struct qot_x86_capture_interface capture;	/* Software Capture Interface */
 };
 
 #ifdef PARAVIRT_GUEST
@@ -130,49 +190,69 @@ cycle_t qot_x86_pvclock_clocksource_read(struct pvclock_vcpu_time_info *src)
 }
 #endif
 
-// PTP CLOCK FUNCTIONALITY //////////////////////////////////////////////////////////
-static int qot_x86_adjfreq(struct ptp_clock_info *ptp, s32 ppb)
+// Check if the TSC is invariant and consistent across CPUs, and calibrate it
+static int qot_x86_tsc_calibrate(void)
 {
-	// Core Clock is Strictly Monotonic and Raw (no frequency adjustments or jumps)
-	return -EOPNOTSUPP;
-}
+	unsigned long flags;
 
-static int qot_x86_adjtime(struct ptp_clock_info *ptp, s64 delta)
-{
-	// Core Clock is Strictly Monotonic and Raw (no frequency adjustments or jumps)
-	return -EOPNOTSUPP;
+	if (!use_tsc)
+		return -EPERM;
+	if (!boot_cpu_has(X86_FEATURE_CONSTANT_TSC) || !boot_cpu_has(X86_FEATURE_NONSTOP_TSC))
+		return -ENODEV;
+	if (check_tsc_unstable() || !tsc_khz)
+		return -ENODEV;
+
+	// Reads use a 128-bit intermediate product, so favour precision over range
+	clocks_calc_mult_shift(&tsc_mult, &tsc_shift, tsc_khz, NSEC_PER_MSEC, 0);
+
+	// Capture the TSC and CLOCK_REALTIME as close to each other as possible
+	local_irq_save(flags);
+	tsc_base = rdtsc_ordered();
+	tsc_ns_base = ktime_get_real_ns();
+	local_irq_restore(flags);
+	return 0;
 }
 
-static int qot_x86_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
+// Read the core clock in nanoseconds (without the global offset), lockless
+static inline u64 qot_x86_read_ns(void)
 {
-	struct timespec raw_monotonic_ts;
-	unsigned long flags;
-	
 	#ifdef PARAVIRT_GUEST
 	struct pvclock_vcpu_time_info *src;
 	u64 ret;
-	int cpu;
 	#endif
 
-	struct qot_x86_data *pdata = container_of(
-    	ptp, struct qot_x86_data, info);
+	if (tsc_enabled)
+		return tsc_ns_base + mul_u64_u32_shr(rdtsc_ordered() - tsc_base, tsc_mult, tsc_shift);
 
-	raw_spin_lock_irqsave(&pdata->lock, flags);
 	#ifdef PARAVIRT_GUEST
+	// The pvclock page is protected by its own version counter
 	preempt_disable_notrace();
-	cpu = smp_processor_id();
-	src = &hv_clock[cpu].pvti;	
+	src = &hv_clock[smp_processor_id()].pvti;
 	ret = qot_x86_pvclock_clocksource_read(src);
-	raw_monotonic_ts = ns_to_timespec(ret);
 	preempt_enable_notrace();
+	return ret;
 	#else
-	// Grab a raw monotonic timestamp from the clocksource
-	//getrawmonotonic(&raw_monotonic_ts);
-	//ktime_get_ts(&raw_monotonic_ts);
-	ktime_get_real_ts(&raw_monotonic_ts);
+	// Grab a timestamp from the timekeeper (internally seqcount protected)
+	return ktime_get_real_ns();
 	#endif
-	raw_spin_unlock_irqrestore(&pdata->lock, flags);
-	*ts = timespec_to_timespec64(timespec_add(raw_monotonic_ts, ns_to_timespec(offset)));
+}
+
+// PTP CLOCK FUNCTIONALITY //////////////////////////////////////////////////////////
+static int qot_x86_adjfreq(struct ptp_clock_info *ptp, s32 ppb)
+{
+	// Core Clock is Strictly Monotonic and Raw (no frequency adjustments or jumps)
+	return -EOPNOTSUPP;
+}
+
+static int qot_x86_adjtime(struct ptp_clock_info *ptp, s64 delta)
+{
+	// Core Clock is Strictly Monotonic and Raw (no frequency adjustments or jumps)
+	return -EOPNOTSUPP;
+}
+
+static int qot_x86_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts)
+{
+	*ts = ns_to_timespec64((s64)qot_x86_read_ns() + offset);
 	return 0;
 }
 
@@ -237,35 +317,9 @@ static struct ptp_clock_info qot_x86_info = {
 static timepoint_t qot_x86_read_time(void)
 {
 	s64 ns;
-	struct timespec raw_monotonic_ts;
 	timepoint_t time_now;
-	unsigned long flags;
-	struct qot_x86_data *pdata;
 
-	#ifdef PARAVIRT_GUEST
-	struct pvclock_vcpu_time_info *src;
-	u64 ret;
-	int cpu;
-	#endif
-
-	pdata = qot_x86_data_ptr;
-
-	raw_spin_lock_irqsave(&pdata->lock, flags);
-	#ifdef PARAVIRT_GUEST
-	preempt_disable_notrace();
-	cpu = smp_processor_id();
-	src = &hv_clock[cpu].pvti;	
-	ret = qot_x86_pvclock_clocksource_read(src);
-	raw_monotonic_ts = ns_to_timespec(ret);
-	preempt_enable_notrace();
-	#else
-	// Grab a raw monotonic timestamp from the clocksource
-	//getrawmonotonic(&raw_monotonic_ts);
-	//ktime_get_ts(&raw_monotonic_ts);
-	ktime_get_real_ts(&raw_monotonic_ts);
-	#endif
-	raw_spin_unlock_irqrestore(&pdata->lock, flags);
-	ns = offset + timespec_to_ns(&raw_monotonic_ts);
+	ns = offset + (s64)qot_x86_read_ns();
 	TP_FROM_nSEC(time_now, (s64)ns);
 	return time_now;
 }
@@ -276,26 +330,70 @@ static long qot_x86_timeline_enable_compare(timepoint_t *core_start, timelength_
 	return -EOPNOTSUPP;
 }
 
+// SOFTWARE INPUT CAPTURE ///////////////////////////////////////////////////////
+// Emulates a capture pin with a periodic hrtimer, so that the full external
+// timestamp pipeline of the QoT core can be exercised without hardware
+static long qot_x86_timeline_enable_extts(qot_extts_t *extts, qot_return_t (*callback)(qot_extts_t *extts_ret, timepoint_t *event_core_timestamp), int on)
+{
+	unsigned long flags;
+	struct qot_x86_capture_interface *capture = &qot_x86_data_ptr->capture;
+
+	spin_lock_irqsave(&capture->lock, flags);
+	if(capture->key != 0 && capture->extts.owner_file != extts->owner_file)
+	{
+		spin_unlock_irqrestore(&capture->lock, flags);
+		pr_info("qot_x86: software capture is in use\n");
+		return 1;
+	}
+	if(!on)
+	{
+		capture->key = 0;
+		spin_unlock_irqrestore(&capture->lock, flags);
+		hrtimer_cancel(&capture->timer);
+		capture->callback = NULL;
+		capture->extts.owner_file = NULL;
+		return 0;
+	}
+	capture->key = 1;
+	capture->extts = *extts;
+	capture->callback = callback;
+	spin_unlock_irqrestore(&capture->lock, flags);
+
+	pr_info("qot_x86: software capture on timeline %d every %lu ns\n", extts->timeline.index, swextts_period_ns);
+	hrtimer_start(&capture->timer, ns_to_ktime(swextts_period_ns), HRTIMER_MODE_REL);
+	return 0;
+}
+
+// Software Capture Timer Interrupt (uses HRTIMER Callback)
+static enum hrtimer_restart qot_x86_capture_interrupt(struct hrtimer *timer)
+{
+	struct qot_x86_capture_interface *capture = &qot_x86_data_ptr->capture;
+	timepoint_t event_core_timestamp;
+
+	/* Timestamp the software edge as close to the interrupt as possible */
+	event_core_timestamp = qot_x86_read_time();
+	if(capture->callback)
+		capture->callback(&capture->extts, &event_core_timestamp);
+	hrtimer_forward_now(timer, ns_to_ktime(swextts_period_ns));
+	return HRTIMER_RESTART;
+}
+
 // SCHEDULER INTERFACE TIMER ///////////////////////////////////////////////////
 // Interface function to qot_core, used to program the scheduler interface interrupt using a timepoint_t value
 static long qot_x86_program_sched_interrupt(timepoint_t expiry, int force, long (*callback)(void))
 {
-	unsigned long flags;
 	struct qot_x86_sched_interface *interface;
 	u64 ns;
-	struct timespec ns_ts;
 	u64 expiry_ns;
 	struct qot_x86_data *pdata;
 	
 	pdata = qot_x86_data_ptr;
 	interface = &pdata->core_sched;
 	expiry_ns = TP_TO_nSEC(expiry);
-	raw_spin_lock_irqsave(&pdata->lock, flags);
-	//getrawmonotonic(&ns_ts);
-	//ktime_get_ts(&ns_ts);
-	ktime_get_real_ts(&ns_ts);
-	raw_spin_unlock_irqrestore(&pdata->lock, flags);
-	ns = (u64)timespec_to_ns(&ns_ts);
+	if (tsc_enabled)
+		ns = (u64)(offset + (s64)qot_x86_read_ns());
+	else
+		ns = (u64)ktime_get_real_ns();
 
 	// Check if expiry is not behind current time Else return error code
 	if(expiry_ns <= ns)
@@ -303,6 +401,12 @@ static long qot_x86_program_sched_interrupt(timepoint_t expiry, int force, long
 		return -EINVAL;
 	}
 	interface->callback = callback;
+	// The TSC is not slewed along with CLOCK_REALTIME, so program a relative expiry
+	if (tsc_enabled)
+	{
+		hrtimer_start_range_ns(&interface->timer, ns_to_ktime(expiry_ns-ns), 0ULL, HRTIMER_MODE_REL);
+		return 0;
+	}
 	// May need to consider using pinned timers
 	#ifdef PARAVIRT_GUEST
 	hrtimer_start_range_ns(&interface->timer, ns_to_ktime(expiry_ns-offset-pv_offset), 0ULL, HRTIMER_MODE_ABS);
@@ -352,6 +456,8 @@ static void qot_x86_cleanup(struct qot_x86_data *pdata)
 {
 	pr_info("qot_x86: Cleaning up...\n");
 	if (pdata) {
+		/* Stop the software capture source */
+		hrtimer_cancel(&pdata->capture.timer);
 		/* Remove the PTP clock */
 		ptp_clock_unregister(pdata->clock);
 	}
@@ -369,6 +475,7 @@ struct qot_clock_impl qot_x86_impl_info = {
 	.program_interrupt =  qot_x86_program_sched_interrupt,
 	.cancel_interrupt = qot_x86_cancel_sched_interrupt,
 	.enable_compare = qot_x86_timeline_enable_compare,
+	.enable_extts = qot_x86_timeline_enable_extts,
 	.sleep = qot_x86_sleep,
 	.wake = qot_x86_wake
 };
@@ -388,9 +495,13 @@ static struct qot_x86_data *qot_x86_initialize(struct platform_device *pdev)
 	/* Initialize a Global Variable for easy reference later */
 	qot_x86_data_ptr = pdata;
 
-	/* Initialize spin lock for protecting time registers */
-	pr_info("qot_x86: Initializing spinlock...\n");
-	raw_spin_lock_init(&pdata->lock);
+	/* Calibrate the TSC for lockless core clock reads, if it is invariant */
+	if (qot_x86_tsc_calibrate() == 0) {
+		tsc_enabled = true;
+		pr_info("qot_x86: Using invariant TSC core clock (mult %u shift %u)\n", tsc_mult, tsc_shift);
+	} else {
+		pr_info("qot_x86: Invariant TSC unavailable, using the kernel timekeeper\n");
+	}
 
 	/* Initialize Platform Clock Data Structures */
 	pdata->info           = qot_x86_info;
@@ -404,6 +515,13 @@ static struct qot_x86_data *qot_x86_initialize(struct platform_device *pdev)
 	hrtimer_init(&pdata->core_sched.timer, CLOCK_REALTIME, HRTIMER_MODE_ABS);
 	pdata->core_sched.timer.function = qot_x86_sched_interface_interrupt;
 
+	/* Initialize Software Capture Interface Data Structures*/
+	spin_lock_init(&pdata->capture.lock);
+	pdata->capture.key = 0;
+	pdata->capture.callback = NULL;
+	hrtimer_init(&pdata->capture.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	pdata->capture.timer.function = qot_x86_capture_interrupt;
+
 	/* Initialize Pointer to QoT Clock Data*/
 	pdata->qot_x86_impl_info = &qot_x86_impl_info;
 
@@ -416,9 +534,10 @@ static struct qot_x86_data *qot_x86_initialize(struct platform_device *pdev)
 	}
 
 	#ifdef PARAVIRT_GUEST
+	/* The pvclock path is used only if the TSC mode is disabled */
 	hv_clock = pvclock_pvti_cpu0_va();
 
-	if (!hv_clock)
+	if (!hv_clock && !tsc_enabled)
 	{
 		pr_info("qot_x86: Cannot interface with Linux PVclock\n");
 		goto err;
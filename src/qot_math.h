@@ -0,0 +1,273 @@
+/*
+ * @file qot_math.h
+ * @brief Bulk (array) temporal math over the types in qot_types.h
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QOT_STACK_SRC_QOT_MATH_H
+#define QOT_STACK_SRC_QOT_MATH_H
+
+/* Every routine in this file produces exactly the same result for every
+   element as the corresponding scalar operation in qot_types.h; SIMD is only
+   used where the element math is plain 64-bit lane arithmetic. Userspace only,
+   since the kernel may not touch vector registers without saving them. */
+
+#ifdef __KERNEL__
+	#error "qot_math.h is not available to kernel code"
+#endif
+
+#include <stddef.h>
+
+#include "qot_types.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	#include <immintrin.h>
+	#define QOT_MATH_SSE2
+	#define QOT_MATH_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	#include <arm_neon.h>
+	#define QOT_MATH_NEON
+#endif
+
+/* Divide a signed scalar by a ratio in qot_types.h, rounding towards zero
+   like div_s64 and the C division operator */
+static inline s64 qot_div_ratio_s64(s64 x, u64 d)
+{
+	if (x < 0)
+		return -(s64) qot_div_ratio(-(u64) x, d);
+	return (s64) qot_div_ratio((u64) x, d);
+}
+
+/* An attosecond field that timepoint_add can carry with one subtraction */
+static inline int qot_asec_normalized(u64 asec)
+{
+	return asec < aSEC_PER_SEC;
+}
+
+#ifdef QOT_MATH_SSE2
+
+/* Lanes are {sec, asec}. Subtracting {0, 1s} leaves the asec lane negative
+   exactly when no second needs to carry, as asec < 2s < 2^63 after adding
+   two normalized values. The sign is broadcast to both lanes so that the
+   carry subtracts {-1, 1s}, incrementing sec. */
+static inline __m128i qot_math_carry_sse2(__m128i sum)
+{
+	const __m128i one = _mm_set_epi64x((long long) aSEC_PER_SEC, 0);
+	const __m128i adj = _mm_set_epi64x((long long) aSEC_PER_SEC, -1LL);
+	__m128i nocarry = _mm_shuffle_epi32(
+		_mm_srai_epi32(_mm_sub_epi64(sum, one), 31), _MM_SHUFFLE(3,3,3,3));
+	return _mm_sub_epi64(sum, _mm_andnot_si128(nocarry, adj));
+}
+
+static QOT_MATH_AVX2 void timepoint_add_n_avx2(timepoint_t *t,
+	const timelength_t *v, size_t n)
+{
+	const __m256i one = _mm256_set_epi64x((long long) aSEC_PER_SEC, 0,
+		(long long) aSEC_PER_SEC, 0);
+	const __m256i adj = _mm256_set_epi64x((long long) aSEC_PER_SEC, -1LL,
+		(long long) aSEC_PER_SEC, -1LL);
+	size_t i;
+	for (i = 0; i + 2 <= n; i += 2) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) &t[i]);
+		__m256i b = _mm256_loadu_si256((const __m256i *) &v[i]);
+		__m256i sum, nocarry;
+		/* Fall back for denormalized input (asec >= 1s, incl. >= 2^63) */
+		if (!qot_asec_normalized(t[i].asec)   || !qot_asec_normalized(v[i].asec)
+		 || !qot_asec_normalized(t[i+1].asec) || !qot_asec_normalized(v[i+1].asec)) {
+			timepoint_add(&t[i],   (timelength_t *) &v[i]);
+			timepoint_add(&t[i+1], (timelength_t *) &v[i+1]);
+			continue;
+		}
+		sum = _mm256_add_epi64(a, b);
+		nocarry = _mm256_shuffle_epi32(_mm256_srai_epi32(
+			_mm256_sub_epi64(sum, one), 31), _MM_SHUFFLE(3,3,3,3));
+		_mm256_storeu_si256((__m256i *) &t[i],
+			_mm256_sub_epi64(sum, _mm256_andnot_si256(nocarry, adj)));
+	}
+	for (; i < n; i++)
+		timepoint_add(&t[i], (timelength_t *) &v[i]);
+}
+
+/* Result of timepoint_cmp from the per-lane {sec, asec} greater-than and
+   less-than bits of one timepoint pair, indexed by gt | (lt << 2) */
+static const signed char qot_math_cmp_lut[16] = {
+	 0, -1, -1, -1,		/* lt = none */
+	 1,  1,  1,  1,		/* lt = sec */
+	 1, -1, -1, -1,		/* lt = asec */
+	 1,  1,  1,  1,		/* lt = sec and asec */
+};
+
+static QOT_MATH_AVX2 void timepoint_cmp_n_avx2(const timepoint_t *t1,
+	const timepoint_t *t2, int *res, size_t n)
+{
+	/* Bias the asec lanes so that the signed compare orders them unsigned */
+	const __m256i bias = _mm256_set_epi64x((long long) 0x8000000000000000ULL, 0,
+		(long long) 0x8000000000000000ULL, 0);
+	size_t i;
+	for (i = 0; i + 2 <= n; i += 2) {
+		__m256i a = _mm256_xor_si256(bias,
+			_mm256_loadu_si256((const __m256i *) &t1[i]));
+		__m256i b = _mm256_xor_si256(bias,
+			_mm256_loadu_si256((const __m256i *) &t2[i]));
+		int gt = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(a, b)));
+		int lt = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(b, a)));
+		res[i]   = qot_math_cmp_lut[(gt & 3) | ((lt & 3) << 2)];
+		res[i+1] = qot_math_cmp_lut[(gt >> 2) | ((lt >> 2) << 2)];
+	}
+	for (; i < n; i++)
+		res[i] = timepoint_cmp((timepoint_t *) &t1[i], (timepoint_t *) &t2[i]);
+}
+
+#endif /* QOT_MATH_SSE2 */
+
+/**
+ * @brief Add an array of timelengths to an array of timepoints (t[i] += v[i])
+ * @param t Timepoints, updated in place
+ * @param v Timelengths to add
+ * @param n Number of elements
+ **/
+static inline void timepoint_add_n(timepoint_t *t, const timelength_t *v,
+	size_t n)
+{
+	size_t i;
+#if defined(QOT_MATH_SSE2)
+	if (__builtin_cpu_supports("avx2")) {
+		timepoint_add_n_avx2(t, v, n);
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		if (!qot_asec_normalized(t[i].asec) || !qot_asec_normalized(v[i].asec)) {
+			timepoint_add(&t[i], (timelength_t *) &v[i]);
+			continue;
+		}
+		_mm_storeu_si128((__m128i *) &t[i], qot_math_carry_sse2(_mm_add_epi64(
+			_mm_loadu_si128((const __m128i *) &t[i]),
+			_mm_loadu_si128((const __m128i *) &v[i]))));
+	}
+#elif defined(QOT_MATH_NEON)
+	const uint64x2_t one = vcombine_u64(vcreate_u64(0), vcreate_u64(aSEC_PER_SEC));
+	const uint64x2_t adj = vcombine_u64(vcreate_u64(~0ULL), vcreate_u64(aSEC_PER_SEC));
+	for (i = 0; i < n; i++) {
+		uint64x2_t sum, carry;
+		if (!qot_asec_normalized(t[i].asec) || !qot_asec_normalized(v[i].asec)) {
+			timepoint_add(&t[i], (timelength_t *) &v[i]);
+			continue;
+		}
+		sum = vaddq_u64(vld1q_u64((const uint64_t *) &t[i]),
+			vld1q_u64((const uint64_t *) &v[i]));
+		carry = vcgeq_u64(sum, one);
+		carry = vdupq_laneq_u64(carry, 1);
+		vst1q_u64((uint64_t *) &t[i], vsubq_u64(sum, vandq_u64(carry, adj)));
+	}
+#else
+	for (i = 0; i < n; i++)
+		timepoint_add(&t[i], (timelength_t *) &v[i]);
+#endif
+}
+
+/**
+ * @brief Compare two arrays of timepoints element-wise, as timepoint_cmp
+ * @param t1 First timepoints
+ * @param t2 Second timepoints
+ * @param res Per element: t1 > t2 => -1, t1 < t2 => 1, else 0
+ * @param n Number of elements
+ **/
+static inline void timepoint_cmp_n(const timepoint_t *t1,
+	const timepoint_t *t2, int *res, size_t n)
+{
+	size_t i;
+#if defined(QOT_MATH_SSE2)
+	/* SSE2 has no 64-bit compare, so only AVX2 is vectorized */
+	if (__builtin_cpu_supports("avx2")) {
+		timepoint_cmp_n_avx2(t1, t2, res, n);
+		return;
+	}
+#elif defined(QOT_MATH_NEON)
+	for (i = 0; i < n; i++) {
+		int64x2_t a = vld1q_s64((const int64_t *) &t1[i]);
+		int64x2_t b = vld1q_s64((const int64_t *) &t2[i]);
+		uint64x2_t ua = vreinterpretq_u64_s64(a);
+		uint64x2_t ub = vreinterpretq_u64_s64(b);
+		int sgt = vgetq_lane_u64(vcgtq_s64(a, b), 0) != 0;
+		int slt = vgetq_lane_u64(vcgtq_s64(b, a), 0) != 0;
+		int agt = vgetq_lane_u64(vcgtq_u64(ua, ub), 1) != 0;
+		int alt = vgetq_lane_u64(vcgtq_u64(ub, ua), 1) != 0;
+		res[i] = (sgt || slt) ? (slt - sgt) : (alt - agt);
+	}
+	return;
+#endif
+	for (i = 0; i < n; i++)
+		res[i] = timepoint_cmp((timepoint_t *) &t1[i], (timepoint_t *) &t2[i]);
+}
+
+/**
+ * @brief Convert an array of timepoints to nanoseconds, as TP_TO_nSEC
+ * @param t Timepoints
+ * @param ns Nanosecond values
+ * @param n Number of elements
+ **/
+static inline void timepoint_to_nsec_n(const timepoint_t *t, s64 *ns, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+		ns[i] = (s64) TP_TO_nSEC(t[i]);
+}
+
+/**
+ * @brief Convert an array of nanosecond values to timepoints, as TP_FROM_nSEC
+ * @param t Timepoints
+ * @param ns Nanosecond values
+ * @param n Number of elements
+ **/
+static inline void timepoint_from_nsec_n(timepoint_t *t, const s64 *ns,
+	size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++)
+		TP_FROM_nSEC(t[i], ns[i]);
+}
+
+/**
+ * @brief Project core times onto a timeline (ns), as qot_loc2rem does in the
+ *        kernel for a non-period value: nsec + d + mult * d / 1e9, d = x - last
+ * @param tr Timeline translation parameters (TIMELINE_GET_PARAMETERS)
+ * @param core Core times (ns)
+ * @param tl Timeline times (ns), may alias core
+ * @param n Number of elements
+ **/
+static inline void timepoint_loc2rem_n(const tl_translation_t *tr,
+	const s64 *core, s64 *tl, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++) {
+		s64 d = core[i] - tr->last;
+		tl[i] = tr->nsec + d + qot_div_ratio_s64(
+			(s64) ((u64) tr->mult * (u64) d), nSEC_PER_SEC);
+	}
+}
+
+#endif
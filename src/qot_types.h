@@ -81,6 +81,67 @@
 #define fSEC_PER_SEC  1000000000000000ULL
 #define aSEC_PER_SEC  1000000000000000000ULL
 
+/* High 64 bits of a 64x64 bit product (a single mul on 64-bit targets) */
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 qot_u128;
+#endif
+static inline u64 qot_mulhi64(u64 a, u64 b)
+{
+#ifdef __SIZEOF_INT128__
+	return (u64) (((qot_u128) a * b) >> 64);
+#else
+	u64 al = (u32) a, ah = a >> 32;
+	u64 bl = (u32) b, bh = b >> 32;
+	u64 ll = al * bl, lh = al * bh, hl = ah * bl, hh = ah * bh;
+	u64 mid = (ll >> 32) + (u32) lh + (u32) hl;
+	return hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+
+/* Divide by one of the ratios above using a reciprocal multiply, which is
+   exact over the whole u64 range (the divisor is pre-shifted by its factor
+   of two where that keeps the reciprocal within 64 bits). Any other divisor
+   falls back to a real division. 32-bit targets otherwise pay for a
+   software 64-bit division on every conversion. */
+static inline u64 qot_div_ratio(u64 x, u64 d)
+{
+	switch (d) {
+	case SEC_PER_SEC:
+		return x;
+	case mSEC_PER_SEC:
+		return qot_mulhi64(x >> 1, 0x20c49ba5e353f7cfULL) >> 6;
+	case uSEC_PER_SEC:
+		return qot_mulhi64(x, 0x431bde82d7b634dbULL) >> 18;
+	case nSEC_PER_SEC:
+		return qot_mulhi64(x >> 1, 0x112e0be826d694b3ULL) >> 25;
+	case pSEC_PER_SEC:
+		return qot_mulhi64(x, 0x232f33025bd42233ULL) >> 37;
+	case fSEC_PER_SEC:
+		return qot_mulhi64(x >> 1, 0x480ebe7b9d58566dULL) >> 47;
+	case aSEC_PER_SEC:
+		return qot_mulhi64(x >> 1, 0x12725dd1d243aba1ULL) >> 55;
+	default:
+		break;
+	}
+	return div64_u64(x, d);
+}
+
+/* Carry whole seconds out of an attosecond field. After adding two
+   normalized values at most one second carries, so the division is
+   only needed for denormalized input. */
+static inline u64 qot_carry_asec(u64 *asec)
+{
+	u64 tm;
+	if (*asec < aSEC_PER_SEC)
+		return 0;
+	if (*asec < 2 * aSEC_PER_SEC)
+		tm = 1;
+	else
+		tm = qot_div_ratio(*asec, aSEC_PER_SEC);
+	*asec -= (tm * aSEC_PER_SEC);
+	return tm;
+}
+
 /* Operations on lengths of time */
 
 /* An absolute length time */
@@ -102,7 +163,7 @@ static inline void scalar_to_timelength(timelength_t *tl, u64 t, u64 dv, u64 ml)
     }
 
     /* Perform the calculation */
-	tl->sec = div64_u64(t, dv);
+	tl->sec = qot_div_ratio(t, dv);
 	tl->asec = t - dv * (u64) tl->sec;
 	tl->asec *= ml;
 }
@@ -110,12 +171,9 @@ static inline void scalar_to_timelength(timelength_t *tl, u64 t, u64 dv, u64 ml)
 /* Add two lengths of time together */
 static inline void timelength_add(timelength_t *l1, timelength_t *l2)
 {
-	u64 tm;
 	l1->asec += l2->asec;
 	l1->sec  += l2->sec;
-	tm = div64_u64(l1->asec, aSEC_PER_SEC);
-	l1->sec  += tm;
-	l1->asec -= (tm * aSEC_PER_SEC);
+	l1->sec  += qot_carry_asec(&l1->asec);
 }
 
 /* Compare two timelengths: l1 < l2 => -1, l1 > l2 => 1, else 0 */
@@ -168,7 +226,7 @@ static inline void timelength_min(timelength_t *sol, timelength_t *l1,
 #define TL_FROM_aSEC(d,t) scalar_to_timelength(&d,t,aSEC_PER_SEC, SEC_PER_SEC)
 
 /* Casts to scalars */
-#define  TL_TO_GEN(d,f1,f2) (d.sec*(u64)f1)+div64_u64(d.asec,f2)
+#define  TL_TO_GEN(d,f1,f2) ((d.sec*(u64)f1)+qot_div_ratio(d.asec,f2))
 #define  TL_TO_SEC(d) TL_TO_GEN(d, SEC_PER_SEC,aSEC_PER_SEC)
 #define TL_TO_mSEC(d) TL_TO_GEN(d,mSEC_PER_SEC,fSEC_PER_SEC)
 #define TL_TO_uSEC(d) TL_TO_GEN(d,uSEC_PER_SEC,pSEC_PER_SEC)
@@ -216,7 +274,7 @@ static inline void scalar_to_timepoint(timepoint_t *tp, s64 t, u64 dv, u64 ml)
     #endif   
 
     /* Get number of seconds */
-	tp->sec = div64_u64(tm, dv);
+	tp->sec = qot_div_ratio(tm, dv);
 	tp->asec = tm - dv * (u64) tp->sec;
 	#ifdef __KERNEL__
 
@@ -239,12 +297,9 @@ static inline void scalar_to_timepoint(timepoint_t *tp, s64 t, u64 dv, u64 ml)
 /* Add a length of time to a point in time */
 static inline void timepoint_add(timepoint_t *t, timelength_t *v)
 {
-	u64 tm;
 	t->asec += v->asec;
 	t->sec  += v->sec;
-	tm = div64_u64(t->asec, aSEC_PER_SEC);
-	t->sec  += tm;
-	t->asec -= (tm * aSEC_PER_SEC);
+	t->sec  += qot_carry_asec(&t->asec);
 }
 
 /* Subtract a length of time from a point in time */
@@ -275,17 +330,25 @@ static inline int timepoint_cmp(timepoint_t *t1, timepoint_t *t2)
     return 0;
 }
 
-/* Get the difference between two timepoints as a timelength */
+/* Get the (absolute) difference between two timepoints as a timelength */
 static inline void timepoint_diff(timelength_t *v, timepoint_t *t1,
     timepoint_t *t2)
 {
+	timepoint_t *hi = t1, *lo = t2;
 	if (!v || !t1 || !t2)
 		return;
-	v->sec = abs(t1->sec - t2->sec);
-	if (t2->asec > t1->asec)
-		v->asec = t2->asec - t1->asec;
-	else
-		v->asec = t1->asec - t2->asec;
+	if (timepoint_cmp(t1, t2) > 0) {
+		hi = t2;
+		lo = t1;
+	}
+	v->sec = (u64) (hi->sec - lo->sec);
+	if (hi->asec >= lo->asec) {
+		v->asec = hi->asec - lo->asec;
+	} else {
+		/* Borrow a second for the fractional part */
+		v->sec -= 1;
+		v->asec = aSEC_PER_SEC - lo->asec + hi->asec;
+	}
 }
 
 /* Get the difference between two timepoints as a timelength */
@@ -305,7 +368,7 @@ static inline void timepoint_from_timespec(timepoint_t *t, struct timespec *ts)
 #define TP_FROM_aSEC(d,t) scalar_to_timepoint(&d,t,aSEC_PER_SEC, SEC_PER_SEC)
 
 /* Some casts for efficiency */
-#define  TP_TO_GEN(d,f1,f2) (d.sec*f1)+div64_u64(d.asec,f2)
+#define  TP_TO_GEN(d,f1,f2) ((d.sec*f1)+qot_div_ratio(d.asec,f2))
 #define  TP_TO_SEC(d) TP_TO_GEN(d, SEC_PER_SEC,aSEC_PER_SEC)
 #define TP_TO_mSEC(d) TP_TO_GEN(d,mSEC_PER_SEC,fSEC_PER_SEC)
 #define TP_TO_uSEC(d) TP_TO_GEN(d,uSEC_PER_SEC,pSEC_PER_SEC)
@@ -357,6 +420,21 @@ static inline void utimepoint_sub(utimepoint_t *t, utimelength_t *v)
 	timelength_add(&t->interval.above, &v->interval.above);
 }
 
+/* The window in which the true time of an uncertain point is known to lie */
+typedef struct timewindow {
+	timepoint_t earliest;		/* True time is no earlier than this */
+	timepoint_t latest;		/* True time is no later than this   */
+} timewindow_t;
+
+/* Get the window bounded by an uncertain point in time */
+static inline void utimepoint_to_window(timewindow_t *w, utimepoint_t *t)
+{
+	w->earliest = t->estimate;
+	timepoint_sub(&w->earliest, &t->interval.below);
+	w->latest = t->estimate;
+	timepoint_add(&w->latest, &t->interval.above);
+}
+
 /* Operations on frequencies */
 
 /**
@@ -388,6 +466,9 @@ typedef enum {
 	QOT_EVENT_TIMER_CALLBACK     = (4),    /* Timer Callback        */
 } qot_event_type_t;
 
+/* Number of timeline event types */
+#define QOT_EVENT_NUM_TYPES 5
+
 /**
  * @brief Timeline message types
  */
@@ -448,6 +529,7 @@ typedef struct qot_timer {
 
 /* QoT external input timestamping */
 typedef struct qot_extts {
+	qot_timeline_t timeline;			/* Timeline to project captures onto */
 	int pin_index;          			/* Pin (according to testptp -l) */
 	qot_trigger_t edge;					/* Edge to capture */
 	qot_return_t response;			    /* Response */
@@ -488,6 +570,8 @@ typedef struct timeline_translation {
     int64_t l_nsec;                          /* Discipline: global time for master  */
     int64_t u_mult;                          /* Discipline: upper bound on ppb      */
     int64_t l_mult;                          /* Discipline: lower bound on ppb      */
+    int64_t u_pow;                           /* Discipline: upper (t-t0)^(3/2) coef */
+    int64_t l_pow;                           /* Discipline: lower (t-t0)^(3/2) coef */
 } tl_translation_t;
 
 /**
@@ -502,6 +586,9 @@ typedef struct timeline_translation {
 #define QOTUSR_OUTPUT_COMPARE_ENABLE       _IOWR(QOTUSR_MAGIC_CODE, 10, qot_perout_t*)
 #define QOTUSR_OUTPUT_COMPARE_DISABLE       _IOWR(QOTUSR_MAGIC_CODE, 11, qot_perout_t*)
 #define QOTUSR_GET_CORE_CLOCK_INFO     _IOR(QOTUSR_MAGIC_CODE, 12, qot_clock_t*)
+#define QOTUSR_INPUT_CAPTURE_ENABLE    _IOWR(QOTUSR_MAGIC_CODE, 13, qot_extts_t*)
+#define QOTUSR_INPUT_CAPTURE_DISABLE   _IOWR(QOTUSR_MAGIC_CODE, 14, qot_extts_t*)
+#define QOTUSR_MUTE_EVENTS             _IO(QOTUSR_MAGIC_CODE, 15)   /* Control-only connection: drop queued events, queue no timeline ones */
 
 /* QoT clock type (admin only) */
 typedef struct qot_clock {
@@ -547,12 +634,69 @@ typedef struct qot_message {
 	char data[QOT_MAX_NAMELEN];			 /* Message data */
 } qot_message_t;
 
+/* Largest batch and receive queue a messenger, publisher or subscriber accepts */
+#define QOT_MSG_MAX_BATCH_SIZE  4096
+#define QOT_MSG_MAX_QUEUE_DEPTH 65536
+
+/* Batched publish and queued delivery of messages (zero fields keep the defaults) */
+typedef struct qot_msg_config {
+	u32 batch_size;                      /* Messages written together, up to QOT_MSG_MAX_BATCH_SIZE (1 writes each at once) */
+	u32 flush_us;                        /* Longest a message waits in a partial batch */
+	u32 queue_depth;                     /* Receive queue slots, a power of two up to QOT_MSG_MAX_QUEUE_DEPTH (0 calls back on the transport thread) */
+	u32 block_us;                        /* Longest the transport thread waits for room in a full queue */
+	u32 order_hold_us;                   /* Longest a message is held to deliver in timestamp order (0 delivers in arrival order) */
+	u32 order_depth;                     /* Most messages held for ordering */
+	u64 deadline_ns;                     /* Drop messages older than this on arrival (0 keeps all) */
+	u32 latency_stats;                   /* Stamp messages and keep latency histograms (0 off) */
+} qot_msg_config_t;
+
+/* Message pipeline counters */
+typedef struct qot_msg_stats {
+	u64 published;                       /* Messages handed to publish */
+	u64 batches;                         /* Batches handed to the transport */
+	u64 timed_flushes;                   /* Batches written because the flush interval expired */
+	u64 received;                        /* Messages offered to the receive queue */
+	u64 delivered;                       /* Messages taken from the receive queue */
+	u64 dropped;                         /* Messages lost to a full receive queue */
+	u64 stalls;                          /* Times the transport thread waited for room in the queue */
+	u64 reordered;                       /* Messages which overtook an earlier stamped one and were put back in order */
+	u64 late;                            /* Messages dropped as stamped before one already delivered */
+	u64 expired;                         /* Messages dropped as past the deadline */
+	u32 depth;                           /* Messages in the receive queue */
+	u32 max_depth;                       /* Most messages queued at once */
+	u32 reorder_depth;                   /* Messages held for ordering */
+	u32 max_reorder_depth;               /* Most messages held at once */
+} qot_msg_stats_t;
+
+/* One-way message latency of a topic and peer, from timeline stamps taken at
+   publish, transport handoff and delivery */
+typedef struct qot_latency_stats {
+	char topic[QOT_MAX_NAMELEN];         /* Topic ("" for all of them) */
+	char peer[QOT_MAX_NAMELEN];          /* Publishing node ("" for all of them) */
+	u64 samples;                         /* Messages measured */
+	u64 negative;                        /* Samples below zero, counted as zero (clock error) */
+	s64 min_ns;                          /* Publish to delivery */
+	s64 mean_ns;
+	s64 p50_ns;
+	s64 p90_ns;
+	s64 p99_ns;
+	s64 p999_ns;
+	s64 max_ns;
+	s64 transport_p50_ns;                /* Transport handoff to delivery */
+	s64 transport_p99_ns;
+	s64 batching_mean_ns;                /* Publish to transport handoff */
+	s64 uncertainty_mean_ns;             /* Combined sender and receiver uncertainty */
+	s64 uncertainty_max_ns;
+} qot_latency_stats_t;
+
 /* Upper and lower bound on current time */
 typedef struct qot_bounds {
 	s64 u_drift; // Upper bound (Right Predictor) function for drift
 	s64 l_drift; // Lower bound (Left Predictor) function for drift
 	s64 u_nsec;  // Upper bound (Right Margin) function for offset
 	s64 l_nsec;  // Lower bound (Left Margin) function for offset
+	s64 u_pow;   // Upper bound (Right Predictor) coefficient of (t-t0)^(3/2) in ns/s^(3/2)
+	s64 l_pow;   // Lower bound (Left Predictor) coefficient of (t-t0)^(3/2) in ns/s^(3/2)
 } qot_bounds_t;
 
 // Clock Statistic Data Point
@@ -581,8 +725,25 @@ typedef struct qot_node {
 	qot_node_status_t status;            /* Status of the node        */
 } qot_node_t;
 
+/* Timed barrier of a cluster: the caller keeps it from one round to the next */
+typedef struct qot_barrier {
+	uint64_t round;                      /* Next round (zero the struct to start)      */
+	int timeout_ms;                      /* Wait for every proposal (-1 blocks)        */
+	timelength_t margin_floor;           /* Smallest safety margin                     */
+	timelength_t margin;                 /* Safety margin, adapted between rounds      */
+	timepoint_t release;                 /* Agreed release instant of the last round   */
+	timepoint_t wakeup;                  /* Wake-up of this node for that round        */
+	timelength_t latency;                /* Time this node took to gather proposals    */
+	timelength_t uncertainty;            /* Worst peer uncertainty (below + above)     */
+	timelength_t skew;                   /* Spread of wake-ups in the round before     */
+	int64_t slack_ns;                    /* Least time left before its release (< 0 late) */
+	uint32_t reported;                   /* Nodes whose wake-up is in skew and slack   */
+} qot_barrier_t;
+
 // Callback Function Prototypes
 typedef void (*qot_msg_callback_t)(const qot_message_t *msg);
+typedef void (*qot_payload_callback_t)(const qot_message_t *msg, const void *payload, size_t length);
+typedef qot_return_t (*qot_clock_callback_t)(void *arg, utimepoint_t *now);
 typedef void (*qot_node_callback_t)(qot_node_t *node);
 
 /**
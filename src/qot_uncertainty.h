@@ -0,0 +1,168 @@
+/*
+ * @file qot_uncertainty.h
+ * @brief Non-linear synchronization uncertainty growth model for timelines
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QOT_STACK_SRC_QOT_UNCERTAINTY_H
+#define QOT_STACK_SRC_QOT_UNCERTAINTY_H
+
+/* Shared by the kernel module, the emulation and the userspace libraries, so
+   that all of them compute exactly the same bounds. Only the few 64-bit
+   helpers that differ between the kernel and userspace are wrapped below. */
+
+#include "qot_types.h"
+
+#ifdef __KERNEL__
+	#include <linux/bitops.h>
+#endif
+
+/* Number of power-of-two breakpoints in a (t-t0)^(3/2) bound table,
+   covering elapsed times up to 2^47 ns (~39 hours) since the last sync */
+#define QOT_UNCERTAINTY_TABLE_SIZE 48
+
+/* Saturation value (ns) of the uncertainty bound beyond the table range */
+#define QOT_UNCERTAINTY_SAT_NSEC   (1LL << 61)
+
+/* Precomputed random-walk bound for one side (upper or lower) of a timeline */
+typedef struct qot_uncertainty_table {
+    s64 coef;                                /* Coefficient (ns per s^(3/2))  */
+    s64 table[QOT_UNCERTAINTY_TABLE_SIZE];   /* Bound (ns) at 2^k ns elapsed  */
+} qot_uncertainty_table_t;
+
+/* Bound (ns) for a unit coefficient (1 ns per s^(3/2)) after 2^k ns, scaled by
+   2^32 and rounded up: ceil((2^k/1e9)^(3/2) * 2^32). Generated offline. */
+#define QOT_UNCERTAINTY_TABLE_FRAC 32
+static const u64 qot_pow32_table[QOT_UNCERTAINTY_TABLE_SIZE] = {
+    1ULL, 1ULL, 1ULL, 1ULL,
+    1ULL, 1ULL, 1ULL, 1ULL,
+    1ULL, 2ULL, 5ULL, 13ULL,
+    36ULL, 101ULL, 285ULL, 806ULL,
+    2279ULL, 6446ULL, 18230ULL, 51561ULL,
+    145835ULL, 412482ULL, 1166675ULL, 3299854ULL,
+    9333397ULL, 26398832ULL, 74667171ULL, 211190650ULL,
+    597337362ULL, 1689525196ULL, 4778698891ULL, 13516201563ULL,
+    38229591122ULL, 108129612497ULL, 305836728974ULL, 865036899973ULL,
+    2446693831788ULL, 6920295199778ULL, 19573550654301ULL, 55362361598218ULL,
+    156588405234405ULL, 442898892785740ULL, 1252707241875240ULL, 3543191142285915ULL,
+    10021657935001918ULL, 28345529138287314ULL, 80173263480015338ULL, 226764233106298510ULL,
+};
+
+/* Index of the most significant set bit plus one, 0 for 0 */
+static inline int qot_uncertainty_fls64(u64 x)
+{
+#ifdef __KERNEL__
+    return fls64(x);
+#else
+    return x ? 64 - __builtin_clzll(x) : 0;
+#endif
+}
+
+/* (a * mul) >> QOT_UNCERTAINTY_TABLE_FRAC without a 128-bit product. Exact,
+   since the high half of a contributes whole multiples of the shift */
+static inline u64 qot_uncertainty_mul_frac(u64 a, u32 mul)
+{
+    return (a >> QOT_UNCERTAINTY_TABLE_FRAC) * mul
+        + (((a & ((1ULL << QOT_UNCERTAINTY_TABLE_FRAC) - 1)) * mul) >> QOT_UNCERTAINTY_TABLE_FRAC);
+}
+
+/* Precompute the table for a coefficient (called only when bounds change) */
+static inline void qot_uncertainty_build(qot_uncertainty_table_t *ut, s64 coef)
+{
+    int k;
+    u64 mag, hi, lo, val;
+
+    ut->coef = coef;
+    mag = (coef < 0) ? (u64)(-coef) : (u64)coef;
+    for (k = 0; k < QOT_UNCERTAINTY_TABLE_SIZE; k++)
+    {
+        hi = qot_pow32_table[k] >> QOT_UNCERTAINTY_TABLE_FRAC;
+        lo = qot_pow32_table[k] & ((1ULL << QOT_UNCERTAINTY_TABLE_FRAC) - 1);
+        /* Saturate rather than overflow for large coefficients/horizons */
+        if (mag == 0)
+            val = 0;
+#ifdef __KERNEL__
+        else if (hi && mag > div64_u64(QOT_UNCERTAINTY_SAT_NSEC, hi))
+#else
+        else if (hi && mag > (u64) QOT_UNCERTAINTY_SAT_NSEC / hi)
+#endif
+            val = QOT_UNCERTAINTY_SAT_NSEC;
+        else
+            val = mag*hi + qot_uncertainty_mul_frac(mag, (u32)lo) + 1;
+        if (val > QOT_UNCERTAINTY_SAT_NSEC)
+            val = QOT_UNCERTAINTY_SAT_NSEC;
+        ut->table[k] = (coef < 0) ? -(s64)val : (s64)val;
+    }
+}
+
+/* Evaluate coef*(dt)^(3/2) in ns without divisions (dt in ns). The curve is
+   convex, so interpolating linearly between power-of-two breakpoints always
+   over-estimates its magnitude, which keeps the bound conservative. */
+static inline s64 qot_uncertainty_eval(const qot_uncertainty_table_t *ut, s64 dt)
+{
+    int k;
+    u64 x, frac;
+    s64 lo, diff, part;
+
+    if (ut->coef == 0 || dt <= 0)
+        return 0;
+    x = (u64)dt;
+    k = qot_uncertainty_fls64(x) - 1;
+    if (k >= QOT_UNCERTAINTY_TABLE_SIZE - 1)
+        return (ut->coef < 0) ? -QOT_UNCERTAINTY_SAT_NSEC : QOT_UNCERTAINTY_SAT_NSEC;
+
+    /* 16-bit fraction of the position between 2^k and 2^(k+1), rounded up so
+       that the chord is never evaluated short of dt (it may reach 1 << 16) */
+    frac = x - (1ULL << k);
+    if (k >= 16)
+        frac = (frac >> (k - 16)) + ((frac & ((1ULL << (k - 16)) - 1)) != 0);
+    else
+        frac <<= 16 - k;
+
+    /* Split the product so that it can not overflow. The shifts floor the
+       result, which is away from zero for negative (lower) bounds; round
+       positive (upper) bounds up */
+    lo   = ut->table[k];
+    diff = ut->table[k+1] - lo;
+    part = (diff & 0xFFFF)*(s64)frac;
+    lo  += (diff >> 16)*(s64)frac + (part >> 16);
+    if (ut->coef > 0 && (part & 0xFFFF))
+        lo++;
+    return lo;
+}
+
+/* Full bound: offset + linear drift (ppb) + (t-t0)^(3/2) term, in ns. The
+   drift term rounds towards zero, like div_s64 */
+static inline s64 qot_uncertainty_bound(s64 nsec, s64 mult, const qot_uncertainty_table_t *ut, s64 dt)
+{
+    s64 drift = mult*dt;
+    drift = (drift < 0) ? -(s64) qot_div_ratio(-(u64) drift, nSEC_PER_SEC)
+                        : (s64) qot_div_ratio((u64) drift, nSEC_PER_SEC);
+    return nsec + drift + qot_uncertainty_eval(ut, dt);
+}
+
+#endif
@@ -35,20 +35,25 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include <iterator>
 #include <algorithm>
 #include <signal.h>
 
 using namespace qot_broker;
 
-/* Vector of Discovered Nodes */
-std::vector<NodeInfo> nodes;
+/* Discovered Nodes, indexed by node ID */
+std::unordered_map<int32_t, NodeInfo> nodes;
 
-/* Vector of Discovered Topics */
-std::vector<TopicInfo> topics;
+/* Discovered Topics, indexed by topic ID */
+std::unordered_map<int32_t, TopicInfo> topics;
+
+/* Topic IDs indexed by topic name, in discovery order (publishers and subscribers
+   name their topic, and find the first topic of that name still known) */
+std::unordered_map<std::string, std::vector<int32_t> > topicNames;
 
 /* Map of Discovered Timelines */
-std::map<std::string, TimelineInfo> timelines;
+std::unordered_map<std::string, TimelineInfo> timelines;
 
 /* NodeInfo Class Constructor */
 NodeInfo::NodeInfo(const DDS::ParticipantBuiltinTopicData& participantData)
@@ -66,25 +71,21 @@ NodeInfo::NodeInfo(const DDS::ParticipantBuiltinTopicData& participantData)
 NodeInfo& getNodeInfo(const DDS::ParticipantBuiltinTopicData& participantData)
 {
     /** Find and return the node if it already exists */
-    for(std::vector<NodeInfo>::iterator it = nodes.begin(); it < nodes.end(); it++)
+    std::unordered_map<int32_t, NodeInfo>::iterator it = nodes.find(participantData.key[0]);
+    if(it != nodes.end())
     {
-        if(it->nodeID_ == participantData.key[0])
+        /** Update the hostname */
+        if(participantData.user_data.value.length() > 0
+        && *participantData.user_data.value.get_buffer() != '<' )
         {
-            /** Update the hostname */
-            if(participantData.user_data.value.length() > 0
-            && *participantData.user_data.value.get_buffer() != '<' )
-            {
-                it->hostName_ = std::string(reinterpret_cast<const char*> (participantData.user_data.value.get_buffer()),
-                                        participantData.user_data.value.length());
-            }
-            return *it;
+            it->second.hostName_ = std::string(reinterpret_cast<const char*> (participantData.user_data.value.get_buffer()),
+                                    participantData.user_data.value.length());
         }
+        return it->second;
     }
 
     /** Create a new node and return it if no node existed */
-    NodeInfo node(participantData);
-    nodes.push_back(node);
-    return nodes.back();
+    return nodes.emplace(participantData.key[0], NodeInfo(participantData)).first->second;
 }
 
 /* TimelineInfo Class Constructor */
@@ -118,7 +119,7 @@ int addTimeline(std::string timeline_uuid)
 /* Remove a timeline */
 int removeTimeline(std::string timeline_uuid)
 {
-    std::map<std::string, TimelineInfo>::iterator it;
+    std::unordered_map<std::string, TimelineInfo>::iterator it;
     it = timelines.find(timeline_uuid);
     if(it == timelines.end())
     {
@@ -219,7 +220,7 @@ int TopicInfo::addPublisher(int32_t participant_ID, int32_t dw_ID, std::string t
 /* Remove a subscriber */
 int TopicInfo::removeSubscriber(int32_t participant_ID, int32_t dr_ID)
 {
-    std::map<int32_t, int32_t>::iterator it;
+    std::unordered_map<int32_t, int32_t>::iterator it;
     topic_mtx.lock();
     it = subscribers.find(dr_ID);
     if(it == subscribers.end())
@@ -239,7 +240,7 @@ int TopicInfo::removeSubscriber(int32_t participant_ID, int32_t dr_ID)
 /* Remove a publisher */
 int TopicInfo::removePublisher(int32_t participant_ID, int32_t dw_ID)
 {
-    std::map<int32_t, int32_t>::iterator it;
+    std::unordered_map<int32_t, int32_t>::iterator it;
     topic_mtx.lock();
     it = publishers.find(dw_ID);
     if(it == publishers.end())
@@ -302,19 +303,17 @@ void TopicInfo::deleteTopicPubSubNodes()
 TopicInfo& getTopicInfo(const DDS::TopicBuiltinTopicData& topicData)
 {
     /** Find and return the node if it already exists */
-    for(std::vector<TopicInfo>::iterator it = topics.begin(); it < topics.end(); it++)
+    std::unordered_map<int32_t, TopicInfo>::iterator it = topics.find(topicData.key[0]);
+    if(it != topics.end())
     {
-        if(it->getTopicID() == topicData.key[0])
-        {
-            /* If the topic is found return the topic */
-            return *it;
-        }
+        /* If the topic is found return the topic */
+        return it->second;
     }
 
-    /** Create a new node and return it if no node existed */
-    TopicInfo node(topicData);
-    topics.push_back(node);
-    return topics.back();
+    /** Create a new node and return it if no node existed (the first topic of a name keeps it) */
+    it = topics.emplace(topicData.key[0], TopicInfo(topicData)).first;
+    topicNames[it->second.getTopicName()].push_back(topicData.key[0]);
+    return it->second;
 }
 
 /**
@@ -326,23 +325,44 @@ TopicInfo& getTopicInfo(const DDS::TopicBuiltinTopicData& topicData)
  */
 bool deleteTopicInfo(const DDS::TopicBuiltinTopicData& topicData)
 {
-    /** Find and return the node if it already exists */
-    for(std::vector<TopicInfo>::iterator it = topics.begin(); it < topics.end(); it++)
+    /** Find the node if it already exists */
+    std::unordered_map<int32_t, TopicInfo>::iterator it = topics.find(topicData.key[0]);
+    if(it == topics.end())
     {
-        if(it->getTopicID() == topicData.key[0])
-        {
-            /* Delete all the publishers and subscribers before attempting to delete the topic */
-            it->deleteTopicPubSubNodes();
-            /* Delete the corresponding zookeeper node */
-            zk_topic_delete(it->getTimelineUUID().c_str(), it->getTopicName().c_str());
-            /* If the topic is found erase the topic and return true */
-            topics.erase(it);
-            return true;
-        }
+        /** Return false if the node does not exist */
+        return false;
     }
 
-    /** Return false if the node does not exist */
-    return false;
+    /* Delete all the publishers and subscribers before attempting to delete the topic */
+    it->second.deleteTopicPubSubNodes();
+    /* Delete the corresponding zookeeper node */
+    zk_topic_delete(it->second.getTimelineUUID().c_str(), it->second.getTopicName().c_str());
+
+    /* If the topic is found erase the topic and its name entry (the next topic of that name takes over) and return true */
+    std::unordered_map<std::string, std::vector<int32_t> >::iterator name = topicNames.find(it->second.getTopicName());
+    if(name != topicNames.end())
+    {
+        name->second.erase(std::remove(name->second.begin(), name->second.end(), it->first), name->second.end());
+        if(name->second.empty())
+            topicNames.erase(name);
+    }
+    topics.erase(it);
+    return true;
+}
+
+/**
+ * Finds a topic by name through the name index
+ *
+ * @param topicName The name of the topic
+ * @return The found node, or NULL
+ */
+TopicInfo* getNamedTopicInfo(const char* topicName)
+{
+    std::unordered_map<std::string, std::vector<int32_t> >::iterator name = topicNames.find(topicName);
+    if(name == topicNames.end())
+        return NULL;
+    std::unordered_map<int32_t, TopicInfo>::iterator it = topics.find(name->second.front());
+    return (it != topics.end()) ? &it->second : NULL;
 }
 
 /**
@@ -354,16 +374,7 @@ bool deleteTopicInfo(const DDS::TopicBuiltinTopicData& topicData)
  */
 TopicInfo* getPublicationTopicInfo(const DDS::PublicationBuiltinTopicData& publisherData)
 {
-    /** Find and return the node if it already exists */
-    for(std::vector<TopicInfo>::iterator it = topics.begin(); it < topics.end(); it++)
-    {
-        if(it->getTopicName().compare(publisherData.topic_name) == 0)
-        {
-            /* If the topic is found return the topic */
-            return &(*it);
-        }
-    }
-    return NULL;
+    return getNamedTopicInfo(publisherData.topic_name);
 }
 
 /**
@@ -375,16 +386,7 @@ TopicInfo* getPublicationTopicInfo(const DDS::PublicationBuiltinTopicData& publi
  */
 TopicInfo* getSubscriptionTopicInfo(const DDS::SubscriptionBuiltinTopicData& subscriberData)
 {
-    /** Find and return the node if it already exists */
-    for(std::vector<TopicInfo>::iterator it = topics.begin(); it < topics.end(); it++)
-    {
-        if(it->getTopicName().compare(subscriberData.topic_name) == 0)
-        {
-            /* If the topic is found return the topic */
-            return &(*it);
-        }
-    }
-    return NULL;
+    return getNamedTopicInfo(subscriberData.topic_name);
 }
 
 /* Constructor of the Broker Class */
@@ -434,6 +436,9 @@ void newTimelineCallback(dds::sub::DataReader<qot_msgs::TimelineType>& topicRead
             }
         }
     }
+
+    /* Send the zookeeper updates of these samples together */
+    zk_flush();
 }
 
 /* Callback Function for handling timeline deletion */
@@ -455,6 +460,8 @@ void deletedTimelineCallback(dds::core::Entity& e, dds::sub::status::DataState&
             } 
         }
     }
+
+    zk_flush();
 }
 
 /* Timeline Thread */
@@ -585,6 +592,7 @@ void Broker::ParticipantThread()
         {
             if(sample->info().valid())
             {
+                std::lock_guard<std::mutex> lock(registry_mtx);
                 NodeInfo& nodeInfo = getNodeInfo(sample->data());
 
                 /**
@@ -639,15 +647,17 @@ void Broker::ParticipantThread()
             }
         }
 
-        for(std::vector<NodeInfo>::iterator it = nodes.begin(); it < nodes.end(); it++)
+        std::unique_lock<std::mutex> lock(registry_mtx);
+        for(std::unordered_map<int32_t, NodeInfo>::iterator it = nodes.begin(); it != nodes.end(); it++)
         {
-            if(it->participants.size() > 0)
+            if(it->second.participants.size() > 0)
             {
-                std::cout << "=== [BuiltInTopicsDataSubscriber] Node '" << it->nodeID_
-                            << "' has '" << it->participants.size()
+                std::cout << "=== [BuiltInTopicsDataSubscriber] Node '" << it->second.nodeID_
+                            << "' has '" << it->second.participants.size()
                             << "' participants." << std::endl;
             }
         }
+        lock.unlock();
 
         /* Block the current thread until the attached condition becomes
         *  true or the user interrupts.
@@ -673,6 +683,8 @@ void newTopicCallback(dds::sub::DataReader<DDS::TopicBuiltinTopicData>& topicRea
     {
         if(sample->info().valid())
         {
+            /* The topic index is shared with the other broker threads */
+            std::lock_guard<std::mutex> lock(registry_mtx);
             /* Check if a topic is designated as global or global optimized */
             bool status = checkTopicInfo(sample->data());
 
@@ -687,6 +699,8 @@ void newTopicCallback(dds::sub::DataReader<DDS::TopicBuiltinTopicData>& topicRea
             }  
         }
     }
+
+    zk_flush();
 }
 
 /* Callback Function for handling topic deletion */
@@ -701,6 +715,7 @@ void deletedTopicCallback(dds::core::Entity& e, dds::sub::status::DataState& dat
     {
         if(sample->info().valid())
         {
+            std::lock_guard<std::mutex> lock(registry_mtx);
             /* Check if a topic is designated as global or global optimized */
             bool found = checkTopicInfo(sample->data());
 
@@ -717,6 +732,8 @@ void deletedTopicCallback(dds::core::Entity& e, dds::sub::status::DataState& dat
             }
         }
     }
+
+    zk_flush();
 }
 
 /* Topic Thread */
@@ -808,6 +825,7 @@ void newPubCallback(dds::sub::DataReader<DDS::PublicationBuiltinTopicData>& topi
     {
         if(sample->info().valid())
         {
+            std::lock_guard<std::mutex> lock(registry_mtx);
             TopicInfo* topicInfo = getPublicationTopicInfo(sample->data());
 
             // Check if the topic is relevant (global or global optimized) to be shared
@@ -823,6 +841,8 @@ void newPubCallback(dds::sub::DataReader<DDS::PublicationBuiltinTopicData>& topi
                
         }
     }
+
+    zk_flush();
 }
 
 /* Callback Function for handling publisher deletion */
@@ -837,6 +857,7 @@ void deletedPubCallback(dds::core::Entity& e, dds::sub::status::DataState& dataS
     {
         if(sample->info().valid())
         {
+            std::lock_guard<std::mutex> lock(registry_mtx);
             TopicInfo* topicInfo = getPublicationTopicInfo(sample->data());
 
             // Check if the topic is relevant (global or global optimized) to be shared
@@ -849,6 +870,8 @@ void deletedPubCallback(dds::core::Entity& e, dds::sub::status::DataState& dataS
             }  
         }
     }
+
+    zk_flush();
 }
 
 
@@ -941,6 +964,7 @@ void newSubCallback(dds::sub::DataReader<DDS::SubscriptionBuiltinTopicData>& top
     {
         if(sample->info().valid())
         {
+            std::lock_guard<std::mutex> lock(registry_mtx);
             TopicInfo* topicInfo = getSubscriptionTopicInfo(sample->data());
 
             // Check if the topic is relevant (global or global optimized) to be shared
@@ -956,6 +980,8 @@ void newSubCallback(dds::sub::DataReader<DDS::SubscriptionBuiltinTopicData>& top
                
         }
     }
+
+    zk_flush();
 }
 
 /* Callback Function for handling publisher deletion */
@@ -970,6 +996,7 @@ void deletedSubCallback(dds::core::Entity& e, dds::sub::status::DataState& dataS
     {
         if(sample->info().valid())
         {
+            std::lock_guard<std::mutex> lock(registry_mtx);
             TopicInfo* topicInfo = getSubscriptionTopicInfo(sample->data());
 
             // Check if the topic is relevant (global or global optimized) to be shared
@@ -982,6 +1009,8 @@ void deletedSubCallback(dds::core::Entity& e, dds::sub::status::DataState& dataS
             }  
         }
     }
+
+    zk_flush();
 }
 
 /* Participant Thread */
@@ -1098,6 +1127,8 @@ int main(int argc, char *argv[])
         while(running)
         {
             sleep(5);
+            /* Resend the zookeeper updates held back by a lost connection */
+            zk_flush();
         }
         // Destroy threads
         broker.~Broker();
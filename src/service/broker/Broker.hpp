@@ -31,6 +31,7 @@
 #include <thread>
 #include <map>
 #include <mutex>      
+#include <unordered_map>
 
 // Boost includes
 #include <boost/thread.hpp>
@@ -43,6 +44,7 @@
 namespace qot_broker {
 
 static std::mutex topic_mtx;           	     // mutex for critical section
+static std::mutex registry_mtx;              // mutex guarding the node and topic indexes
 bool terminated;							 // Flag to terminate the edge broker
 
 /*  Class to maintain node information 
@@ -107,8 +109,8 @@ class TopicInfo
 	    int32_t topicID_;						 // Topic Unique ID
 	    std::string topicName_; 			     // Topic Name
 	    std::string timeline_uuid;				 // Timeline Name under which the topic falls
-	    std::map<int32_t, int32_t> subscribers;	 // List of Subscribers of the topic
-	    std::map<int32_t, int32_t> publishers;   // List of Publishers of the topic
+	    std::unordered_map<int32_t, int32_t> subscribers; // Subscribers of the topic, by reader ID
+	    std::unordered_map<int32_t, int32_t> publishers;  // Publishers of the topic, by writer ID
 };
 
 /* Class to Start the Broker Threads which listen for new topics, publishers and subscribers */
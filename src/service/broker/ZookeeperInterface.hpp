@@ -37,30 +37,33 @@ extern "C"
 
 int init_zk_logic (int argc, char * argv[]);
 
-/* Synchronous call to Create a Timeline zk node */
+/* Queue the creation of a Timeline zk node (sent by zk_flush) */
 int zk_timeline_create(const char* timelineName);
 
-/* Asynchronous call to delete a Timeline zk node */
+/* Queue the deletion of a Timeline zk node (sent by zk_flush) */
 void zk_timeline_delete(const char* timelineName);
 
-/* Synchronous call to Create a Topic zk node */
+/* Queue the creation of a Topic zk node (sent by zk_flush) */
 int zk_topic_create(const char* timelineName, const char* topicName);
 
-/* Synchronous call to delete a Topic zk node */
+/* Queue the deletion of a Topic zk node (sent by zk_flush) */
 void zk_topic_delete(const char* timelineName, const char* topicName);
 
-/* Asynchronous call to Create a Publisher zk node */ 
+/* Queue the creation of a Publisher zk node (sent by zk_flush) */
 void zk_publisher_create(const char* timelineName, const char* topicName, const char* publisherName); 
 
-/* Synchronous call to delete a Publisher zk node */ 
+/* Queue the deletion of a Publisher zk node (sent by zk_flush) */
 void zk_publisher_delete(const char* timelineName, const char* topicName, const char* publisherName); 
 
-/* Asynchronous call to Create a Subscriber zk node */ 
+/* Queue the creation of a Subscriber zk node (sent by zk_flush) */
 void zk_subscriber_create(const char* timelineName, const char* topicName, const char* subscriberName);
 
-/* Synchronous call to delete a Subscriber zk node */ 
+/* Queue the deletion of a Subscriber zk node (sent by zk_flush) */
 void zk_subscriber_delete(const char* timelineName, const char* topicName, const char* subscriberName);
 
+/* Have the flusher thread send the queued zk node updates as multi-op transactions, returns the number queued */
+int zk_flush(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,41 +37,8 @@ extern "C"
  * Auxiliary functions
  */
 
-/* Make a path to a znode by combining multiple strings */
-char * make_path(int num, ...) 
-{
-    const char * tmp_string;
-    
-    va_list arguments;
-    va_start ( arguments, num );
-    
-    int total_length = 0;
-    int x;
-    for ( x = 0; x < num; x++ ) {
-        tmp_string = va_arg ( arguments, const char * );
-        if(tmp_string != NULL) {
-            LOG_DEBUG(("Counting path with this path %s (%d)", tmp_string, num));
-            total_length += strlen(tmp_string);
-        }
-    }
-
-    va_end ( arguments );
-
-    char * path = (char*) malloc(total_length * sizeof(char) + 1);
-    path[0] = '\0';
-    va_start ( arguments, num );
-    
-    for ( x = 0; x < num; x++ ) {
-        tmp_string = va_arg ( arguments, const char * );
-        if(tmp_string != NULL) {
-            LOG_DEBUG(("Counting path with this path %s",
-                       tmp_string));
-            strcat(path, tmp_string);
-        }
-    }
-
-    return path;
-}
+/* Make a path to a znode by combining multiple strings (into a caller buffer, see zk_path_join) */
+#define make_path(buf, num, ...) zk_path_join(buf, sizeof(buf), num, __VA_ARGS__)
 
 /* Make a copy of a string vector */
 struct String_vector* make_copy( const struct String_vector* vector ) 
@@ -125,56 +92,28 @@ void free_vector(struct String_vector* vector)
     free(vector);
 }
 
-/*
- * Functions to find if a node is contained within a string vector
- */
-
-int contains(const char * child, const struct String_vector* children) 
-{
-  int i;
-  for(i = 0; i < children->count; i++) {
-    if(!strcmp(child, children->data[i])) {
-      return 1;
-    }
-  }
-
-  return 0;
-}
-
 /*
  * This function returns the elements that are new in current
- * compared to previous and update previous.
+ * compared to previous and update previous. Previous is kept
+ * sorted, so both differences are a merge of two sorted lists.
  */
 struct String_vector* added_and_set(const struct String_vector* current,
                                     struct String_vector** previous) 
 {
     struct String_vector* diff = (struct String_vector*) malloc(sizeof(struct String_vector));
-    
-    int count = 0;
+    struct String_vector* sorted = make_copy(current);
     int i;
-    for(i = 0; i < current->count; i++) {
-        if (!contains(current->data[i], (*previous))) {
-            count++;
-        }
-    }
-    
-    allocate_vector(diff, count);
-    
-    int prev_count = count;
-    count = 0;
-    for(i = 0; i < current->count; i++) {
-        if (!contains(current->data[i], (* previous))) {
-            diff->data[count] = (char*) malloc(sizeof(char) * strlen(current->data[i]) + 1);
-            memcpy(diff->data[count++],
-                   current->data[i],
-                   strlen(current->data[i]));
-        }
+
+    zk_children_sort(sorted->data, sorted->count);
+    allocate_vector(diff, sorted->count);
+    diff->count = zk_children_diff(sorted->data, sorted->count,
+                                   (*previous)->data, (*previous)->count, diff->data);
+    for(i = 0; i < diff->count; i++) {
+        diff->data[i] = strdup(diff->data[i]);
     }
-    
-    assert(prev_count == count);
-    
+
     free_vector((struct String_vector*) *previous);
-    (*previous) = make_copy(current);
+    (*previous) = sorted;
     
     return diff; 
 }
@@ -187,30 +126,19 @@ struct String_vector* removed_and_set(const struct String_vector* current,
                                       struct String_vector** previous) 
 {    
     struct String_vector* diff = (struct String_vector*) malloc(sizeof(struct String_vector));
-    
-    int count = 0;
+    struct String_vector* sorted = make_copy(current);
     int i;
-    for(i = 0; i < (* previous)->count; i++) {
-        if (!contains((* previous)->data[i], current)) {
-            count++;
-        }
-    }
-    
-    allocate_vector(diff, count);
-    
-    int prev_count = count;
-    count = 0;
-    for(i = 0; i < (* previous)->count; i++) {
-        if (!contains((* previous)->data[i], current)) {
-            diff->data[count] = (char*) malloc(sizeof(char) * strlen((* previous)->data[i]));
-            strcpy(diff->data[count++], (* previous)->data[i]);
-        }
-    }
 
-    assert(prev_count == count);
+    zk_children_sort(sorted->data, sorted->count);
+    allocate_vector(diff, (*previous)->count);
+    diff->count = zk_children_diff((*previous)->data, (*previous)->count,
+                                   sorted->data, sorted->count, diff->data);
+    for(i = 0; i < diff->count; i++) {
+        diff->data[i] = strdup(diff->data[i]);
+    }
 
     free_vector((struct String_vector*) *previous);
-    (*previous) = make_copy(current);
+    (*previous) = sorted;
     
     return diff;
 }
@@ -268,6 +196,8 @@ void main_watcher (zhandle_t *zkh,
         } else if (state == ZOO_EXPIRED_SESSION_STATE) {
             expired = 1;
             connected = 0;
+            /* The ephemeral znodes went with the session */
+            zk_mirror_reset(&mirror);
             zookeeper_close(zkh);
         }
     }
@@ -324,13 +254,13 @@ void master_check_completion (int rc, const char *value, int value_len,
 
 void check_master () 
 {
-    char* path = make_path(2, "/brokers/" , brokerGroup);
+    char path[ZK_PATH_MAX];
+    make_path(path, 2, "/brokers/" , brokerGroup);
     zoo_aget(zh,
              path,
              0,
              master_check_completion,
              NULL);
-    free(path);
 }
 
 
@@ -347,10 +277,10 @@ void master_exists_watcher (zhandle_t *zh,
                             void *watcherCtx) 
 {
     if( type == ZOO_DELETED_EVENT) {
-    	char* broker_path = make_path(2, "/brokers/" , brokerGroup);
+    	char broker_path[ZK_PATH_MAX];
+    	make_path(broker_path, 2, "/brokers/" , brokerGroup);
         assert( !strcmp(path, broker_path) );
         run_for_master();
-        free(broker_path);
     } else {
         LOG_DEBUG(("Watched event: ", type2string(type)));
     }
@@ -381,7 +311,8 @@ void master_exists_completion (int rc, const struct Stat *stat, const void *data
 
 void master_exists() 
 {
-	char* path = make_path(2, "/brokers/" , brokerGroup);
+	char path[ZK_PATH_MAX];
+	make_path(path, 2, "/brokers/" , brokerGroup);
 	leader = 0;
     zoo_awexists(zh,
                  path,
@@ -389,7 +320,6 @@ void master_exists()
                  NULL,
                  master_exists_completion,
                  NULL);
-    free(path);
 }
 
 void master_create_completion (int rc, const char *value, const void *data) 
@@ -425,7 +355,8 @@ void run_for_master()
 
         return;
     }
-    char* path = make_path(2, "/brokers/" , brokerGroup);
+    char path[ZK_PATH_MAX];
+    make_path(path, 2, "/brokers/" , brokerGroup);
     
     printf("*********** Registering Broker *****************\n");
     
@@ -439,125 +370,148 @@ void run_for_master()
                 ZOO_EPHEMERAL,
                 master_create_completion,
                 NULL);
-    free(path);
 }
 
 /*********************************************************************************/
 /*
- * Routines to bootstrap initial parent znodes 
+ * Mirroring of the znode tree: timelines, topics, publishers and subscribers
+ * are queued on the mirror, which skips what its cache already shows in place,
+ * and the flusher thread woken by zk_flush() sends them as multi-op transactions
  */
 
-/* Create a parent node */
-void create_parent(const char * path, const char * value);
+/* Function to get subscribers to the topic */
+void get_subscribers(const char * path);
 
-/*
- * Completion function for creating parent znodes.
- */
-void create_parent_completion (int rc, const char * value, const void * data) 
+/* Function to get publishers to the topic */
+void get_publishers(const char * path);
+
+/* Map a ZooKeeper return code onto a mirror status */
+static int zk_status(int rc)
 {
     switch (rc) {
-        case ZCONNECTIONLOSS:
-            create_parent(value, (const char *) data);
-            
-            break;
         case ZOK:
-            LOG_INFO(("Created parent node", value));
-
-            break;
+            return ZK_STATUS_OK;
+        case ZNONODE:
+            return ZK_STATUS_NONODE;
         case ZNODEEXISTS:
-            LOG_WARN(("Node already exists"));
-            
-            break;
+            return ZK_STATUS_EXISTS;
+        case ZNOTEMPTY:
+            return ZK_STATUS_NOTEMPTY;
+        case ZCONNECTIONLOSS:
+        case ZOPERATIONTIMEOUT:
+            return ZK_STATUS_RETRY;
         default:
-	  		LOG_ERROR(("Something went wrong when creating a parent node: %s, %s", value, rc2string(rc)));
-            
-            break;
+            return ZK_STATUS_ERROR;
+    }
+}
+
+/* Send a batch of mirrored updates as one ZooKeeper transaction */
+int zk_multi(void *ctx, const struct zk_op *ops, int count, int *failed)
+{
+    zoo_op_t zops[count];
+    zoo_op_result_t results[count];
+    char created[ZK_PATH_MAX];
+    int i, rc;
+
+    for (i = 0; i < count; i++) {
+        if (ops[i].type == ZK_OP_CREATE) {
+            zoo_create_op_init(&zops[i],
+                               ops[i].path,
+                               ops[i].value,
+                               ops[i].length,
+                               &ZOO_OPEN_ACL_UNSAFE,
+                               (ops[i].flags & ZK_FLAG_EPHEMERAL) ? ZOO_EPHEMERAL : 0,
+                               created,
+                               sizeof(created));
+        } else {
+            zoo_delete_op_init(&zops[i], ops[i].path, -1);
+        }
     }
-}
+    memset(results, 0, sizeof(results));
 
-/* Create a parent node */
-void create_parent(const char * path, const char * value) 
-{
-    zoo_acreate(zh,
-                path,
-                value,
-                0,
-                &ZOO_OPEN_ACL_UNSAFE,
-                0,
-                create_parent_completion,
-                NULL);
+    rc = zoo_multi(zh, count, zops, results);
+    if (rc == ZOK || zk_status(rc) == ZK_STATUS_RETRY)
+        return zk_status(rc);
+
+    /* The operations ahead of the failing one report ZOK, the ones after it a runtime inconsistency */
+    *failed = -1;
+    for (i = 0; i < count; i++) {
+        if (results[i].err != ZOK && results[i].err != ZRUNTIMEINCONSISTENCY) {
+            *failed = i;
+            return zk_status(results[i].err);
+        }
+    }
+    return zk_status(rc);
 }
 
-/* Create a parent node synchronous call*/
-int create_parent_sync(const char * path, const char * value) 
+/* Completion of a mirrored update, publishers and subscribers start watching the other side of their topic */
+void zk_update_completion(void *arg, const struct zk_op *op, int status)
 {
-    int rc = ZNONODE;
-    while (rc == ZNONODE)
-    {
-        rc = zoo_create(zh,
-                        path,
-                        value,
-                        0,
-                        &ZOO_OPEN_ACL_UNSAFE,
-                        0,
-                        NULL,
-                        0);
+    if (op->type == ZK_OP_DELETE) {
+        if (status == ZK_STATUS_OK || status == ZK_STATUS_NONODE) {
+            LOG_DEBUG(("Deleted node: %s", op->path));
+        } else {
+            LOG_ERROR(("Something went wrong when deleting node: %s", op->path));
+        }
+        return;
     }
-    return rc;
-}
 
-/*********************************************************************************/
-/*
- * Routines to delete a znode
- */
+    switch (status) {
+        case ZK_STATUS_OK:
+            LOG_INFO(("Created node %s", op->path));
+            if (strstr(op->path, "/publishers/") != NULL) {
+                // Setup a poll for subscribers for the same topic
+                get_subscribers(op->path);
+            } else if (strstr(op->path, "/subscribers/") != NULL) {
+                // Setup a poll for publishers for the same topic
+                get_publishers(op->path);
+            }
 
-/* znode deletion function declaration */
-void delete_znode(const char *path) ;
+            break;
+        case ZK_STATUS_EXISTS:
+            LOG_WARN(("Node already exists"));
 
-/* Completion function called when the request to delete znode returns. */
-void delete_znode_completion(int rc, const void *data) 
-{
-    switch (rc) {
-        case ZCONNECTIONLOSS:
-        case ZOPERATIONTIMEOUT:
-            delete_znode((const char *) data);
-        break;
-        case ZOK:
-            LOG_DEBUG(("Deleted node: %s", (char *) data));
-            free((char *) data);
-        break;
+            break;
         default:
-            LOG_ERROR(("Something went wrong when deleting node: %s",
-            rc2string(rc)));
-        break;
+            LOG_ERROR(("Something went wrong when creating node: %s", op->path));
+
+            break;
     }
 }
 
-/* znode deletion function*/
-void delete_znode(const char *path) 
+/* Flusher thread, sends the queued updates whenever zk_flush() asks for it */
+static void *zk_flusher(void *arg)
 {
-    if(path == NULL) 
-        return;
-    char * tmp_path = strdup(path);
-    zoo_adelete(zh,
-                tmp_path,
-                -1,
-                delete_znode_completion,
-                (const void*) tmp_path);
+    (void) arg;
+
+    while (1) {
+        pthread_mutex_lock(&flush_mutex);
+        while (!flush_requested)
+            pthread_cond_wait(&flush_cond, &flush_mutex);
+        flush_requested = 0;
+        pthread_mutex_unlock(&flush_mutex);
+
+        if(!connected) {
+            LOG_WARN(("Client not connected to ZooKeeper"));
+            continue;
+        }
+        /* zoo_multi blocks until the transaction completes, so this runs here and not on the caller */
+        zk_mirror_flush(&mirror);
+    }
+    return NULL;
 }
 
-/* znode deletion function*/
-int sync_delete_znode(const char *path) 
+/* Wake the flusher thread to send the queued znode updates, returns the number queued */
+int zk_flush(void)
 {
-    int rc;
-    if(path == NULL) 
-        return ZBADARGUMENTS;
-    rc = zoo_delete(zh, path, -1);
+    pthread_mutex_lock(&flush_mutex);
+    flush_requested = 1;
+    pthread_cond_signal(&flush_cond);
+    pthread_mutex_unlock(&flush_mutex);
 
-    return rc;
+    return zk_mirror_pending(&mirror);
 }
 
-
 /*********************************************************************************/
 /*
  * Timeline Handling Logic
@@ -572,33 +526,17 @@ int zk_timeline_create(const char* timelineName)
         return ZCONNECTIONLOSS;
     }
     
-   	char* path = make_path(2, "/timelines/" , timelineName);
-    
-    printf("Registering Timeline %s\n", timelineName);
+    char path[ZK_PATH_MAX];
+    if (make_path(path, 2, "/timelines/" , timelineName) < 0)
+        return ZBADARGUMENTS;
     
-    char* tmp_string;
-    int rc = ZNONODE;
-
-    /* Wait untill the node creation occurs */
-    while (rc == ZNONODE)
-    {
-       rc = zoo_create(zh, 
-                       path,
-                       tmp_string,
-                       0, 
-                       &ZOO_OPEN_ACL_UNSAFE, 
-                       0,
-                       NULL, 
-                       0); 
-    }
     /* Possible Return Codes
-     * ZOK operation completed successfully
-     * ZNONODE the parent node does not exist.
-     * ZNODEEXISTS the node already exists
-     * ZNOAUTH the client does not have permission.
+     * ZOK the creation is queued, or the node is known to exist
+     * ZBADARGUMENTS the path is too long
      */
-    free(path);
-    return rc;
+    if (zk_mirror_create(&mirror, path, NULL, 0, 0) > 0)
+        printf("Registering Timeline %s\n", timelineName);
+    return ZOK;
 }
 
 void zk_timeline_delete(const char* timelineName) 
@@ -609,9 +547,11 @@ void zk_timeline_delete(const char* timelineName)
         return;
     }
     
-    char* path = make_path(2, "/timelines/" , timelineName);
+    char path[ZK_PATH_MAX];
+    if (make_path(path, 2, "/timelines/" , timelineName) < 0)
+        return;
     printf("Deleting Timeline %s\n", timelineName);
-    delete_znode(path);
+    zk_mirror_delete(&mirror, path);
 }
 
 /*********************************************************************************/
@@ -619,57 +559,7 @@ void zk_timeline_delete(const char* timelineName)
  * Topic Handling Logic
  */
 
-
-/* Re-try to create a topic node */
-void create_topic(const char * path, const char * value);
-
-/*
- * Completion function for creating topic nodes.
- */
-void topic_create_completion (int rc, const char * value, const void * data) 
-{
-    switch (rc) {
-        case ZCONNECTIONLOSS:
-            create_topic(value, (const char *) data);
-            
-            break;
-        case ZOK:
-            {
-                LOG_INFO(("Created topic node", value));
-                char* pub_path = make_path(2, value, "/publishers");
-       			char* sub_path = make_path(2, value, "/subscribers");
-                create_parent(pub_path, "");
-                create_parent(sub_path, "");
-                free(pub_path);
-                free(sub_path);
-            }
-            break;
-        case ZNODEEXISTS:
-            LOG_WARN(("Node already exists"));
-            
-            break;
-        default:
-	  		LOG_ERROR(("Something went wrong when creating the topic: %s, %s", value, rc2string(rc)));
-            
-            break;
-    }
-}
-
-/* Re-try to create a topic node */
-void create_topic(const char * path, const char * value) 
-{
-    zoo_acreate(zh,
-                path,
-                value,
-                0,
-                &ZOO_OPEN_ACL_UNSAFE,
-                0,
-                topic_create_completion,
-                NULL);   
-}
-
-/* Remove a new topic to a timeline (synchronous call)
-   Note: Will fail if child node exist (this is desirable)*/
+/* Add a new topic to a timeline, with the parents of its publishers and subscribers */
 int zk_topic_create(const char* timelineName, const char* topicName) 
 {
     if(!connected) {
@@ -678,43 +568,22 @@ int zk_topic_create(const char* timelineName, const char* topicName)
         return ZCONNECTIONLOSS;
     }
     
-   	char* path = make_path(4, "/timelines/" , timelineName, "/", topicName);
-    printf("Registering Topic %s on Timeline %s\n", timelineName, topicName);
-    
-    char* tmp_string;
-    int rc = ZNONODE;
-
-    /* Wait until the node creation occurs */
-    while (rc == ZNONODE)
-    {
-       rc = zoo_create(zh, 
-                       path,
-                       tmp_string,
-                       0, 
-                       &ZOO_OPEN_ACL_UNSAFE, 
-                       0,
-                       NULL, 
-                       0); 
-    }
-    /* Possible Return Codes
-     * ZOK operation completed successfully
-     * ZNONODE the parent node does not exist.
-     * ZNODEEXISTS the node already exists
-     * ZNOAUTH the client does not have permission.
-     */
-
-    char* pub_path = make_path(5, "/timelines/" , timelineName, "/", topicName, "/publishers");
-    char* sub_path = make_path(5, "/timelines/" , timelineName, "/", topicName, "/subscribers");
-    rc = create_parent_sync(pub_path, "");
-    rc = create_parent_sync(sub_path, "");
-    free(pub_path);
-    free(sub_path);
+    char path[ZK_PATH_MAX], pub_path[ZK_PATH_MAX], sub_path[ZK_PATH_MAX];
+    if (make_path(path, 4, "/timelines/" , timelineName, "/", topicName) < 0
+     || make_path(pub_path, 2, path, "/publishers") < 0
+     || make_path(sub_path, 2, path, "/subscribers") < 0)
+        return ZBADARGUMENTS;
 
-    free(path);
-    return rc;
+    if (zk_mirror_create(&mirror, path, NULL, 0, 0) > 0)
+        printf("Registering Topic %s on Timeline %s\n", topicName, timelineName);
+    zk_mirror_create(&mirror, pub_path, NULL, 0, 0);
+    zk_mirror_create(&mirror, sub_path, NULL, 0, 0);
+    return ZOK;
 }
 
-/* Add a new topic to a timeline (synchronous call)*/
+/* Remove a topic from a timeline
+   Note: Will fail if child node exist (this is desirable), the publishers and
+   subscribers of this broker are deleted ahead of it in the same transaction */
 void zk_topic_delete(const char* timelineName, const char* topicName) 
 {
     if(!connected) {
@@ -722,21 +591,16 @@ void zk_topic_delete(const char* timelineName, const char* topicName)
         return;
     }
 
-    char* pub_path = make_path(5, "/timelines/" , timelineName, "/", topicName, "/publishers");
-    char* sub_path = make_path(5, "/timelines/" , timelineName, "/", topicName, "/subscribers");
-    delete_znode(pub_path);
-    delete_znode(sub_path);
-    free(pub_path);
-    free(sub_path);
+    char path[ZK_PATH_MAX], pub_path[ZK_PATH_MAX], sub_path[ZK_PATH_MAX];
+    if (make_path(path, 4, "/timelines/" , timelineName, "/", topicName) < 0
+     || make_path(pub_path, 2, path, "/publishers") < 0
+     || make_path(sub_path, 2, path, "/subscribers") < 0)
+        return;
 
-    sleep(2);
-    
-    char* path = make_path(4, "/timelines/" , timelineName, "/", topicName);
-    printf("Deleting zk node Topic %s on Timeline %s\n", timelineName, topicName);
-    
-    delete_znode(path);
-    free(path);
-    return;
+    printf("Deleting zk node Topic %s on Timeline %s\n", topicName, timelineName);
+    zk_mirror_delete(&mirror, pub_path);
+    zk_mirror_delete(&mirror, sub_path);
+    zk_mirror_delete(&mirror, path);
 }
 
 /*********************************************************************************/
@@ -744,9 +608,6 @@ void zk_topic_delete(const char* timelineName, const char* topicName)
  *  Logic to listen for relevant subscribers to a topic
  */
 
-/* Function to get subscribers to the topic */
-void get_subscribers(const char * path);
-
 /* Completion function looking for subscribers, to match with publishers */
 void get_subscribers_completion (int rc,
                          const struct String_vector *strings,
@@ -755,7 +616,7 @@ void get_subscribers_completion (int rc,
     switch (rc) {
         case ZCONNECTIONLOSS:
         case ZOPERATIONTIMEOUT:
-            get_subscribers((char*) data);
+            get_subscribers((const char*) data);
             
             break;
         case ZOK:
@@ -767,7 +628,6 @@ void get_subscribers_completion (int rc,
 
             // struct String_vector *tmp_workers = removed_and_set(strings, &workers);
             // free_vector(tmp_workers);
-            get_subscribers((char*) data);
 
             break;
         default:
@@ -775,6 +635,7 @@ void get_subscribers_completion (int rc,
             
             break;
     }
+    free((char*) data);
 }
 
 /* Subscriber Watch return function */
@@ -786,36 +647,32 @@ void subscribers_watcher (zhandle_t *zh, int type, int state, const char *path,v
     }
 }
 
-/* Pre-process the path for the get_subscribers() function */
-char* process_sub_topic_string(const char* path)
+/* Replace the endpoint part of a path ("/publishers/<name>") with the parent of the other side */
+int process_topic_string(const char* path, const char* from, const char* to, char* new_path, size_t size)
 {
-	char* new_path = (char*) malloc((strlen(path)+1)*sizeof(char));
-	char* replace_ptr;
+	const char* replace_ptr = strstr(path, from);
+	size_t len = (replace_ptr != NULL) ? (size_t) (replace_ptr - path) : strlen(path);
 
-	// Find "/publishers/" string
-	replace_ptr = (char*) strstr(path, "/publishers/");
+	if (len >= size)
+		return -1;
+	memcpy(new_path, path, len);
+	new_path[len] = '\0';
 	if (replace_ptr != NULL)
-	{
-		size_t len = replace_ptr - path;
-		strncpy(new_path, path, len);
-		new_path[len] = '\0';
-		strcat(new_path, "/subscribers");
-		return new_path;
-	}
-	strcpy(new_path, path);
-	return new_path;
+		return zk_path_join(new_path + len, size - len, 1, to) < 0 ? -1 : 0;
+	return 0;
 }
 
 /* Function to get subscribers to the topic */
 void get_subscribers(const char * path){
-	char *new_path = process_sub_topic_string(path);
+	char new_path[ZK_PATH_MAX];
+	if (process_topic_string(path, "/publishers/", "/subscribers", new_path, sizeof(new_path)) < 0)
+		return;
     zoo_awget_children(zh,
                        new_path,
                        subscribers_watcher,
                        NULL,
                        get_subscribers_completion,
-                       (void*) new_path);
-    free(new_path);
+                       (void*) strdup(new_path));
 }
 
 /*********************************************************************************/
@@ -823,47 +680,6 @@ void get_subscribers(const char * path){
  * Logic to handle publisher creation
  */
 
-/* Re-try to create a publisher node */
-void create_publisher(const char * path, const char * value);
-
-/*
- * Completion function for creating publishers/subscribers
- */
-void publisher_create_completion (int rc, const char * value, const void * data) {
-    switch (rc) {
-        case ZCONNECTIONLOSS:
-            create_publisher(value, (const char *) data);
-            
-            break;
-        case ZOK:
-            LOG_INFO(("Created publisher node", value));
-            // Setup a poll for subscribers for the same topic
-            get_subscribers(value);
-
-            break;
-        case ZNODEEXISTS:
-            LOG_WARN(("Node already exists"));
-            
-            break;
-        default:
-	  		LOG_ERROR(("Something went wrong when creating the topic: %s, %s", value, rc2string(rc)));
-            
-            break;
-    }
-}
-
-/* Re-try to create a publisher node */
-void create_publisher(const char* path, const char* value) {    
-    zoo_acreate(zh,
-                path,
-                value,
-                strlen(value) + 1,
-                &ZOO_OPEN_ACL_UNSAFE,
-                ZOO_EPHEMERAL,
-                publisher_create_completion,
-                NULL);    
-}
-
 /* Add a new publisher to a topic*/
 void zk_publisher_create(const char* timelineName, const char* topicName, const char* publisherName) {
     if(!connected) {
@@ -872,18 +688,12 @@ void zk_publisher_create(const char* timelineName, const char* topicName, const
         return;
     }
     
-   	char* path = make_path(6, "/timelines/" , timelineName, "/", topicName, "/publishers/", publisherName);
-    printf("Registering the existense of a Publisher on Topic %s on Timeline %s\n", timelineName, topicName);
+   	char path[ZK_PATH_MAX];
+   	if (make_path(path, 6, "/timelines/" , timelineName, "/", topicName, "/publishers/", publisherName) < 0)
+   		return;
+    printf("Registering the existense of a Publisher on Topic %s on Timeline %s\n", topicName, timelineName);
 
-    zoo_acreate(zh,
-                path,
-                brokerGroup,
-                strlen(brokerGroup) + 1,
-                &ZOO_OPEN_ACL_UNSAFE,
-                ZOO_EPHEMERAL,
-                publisher_create_completion,
-                NULL);
-    free(path);
+    zk_mirror_create(&mirror, path, brokerGroup, strlen(brokerGroup) + 1, ZK_FLAG_EPHEMERAL);
 }
 
 /* Delete a new publisher from a topic*/
@@ -894,11 +704,12 @@ void zk_publisher_delete(const char* timelineName, const char* topicName, const
         return;
     }
     
-    char* path = make_path(6, "/timelines/" , timelineName, "/", topicName, "/publishers/", publisherName);
-    printf("Deleting znode of a Publisher on Topic %s on Timeline %s\n", timelineName, topicName);
+    char path[ZK_PATH_MAX];
+    if (make_path(path, 6, "/timelines/" , timelineName, "/", topicName, "/publishers/", publisherName) < 0)
+        return;
+    printf("Deleting znode of a Publisher on Topic %s on Timeline %s\n", topicName, timelineName);
 
-    sync_delete_znode(path);
-    free(path);
+    zk_mirror_delete(&mirror, path);
 }
 
 /*********************************************************************************/
@@ -906,9 +717,6 @@ void zk_publisher_delete(const char* timelineName, const char* topicName, const
  * Logic to listen to relevant publishers to a topic
  */
 
-/* Function to get publishers to the topic */
-void get_publishers(const char * path);
-
 /* Completion function looking for publishers, to match with subscribers */
 void get_publishers_completion (int rc,
                          const struct String_vector *strings,
@@ -916,7 +724,7 @@ void get_publishers_completion (int rc,
     switch (rc) {
         case ZCONNECTIONLOSS:
         case ZOPERATIONTIMEOUT:
-            get_publishers((char*) data);
+            get_publishers((const char*) data);
             
             break;
         case ZOK:
@@ -928,7 +736,6 @@ void get_publishers_completion (int rc,
 
             // struct String_vector *tmp_workers = removed_and_set(strings, &workers);
             // free_vector(tmp_workers);
-            get_publishers((char*) data);
 
             break;
         default:
@@ -936,6 +743,7 @@ void get_publishers_completion (int rc,
             
             break;
     }
+    free((char*) data);
 }
 
 /* Publisher Watch return function */
@@ -947,36 +755,17 @@ void publishers_watcher (zhandle_t *zh, int type, int state, const char *path,vo
     }
 }
 
-/* Pre-process the path for the get_publishers() function */
-char* process_pub_topic_string(const char* path)
-{
-	char* new_path = (char*) malloc((strlen(path)+1)*sizeof(char));
-	char* replace_ptr;
-
-	// Find "/subscribers/" string
-	replace_ptr = (char*) strstr(path, "/subscribers/");
-	if (replace_ptr != NULL)
-	{
-		size_t len = replace_ptr - path;
-		strncpy(new_path, path, len);
-		new_path[len] = '\0';
-		strcat(new_path, "/publishers");
-		return new_path;
-	}
-	strcpy(new_path, path);
-	return new_path;
-}
-
 /* Function to get publishers to the topic */
 void get_publishers(const char * path){
-	char *new_path = process_pub_topic_string(path);
+	char new_path[ZK_PATH_MAX];
+	if (process_topic_string(path, "/subscribers/", "/publishers", new_path, sizeof(new_path)) < 0)
+		return;
     zoo_awget_children(zh,
                        new_path,
                        publishers_watcher,
                        NULL,
                        get_publishers_completion,
-                       (void*) new_path);
-    free(new_path);
+                       (void*) strdup(new_path));
 }
 
 /*********************************************************************************/
@@ -984,47 +773,6 @@ void get_publishers(const char * path){
  * Routines to handle subscriber creation
  */
 
-/* Re-try to create a subscriber node */
-void create_subscriber(const char * path, const char * value);
-
-/*
- * Completion function for creating publishers/subscribers
- */
-void subscriber_create_completion (int rc, const char * value, const void * data) {
-    switch (rc) {
-        case ZCONNECTIONLOSS:
-            create_subscriber(value, (const char *) data);
-            
-            break;
-        case ZOK:
-            LOG_INFO(("Created subscriber node", value));
-            // Setup a poll for publishers for the same topic
-            get_publishers(value);
-
-            break;
-        case ZNODEEXISTS:
-            LOG_WARN(("Node already exists"));
-            
-            break;
-        default:
-	  		LOG_ERROR(("Something went wrong when creating the topic: %s, %s", value, rc2string(rc)));
-            
-            break;
-    }
-}
-
-/* Re-try to create a subscriber node */
-void create_subscriber(const char * path, const char * value) {    
-    zoo_acreate(zh,
-                path,
-                value,
-                strlen(value) + 1,
-                &ZOO_OPEN_ACL_UNSAFE,
-                ZOO_EPHEMERAL,
-                subscriber_create_completion,
-                NULL);    
-}
-
 /* Add a new subscriber to a topic*/
 void zk_subscriber_create(const char* timelineName, const char* topicName, const char* subscriberName) {
     if(!connected) {
@@ -1033,18 +781,12 @@ void zk_subscriber_create(const char* timelineName, const char* topicName, const
         return;
     }
     
-   	char* path = make_path(6, "/timelines/" , timelineName, "/", topicName, "/subscribers/", subscriberName);
-    printf("Registering the existense of a Subscriber on Topic %s on Timeline %s\n", timelineName, topicName);
+   	char path[ZK_PATH_MAX];
+   	if (make_path(path, 6, "/timelines/" , timelineName, "/", topicName, "/subscribers/", subscriberName) < 0)
+   		return;
+    printf("Registering the existense of a Subscriber on Topic %s on Timeline %s\n", topicName, timelineName);
 
-    zoo_acreate(zh,
-                path,
-                brokerGroup,
-                strlen(brokerGroup) + 1,
-                &ZOO_OPEN_ACL_UNSAFE,
-                ZOO_EPHEMERAL,
-                subscriber_create_completion,
-                NULL);
-    free(path);
+    zk_mirror_create(&mirror, path, brokerGroup, strlen(brokerGroup) + 1, ZK_FLAG_EPHEMERAL);
 }
 
 /* Delete a subscriber from a topic*/
@@ -1055,11 +797,12 @@ void zk_subscriber_delete(const char* timelineName, const char* topicName, const
         return;
     }
     
-    char* path = make_path(6, "/timelines/" , timelineName, "/", topicName, "/subscribers/", subscriberName);
-    printf("Deleting the znode of a Subscriber on Topic %s on Timeline %s\n", timelineName, topicName);
+    char path[ZK_PATH_MAX];
+    if (make_path(path, 6, "/timelines/" , timelineName, "/", topicName, "/subscribers/", subscriberName) < 0)
+        return;
+    printf("Deleting the znode of a Subscriber on Topic %s on Timeline %s\n", topicName, timelineName);
 
-    sync_delete_znode(path);
-    free(path);
+    zk_mirror_delete(&mirror, path);
 }
 
 /*********************************************************************************/
@@ -1071,8 +814,9 @@ void bootstrap() {
         return;
     }
     
-    create_parent("/timelines", "");
-    create_parent("/brokers", "");
+    zk_mirror_create(&mirror, "/timelines", NULL, 0, 0);
+    zk_mirror_create(&mirror, "/brokers", NULL, 0, 0);
+    zk_mirror_flush(&mirror);
 
     // Initialize timeline vector
     timelines = (struct String_vector*) malloc(sizeof(struct String_vector));
@@ -1083,8 +827,19 @@ void bootstrap() {
 /* Initialize the Zookeeper connection -> takes in host:port pair to initiate connection*/
 int init (char * hostPort) 
 {
+    struct zk_backend backend = { zk_multi, NULL };
+
     srand(time(NULL));
     server_id  = rand();
+
+    /* Mirror of the znodes this broker maintains, batched into transactions */
+    zk_mirror_init(&mirror, &backend, ZK_BATCH_DEFAULT);
+    zk_mirror_set_done(&mirror, zk_update_completion, NULL);
+    if (pthread_create(&flusher, NULL, zk_flusher, NULL) == 0) {
+        pthread_detach(flusher);
+    } else {
+        LOG_ERROR(("Could not start the ZooKeeper flusher thread"));
+    }
     
     zoo_set_debug_level(ZOO_LOG_LEVEL_DEBUG);
     
@@ -40,11 +40,14 @@ extern "C"
 #include <stdarg.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <zookeeper.h>
 #include <zookeeper_log.h>
 #include <zookeeper.jute.h>
 
+#include "zk_mirror.h"
+
 /*
  * Global Variables
  */
@@ -56,6 +59,11 @@ static int expired = 0;							// Variable indicating if connection has expired
 static int leader = 0;							// Variable indicating if this edge broker is the local leader (active node)
 static int server_id;
 static struct String_vector* timelines = NULL;
+static struct zk_mirror mirror;					// Write-through cache and batching of the broker's znodes
+static pthread_t flusher;						// Thread sending the mirrored updates, off the DDS listener threads
+static pthread_mutex_t flush_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+static int flush_requested = 0;					// Set by zk_flush(), cleared by the flusher thread
 
 /*
  * Master Edge Broker Election Function definitions.
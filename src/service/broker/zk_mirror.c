@@ -0,0 +1,635 @@
+/*
+ * @file zk_mirror.c
+ * @brief Write-through cache and multi-op batching of the edge broker znode tree
+ * @author Sandeep D'souza
+ * 
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice, 
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "zk_mirror.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*********************************************************************************/
+/*
+ * Znode tree (a chained hash set of paths)
+ */
+
+struct zk_tree_node {
+    struct zk_tree_node *next;
+    uint64_t hash;
+    size_t length;
+    int children;
+    char path[];
+};
+
+#define ZK_TREE_BUCKETS 64
+
+/* FNV-1a hash of a path */
+static uint64_t zk_hash(const char *path, size_t length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char) path[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* A path is absolute, below the root and without a trailing slash */
+static int zk_path_valid(const char *path, size_t *length)
+{
+    if (path == NULL || path[0] != '/')
+        return 0;
+    *length = strlen(path);
+    return *length > 1 && *length < ZK_PATH_MAX && path[*length - 1] != '/';
+}
+
+/* Length of the parent path, 0 if the parent is the root */
+static size_t zk_parent_length(const char *path, size_t length)
+{
+    while (length > 0 && path[length - 1] != '/')
+        length--;
+    return length > 0 ? length - 1 : 0;
+}
+
+/* Slot holding the node of a path, or the empty slot at the end of its chain */
+static struct zk_tree_node **zk_tree_slot(const struct zk_tree *tree, const char *path,
+                                          size_t length, uint64_t hash)
+{
+    struct zk_tree_node **slot = &tree->buckets[hash & tree->mask];
+    while (*slot != NULL) {
+        if ((*slot)->hash == hash && (*slot)->length == length && !memcmp((*slot)->path, path, length))
+            break;
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+static struct zk_tree_node *zk_tree_find(const struct zk_tree *tree, const char *path, size_t length)
+{
+    return *zk_tree_slot(tree, path, length, zk_hash(path, length));
+}
+
+/* Double the buckets once the chains get longer than one node on average */
+static void zk_tree_grow(struct zk_tree *tree)
+{
+    size_t size = (tree->mask + 1) * 2, i;
+    struct zk_tree_node **buckets = (struct zk_tree_node **) calloc(size, sizeof(*buckets));
+    if (buckets == NULL)
+        return;
+    for (i = 0; i <= tree->mask; i++) {
+        struct zk_tree_node *node = tree->buckets[i], *next;
+        for (; node != NULL; node = next) {
+            next = node->next;
+            node->next = buckets[node->hash & (size - 1)];
+            buckets[node->hash & (size - 1)] = node;
+        }
+    }
+    free(tree->buckets);
+    tree->buckets = buckets;
+    tree->mask = size - 1;
+}
+
+int zk_tree_init(struct zk_tree *tree)
+{
+    tree->buckets = (struct zk_tree_node **) calloc(ZK_TREE_BUCKETS, sizeof(*tree->buckets));
+    tree->mask = ZK_TREE_BUCKETS - 1;
+    tree->count = 0;
+    return tree->buckets == NULL ? -1 : 0;
+}
+
+void zk_tree_clear(struct zk_tree *tree)
+{
+    size_t i;
+    for (i = 0; i <= tree->mask; i++) {
+        struct zk_tree_node *node = tree->buckets[i], *next;
+        for (; node != NULL; node = next) {
+            next = node->next;
+            free(node);
+        }
+        tree->buckets[i] = NULL;
+    }
+    tree->count = 0;
+}
+
+void zk_tree_destroy(struct zk_tree *tree)
+{
+    if (tree->buckets == NULL)
+        return;
+    zk_tree_clear(tree);
+    free(tree->buckets);
+    tree->buckets = NULL;
+}
+
+int zk_tree_contains(const struct zk_tree *tree, const char *path)
+{
+    size_t length;
+    if (!zk_path_valid(path, &length))
+        return 0;
+    return zk_tree_find(tree, path, length) != NULL;
+}
+
+int zk_tree_children(const struct zk_tree *tree, const char *path)
+{
+    struct zk_tree_node *node;
+    size_t length;
+    if (!zk_path_valid(path, &length))
+        return -1;
+    node = zk_tree_find(tree, path, length);
+    return node != NULL ? node->children : -1;
+}
+
+int zk_tree_add(struct zk_tree *tree, const char *path, int strict)
+{
+    struct zk_tree_node **slot, *node, *parent = NULL;
+    size_t length, parent_length;
+    uint64_t hash;
+
+    if (!zk_path_valid(path, &length))
+        return ZK_STATUS_ERROR;
+    hash = zk_hash(path, length);
+    slot = zk_tree_slot(tree, path, length, hash);
+    if (*slot != NULL)
+        return ZK_STATUS_EXISTS;
+    parent_length = zk_parent_length(path, length);
+    if (parent_length > 0)
+        parent = zk_tree_find(tree, path, parent_length);
+    if (strict && parent_length > 0 && parent == NULL)
+        return ZK_STATUS_NONODE;
+
+    node = (struct zk_tree_node *) malloc(sizeof(*node) + length + 1);
+    if (node == NULL)
+        return ZK_STATUS_ERROR;
+    node->next = NULL;
+    node->hash = hash;
+    node->length = length;
+    node->children = 0;
+    memcpy(node->path, path, length + 1);
+    *slot = node;
+    if (parent != NULL)
+        parent->children++;
+    if (++tree->count > tree->mask + 1)
+        zk_tree_grow(tree);
+    return ZK_STATUS_OK;
+}
+
+int zk_tree_remove(struct zk_tree *tree, const char *path, int strict)
+{
+    struct zk_tree_node **slot, *node, *parent;
+    size_t length, parent_length;
+
+    if (!zk_path_valid(path, &length))
+        return ZK_STATUS_ERROR;
+    slot = zk_tree_slot(tree, path, length, zk_hash(path, length));
+    node = *slot;
+    if (node == NULL)
+        return ZK_STATUS_NONODE;
+    if (strict && node->children > 0)
+        return ZK_STATUS_NOTEMPTY;
+    *slot = node->next;
+    free(node);
+    tree->count--;
+
+    parent_length = zk_parent_length(path, length);
+    if (parent_length > 0) {
+        parent = zk_tree_find(tree, path, parent_length);
+        if (parent != NULL && parent->children > 0)
+            parent->children--;
+    }
+    return ZK_STATUS_OK;
+}
+
+/*********************************************************************************/
+/*
+ * Mirror
+ */
+
+/* Append an update to the queue (called with the lock held) */
+static int zk_mirror_push(struct zk_mirror *mirror, enum zk_op_type type, const char *path,
+                          const char *value, int length, int flags, int attempts)
+{
+    struct zk_op *op;
+    if (mirror->count == mirror->capacity) {
+        int capacity = mirror->capacity ? mirror->capacity * 2 : 64;
+        struct zk_op *pending = (struct zk_op *) realloc(mirror->pending, capacity * sizeof(*pending));
+        if (pending == NULL)
+            return -1;
+        mirror->pending = pending;
+        mirror->capacity = capacity;
+    }
+    op = &mirror->pending[mirror->count++];
+    op->type = type;
+    op->flags = flags;
+    op->length = length;
+    op->attempts = attempts;
+    strcpy(op->path, path);
+    if (length > 0)
+        memcpy(op->value, value, length);
+    mirror->stats.queued++;
+    return 0;
+}
+
+/* Put updates back at the front of the queue, ahead of those queued since
+   (called with the lock held) */
+static int zk_mirror_unshift(struct zk_mirror *mirror, const struct zk_op *ops, int count)
+{
+    struct zk_op *pending = (struct zk_op *) malloc((count + mirror->count) * sizeof(*pending));
+    if (pending == NULL)
+        return -1;
+    memcpy(pending, ops, count * sizeof(*pending));
+    if (mirror->count > 0)
+        memcpy(pending + count, mirror->pending, mirror->count * sizeof(*pending));
+    free(mirror->pending);
+    mirror->pending = pending;
+    mirror->count = mirror->capacity = count + mirror->count;
+    return 0;
+}
+
+/*
+ * A create that found its parent missing means the cache was stale (another
+ * broker removed part of the tree). The parents are queued again, as the empty
+ * persistent znodes the broker tree is made of, followed by the update itself
+ * and the updates after it, all at the front of the queue: a later delete of
+ * the same path must not overtake the retried create (called with the lock held).
+ */
+static int zk_mirror_requeue(struct zk_mirror *mirror, const struct zk_op *ops, int count)
+{
+    const struct zk_op *op = &ops[0];
+    struct zk_op *retry;
+    const char *slash;
+    int parents = 0, rc;
+
+    for (slash = strchr(op->path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+        parents++;
+    retry = (struct zk_op *) malloc((parents + count) * sizeof(*retry));
+    if (retry == NULL)
+        return -1;
+    parents = 0;
+    for (slash = strchr(op->path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        struct zk_op *parent = &retry[parents++];
+        size_t length = slash - op->path;
+        parent->type = ZK_OP_CREATE;
+        parent->flags = 0;
+        parent->length = 0;
+        parent->attempts = op->attempts;
+        memcpy(parent->path, op->path, length);
+        parent->path[length] = '\0';
+        zk_tree_add(&mirror->cache, parent->path, 0);
+    }
+    memcpy(retry + parents, ops, count * sizeof(*retry));
+    rc = zk_mirror_unshift(mirror, retry, parents + count);
+    if (rc == 0)
+        mirror->stats.queued += parents + 1;
+    free(retry);
+    return rc;
+}
+
+/* Settle an update with its final status. Returns 1 if it failed for good,
+   and -1 if it is a create to retry after its parents (see zk_mirror_requeue) */
+static int zk_mirror_finish(struct zk_mirror *mirror, struct zk_op *op, int status)
+{
+    int failed = 0;
+
+    op->attempts++;
+    if (op->type == ZK_OP_CREATE && status == ZK_STATUS_NONODE && op->attempts < 2)
+        return -1;
+    pthread_mutex_lock(&mirror->lock);
+    if (op->type == ZK_OP_CREATE) {
+        /* A znode that is already there is as good as created */
+        if (status != ZK_STATUS_OK && status != ZK_STATUS_EXISTS) {
+            zk_tree_remove(&mirror->cache, op->path, 0);
+            failed = 1;
+        }
+    } else if (status != ZK_STATUS_OK && status != ZK_STATUS_NONODE) {
+        zk_tree_add(&mirror->cache, op->path, 0);
+        failed = 1;
+    }
+    mirror->stats.failed += failed;
+    pthread_mutex_unlock(&mirror->lock);
+
+    if (mirror->done != NULL)
+        mirror->done(mirror->done_arg, op, status);
+    return failed;
+}
+
+/*
+ * Send updates in transactions of up to batch operations. A failed transaction
+ * is applied by nobody, so the updates ahead of the failing one are resent on
+ * their own, the failing one is settled and the rest carry on in a new batch.
+ * Returns the number of updates sent before a connection loss or a create to
+ * retry after its parents (*retry set), or all of them.
+ */
+static int zk_mirror_send(struct zk_mirror *mirror, struct zk_op *ops, int count, int *failures, int *retry)
+{
+    int start = 0, limit = mirror->batch, culprit = -1, culprit_status = ZK_STATUS_OK;
+
+    while (start < count) {
+        int length = count - start < limit ? count - start : limit, failed = -1, status, rc, i;
+        limit = mirror->batch;
+
+        /* The failure of this update is already known from the transaction it spoiled */
+        if (start == culprit) {
+            status = culprit_status;
+            culprit = -1;
+        } else {
+            status = mirror->backend.multi(mirror->backend.ctx, ops + start, length, &failed);
+            pthread_mutex_lock(&mirror->lock);
+            mirror->stats.transactions++;
+            if (status == ZK_STATUS_RETRY)
+                mirror->stats.retries++;
+            pthread_mutex_unlock(&mirror->lock);
+
+            if (status == ZK_STATUS_OK) {
+                for (i = 0; i < length; i++)
+                    zk_mirror_finish(mirror, &ops[start + i], ZK_STATUS_OK);
+                start += length;
+                continue;
+            }
+            if (status == ZK_STATUS_RETRY)
+                break;
+            if (failed > 0 && failed < length) {
+                culprit = start + failed;
+                culprit_status = status;
+                limit = failed;
+                continue;
+            }
+            if (failed != 0 && length > 1) {
+                /* The backend cannot tell which update failed, find it one at a time */
+                limit = 1;
+                continue;
+            }
+        }
+
+        rc = zk_mirror_finish(mirror, &ops[start], status);
+        if (rc < 0) {
+            *retry = 1;
+            break;
+        }
+        *failures += rc;
+        start++;
+    }
+    return start;
+}
+
+int zk_mirror_init(struct zk_mirror *mirror, const struct zk_backend *backend, int batch)
+{
+    memset(mirror, 0, sizeof(*mirror));
+    if (backend == NULL || backend->multi == NULL)
+        return -1;
+    if (zk_tree_init(&mirror->cache))
+        return -1;
+    mirror->backend = *backend;
+    mirror->batch = batch <= 0 ? ZK_BATCH_DEFAULT : (batch > ZK_BATCH_MAX ? ZK_BATCH_MAX : batch);
+    pthread_mutex_init(&mirror->lock, NULL);
+    pthread_mutex_init(&mirror->flush_lock, NULL);
+    return 0;
+}
+
+void zk_mirror_destroy(struct zk_mirror *mirror)
+{
+    zk_tree_destroy(&mirror->cache);
+    free(mirror->pending);
+    mirror->pending = NULL;
+    mirror->count = mirror->capacity = 0;
+    pthread_mutex_destroy(&mirror->lock);
+    pthread_mutex_destroy(&mirror->flush_lock);
+}
+
+void zk_mirror_set_done(struct zk_mirror *mirror, zk_done_t done, void *arg)
+{
+    pthread_mutex_lock(&mirror->flush_lock);
+    mirror->done = done;
+    mirror->done_arg = arg;
+    pthread_mutex_unlock(&mirror->flush_lock);
+}
+
+int zk_mirror_create(struct zk_mirror *mirror, const char *path, const char *value, int length, int flags)
+{
+    int rc;
+
+    if (length < 0 || length > ZK_VALUE_MAX || (length > 0 && value == NULL))
+        return -1;
+    pthread_mutex_lock(&mirror->lock);
+    rc = zk_tree_add(&mirror->cache, path, 0);
+    if (rc == ZK_STATUS_EXISTS) {
+        mirror->stats.cached++;
+        pthread_mutex_unlock(&mirror->lock);
+        return 0;
+    }
+    if (rc == ZK_STATUS_OK && zk_mirror_push(mirror, ZK_OP_CREATE, path, value, length, flags, 0)) {
+        zk_tree_remove(&mirror->cache, path, 0);
+        rc = ZK_STATUS_ERROR;
+    }
+    pthread_mutex_unlock(&mirror->lock);
+    return rc == ZK_STATUS_OK ? 1 : -1;
+}
+
+int zk_mirror_delete(struct zk_mirror *mirror, const char *path)
+{
+    int rc, cached;
+
+    /* A znode missing from the cache may still exist: another broker may have
+       made it, or it was made before the cache was reset. The delete is sent
+       anyway, and a znode found gone counts as deleted. */
+    pthread_mutex_lock(&mirror->lock);
+    rc = zk_tree_remove(&mirror->cache, path, 0);
+    cached = rc == ZK_STATUS_OK;
+    if (rc == ZK_STATUS_NONODE)
+        rc = ZK_STATUS_OK;
+    if (rc == ZK_STATUS_OK && zk_mirror_push(mirror, ZK_OP_DELETE, path, NULL, 0, 0, 0)) {
+        if (cached)
+            zk_tree_add(&mirror->cache, path, 0);
+        rc = ZK_STATUS_ERROR;
+    }
+    pthread_mutex_unlock(&mirror->lock);
+    return rc == ZK_STATUS_OK ? 1 : -1;
+}
+
+int zk_mirror_exists(struct zk_mirror *mirror, const char *path)
+{
+    int exists;
+    pthread_mutex_lock(&mirror->lock);
+    exists = zk_tree_contains(&mirror->cache, path);
+    pthread_mutex_unlock(&mirror->lock);
+    return exists;
+}
+
+int zk_mirror_pending(struct zk_mirror *mirror)
+{
+    int count;
+    pthread_mutex_lock(&mirror->lock);
+    count = mirror->count;
+    pthread_mutex_unlock(&mirror->lock);
+    return count;
+}
+
+int zk_mirror_flush(struct zk_mirror *mirror)
+{
+    int failures = 0;
+
+    pthread_mutex_lock(&mirror->flush_lock);
+    for (;;) {
+        struct zk_op *ops;
+        int count, sent, retry = 0;
+
+        /* Take the queue, so that updates can be queued while this batch is out */
+        pthread_mutex_lock(&mirror->lock);
+        ops = mirror->pending;
+        count = mirror->count;
+        mirror->pending = NULL;
+        mirror->count = mirror->capacity = 0;
+        pthread_mutex_unlock(&mirror->lock);
+        if (count == 0) {
+            free(ops);
+            break;
+        }
+
+        sent = zk_mirror_send(mirror, ops, count, &failures, &retry);
+        if (sent < count) {
+            /* Put what is left back at the front of the queue: after the parents
+               of a create to retry (sent again now), or for the next flush after
+               a connection loss */
+            int rest = count - sent, rc;
+            pthread_mutex_lock(&mirror->lock);
+            rc = retry ? zk_mirror_requeue(mirror, ops + sent, rest) : zk_mirror_unshift(mirror, ops + sent, rest);
+            if (rc) {
+                mirror->stats.failed += rest;
+                failures += rest;
+            }
+            pthread_mutex_unlock(&mirror->lock);
+            free(ops);
+            if (!retry)
+                break;
+            continue;
+        }
+        free(ops);
+    }
+    pthread_mutex_unlock(&mirror->flush_lock);
+    return failures;
+}
+
+void zk_mirror_reset(struct zk_mirror *mirror)
+{
+    int i, kept = 0;
+
+    pthread_mutex_lock(&mirror->flush_lock);
+    pthread_mutex_lock(&mirror->lock);
+    zk_tree_clear(&mirror->cache);
+
+    /* Ephemeral creates died with the session. Persistent updates still have
+       to be made, so they stay queued (and their creates cached), in order */
+    for (i = 0; i < mirror->count; i++) {
+        struct zk_op *op = &mirror->pending[i];
+        if (op->type == ZK_OP_CREATE && (op->flags & ZK_FLAG_EPHEMERAL))
+            continue;
+        if (op->type == ZK_OP_CREATE)
+            zk_tree_add(&mirror->cache, op->path, 0);
+        if (kept != i)
+            mirror->pending[kept] = *op;
+        kept++;
+    }
+    mirror->count = kept;
+    pthread_mutex_unlock(&mirror->lock);
+    pthread_mutex_unlock(&mirror->flush_lock);
+}
+
+void zk_mirror_get_stats(struct zk_mirror *mirror, struct zk_mirror_stats *stats)
+{
+    pthread_mutex_lock(&mirror->lock);
+    *stats = mirror->stats;
+    pthread_mutex_unlock(&mirror->lock);
+}
+
+/*********************************************************************************/
+/*
+ * Paths and children
+ */
+
+int zk_path_join(char *buf, size_t size, int num, ...)
+{
+    va_list arguments;
+    size_t length = 0;
+    int x;
+
+    if (buf == NULL || size == 0)
+        return -1;
+    va_start(arguments, num);
+    for (x = 0; x < num; x++) {
+        const char *part = va_arg(arguments, const char *);
+        size_t part_length;
+        if (part == NULL)
+            continue;
+        part_length = strlen(part);
+        if (length + part_length >= size) {
+            va_end(arguments);
+            buf[0] = '\0';
+            return -1;
+        }
+        memcpy(buf + length, part, part_length);
+        length += part_length;
+    }
+    va_end(arguments);
+    buf[length] = '\0';
+    return (int) length;
+}
+
+static int zk_compare_children(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+void zk_children_sort(char **children, int count)
+{
+    if (count > 1)
+        qsort(children, count, sizeof(*children), zk_compare_children);
+}
+
+int zk_children_diff(char *const *a, int na, char *const *b, int nb, char **out)
+{
+    int i = 0, j = 0, count = 0;
+    while (i < na) {
+        int cmp = j < nb ? strcmp(a[i], b[j]) : -1;
+        if (cmp < 0)
+            out[count++] = a[i++];
+        else if (cmp > 0)
+            j++;
+        else {
+            i++;
+            j++;
+        }
+    }
+    return count;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,187 @@
+/*
+ * @file zk_mirror.h
+ * @brief Write-through cache and multi-op batching of the edge broker znode tree
+ * @author Sandeep D'souza
+ * 
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice, 
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _zk_mirror_h
+#define _zk_mirror_h
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+ * The broker mirrors its timelines, topics, publishers and subscribers into a
+ * znode tree. Rather than sending one request per znode, updates are queued on
+ * a zk_mirror and sent as multi-op transactions when the mirror is flushed. A
+ * local copy of the tree is kept up to date as updates are queued, so that
+ * znodes already known to exist cost no round trip at all. The cache only
+ * holds part of the real tree, so a delete is always sent.
+ *
+ * Nothing here depends on the ZooKeeper client: transactions go through a
+ * zk_backend, which zk_logic.c binds to zoo_multi() and zk_standin.c to an
+ * in-process tree for tests and benchmarks.
+ */
+
+/* Longest znode path and value handled by the mirror */
+#define ZK_PATH_MAX      512
+#define ZK_VALUE_MAX     128
+
+/* Operations coalesced into a single transaction, by default and at most */
+#define ZK_BATCH_DEFAULT 128
+#define ZK_BATCH_MAX     1024
+
+/* Outcome of an operation (backends map their return codes onto these) */
+enum zk_status {
+    ZK_STATUS_OK = 0,
+    ZK_STATUS_NONODE,       /* The znode, or the parent of a created znode, does not exist */
+    ZK_STATUS_EXISTS,       /* The znode already exists */
+    ZK_STATUS_NOTEMPTY,     /* The znode has children */
+    ZK_STATUS_RETRY,        /* Connection loss or timeout, nothing was applied */
+    ZK_STATUS_ERROR         /* Any other failure */
+};
+
+/* Flags of a created znode */
+#define ZK_FLAG_EPHEMERAL 1
+
+enum zk_op_type {
+    ZK_OP_CREATE,
+    ZK_OP_DELETE
+};
+
+/* A queued znode update */
+struct zk_op {
+    enum zk_op_type type;
+    int flags;                      /* Creation flags */
+    int length;                     /* Length of the value */
+    int attempts;                   /* Times the update was sent */
+    char path[ZK_PATH_MAX];
+    char value[ZK_VALUE_MAX];
+};
+
+/*
+ * Applies count operations as one atomic transaction. Returns ZK_STATUS_OK,
+ * or the status of the first failing operation with its index in *failed
+ * (-1 if the backend cannot tell) and nothing applied.
+ */
+struct zk_backend {
+    int (*multi)(void *ctx, const struct zk_op *ops, int count, int *failed);
+    void *ctx;
+};
+
+/* Called once per operation with its final status when the mirror is flushed */
+typedef void (*zk_done_t)(void *arg, const struct zk_op *op, int status);
+
+/*
+ * Hash set of znode paths with the number of children of each. A strict tree
+ * behaves like ZooKeeper (parents must exist, only leaves can be removed); the
+ * mirror's cache is relaxed, as it only ever sees part of the real tree.
+ */
+struct zk_tree_node;
+struct zk_tree {
+    struct zk_tree_node **buckets;
+    size_t mask;
+    size_t count;
+};
+
+int zk_tree_init(struct zk_tree *tree);
+void zk_tree_destroy(struct zk_tree *tree);
+void zk_tree_clear(struct zk_tree *tree);
+int zk_tree_contains(const struct zk_tree *tree, const char *path);
+int zk_tree_children(const struct zk_tree *tree, const char *path);
+int zk_tree_add(struct zk_tree *tree, const char *path, int strict);
+int zk_tree_remove(struct zk_tree *tree, const char *path, int strict);
+
+/* Counters of a mirror */
+struct zk_mirror_stats {
+    unsigned long long queued;          /* Updates queued */
+    unsigned long long cached;          /* Updates answered by the cache */
+    unsigned long long transactions;    /* Transactions sent */
+    unsigned long long retries;         /* Flushes cut short by connection loss */
+    unsigned long long failed;          /* Updates that failed for good */
+};
+
+struct zk_mirror {
+    struct zk_backend backend;
+    struct zk_tree cache;               /* Znodes known to exist */
+    struct zk_op *pending;              /* Queued updates, in order */
+    int count;
+    int capacity;
+    int batch;
+    zk_done_t done;
+    void *done_arg;
+    struct zk_mirror_stats stats;
+    pthread_mutex_t lock;               /* Guards the cache, queue and counters */
+    pthread_mutex_t flush_lock;         /* Keeps transactions in the order they were queued */
+};
+
+/* Bind a mirror to a backend, sending at most batch updates per transaction (0 for the default) */
+int zk_mirror_init(struct zk_mirror *mirror, const struct zk_backend *backend, int batch);
+void zk_mirror_destroy(struct zk_mirror *mirror);
+
+/* Install the per-operation completion (called outside the queue lock, while flushing) */
+void zk_mirror_set_done(struct zk_mirror *mirror, zk_done_t done, void *arg);
+
+/* Queue an update. Returns 1 if queued, 0 if the cache shows it is already in place, -1 on bad arguments.
+   A delete is queued even if the znode is not in the cache */
+int zk_mirror_create(struct zk_mirror *mirror, const char *path, const char *value, int length, int flags);
+int zk_mirror_delete(struct zk_mirror *mirror, const char *path);
+
+/* Whether a znode is in the cache */
+int zk_mirror_exists(struct zk_mirror *mirror, const char *path);
+
+/* Number of queued updates */
+int zk_mirror_pending(struct zk_mirror *mirror);
+
+/* Send the queued updates. Returns the number that failed for good, updates cut
+   short by connection loss stay queued for the next flush */
+int zk_mirror_flush(struct zk_mirror *mirror);
+
+/* Drop the cache and the queued ephemeral creates (the session, and with it ephemeral
+   znodes, is gone). Queued persistent creates and all queued deletes are kept */
+void zk_mirror_reset(struct zk_mirror *mirror);
+
+void zk_mirror_get_stats(struct zk_mirror *mirror, struct zk_mirror_stats *stats);
+
+/* Join num strings into a znode path in buf. Returns its length, or -1 (and an empty
+   path) if it does not fit */
+int zk_path_join(char *buf, size_t size, int num, ...);
+
+/* Sort a list of child names, so that it can be diffed */
+void zk_children_sort(char **children, int count);
+
+/* Collect into out the entries of the sorted list a that are not in the sorted list b.
+   Returns the number collected, out must have room for na entries */
+int zk_children_diff(char *const *a, int na, char *const *b, int nb, char **out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
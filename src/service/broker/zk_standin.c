@@ -0,0 +1,165 @@
+/*
+ * @file zk_standin.c
+ * @brief In-process ZooKeeper stand-in for the edge broker mirror
+ * @author Sandeep D'souza
+ * 
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice, 
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "zk_standin.h"
+
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Apply one operation to the tree */
+static int zk_standin_apply(struct zk_standin *zk, const struct zk_op *op)
+{
+    if (op->type == ZK_OP_CREATE)
+        return zk_tree_add(&zk->tree, op->path, 1);
+    return zk_tree_remove(&zk->tree, op->path, 1);
+}
+
+/* Roll back an applied operation */
+static void zk_standin_undo(struct zk_standin *zk, const struct zk_op *op)
+{
+    if (op->type == ZK_OP_CREATE)
+        zk_tree_remove(&zk->tree, op->path, 0);
+    else
+        zk_tree_add(&zk->tree, op->path, 0);
+}
+
+static int zk_standin_multi(void *ctx, const struct zk_op *ops, int count, int *failed)
+{
+    struct zk_standin *zk = (struct zk_standin *) ctx;
+    int i, status = ZK_STATUS_OK;
+
+    if (zk->delay_us > 0)
+        usleep(zk->delay_us);
+
+    pthread_mutex_lock(&zk->lock);
+    zk->transactions++;
+    if (zk->fail != ZK_STATUS_OK) {
+        *failed = -1;
+        status = zk->fail;
+        pthread_mutex_unlock(&zk->lock);
+        return status;
+    }
+    for (i = 0; i < count; i++) {
+        status = zk_standin_apply(zk, &ops[i]);
+        if (status != ZK_STATUS_OK)
+            break;
+    }
+    if (status != ZK_STATUS_OK) {
+        /* All or nothing */
+        *failed = i;
+        while (i-- > 0)
+            zk_standin_undo(zk, &ops[i]);
+    } else {
+        zk->operations += count;
+    }
+    pthread_mutex_unlock(&zk->lock);
+    return status;
+}
+
+int zk_standin_init(struct zk_standin *zk, unsigned int delay_us)
+{
+    if (zk_tree_init(&zk->tree))
+        return -1;
+    pthread_mutex_init(&zk->lock, NULL);
+    zk->delay_us = delay_us;
+    zk->transactions = 0;
+    zk->operations = 0;
+    zk->fail = ZK_STATUS_OK;
+    return 0;
+}
+
+void zk_standin_destroy(struct zk_standin *zk)
+{
+    zk_tree_destroy(&zk->tree);
+    pthread_mutex_destroy(&zk->lock);
+}
+
+void zk_standin_backend(struct zk_standin *zk, struct zk_backend *backend)
+{
+    backend->multi = zk_standin_multi;
+    backend->ctx = zk;
+}
+
+int zk_standin_create(struct zk_standin *zk, const char *path)
+{
+    int status;
+    pthread_mutex_lock(&zk->lock);
+    status = zk_tree_add(&zk->tree, path, 1);
+    pthread_mutex_unlock(&zk->lock);
+    return status;
+}
+
+int zk_standin_delete(struct zk_standin *zk, const char *path)
+{
+    int status;
+    pthread_mutex_lock(&zk->lock);
+    status = zk_tree_remove(&zk->tree, path, 1);
+    pthread_mutex_unlock(&zk->lock);
+    return status;
+}
+
+int zk_standin_exists(struct zk_standin *zk, const char *path)
+{
+    int exists;
+    pthread_mutex_lock(&zk->lock);
+    exists = zk_tree_contains(&zk->tree, path);
+    pthread_mutex_unlock(&zk->lock);
+    return exists;
+}
+
+int zk_standin_children(struct zk_standin *zk, const char *path)
+{
+    int children;
+    pthread_mutex_lock(&zk->lock);
+    children = zk_tree_children(&zk->tree, path);
+    pthread_mutex_unlock(&zk->lock);
+    return children;
+}
+
+size_t zk_standin_size(struct zk_standin *zk)
+{
+    size_t size;
+    pthread_mutex_lock(&zk->lock);
+    size = zk->tree.count;
+    pthread_mutex_unlock(&zk->lock);
+    return size;
+}
+
+void zk_standin_fail(struct zk_standin *zk, int status)
+{
+    pthread_mutex_lock(&zk->lock);
+    zk->fail = status;
+    pthread_mutex_unlock(&zk->lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,79 @@
+/*
+ * @file zk_standin.h
+ * @brief In-process ZooKeeper stand-in for the edge broker mirror
+ * @author Sandeep D'souza
+ * 
+ * Copyright (c) Carnegie Mellon University, 2018. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice, 
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. 
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, 
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE 
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF 
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _zk_standin_h
+#define _zk_standin_h
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "zk_mirror.h"
+
+/*
+ * An in-process replacement for a ZooKeeper ensemble, behind the same backend
+ * as the real client. Transactions are atomic and checked like ZooKeeper checks
+ * them (parents must exist, only leaves can be deleted). There are no sessions,
+ * so ephemeral znodes live as long as the stand-in. An optional delay stands in
+ * for the round trip to the ensemble.
+ */
+struct zk_standin {
+    struct zk_tree tree;
+    pthread_mutex_t lock;
+    unsigned int delay_us;              /* Simulated round trip of a transaction */
+    unsigned long long transactions;    /* Transactions received */
+    unsigned long long operations;      /* Operations applied */
+    int fail;                           /* Status returned by every transaction, when set */
+};
+
+int zk_standin_init(struct zk_standin *zk, unsigned int delay_us);
+void zk_standin_destroy(struct zk_standin *zk);
+
+/* Backend that sends a mirror's transactions to the stand-in */
+void zk_standin_backend(struct zk_standin *zk, struct zk_backend *backend);
+
+/* Apply a single operation directly, as another client would */
+int zk_standin_create(struct zk_standin *zk, const char *path);
+int zk_standin_delete(struct zk_standin *zk, const char *path);
+
+int zk_standin_exists(struct zk_standin *zk, const char *path);
+
+/* Number of children of a znode, -1 if it does not exist */
+int zk_standin_children(struct zk_standin *zk, const char *path);
+
+/* Number of znodes */
+size_t zk_standin_size(struct zk_standin *zk);
+
+/* Fail every following transaction with the given status (ZK_STATUS_OK to stop) */
+void zk_standin_fail(struct zk_standin *zk, int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -89,9 +89,12 @@ bool SyncUncertainty::CalculateBounds(int64_t offset, double drift, int timeline
 	std::cout << "Right Predictor = " << right_predictor
 	          << " Right Margin = " << right_margin << "\n";
 
-	// Poulate the bounds
-	bounds.u_drift = (s64)ceil(right_predictor*1000000000LL); // Upper bound (Right Predictor) function for drift
-	bounds.l_drift = (s64)ceil(left_predictor*1000000000LL);  // Lower bound (Left Predictor) function for drift
+	// Poulate the bounds -> the predictors grow with (t-t0)^(3/2), which the kernel
+	// now evaluates directly, so no linear drift term has to be pushed
+	bounds.u_drift = 0;                                       // Upper bound (linear) function for drift
+	bounds.l_drift = 0;                                       // Lower bound (linear) function for drift
+	bounds.u_pow   = (s64)ceil(right_predictor*1000000000LL); // Upper bound (Right Predictor) coefficient of (t-t0)^(3/2)
+	bounds.l_pow   = (s64)floor(left_predictor*1000000000LL); // Lower bound (Left Predictor) coefficient of (t-t0)^(3/2)
 	bounds.u_nsec  = (s64)ceil(right_margin);                 // Upper bound (Right Margin) function for offset
 	bounds.l_nsec  = (s64)ceil(left_margin);                  // Lower bound (Left Margin) function for offset
 
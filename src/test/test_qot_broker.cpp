@@ -0,0 +1,237 @@
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "../service/broker/zk_mirror.h"
+#include "../service/broker/zk_standin.h"
+
+// Final statuses reported by the mirror
+static std::vector<std::pair<std::string, int> > settled;
+
+static void on_done(void *arg, const struct zk_op *op, int status)
+{
+    (void) arg;
+    settled.push_back(std::make_pair(std::string(op->path), status));
+}
+
+// A mirror bound to a stand-in
+struct Fixture {
+    struct zk_standin zk;
+    struct zk_mirror mirror;
+    Fixture(int batch, unsigned int delay_us = 0) {
+        struct zk_backend backend;
+        zk_standin_init(&zk, delay_us);
+        zk_standin_backend(&zk, &backend);
+        zk_mirror_init(&mirror, &backend, batch);
+        zk_mirror_set_done(&mirror, on_done, NULL);
+        settled.clear();
+    }
+    ~Fixture() {
+        zk_mirror_destroy(&mirror);
+        zk_standin_destroy(&zk);
+    }
+    void topic(const std::string &timeline, const std::string &name) {
+        std::string path = "/timelines/" + timeline + "/" + name;
+        zk_mirror_create(&mirror, ("/timelines/" + timeline).c_str(), NULL, 0, 0);
+        zk_mirror_create(&mirror, path.c_str(), NULL, 0, 0);
+        zk_mirror_create(&mirror, (path + "/publishers").c_str(), NULL, 0, 0);
+        zk_mirror_create(&mirror, (path + "/subscribers").c_str(), NULL, 0, 0);
+    }
+};
+
+TEST(QoTBroker, TreeLikeZooKeeper) {
+    struct zk_tree tree;
+    ASSERT_EQ(zk_tree_init(&tree), 0);
+
+    // Parents first, only leaves are removed
+    EXPECT_EQ(zk_tree_add(&tree, "/a/b", 1), ZK_STATUS_NONODE);
+    EXPECT_EQ(zk_tree_add(&tree, "/a", 1), ZK_STATUS_OK);
+    EXPECT_EQ(zk_tree_add(&tree, "/a", 1), ZK_STATUS_EXISTS);
+    EXPECT_EQ(zk_tree_add(&tree, "/a/b", 1), ZK_STATUS_OK);
+    EXPECT_EQ(zk_tree_children(&tree, "/a"), 1);
+    EXPECT_EQ(zk_tree_remove(&tree, "/a", 1), ZK_STATUS_NOTEMPTY);
+    EXPECT_EQ(zk_tree_remove(&tree, "/a/b", 1), ZK_STATUS_OK);
+    EXPECT_EQ(zk_tree_remove(&tree, "/a/b", 1), ZK_STATUS_NONODE);
+    EXPECT_EQ(zk_tree_children(&tree, "/a"), 0);
+    EXPECT_EQ(zk_tree_add(&tree, "relative", 0), ZK_STATUS_ERROR);
+    EXPECT_EQ(zk_tree_add(&tree, "/trailing/", 0), ZK_STATUS_ERROR);
+
+    // Growing keeps every path reachable
+    for (int i = 0; i < 5000; i++)
+        ASSERT_EQ(zk_tree_add(&tree, ("/a/" + std::to_string(i)).c_str(), 1), ZK_STATUS_OK);
+    EXPECT_EQ(tree.count, 5001u);
+    EXPECT_EQ(zk_tree_children(&tree, "/a"), 5000);
+    for (int i = 0; i < 5000; i += 7)
+        EXPECT_TRUE(zk_tree_contains(&tree, ("/a/" + std::to_string(i)).c_str()));
+    EXPECT_FALSE(zk_tree_contains(&tree, "/a/5000"));
+    zk_tree_destroy(&tree);
+}
+
+TEST(QoTBroker, PathsAndChildren) {
+    char path[16];
+    EXPECT_EQ(zk_path_join(path, sizeof(path), 4, "/timelines/", "t", "/", "x"), 14);
+    EXPECT_STREQ(path, "/timelines/t/x");
+    EXPECT_EQ(zk_path_join(path, sizeof(path), 3, "/timelines/", NULL, "t"), 12);
+    EXPECT_EQ(zk_path_join(path, sizeof(path), 2, "/timelines/", "topic"), -1);
+    EXPECT_STREQ(path, "");
+
+    // Differences of sorted child lists, both ways
+    std::vector<std::string> now = { "d", "b", "a" }, before = { "c", "a" };
+    std::vector<char *> a, b, out(3);
+    for (auto &s : now) a.push_back(&s[0]);
+    for (auto &s : before) b.push_back(&s[0]);
+    zk_children_sort(a.data(), a.size());
+    zk_children_sort(b.data(), b.size());
+    ASSERT_EQ(zk_children_diff(a.data(), a.size(), b.data(), b.size(), out.data()), 2);
+    EXPECT_STREQ(out[0], "b");
+    EXPECT_STREQ(out[1], "d");
+    ASSERT_EQ(zk_children_diff(b.data(), b.size(), a.data(), a.size(), out.data()), 1);
+    EXPECT_STREQ(out[0], "c");
+}
+
+TEST(QoTBroker, BatchedAndCached) {
+    Fixture f(16);
+    zk_mirror_create(&f.mirror, "/timelines", NULL, 0, 0);
+    for (int i = 0; i < 10; i++)
+        f.topic("tl", "gl_" + std::to_string(i));
+
+    // The timeline is queued once, everything else waits for the flush
+    EXPECT_EQ(zk_mirror_pending(&f.mirror), 32);
+    EXPECT_EQ(zk_standin_size(&f.zk), 0u);
+    EXPECT_EQ(zk_mirror_flush(&f.mirror), 0);
+    EXPECT_EQ(f.zk.transactions, 2u);
+    EXPECT_EQ(zk_standin_size(&f.zk), 32u);
+    EXPECT_EQ(zk_standin_children(&f.zk, "/timelines/tl"), 10);
+    EXPECT_EQ(settled.size(), 32u);
+
+    // What the cache shows in place costs nothing
+    f.topic("tl", "gl_3");
+    EXPECT_EQ(zk_mirror_pending(&f.mirror), 0);
+    EXPECT_EQ(zk_mirror_create(&f.mirror, "/timelines/tl/gl_3/publishers/7", "lan", 4, ZK_FLAG_EPHEMERAL), 1);
+
+    // A topic goes in one transaction with its endpoints
+    EXPECT_EQ(zk_mirror_delete(&f.mirror, "/timelines/tl/gl_3/publishers/7"), 1);
+    EXPECT_EQ(zk_mirror_delete(&f.mirror, "/timelines/tl/gl_3/publishers"), 1);
+    EXPECT_EQ(zk_mirror_delete(&f.mirror, "/timelines/tl/gl_3/subscribers"), 1);
+    EXPECT_EQ(zk_mirror_delete(&f.mirror, "/timelines/tl/gl_3"), 1);
+    EXPECT_EQ(zk_mirror_flush(&f.mirror), 0);
+    EXPECT_EQ(f.zk.transactions, 3u);
+    EXPECT_FALSE(zk_standin_exists(&f.zk, "/timelines/tl/gl_3"));
+    EXPECT_FALSE(zk_mirror_exists(&f.mirror, "/timelines/tl/gl_3"));
+
+    struct zk_mirror_stats stats;
+    zk_mirror_get_stats(&f.mirror, &stats);
+    EXPECT_EQ(stats.queued, 37u);
+    EXPECT_EQ(stats.cached, 13u);
+    EXPECT_EQ(stats.failed, 0u);
+
+    // The cache only holds part of the tree, so a delete it does not know is still sent
+    zk_standin_create(&f.zk, "/timelines/other");
+    EXPECT_EQ(zk_mirror_delete(&f.mirror, "/timelines/other"), 1);
+    EXPECT_EQ(zk_mirror_delete(&f.mirror, "/timelines/gone"), 1);
+    EXPECT_EQ(zk_mirror_flush(&f.mirror), 0);
+    EXPECT_FALSE(zk_standin_exists(&f.zk, "/timelines/other"));
+    EXPECT_EQ(settled.back().first, "/timelines/gone");
+    EXPECT_EQ(settled.back().second, ZK_STATUS_NONODE);
+}
+
+TEST(QoTBroker, FailuresAreIsolated) {
+    Fixture f(64);
+    zk_standin_create(&f.zk, "/timelines");
+    zk_standin_create(&f.zk, "/timelines/shared");
+    zk_standin_create(&f.zk, "/timelines/busy");
+    zk_standin_create(&f.zk, "/timelines/busy/other");
+
+    // Another broker made the timeline, and a topic of someone else keeps one busy
+    zk_mirror_create(&f.mirror, "/timelines/a", NULL, 0, 0);
+    zk_mirror_create(&f.mirror, "/timelines/shared", NULL, 0, 0);
+    zk_mirror_create(&f.mirror, "/timelines/shared/t", NULL, 0, 0);
+    zk_mirror_create(&f.mirror, "/timelines/busy", NULL, 0, 0);
+    zk_mirror_create(&f.mirror, "/timelines/busy/t", NULL, 0, 0);
+    zk_mirror_delete(&f.mirror, "/timelines/busy/t");
+    zk_mirror_delete(&f.mirror, "/timelines/busy");
+    zk_mirror_create(&f.mirror, "/timelines/b", NULL, 0, 0);
+    EXPECT_EQ(zk_mirror_flush(&f.mirror), 1);
+
+    // Everything but the failed delete went through, and the cache tells the truth
+    EXPECT_TRUE(zk_standin_exists(&f.zk, "/timelines/a"));
+    EXPECT_TRUE(zk_standin_exists(&f.zk, "/timelines/shared/t"));
+    EXPECT_TRUE(zk_standin_exists(&f.zk, "/timelines/b"));
+    EXPECT_TRUE(zk_standin_exists(&f.zk, "/timelines/busy"));
+    EXPECT_TRUE(zk_mirror_exists(&f.mirror, "/timelines/busy"));
+    EXPECT_TRUE(zk_mirror_exists(&f.mirror, "/timelines/shared"));
+    ASSERT_EQ(settled.size(), 8u);
+    EXPECT_EQ(settled[1].second, ZK_STATUS_EXISTS);
+    EXPECT_EQ(settled[3].second, ZK_STATUS_EXISTS);
+    EXPECT_EQ(settled[6].first, "/timelines/busy");
+    EXPECT_EQ(settled[6].second, ZK_STATUS_NOTEMPTY);
+    for (size_t i = 0; i < settled.size(); i++) {
+        if (i != 1 && i != 3 && i != 6) {
+            EXPECT_EQ(settled[i].second, ZK_STATUS_OK);
+        }
+    }
+}
+
+TEST(QoTBroker, StaleParentsAndConnectionLoss) {
+    Fixture f(8);
+    f.topic("tl", "gl_x");
+    zk_mirror_create(&f.mirror, "/timelines", NULL, 0, 0);
+    zk_standin_create(&f.zk, "/timelines");
+    zk_mirror_flush(&f.mirror);
+
+    // Another broker removed the topic behind the cache's back: it is recreated for the publisher
+    zk_standin_delete(&f.zk, "/timelines/tl/gl_x/publishers");
+    zk_standin_delete(&f.zk, "/timelines/tl/gl_x/subscribers");
+    zk_standin_delete(&f.zk, "/timelines/tl/gl_x");
+    settled.clear();
+    zk_mirror_create(&f.mirror, "/timelines/tl/gl_x/publishers/1", "lan", 4, ZK_FLAG_EPHEMERAL);
+    EXPECT_EQ(zk_mirror_flush(&f.mirror), 0);
+    EXPECT_TRUE(zk_standin_exists(&f.zk, "/timelines/tl/gl_x/publishers/1"));
+    ASSERT_FALSE(settled.empty());
+    EXPECT_EQ(settled.back().first, "/timelines/tl/gl_x/publishers/1");
+    EXPECT_EQ(settled.back().second, ZK_STATUS_OK);
+
+    // A delete queued after a create that has to wait for its parents does not overtake it
+    zk_standin_delete(&f.zk, "/timelines/tl/gl_x/publishers/1");
+    zk_standin_delete(&f.zk, "/timelines/tl/gl_x/publishers");
+    zk_mirror_create(&f.mirror, "/timelines/tl/gl_x/publishers/4", "lan", 4, ZK_FLAG_EPHEMERAL);
+    zk_mirror_delete(&f.mirror, "/timelines/tl/gl_x/publishers/4");
+    EXPECT_EQ(zk_mirror_flush(&f.mirror), 0);
+    EXPECT_TRUE(zk_standin_exists(&f.zk, "/timelines/tl/gl_x/publishers"));
+    EXPECT_FALSE(zk_standin_exists(&f.zk, "/timelines/tl/gl_x/publishers/4"));
+    EXPECT_FALSE(zk_mirror_exists(&f.mirror, "/timelines/tl/gl_x/publishers/4"));
+
+    // Updates cut short by a lost connection wait for the next flush, ahead of newer ones
+    zk_standin_fail(&f.zk, ZK_STATUS_RETRY);
+    zk_mirror_create(&f.mirror, "/timelines/tl/gl_x/publishers/2", "lan", 4, ZK_FLAG_EPHEMERAL);
+    EXPECT_EQ(zk_mirror_flush(&f.mirror), 0);
+    EXPECT_EQ(zk_mirror_pending(&f.mirror), 1);
+    zk_standin_fail(&f.zk, ZK_STATUS_OK);
+    zk_mirror_delete(&f.mirror, "/timelines/tl/gl_x/publishers/2");
+    EXPECT_EQ(zk_mirror_flush(&f.mirror), 0);
+    EXPECT_EQ(zk_mirror_pending(&f.mirror), 0);
+    EXPECT_FALSE(zk_standin_exists(&f.zk, "/timelines/tl/gl_x/publishers/2"));
+
+    struct zk_mirror_stats stats;
+    zk_mirror_get_stats(&f.mirror, &stats);
+    EXPECT_EQ(stats.retries, 1u);
+
+    // A lost session takes the cache and the ephemeral creates with it, persistent updates stay
+    zk_mirror_create(&f.mirror, "/timelines/tl/gl_x/publishers/3", "lan", 4, ZK_FLAG_EPHEMERAL);
+    zk_mirror_create(&f.mirror, "/timelines/tl/gl_y", NULL, 0, 0);
+    zk_mirror_delete(&f.mirror, "/timelines/tl/gl_x/subscribers");
+    zk_mirror_reset(&f.mirror);
+    EXPECT_FALSE(zk_mirror_exists(&f.mirror, "/timelines/tl"));
+    EXPECT_FALSE(zk_mirror_exists(&f.mirror, "/timelines/tl/gl_x/publishers/3"));
+    EXPECT_TRUE(zk_mirror_exists(&f.mirror, "/timelines/tl/gl_y"));
+    EXPECT_EQ(zk_mirror_pending(&f.mirror), 2);
+
+    // Including deletes of znodes the new cache no longer knows about
+    zk_standin_create(&f.zk, "/timelines/tl/gl_x/subscribers");
+    EXPECT_EQ(zk_mirror_delete(&f.mirror, "/timelines/tl/gl_x/publishers/1"), 1);
+    EXPECT_EQ(zk_mirror_delete(&f.mirror, "/timelines/tl/gl_x/publishers"), 1);
+    EXPECT_EQ(zk_mirror_flush(&f.mirror), 0);
+    EXPECT_TRUE(zk_standin_exists(&f.zk, "/timelines/tl/gl_y"));
+    EXPECT_FALSE(zk_standin_exists(&f.zk, "/timelines/tl/gl_x/subscribers"));
+    EXPECT_FALSE(zk_standin_exists(&f.zk, "/timelines/tl/gl_x/publishers"));
+}
@@ -0,0 +1,106 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "../api/cpp/transport/ClusterMembership.hpp"
+
+using namespace qot;
+
+// Node changes handed to the application
+static std::vector<std::pair<std::string, qot_node_status_t> > changes;
+
+static void on_node(qot_node_t *node)
+{
+    changes.push_back(std::make_pair(std::string(node->name), node->status));
+}
+
+TEST(QoTCluster, JoinLeaveAndReady) {
+    ClusterMembership membership;
+    std::vector<std::string> cluster = { "a", "b", "c" };
+
+    // Nodes which joined before the cluster was defined count towards it
+    EXPECT_TRUE(membership.Join("a", 1));
+    EXPECT_FALSE(membership.Join("a", 1));
+    EXPECT_TRUE(membership.Join("outsider", 9));
+    membership.Define(cluster);
+    EXPECT_EQ(membership.Members(), 3u);
+    EXPECT_EQ(membership.AliveMembers(), 1u);
+    EXPECT_TRUE(membership.IsMember("c"));
+    EXPECT_FALSE(membership.IsMember("outsider"));
+    EXPECT_EQ(membership.Intern("b"), membership.Intern("b"));
+
+    EXPECT_TRUE(membership.Join("b", 2));
+    EXPECT_FALSE(membership.Ready());
+    EXPECT_FALSE(membership.WaitForReady(10));
+
+    // The last node to join wakes the waiter
+    std::atomic<bool> ready(false);
+    std::thread waiter([&]{ ready = membership.WaitForReady(-1); });
+    EXPECT_TRUE(membership.Join("c", 3));
+    waiter.join();
+    EXPECT_TRUE(ready);
+
+    // Leaving drops the count, leaving twice or unknown nodes change nothing
+    EXPECT_TRUE(membership.Leave("b"));
+    EXPECT_FALSE(membership.Leave("b"));
+    EXPECT_FALSE(membership.Leave("nobody"));
+    EXPECT_TRUE(membership.Leave("outsider"));
+    EXPECT_EQ(membership.AliveMembers(), 2u);
+    EXPECT_FALSE(membership.Ready());
+
+    // Stopping releases the waiters
+    std::thread stopped([&]{ ready = membership.WaitForReady(-1); });
+    membership.Stop();
+    stopped.join();
+    EXPECT_FALSE(ready);
+}
+
+TEST(QoTCluster, BatchedNotifications) {
+    ClusterMembership membership;
+    changes.clear();
+    membership.SetCallback(on_node);
+
+    // Changes wait for the dispatch
+    membership.Join("a", 1);
+    membership.Join("b", 2);
+    EXPECT_TRUE(changes.empty());
+    EXPECT_EQ(membership.Dispatch(), 2u);
+    ASSERT_EQ(changes.size(), 2u);
+    EXPECT_EQ(changes[0].first, "a");
+    EXPECT_EQ(changes[0].second, QOT_NODE_JOINED);
+
+    // A node which left and came back within a batch is not reported
+    membership.Leave("a");
+    membership.Join("a", 1);
+    membership.Leave("b");
+    EXPECT_EQ(membership.Dispatch(), 1u);
+    ASSERT_EQ(changes.size(), 3u);
+    EXPECT_EQ(changes[2].first, "b");
+    EXPECT_EQ(changes[2].second, QOT_NODE_LEFT);
+    EXPECT_EQ(membership.Dispatch(), 0u);
+}
+
+TEST(QoTCluster, JoinAndLeaveStorm) {
+    ClusterMembership membership;
+    std::vector<std::string> cluster;
+    for (int i = 0; i < 500; i++)
+        cluster.push_back("node" + std::to_string(i));
+    membership.Define(cluster);
+
+    // Every node flaps a few times, the last half in reverse order
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 500; i++)
+            membership.Join(cluster[round % 2 ? 499 - i : i], i);
+        EXPECT_TRUE(membership.Ready());
+        for (int i = 0; i < 500; i += 2)
+            membership.Leave(cluster[i]);
+        EXPECT_EQ(membership.AliveMembers(), 250u);
+    }
+    for (int i = 0; i < 500; i++)
+        membership.Join(cluster[i], i);
+    EXPECT_TRUE(membership.WaitForReady(0));
+    EXPECT_EQ(membership.Dispatch(), 500u);
+}
@@ -0,0 +1,291 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+
+extern "C" {
+    #include <fcntl.h>
+    #include <string.h>
+    #include <time.h>
+    #include <unistd.h>
+}
+
+#include "../api/cpp/qot.hpp"
+#include "../api/cpp/qot_async.hpp"
+
+using namespace qot;
+
+static s64 realtime_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (s64) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static qot_return_t bind(Timeline &timeline, const char *uuid)
+{
+    return timeline.Bind(uuid, "app", TimeLength::FromNsec(1),
+        TimeLength::FromUsec(1), TimeLength::FromUsec(1));
+}
+
+// Wait for the tasks of a test to finish
+static bool settle(std::atomic<int> &done, int count)
+{
+    for (int i = 0; i < 2000 && done < count; i++)
+        usleep(1000);
+    return done == count;
+}
+
+TEST(QoTCpp, TimelineBindAndMove) {
+    Timeline timeline;
+    EXPECT_FALSE(timeline.Bound());
+    ASSERT_EQ(bind(timeline, "cpp_handle"), QOT_RETURN_TYPE_OK);
+    EXPECT_TRUE(timeline);
+    EXPECT_NE(timeline.Get(), (timeline_t *) NULL);
+    EXPECT_NE(bind(timeline, "cpp_handle"), QOT_RETURN_TYPE_OK);
+
+    // The binding follows a move, the source is left unbound
+    Timeline moved(std::move(timeline));
+    EXPECT_FALSE(timeline.Bound());
+    EXPECT_TRUE(moved.Bound());
+    Timeline assigned;
+    assigned = std::move(moved);
+    EXPECT_FALSE(moved.Bound());
+    ASSERT_TRUE(assigned.Bound());
+
+    TimePoint now;
+    EXPECT_EQ(assigned.Now(now), QOT_RETURN_TYPE_OK);
+    EXPECT_NE(timeline.Unbind(), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(assigned.Unbind(), QOT_RETURN_TYPE_OK);
+    EXPECT_FALSE(assigned.Bound());
+}
+
+TEST(QoTCpp, TimelineReads) {
+    Timeline timeline;
+    UTimePoint unow, core, until;
+    TimePoint now;
+    ASSERT_EQ(bind(timeline, "cpp_reads"), QOT_RETURN_TYPE_OK);
+
+    // An undisciplined emulated timeline follows the core clock
+    ASSERT_EQ(timeline.Now(now), QOT_RETURN_TYPE_OK);
+    EXPECT_LT(llabs(now.ToNsec() - realtime_ns()), 10000000LL);
+    ASSERT_EQ(timeline.Now(unow), QOT_RETURN_TYPE_OK);
+    EXPECT_GE(unow.Estimate(), now);
+    ASSERT_EQ(timeline.CoreNow(core), QOT_RETURN_TYPE_OK);
+    EXPECT_LT(llabs(core.Estimate().ToNsec() - realtime_ns()), 10000000LL);
+
+    // Waits return at or after the requested timeline time
+    until = UTimePoint(unow.Estimate() + TimeLength::FromMsec(5));
+    ASSERT_EQ(timeline.WaitUntil(until), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline.Now(now), QOT_RETURN_TYPE_OK);
+    EXPECT_GE(now, unow.Estimate() + TimeLength::FromMsec(5));
+}
+
+TEST(QoTCpp, TimelineClock) {
+    Timeline timeline;
+    timeline_clock::uncertainty u;
+    ASSERT_EQ(bind(timeline, "cpp_clock"), QOT_RETURN_TYPE_OK);
+
+    // The epoch until a timeline is selected
+    EXPECT_EQ(timeline_clock::now(), timeline_clock::time_point());
+    timeline_clock::Use(timeline);
+    timeline_clock::time_point before = timeline_clock::now();
+    TimePoint now;
+    ASSERT_EQ(timeline.Now(now), QOT_RETURN_TYPE_OK);
+    EXPECT_LE(timeline_clock::ToTimePoint(before), now);
+    EXPECT_EQ(timeline_clock::ToTimePoint(timeline_clock::FromTimePoint(now)), now);
+
+    // Bounds of the binding show up around the estimate
+    timeline_clock::time_point estimate = timeline_clock::now(u);
+    EXPECT_GE(estimate, before);
+    EXPECT_GE(u.below.count(), 0);
+    EXPECT_GE(u.above.count(), 0);
+
+    // Standard waits and arithmetic run on timeline time
+    std::this_thread::sleep_until(before + std::chrono::milliseconds(5));
+    EXPECT_GE(timeline_clock::now() - before, std::chrono::milliseconds(5));
+
+    // Unbinding drops the selection rather than reading a closed descriptor
+    EXPECT_EQ(timeline.Unbind(), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(timeline_clock::now(), timeline_clock::time_point());
+    EXPECT_EQ(timeline_clock::now(u), timeline_clock::time_point());
+    EXPECT_EQ(u.below.count(), 0);
+}
+
+// Coroutines take their state as parameters, which live in the coroutine
+// frame (the captures of a temporary lambda would not outlive the call)
+static Task wait_until(AsyncTimeline &tl, TimePoint target, qot_return_t expect, int id,
+    std::mutex &lock, std::vector<int> &order, std::atomic<int> &done)
+{
+    auto [ret, wake] = co_await tl.until(target);
+    EXPECT_EQ(ret, expect);
+    if (ret == QOT_RETURN_TYPE_OK) {
+        EXPECT_GE(wake.Estimate(), target);
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        order.push_back(id);
+    }
+    done++;
+}
+
+static Task wait_periods(AsyncTimeline &tl, TimePoint start, TimeLength period, int count,
+    std::vector<s64> &slots, std::atomic<int> &done)
+{
+    for (int i = 0; i < count; i++) {
+        auto [ret, wake] = co_await tl.next_period();
+        EXPECT_EQ(ret, QOT_RETURN_TYPE_OK);
+        slots.push_back((s64) ((wake.Estimate() - start).ToNsec() / period.ToNsec()));
+    }
+    done++;
+}
+
+static Task wait_created(AsyncTimeline &tl, const char *name, std::atomic<int> &done)
+{
+    for (;;) {
+        auto [ret, event] = co_await tl.next_event();
+        EXPECT_EQ(ret, QOT_RETURN_TYPE_OK);
+        if (ret != QOT_RETURN_TYPE_OK)
+            break;
+        if (event.type == QOT_EVENT_TIMELINE_CREATE && !strcmp(event.data, name))
+            break;
+    }
+    done++;
+}
+
+// Counts its destruction, once whichever copy is left owns it
+struct FrameGuard {
+    std::atomic<int> *count;
+    explicit FrameGuard(std::atomic<int> &c) : count(&c) {}
+    FrameGuard(FrameGuard &&other) noexcept : count(std::exchange(other.count, nullptr)) {}
+    ~FrameGuard() { if (count) (*count)++; }
+};
+
+static Task block_worker(int us)
+{
+    usleep(us);
+    co_return;
+}
+
+static Task guarded(FrameGuard guard, std::atomic<int> &ran)
+{
+    (void) guard;
+    ran++;
+    co_return;
+}
+
+TEST(QoTCpp, ReactorWakeOrder) {
+    Timeline timeline;
+    TimePoint now;
+    std::mutex lock;
+    std::vector<int> order;
+    std::atomic<int> done(0);
+    ASSERT_EQ(bind(timeline, "cpp_reactor_order"), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline.Now(now), QOT_RETURN_TYPE_OK);
+    {
+        Reactor reactor(1);
+        AsyncTimeline tl(reactor, timeline);
+
+        // Later targets first, and two waits on the same target; one worker
+        // resumes them by timeline time, then by arrival
+        const int targets[] = { 40, 30, 20, 20, 10 };
+        for (int i = 0; i < 5; i++)
+            reactor.Spawn(wait_until(tl, now + TimeLength::FromMsec(targets[i]),
+                QOT_RETURN_TYPE_OK, i, lock, order, done));
+        EXPECT_TRUE(settle(done, 5));
+
+        // A time already passed resumes without waiting
+        reactor.Spawn(wait_until(tl, now, QOT_RETURN_TYPE_OK, 5, lock, order, done));
+        EXPECT_TRUE(settle(done, 6));
+    }
+    EXPECT_EQ(order, std::vector<int>({ 4, 2, 3, 1, 0, 5 }));
+}
+
+TEST(QoTCpp, ReactorPeriods) {
+    Timeline timeline;
+    TimePoint start;
+    TimeLength period = TimeLength::FromMsec(5);
+    std::vector<s64> slots;
+    std::atomic<int> done(0);
+    ASSERT_EQ(bind(timeline, "cpp_reactor_period"), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline.Now(start), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline.SetSchedParams(period, start), QOT_RETURN_TYPE_OK);
+    {
+        Reactor reactor(1);
+        AsyncTimeline tl(reactor, timeline);
+
+        // Each wake-up lands in a later period than the one before
+        reactor.Spawn(wait_periods(tl, start, period, 4, slots, done));
+        EXPECT_TRUE(settle(done, 1));
+    }
+    ASSERT_EQ(slots.size(), 4U);
+    for (size_t i = 1; i < slots.size(); i++)
+        EXPECT_GT(slots[i], slots[i - 1]);
+}
+
+TEST(QoTCpp, ReactorEvents) {
+    Timeline timeline;
+    qot_timeline_t info;
+    std::atomic<int> done(0);
+    ASSERT_EQ(bind(timeline, "cpp_reactor_events"), QOT_RETURN_TYPE_OK);
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    {
+        Reactor reactor(1);
+        AsyncTimeline tl(reactor, timeline);
+
+        // A notification reaches the task waiting for it
+        reactor.Spawn(wait_created(tl, "cpp_reactor_created", done));
+        usleep(10000);
+        memset(&info, 0, sizeof(info));
+        strcpy(info.name, "cpp_reactor_created");
+        ASSERT_EQ(ioctl(usr, QOTUSR_CREATE_TIMELINE, &info), 0);
+        EXPECT_TRUE(settle(done, 1));
+
+        // Events nobody waits for are kept until asked for
+        memset(&info, 0, sizeof(info));
+        strcpy(info.name, "cpp_reactor_queued");
+        ASSERT_EQ(ioctl(usr, QOTUSR_CREATE_TIMELINE, &info), 0);
+        usleep(10000);
+        reactor.Spawn(wait_created(tl, "cpp_reactor_queued", done));
+        EXPECT_TRUE(settle(done, 2));
+    }
+    strcpy(info.name, "cpp_reactor_created");
+    EXPECT_EQ(ioctl(usr, QOTUSR_DESTROY_TIMELINE, &info), 0);
+    strcpy(info.name, "cpp_reactor_queued");
+    EXPECT_EQ(ioctl(usr, QOTUSR_DESTROY_TIMELINE, &info), 0);
+    close(usr);
+}
+
+TEST(QoTCpp, ReactorDetachAndShutdown) {
+    Timeline timeline;
+    TimePoint now;
+    std::mutex lock;
+    std::vector<int> order;
+    std::atomic<int> done(0), destroyed(0), ran(0);
+    ASSERT_EQ(bind(timeline, "cpp_reactor_detach"), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline.Now(now), QOT_RETURN_TYPE_OK);
+    {
+        // Detaching the timeline fails the waits pending on it
+        Reactor reactor(1);
+        {
+            AsyncTimeline tl(reactor, timeline);
+            reactor.Spawn(wait_until(tl, now + TimeLength::FromSec(60),
+                QOT_RETURN_TYPE_ERR, 0, lock, order, done));
+            usleep(10000);
+            EXPECT_EQ(done, 0);
+        }
+        EXPECT_TRUE(settle(done, 1));
+    }
+    {
+        // Tasks not run when the reactor goes are destroyed, not resumed
+        Reactor reactor(1);
+        reactor.Spawn(block_worker(20000));
+        reactor.Spawn(guarded(FrameGuard(destroyed), ran));
+    }
+    EXPECT_EQ(ran, 0);
+    EXPECT_EQ(destroyed, 1);
+}
@@ -0,0 +1,1113 @@
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+extern "C" {
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <pthread.h>
+    #include <sched.h>
+    #include <signal.h>
+    #include <time.h>
+    #include <unistd.h>
+    #include <sys/timex.h>
+    #include "../api/c/qot.h"
+    #include "../api/c/qot_tdma.h"
+    #include "../api/c/qot_net.h"
+    #include "../api/c/qot_trace.h"
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include "../emu/qot_emu.h"
+}
+
+#define FD_TO_CLOCKID(fd) ((~(clockid_t) (fd) << 3) | 3)
+
+static int open_fds()
+{
+    DIR *dir = opendir("/proc/self/fd");
+    int count = 0;
+    if (!dir)
+        return -1;
+    while (struct dirent *entry = readdir(dir))
+        if (entry->d_name[0] != '.')
+            count++;
+    closedir(dir);
+    return count;
+}
+
+static s64 realtime_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (s64) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+TEST(QoTEmu, BindAndGetTime) {
+    timeline_t *timeline = timeline_t_create();
+    timelength_t res;
+    timeinterval_t acc;
+    utimepoint_t now;
+    s64 ns;
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    ASSERT_EQ(timeline_bind(timeline, "emu_bind", "app", res, acc), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_gettime(timeline, &now), QOT_RETURN_TYPE_OK);
+    ns = TP_TO_nSEC(now.estimate);
+    EXPECT_LT(llabs(ns - realtime_ns()), 10000000LL);
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
+
+TEST(QoTEmu, DisciplineAndUncertainty) {
+    qot_timeline_t info;
+    qot_bounds_t bounds;
+    utimepoint_t now;
+    struct timex tx;
+    struct timespec ts;
+    char path[32];
+    s64 ns;
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_discipline");
+    ASSERT_EQ(ioctl(usr, QOTUSR_CREATE_TIMELINE, &info), 0);
+    sprintf(path, "/dev/timeline%d", info.index);
+    int fd = open(path, O_RDWR);
+    ASSERT_GE(fd, 0);
+
+    // Step the timeline one second ahead of the core clock
+    memset(&tx, 0, sizeof(tx));
+    tx.modes = ADJ_SETOFFSET | ADJ_NANO;
+    tx.time.tv_sec = 1;
+    ASSERT_EQ(clock_adjtime(FD_TO_CLOCKID(fd), &tx), 0);
+    ASSERT_EQ(clock_gettime(FD_TO_CLOCKID(fd), &ts), 0);
+    ns = (s64) ts.tv_sec * 1000000000LL + ts.tv_nsec - realtime_ns();
+    EXPECT_LT(llabs(ns - 1000000000LL), 10000000LL);
+
+    // Static bounds show up in the uncertainty of the current time
+    memset(&bounds, 0, sizeof(bounds));
+    bounds.u_nsec = 5000;
+    bounds.l_nsec = -5000;
+    ASSERT_EQ(ioctl(fd, TIMELINE_SET_SYNC_UNCERTAINTY, &bounds), 0);
+    ASSERT_EQ(ioctl(fd, TIMELINE_GET_TIME_NOW, &now), 0);
+    u64 above = TL_TO_nSEC(now.interval.above);
+    u64 below = TL_TO_nSEC(now.interval.below);
+    EXPECT_EQ(above, 5000ULL);
+    EXPECT_EQ(below, 5000ULL);
+
+    close(fd);
+    EXPECT_EQ(ioctl(usr, QOTUSR_DESTROY_TIMELINE, &info), 0);
+    close(usr);
+}
+
+TEST(QoTEmu, TimelineCreateEvent) {
+    qot_timeline_t info;
+    qot_event_t event;
+    struct pollfd pfd;
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    // Drain notifications about timelines created by earlier tests
+    while (ioctl(usr, QOTUSR_GET_NEXT_EVENT, &event) == 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_event");
+    ASSERT_EQ(ioctl(usr, QOTUSR_CREATE_TIMELINE, &info), 0);
+    pfd.fd = usr;
+    pfd.events = POLLIN;
+    ASSERT_EQ(poll(&pfd, 1, 0), 1);
+    ASSERT_EQ(ioctl(usr, QOTUSR_GET_NEXT_EVENT, &event), 0);
+    EXPECT_EQ(event.type, QOT_EVENT_TIMELINE_CREATE);
+    EXPECT_STREQ(event.data, "emu_event");
+    EXPECT_EQ(poll(&pfd, 1, 0), 0);
+    EXPECT_EQ(ioctl(usr, QOTUSR_DESTROY_TIMELINE, &info), 0);
+    close(usr);
+}
+
+static void on_interrupt(int)
+{
+}
+
+TEST(QoTEmu, PinTimestampReadSkipsOtherEvents) {
+    timeline_t *timeline = timeline_t_create();
+    timelength_t res;
+    timeinterval_t acc;
+    qot_event_t event;
+    struct sigaction action, previous;
+    std::atomic<int> done(0);
+    qot_return_t retval = QOT_RETURN_TYPE_OK;
+    int hangup[2];
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    ASSERT_EQ(timeline_bind(timeline, "emu_pinread", "app", res, acc), QOT_RETURN_TYPE_OK);
+
+    // The notification for the timeline is consumed, the read keeps waiting for a capture
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_interrupt;
+    ASSERT_EQ(sigaction(SIGUSR1, &action, &previous), 0);
+    std::thread reader([&]() {
+        retval = timeline_read_pin_timestamps(timeline, &event);
+        done = 1;
+    });
+    struct pollfd fds = { timeline_get_event_fd(timeline), POLLIN, 0 };
+    for (int i = 0; i < 1000 && poll(&fds, 1, 0) > 0; i++)
+        usleep(1000);
+    EXPECT_EQ(poll(&fds, 1, 0), 0);
+    usleep(50000);
+    EXPECT_EQ(done, 0);
+
+    // Interrupting the wait fails the read
+    for (int i = 0; i < 1000 && !done; i++) {
+        pthread_kill(reader.native_handle(), SIGUSR1);
+        usleep(1000);
+    }
+    reader.join();
+    EXPECT_EQ(retval, QOT_RETURN_TYPE_ERR);
+    sigaction(SIGUSR1, &previous, NULL);
+
+    // A connection that hung up fails the read instead of polling it again
+    ASSERT_EQ(pipe(hangup), 0);
+    ASSERT_GE(dup2(hangup[0], timeline_get_event_fd(timeline)), 0);
+    close(hangup[0]);
+    close(hangup[1]);
+    EXPECT_EQ(timeline_read_pin_timestamps(timeline, &event), QOT_RETURN_TYPE_ERR);
+
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
+
+TEST(QoTEmu, DeadlineReservation) {
+    timeline_t *timeline = timeline_t_create();
+    timelength_t res, period, runtime, deadline;
+    timeinterval_t acc;
+    utimepoint_t now, wake;
+    timepoint_t start;
+    qot_timeline_t info;
+    qot_deadline_stats_t stats;
+    struct timex tx;
+    char path[32];
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    TL_FROM_mSEC(period, 10);
+    TL_FROM_mSEC(runtime, 1);
+    TL_FROM_mSEC(deadline, 5);
+
+    // Create the timeline first, to discipline its clock directly later on (the
+    // last binding to leave destroys it)
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_deadline");
+    ASSERT_EQ(ioctl(usr, QOTUSR_CREATE_TIMELINE, &info), 0);
+    sprintf(path, "/dev/timeline%d", info.index);
+    int fd = open(path, O_RDWR);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(timeline_bind(timeline, "emu_deadline", "app", res, acc), QOT_RETURN_TYPE_OK);
+
+    // A reservation needs a period, and must fit within it
+    EXPECT_NE(timeline_set_deadline_reservation(timeline, &runtime, &deadline, 1), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_gettime(timeline, &now), QOT_RETURN_TYPE_OK);
+    start = now.estimate;
+    ASSERT_EQ(timeline_set_schedparams(timeline, &period, &start), QOT_RETURN_TYPE_OK);
+    EXPECT_NE(timeline_set_deadline_reservation(timeline, &deadline, &runtime, 1), QOT_RETURN_TYPE_OK);
+    TL_FROM_mSEC(deadline, 20);
+    EXPECT_NE(timeline_set_deadline_reservation(timeline, &runtime, &deadline, 1), QOT_RETURN_TYPE_OK);
+    TL_FROM_mSEC(deadline, 5);
+    ASSERT_EQ(timeline_get_deadline_stats(timeline, &stats), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(stats.activations, 0ULL);
+
+    if (timeline_set_deadline_reservation(timeline, &runtime, &deadline, 1) != QOT_RETURN_TYPE_OK) {
+        EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+        timeline_t_destroy(timeline);
+        close(fd);
+        close(usr);
+        GTEST_SKIP() << "SCHED_DEADLINE is not available";
+    }
+    EXPECT_EQ(sched_getscheduler(0), SCHED_DEADLINE);
+
+    // Jobs which complete right after their release meet the deadline
+    ASSERT_EQ(timeline_waituntil_nextperiod(timeline, &wake), QOT_RETURN_TYPE_OK);
+    for (int i = 0; i < 4; i++)
+        ASSERT_EQ(timeline_waituntil_nextperiod(timeline, &wake), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_get_deadline_stats(timeline, &stats), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(stats.activations, 5ULL);
+    EXPECT_EQ(stats.misses, 0ULL);
+
+    // A job which runs past its deadline is counted with its lateness
+    usleep(7000);
+    ASSERT_EQ(timeline_waituntil_nextperiod(timeline, &wake), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_get_deadline_stats(timeline, &stats), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(stats.misses, 1ULL);
+    EXPECT_GE(stats.max_lateness_ns, 1000000LL);
+
+    // A discipline drift re-issues the reservation within the check interval
+    memset(&tx, 0, sizeof(tx));
+    tx.modes = ADJ_FREQUENCY;
+    tx.freq = 100 << 16;
+    ASSERT_EQ(clock_adjtime(FD_TO_CLOCKID(fd), &tx), 0);
+    for (int i = 0; i < 16; i++)
+        ASSERT_EQ(timeline_waituntil_nextperiod(timeline, &wake), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_get_deadline_stats(timeline, &stats), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(stats.realignments, 1ULL);
+
+    EXPECT_EQ(timeline_set_deadline_reservation(timeline, NULL, NULL, 0), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(sched_getscheduler(0), SCHED_OTHER);
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+    close(fd);
+    close(usr);
+}
+
+TEST(QoTEmu, WaitUntil) {
+    timeline_t *timeline = timeline_t_create();
+    timelength_t res, delay;
+    timeinterval_t acc;
+    utimepoint_t now, wake;
+    timepoint_t target;
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    TL_FROM_mSEC(delay, 5);
+    ASSERT_EQ(timeline_bind(timeline, "emu_wait", "app", res, acc), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_gettime(timeline, &now), QOT_RETURN_TYPE_OK);
+    wake = now;
+    timepoint_add(&wake.estimate, &delay);
+    target = wake.estimate;
+    ASSERT_EQ(timeline_waituntil(timeline, &wake), QOT_RETURN_TYPE_OK);
+    // The reported wakeup time is never before the requested one
+    EXPECT_LE(timepoint_cmp(&wake.estimate, &target), 0);
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
+
+TEST(QoTEmu, CommitWait) {
+    timeline_t *timeline = timeline_t_create();
+    timelength_t res, width;
+    timeinterval_t acc;
+    qot_timeline_t info;
+    qot_bounds_t bounds;
+    timewindow_t now, done;
+    timepoint_t tp;
+    char path[32];
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    ASSERT_EQ(timeline_bind(timeline, "emu_commit", "app", res, acc), QOT_RETURN_TYPE_OK);
+
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_commit");
+    ASSERT_EQ(ioctl(usr, QOTUSR_GET_TIMELINE_INFO, &info), 0);
+    sprintf(path, "/dev/timeline%d", info.index);
+    int fd = open(path, O_RDWR);
+    ASSERT_GE(fd, 0);
+    memset(&bounds, 0, sizeof(bounds));
+    bounds.u_nsec = 2000000;
+    bounds.l_nsec = -2000000;
+    ASSERT_EQ(ioctl(fd, TIMELINE_SET_SYNC_UNCERTAINTY, &bounds), 0);
+
+    // The window spans the live uncertainty around the estimate
+    ASSERT_EQ(timeline_now(timeline, &now), QOT_RETURN_TYPE_OK);
+    timepoint_diff(&width, &now.latest, &now.earliest);
+    EXPECT_EQ(TL_TO_nSEC(width), 4000000ULL);
+
+    // Until the window has moved past it, a timestamp is neither after nor before
+    tp = now.latest;
+    EXPECT_EQ(timeline_after(timeline, &tp), 0);
+    EXPECT_EQ(timeline_before(timeline, &tp), 0);
+    timepoint_add(&tp, &width);
+    EXPECT_EQ(timeline_before(timeline, &tp), 1);
+
+    // Commit wait returns once the lower bound exceeds the timestamp
+    tp = now.latest;
+    s64 start = realtime_ns();
+    ASSERT_EQ(timeline_commit_wait(timeline, &tp, &done), QOT_RETURN_TYPE_OK);
+    s64 loose = realtime_ns() - start;
+    EXPECT_EQ(timepoint_cmp(&done.earliest, &tp), -1);
+    EXPECT_EQ(timeline_after(timeline, &tp), 1);
+    EXPECT_GE(loose, 4000000);
+
+    // Tighter synchronization shortens the wait
+    bounds.u_nsec = 100000;
+    bounds.l_nsec = -100000;
+    ASSERT_EQ(ioctl(fd, TIMELINE_SET_SYNC_UNCERTAINTY, &bounds), 0);
+    ASSERT_EQ(timeline_now(timeline, &now), QOT_RETURN_TYPE_OK);
+    tp = now.latest;
+    start = realtime_ns();
+    ASSERT_EQ(timeline_commit_wait(timeline, &tp, NULL), QOT_RETURN_TYPE_OK);
+    EXPECT_LT(realtime_ns() - start, loose);
+    EXPECT_EQ(timeline_after(timeline, &tp), 1);
+
+    close(fd);
+    close(usr);
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
+
+TEST(QoTEmu, TdmaSlots) {
+    timeline_t *timeline = timeline_t_create();
+    tdma_t *tdma = tdma_t_create();
+    timelength_t res;
+    timeinterval_t acc, peer;
+    qot_timeline_t info;
+    qot_bounds_t bounds;
+    tdma_slot_t slots[3];
+    tdma_config_t config;
+    tdma_window_t window;
+    tdma_stats_t stats;
+    utimepoint_t late;
+    char path[32];
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    ASSERT_EQ(timeline_bind(timeline, "emu_tdma", "app", res, acc), QOT_RETURN_TYPE_OK);
+
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_tdma");
+    ASSERT_EQ(ioctl(usr, QOTUSR_GET_TIMELINE_INFO, &info), 0);
+    sprintf(path, "/dev/timeline%d", info.index);
+    int fd = open(path, O_RDWR);
+    ASSERT_GE(fd, 0);
+    memset(&bounds, 0, sizeof(bounds));
+    bounds.u_nsec = 100000;
+    bounds.l_nsec = -100000;
+    ASSERT_EQ(ioctl(fd, TIMELINE_SET_SYNC_UNCERTAINTY, &bounds), 0);
+
+    // Node b follows a directly; a's second slot follows an idle gap
+    memset(slots, 0, sizeof(slots));
+    strcpy(slots[0].owner, "a");
+    TL_FROM_mSEC(slots[0].offset, 0);
+    TL_FROM_mSEC(slots[0].length, 5);
+    strcpy(slots[1].owner, "b");
+    TL_FROM_mSEC(slots[1].offset, 5);
+    TL_FROM_mSEC(slots[1].length, 5);
+    strcpy(slots[2].owner, "a");
+    TL_FROM_mSEC(slots[2].offset, 12);
+    TL_FROM_mSEC(slots[2].length, 4);
+    memset(&config, 0, sizeof(config));
+    config.node = "b";
+    TL_FROM_mSEC(config.period, 20);
+    config.slots = slots;
+    config.num_slots = 3;
+
+    // Overlapping slots are rejected
+    TL_FROM_mSEC(slots[1].offset, 4);
+    EXPECT_EQ(tdma_configure(tdma, timeline, &config), QOT_RETURN_TYPE_ERR);
+    TL_FROM_mSEC(slots[1].offset, 5);
+    ASSERT_EQ(tdma_configure(tdma, timeline, &config), QOT_RETURN_TYPE_OK);
+    TL_FROM_nSEC(peer.below, 10000);
+    TL_FROM_nSEC(peer.above, 10000);
+    EXPECT_EQ(tdma_set_peer_uncertainty(tdma, "c", &peer), QOT_RETURN_TYPE_ERR);
+
+    // Until a reports, its uncertainty is taken to be ours: 100us + 100us
+    ASSERT_EQ(tdma_wait_slot(tdma, &window), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(window.slot, 1);
+    EXPECT_EQ(TL_TO_nSEC(window.guard), 200000ULL);
+    EXPECT_LE(timepoint_cmp(&window.wakeup.estimate, &window.start), 0);
+    EXPECT_EQ(TP_TO_nSEC(window.end) - TP_TO_nSEC(window.start), 4800000ULL);
+    ASSERT_EQ(tdma_slot_done(tdma, &window), QOT_RETURN_TYPE_OK);
+
+    // A better synchronized peer shrinks the guard band
+    ASSERT_EQ(tdma_set_peer_uncertainty(tdma, "a", &peer), QOT_RETURN_TYPE_OK);
+    uint64_t cycle = window.cycle;
+    ASSERT_EQ(tdma_wait_slot(tdma, &window), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(window.cycle, cycle + 1);
+    EXPECT_EQ(TL_TO_nSEC(window.guard), 110000ULL);
+
+    // Finishing after the end of the slot is an overrun
+    memset(&late, 0, sizeof(late));
+    late.estimate = window.end;
+    ASSERT_EQ(timeline_waituntil(timeline, &late), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(tdma_slot_done(tdma, &window), QOT_RETURN_TYPE_OK);
+
+    ASSERT_EQ(tdma_get_stats(tdma, &stats), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(stats.slots, 2ULL);
+    EXPECT_EQ(stats.missed, 0ULL);
+    EXPECT_EQ(stats.starved, 0ULL);
+    EXPECT_EQ(stats.overruns, 1ULL);
+    EXPECT_EQ(stats.nominal_ns, 10000000ULL);
+    EXPECT_EQ(stats.usable_ns, 10000000ULL - 310000ULL);
+    EXPECT_GE(stats.used_ns, 4890000ULL);
+    EXPECT_EQ(TL_TO_nSEC(stats.max_guard), 200000ULL);
+
+    // With lopsided bounds the guard is a running late plus b running early
+    bounds.u_nsec = 300000;
+    bounds.l_nsec = -50000;
+    ASSERT_EQ(ioctl(fd, TIMELINE_SET_SYNC_UNCERTAINTY, &bounds), 0);
+    TL_FROM_nSEC(peer.above, 20000);
+    TL_FROM_nSEC(peer.below, 70000);
+    ASSERT_EQ(tdma_set_peer_uncertainty(tdma, "a", &peer), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(tdma_wait_slot(tdma, &window), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(window.slot, 1);
+    EXPECT_EQ(TL_TO_nSEC(window.guard), 70000ULL);
+
+    close(fd);
+    close(usr);
+    tdma_t_destroy(tdma);
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
+
+TEST(QoTEmu, LaunchTimeSend) {
+    timeline_t *timeline = timeline_t_create();
+    timelength_t res, step;
+    timeinterval_t acc;
+    qot_timeline_t info;
+    qot_bounds_t bounds;
+    qot_txtime_config_t config;
+    utimepoint_t now, achieved[3];
+    timepoint_t launch[3];
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    struct mmsghdr msgs[3];
+    struct iovec iov[3];
+    char payload[3][8], buf[8];
+    char path[32];
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    ASSERT_EQ(timeline_bind(timeline, "emu_txtime", "app", res, acc), QOT_RETURN_TYPE_OK);
+
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_txtime");
+    ASSERT_EQ(ioctl(usr, QOTUSR_GET_TIMELINE_INFO, &info), 0);
+    sprintf(path, "/dev/timeline%d", info.index);
+    int fd = open(path, O_RDWR);
+    ASSERT_GE(fd, 0);
+    memset(&bounds, 0, sizeof(bounds));
+    bounds.u_nsec = 5000;
+    bounds.l_nsec = -5000;
+    ASSERT_EQ(ioctl(fd, TIMELINE_SET_SYNC_UNCERTAINTY, &bounds), 0);
+
+    // Loopback has no ETF qdisc: the packets leave at once, but carry their launch times
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(rx, 0);
+    ASSERT_GE(tx, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(rx, (struct sockaddr *) &addr, sizeof(addr)), 0);
+    ASSERT_EQ(getsockname(rx, (struct sockaddr *) &addr, &addrlen), 0);
+    memset(&config, 0, sizeof(config));
+    config.clockid = CLOCK_TAI;
+    TL_FROM_nSEC(config.launch_error.below, 1000);
+    TL_FROM_nSEC(config.launch_error.above, 2000);
+    if (qot_txtime_enable(tx, &config)) {
+        std::cout << "SO_TXTIME is not available, skipping" << std::endl;
+    } else {
+        ASSERT_EQ(timeline_gettime(timeline, &now), QOT_RETURN_TYPE_OK);
+        TL_FROM_mSEC(step, 1);
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < 3; i++) {
+            launch[i] = now.estimate;
+            for (int j = 0; j <= i; j++)
+                timepoint_add(&launch[i], &step);
+            sprintf(payload[i], "pkt%d", i);
+            iov[i].iov_base = payload[i];
+            iov[i].iov_len = sizeof(payload[i]);
+            msgs[i].msg_hdr.msg_name = &addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        ASSERT_EQ(timeline_sendmmsg_at(timeline, tx, &config, msgs, launch, achieved, 3, 0), 3);
+        for (int i = 0; i < 3; i++) {
+            // The caller's messages are left as they were
+            EXPECT_EQ(msgs[i].msg_hdr.msg_control, nullptr);
+            EXPECT_EQ(msgs[i].msg_hdr.msg_controllen, 0U);
+            EXPECT_EQ(msgs[i].msg_len, sizeof(payload[i]));
+            // Launch instants map back to the requested times, within the uncertainty
+            s64 err = (s64) TP_TO_nSEC(achieved[i].estimate) - (s64) TP_TO_nSEC(launch[i]);
+            EXPECT_LE(llabs(err), 1);
+            EXPECT_EQ(TL_TO_nSEC(achieved[i].interval.above), 7000ULL);
+            EXPECT_EQ(TL_TO_nSEC(achieved[i].interval.below), 6000ULL);
+            ASSERT_EQ(recv(rx, buf, sizeof(buf), 0), (ssize_t) sizeof(buf));
+            EXPECT_STREQ(buf, payload[i]);
+        }
+    }
+
+    close(tx);
+    close(rx);
+    close(fd);
+    close(usr);
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
+
+TEST(QoTEmu, TimestampedReceive) {
+    timeline_t *timeline = timeline_t_create();
+    timelength_t res;
+    timeinterval_t acc;
+    qot_timeline_t info;
+    qot_bounds_t bounds;
+    utimepoint_t before, after, arrival[8];
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    struct mmsghdr msgs[8];
+    struct iovec iov[8];
+    char bufs[8][16], control[QOT_NET_RX_CONTROL];
+    char path[32];
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    ASSERT_EQ(timeline_bind(timeline, "emu_rxtime", "app", res, acc), QOT_RETURN_TYPE_OK);
+
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_rxtime");
+    ASSERT_EQ(ioctl(usr, QOTUSR_GET_TIMELINE_INFO, &info), 0);
+    sprintf(path, "/dev/timeline%d", info.index);
+    int fd = open(path, O_RDWR);
+    ASSERT_GE(fd, 0);
+    memset(&bounds, 0, sizeof(bounds));
+    bounds.u_nsec = 5000;
+    bounds.l_nsec = -5000;
+    ASSERT_EQ(ioctl(fd, TIMELINE_SET_SYNC_UNCERTAINTY, &bounds), 0);
+
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(rx, 0);
+    ASSERT_GE(tx, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(rx, (struct sockaddr *) &addr, sizeof(addr)), 0);
+    ASSERT_EQ(getsockname(rx, (struct sockaddr *) &addr, &addrlen), 0);
+    ASSERT_EQ(qot_rxtime_enable(rx, NULL), QOT_RETURN_TYPE_OK);
+
+    // The kernel turns receive timestamps on asynchronously, so wait until a
+    // probe comes back stamped before sending the burst
+    for (int i = 0; i < 1000; i++) {
+        struct msghdr probe;
+        struct iovec piov = { bufs[0], sizeof(bufs[0]) };
+        ASSERT_EQ(sendto(tx, "probe", 6, 0, (struct sockaddr *) &addr, sizeof(addr)), 6);
+        memset(&probe, 0, sizeof(probe));
+        probe.msg_iov = &piov;
+        probe.msg_iovlen = 1;
+        probe.msg_control = control;
+        probe.msg_controllen = sizeof(control);
+        ASSERT_EQ(recvmsg(rx, &probe, 0), 6);
+        if (probe.msg_controllen > 0)
+            break;
+        usleep(1000);
+    }
+
+    ASSERT_EQ(timeline_gettime(timeline, &before), QOT_RETURN_TYPE_OK);
+    for (int i = 0; i < 5; i++) {
+        sprintf(bufs[i], "pkt%d", i);
+        ASSERT_EQ(sendto(tx, bufs[i], strlen(bufs[i]) + 1, 0, (struct sockaddr *) &addr, sizeof(addr)),
+            (ssize_t) strlen(bufs[i]) + 1);
+    }
+
+    // The first message brings its own control buffer, the others get one
+    memset(msgs, 0, sizeof(msgs));
+    memset(bufs, 0, sizeof(bufs));
+    for (int i = 0; i < 8; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = sizeof(bufs[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    msgs[0].msg_hdr.msg_control = control;
+    msgs[0].msg_hdr.msg_controllen = sizeof(control);
+    ASSERT_EQ(timeline_recvmmsg(timeline, rx, msgs, arrival, 8, MSG_DONTWAIT, NULL), 5);
+    ASSERT_EQ(timeline_gettime(timeline, &after), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(msgs[0].msg_hdr.msg_control, (void *) control);
+    EXPECT_GT(msgs[0].msg_hdr.msg_controllen, 0U);
+    for (int i = 0; i < 5; i++) {
+        char expect[16];
+        sprintf(expect, "pkt%d", i);
+        EXPECT_STREQ(bufs[i], expect);
+        if (i) {
+            EXPECT_EQ(msgs[i].msg_hdr.msg_control, nullptr);
+        }
+        // Kernel receive timestamps lie between the send and the return
+        EXPECT_LE(timepoint_cmp(&arrival[i].estimate, &before.estimate), 0);
+        EXPECT_GE(timepoint_cmp(&arrival[i].estimate, &after.estimate), 0);
+        if (i) {
+            EXPECT_LE(timepoint_cmp(&arrival[i].estimate, &arrival[i - 1].estimate), 0);
+        }
+        EXPECT_EQ(TL_TO_nSEC(arrival[i].interval.above), 5000ULL);
+        EXPECT_EQ(TL_TO_nSEC(arrival[i].interval.below), 5000ULL);
+    }
+
+    // Nothing left: the non-blocking call reports it
+    EXPECT_EQ(timeline_recvmmsg(timeline, rx, msgs, arrival, 8, MSG_DONTWAIT, NULL), -1);
+    EXPECT_EQ(errno, EAGAIN);
+
+    close(tx);
+    close(rx);
+    close(fd);
+    close(usr);
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
+
+TEST(QoTEmu, Trace) {
+    timeline_t *timeline = timeline_t_create();
+    timelength_t res;
+    timeinterval_t acc;
+    qot_timeline_t info;
+    qot_bounds_t bounds;
+    qot_trace_config_t config;
+    qot_trace_stats_t stats;
+    qot_trace_header_t header;
+    qot_trace_block_t block;
+    qot_trace_name_t name;
+    qot_trace_entry_t entry;
+    char path[] = "/tmp/qot_trace_XXXXXX";
+    char tlpath[32];
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    ASSERT_EQ(timeline_bind(timeline, "emu_trace", "app", res, acc), QOT_RETURN_TYPE_OK);
+
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_trace");
+    ASSERT_EQ(ioctl(usr, QOTUSR_GET_TIMELINE_INFO, &info), 0);
+    sprintf(tlpath, "/dev/timeline%d", info.index);
+    int fd = open(tlpath, O_RDWR);
+    ASSERT_GE(fd, 0);
+    memset(&bounds, 0, sizeof(bounds));
+    bounds.u_nsec = 5000;
+    bounds.l_nsec = -5000;
+    ASSERT_EQ(ioctl(fd, TIMELINE_SET_SYNC_UNCERTAINTY, &bounds), 0);
+    int tmp = mkstemp(path);
+    ASSERT_GE(tmp, 0);
+    close(tmp);
+
+    // Two threads trace into their own buffers while a background flush drains them
+    memset(&config, 0, sizeof(config));
+    config.records = 1024;
+    config.flush_ms = 1;
+    ASSERT_EQ(qot_trace_open(timeline, path, &config), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(qot_trace_name(1, "work"), QOT_RETURN_TYPE_OK);
+    std::vector<std::thread> workers;
+    for (uint64_t t = 0; t < 2; t++)
+        workers.push_back(std::thread([t] {
+            for (uint64_t i = 0; i < 500; i++)
+                qot_trace(1, t, i);
+        }));
+    for (auto &w : workers)
+        w.join();
+    ASSERT_EQ(qot_trace_get_stats(&stats), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(stats.threads, 2U);
+    EXPECT_EQ(stats.dropped, 0ULL);
+    ASSERT_EQ(qot_trace_close(), QOT_RETURN_TYPE_OK);
+    qot_trace(1, 0, 0);
+
+    FILE *f = fopen(path, "rb");
+    ASSERT_NE(f, nullptr);
+    ASSERT_EQ(fread(&header, sizeof(header), 1, f), 1U);
+    EXPECT_EQ(header.magic, QOT_TRACE_MAGIC);
+    EXPECT_EQ(header.entry_size, sizeof(qot_trace_entry_t));
+    EXPECT_STREQ(header.timeline, "emu_trace");
+    std::map<uint64_t, uint64_t> next;
+    tl_translation_t params;
+    int names = 0, entries = 0, batches = 0;
+    while (fread(&block, sizeof(block), 1, f) == 1) {
+        for (uint32_t i = 0; i < block.count; i++) {
+            if (block.type == QOT_TRACE_BLOCK_PARAMS) {
+                // The projection comes before any entry it applies to
+                ASSERT_EQ(fread(&params, sizeof(params), 1, f), 1U);
+                EXPECT_EQ(entries, 0);
+                batches++;
+                continue;
+            }
+            if (block.type == QOT_TRACE_BLOCK_NAMES) {
+                ASSERT_EQ(fread(&name, sizeof(name), 1, f), 1U);
+                EXPECT_EQ(name.id, 1U);
+                EXPECT_STREQ(name.name, "work");
+                names++;
+                continue;
+            }
+            ASSERT_EQ(block.type, (uint32_t) QOT_TRACE_BLOCK_ENTRIES);
+            ASSERT_EQ(fread(&entry, sizeof(entry), 1, f), 1U);
+            // Each thread's records arrive in order, projected with their bounds
+            EXPECT_EQ(entry.rec.arg[1], next[entry.rec.arg[0]]++);
+            EXPECT_EQ(entry.below_ns, 5000U);
+            EXPECT_EQ(entry.above_ns, 5000U);
+            EXPECT_LT(llabs(entry.tl_ns - entry.rec.core_ns), 1000000000LL);
+            entries++;
+        }
+    }
+    fclose(f);
+    EXPECT_EQ(names, 1);
+    EXPECT_EQ(entries, 1000);
+    EXPECT_EQ(batches, 1);
+
+    // Without flushes a full buffer drops records instead of blocking
+    config.records = 256;
+    config.flush_ms = 0;
+    ASSERT_EQ(qot_trace_open(timeline, path, &config), QOT_RETURN_TYPE_OK);
+    for (uint64_t i = 0; i < 1000; i++)
+        qot_trace(2, 0, i);
+    ASSERT_EQ(qot_trace_get_stats(&stats), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(stats.dropped, 744ULL);
+    ASSERT_EQ(qot_trace_flush(), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(qot_trace_get_stats(&stats), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(stats.written, 256ULL);
+    ASSERT_EQ(qot_trace_close(), QOT_RETURN_TYPE_OK);
+
+    // Closing while threads are taking records keeps their buffers alive, and
+    // the threads carry on into the next session
+    config.records = 1024;
+    config.flush_ms = 1;
+    std::atomic<bool> stop(false);
+    ASSERT_EQ(qot_trace_open(timeline, path, &config), QOT_RETURN_TYPE_OK);
+    workers.clear();
+    for (uint64_t t = 0; t < 2; t++)
+        workers.push_back(std::thread([t, &stop] {
+            for (uint64_t i = 0; !stop; i++)
+                qot_trace(3, t, i);
+        }));
+    usleep(2000);
+    ASSERT_EQ(qot_trace_close(), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(qot_trace_open(timeline, path, &config), QOT_RETURN_TYPE_OK);
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ(qot_trace_get_stats(&stats), QOT_RETURN_TYPE_OK);
+        if (stats.threads == 2)
+            break;
+        usleep(1000);
+    }
+    EXPECT_EQ(stats.threads, 2U);
+    stop = true;
+    for (auto &w : workers)
+        w.join();
+    ASSERT_EQ(qot_trace_get_stats(&stats), QOT_RETURN_TYPE_OK);
+    EXPECT_GT(stats.written, 0ULL);
+    ASSERT_EQ(qot_trace_close(), QOT_RETURN_TYPE_OK);
+
+    unlink(path);
+    close(fd);
+    close(usr);
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
+
+static std::atomic<int> created_events(0);
+static std::atomic<int> created_named(0);
+static std::atomic<int> created_batches(0);
+
+static void on_created(const qot_event_t *evts, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(evts[i].type, QOT_EVENT_TIMELINE_CREATE);
+        if (!strncmp(evts[i].data, "emu_dispatch_", 13))
+            created_named++;
+    }
+    created_events += (int) count;
+    created_batches++;
+}
+
+TEST(QoTEmu, EventDispatch) {
+    timeline_t *timeline = timeline_t_create();
+    timelength_t res;
+    timeinterval_t acc;
+    qot_timeline_t info[3];
+    qot_event_stats_t stats;
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    ASSERT_EQ(timeline_bind(timeline, "emu_dispatch", "app", res, acc), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_config_event_batch(timeline, QOT_EVENT_TIMELINE_CREATE, 1, on_created),
+        QOT_RETURN_TYPE_OK);
+
+    // Events queued before the dispatcher wakes up are delivered together
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    for (int i = 0; i < 3; i++) {
+        memset(&info[i], 0, sizeof(info[i]));
+        sprintf(info[i].name, "emu_dispatch_%d", i);
+        ASSERT_EQ(ioctl(usr, QOTUSR_CREATE_TIMELINE, &info[i]), 0);
+    }
+    for (int i = 0; i < 1000 && created_named < 3; i++)
+        usleep(1000);
+    EXPECT_EQ(created_named, 3);
+    EXPECT_GE(created_batches, 1);
+
+    ASSERT_EQ(timeline_get_event_stats(timeline, &stats), QOT_RETURN_TYPE_OK);
+    // Includes the creation of the bound timeline itself
+    EXPECT_EQ(stats.types[QOT_EVENT_TIMELINE_CREATE].events, (uint64_t) created_events);
+    EXPECT_EQ(stats.types[QOT_EVENT_TIMELINE_CREATE].batches, (uint64_t) created_batches);
+    EXPECT_GE(stats.types[QOT_EVENT_TIMELINE_CREATE].max_depth, 1U);
+    EXPECT_GE(stats.wakeups, 1ULL);
+
+    EXPECT_EQ(timeline_config_event_batch(timeline, QOT_EVENT_TIMELINE_CREATE, 0, NULL),
+        QOT_RETURN_TYPE_OK);
+    for (int i = 0; i < 3; i++)
+        EXPECT_EQ(ioctl(usr, QOTUSR_DESTROY_TIMELINE, &info[i]), 0);
+    close(usr);
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
+
+static std::atomic<int> hangup_events(0);
+
+static void on_hangup_event(const qot_event_t *evt)
+{
+    if (evt->type == QOT_EVENT_TIMELINE_CREATE && !strcmp(evt->data, "emu_hangup_created"))
+        hangup_events++;
+}
+
+static s64 cpu_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (s64) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+TEST(QoTEmu, EventDispatchHangup) {
+    timeline_t *broken = timeline_t_create(), *healthy = timeline_t_create();
+    timelength_t res;
+    timeinterval_t acc;
+    qot_timeline_t info;
+    int hangup[2];
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    ASSERT_EQ(timeline_bind(broken, "emu_hangup_broken", "app", res, acc), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_config_event_type(broken, QOT_EVENT_TIMELINE_CREATE, 1, on_hangup_event),
+        QOT_RETURN_TYPE_OK);
+
+    // Replace the event connection by a pipe whose writer is gone
+    ASSERT_EQ(pipe(hangup), 0);
+    ASSERT_GE(dup2(hangup[0], timeline_get_event_fd(broken)), 0);
+    close(hangup[0]);
+    close(hangup[1]);
+
+    // Registering another timeline makes the dispatcher poll the hung up one
+    ASSERT_EQ(timeline_bind(healthy, "emu_hangup_healthy", "app", res, acc), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_config_event_type(healthy, QOT_EVENT_TIMELINE_CREATE, 1, on_hangup_event),
+        QOT_RETURN_TYPE_OK);
+    s64 cpu = cpu_time_ns();
+    usleep(200000);
+    EXPECT_LT(cpu_time_ns() - cpu, 100000000LL);
+
+    // The healthy timeline still gets its callbacks
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_hangup_created");
+    ASSERT_EQ(ioctl(usr, QOTUSR_CREATE_TIMELINE, &info), 0);
+    for (int i = 0; i < 1000 && hangup_events < 1; i++)
+        usleep(1000);
+    EXPECT_EQ(hangup_events, 1);
+
+    EXPECT_EQ(ioctl(usr, QOTUSR_DESTROY_TIMELINE, &info), 0);
+    close(usr);
+    EXPECT_EQ(timeline_unbind(healthy), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(timeline_unbind(broken), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(healthy);
+    timeline_t_destroy(broken);
+}
+
+TEST(QoTEmu, BatchConversion) {
+    timeline_t *timeline = timeline_t_create();
+    timelength_t res;
+    timeinterval_t acc;
+    qot_timeline_t info;
+    qot_bounds_t bounds;
+    struct timex tx;
+    stimepoint_t stp;
+    timepoint_t tp;
+    qot_event_t events[4];
+    char path[32];
+    const size_t n = 1000;
+    std::vector<s64> core(n), tl(n), upper(n), lower(n), back(n);
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    ASSERT_EQ(timeline_bind(timeline, "emu_batch", "app", res, acc), QOT_RETURN_TYPE_OK);
+
+    // Give the timeline a discipline and an uncertainty model to project with
+    int usr = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(usr, 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_batch");
+    ASSERT_EQ(ioctl(usr, QOTUSR_GET_TIMELINE_INFO, &info), 0);
+    sprintf(path, "/dev/timeline%d", info.index);
+    int fd = open(path, O_RDWR);
+    ASSERT_GE(fd, 0);
+    memset(&tx, 0, sizeof(tx));
+    tx.modes = ADJ_SETOFFSET | ADJ_NANO;
+    tx.time.tv_usec = 250000000;
+    ASSERT_EQ(clock_adjtime(FD_TO_CLOCKID(fd), &tx), 0);
+    memset(&tx, 0, sizeof(tx));
+    tx.modes = ADJ_FREQUENCY;
+    tx.freq = 100 * 65536;
+    ASSERT_EQ(clock_adjtime(FD_TO_CLOCKID(fd), &tx), 0);
+    memset(&bounds, 0, sizeof(bounds));
+    bounds.u_nsec = 5000;
+    bounds.l_nsec = -5000;
+    bounds.u_drift = 20;
+    bounds.l_drift = -20;
+    bounds.u_pow = 3;
+    bounds.l_pow = -3;
+    ASSERT_EQ(ioctl(fd, TIMELINE_SET_SYNC_UNCERTAINTY, &bounds), 0);
+
+    // A batch matches the per-timestamp ioctls exactly
+    s64 now = realtime_ns();
+    for (size_t i = 0; i < n; i++)
+        core[i] = now - 3000000000LL + (s64) i * 7777777LL;
+    ASSERT_EQ(timeline_core2rem_n(timeline, core.data(), tl.data(), upper.data(), lower.data(), n),
+        QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_rem2core_n(timeline, tl.data(), back.data(), n), QOT_RETURN_TYPE_OK);
+    for (size_t i = 0; i < n; i++) {
+        memset(&stp, 0, sizeof(stp));
+        TP_FROM_nSEC(stp.estimate, core[i]);
+        ASSERT_EQ(timeline_core2rem(timeline, &stp), QOT_RETURN_TYPE_OK);
+        EXPECT_EQ(tl[i], TP_TO_nSEC(stp.estimate));
+        EXPECT_EQ(upper[i], TP_TO_nSEC(stp.u_estimate));
+        EXPECT_EQ(lower[i], TP_TO_nSEC(stp.l_estimate));
+        TP_FROM_nSEC(tp, tl[i]);
+        ASSERT_EQ(timeline_rem2core(timeline, &tp), QOT_RETURN_TYPE_OK);
+        EXPECT_EQ(back[i], TP_TO_nSEC(tp));
+    }
+
+    // In place, without bounds
+    ASSERT_EQ(timeline_core2rem_n(timeline, core.data(), core.data(), NULL, NULL, n),
+        QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(core, tl);
+
+    // Queued events are read in one call, and an empty queue does not block
+    while (timeline_read_events_n(timeline, events, 4, 0) > 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_batch_other");
+    ASSERT_EQ(ioctl(usr, QOTUSR_CREATE_TIMELINE, &info), 0);
+    EXPECT_EQ(timeline_read_events_n(timeline, events, 4, 1000), 1);
+    EXPECT_EQ(events[0].type, QOT_EVENT_TIMELINE_CREATE);
+    EXPECT_STREQ(events[0].data, "emu_batch_other");
+    EXPECT_EQ(timeline_read_events_n(timeline, events, 4, 0), 0);
+    EXPECT_EQ(ioctl(usr, QOTUSR_DESTROY_TIMELINE, &info), 0);
+
+    close(fd);
+    close(usr);
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
+
+TEST(QoTEmu, MutedConnection) {
+    qot_timeline_t info;
+    qot_event_t event;
+    int control = open("/dev/qotusr", O_RDWR), watcher = open("/dev/qotusr", O_RDWR);
+    ASSERT_GE(control, 0);
+    ASSERT_GE(watcher, 0);
+
+    // A muted connection drops what was queued and hears of no new timelines
+    ASSERT_EQ(ioctl(control, QOTUSR_MUTE_EVENTS), 0);
+    while (ioctl(watcher, QOTUSR_GET_NEXT_EVENT, &event) == 0);
+    memset(&info, 0, sizeof(info));
+    strcpy(info.name, "emu_muted");
+    ASSERT_EQ(ioctl(control, QOTUSR_CREATE_TIMELINE, &info), 0);
+    EXPECT_NE(ioctl(control, QOTUSR_GET_NEXT_EVENT, &event), 0);
+    ASSERT_EQ(ioctl(watcher, QOTUSR_GET_NEXT_EVENT, &event), 0);
+    EXPECT_EQ(event.type, QOT_EVENT_TIMELINE_CREATE);
+    EXPECT_STREQ(event.data, "emu_muted");
+    struct pollfd fds = { control, POLLIN, 0 };
+    EXPECT_EQ(poll(&fds, 1, 0), 0);
+
+    EXPECT_EQ(ioctl(control, QOTUSR_DESTROY_TIMELINE, &info), 0);
+    close(control);
+    close(watcher);
+}
+
+TEST(QoTEmu, SharedContext) {
+    timeline_t *first = timeline_t_create(), *second = timeline_t_create();
+    timelength_t res;
+    timeinterval_t acc;
+    qot_event_t events[4];
+    int base;
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    base = open_fds();
+    ASSERT_GE(base, 0);
+
+    // One core connection for the process plus one clock per timeline
+    ASSERT_EQ(timeline_bind(first, "emu_shared_a", "app", res, acc), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_bind(second, "emu_shared_b", "app", res, acc), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(open_fds(), base + 3);
+
+    // Events get a connection of their own, told about both timelines
+    EXPECT_EQ(timeline_read_events_n(second, events, 4, 0), 2);
+    EXPECT_EQ(open_fds(), base + 4);
+
+    // Each timeline watches its own event connection, so both fit in one epoll set
+    ASSERT_GE(timeline_get_event_fd(first), 0);
+    EXPECT_NE(timeline_get_event_fd(first), timeline_get_event_fd(second));
+    EXPECT_EQ(open_fds(), base + 5);
+
+    EXPECT_EQ(timeline_unbind(first), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(open_fds(), base + 3);
+    EXPECT_EQ(timeline_unbind(second), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(open_fds(), base);
+    timeline_t_destroy(first);
+    timeline_t_destroy(second);
+}
+
+// Runs last: the real-time profile stays enabled for the rest of the process
+TEST(QoTEmu, RealTimeProfile) {
+    qot_rt_config_t config;
+    timelength_t res, period;
+    timeinterval_t acc;
+    timepoint_t start;
+    utimepoint_t now, wake, prev;
+    memset(&config, 0, sizeof(config));
+    config.heap_reserve = 1 << 20;
+    ASSERT_EQ(qot_rt_profile_enable(&config), QOT_RETURN_TYPE_OK);
+    EXPECT_EQ(qot_rt_profile_enabled(), 1);
+
+    // Structures come from the preallocated pool until it runs out
+    timeline_t *pool[QOT_RT_MAX_TIMELINES];
+    for (int i = 0; i < QOT_RT_MAX_TIMELINES; i++)
+        ASSERT_NE(pool[i] = timeline_t_create(), (timeline_t *) NULL);
+    EXPECT_EQ(timeline_t_create(), (timeline_t *) NULL);
+    for (int i = 1; i < QOT_RT_MAX_TIMELINES; i++)
+        timeline_t_destroy(pool[i]);
+    timeline_t *timeline = pool[0];
+
+    TL_FROM_nSEC(res, 1);
+    TL_FROM_nSEC(acc.below, 1000);
+    TL_FROM_nSEC(acc.above, 1000);
+    TL_FROM_mSEC(period, 2);
+    EXPECT_NE(timeline_gettime(timeline, &now), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_bind(timeline, "emu_rt", "app", res, acc), QOT_RETURN_TYPE_OK);
+    ASSERT_EQ(timeline_gettime(timeline, &now), QOT_RETURN_TYPE_OK);
+    start = now.estimate;
+    ASSERT_EQ(timeline_set_schedparams(timeline, &period, &start), QOT_RETURN_TYPE_OK);
+
+    // Later periods are computed from the previous wakeup, and stay phase aligned
+    ASSERT_EQ(timeline_waituntil_nextperiod(timeline, &prev), QOT_RETURN_TYPE_OK);
+    for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(timeline_waituntil_nextperiod(timeline, &wake), QOT_RETURN_TYPE_OK);
+        EXPECT_GT(timepoint_cmp(&prev.estimate, &wake.estimate), 0);
+        prev = wake;
+    }
+
+    // Binding logged through the ring rather than stdio
+    int null = open("/dev/null", O_WRONLY);
+    ASSERT_GE(null, 0);
+    EXPECT_GT(qot_rt_log_drain(null), 0U);
+    EXPECT_EQ(qot_rt_log_drain(null), 0U);
+    EXPECT_EQ(qot_rt_log_dropped(), 0ULL);
+    close(null);
+
+    EXPECT_EQ(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    EXPECT_NE(timeline_unbind(timeline), QOT_RETURN_TYPE_OK);
+    timeline_t_destroy(timeline);
+}
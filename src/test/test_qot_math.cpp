@@ -1,8 +1,13 @@
+#include <cmath>
 #include <iostream>
+#include <random>
+#include <vector>
 #include <gtest/gtest.h>
 
 extern "C" {
     #include "../qot_types.h"
+    #include "../qot_math.h"
+    #include "../qot_uncertainty.h"
 }
 
 TEST(TimelineMath, TL_FROM) {
@@ -220,6 +225,14 @@ TEST(TimelineMath, timepoint_diff) {
 	timepoint_diff(&v, &t1, &t2);
 	EXPECT_EQ(1,v.sec);
 	EXPECT_EQ(1,v.asec);
+	// The fractional part borrows from the seconds, in either order
+	t2.asec = 0;
+	timepoint_diff(&v, &t1, &t2);
+	EXPECT_EQ(0,v.sec);
+	EXPECT_EQ(999999999999999999ULL,v.asec);
+	timepoint_diff(&v, &t2, &t1);
+	EXPECT_EQ(0,v.sec);
+	EXPECT_EQ(999999999999999999ULL,v.asec);
 }
 
 TEST(TimelineMath, timepoint_cmp) {
@@ -281,3 +294,200 @@ TEST(TimelineMath, utimepoint_sub) {
 	EXPECT_EQ(400ULL,ut.interval.below.asec);
 	EXPECT_EQ(400ULL,ut.interval.below.asec);
 }
+
+// Division-based reference versions of the normalization in qot_types.h
+
+static void ref_timepoint_add(timepoint_t *t, const timelength_t *v)
+{
+	u64 tm;
+	t->asec += v->asec;
+	t->sec  += v->sec;
+	tm = t->asec / aSEC_PER_SEC;
+	t->sec  += tm;
+	t->asec -= (tm * aSEC_PER_SEC);
+}
+
+static void ref_timepoint_from_nsec(timepoint_t *tp, s64 t)
+{
+	u64 tm;
+	memset(tp, 0, sizeof(timepoint_t));
+	if (!t)
+		return;
+	tm = (u64) llabs(t);
+	tp->sec = tm / nSEC_PER_SEC;
+	tp->asec = (tm - nSEC_PER_SEC * (u64) tp->sec) * nSEC_PER_SEC;
+	if (t < 0) {
+		tp->sec = -tp->sec;
+		if (tp->asec) {
+			tp->sec--;
+			tp->asec = aSEC_PER_SEC - tp->asec;
+		}
+	}
+}
+
+// Mostly normalized timepoints, with some denormalized fields mixed in
+static void random_timepoints(std::mt19937_64 &rng, timepoint_t *t, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		t[i].sec = (s64) (rng() >> (rng() % 64)) * ((rng() & 1) ? 1 : -1);
+		t[i].asec = rng() % aSEC_PER_SEC;
+		if (rng() % 16 == 0)
+			t[i].asec = rng() >> (rng() % 8);
+	}
+}
+
+TEST(TimelineMath, div_ratio) {
+	const u64 ratios[] = {SEC_PER_SEC, mSEC_PER_SEC, uSEC_PER_SEC,
+		nSEC_PER_SEC, pSEC_PER_SEC, fSEC_PER_SEC, aSEC_PER_SEC, 7ULL};
+	std::mt19937_64 rng(1);
+	for (u64 d : ratios) {
+		std::vector<u64> xs = {0ULL, 1ULL, d - 1, d, d + 1, 2 * d - 1,
+			MAX_ULL, MAX_ULL - 1, MAX_ULL / d * d, MAX_ULL / d * d - 1,
+			(u64) MAX_LL, (u64) MAX_LL + 1};
+		for (int i = 0; i < 100000; i++)
+			xs.push_back(rng() >> (rng() % 64));
+		for (u64 x : xs)
+			ASSERT_EQ(qot_div_ratio(x, d), x / d) << x << " / " << d;
+	}
+	EXPECT_EQ(qot_div_ratio_s64(-1999999999LL, nSEC_PER_SEC), -1LL);
+	EXPECT_EQ(qot_div_ratio_s64(-MAX_LL - 1, nSEC_PER_SEC),
+		(-MAX_LL - 1) / 1000000000LL);
+}
+
+TEST(TimelineMath, timepoint_add_exact) {
+	std::mt19937_64 rng(2);
+	timepoint_t t[1024], r[1024];
+	timelength_t v[1024];
+	random_timepoints(rng, t, 1024);
+	random_timepoints(rng, (timepoint_t *) v, 1024);
+	memcpy(r, t, sizeof(r));
+	for (int i = 0; i < 1024; i++) {
+		timepoint_add(&t[i], &v[i]);
+		ref_timepoint_add(&r[i], &v[i]);
+		ASSERT_EQ(t[i].sec, r[i].sec);
+		ASSERT_EQ(t[i].asec, r[i].asec);
+	}
+}
+
+TEST(TimelineMath, timepoint_add_n) {
+	std::mt19937_64 rng(3);
+	for (size_t n : {0, 1, 2, 3, 255}) {
+		std::vector<timepoint_t> t(n), r(n);
+		std::vector<timelength_t> v(n);
+		random_timepoints(rng, t.data(), n);
+		random_timepoints(rng, (timepoint_t *) v.data(), n);
+		r = t;
+		timepoint_add_n(t.data(), v.data(), n);
+		for (size_t i = 0; i < n; i++) {
+			ref_timepoint_add(&r[i], &v[i]);
+			ASSERT_EQ(t[i].sec, r[i].sec) << i;
+			ASSERT_EQ(t[i].asec, r[i].asec) << i;
+		}
+	}
+}
+
+TEST(TimelineMath, timepoint_cmp_n) {
+	std::mt19937_64 rng(4);
+	const size_t n = 257;
+	timepoint_t t1[n], t2[n];
+	int res[n];
+	random_timepoints(rng, t1, n);
+	random_timepoints(rng, t2, n);
+	// Exercise equal seconds, equal timepoints and the unsigned asec order
+	for (size_t i = 0; i < n; i += 3)
+		t2[i].sec = t1[i].sec;
+	for (size_t i = 0; i < n; i += 7)
+		t2[i] = t1[i];
+	t1[1].sec = t2[1].sec;
+	t1[1].asec = 1ULL << 63;
+	t2[1].asec = 1;
+	timepoint_cmp_n(t1, t2, res, n);
+	for (size_t i = 0; i < n; i++)
+		ASSERT_EQ(res[i], timepoint_cmp(&t1[i], &t2[i])) << i;
+	EXPECT_EQ(res[1], -1);
+}
+
+TEST(TimelineMath, timepoint_nsec_n) {
+	std::mt19937_64 rng(5);
+	const size_t n = 1000;
+	s64 ns[n], back[n];
+	timepoint_t t[n];
+	for (size_t i = 0; i < n; i++)
+		ns[i] = (s64) (rng() >> (rng() % 64));
+	ns[0] = 0;
+	ns[1] = -1;
+	ns[2] = -1000000000LL;
+	ns[3] = MAX_LL;
+	timepoint_from_nsec_n(t, ns, n);
+	timepoint_to_nsec_n(t, back, n);
+	for (size_t i = 0; i < n; i++) {
+		timepoint_t r;
+		ref_timepoint_from_nsec(&r, ns[i]);
+		ASSERT_EQ(t[i].sec, r.sec) << ns[i];
+		ASSERT_EQ(t[i].asec, r.asec) << ns[i];
+		ASSERT_EQ(back[i], (s64) (r.sec * nSEC_PER_SEC + r.asec / nSEC_PER_SEC));
+		ASSERT_EQ(back[i], ns[i]);
+	}
+}
+
+TEST(TimelineMath, timepoint_loc2rem_n) {
+	std::mt19937_64 rng(6);
+	const size_t n = 1000;
+	tl_translation_t tr;
+	s64 core[n], tl[n];
+	memset(&tr, 0, sizeof(tr));
+	tr.last = 1500000000000000000LL;
+	tr.nsec = 1500000000123456789LL;
+	tr.mult = -12345;
+	for (size_t i = 0; i < n; i++)
+		core[i] = tr.last + (s64) (rng() % 200000000000ULL) - 100000000000LL;
+	timepoint_loc2rem_n(&tr, core, tl, n);
+	for (size_t i = 0; i < n; i++) {
+		s64 d = core[i] - tr.last;
+		ASSERT_EQ(tl[i], tr.nsec + d + (tr.mult * d) / 1000000000L);
+	}
+}
+
+TEST(TimelineMath, uncertainty_bound) {
+	// The table model must never under-estimate nsec + mult*dt/1e9 + coef*dt^(3/2)
+	qot_uncertainty_table_t u, l;
+	qot_uncertainty_build(&u, 1000);
+	qot_uncertainty_build(&l, -1000);
+	std::mt19937_64 gen(11);
+	for (int i = 0; i < 10000; i++) {
+		s64 dt = (s64) (gen() >> (17 + gen() % 40));
+		double s = dt / 1e9;
+		double exact = 1000.0 * s * std::sqrt(s);
+		s64 drift = (s64) (50 * dt) / 1000000000L;
+		s64 upper = qot_uncertainty_bound(10, 50, &u, dt);
+		s64 lower = qot_uncertainty_bound(-10, -50, &l, dt);
+		ASSERT_GE((double) (upper - 10 - drift), exact * (1 - 1e-9)) << dt;
+		ASSERT_LE((double) (lower + 10 + drift), -exact * (1 - 1e-9)) << dt;
+	}
+	EXPECT_EQ(qot_uncertainty_bound(7, 0, &u, 0), 7);
+	EXPECT_EQ(qot_uncertainty_bound(0, 0, &u, 1LL << 50), QOT_UNCERTAINTY_SAT_NSEC);
+}
+
+TEST(TimelineMath, uncertainty_breakpoints) {
+	// Just above a breakpoint the 16-bit interpolation fraction drops low bits,
+	// which must round the bound up, never down
+	qot_uncertainty_table_t u, l;
+	qot_uncertainty_build(&u, 1000);
+	qot_uncertainty_build(&l, -1000);
+	const s64 fixed[] = { 68720525311LL, 274882101247LL, (1LL << 45) + (1LL << 29) - 1 };
+	std::vector<s64> dts(fixed, fixed + 3);
+	for (int k = 1; k < QOT_UNCERTAINTY_TABLE_SIZE - 1; k++) {
+		s64 p = 1LL << k;
+		dts.push_back(p - 1);
+		dts.push_back(p);
+		dts.push_back(p + 1);
+		if (k > 16)
+			dts.push_back(p + (p >> 16) - 1);
+	}
+	for (s64 dt : dts) {
+		long double s = dt / 1e9L;
+		long double exact = 1000.0L * s * sqrtl(s);
+		ASSERT_GE((long double) qot_uncertainty_eval(&u, dt), exact) << dt;
+		ASSERT_LE((long double) qot_uncertainty_eval(&l, dt), -exact) << dt;
+	}
+}
@@ -0,0 +1,120 @@
+#
+# @file test_qot_python.py
+# @brief Tests of the Python bindings against the userspace core emulation
+# @author Sandeep D'souza
+#
+# Copyright (c) Carnegie Mellon University 2018.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#  1. Redistributions of source code must retain the above copyright notice,
+#     this list of conditions and the following disclaimer.
+#  2. Redistributions in binary form must reproduce the above copyright notice,
+#     this list of conditions and the following disclaimer in the documentation
+#     and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+
+# Run with libqotemu preloaded and the built qot package on PYTHONPATH (see CMakeLists.txt)
+
+import array
+import threading
+import time
+import unittest
+
+import numpy
+
+import qot
+from qot import _qot
+
+
+class TestQoTPython(unittest.TestCase):
+
+    def setUp(self):
+        self.tl = _qot.Timeline()
+        self.tl.bind('py_timeline', 'app', 1, 1000, 1000)
+
+    def tearDown(self):
+        self.tl.close()
+
+    def test_gettime(self):
+        est, below, above = self.tl.gettime()
+        self.assertLess(abs(est - time.time_ns()), 10000000)
+        self.assertGreaterEqual(below, 0)
+        self.assertGreaterEqual(above, 0)
+
+    def test_conversions(self):
+        now = time.time_ns()
+        core = array.array('q', [now - 1000000000 + i * 7777777 for i in range(64)])
+        tl = array.array('q', [0] * 64)
+        upper = array.array('q', [0] * 64)
+        lower = array.array('q', [0] * 64)
+        back = array.array('q', [0] * 64)
+        self.assertEqual(self.tl.core2rem_into(core, tl, upper, lower), 64)
+        self.assertEqual(self.tl.rem2core_into(tl, back), 64)
+        for i in range(64):
+            self.assertLessEqual(lower[i], tl[i])
+            self.assertLessEqual(tl[i], upper[i])
+            self.assertLess(abs(back[i] - core[i]), 2)
+
+        # Buffers must be int64 and as long as the input
+        with self.assertRaises(TypeError):
+            self.tl.core2rem_into(array.array('i', [0] * 64), tl)
+        with self.assertRaises(ValueError):
+            self.tl.core2rem_into(core, array.array('q', [0] * 63))
+
+    def test_events(self):
+        while self.tl.read_events(16, 0):
+            pass
+        other = _qot.Timeline()
+        other.bind('py_timeline_other', 'app', 1, 1000, 1000)
+        try:
+            events = self.tl.read_events(4, 1000)
+            self.assertIn(_qot.EVENT_TIMELINE_CREATE, [e[0] for e in events])
+        finally:
+            other.close()
+
+    def test_close_while_in_use(self):
+        result = []
+
+        def wait():
+            result.append(self.tl.waituntil(self.tl.gettime()[0] + 300000000))
+
+        waiter = threading.Thread(target=wait)
+        waiter.start()
+        time.sleep(0.1)
+
+        # The handle stays usable while another thread waits on it, but is not released
+        self.tl.gettime()
+        with self.assertRaises(_qot.QoTError):
+            self.tl.unbind()
+        with self.assertRaises(_qot.QoTError):
+            self.tl.close()
+        waiter.join()
+        self.assertEqual(len(result), 1)
+        self.tl.close()
+        with self.assertRaises(_qot.QoTError):
+            self.tl.gettime()
+
+    def test_package(self):
+        with qot.Timeline('py_timeline_package') as tl:
+            core = numpy.arange(16, dtype=numpy.int64) * 1000 + time.time_ns()
+            t, upper, lower = tl.core_to_timeline(core)
+            self.assertTrue((lower <= t).all() and (t <= upper).all())
+            self.assertTrue((abs(tl.timeline_to_core(t) - core) < 2).all())
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <random>
+#include <gtest/gtest.h>
+
+#include "../api/cpp/qot_time.hpp"
+
+using namespace qot;
+using namespace qot::literals;
+
+// Constant schedules fold at compile time
+static constexpr TimeLength kPeriod = 10_ms;
+static constexpr TimeLength kGuard = 250_us;
+static constexpr TimePoint kStart = TimePoint::FromSec(100) + kGuard;
+static_assert((kStart + kPeriod * 3).ToUsec() == 100030250LL, "schedule");
+static_assert(5_asec + 1_sec == TimeLength(1, 5), "literal sum");
+static_assert(1_sec - 1_asec == TimeLength(0, aSEC_PER_SEC - 1), "borrow");
+static_assert(TimePoint::FromNsec(-1).sec == -1, "negative point");
+static_assert(UTimePoint(TimePoint::FromSec(1), 1_ms, 1_ms)
+    .Before(TimePoint::FromSec(1) + 2_ms), "uncertain comparison");
+
+TEST(TimelineTypes, MatchesCMacros) {
+    std::mt19937_64 rng(7);
+    for (int i = 0; i < 10000; i++) {
+        u64 v = rng() >> (rng() % 64);
+        s64 sv = (s64) (rng() >> (rng() % 64)) * ((rng() & 1) ? 1 : -1);
+        timelength_t tl;
+        timepoint_t tp;
+        TL_FROM_nSEC(tl, v);
+        TimeLength l = TimeLength::FromNsec(v);
+        EXPECT_EQ(l.sec, tl.sec);
+        EXPECT_EQ(l.asec, tl.asec);
+        u64 lns = TL_TO_nSEC(tl);
+        EXPECT_EQ(l.ToNsec(), lns);
+        TP_FROM_uSEC(tp, sv);
+        TimePoint p = TimePoint::FromUsec(sv);
+        EXPECT_EQ(p.sec, tp.sec);
+        EXPECT_EQ(p.asec, tp.asec);
+        s64 pus = TP_TO_uSEC(tp);
+        EXPECT_EQ(p.ToUsec(), pus);
+        timepoint_add(&tp, &tl);
+        TimePoint q = p + l;
+        EXPECT_EQ(q.sec, tp.sec);
+        EXPECT_EQ(q.asec, tp.asec);
+        EXPECT_EQ(q - l, p);
+        EXPECT_EQ(q - p, l);
+        EXPECT_EQ(p - q, l);
+    }
+}
+
+TEST(TimelineTypes, Scale) {
+    TimeLength l(3, aSEC_PER_SEC - 1);
+    TimeLength sum;
+    for (int i = 0; i < 1000; i++)
+        sum += l;
+    EXPECT_EQ(l * 1000u, sum);
+    EXPECT_EQ((1_asec * 0xffffffffu).ToAsec(), 0xffffffffULL);
+}
+
+TEST(TimelineTypes, CInterop) {
+    UTimePoint u(TimePoint::FromSec(-2), 100_asec, 100_asec);
+    UTimeLength d(1_sec, 300_asec, 300_asec);
+    utimepoint_t *c = &u;
+    utimepoint_add(c, &d);
+    EXPECT_EQ(UTimePoint(*c).Estimate(), TimePoint::FromSec(-1));
+    EXPECT_EQ(u.Below(), 400_asec);
+    EXPECT_EQ(u.Latest(), TimePoint::FromSec(-1) + 400_asec);
+    EXPECT_TRUE(Overlaps(u, UTimePoint(TimePoint::FromSec(-1) + 800_asec, 400_asec)));
+    EXPECT_FALSE(Overlaps(u, UTimePoint(TimePoint::FromSec(-1) + 801_asec, 400_asec)));
+}
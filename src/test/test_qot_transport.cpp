@@ -0,0 +1,741 @@
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+extern "C" {
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+}
+
+#include "../api/cpp/transport/Transport.hpp"
+#include "../api/cpp/transport/MsgPipeline.hpp"
+#include "../api/cpp/transport/LatencyStats.hpp"
+
+using namespace qot;
+
+// Collects what a transport delivers
+class Sink
+{
+    public:
+    TransportCallback callback()
+    {
+        return [this](const TransportHeader &header, const void *payload, size_t length) {
+            std::lock_guard<std::mutex> guard(lock);
+            names.push_back(header.name);
+            types.push_back(header.type);
+            estimates.push_back(TP_TO_nSEC(header.timestamp.estimate));
+            payloads.push_back(std::string((const char *) payload, length));
+            cv.notify_all();
+        };
+    }
+    bool wait(size_t count, int timeout_ms = 2000)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        return cv.wait_for(guard, std::chrono::milliseconds(timeout_ms),
+            [&]{ return payloads.size() >= count; });
+    }
+    std::mutex lock;
+    std::condition_variable cv;
+    std::vector<std::string> names;
+    std::vector<qot_msg_type_t> types;
+    std::vector<int64_t> estimates;
+    std::vector<std::string> payloads;
+};
+
+static TransportHeader make_header(const char *node, qot_msg_type_t type)
+{
+    TransportHeader header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.name, node, QOT_MAX_NAMELEN - 1);
+    header.type = type;
+    header.timestamp.estimate.sec = 12;
+    header.timestamp.estimate.asec = 345000000000ULL;
+    return header;
+}
+
+static TransportConfig make_config(const std::string &topic, const char *node)
+{
+    TransportConfig config;
+    config.timeline = "transport_test_" + std::to_string(getpid());
+    config.topic = topic;
+    config.node = node;
+    return config;
+}
+
+TEST(QoTTransport, ShmRoundTrip) {
+    TransportConfig config = make_config("roundtrip", "sub");
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+    std::unique_ptr<Transport> sub(CreateTransport(TRANSPORT_SHM, config));
+    config.node = "pub";
+    std::unique_ptr<Transport> pub(CreateTransport(TRANSPORT_SHM, config));
+    ASSERT_TRUE(sub && pub);
+
+    Sink sink;
+    ASSERT_EQ(sub->Subscribe(sink.callback()), QOT_RETURN_TYPE_OK);
+
+    // Payloads of every size from empty to a few cache lines, in order
+    TransportHeader header = make_header("pub", QOT_MSG_SENSOR_VAL);
+    for (int i = 0; i < 300; i++)
+    {
+        std::string payload(i, 'a' + i % 26);
+        ASSERT_EQ(pub->Publish(header, payload.data(), payload.size()), QOT_RETURN_TYPE_OK);
+    }
+    ASSERT_TRUE(sink.wait(300));
+    for (int i = 0; i < 300; i++)
+    {
+        EXPECT_EQ(sink.payloads[i], std::string(i, 'a' + i % 26));
+        EXPECT_EQ(sink.names[i], "pub");
+        EXPECT_EQ(sink.types[i], QOT_MSG_SENSOR_VAL);
+    }
+
+    TransportStats stats;
+    sub->GetStats(stats);
+    EXPECT_EQ(stats.received, 300u);
+    EXPECT_EQ(stats.lost, 0u);
+    sub.reset();
+    pub.reset();
+
+    // The last transport to close the channel removed the segment
+    EXPECT_NE(shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str()), 0);
+    EXPECT_EQ(errno, ENOENT);
+}
+
+TEST(QoTTransport, ShmFiltersOwnMessages) {
+    TransportConfig config = make_config("own", "node");
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+    config.receive_own = false;
+    std::unique_ptr<Transport> self(CreateTransport(TRANSPORT_SHM, config));
+    config.node = "other";
+    std::unique_ptr<Transport> other(CreateTransport(TRANSPORT_SHM, config));
+    ASSERT_TRUE(self && other);
+
+    Sink sink;
+    ASSERT_EQ(self->Subscribe(sink.callback()), QOT_RETURN_TYPE_OK);
+    TransportHeader mine = make_header("node", QOT_MSG_INVALID);
+    TransportHeader theirs = make_header("other", QOT_MSG_INVALID);
+    self->Publish(mine, "mine", 4);
+    other->Publish(theirs, "theirs", 6);
+    ASSERT_TRUE(sink.wait(1));
+    usleep(20000);
+    ASSERT_EQ(sink.payloads.size(), 1u);
+    EXPECT_EQ(sink.payloads[0], "theirs");
+    self.reset();
+    other.reset();
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+}
+
+TEST(QoTTransport, ShmReserveCommitWraps) {
+    TransportConfig config = make_config("wrap", "node");
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+    config.shm_bytes = 4096;
+    std::unique_ptr<Transport> sub(CreateTransport(TRANSPORT_SHM, config));
+    std::unique_ptr<Transport> pub(CreateTransport(TRANSPORT_SHM, config));
+    ASSERT_TRUE(sub && pub);
+    EXPECT_LT(pub->MaxPayload(), 1024u);
+
+    TransportBuffer buffer;
+    EXPECT_NE(pub->Reserve(pub->MaxPayload() + 1, buffer), QOT_RETURN_TYPE_OK);
+
+    // Publish in place, going round the small ring many times but waiting for
+    // each message so that nothing is overwritten before it is read
+    Sink sink;
+    ASSERT_EQ(sub->Subscribe(sink.callback()), QOT_RETURN_TYPE_OK);
+    TransportHeader header = make_header("node", QOT_MSG_INVALID);
+    for (int i = 0; i < 200; i++)
+    {
+        size_t length = 100 + (i * 37) % 400;
+        ASSERT_EQ(pub->Reserve(length, buffer), QOT_RETURN_TYPE_OK);
+        memset(buffer.data, 'A' + i % 26, length);
+        ASSERT_EQ(pub->Commit(header, buffer), QOT_RETURN_TYPE_OK);
+        ASSERT_TRUE(sink.wait(i + 1));
+        EXPECT_EQ(sink.payloads[i], std::string(length, 'A' + i % 26));
+    }
+    sub.reset();
+    pub.reset();
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+}
+
+TEST(QoTTransport, ShmSlowSubscriberLoses) {
+    TransportConfig config = make_config("lapped", "node");
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+    config.shm_bytes = 4096;
+    std::unique_ptr<Transport> sub(CreateTransport(TRANSPORT_SHM, config));
+    std::unique_ptr<Transport> pub(CreateTransport(TRANSPORT_SHM, config));
+    ASSERT_TRUE(sub && pub);
+
+    // Hold the receive thread in the first callback while the ring laps it
+    std::mutex gate;
+    std::atomic<int> delivered(0);
+    gate.lock();
+    ASSERT_EQ(sub->Subscribe([&](const TransportHeader &, const void *, size_t) {
+        if (delivered.fetch_add(1) == 0)
+            std::lock_guard<std::mutex> wait(gate);
+    }), QOT_RETURN_TYPE_OK);
+    TransportHeader header = make_header("node", QOT_MSG_INVALID);
+    char payload[192] = {0};
+    pub->Publish(header, payload, sizeof(payload));
+    while (delivered.load() == 0)
+        usleep(1000);
+    for (int i = 0; i < 100; i++)
+        pub->Publish(header, payload, sizeof(payload));
+    gate.unlock();
+    usleep(50000);
+
+    TransportStats stats;
+    sub->GetStats(stats);
+    EXPECT_GT(stats.lost, 0u);
+    EXPECT_LT(delivered.load(), 101);
+    sub.reset();
+    pub.reset();
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+}
+
+TEST(QoTTransport, UdpLoopback) {
+    TransportConfig config = make_config("udp", "sub");
+    config.udp_iface = "127.0.0.1";
+    config.udp_port = 47400 + getpid() % 1000;
+    std::unique_ptr<Transport> sub(CreateTransport(TRANSPORT_UDP, config));
+    config.node = "pub";
+    config.roles = TRANSPORT_ROLE_PUB;
+    std::unique_ptr<Transport> pub(CreateTransport(TRANSPORT_UDP, config));
+    ASSERT_TRUE(sub && pub);
+    EXPECT_NE(pub->Subscribe([](const TransportHeader &, const void *, size_t) {}), QOT_RETURN_TYPE_OK);
+
+    Sink sink;
+    ASSERT_EQ(sub->Subscribe(sink.callback()), QOT_RETURN_TYPE_OK);
+    std::vector<TransportHeader> headers(20, make_header("pub", QOT_MSG_COORD_START));
+    std::vector<std::string> payloads;
+    std::vector<const void *> data;
+    std::vector<size_t> lengths;
+    for (int i = 0; i < 20; i++)
+        payloads.push_back("udp message " + std::to_string(i));
+    TP_FROM_nSEC(headers[1].timestamp.estimate, -1500000001LL);
+    for (int i = 0; i < 20; i++)
+    {
+        data.push_back(payloads[i].data());
+        lengths.push_back(payloads[i].size());
+    }
+    ASSERT_EQ(pub->PublishBatch(headers.data(), data.data(), lengths.data(), 20), QOT_RETURN_TYPE_OK);
+    ASSERT_TRUE(sink.wait(20));
+    for (int i = 0; i < 20; i++)
+    {
+        EXPECT_EQ(sink.payloads[i], payloads[i]);
+        EXPECT_EQ(sink.names[i], "pub");
+        EXPECT_EQ(sink.types[i], QOT_MSG_COORD_START);
+    }
+
+    // Timeline times before the epoch survive the wire
+    EXPECT_EQ(sink.estimates[0], TP_TO_nSEC(headers[0].timestamp.estimate));
+    EXPECT_EQ(sink.estimates[1], -1500000001LL);
+
+    // Datagrams cannot be fragmented into several messages
+    std::vector<char> large(pub->MaxPayload() + 1);
+    EXPECT_NE(pub->Publish(headers[0], large.data(), large.size()), QOT_RETURN_TYPE_OK);
+}
+
+TEST(QoTTransport, BatchedOverShm) {
+    TransportConfig config = make_config("batched", "node");
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+    std::unique_ptr<Transport> sub(CreateTransport(TRANSPORT_SHM, config));
+    std::unique_ptr<Transport> pub(CreateTransport(TRANSPORT_SHM, config));
+    ASSERT_TRUE(sub && pub);
+
+    // Received messages go through the queue, as the messenger does
+    MessageQueue queue(64, 1000);
+    ASSERT_EQ(sub->Subscribe([&](const TransportHeader &header, const void *payload, size_t length) {
+        qot_message_t msg;
+        HeaderToMessage(header, payload, length, msg);
+        queue.Push(&msg, 1);
+    }), QOT_RETURN_TYPE_OK);
+
+    qot_message_t msg;
+    TransportHeader header;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = QOT_MSG_DATA;
+    {
+        MessageBatcher batcher(*pub);
+        ASSERT_EQ(batcher.Configure(8, 200000), QOT_RETURN_TYPE_OK);
+        for (int i = 0; i < 20; i++)
+        {
+            snprintf(msg.data, QOT_MAX_NAMELEN, "message %d", i);
+            MessageToHeader(msg, "node", header);
+            ASSERT_EQ(batcher.Publish(header, msg.data, strlen(msg.data)), QOT_RETURN_TYPE_OK);
+        }
+
+        // Two full batches went out, the last four wait for the flush interval
+        qot_message_t got[20];
+        size_t count = 0, n;
+        while (count < 16 && (n = queue.Pop(got + count, 20 - count, 1000)) > 0)
+            count += n;
+        ASSERT_EQ(count, 16u);
+        EXPECT_STREQ(got[0].data, "message 0");
+        EXPECT_STREQ(got[15].data, "message 15");
+        EXPECT_STREQ(got[15].name, "node");
+        EXPECT_EQ(got[15].type, QOT_MSG_DATA);
+        qot_msg_stats_t stats;
+        memset(&stats, 0, sizeof(stats));
+        batcher.GetStats(stats);
+        EXPECT_EQ(stats.published, 20u);
+        EXPECT_EQ(stats.batches, 2u);
+        ASSERT_EQ(batcher.Flush(), QOT_RETURN_TYPE_OK);
+        count = 0;
+        while (count < 4 && (n = queue.Pop(got + count, 20 - count, 1000)) > 0)
+            count += n;
+        EXPECT_EQ(count, 4u);
+        EXPECT_EQ(queue.Pop(got, 20, 10), 0u);
+        batcher.GetStats(stats);
+        EXPECT_EQ(stats.batches, 3u);
+        EXPECT_EQ(stats.timed_flushes, 0u);
+    }
+    sub.reset();
+    pub.reset();
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+}
+
+TEST(QoTTransport, QueueCarriesStamps) {
+    // Stamps ride with queued messages so latency is measured when they are taken
+    MessageQueue queue(8, 1000);
+    qot_message_t msgs[2], got[4];
+    memset(msgs, 0, sizeof(msgs));
+    snprintf(msgs[0].data, QOT_MAX_NAMELEN, "first");
+    snprintf(msgs[1].data, QOT_MAX_NAMELEN, "second");
+    MessageStamps stamps[2] = { { 100, 150, 7 }, { 200, 250, 9 } };
+    queue.Push(msgs, 2, stamps);
+    queue.Push(msgs, 1);
+
+    MessageStamps taken[4];
+    memset(taken, 0xff, sizeof(taken));
+    ASSERT_EQ(queue.Pop(got, 4, 100, taken), 3u);
+    EXPECT_STREQ(got[1].data, "second");
+    EXPECT_EQ(taken[0].published_ns, 100);
+    EXPECT_EQ(taken[1].handoff_ns, 250);
+    EXPECT_EQ(taken[1].stamp_unc_ns, 9);
+    EXPECT_EQ(taken[2].published_ns, 0);
+    EXPECT_EQ(taken[2].handoff_ns, 0);
+
+    // Taking without stamps still drains the queue
+    queue.Push(msgs, 2, stamps);
+    EXPECT_EQ(queue.Pop(got, 4, 100), 2u);
+}
+
+TEST(QoTTransport, QueueWrapsAndDrops) {
+    MessageQueue queue(4, 1000);
+    qot_message_t msgs[6], got[6];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < 6; i++)
+        snprintf(msgs[i].data, QOT_MAX_NAMELEN, "message %d", i);
+
+    // Messages come out in order across many laps of the ring
+    for (int lap = 0; lap < 10; lap++)
+    {
+        queue.Push(msgs, 3);
+        ASSERT_EQ(queue.Pop(got, 6, 0), 3u);
+        EXPECT_STREQ(got[0].data, "message 0");
+        EXPECT_STREQ(got[2].data, "message 2");
+    }
+
+    // A full queue waits block_us for room, then drops the rest of the burst
+    queue.Push(msgs, 6);
+    qot_msg_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    queue.GetStats(stats);
+    EXPECT_EQ(stats.received, 36u);
+    EXPECT_EQ(stats.dropped, 2u);
+    EXPECT_EQ(stats.stalls, 1u);
+    EXPECT_EQ(stats.depth, 4u);
+    EXPECT_EQ(stats.max_depth, 4u);
+    ASSERT_EQ(queue.Pop(got, 6, 0), 4u);
+    EXPECT_STREQ(got[3].data, "message 3");
+
+    // An empty queue times out, and a sleeping consumer is woken by a push
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(queue.Pop(got, 6, 20), 0u);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+    std::thread producer([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        queue.Push(msgs + 5, 1);
+    });
+    ASSERT_EQ(queue.Pop(got, 6, -1), 1u);
+    EXPECT_STREQ(got[0].data, "message 5");
+    producer.join();
+    queue.GetStats(stats);
+    EXPECT_EQ(stats.delivered, 35u);
+}
+
+// Transport recording the batches a batcher hands it
+class BatchSink : public Transport
+{
+    public:
+    BatchSink() : budget_us(0) {}
+    qot_return_t Publish(const TransportHeader &header, const void *payload, size_t length)
+    {
+        return PublishBatch(&header, &payload, &length, 1);
+    }
+    qot_return_t PublishBatch(const TransportHeader *, const void *const *payloads,
+        const size_t *lengths, size_t count)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        sizes.push_back(count);
+        for (size_t i = 0; i < count; i++)
+            data.push_back(std::string((const char *) payloads[i], lengths[i]));
+        cv.notify_all();
+        return QOT_RETURN_TYPE_OK;
+    }
+    qot_return_t Subscribe(TransportCallback) { return QOT_RETURN_TYPE_ERR; }
+    void SetLatencyBudget(uint32_t budget_us) { this->budget_us = budget_us; }
+    size_t MaxPayload() { return 1024; }
+    void GetStats(TransportStats &stats) { memset(&stats, 0, sizeof(stats)); }
+    bool wait(size_t count, int timeout_ms = 2000)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        return cv.wait_for(guard, std::chrono::milliseconds(timeout_ms),
+            [&]{ return data.size() >= count; });
+    }
+    std::mutex lock;
+    std::condition_variable cv;
+    std::vector<size_t> sizes;
+    std::vector<std::string> data;
+    uint32_t budget_us;
+};
+
+TEST(QoTTransport, BatcherSizesAndFlushes) {
+    BatchSink sink;
+    TransportHeader header = make_header("pub", QOT_MSG_DATA);
+    qot_msg_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    {
+        MessageBatcher batcher(sink);
+
+        // Unbatched messages go straight through, without a latency budget
+        ASSERT_EQ(batcher.Configure(1, 0), QOT_RETURN_TYPE_OK);
+        EXPECT_EQ(sink.budget_us, 0u);
+        ASSERT_EQ(batcher.Publish(header, "a", 1), QOT_RETURN_TYPE_OK);
+        ASSERT_EQ(sink.sizes.size(), 1u);
+
+        // Full batches are sent by the publisher, a partial one once flush_us has passed
+        ASSERT_EQ(batcher.Configure(4, 200000), QOT_RETURN_TYPE_OK);
+        EXPECT_EQ(sink.budget_us, 200000u);
+        for (int i = 0; i < 10; i++)
+        {
+            std::string payload(1, 'b' + i);
+            ASSERT_EQ(batcher.Publish(header, payload.data(), payload.size()), QOT_RETURN_TYPE_OK);
+        }
+        ASSERT_TRUE(sink.wait(11));
+        ASSERT_EQ(sink.sizes.size(), 4u);
+        EXPECT_EQ(sink.sizes[1], 4u);
+        EXPECT_EQ(sink.sizes[2], 4u);
+        EXPECT_EQ(sink.sizes[3], 2u);
+        for (int i = 0; i < 11; i++)
+            EXPECT_EQ(sink.data[i], std::string(1, 'a' + i));
+        batcher.GetStats(stats);
+        EXPECT_EQ(stats.published, 11u);
+        EXPECT_EQ(stats.batches, 4u);
+        EXPECT_EQ(stats.timed_flushes, 1u);
+
+        // Oversized batches are refused, and what is pending goes out with the batcher
+        EXPECT_EQ(batcher.Configure(QOT_MSG_MAX_BATCH_SIZE + 1, 0), QOT_RETURN_TYPE_ERR);
+        ASSERT_EQ(batcher.Configure(8, 1000000), QOT_RETURN_TYPE_OK);
+        ASSERT_EQ(batcher.Publish(header, "z", 1), QOT_RETURN_TYPE_OK);
+        EXPECT_EQ(sink.data.size(), 11u);
+    }
+    ASSERT_EQ(sink.data.size(), 12u);
+    EXPECT_EQ(sink.data[11], "z");
+}
+
+// Timeline clock the tests move by hand, and a sink collecting released messages
+struct OrderedSink
+{
+    OrderedSink() : now_ns(10 * nSEC_PER_SEC), broken(false) {}
+    MessageReorderer::Clock clock()
+    {
+        return [this](utimepoint_t &now) {
+            if (broken)
+                return QOT_RETURN_TYPE_ERR;
+            memset(&now, 0, sizeof(now));
+            TP_FROM_nSEC(now.estimate, (int64_t) now_ns.load());
+            return QOT_RETURN_TYPE_OK;
+        };
+    }
+    MessageReorderer::Sink sink()
+    {
+        return [this](const TransportHeader &, const qot_message_t &msg) {
+            std::lock_guard<std::mutex> guard(lock);
+            data.push_back(msg.data);
+            cv.notify_all();
+        };
+    }
+    bool wait(size_t count, int timeout_ms = 2000)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        return cv.wait_for(guard, std::chrono::milliseconds(timeout_ms),
+            [&]{ return data.size() >= count; });
+    }
+    void push(MessageReorderer &reorderer, int64_t age_ns, const char *data)
+    {
+        TransportHeader header = make_header("pub", QOT_MSG_DATA);
+        TP_FROM_nSEC(header.timestamp.estimate, (int64_t) now_ns.load() - age_ns);
+        reorderer.Push(header, data, strlen(data));
+    }
+    void push_stamped(MessageReorderer &reorderer, int64_t age_ns, const char *data)
+    {
+        // Published age_ns ago, timestamped with an action time well ahead
+        TransportHeader header = make_header("pub", QOT_MSG_DATA);
+        TP_FROM_nSEC(header.timestamp.estimate, (int64_t) now_ns.load() + 10 * nSEC_PER_SEC);
+        header.published_ns = (int64_t) now_ns.load() - age_ns;
+        header.handoff_ns = header.published_ns;
+        reorderer.Push(header, data, strlen(data));
+    }
+    std::atomic<uint64_t> now_ns;
+    std::atomic<bool> broken;
+    std::mutex lock;
+    std::condition_variable cv;
+    std::vector<std::string> data;
+};
+
+TEST(QoTTransport, ReorderByTimestamp) {
+    OrderedSink out;
+    MessageReorderer reorderer(out.clock(), out.sink());
+    ASSERT_EQ(reorderer.Configure(1000000, 0, 0), QOT_RETURN_TYPE_OK);
+
+    // Three messages a few milliseconds old arrive out of order and are all held
+    out.push(reorderer, 3000000, "first");
+    out.push(reorderer, 1000000, "third");
+    out.push(reorderer, 2000000, "second");
+    EXPECT_FALSE(out.wait(1, 50));
+
+    // Once the timeline passes the hold horizon they come out in timestamp order
+    out.now_ns += nSEC_PER_SEC;
+    ASSERT_TRUE(out.wait(3));
+    EXPECT_EQ(out.data[0], "first");
+    EXPECT_EQ(out.data[1], "second");
+    EXPECT_EQ(out.data[2], "third");
+
+    // A message stamped before one already delivered can no longer be put in order
+    out.push(reorderer, nSEC_PER_SEC + 1500000, "late");
+    qot_msg_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    reorderer.GetStats(stats);
+    EXPECT_EQ(stats.reordered, 1u);
+    EXPECT_EQ(stats.late, 1u);
+    EXPECT_EQ(stats.max_reorder_depth, 3u);
+    EXPECT_EQ(stats.reorder_depth, 0u);
+    EXPECT_EQ(out.data.size(), 3u);
+}
+
+TEST(QoTTransport, ReorderDeadlineAndDepth) {
+    OrderedSink out;
+    MessageReorderer reorderer(out.clock(), out.sink());
+
+    // Without a hold messages pass straight through, unless past the deadline
+    ASSERT_EQ(reorderer.Configure(0, 0, 1000000), QOT_RETURN_TYPE_OK);
+    out.push(reorderer, 2000000, "expired");
+    out.push(reorderer, 500000, "fresh");
+    ASSERT_TRUE(out.wait(1));
+    EXPECT_EQ(out.data[0], "fresh");
+
+    // A full hold releases its earliest message at once
+    ASSERT_EQ(reorderer.Configure(1000000, 2, 0), QOT_RETURN_TYPE_OK);
+    out.push(reorderer, 3000, "b");
+    out.push(reorderer, 1000, "c");
+    out.push(reorderer, 5000, "a");
+    ASSERT_TRUE(out.wait(2));
+    EXPECT_EQ(out.data[1], "a");
+    reorderer.Flush();
+    ASSERT_EQ(out.data.size(), 4u);
+    EXPECT_EQ(out.data[2], "b");
+    EXPECT_EQ(out.data[3], "c");
+
+    qot_msg_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    reorderer.GetStats(stats);
+    EXPECT_EQ(stats.expired, 1u);
+    EXPECT_EQ(stats.max_reorder_depth, 2u);
+}
+
+TEST(QoTTransport, ReorderFutureTimestamps) {
+    OrderedSink out;
+    MessageReorderer reorderer(out.clock(), out.sink());
+    ASSERT_EQ(reorderer.Configure(1000000, 0, 0), QOT_RETURN_TYPE_OK);
+
+    // An unstamped message naming a future action time is not held until then
+    out.push(reorderer, -(int64_t) nSEC_PER_SEC, "start");
+    ASSERT_TRUE(out.wait(1, 50));
+    EXPECT_EQ(out.data[0], "start");
+
+    // Stamped messages are ordered by when they were published, not by their timestamp
+    out.push_stamped(reorderer, 3000000, "first");
+    out.push_stamped(reorderer, 1000000, "third");
+    out.push_stamped(reorderer, 2000000, "second");
+    EXPECT_FALSE(out.wait(2, 50));
+    out.now_ns += 20000000;
+    ASSERT_TRUE(out.wait(4));
+    EXPECT_EQ(out.data[1], "first");
+    EXPECT_EQ(out.data[2], "second");
+    EXPECT_EQ(out.data[3], "third");
+
+    // A held message which passes the deadline meanwhile is dropped on release
+    ASSERT_EQ(reorderer.Configure(1000000, 0, 5000000), QOT_RETURN_TYPE_OK);
+    out.push_stamped(reorderer, 3000000, "stale");
+    out.now_ns += 20000000;
+    out.push_stamped(reorderer, 0, "fresh");
+    reorderer.Flush();
+    ASSERT_EQ(out.data.size(), 5u);
+    EXPECT_EQ(out.data[4], "fresh");
+    qot_msg_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    reorderer.GetStats(stats);
+    EXPECT_EQ(stats.expired, 1u);
+    EXPECT_EQ(stats.late, 0u);
+
+    // Without the time messages are still held, and released after the longest hold
+    ASSERT_EQ(reorderer.Configure(20000, 0, 0), QOT_RETURN_TYPE_OK);
+    out.broken = true;
+    out.push_stamped(reorderer, 0, "untimed");
+    EXPECT_FALSE(out.wait(6, 5));
+    ASSERT_TRUE(out.wait(6));
+    EXPECT_EQ(out.data[5], "untimed");
+}
+
+TEST(QoTTransport, LatencyHistogramPercentiles) {
+    LatencyHistogram histogram;
+    for (int64_t v = 1; v <= 100000; v++)
+        histogram.Record(v);
+    histogram.Record(-5);
+    EXPECT_EQ(histogram.Count(), 100001u);
+    EXPECT_EQ(histogram.Min(), 0);
+    EXPECT_EQ(histogram.Max(), 100000);
+
+    // Percentiles are within a bucket (1/32) of the exact value
+    EXPECT_NEAR(histogram.Percentile(50), 50000, 50000 / 32);
+    EXPECT_NEAR(histogram.Percentile(99), 99000, 99000 / 32);
+    EXPECT_EQ(histogram.Percentile(100), 100000);
+
+    // Small values are kept exactly, and histograms merge bucket by bucket
+    LatencyHistogram small;
+    for (int i = 0; i < 10; i++)
+        small.Record(i < 9 ? 40 : 63);
+    EXPECT_EQ(small.Percentile(90), 40);
+    EXPECT_EQ(small.Percentile(100), 63);
+    small.Merge(histogram);
+    EXPECT_EQ(small.Count(), 100011u);
+    EXPECT_EQ(small.Max(), 100000);
+}
+
+TEST(QoTTransport, LatencyPerTopicAndPeer) {
+    LatencyMonitor monitor;
+    utimepoint_t now;
+    memset(&now, 0, sizeof(now));
+    TP_FROM_nSEC(now.estimate, 10 * (int64_t) nSEC_PER_SEC);
+    TL_FROM_nSEC(now.interval.above, 1000);
+    TL_FROM_nSEC(now.interval.below, 1000);
+
+    // Two peers, one slower than the other, and an unstamped message which is skipped
+    TransportHeader header = make_header("fast", QOT_MSG_DATA);
+    for (int i = 0; i < 100; i++)
+    {
+        header.published_ns = 10 * (int64_t) nSEC_PER_SEC - 50000;
+        header.handoff_ns = header.published_ns + 10000;
+        header.stamp_unc_ns = 3000;
+        monitor.Record("data", header, now);
+    }
+    header = make_header("slow", QOT_MSG_DATA);
+    header.published_ns = 10 * (int64_t) nSEC_PER_SEC - 2000000;
+    monitor.Record("data", header, now);
+    monitor.Record("sensor_val", header, now);
+    header.published_ns = 0;
+    monitor.Record("data", header, now);
+
+    qot_latency_stats_t stats;
+    ASSERT_TRUE(monitor.Query("data", "fast", stats));
+    EXPECT_EQ(stats.samples, 100u);
+    EXPECT_NEAR(stats.p50_ns, 50000, 50000 / 32);
+    EXPECT_NEAR(stats.transport_p50_ns, 40000, 40000 / 32);
+    EXPECT_EQ(stats.batching_mean_ns, 10000);
+    EXPECT_EQ(stats.uncertainty_max_ns, 5000);
+    ASSERT_TRUE(monitor.Query(NULL, "slow", stats));
+    EXPECT_EQ(stats.samples, 2u);
+    EXPECT_NEAR(stats.min_ns, 2000000, 2000000 / 32);
+    ASSERT_TRUE(monitor.Query("data", NULL, stats));
+    EXPECT_EQ(stats.samples, 101u);
+    EXPECT_EQ(stats.max_ns, 2000000);
+    EXPECT_FALSE(monitor.Query("coord_start", NULL, stats));
+
+    // The dump has a summary and a distribution per topic and peer
+    std::string path = "/tmp/qot_latency_test_" + std::to_string(getpid());
+    ASSERT_EQ(monitor.Dump(path.c_str()), QOT_RETURN_TYPE_OK);
+    std::ifstream dump(path);
+    std::string line;
+    int summaries = 0;
+    while (std::getline(dump, line))
+        summaries += (line.compare(0, 8, "# topic ") == 0);
+    EXPECT_EQ(summaries, 3);
+    remove(path.c_str());
+    monitor.Reset();
+    EXPECT_FALSE(monitor.Query(NULL, NULL, stats));
+}
+
+TEST(QoTTransport, StampsCrossTheTransport) {
+    TransportConfig config = make_config("stamps", "sub");
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+    std::unique_ptr<Transport> sub(CreateTransport(TRANSPORT_SHM, config));
+    config.node = "pub";
+    std::unique_ptr<Transport> pub(CreateTransport(TRANSPORT_SHM, config));
+    ASSERT_TRUE(sub && pub);
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::vector<TransportHeader> got;
+    ASSERT_EQ(sub->Subscribe([&](const TransportHeader &header, const void *, size_t) {
+        std::lock_guard<std::mutex> guard(lock);
+        got.push_back(header);
+        cv.notify_all();
+    }), QOT_RETURN_TYPE_OK);
+
+    // The batcher stamps at publish and once per batch at handoff
+    std::atomic<int64_t> now_ns(5 * (int64_t) nSEC_PER_SEC);
+    {
+        MessageBatcher batcher(*pub);
+        batcher.SetClock([&](utimepoint_t &now) {
+            memset(&now, 0, sizeof(now));
+            TP_FROM_nSEC(now.estimate, (int64_t) now_ns.load());
+            TL_FROM_nSEC(now.interval.above, 100);
+            TL_FROM_nSEC(now.interval.below, 200);
+            return QOT_RETURN_TYPE_OK;
+        });
+        ASSERT_EQ(batcher.Configure(2, 200000), QOT_RETURN_TYPE_OK);
+        TransportHeader header = make_header("pub", QOT_MSG_DATA);
+        ASSERT_EQ(batcher.Publish(header, "a", 1), QOT_RETURN_TYPE_OK);
+        now_ns += 7000;
+        ASSERT_EQ(batcher.Publish(header, "b", 1), QOT_RETURN_TYPE_OK);
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    ASSERT_TRUE(cv.wait_for(guard, std::chrono::seconds(2), [&]{ return got.size() >= 2; }));
+    EXPECT_EQ(got[0].published_ns, 5 * (int64_t) nSEC_PER_SEC);
+    EXPECT_EQ(got[0].handoff_ns, 5 * (int64_t) nSEC_PER_SEC + 7000);
+    EXPECT_EQ(got[1].published_ns, got[1].handoff_ns);
+    EXPECT_EQ(got[0].stamp_unc_ns, 300);
+    guard.unlock();
+    sub.reset();
+    pub.reset();
+    shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+}
+
+TEST(QoTTransport, ResolveFromEnvironment) {
+    unsetenv("QOT_TRANSPORT");
+    EXPECT_EQ(ResolveTransport(TRANSPORT_DEFAULT), TRANSPORT_DDS);
+    setenv("QOT_TRANSPORT", "shm", 1);
+    EXPECT_EQ(ResolveTransport(TRANSPORT_DEFAULT), TRANSPORT_SHM);
+    EXPECT_EQ(ResolveTransport(TRANSPORT_UDP), TRANSPORT_UDP);
+    unsetenv("QOT_TRANSPORT");
+    EXPECT_EQ(CreateTransport(TRANSPORT_DDS, TransportConfig()), (Transport *) NULL);
+}
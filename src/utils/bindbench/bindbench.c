@@ -0,0 +1,208 @@
+/*
+ * @file bindbench.c
+ * @brief Bind latency, descriptors and resident memory per bound timeline
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Include the QoT API
+#include "../../api/c/qot.h"
+
+// Basic configuration
+#define TIMELINE_UUID    "my_test_timeline"
+#define APPLICATION_NAME "bindbench"
+
+static s64 monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (s64) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Resident set size of this process in KiB */
+static long rss_kb(void)
+{
+    char line[128];
+    long kb = -1;
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "VmRSS: %ld kB", &kb) == 1)
+            break;
+    fclose(f);
+    return kb;
+}
+
+/* Number of open descriptors of this process */
+static int open_fds(void)
+{
+    struct dirent *entry;
+    int count = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir)
+        return -1;
+    while ((entry = readdir(dir)))
+        if (entry->d_name[0] != '.')
+            count++;
+    closedir(dir);
+    return count - 1;  // The directory stream itself
+}
+
+static int cmp_s64(const void *a, const void *b)
+{
+    s64 x = *(const s64 *) a, y = *(const s64 *) b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, s64 *samples, int count)
+{
+    s64 sum = 0;
+    int i;
+    if (count <= 0)
+        return;
+    qsort(samples, count, sizeof(s64), cmp_s64);
+    for (i = 0; i < count; i++)
+        sum += samples[i];
+    printf("%-20s %8d %10lld %10lld %10lld %10lld %10lld\n", name, count,
+        (long long) samples[0], (long long) (sum / count),
+        (long long) samples[count / 2], (long long) samples[(count * 99) / 100],
+        (long long) samples[count - 1]);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t uuid] [-b bindings] [-c cycles]\n", prog);
+    fprintf(stderr, "  -b  timelines (uuid_0, uuid_1, ...) bound at the same time\n");
+    fprintf(stderr, "  -c  bind/unbind cycles of a short-lived worker\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *uuid = TIMELINE_UUID;
+    int bindings = 16, cycles = 1000;
+    timeline_t **timelines, *worker;
+    timelength_t resolution;
+    timeinterval_t accuracy;
+    char tl_uuid[QOT_MAX_NAMELEN];
+    s64 *bind_ns, *unbind_ns, *cycle_ns, t0;
+    long rss_before, rss_after;
+    int fds_before, fds_after, i, opt;
+
+    while ((opt = getopt(argc, argv, "t:b:c:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': uuid = optarg; break;
+        case 'b': bindings = atoi(optarg); break;
+        case 'c': cycles = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (bindings <= 0 || cycles < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    timelines = (timeline_t **) calloc(bindings, sizeof(timeline_t *));
+    bind_ns = (s64 *) calloc(bindings, sizeof(s64));
+    unbind_ns = (s64 *) calloc(bindings, sizeof(s64));
+    cycle_ns = (s64 *) calloc(cycles + 1, sizeof(s64));
+    if (!timelines || !bind_ns || !unbind_ns || !cycle_ns)
+        return 1;
+
+    TL_FROM_nSEC(resolution, 1);
+    TL_FROM_uSEC(accuracy.below, 1);
+    TL_FROM_uSEC(accuracy.above, 1);
+
+    // Many timelines bound at once (one binding per thread and timeline is
+    // allowed): latency and the footprint of each one
+    rss_before = rss_kb();
+    fds_before = open_fds();
+    for (i = 0; i < bindings; i++)
+    {
+        snprintf(tl_uuid, sizeof(tl_uuid), "%s_%d", uuid, i);
+        timelines[i] = timeline_t_create();
+        t0 = monotonic_ns();
+        if (!timelines[i] || timeline_bind(timelines[i], tl_uuid, APPLICATION_NAME, resolution, accuracy))
+        {
+            fprintf(stderr, "Failed to bind to timeline %s\n", tl_uuid);
+            return 1;
+        }
+        bind_ns[i] = monotonic_ns() - t0;
+    }
+    rss_after = rss_kb();
+    fds_after = open_fds();
+    for (i = 0; i < bindings; i++)
+    {
+        t0 = monotonic_ns();
+        timeline_unbind(timelines[i]);
+        unbind_ns[i] = monotonic_ns() - t0;
+        timeline_t_destroy(timelines[i]);
+    }
+
+    // A short-lived worker: create, bind, read the time once, unbind
+    for (i = 0; i < cycles; i++)
+    {
+        utimepoint_t now;
+        t0 = monotonic_ns();
+        worker = timeline_t_create();
+        if (!worker || timeline_bind(worker, uuid, APPLICATION_NAME, resolution, accuracy))
+        {
+            fprintf(stderr, "Failed to bind worker %d to %s\n", i, uuid);
+            return 1;
+        }
+        timeline_gettime(worker, &now);
+        timeline_unbind(worker);
+        timeline_t_destroy(worker);
+        cycle_ns[i] = monotonic_ns() - t0;
+    }
+
+    printf("%-20s %8s %10s %10s %10s %10s %10s\n", "ns", "samples",
+        "min", "avg", "p50", "p99", "max");
+    report("bind", bind_ns, bindings);
+    report("unbind", unbind_ns, bindings);
+    report("worker cycle", cycle_ns, cycles);
+    printf("per bound timeline: %.1f descriptors, %.1f KiB resident\n",
+        (double) (fds_after - fds_before) / bindings,
+        (double) (rss_after - rss_before) / bindings);
+
+    free(timelines);
+    free(bind_ns);
+    free(unbind_ns);
+    free(cycle_ns);
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * @file brokerbench.cpp
+ * @brief Cost of mirroring thousands of broker topics into the znode tree
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Znode mirroring of the edge broker, against the in-process ZooKeeper stand-in
+#include "../../service/broker/zk_mirror.h"
+#include "../../service/broker/zk_standin.h"
+
+#define TIMELINE_UUID "my_test_timeline"
+#define BROKER_GROUP  "brokerbench"
+
+static int64_t monotonic_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n topics] [-p endpoints] [-b batch] [-d delay]\n", prog);
+    fprintf(stderr, "  -n  global topics on the timeline\n");
+    fprintf(stderr, "  -p  publishers and subscribers per topic\n");
+    fprintf(stderr, "  -b  updates per transaction, 1 sends every znode on its own\n");
+    fprintf(stderr, "  -d  simulated round trip to the ensemble in microseconds\n");
+}
+
+// Mirrors the updates the broker makes as topics, publishers and subscribers come and go
+class Run
+{
+public:
+    Run(int batch, unsigned int delay_us)
+    {
+        struct zk_backend backend;
+        zk_standin_init(&zk, delay_us);
+        zk_standin_backend(&zk, &backend);
+        zk_mirror_init(&mirror, &backend, batch);
+        zk_standin_create(&zk, "/timelines");
+    }
+
+    ~Run()
+    {
+        zk_mirror_destroy(&mirror);
+        zk_standin_destroy(&zk);
+    }
+
+    // Queue the updates of one phase for every topic, then flush them as the broker does
+    template <typename Phase>
+    void Measure(const char *name, size_t topics, Phase phase)
+    {
+        struct zk_mirror_stats before, after;
+        unsigned long long transactions = zk.transactions;
+        zk_mirror_get_stats(&mirror, &before);
+        int64_t start = monotonic_ns();
+        for (size_t i = 0; i < topics; i++)
+            phase(std::string("/timelines/" TIMELINE_UUID "/gl_topic_") + std::to_string(i));
+        int failed = zk_mirror_flush(&mirror);
+        int64_t elapsed = monotonic_ns() - start;
+        zk_mirror_get_stats(&mirror, &after);
+        printf("%-12s %10llu %10llu %12llu %10.1f %12.0f %6d\n", name, after.queued - before.queued,
+            after.cached - before.cached, zk.transactions - transactions, elapsed / 1e6,
+            (after.queued - before.queued + after.cached - before.cached) * 1e9 / elapsed, failed);
+    }
+
+    struct zk_standin zk;
+    struct zk_mirror mirror;
+};
+
+int main(int argc, char **argv)
+{
+    size_t topics = 5000, endpoints = 1;
+    int batch = ZK_BATCH_DEFAULT;
+    unsigned int delay_us = 100;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:b:d:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': topics = strtoul(optarg, NULL, 0); break;
+        case 'p': endpoints = strtoul(optarg, NULL, 0); break;
+        case 'b': batch = atoi(optarg); break;
+        case 'd': delay_us = strtoul(optarg, NULL, 0); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (topics == 0 || batch <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Run run(batch, delay_us);
+    const int length = sizeof(BROKER_GROUP);
+    printf("%zu topics, %zu publishers and subscribers each, batch %d, %u us round trip\n", topics, endpoints,
+        batch, delay_us);
+    printf("%-12s %10s %10s %12s %10s %12s %6s\n", "phase", "queued", "cached", "transactions", "ms",
+        "updates/s", "failed");
+
+    // Timeline and topic znodes, with the parents of their publishers and subscribers
+    run.Measure("topics", topics, [&](const std::string &topic) {
+        zk_mirror_create(&run.mirror, "/timelines/" TIMELINE_UUID, NULL, 0, 0);
+        zk_mirror_create(&run.mirror, topic.c_str(), NULL, 0, 0);
+        zk_mirror_create(&run.mirror, (topic + "/publishers").c_str(), NULL, 0, 0);
+        zk_mirror_create(&run.mirror, (topic + "/subscribers").c_str(), NULL, 0, 0);
+    });
+
+    // Ephemeral znodes of the endpoints
+    run.Measure("endpoints", topics, [&](const std::string &topic) {
+        for (size_t i = 0; i < endpoints; i++)
+        {
+            std::string id = std::to_string(i);
+            zk_mirror_create(&run.mirror, (topic + "/publishers/" + id).c_str(), BROKER_GROUP, length,
+                ZK_FLAG_EPHEMERAL);
+            zk_mirror_create(&run.mirror, (topic + "/subscribers/" + id).c_str(), BROKER_GROUP, length,
+                ZK_FLAG_EPHEMERAL);
+        }
+    });
+
+    // Endpoints joining topics that are already registered
+    run.Measure("rediscover", topics, [&](const std::string &topic) {
+        zk_mirror_create(&run.mirror, "/timelines/" TIMELINE_UUID, NULL, 0, 0);
+        zk_mirror_create(&run.mirror, topic.c_str(), NULL, 0, 0);
+        zk_mirror_create(&run.mirror, (topic + "/publishers").c_str(), NULL, 0, 0);
+        zk_mirror_create(&run.mirror, (topic + "/subscribers").c_str(), NULL, 0, 0);
+    });
+
+    // Topics torn down with their endpoints
+    run.Measure("teardown", topics, [&](const std::string &topic) {
+        for (size_t i = 0; i < endpoints; i++)
+        {
+            std::string id = std::to_string(i);
+            zk_mirror_delete(&run.mirror, (topic + "/publishers/" + id).c_str());
+            zk_mirror_delete(&run.mirror, (topic + "/subscribers/" + id).c_str());
+        }
+        zk_mirror_delete(&run.mirror, (topic + "/publishers").c_str());
+        zk_mirror_delete(&run.mirror, (topic + "/subscribers").c_str());
+        zk_mirror_delete(&run.mirror, topic.c_str());
+    });
+
+    // Diffing the children of a topic-sized directory against its previous listing
+    std::vector<std::string> names;
+    std::vector<char *> now, before, diff(topics);
+    for (size_t i = 0; i < topics; i++)
+        names.push_back("gl_topic_" + std::to_string((i * 7919) % topics));
+    for (size_t i = 0; i < topics; i++)
+    {
+        now.push_back(&names[i][0]);
+        if (i % 10)
+            before.push_back(&names[i][0]);
+    }
+    int64_t start = monotonic_ns();
+    zk_children_sort(now.data(), now.size());
+    zk_children_sort(before.data(), before.size());
+    int added = zk_children_diff(now.data(), now.size(), before.data(), before.size(), diff.data());
+    printf("diff of %zu children: %d added in %.3f ms\n", topics, added, (monotonic_ns() - start) / 1e6);
+
+    printf("%zu znodes left in the stand-in\n", zk_standin_size(&run.zk));
+    return 0;
+}
@@ -0,0 +1,253 @@
+/*
+ * @file msgbench.cpp
+ * @brief Throughput and latency of the shared-memory and UDP message transports
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Message transports
+#include "../../api/cpp/transport/Transport.hpp"
+#include "../../api/cpp/transport/MsgPipeline.hpp"
+
+// Basic configuration
+#define TIMELINE_UUID    "my_test_timeline"
+#define APPLICATION_NAME "msgbench"
+#define TOPIC_NAME       "msgbench"
+
+using namespace qot;
+
+// Wall-clock time, so that latencies can be measured between processes
+static int64_t realtime_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void report(const char *name, std::vector<int64_t> &samples)
+{
+    int64_t sum = 0;
+    size_t count = samples.size();
+    if (count == 0)
+        return;
+    std::sort(samples.begin(), samples.end());
+    for (size_t i = 0; i < count; i++)
+        sum += samples[i];
+    printf("%-20s %8zu %10lld %10lld %10lld %10lld %10lld %10lld\n", name, count,
+        (long long) samples[0], (long long) (sum / (int64_t) count),
+        (long long) samples[count / 2], (long long) samples[(count * 99) / 100],
+        (long long) samples[(count * 999) / 1000], (long long) samples[count - 1]);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-x shm|udp] [-m both|pub|sub] [-n messages] [-s bytes] [-r rate] [-b batch] [-z] [-i iface] [-t uuid]\n", prog);
+    fprintf(stderr, "  -m  publish and subscribe in this process, or only one side (run the other elsewhere)\n");
+    fprintf(stderr, "  -s  payload size, at least 8 bytes (the send time travels in the payload)\n");
+    fprintf(stderr, "  -r  messages per second, 0 publishes as fast as possible\n");
+    fprintf(stderr, "  -b  messages sent together (through the message batcher)\n");
+    fprintf(stderr, "  -z  write payloads in place with reserve/commit (shm)\n");
+    fprintf(stderr, "  -i  address of the interface to multicast on (udp)\n");
+}
+
+int main(int argc, char **argv)
+{
+    std::string transport_name = "shm", mode = "both", uuid = TIMELINE_UUID;
+    size_t messages = 100000, size = 64;
+    uint32_t batch = 1;
+    bool zero_copy = false;
+    double rate = 0;
+    TransportConfig config;
+    TransportType type;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "x:m:n:s:r:b:zi:t:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'x': transport_name = optarg; break;
+        case 'm': mode = optarg; break;
+        case 'n': messages = strtoul(optarg, NULL, 0); break;
+        case 's': size = strtoul(optarg, NULL, 0); break;
+        case 'r': rate = atof(optarg); break;
+        case 'b': batch = strtoul(optarg, NULL, 0); break;
+        case 'z': zero_copy = true; break;
+        case 'i': config.udp_iface = optarg; break;
+        case 't': uuid = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (transport_name == "shm")
+        type = TRANSPORT_SHM;
+    else if (transport_name == "udp")
+        type = TRANSPORT_UDP;
+    else
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (size < sizeof(int64_t) || messages == 0 || (mode != "both" && mode != "pub" && mode != "sub"))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    config.timeline = uuid;
+    config.topic = TOPIC_NAME;
+    config.node = APPLICATION_NAME;
+    config.roles = (mode == "both") ? (TRANSPORT_ROLE_PUB | TRANSPORT_ROLE_SUB)
+        : (mode == "pub") ? TRANSPORT_ROLE_PUB : TRANSPORT_ROLE_SUB;
+    std::unique_ptr<Transport> transport(CreateTransport(type, config));
+    if (!transport)
+    {
+        fprintf(stderr, "Failed to open the %s transport\n", transport_name.c_str());
+        return 1;
+    }
+    if (size > transport->MaxPayload())
+    {
+        fprintf(stderr, "Payloads of the %s transport are limited to %zu bytes\n", transport_name.c_str(),
+            transport->MaxPayload());
+        return 1;
+    }
+
+    // Subscriber: the latency of each message from the send time it carries
+    std::vector<int64_t> latency;
+    std::atomic<size_t> received(0);
+    latency.reserve(messages);
+    if (mode != "pub")
+    {
+        transport->Subscribe([&](const TransportHeader &, const void *payload, size_t length) {
+            int64_t sent;
+            if (length < sizeof(sent) || received.load(std::memory_order_relaxed) >= messages)
+                return;
+            memcpy(&sent, payload, sizeof(sent));
+            latency.push_back(realtime_ns() - sent);
+            received.fetch_add(1, std::memory_order_release);
+        });
+    }
+
+    // Publisher: paced or flat out, one message, batch or in-place write at a time
+    int64_t start = realtime_ns(), elapsed = 0;
+    if (mode != "sub")
+    {
+        TransportHeader header;
+        TransportBuffer buffer;
+        std::vector<char> payload(size, 0);
+        MessageBatcher batcher(*transport);
+        int64_t now;
+        memset(&header, 0, sizeof(header));
+        strncpy(header.name, APPLICATION_NAME, QOT_MAX_NAMELEN - 1);
+        header.type = QOT_MSG_DATA;
+        batcher.Configure(batch, 1000);
+        for (size_t i = 0; i < messages; i++)
+        {
+            if (rate > 0)
+            {
+                int64_t due = start + (int64_t) (i * 1e9 / rate);
+                while ((now = realtime_ns()) < due)
+                {
+                    if (due - now > 100000)
+                        std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - 50000));
+                    else
+                        std::this_thread::yield();
+                }
+            }
+            now = realtime_ns();
+            if (zero_copy)
+            {
+                if (transport->Reserve(size, buffer))
+                    break;
+                memcpy(buffer.data, &now, sizeof(now));
+                transport->Commit(header, buffer);
+            }
+            else
+            {
+                memcpy(payload.data(), &now, sizeof(now));
+                batcher.Publish(header, payload.data(), size);
+            }
+        }
+        batcher.Flush();
+        elapsed = realtime_ns() - start;
+    }
+
+    // Give the last messages a second to arrive (or wait for the publisher)
+    if (mode != "pub")
+    {
+        int64_t idle = realtime_ns();
+        size_t last = 0, now;
+        while ((now = received.load(std::memory_order_acquire)) < messages)
+        {
+            if (now != last)
+            {
+                last = now;
+                idle = realtime_ns();
+            }
+            else if (realtime_ns() - idle > 1000000000LL && (mode == "both" || now > 0))
+                break;
+            usleep(1000);
+        }
+        if (mode == "sub")
+            elapsed = realtime_ns() - start;
+    }
+
+    TransportStats stats;
+    transport->GetStats(stats);
+    size_t count = std::min(received.load(std::memory_order_acquire), messages);
+    transport.reset();
+
+    printf("%s, %zu byte payloads, %zu messages, batch %u%s\n", transport_name.c_str(), size, messages, batch,
+        zero_copy ? ", zero-copy" : "");
+    if (mode != "sub")
+        printf("published %llu in %.3f s: %.0f msg/s, %.1f MB/s, %llu errors\n", (unsigned long long) stats.sent,
+            elapsed / 1e9, stats.sent * 1e9 / elapsed, stats.sent * size * 1e3 / elapsed,
+            (unsigned long long) stats.errors);
+    if (mode != "pub")
+    {
+        printf("received %zu, lost %llu\n", count, (unsigned long long) stats.lost);
+        latency.resize(count);
+        printf("%-20s %8s %10s %10s %10s %10s %10s %10s\n", "ns", "samples",
+            "min", "avg", "p50", "p99", "p99.9", "max");
+        report("latency", latency);
+    }
+    if (type == TRANSPORT_SHM && mode == "both")
+        shm_unlink(ShmSegmentName(config.timeline, config.topic).c_str());
+    return 0;
+}
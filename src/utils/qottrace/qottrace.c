@@ -0,0 +1,205 @@
+/*
+ * @file qottrace.c
+ * @brief Decode a QoT binary trace into timeline-ordered text or JSON
+ * @author Sandeep D'souza
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Include the QoT trace format
+#include "../../api/c/qot_trace.h"
+
+typedef struct trace {
+    qot_trace_header_t header;
+    qot_trace_entry_t *entries;
+    size_t num_entries;
+    qot_trace_name_t *names;
+    size_t num_names;
+} trace_t;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-j] trace.bin\n", prog);
+}
+
+static int load(const char *path, trace_t *trace)
+{
+    qot_trace_block_t block;
+    size_t size;
+    void *mem;
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+    if (fread(&trace->header, sizeof(trace->header), 1, f) != 1
+        || trace->header.magic != QOT_TRACE_MAGIC
+        || trace->header.version != QOT_TRACE_VERSION
+        || trace->header.entry_size != sizeof(qot_trace_entry_t))
+    {
+        fprintf(stderr, "%s is not a version %d QoT trace\n", path, QOT_TRACE_VERSION);
+        fclose(f);
+        return -1;
+    }
+    while (fread(&block, sizeof(block), 1, f) == 1)
+    {
+        if (block.type == QOT_TRACE_BLOCK_NAMES)
+        {
+            size = (trace->num_names + block.count) * sizeof(qot_trace_name_t);
+            mem = realloc(trace->names, size);
+            if (!mem)
+                break;
+            trace->names = (qot_trace_name_t *) mem;
+            if (fread(trace->names + trace->num_names, sizeof(qot_trace_name_t), block.count, f) != block.count)
+                break;
+            trace->num_names += block.count;
+        }
+        else if (block.type == QOT_TRACE_BLOCK_ENTRIES)
+        {
+            size = (trace->num_entries + block.count) * sizeof(qot_trace_entry_t);
+            mem = realloc(trace->entries, size);
+            if (!mem)
+                break;
+            trace->entries = (qot_trace_entry_t *) mem;
+            if (fread(trace->entries + trace->num_entries, sizeof(qot_trace_entry_t), block.count, f) != block.count)
+                break;
+            trace->num_entries += block.count;
+        }
+        else if (block.type == QOT_TRACE_BLOCK_PARAMS)
+        {
+            // Entries are already projected, the parameters are for reference
+            if (fseek(f, (long) (block.count * sizeof(tl_translation_t)), SEEK_CUR))
+                break;
+        }
+        else
+        {
+            fprintf(stderr, "unknown block type %u, stopping\n", block.type);
+            break;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Timeline order; core order breaks ties, which keeps each thread in order */
+static int compare(const void *a, const void *b)
+{
+    const qot_trace_entry_t *x = (const qot_trace_entry_t *) a;
+    const qot_trace_entry_t *y = (const qot_trace_entry_t *) b;
+    if (x->tl_ns != y->tl_ns)
+        return x->tl_ns < y->tl_ns ? -1 : 1;
+    if (x->rec.core_ns != y->rec.core_ns)
+        return x->rec.core_ns < y->rec.core_ns ? -1 : 1;
+    return 0;
+}
+
+/* Latest name given to an id */
+static const char *name_of(trace_t *trace, uint32_t id)
+{
+    size_t i = trace->num_names;
+    while (i--)
+        if (trace->names[i].id == id)
+            return trace->names[i].name;
+    return NULL;
+}
+
+/* Write a string as the body of a JSON string literal */
+static void json_string(const char *s)
+{
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    trace_t trace;
+    const char *name;
+    char unnamed[16];
+    qot_trace_entry_t *e;
+    size_t i;
+    int opt, json = 0;
+
+    while ((opt = getopt(argc, argv, "jh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': json = 1; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&trace, 0, sizeof(trace));
+    if (load(argv[optind], &trace))
+        return 1;
+    qsort(trace.entries, trace.num_entries, sizeof(qot_trace_entry_t), compare);
+
+    for (i = 0; i < trace.num_entries; i++)
+    {
+        e = &trace.entries[i];
+        name = name_of(&trace, e->rec.id);
+        if (!name)
+        {
+            snprintf(unnamed, sizeof(unnamed), "%u", e->rec.id);
+            name = unnamed;
+        }
+        if (json)
+        {
+            printf("{\"timeline\":\"");
+            json_string(trace.header.timeline);
+            printf("\",\"t\":%" PRId64 ",\"below\":%u,\"above\":%u,\"core\":%" PRId64
+                ",\"tid\":%u,\"event\":\"", e->tl_ns, e->below_ns, e->above_ns, e->rec.core_ns,
+                e->rec.tid);
+            json_string(name);
+            printf("\",\"args\":[%" PRIu64 ",%" PRIu64 "]}\n", e->rec.arg[0], e->rec.arg[1]);
+        }
+        else
+            printf("%" PRId64 ".%09" PRId64 " -%u +%u [%u] %s %" PRIu64 " %" PRIu64 "\n",
+                (int64_t) (e->tl_ns / 1000000000LL), (int64_t) (e->tl_ns % 1000000000LL), e->below_ns, e->above_ns,
+                e->rec.tid, name, e->rec.arg[0], e->rec.arg[1]);
+    }
+
+    free(trace.entries);
+    free(trace.names);
+    return 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * @file rtjitter.c
+ * @brief Periodic wakeup jitter of the QoT API, optionally under the real-time profile and stress
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Include the QoT API
+#include "../../api/c/qot.h"
+
+// Basic configuration
+#define TIMELINE_UUID    "my_test_timeline"
+#define APPLICATION_NAME "rtjitter"
+
+/* Benchmark options */
+typedef struct rtjitter_opts {
+    const char *uuid;                     /* Timeline to bind to                      */
+    u64 period_ns;                        /* Control loop period                      */
+    int iterations;                       /* Periods measured                         */
+    int stressors;                        /* Stress threads                           */
+    int rt_profile;                       /* Enable the QoT real-time profile         */
+    int lock_memory;                      /* mlockall under the real-time profile     */
+    int priority;                         /* SCHED_FIFO priority (0 keeps the policy) */
+} rtjitter_opts_t;
+
+static volatile int running = 1;
+
+static s64 monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (s64) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Allocation, stdio and scheduler churn which competes with the control loop */
+static void *stress_thread(void *arg)
+{
+    FILE *sink = fopen("/dev/null", "w");
+    size_t size = 4096;
+    char *buf;
+    (void) arg;
+    while (running)
+    {
+        buf = (char *) malloc(size);
+        if (buf)
+        {
+            memset(buf, 0xa5, size);
+            if (sink)
+                fprintf(sink, "%p %zu\n", (void *) buf, size);
+            free(buf);
+        }
+        size = (size * 3) % (1 << 20) + 4096;
+        sched_yield();
+    }
+    if (sink)
+        fclose(sink);
+    return NULL;
+}
+
+/* Move the library log out of the control loop */
+static void *drain_thread(void *arg)
+{
+    (void) arg;
+    while (running)
+    {
+        qot_rt_log_drain(STDERR_FILENO);
+        usleep(100000);
+    }
+    qot_rt_log_drain(STDERR_FILENO);
+    return NULL;
+}
+
+static int cmp_s64(const void *a, const void *b)
+{
+    s64 x = *(const s64 *) a, y = *(const s64 *) b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, s64 *samples, int count)
+{
+    s64 sum = 0;
+    int i;
+    if (count <= 0)
+        return;
+    qsort(samples, count, sizeof(s64), cmp_s64);
+    for (i = 0; i < count; i++)
+        sum += samples[i];
+    printf("%-20s %8d %10lld %10lld %10lld %10lld %10lld %10lld\n", name, count,
+        (long long) samples[0], (long long) (sum / count),
+        (long long) samples[count / 2], (long long) samples[(count * 99) / 100],
+        (long long) samples[(count * 999) / 1000], (long long) samples[count - 1]);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t uuid] [-p period_us] [-n iterations] [-s stressors] "
+        "[-r] [-L] [-f fifo_priority]\n", prog);
+    fprintf(stderr, "  -r  enable the QoT real-time profile\n");
+    fprintf(stderr, "  -L  do not lock memory under the real-time profile\n");
+}
+
+int main(int argc, char **argv)
+{
+    rtjitter_opts_t opts = { TIMELINE_UUID, 1000000, 10000, 0, 0, 1, 0 };
+    qot_rt_config_t config;
+    struct sched_param param;
+    timeline_t *timeline;
+    timelength_t resolution, period;
+    timeinterval_t accuracy;
+    timepoint_t start;
+    utimepoint_t now;
+    pthread_t *stress = NULL;
+    pthread_t drain;
+    s64 *lateness, *readout, t0, phase;
+    int i, opt, done, missed = 0;
+
+    while ((opt = getopt(argc, argv, "t:p:n:s:rLf:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': opts.uuid = optarg; break;
+        case 'p': opts.period_ns = strtoull(optarg, NULL, 10) * 1000ULL; break;
+        case 'n': opts.iterations = atoi(optarg); break;
+        case 's': opts.stressors = atoi(optarg); break;
+        case 'r': opts.rt_profile = 1; break;
+        case 'L': opts.lock_memory = 0; break;
+        case 'f': opts.priority = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (opts.period_ns == 0 || opts.iterations <= 0 || opts.stressors < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Sample buffers are allocated (and touched) before the profile locks memory
+    lateness = (s64 *) calloc(opts.iterations, sizeof(s64));
+    readout = (s64 *) calloc(opts.iterations, sizeof(s64));
+    if (!lateness || !readout)
+        return 1;
+
+    if (opts.priority > 0)
+    {
+        param.sched_priority = opts.priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+            fprintf(stderr, "SCHED_FIFO not available (%s), using the default policy\n", strerror(errno));
+    }
+    if (opts.rt_profile)
+    {
+        memset(&config, 0, sizeof(config));
+        config.lock_memory = opts.lock_memory;
+        config.heap_reserve = 4 << 20;
+        if (qot_rt_profile_enable(&config))
+        {
+            fprintf(stderr, "Unable to enable the real-time profile (try -L)\n");
+            return 1;
+        }
+        pthread_create(&drain, NULL, drain_thread, NULL);
+    }
+
+    TL_FROM_nSEC(resolution, 1);
+    TL_FROM_uSEC(accuracy.below, 1);
+    TL_FROM_uSEC(accuracy.above, 1);
+    TL_FROM_nSEC(period, opts.period_ns);
+
+    timeline = timeline_t_create();
+    if (!timeline)
+    {
+        fprintf(stderr, "Unable to create the timeline_t data structure\n");
+        return 1;
+    }
+    if (timeline_bind(timeline, opts.uuid, APPLICATION_NAME, resolution, accuracy))
+    {
+        fprintf(stderr, "Failed to bind to timeline %s\n", opts.uuid);
+        timeline_t_destroy(timeline);
+        return 1;
+    }
+    if (timeline_gettime(timeline, &now) || timeline_set_schedparams(timeline, &period, &now.estimate))
+    {
+        fprintf(stderr, "Failed to set the period of timeline %s\n", opts.uuid);
+        timeline_unbind(timeline);
+        timeline_t_destroy(timeline);
+        return 1;
+    }
+    start = now.estimate;
+
+    if (opts.stressors)
+    {
+        stress = (pthread_t *) calloc(opts.stressors, sizeof(pthread_t));
+        for (i = 0; i < opts.stressors; i++)
+            pthread_create(&stress[i], NULL, stress_thread, NULL);
+    }
+
+    // Control loop: wake on the period grid, then read the timeline once
+    for (i = 0; i < opts.iterations; i++)
+    {
+        if (timeline_waituntil_nextperiod(timeline, &now))
+        {
+            fprintf(stderr, "Periodic wait failed at iteration %d\n", i);
+            break;
+        }
+        phase = (TP_TO_nSEC(now.estimate) - TP_TO_nSEC(start)) % (s64) opts.period_ns;
+        lateness[i] = phase;
+        if (phase > (s64) opts.period_ns / 2)
+            missed++;
+        t0 = monotonic_ns();
+        timeline_gettime(timeline, &now);
+        readout[i] = monotonic_ns() - t0;
+    }
+    done = i;
+
+    running = 0;
+    for (i = 0; i < opts.stressors; i++)
+        pthread_join(stress[i], NULL);
+    if (opts.rt_profile)
+        pthread_join(drain, NULL);
+
+    printf("period %llu ns, %d stressors, real-time profile %s\n",
+        (unsigned long long) opts.period_ns, opts.stressors, opts.rt_profile ? "on" : "off");
+    printf("%-20s %8s %10s %10s %10s %10s %10s %10s\n", "ns", "samples",
+        "min", "avg", "p50", "p99", "p99.9", "max");
+    report("wakeup lateness", lateness, done);
+    report("gettime latency", readout, done);
+    printf("late by over half a period: %d, log messages dropped: %llu\n",
+        missed, (unsigned long long) qot_rt_log_dropped());
+
+    timeline_unbind(timeline);
+    timeline_t_destroy(timeline);
+    free(stress);
+    free(lateness);
+    free(readout);
+    return 0;
+}
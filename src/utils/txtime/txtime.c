@@ -0,0 +1,264 @@
+/*
+ * @file txtime.c
+ * @brief Send UDP bursts at timeline times through SO_TXTIME and measure their arrival
+ * @author Sandeep D'souza
+ *
+ *
+ * Copyright (c) Carnegie Mellon University 2018.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Software ETF on a veth pair, with the receiver in its own namespace:
+ *
+ *   ip netns add rx
+ *   ip link add veth0 type veth peer name veth1 netns rx
+ *   ip addr add 10.9.0.1/24 dev veth0 && ip link set veth0 up
+ *   ip -n rx addr add 10.9.0.2/24 dev veth1 && ip -n rx link set veth1 up
+ *   tc qdisc replace dev veth0 root etf clockid CLOCK_TAI delta 200000
+ *
+ *   ip netns exec rx txtime -r -p 7788 &
+ *   txtime -d 10.9.0.2 -p 7788 -n 8 -s 50
+ *
+ * The receiver prints the arrival of each packet relative to its launch
+ * time, in timeline time; with a plain qdisc the launch time is ignored.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/net_tstamp.h>
+
+// Include the QoT API
+#include "../../api/c/qot.h"
+#include "../../api/c/qot_net.h"
+
+// Basic configuration
+#define TIMELINE_UUID    "my_test_timeline"
+#define APPLICATION_NAME "txtime"
+#define MAX_BURST        QOT_NET_MAX_BATCH
+
+static volatile sig_atomic_t running = 1;
+
+static void exit_handler(int s)
+{
+    (void) s;
+    running = 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t uuid] -d dest [-p port] [-n burst] [-s spacing_us]"
+        " [-P period_ms] [-l lead_us] [-c count]\n", prog);
+    fprintf(stderr, "       %s [-t uuid] -r [-p port]\n", prog);
+}
+
+/* Print the arrival of each packet relative to the launch time it carries */
+static int receive(timeline_t *timeline, int port)
+{
+    struct sockaddr_in addr;
+    char buf[64], control[256];
+    struct iovec iov = { buf, sizeof(buf) };
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    stimepoint_t arrival;
+    long long launch;
+    int one = 1;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+        return 1;
+    setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(sock);
+        return 1;
+    }
+    printf("launch(ns)\tlateness(ns)\tbelow(ns)\tabove(ns)\n");
+    while (running) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &msg, 0) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        memset(&arrival, 0, sizeof(arrival));
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS)
+                timepoint_from_timespec(&arrival.estimate, (struct timespec *) CMSG_DATA(cm));
+        if (timeline_core2rem(timeline, &arrival) || sscanf(buf, "%lld", &launch) != 1)
+            continue;
+        printf("%lld\t%lld\t%lld\t%lld\n", launch, (long long) TP_TO_nSEC(arrival.estimate) - launch,
+            (long long) (TP_TO_nSEC(arrival.estimate) - TP_TO_nSEC(arrival.l_estimate)),
+            (long long) (TP_TO_nSEC(arrival.u_estimate) - TP_TO_nSEC(arrival.estimate)));
+        fflush(stdout);
+    }
+    close(sock);
+    return 0;
+}
+
+/* Send a burst every period, scheduled a lead time ahead of its launch */
+static int transmit(timeline_t *timeline, const char *dest, int port, int burst,
+    int spacing_us, int period_ms, int lead_us, int count)
+{
+    struct sockaddr_in addr;
+    qot_txtime_config_t config;
+    struct mmsghdr msgs[MAX_BURST];
+    struct iovec iov[MAX_BURST];
+    char payload[MAX_BURST][32];
+    timepoint_t launch[MAX_BURST];
+    utimepoint_t achieved[MAX_BURST], wake;
+    timelength_t period, lead, spacing;
+    timepoint_t next;
+    int i, sent, sock;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+        return 1;
+    memset(&config, 0, sizeof(config));
+    config.clockid = CLOCK_TAI;
+    config.flags = SOF_TXTIME_REPORT_ERRORS;
+    TL_FROM_uSEC(config.launch_error.below, 5);
+    TL_FROM_uSEC(config.launch_error.above, 5);
+    if (qot_txtime_enable(sock, &config)) {
+        perror("SO_TXTIME");
+        close(sock);
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, dest, &addr.sin_addr) != 1) {
+        fprintf(stderr, "bad destination %s\n", dest);
+        close(sock);
+        return 1;
+    }
+
+    TL_FROM_mSEC(period, period_ms);
+    TL_FROM_uSEC(lead, lead_us);
+    TL_FROM_uSEC(spacing, spacing_us);
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < burst; i++) {
+        iov[i].iov_base = payload[i];
+        msgs[i].msg_hdr.msg_name = &addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // Bursts start on whole seconds of the timeline, then every period
+    if (timeline_gettime(timeline, &wake)) {
+        close(sock);
+        return 1;
+    }
+    next.sec = wake.estimate.sec + 1;
+    next.asec = 0;
+    printf("launch(ns)\tbelow(ns)\tabove(ns)\n");
+    while (running && count--) {
+        memset(&wake, 0, sizeof(wake));
+        wake.estimate = next;
+        timepoint_sub(&wake.estimate, &lead);
+        timeline_waituntil(timeline, &wake);
+        for (i = 0; i < burst; i++) {
+            launch[i] = i ? launch[i - 1] : next;
+            if (i)
+                timepoint_add(&launch[i], &spacing);
+            iov[i].iov_len = snprintf(payload[i], sizeof(payload[i]), "%lld",
+                (long long) TP_TO_nSEC(launch[i])) + 1;
+        }
+        sent = timeline_sendmmsg_at(timeline, sock, &config, msgs, launch, achieved, burst, 0);
+        if (sent < 0)
+            perror("sendmmsg");
+        for (i = 0; i < sent; i++)
+            printf("%lld\t%llu\t%llu\n", (long long) TP_TO_nSEC(achieved[i].estimate),
+                (unsigned long long) TL_TO_nSEC(achieved[i].interval.below),
+                (unsigned long long) TL_TO_nSEC(achieved[i].interval.above));
+        timepoint_add(&next, &period);
+    }
+    close(sock);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    timeline_t *timeline;
+    timelength_t resolution;
+    timeinterval_t accuracy;
+    const char *u = TIMELINE_UUID, *dest = NULL;
+    int opt, rx = 0, port = 7788, burst = 8, spacing_us = 50;
+    int period_ms = 100, lead_us = 2000, count = 100, ret;
+
+    while ((opt = getopt(argc, argv, "t:d:p:n:s:P:l:c:rh")) != -1) {
+        switch (opt) {
+        case 't': u = optarg; break;
+        case 'd': dest = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'n': burst = atoi(optarg); break;
+        case 's': spacing_us = atoi(optarg); break;
+        case 'P': period_ms = atoi(optarg); break;
+        case 'l': lead_us = atoi(optarg); break;
+        case 'c': count = atoi(optarg); break;
+        case 'r': rx = 1; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if ((!rx && !dest) || burst < 1 || burst > MAX_BURST || period_ms < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TL_FROM_nSEC(resolution, 1);
+    TL_FROM_uSEC(accuracy.below, 1);
+    TL_FROM_uSEC(accuracy.above, 1);
+    timeline = timeline_t_create();
+    if (!timeline || timeline_bind(timeline, u, APPLICATION_NAME, resolution, accuracy)) {
+        fprintf(stderr, "Failed to bind to timeline %s\n", u);
+        timeline_t_destroy(timeline);
+        return 1;
+    }
+    signal(SIGINT, exit_handler);
+
+    if (rx)
+        ret = receive(timeline, port);
+    else
+        ret = transmit(timeline, dest, port, burst, spacing_us, period_ms, lead_us, count);
+
+    timeline_unbind(timeline);
+    timeline_t_destroy(timeline);
+    return ret;
+}
@@ -1,8 +1,14 @@
 /* 
- * udpserver.c - A simple UDP echo server 
- * usage: udpserver <port>
+ * udpserver-qot.c - A UDP echo server which stamps packets with timeline time
+ * usage: udpserver-qot <port> <iface> <multicast_recvflag> ...
+ *
+ * Datagrams are received in bursts of up to BURST with recvmmsg, and the
+ * hardware (or software) timestamps of a burst are projected onto the
+ * timeline with one batched conversion (see qot_net.h).
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -22,14 +28,14 @@
 
 // Include the QoT API
 #include "../../api/c/qot.h"
+#include "../../api/c/qot_net.h"
 
 // Basic onfiguration
 #define TIMELINE_UUID    "my_test_timeline"
 #define APPLICATION_NAME "udpserver"
 
 #define BUFSIZE 1024
-
-int swts_flag = 0;
+#define BURST   64
 
 /*
  * error - wrapper for perror
@@ -48,110 +54,19 @@ static void exit_handler(int s)
   running = 0;
 }
 
-/**
- * Try to enable kernel timestamping, otherwise fall back to software.
- *
- * Run setsockopt SO_TIMESTAMPING with SOFTWARE on socket 'sock'. 
- * 
- * \param[in] sock  The socket to activate SO_TIMESTAMPING on (the UDP)
- * \warning         Requires CONFIG_NETWORK_PHY_TIMESTAMPING Linux option
- * \warning         Requires drivers fixed with skb_tx_timestamp() 
- */
-void tstamp_mode_kernel(int sock) {
-  int f = 0; /* flags to setsockopt for socket request */
-  socklen_t slen;
-  
-  slen = (socklen_t)sizeof f;
-  f |= SOF_TIMESTAMPING_RX_SOFTWARE;
-  f |= SOF_TIMESTAMPING_SOFTWARE;
-  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &f, slen) < 0) {
-    printf("SO_TIMESTAMPING not possible\n");
-    return;
-  }
-  printf("Using kernel timestamps\n");
-}
-
-/**
- * Try to enable hardware timestamping, otherwise fall back to kernel.
- *
- * Run ioctl() on 'iface' (supports Intel 82580 right now) and run
- * setsockopt SO_TIMESTAMPING with RAW_HARDWARE on socket 'sock'. 
- * 
- * \param[in] sock  The socket to activate SO_TIMESTAMPING on (the UDP)
- * \param[in] iface The interface name to ioctl SIOCSHWTSTAMP on
- * \warning         Requires CONFIG_NETWORK_PHY_TIMESTAMPING Linux option
- * \warning         Supports only Intel 82580 right now
- * \bug             Intel 82580 has bugs such as IPv4 only, and RX issues
- */
-void tstamp_mode_hardware(int sock, char *iface) {
-  struct ifreq dev; /* request to ioctl */
-  struct hwtstamp_config hwcfg, req; /* hw tstamp cfg to ioctl req */
-  int f = 0; /* flags to setsockopt for socket request */
-  socklen_t slen;
-  
-  slen = (socklen_t)sizeof f;
-  /* STEP 1: ENABLE HW TIMESTAMP ON IFACE IN IOCTL */
-  memset(&dev, 0, sizeof dev);
-  /*@ -mayaliasunique Trust me, iface and dev doesn't share storage */
-  strncpy(dev.ifr_name, iface, sizeof dev.ifr_name);
-  /*@ +mayaliasunique */
-  /*@ -immediatetrans Yes, we might overwrite ifr_data */
-  dev.ifr_data = (void *)&hwcfg;
-  memset(&hwcfg, 0, sizeof hwcfg); 
-  /*@ +immediatetrans */
-  /* enable tx hw tstamp, ptp style, intel 82580 limit */
-  hwcfg.tx_type = HWTSTAMP_TX_ON; 
-  /* enable rx hw tstamp, all packets, yey! */
-  hwcfg.rx_filter = HWTSTAMP_FILTER_ALL;
-  req = hwcfg;
-    /* Check that one is root */
-  if (getuid() != 0)
-    printf("Hardware timestamps requires root privileges\n");
-  /* apply by sending to ioctl */
-  if (ioctl(sock, SIOCSHWTSTAMP, &dev) < 0) {
-    printf("ioctl: SIOCSHWTSTAMP: error\n");
-    printf("Verify that %s supports hardware timestamp\n",iface);
-    /* otherwise, try kernel timestamps (socket only) */ 
-    printf("Falling back to kernel timestamps\n");
-    tstamp_mode_kernel(sock);
-    swts_flag = 1;
-    return;
-  }
-
-  if (memcmp(&hwcfg, &req, sizeof(hwcfg))) {
-    printf("driver changed our HWTSTAMP options\n");
-    printf("tx_type   %d not %d\n", hwcfg.tx_type, req.tx_type);
-    printf("rx_filter %d not %d\n", hwcfg.rx_filter, req.rx_filter);
-    return;
-  }
-  /* STEP 2: ENABLE NANOSEC TIMESTAMPING ON SOCKET */
-  f |= SOF_TIMESTAMPING_TX_SOFTWARE;
-  f |= SOF_TIMESTAMPING_TX_HARDWARE;
-  f |= SOF_TIMESTAMPING_RX_SOFTWARE;
-  f |= SOF_TIMESTAMPING_RX_HARDWARE;
-  f |= SOF_TIMESTAMPING_RAW_HARDWARE;
-  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &f, slen) < 0) {
-    /* bail to userland timestamps (socket only) */ 
-    printf("SO_TIMESTAMPING: error\n");
-    return;
-  }
-  printf("Using hardware timestamps\n");
-}
-
-
-
 int main(int argc, char **argv) {
   int sockfd; /* socket */
   int portno; /* port to listen on */
   int clientlen; /* byte size of client's address */
   struct sockaddr_in serveraddr; /* server's addr */
   struct sockaddr_in clientaddr; /* client addr */
-  struct hostent *hostp; /* client host info */
-  char buf[BUFSIZE]; /* message buf */
-  char *hostaddrp; /* dotted decimal host addr string */
+  struct sockaddr_in clientaddrs[BURST]; /* client addr of each datagram */
+  static char bufs[BURST][BUFSIZE]; /* message bufs */
+  struct mmsghdr msgs[BURST]; /* burst of messages */
+  struct iovec iovs[BURST]; /* one buffer per message */
+  utimepoint_t arrival[BURST]; /* timeline arrival time of each message */
   int optval; /* flag value for setsockopt */
-  int n; /* message byte size */
-  char cmsgbuf[BUFSIZE]; /* ancillary info buf */
+  int i, n; /* message count */
   char *iface; /* hadrware interface to receive packets on */
   int multicast_recvflag = 0; /* multicast receive flag */
   char* multicast_recvaddr; /* multicast receive address */
@@ -164,12 +79,6 @@ int main(int argc, char **argv) {
 
   // Timeline-related Variable declaration
   timeline_t *my_timeline;
-  qot_return_t retval;
-  utimepoint_t nowtl;
-  stimepoint_t tl_stp;
-  tl_translation_t params;
-  char qot_timeline_filename[15];
-  int timeline_fd;
 
 
   // Timeline Name
@@ -221,7 +130,7 @@ int main(int argc, char **argv) {
       printf("Unable to open file, terminating ...\n");
       exit(1);
     }
-    fprintf(ts_fd, "Message,SW-Timestamp(s),SW-Timestamp(ns),TL-Timestamp(s),TL Timestamp(ns),BelowQoT(s),BelowQoT(ns),AboveQoT(s),AboveQoT(ns)\n");
+    fprintf(ts_fd, "Message,TL-Timestamp(s),TL-Timestamp(ns),BelowQoT(ns),AboveQoT(ns)\n");
   }
 
   /* Check if the timestamp needs to have an offset */
@@ -268,8 +177,11 @@ int main(int argc, char **argv) {
   setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, 
 	     (const void *)&optval , sizeof(int));
 	
-  /* Configure timestamping */
-  tstamp_mode_hardware(sockfd, iface);
+  /* Configure timestamping: hardware on the interface if it supports it */
+  if (getuid() != 0)
+    printf("Hardware timestamps requires root privileges\n");
+  if (qot_rxtime_enable(sockfd, iface))
+    error("ERROR enabling SO_TIMESTAMPING");
 
   /*
    * build the server's Internet address
@@ -298,96 +210,61 @@ int main(int argc, char **argv) {
      }
   }
   
-  /* Setp message header */
+  /* Setup message headers, one per datagram of a burst */
   clientlen = sizeof(clientaddr);
-  struct msghdr msg;
-  struct iovec iov[1];
-  iov[0].iov_base=buf;
-  iov[0].iov_len=sizeof(buf);
-
-  msg.msg_name=&clientaddr;
-  msg.msg_namelen=sizeof(clientaddr);
-  msg.msg_iov=iov;
-  msg.msg_iovlen=1;
-  msg.msg_control=(caddr_t)cmsgbuf;
-  msg.msg_controllen=sizeof(cmsgbuf);
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < BURST; i++) {
+    iovs[i].iov_base = bufs[i];
+    iovs[i].iov_len = BUFSIZE - 1;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
   /* 
-   * main loop: wait for a datagram, then echo it
+   * main loop: wait for a burst of datagrams, then echo them
    */
   while (running) {
-
-    /*
-     * recvfrom: receive a UDP datagram from a client
-     */
-    bzero(buf, BUFSIZE);
-    bzero(cmsgbuf, BUFSIZE);
-    n = recvmsg(sockfd, &msg, 0);
-    if (n < 0)
-      printf("ERROR in recvmsg %d\n", n);
-    else
-      printf("received packet\n");
-
-    /* 
-     * gethostbyaddr: determine who sent the datagram
-     */
-    printf("server received %d/%d bytes: %s\n", strlen(buf), n, buf);
-    
-    /* Get Packet Timestamp */
-    int level, type;
-    struct cmsghdr *cm;
-    struct timespec *ts = NULL;
-    for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
-    {
-        level = cm->cmsg_level;
-        type  = cm->cmsg_type;
-        if (SOL_SOCKET == level && SO_TIMESTAMPING == type) {
-           ts = (struct timespec *) CMSG_DATA(cm);
-           struct timespec now, nowreal;
-           clock_gettime(CLOCK_MONOTONIC, &now);
-           clock_gettime(CLOCK_REALTIME, &nowreal);
-           timeline_gettime(my_timeline, &nowtl);
-           printf("HW TIMESTAMP        %ld.%09ld\n", (long)ts[2].tv_sec + (offset/1000000000), (long)ts[2].tv_nsec + (offset%1000000000));
-           printf("HWX TIMESTAMP       %ld.%09ld\n", (long)ts[1].tv_sec + (offset/1000000000), (long)ts[1].tv_nsec + (offset%1000000000));
-           printf("SW TIMESTAMP        %ld.%09ld\n", (long)ts[0].tv_sec + (offset/1000000000), (long)ts[0].tv_nsec + (offset%1000000000));
-           printf("CLOCK_MONOTONIC     %ld.%09ld\n", (long)now.tv_sec, (long)now.tv_nsec);
-           printf("CLOCK_REALTIME      %ld.%09ld\n", (long)nowreal.tv_sec, (long)nowreal.tv_nsec);
-           printf("TIMELINE_TIME       %lld.%18llu\n", nowtl.estimate.sec, nowtl.estimate.asec);
-           printf("Uncertainity below  %llu.%18llu\n", nowtl.interval.below.sec, nowtl.interval.below.asec);
-           printf("Uncertainity above  %llu.%18llu\n", nowtl.interval.above.sec, nowtl.interval.above.asec);
-           if(swts_flag)
-           {
-             tl_stp.estimate.sec = (int64_t)ts[0].tv_sec;
-             tl_stp.estimate.asec = ((uint64_t)ts[0].tv_nsec)*nSEC_PER_SEC;
-           }
-           else
-           {
-             tl_stp.estimate.sec = (int64_t)ts[2].tv_sec;
-             tl_stp.estimate.asec = ((uint64_t)ts[2].tv_nsec)*nSEC_PER_SEC;
-           }
-           timeline_core2rem(my_timeline, &tl_stp);
-        }
+    for (i = 0; i < BURST; i++) {
+      msgs[i].msg_hdr.msg_name = &clientaddrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(clientaddrs[i]);
     }
-    
-    if(multicast_recvflag == 0)
-    {
+    n = timeline_recvmmsg(my_timeline, sockfd, msgs, arrival, BURST, MSG_WAITFORONE, NULL);
+    if (n < 0) {
+      printf("ERROR in recvmmsg %d\n", n);
+      continue;
+    }
+
+    for (i = 0; i < n; i++) {
+      bufs[i][msgs[i].msg_len] = '\0';
+      if (!filewrite_flag) {
+        printf("server received %u bytes: %s\n", msgs[i].msg_len, bufs[i]);
+        printf("TIMELINE_TIME       %lld.%018llu\n", arrival[i].estimate.sec, arrival[i].estimate.asec);
+        printf("Uncertainity below  %llu.%018llu\n", arrival[i].interval.below.sec, arrival[i].interval.below.asec);
+        printf("Uncertainity above  %llu.%018llu\n", arrival[i].interval.above.sec, arrival[i].interval.above.asec);
+      }
+
+      if(multicast_recvflag == 0)
+      {
         /* 
          * sendto: echo the input back to the client 
          */
-        n = sendto(sockfd, buf, strlen(buf), 0, 
-             (struct sockaddr *) &clientaddr, clientlen);
-        if (n < 0) 
+        if (sendto(sockfd, bufs[i], msgs[i].msg_len, 0, 
+             (struct sockaddr *) &clientaddrs[i], clientlen) < 0)
           error("ERROR in sendto");
+      }
+
+      if(filewrite_flag)
+      {
+        /* Write message and timestamps to file*/
+        int64_t tl_ns = (int64_t) TP_TO_nSEC(arrival[i].estimate) + offset;
+        fprintf(ts_fd, "%s,%lld,%09lld,%llu,%llu\n", bufs[i],
+          (long long) (tl_ns / 1000000000), (long long) (tl_ns % 1000000000),
+          (unsigned long long) TL_TO_nSEC(arrival[i].interval.below),
+          (unsigned long long) TL_TO_nSEC(arrival[i].interval.above));
+      }
     }
-
-    if(filewrite_flag && ts !=NULL)
-    {
-      /* Write message and timestamps to file*/
-      if(swts_flag)
-        fprintf(ts_fd, "%s,%ld,%09ld,%lld,%llu,%llu,%llu,%llu,%llu\n", buf, (long)ts[0].tv_sec + (offset/1000000000), (long)ts[0].tv_nsec + (offset%1000000000), tl_stp.estimate.sec, tl_stp.estimate.asec, nowtl.interval.below.sec, nowtl.interval.above.asec, nowtl.interval.below.sec, nowtl.interval.above.asec);
-      else
-        fprintf(ts_fd, "%s,%ld,%09ld,%lld,%llu,%llu,%llu,%llu,%llu\n", buf, (long)ts[2].tv_sec + (offset/1000000000), (long)ts[2].tv_nsec + (offset%1000000000), tl_stp.estimate.sec, tl_stp.estimate.asec, nowtl.interval.below.sec, nowtl.interval.above.asec, nowtl.interval.below.sec, nowtl.interval.above.asec);
+    if(filewrite_flag)
       fflush(ts_fd);
-    }
   }
 
   /* Close Timestamp file */